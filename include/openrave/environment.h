@@ -182,6 +182,83 @@ public:
     ///
     /// See \ref arch_simulation for more about the simulation thread.
     virtual uint64_t GetSimulationTime() = 0;
+
+    /// \brief Sets the number of threads \ref StepSimulation uses to step the sensors. <b>[multi-thread safe]</b>
+    ///
+    /// The physics, bodies (and their controllers) and modules are always stepped in the calling thread.
+    /// Afterwards, the sensors whose \ref SensorBase::IsSimulationStepThreadSafe returns true are distributed to a pool of worker threads.
+    /// StepSimulation waits for all of them to finish and then steps the remaining sensors in the calling thread, so every sensor reflects the bodies of the current step when it returns.
+    /// \param numthreads number of threads including the calling thread. If <= 1, all sensors are stepped in the calling thread (default).
+    virtual void SetSimulationStepThreads(int numthreads) = 0;
+
+    /// \brief Returns the number of threads set with \ref SetSimulationStepThreads. <b>[multi-thread safe]</b>
+    virtual int GetSimulationStepThreads() const = 0;
+
+    /// \brief Time in microseconds spent in each stage of a \ref StepSimulation call
+    class SimulationStepTimes
+    {
+public:
+        SimulationStepTimes() : physics(0), bodies(0), modules(0), parallelsensors(0), sensors(0), total(0) {
+        }
+        uint64_t physics; ///< physics engine step
+        uint64_t bodies; ///< bodies and their controllers
+        uint64_t modules;
+        uint64_t parallelsensors; ///< sensors stepped by the worker threads, including the wait for the slowest one
+        uint64_t sensors; ///< sensors stepped in the calling thread
+        uint64_t total;
+    };
+
+    /// \brief Returns the timing of the last \ref StepSimulation call for profiling. <b>[multi-thread safe]</b>
+    virtual SimulationStepTimes GetSimulationStepTimes() const = 0;
+
+    /// \brief What the fixed-rate scheduler does when a step finishes after the deadline of the next step
+    enum CatchUpPolicy
+    {
+        CUP_Skip = 0, ///< skip the missed deadlines and continue with the next one in phase, simulation time falls behind real time
+        CUP_Burst = 1, ///< run the missed steps back to back without sleeping. If more than SimulationSchedulerParameters::maxcatchupsteps are missed, the remaining ones are skipped.
+    };
+
+    /// \brief Parameters of the scheduler of the simulation thread, see \ref SetSimulationScheduler
+    class SimulationSchedulerParameters
+    {
+public:
+        SimulationSchedulerParameters() : bFixedRate(false), fRealTimeFactor(1), catchuppolicy(CUP_Skip), maxcatchupsteps(10), histogrambinsize(50), numhistogrambins(40) {
+        }
+        bool bFixedRate; ///< if true, each step sleeps until an absolute deadline on a monotonic clock instead of the default heuristic sleep. Only used when the simulation runs in real time.
+        dReal fRealTimeFactor; ///< simulated time per real time, for example 2 simulates twice as fast as real time
+        CatchUpPolicy catchuppolicy;
+        int maxcatchupsteps; ///< maximum number of missed steps to run back to back with CUP_Burst
+        uint64_t histogrambinsize; ///< width of the bins of the step duration histogram in microseconds
+        int numhistogrambins; ///< number of bins of the step duration histogram, the last bin also counts all longer steps
+    };
+
+    /// \brief Timing telemetry of the fixed-rate scheduler, all times in microseconds
+    class SimulationSchedulerStatistics
+    {
+public:
+        SimulationSchedulerStatistics() : numsteps(0), numoverruns(0), numskippedsteps(0), totalsteptime(0), maxsteptime(0), totaljitter(0), maxjitter(0), histogrambinsize(0) {
+        }
+        uint64_t numsteps; ///< number of steps taken by the fixed-rate scheduler
+        uint64_t numoverruns; ///< number of steps that finished after the deadline of the next step
+        uint64_t numskippedsteps; ///< number of deadlines skipped because of overruns
+        uint64_t totalsteptime, maxsteptime; ///< duration of the steps
+        uint64_t totaljitter, maxjitter; ///< difference between the deadline and the time the step actually started
+        std::vector<uint64_t> vsteptimehistogram; ///< vsteptimehistogram[i] is the number of steps that took [i*histogrambinsize, (i+1)*histogrambinsize) microseconds
+        uint64_t histogrambinsize;
+    };
+
+    /// \brief Sets the scheduler used by the simulation thread started with \ref StartSimulation. <b>[multi-thread safe]</b>
+    ///
+    /// Resets the statistics returned by \ref GetSimulationSchedulerStatistics.
+    virtual void SetSimulationScheduler(const SimulationSchedulerParameters& parameters) = 0;
+
+    /// \brief Returns the parameters set with \ref SetSimulationScheduler. <b>[multi-thread safe]</b>
+    virtual SimulationSchedulerParameters GetSimulationScheduler() const = 0;
+
+    /// \brief Returns the timing telemetry of the fixed-rate scheduler since it was set or last reset. <b>[multi-thread safe]</b>
+    ///
+    /// \param bReset if true, resets the statistics after returning them
+    virtual SimulationSchedulerStatistics GetSimulationSchedulerStatistics(bool bReset=false) = 0;
     //@}
 
     /// \name File Loading and Parsing
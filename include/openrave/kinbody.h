@@ -1279,6 +1279,8 @@ private:
     typedef boost::shared_ptr<KinBody::Joint const> JointConstPtr;
     typedef boost::weak_ptr<KinBody::Joint> JointWeakPtr;
 
+    class GrabbedInfo;
+
     /// \brief Stores the state of the current body that is published in a thread safe way from the environment without requiring locking the environment.
     class BodyState
     {
@@ -1296,6 +1298,7 @@ public:
         int environmentid; ///< \see KinBody::GetEnvironmentId
         std::string activeManipulatorName; ///< the currently active manpiulator set for the body
         Transform activeManipulatorTransform; ///< the active manipulator's transform
+        std::vector< boost::shared_ptr<GrabbedInfo> > vGrabbedInfos; ///< \see KinBody::GetGrabbedInfo
     };
     typedef boost::shared_ptr<KinBody::BodyState> BodyStatePtr;
     typedef boost::shared_ptr<KinBody::BodyState const> BodyStateConstPtr;
@@ -2064,9 +2067,13 @@ private:
     {
         AO_Enabled = 1,     ///< return only enabled link pairs
         AO_ActiveDOFs = 2,     ///< return only link pairs that have an active in its path
+        AO_SampledColliding = 4, ///< return only link pairs that collided in some but not all configurations sampled by \ref ComputeSampledCollidingLinks. Has no effect if it has not been called.
     };
 
     /// \brief return all possible link pairs that could get in collision.
+    ///
+    /// The pairs that do not collide in the initial pose are computed on the first call. If the kinematics geometry hash has already been computed,
+    /// they are loaded from the database directory when saved there for the same hash, adjacency and initial pose, and saved there otherwise.
     /// \param adjacentoptions a bitmask of \ref AdjacentOptions values
     virtual const std::vector<int>& GetNonAdjacentLinks(int adjacentoptions=0) const;
 
@@ -2128,6 +2135,22 @@ private:
     /// \brief Treats the current pose as a pose not in collision, which sets the adjacent pairs of links
     virtual void SetNonCollidingConfiguration();
 
+    /// \brief Samples random configurations inside the joint limits and records which of the non-adjacent link pairs ever collide.
+    ///
+    /// All non-adjacent pairs are classified as never, always or sometimes colliding. Only the sometimes colliding pairs are returned by \ref GetNonAdjacentLinks when \ref AO_SampledColliding is set:
+    /// the never colliding pairs need no check, and the always colliding pairs cannot be moved apart so they are treated like adjacent links.
+    /// Since the collision checkers request \ref AO_SampledColliding, calling this function prunes the pairs tested by self-collision checking.
+    /// The pruning is only as good as the sampling, so pairs colliding in a tiny region of the configuration space might be missed.
+    /// The result is reset whenever the geometry or the collision checker changes.
+    /// The samples are drawn from a generator with a fixed seed, so the result does not depend on numthreads or on the global random generator.
+    /// \param numsamples number of random configurations to test, has to be > 0
+    /// \param numthreads if > 1, the samples are split among that many threads each working on a clone of the environment
+    /// \param usecache if true, the result is loaded from the database directory when it was saved there for the same kinematics geometry hash, and saved there after sampling otherwise
+    virtual void ComputeSampledCollidingLinks(int numsamples=10000, int numthreads=1, bool usecache=false);
+
+    /// \brief returns the link pairs that collided in all the samples of \ref ComputeSampledCollidingLinks, sorted by index. Empty if it has not been called.
+    virtual const std::vector<int>& GetSampledAlwaysCollidingLinks() const;
+
     /// Functions dealing with configuration specifications
     /// @name Configuration Specification API
     //@{
@@ -2305,6 +2328,9 @@ protected:
     /// \brief resets cached information dependent on the collision checker (usually called when the collision checker is switched or some big mode is set.
     virtual void _ResetInternalCollisionCache();
 
+    /// \brief fills _vNonAdjacentLinks[AO_SampledColliding] from _vNonAdjacentLinks[0] and _vSampledCollidingLinks
+    void _ComputeSampledNonAdjacentLinks() const;
+
     std::string _name; ///< name of body
     std::vector<JointPtr> _vecjoints; ///< \see GetJoints
     std::vector<JointPtr> _vTopologicallySortedJoints; ///< \see GetDependencyOrderedJoints
@@ -2327,10 +2353,13 @@ protected:
 
     mutable std::vector<std::list<UserDataWeakPtr> > _vlistRegisteredCallbacks; ///< callbacks to call when particular properties of the body change. _vlistRegisteredCallbacks[index] is the list of change callbacks where 1<<index is part of KinBodyProperty, this makes it easy to find out if any particular bits have callbacks. The registration/de-registration of the lists can happen at any point and does not modify the kinbody state exposed to the user, hence it is mutable.
 
-    mutable boost::array<std::vector<int>, 4> _vNonAdjacentLinks; ///< contains cached versions of the non-adjacent links depending on values in AdjacentOptions. Declared as mutable since data is cached.
+    mutable boost::array<std::vector<int>, 8> _vNonAdjacentLinks; ///< contains cached versions of the non-adjacent links depending on values in AdjacentOptions. Declared as mutable since data is cached.
     mutable boost::array<std::set<int>, 4> _cacheSetNonAdjacentLinks; ///< used for caching return value of GetNonAdjacentLinks.
     mutable int _nNonAdjacentLinkCache; ///< specifies what information is currently valid in the AdjacentOptions.  Declared as mutable since data is cached. If 0x80000000 (ie < 0), then everything needs to be recomputed including _setNonAdjacentLinks[0].
     std::vector<Transform> _vInitialLinkTransformations; ///< the initial transformations of each link specifying at least one pose where the robot is collision free
+    std::vector<int> _vSampledCollidingLinks; ///< sorted link pairs that collided in some but not all samples of \ref ComputeSampledCollidingLinks
+    std::vector<int> _vSampledAlwaysCollidingLinks; ///< sorted link pairs that collided in all samples of \ref ComputeSampledCollidingLinks
+    bool _bHasSampledCollidingLinks; ///< true if _vSampledCollidingLinks is valid, otherwise AO_SampledColliding returns all pairs
 
     ConfigurationSpecification _spec;
     CollisionCheckerBasePtr _selfcollisionchecker; ///< optional checker to use for self-collisions
@@ -142,12 +142,176 @@ inline const char* RaveGetSourceFilename(const char* pfilename)
     return p+1;
 }
 
+/// \brief Statistics of the asynchronous logging backend, see \ref RaveGetAsyncLoggingStatistics
+class AsyncLoggingStatistics
+{
+public:
+    AsyncLoggingStatistics() : numlogged(0), numdropped(0), numtruncated(0), numflushes(0), numthreads(0) {
+    }
+    uint64_t numlogged; ///< number of messages queued into the ring buffers
+    uint64_t numdropped; ///< number of messages dropped because the ring buffer of the logging thread was full
+    uint64_t numtruncated; ///< number of messages whose arguments did not fit into one record and were cut short
+    uint64_t numflushes; ///< number of times the ring buffers were drained
+    uint32_t numthreads; ///< number of threads currently owning a ring buffer
+};
+
+/** \brief Enables or disables the asynchronous logging backend.
+
+    When enabled, the RAVELOG_* and RAVELOG_*_FORMAT macros do not format anything on the calling thread. They copy
+    the format string and the typed arguments into a lock-free ring buffer owned by the calling thread, and a background
+    thread formats and writes the queued messages in timestamp order. Memory is bounded by the ring buffer size per
+    logging thread. Messages that do not fit are dropped and counted. Fatal messages are written before the macro returns.
+    The RAVELOG_*W wide character macros always write synchronously.
+
+    Disabling the backend, or calling \ref RaveDestroy, writes all pending messages.
+    \param buffersize size in bytes of every per-thread ring buffer, rounded up to a power of two. Threads reallocate their buffers the next time they log after the size changes.
+    \param flushperiod time in milliseconds the background thread waits between writes
+ */
+OPENRAVE_API void RaveSetAsyncLogging(bool bEnable, uint32_t buffersize=65536, uint32_t flushperiod=10);
+
+/// \brief Returns true if the asynchronous logging backend is enabled.
+OPENRAVE_API bool RaveIsAsyncLogging();
+
+/// \brief Synchronously writes all messages pending in the asynchronous logging ring buffers.
+OPENRAVE_API void RaveFlushLog();
+
+/// \brief Returns the accumulated statistics of the asynchronous logging backend.
+OPENRAVE_API AsyncLoggingStatistics RaveGetAsyncLoggingStatistics();
+
+/// \brief Queues a printf-style message into the ring buffer of the calling thread. Used by the RAVELOG_* macros.
+///
+/// The format string is parsed to pull the typed arguments out of the variable argument list, formatting is deferred to the flushing thread.
+OPENRAVE_API void RaveAsyncLogPrintf(int level, const char* filename, int line, const char* function, const char* fmt, ...);
+
+/// \brief Queues an already formatted message into the ring buffer of the calling thread. Used by the RAVELOG_* macros.
+OPENRAVE_API void RaveAsyncLogPrintf(int level, const char* filename, int line, const char* function, const std::string& s);
+
+/** \brief Captures the typed arguments of a RAVELOG_*_FORMAT message for deferred formatting with boost::format.
+
+    The record is queued into the ring buffer of the calling thread when the writer is destroyed. Arguments of types
+    without a dedicated overload are converted with operator<< on the calling thread, so boost::format width and precision
+    flags do not apply to them.
+ */
+class OPENRAVE_API AsyncLogRecordWriter
+{
+public:
+    /// \brief type tags of the captured arguments
+    enum ArgumentType {
+        AT_Bool=1,
+        AT_Char=2,
+        AT_SignedChar=3,
+        AT_UnsignedChar=4,
+        AT_Short=5,
+        AT_UnsignedShort=6,
+        AT_Int=7,
+        AT_UnsignedInt=8,
+        AT_Long=9,
+        AT_UnsignedLong=10,
+        AT_LongLong=11,
+        AT_UnsignedLongLong=12,
+        AT_Float=13,
+        AT_Double=14,
+        AT_LongDouble=15,
+        AT_String=16, ///< uint32_t length followed by the characters
+        AT_Pointer=17,
+    };
+
+    /// \brief the format string is copied into the record since it might not outlive the flush
+    AsyncLogRecordWriter(int level, const char* filename, int line, const char* function, const char* fmt) {
+        _Begin(level, filename, line, function, fmt, strlen(fmt));
+    }
+    AsyncLogRecordWriter(int level, const char* filename, int line, const char* function, const std::string& fmt) {
+        _Begin(level, filename, line, function, fmt.c_str(), fmt.size());
+    }
+    ~AsyncLogRecordWriter() {
+        _Commit();
+    }
+
+    AsyncLogRecordWriter& operator%(bool value) {
+        _Write(AT_Bool, &value, sizeof(value)); return *this;
+    }
+    AsyncLogRecordWriter& operator%(char value) {
+        _Write(AT_Char, &value, sizeof(value)); return *this;
+    }
+    AsyncLogRecordWriter& operator%(signed char value) {
+        _Write(AT_SignedChar, &value, sizeof(value)); return *this;
+    }
+    AsyncLogRecordWriter& operator%(unsigned char value) {
+        _Write(AT_UnsignedChar, &value, sizeof(value)); return *this;
+    }
+    AsyncLogRecordWriter& operator%(short value) {
+        _Write(AT_Short, &value, sizeof(value)); return *this;
+    }
+    AsyncLogRecordWriter& operator%(unsigned short value) {
+        _Write(AT_UnsignedShort, &value, sizeof(value)); return *this;
+    }
+    AsyncLogRecordWriter& operator%(int value) {
+        _Write(AT_Int, &value, sizeof(value)); return *this;
+    }
+    AsyncLogRecordWriter& operator%(unsigned int value) {
+        _Write(AT_UnsignedInt, &value, sizeof(value)); return *this;
+    }
+    AsyncLogRecordWriter& operator%(long value) {
+        _Write(AT_Long, &value, sizeof(value)); return *this;
+    }
+    AsyncLogRecordWriter& operator%(unsigned long value) {
+        _Write(AT_UnsignedLong, &value, sizeof(value)); return *this;
+    }
+    AsyncLogRecordWriter& operator%(long long value) {
+        _Write(AT_LongLong, &value, sizeof(value)); return *this;
+    }
+    AsyncLogRecordWriter& operator%(unsigned long long value) {
+        _Write(AT_UnsignedLongLong, &value, sizeof(value)); return *this;
+    }
+    AsyncLogRecordWriter& operator%(float value) {
+        _Write(AT_Float, &value, sizeof(value)); return *this;
+    }
+    AsyncLogRecordWriter& operator%(double value) {
+        _Write(AT_Double, &value, sizeof(value)); return *this;
+    }
+    AsyncLogRecordWriter& operator%(long double value) {
+        _Write(AT_LongDouble, &value, sizeof(value)); return *this;
+    }
+    AsyncLogRecordWriter& operator%(const void* value) {
+        _Write(AT_Pointer, &value, sizeof(value)); return *this;
+    }
+    AsyncLogRecordWriter& operator%(const char* value) {
+        if( !value ) {
+            value = "(null)";
+        }
+        _WriteString(value, strlen(value)); return *this;
+    }
+    AsyncLogRecordWriter& operator%(const std::string& value) {
+        _WriteString(value.c_str(), value.size()); return *this;
+    }
+    template <typename T>
+    AsyncLogRecordWriter& operator%(const T& value) {
+        std::stringstream ss;
+        ss << value;
+        return *this % ss.str();
+    }
+
+private:
+    AsyncLogRecordWriter(const AsyncLogRecordWriter&);
+    AsyncLogRecordWriter& operator=(const AsyncLogRecordWriter&);
+
+    void _Begin(int level, const char* filename, int line, const char* function, const char* fmt, size_t fmtlength);
+    void _Write(uint8_t type, const void* pvalue, size_t size);
+    void _WriteString(const char* s, size_t length);
+    void _Commit();
+
+    void* _pstate; ///< the producer state of the calling thread, NULL if the record is discarded
+};
+
 #define RAVEPRINTHEADER(LEVEL) OpenRAVE::RavePrintfA ## LEVEL("[%s:%d %s] ", OpenRAVE::RaveGetSourceFilename(__FILE__), __LINE__,  __FUNCTION__)
 
+/// queues the message into the asynchronous logging backend, the source filename is stripped by the flushing thread
+#define RAVELOG_ASYNCA(level, ...) OpenRAVE::RaveAsyncLogPrintf(level, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+
 // different logging levels. The higher the suffix number, the less important the information is.
 // 0 log level logs all the time. OpenRAVE starts up with a log level of 0.
 #define RAVELOG_LEVELW(LEVEL,level,...) do { if (int(OpenRAVE::RaveGetDebugLevel()&OpenRAVE::Level_OutputMask)>=int(level)) { RAVEPRINTHEADER(LEVEL); OpenRAVE::RavePrintfW ## LEVEL(__VA_ARGS__); } } while (0)
-#define RAVELOG_LEVELA(LEVEL,level,...) do { if (int(OpenRAVE::RaveGetDebugLevel()&OpenRAVE::Level_OutputMask)>=int(level)) { RAVEPRINTHEADER(LEVEL); OpenRAVE::RavePrintfA ## LEVEL(__VA_ARGS__); } } while (0)
+#define RAVELOG_LEVELA(LEVEL,level,...) do { if (int(OpenRAVE::RaveGetDebugLevel()&OpenRAVE::Level_OutputMask)>=int(level)) { if( OpenRAVE::RaveIsAsyncLogging() ) { RAVELOG_ASYNCA(level, __VA_ARGS__); } else { RAVEPRINTHEADER(LEVEL); OpenRAVE::RavePrintfA ## LEVEL(__VA_ARGS__); } } } while (0)
 
 
 #if OPENRAVE_LOG4CXX
@@ -317,7 +481,7 @@ inline int RavePrintfA(const std::string& s, uint32_t level)
 #define RAVELOG_LEVELW(LEVEL, level, ...) RAVELOG_LOGGER_LEVELW(OpenRAVE::RaveGetLogger(), LEVEL, level, __VA_ARGS__)
 
 #undef RAVELOG_LEVELA
-#define RAVELOG_LEVELA(LEVEL, level, ...) RAVELOG_LOGGER_LEVELA(OpenRAVE::RaveGetLogger(), LEVEL, level, __VA_ARGS__)
+#define RAVELOG_LEVELA(LEVEL, level, ...) do { if (int(OpenRAVE::RaveGetDebugLevel()&OpenRAVE::Level_OutputMask)>=int(level)) { if( OpenRAVE::RaveIsAsyncLogging() ) { RAVELOG_ASYNCA(level, __VA_ARGS__); } else { OpenRAVE::RavePrintfA ## LEVEL(OpenRAVE::RaveGetLogger(), LOG4CXX_LOCATION, __VA_ARGS__); } } } while (0)
 
 #else
 
@@ -506,12 +670,15 @@ DefineRavePrintfA(_VERBOSELEVEL)
 #define RAVELOG_VERBOSEA(...) RAVELOG_LEVELA(_VERBOSELEVEL,OpenRAVE::Level_Verbose,__VA_ARGS__)
 #define RAVELOG_VERBOSE RAVELOG_VERBOSEA
 
-#define RAVELOG_FATAL_FORMAT(x, params) RAVELOG_FATAL(boost::str(boost::format(x)%params))
-#define RAVELOG_ERROR_FORMAT(x, params) RAVELOG_ERROR(boost::str(boost::format(x)%params))
-#define RAVELOG_WARN_FORMAT(x, params) RAVELOG_WARN(boost::str(boost::format(x)%params))
-#define RAVELOG_INFO_FORMAT(x, params) RAVELOG_INFO(boost::str(boost::format(x)%params))
-#define RAVELOG_DEBUG_FORMAT(x, params) RAVELOG_DEBUG(boost::str(boost::format(x)%params))
-#define RAVELOG_VERBOSE_FORMAT(x, params) RAVELOG_VERBOSE(boost::str(boost::format(x)%params))
+// with the asynchronous backend the arguments are captured by type and boost::format runs on the flushing thread
+#define RAVELOG_LEVEL_FORMAT(LEVELNAME, level, x, params) do { if (int(OpenRAVE::RaveGetDebugLevel()&OpenRAVE::Level_OutputMask)>=int(level)) { if( OpenRAVE::RaveIsAsyncLogging() ) { OpenRAVE::AsyncLogRecordWriter(level, __FILE__, __LINE__, __FUNCTION__, x)%params; } else { RAVELOG_ ## LEVELNAME(boost::str(boost::format(x)%params)); } } } while (0)
+
+#define RAVELOG_FATAL_FORMAT(x, params) RAVELOG_LEVEL_FORMAT(FATAL, OpenRAVE::Level_Fatal, x, params)
+#define RAVELOG_ERROR_FORMAT(x, params) RAVELOG_LEVEL_FORMAT(ERROR, OpenRAVE::Level_Error, x, params)
+#define RAVELOG_WARN_FORMAT(x, params) RAVELOG_LEVEL_FORMAT(WARN, OpenRAVE::Level_Warn, x, params)
+#define RAVELOG_INFO_FORMAT(x, params) RAVELOG_LEVEL_FORMAT(INFO, OpenRAVE::Level_Info, x, params)
+#define RAVELOG_DEBUG_FORMAT(x, params) RAVELOG_LEVEL_FORMAT(DEBUG, OpenRAVE::Level_Debug, x, params)
+#define RAVELOG_VERBOSE_FORMAT(x, params) RAVELOG_LEVEL_FORMAT(VERBOSE, OpenRAVE::Level_Verbose, x, params)
 
 #define IS_DEBUGLEVEL(level) ((OpenRAVE::RaveGetDebugLevel()&OpenRAVE::Level_OutputMask)>=(level))
 
@@ -370,6 +370,14 @@ public:
     /// Only valid if this sensor is simulation based. A sensor hooked up to a real device can ignore this call
     virtual bool SimulationStep(dReal fTimeElapsed) OPENRAVE_DUMMY_IMPLEMENTATION;
 
+    /// \brief Returns true if \ref SimulationStep can run on a worker thread in parallel with other sensors, see \ref EnvironmentBase::SetSimulationStepThreads
+    ///
+    /// The environment stays locked by the thread calling \ref EnvironmentBase::StepSimulation, so such a sensor cannot call environment functions that lock it.
+    /// It also cannot use interfaces shared with other sensors, like the environment collision checker.
+    virtual bool IsSimulationStepThreadSafe() const {
+        return false;
+    }
+
     /// \brief Returns the sensor geometry. This method is thread safe.
     ///
     /// \param type the requested sensor type to create. A sensor can support many types. If type is ST_Invalid, then returns any structure that represents the geometry.
@@ -207,7 +207,8 @@ public:
 
             RAY r;
 
-            GetEnv()->GetCollisionChecker()->SetCollisionOptions(CO_Distance);
+            CollisionCheckerBasePtr pchecker = GetSensorCollisionChecker(GetEnv(), _privatechecker);
+            pchecker->SetCollisionOptions(CO_Distance);
             Transform t;
 
             {
@@ -231,7 +232,7 @@ public:
 
                         int index = w*_pgeom->height+h;
 
-                        if( GetEnv()->CheckCollision(r, _report)) {
+                        if( pchecker->CheckCollision(r, _report)) {
                             _pdata->ranges[index] = vdir*_report->minDistance;
                             _pdata->intensity[index] = 1;
                             // store the colliding bodies
@@ -251,7 +252,7 @@ public:
                 _report->Reset();
             }
 
-            GetEnv()->GetCollisionChecker()->SetCollisionOptions(0);
+            pchecker->SetCollisionOptions(0);
 
             if( _bRenderData ) {
                 // If can render, check if some time passed before last update
@@ -328,6 +329,10 @@ public:
         return false;
     }
 
+    virtual bool IsSimulationStepThreadSafe() const {
+        return true;
+    }
+
     virtual bool Supports(SensorType type) {
         return type == ST_Laser;
     }
@@ -426,6 +431,7 @@ protected:
     boost::shared_ptr<LaserSensorData> _pdata;
     vector<int> _databodyids;     ///< if non 0, for each point in _data, specifies the body that was hit
     CollisionReportPtr _report;
+    PrivateCollisionChecker _privatechecker; ///< used instead of the environment checker when sensors are stepped in parallel
     // more geom stuff
     RaveVector<float> _vColor;
     dReal _iKK[4];     // inverse of KK
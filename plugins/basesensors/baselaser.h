@@ -200,7 +200,8 @@ public:
             Vector rotaxis(0,0,1);
             RAY r;
 
-            GetEnv()->GetCollisionChecker()->SetCollisionOptions(CO_Distance);
+            CollisionCheckerBasePtr pchecker = GetSensorCollisionChecker(GetEnv(), _privatechecker);
+            pchecker->SetCollisionOptions(CO_Distance);
             Transform t;
 
             {
@@ -219,7 +220,7 @@ public:
                     r.pos = t.trans+_pgeom->min_range*vdir;
                     r.dir = (_pgeom->max_range-_pgeom->min_range)*vdir;
 
-                    if( GetEnv()->CheckCollision(r, _report)) {
+                    if( pchecker->CheckCollision(r, _report)) {
                         _pdata->ranges[index] = vdir*(_report->minDistance+_pgeom->min_range);
                         _pdata->intensity[index] = 1;
                         // store the colliding bodies
@@ -236,7 +237,7 @@ public:
                 }
             }
 
-            GetEnv()->GetCollisionChecker()->SetCollisionOptions(0);
+            pchecker->SetCollisionOptions(0);
 
             if( _bRenderData ) {
                 // If can render, check if some time passed before last update
@@ -314,6 +315,10 @@ public:
         return false;
     }
 
+    virtual bool IsSimulationStepThreadSafe() const {
+        return true;
+    }
+
     virtual bool Supports(SensorType type) {
         return type == ST_Laser;
     }
@@ -433,6 +438,7 @@ protected:
     boost::shared_ptr<LaserSensorData> _pdata;
     vector<int> _databodyids;     ///< if non 0, for each point in _data, specifies the body that was hit
     CollisionReportPtr _report;
+    PrivateCollisionChecker _privatechecker; ///< used instead of the environment checker when sensors are stepped in parallel
 
     // more geom stuff
     RaveVector<float> _vColor;
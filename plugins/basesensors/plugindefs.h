@@ -60,4 +60,48 @@
 using namespace std;
 using namespace OpenRAVE;
 
+/// \brief collision checker owned by a sensor, see \ref GetSensorCollisionChecker
+struct PrivateCollisionChecker
+{
+    CollisionCheckerBasePtr pchecker;
+    std::vector<KinBodyWeakPtr> vbodies; ///< the environment bodies pchecker was last synchronized with
+};
+
+/// \brief returns the checker a sensor should cast its rays with
+///
+/// When the environment steps sensors in parallel, each sensor uses its own checker stored in privatechecker so that the collision options and internal state are not shared between threads.
+/// The private checker is not notified when bodies are added to or removed from the environment, so it is synchronized with the environment bodies on every call.
+inline CollisionCheckerBasePtr GetSensorCollisionChecker(EnvironmentBasePtr penv, PrivateCollisionChecker& privatechecker)
+{
+    CollisionCheckerBasePtr pchecker = penv->GetCollisionChecker();
+    if( penv->GetSimulationStepThreads() <= 1 ) {
+        privatechecker.pchecker.reset();
+        privatechecker.vbodies.resize(0);
+        return pchecker;
+    }
+    std::vector<KinBodyPtr> vbodies;
+    penv->GetBodies(vbodies);
+    if( !privatechecker.pchecker || privatechecker.pchecker->GetXMLId() != pchecker->GetXMLId() ) {
+        privatechecker.pchecker = RaveCreateCollisionChecker(penv, pchecker->GetXMLId());
+        if( !privatechecker.pchecker ) {
+            throw openrave_exception(str(boost::format("failed to create collision checker %s")%pchecker->GetXMLId()));
+        }
+        privatechecker.pchecker->InitEnvironment();
+    }
+    else {
+        FOREACHC(itbody, privatechecker.vbodies) {
+            KinBodyPtr pbody = itbody->lock();
+            if( !!pbody && std::find(vbodies.begin(), vbodies.end(), pbody) == vbodies.end() ) {
+                privatechecker.pchecker->RemoveKinBody(pbody);
+            }
+        }
+        // does nothing for the bodies that are already initialized
+        FOREACHC(itbody, vbodies) {
+            privatechecker.pchecker->InitKinBody(*itbody);
+        }
+    }
+    privatechecker.vbodies.assign(vbodies.begin(), vbodies.end());
+    return privatechecker.pchecker;
+}
+
 #endif
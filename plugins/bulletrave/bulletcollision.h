@@ -776,7 +776,7 @@ public:
         }
 
 
-        int adjacentoptions = KinBody::AO_Enabled;
+        int adjacentoptions = KinBody::AO_Enabled|KinBody::AO_SampledColliding;
         if( (_options&OpenRAVE::CO_ActiveDOFs) && pbody->IsRobot() ) {
             adjacentoptions |= KinBody::AO_ActiveDOFs;
         }
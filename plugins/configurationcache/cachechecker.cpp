@@ -46,16 +46,27 @@ public:
                         "remove all nodes in collision with this body. [bodyname]");
         RegisterCommand("UpdateFreeConfigurations",boost::bind(&CacheCollisionChecker::_UpdateFreeConfigurationsCommand,this,_1,_2),
                         "remove all free nodes that overlap with this body. [bodyname]");
+        RegisterCommand("SetWorkspaceIndexParameters",boost::bind(&CacheCollisionChecker::_SetWorkspaceIndexParametersCommand,this,_1,_2),
+                        "set the parameters of the workspace index used to only invalidate the free nodes overlapping with a changed body: voxelsize (0 invalidates all free nodes), margin added to the link aabbs of the nodes on top of how far the links move within the free space threshold");
         RegisterCommand("SaveCache",boost::bind(&CacheCollisionChecker::_SaveCacheCommand,this,_1,_2),
-                        "save self collision cache");
+                        "save the self collision cache, or the environment collision cache if 'env' is given. The file is tagged with the robot and environment hashes. Returns 1 on success. [env]");
         RegisterCommand("LoadCache",boost::bind(&CacheCollisionChecker::_LoadCacheCommand,this,_1,_2),
-                        "load self collision cache");
+                        "map the self collision cache, or the environment collision cache if 'env' is given, from disk. Nodes are materialized as they are used. Fails if the robot or the environment changed since the cache was saved. Returns 1 on success. [env]");
         RegisterCommand("GetCacheTimes",boost::bind(&CacheCollisionChecker::_GetCacheTimesCommand,this,_1,_2),
                         "get the cache times: insert, query, collision checking, load");
+        RegisterCommand("SetShareCache",boost::bind(&CacheCollisionChecker::_SetShareCacheCommand,this,_1,_2),
+                        "if 1, the checkers of environments cloned from this one use the same collision and self collision caches, so that planners running in parallel on the clones see each other's results. [0|1]");
+        RegisterCommand("GetSharedCacheStatistics",boost::bind(&CacheCollisionChecker::_GetSharedCacheStatisticsCommand,this,_1,_2),
+                        "get the statistics of all the checkers sharing the collision cache (or the self collision cache if 'self' is given), one line per checker: name checks collisionhits freehits inserted. [self]");
         std::string collisionname="ode";
         sinput >> collisionname;
         _pintchecker = RaveCreateCollisionChecker(GetEnv(), collisionname);
         OPENRAVE_ASSERT_FORMAT(!!_pintchecker, "internal checker %s is not valid", collisionname, ORE_Assert);
+        _bShareCache = false;
+        _nSharedCacheStamp = 0;
+        _nSharedSelfCacheStamp = 0;
+        _fWorkspaceVoxelSize = 0.2;
+        _fWorkspaceMargin = 0;
         _cachedcollisionchecks=0;
         _cachedcollisionhits=0;
         _cachedfreehits = 0;
@@ -134,11 +145,22 @@ public:
 
     virtual void DestroyEnvironment()
     {
+        // a shared cache is still used by the checkers of the other environments, so only release it
         if( !!_cache ) {
-            _cache->Reset();
+            if( _cache->IsCacheTreeShared() ) {
+                _cache.reset();
+            }
+            else {
+                _cache->Reset();
+            }
         }
         if( !!_selfcache ) {
-            _selfcache->Reset();
+            if( _selfcache->IsCacheTreeShared() ) {
+                _selfcache.reset();
+            }
+            else {
+                _selfcache->Reset();
+            }
         }
         if( !!_pintchecker ) {
             _pintchecker->DestroyEnvironment();
@@ -165,6 +187,28 @@ public:
             _pintchecker.reset();
         }
 
+        _fWorkspaceVoxelSize = clone->_fWorkspaceVoxelSize;
+        _fWorkspaceMargin = clone->_fWorkspaceMargin;
+        _bShareCache = clone->_bShareCache;
+        if( _bShareCache ) {
+            // the caches are created once the robot is found, which might be after the bodies are cloned
+            _sharedcache = clone->_cache;
+            _sharedselfcache = clone->_selfcache;
+            // the environment of this checker can change before the robot is found, so remember the state the caches were filled in
+            if( !!clone->_cache ) {
+                _nSharedCacheStamp = clone->_cache->GetEnvironmentStamp();
+                _sharedcachehash = clone->_cache->GetStateHash();
+            }
+            if( !!clone->_selfcache ) {
+                _nSharedSelfCacheStamp = clone->_selfcache->GetEnvironmentStamp();
+                _sharedselfcachehash = clone->_selfcache->GetStateHash();
+            }
+        }
+        else {
+            _sharedcache.reset();
+            _sharedselfcache.reset();
+        }
+
         _strRobotName = clone->_strRobotName;
         _probot.reset(); // have to rest to force creating a new cache
         _probot = GetRobot();
@@ -344,7 +388,7 @@ public:
         // save cache every other iteration if its size has increased by 1.5
         if (_selfcachedcollisionchecks % 4000 == 0) {
             if (_size*1.5 < _selfcache->GetNumKnownNodes()) {
-                _selfcache->SaveCache(GetCacheHash());
+                _selfcache->SaveCache("selfcache."+GetCacheHash());
                 _size = _selfcache->GetNumKnownNodes();
             }
         }
@@ -411,7 +455,7 @@ protected:
         std::string fulldirname = RaveFindDatabaseFile(("selfcache."+GetCacheHash()));
         if (fulldirname != "" && _selfcache->GetNumKnownNodes() == 0) {
             _stime = utils::GetMilliTime();
-            _selfcache->LoadCache(GetCacheHash(), GetEnv());
+            _selfcache->LoadCache("selfcache."+GetCacheHash(), GetEnv());
             _loadtime = utils::GetMilliTime()-_stime;
             _size = _selfcache->GetNumKnownNodes();
             RAVELOG_VERBOSE_FORMAT("Loaded %d configurations in %d ms from %s", _size%_loadtime%fulldirname);
@@ -491,6 +535,22 @@ protected:
         return true;
     }
 
+    virtual bool _SetWorkspaceIndexParametersCommand(std::ostream& sout, std::istream& sinput)
+    {
+        dReal voxelsize, margin;
+        sinput >> voxelsize >> margin;
+        if( !sinput ) {
+            return false;
+        }
+        _fWorkspaceVoxelSize = voxelsize;
+        _fWorkspaceMargin = margin;
+        if( !!_cache ) {
+            _cache->SetWorkspaceIndexParameters(_fWorkspaceVoxelSize, _fWorkspaceMargin);
+        }
+        sout << " " << _fWorkspaceVoxelSize << " " << _fWorkspaceMargin;
+        return true;
+    }
+
     virtual bool _SetSelfCacheParametersCommand(std::ostream& sout, std::istream& sinput)
     {
 
@@ -559,6 +619,28 @@ protected:
 
     }
 
+    virtual bool _SetShareCacheCommand(std::ostream& sout, std::istream& sinput)
+    {
+        sinput >> _bShareCache;
+        return !!sinput;
+    }
+
+    virtual bool _GetSharedCacheStatisticsCommand(std::ostream& sout, std::istream& sinput)
+    {
+        string cachename;
+        sinput >> cachename;
+        ConfigurationCachePtr cache = cachename == "self" ? _selfcache : _cache;
+        if( !cache ) {
+            return false;
+        }
+        std::vector<CacheTreeClientStatisticsPtr> vstats;
+        cache->GetSharedStatistics(vstats);
+        FOREACHC(itstats, vstats) {
+            sout << (*itstats)->name << " " << (*itstats)->numchecks << " " << (*itstats)->numcollisionhits << " " << (*itstats)->numfreehits << " " << (*itstats)->numinserted << endl;
+        }
+        return true;
+    }
+
     virtual bool _GetTrackedRobotCommand(std::ostream& sout, std::istream& sinput)
     {
         GetRobot();
@@ -575,14 +657,28 @@ protected:
 
     virtual bool _SaveCacheCommand(std::ostream& sout, std::istream& sinput)
     {
-        _selfcache->SaveCache(GetCacheHash());
+        std::string cachename;
+        sinput >> cachename;
+        if( cachename == "env" ) {
+            sout << _cache->SaveCache("envcache."+GetCacheHash());
+        }
+        else {
+            sout << _selfcache->SaveCache("selfcache."+GetCacheHash());
+        }
         return true;
     }
 
 
     virtual bool _LoadCacheCommand(std::ostream& sout, std::istream& sinput)
     {
-        _selfcache->LoadCache(GetCacheHash(), GetEnv());
+        std::string cachename;
+        sinput >> cachename;
+        if( cachename == "env" ) {
+            sout << _cache->LoadCache("envcache."+GetCacheHash(), GetEnv());
+        }
+        else {
+            sout << _selfcache->LoadCache("selfcache."+GetCacheHash(), GetEnv());
+        }
         return true;
     }
 
@@ -638,6 +734,8 @@ protected:
         _selfcache->SetFreeSpaceThresh(0.3);
         _selfcache->SetInsertionDistanceMult(0.5);
         _selfcache->SetBase(1.8);
+
+        _cache->SetWorkspaceIndexParameters(_fWorkspaceVoxelSize, _fWorkspaceMargin);
     }
 
     void _InitializeCache()
@@ -646,6 +744,7 @@ protected:
         _selfcache.reset(new ConfigurationCache(_probot, false)); //envupdates should be disabled for self collision cache
 
         _SetParams();
+        _ShareCaches();
 
         _cachedcollisionchecks=0;
         _cachedcollisionhits=0;
@@ -656,6 +755,30 @@ protected:
         _selfcachedfreehits=0;
     }
 
+    /// \brief uses the cache trees of the checker this checker was cloned from if it shares its caches and both environments are still in the state of the clone
+    void _ShareCaches()
+    {
+        ConfigurationCachePtr sharedcache = _sharedcache.lock();
+        if( !!sharedcache && !!_cache ) {
+            if( sharedcache->GetEnvironmentStamp() == _nSharedCacheStamp && _cache->GetStateHash() == _sharedcachehash ) {
+                _cache->ShareCacheTree(sharedcache);
+            }
+            else {
+                RAVELOG_DEBUG_FORMAT("env=%d, the environments changed since the clone, so not sharing the cache", GetEnv()->GetId());
+                _sharedcache.reset();
+            }
+        }
+        ConfigurationCachePtr sharedselfcache = _sharedselfcache.lock();
+        if( !!sharedselfcache && !!_selfcache ) {
+            if( sharedselfcache->GetEnvironmentStamp() == _nSharedSelfCacheStamp && _selfcache->GetStateHash() == _sharedselfcachehash ) {
+                _selfcache->ShareCacheTree(sharedselfcache);
+            }
+            else {
+                _sharedselfcache.reset();
+            }
+        }
+    }
+
     void _UpdateRobotDOF()
     {
         // if DOF changed, reset environment cache
@@ -663,6 +786,8 @@ protected:
         {
             RAVELOG_VERBOSE_FORMAT("Updating robot dofs, %d/%d",_numdofs%_probot->GetActiveDOF());
             _cache.reset(new ConfigurationCache(_probot));
+            _cache->SetWorkspaceIndexParameters(_fWorkspaceVoxelSize, _fWorkspaceMargin);
+            _ShareCaches();
 
             _numdofs = _probot->GetActiveDOF();
             _dofindices = _probot->GetActiveDOFIndices();
@@ -675,6 +800,11 @@ protected:
     std::vector<int> _dofindices;
     ConfigurationCachePtr _cache;
     ConfigurationCachePtr _selfcache;
+    boost::weak_ptr<ConfigurationCache> _sharedcache, _sharedselfcache; ///< the caches of the checker this checker was cloned from when sharing
+    uint64_t _nSharedCacheStamp, _nSharedSelfCacheStamp; ///< the environment stamps of _sharedcache and _sharedselfcache at the time of the clone
+    std::string _sharedcachehash, _sharedselfcachehash; ///< the state hashes of _sharedcache and _sharedselfcache at the time of the clone
+    bool _bShareCache; ///< if true, the checkers of cloned environments share the caches of this checker
+    dReal _fWorkspaceVoxelSize, _fWorkspaceMargin; ///< parameters of the workspace index of the collision cache
     CollisionCheckerBasePtr _pintchecker;
     std::string _strRobotName; ///< the robot name to track
     std::string __cachehash;
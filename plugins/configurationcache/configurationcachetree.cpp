@@ -14,6 +14,7 @@
 /// \author Alejandro Perez & Rosen Diankov
 #include "configurationcachetree.h"
 #include <sstream>
+#include <fstream>
 #include <boost/lexical_cast.hpp>
 
 #include <boost/multi_array.hpp>
@@ -28,10 +29,10 @@ inline dReal Sqr(dReal x) {
     return x*x;
 }
 
-CacheTreeNode::CacheTreeNode(const std::vector<dReal>& cs, Vector* plinkspheres)
+CacheTreeNode::CacheTreeNode(const std::vector<dReal>& cs, AABB* plinkaabbs)
 {
     std::copy(cs.begin(), cs.end(), _pcstate);
-    _plinkspheres = plinkspheres;
+    _plinkaabbs = plinkaabbs;
 //    _approxdispersion.first = CacheTreeNodePtr();
 //    _approxdispersion.second = std::numeric_limits<float>::infinity();
 //    _approxnn.first = CacheTreeNodePtr();
@@ -42,18 +43,24 @@ CacheTreeNode::CacheTreeNode(const std::vector<dReal>& cs, Vector* plinkspheres)
     _hasselfchild = 0;
     _usenn = 1;
     _hitcount = 0;
+    _childstride = 0;
+    _levelindex = -1;
+    _mappedindex = -1;
 }
 
-CacheTreeNode::CacheTreeNode(const dReal* pstate, int dof, Vector* plinkspheres)
+CacheTreeNode::CacheTreeNode(const dReal* pstate, int dof, AABB* plinkaabbs)
 {
     std::copy(pstate, pstate+dof, _pcstate);
-    _plinkspheres = plinkspheres;
+    _plinkaabbs = plinkaabbs;
     _conftype = CNT_Unknown;
     _robotlinkindex = -1;
     _level = 0;
     _hasselfchild = 0;
     _usenn = 1;
     _hitcount = 0;
+    _childstride = 0;
+    _levelindex = -1;
+    _mappedindex = -1;
 }
 
 void CacheTreeNode::SetCollisionInfo(CollisionReportPtr report)
@@ -104,14 +111,19 @@ void CacheTreeNode::SetCollisionInfo(int robotlinkindex, int type)
 //    }
 //}
 
-CacheTree::CacheTree(int statedof)
+CacheTree::CacheTree(int statedof, int numlinkaabbs)
 {
-    _poolNodes.reset(new boost::pool<>(sizeof(CacheTreeNode)+sizeof(dReal)*statedof));
-    _vnodes.resize(0);
-    _dummycs.resize(0);
+    _numlinkaabbs = numlinkaabbs;
+    _fVoxelSize = 0.2;
+    _fVoxelSizeInv = 1/_fVoxelSize;
+    _poolNodes.reset(new boost::pool<>(sizeof(CacheTreeNode)+sizeof(dReal)*statedof+sizeof(AABB)*_numlinkaabbs));
     _fulldirname.resize(0);
-    _mapNodeIndices.clear();
-    _collidingbodyname.resize(0);
+    _pmappednodes = NULL;
+    _pmappedchildren = NULL;
+    _pmappedstates = NULL;
+    _pmappedlinkaabbs = NULL;
+    _nummappednodes = 0;
+    _nummappedknownnodes = 0;
 
     _statedof=statedof;
     _weights.resize(_statedof, 1.0);
@@ -122,13 +134,24 @@ CacheTree::~CacheTree()
 {
     Reset();
     _weights.clear();
+    for(size_t i = 0; i < _vFreeNearestNodeBuffers.size(); ++i) {
+        delete _vFreeNearestNodeBuffers[i];
+    }
+    _vFreeNearestNodeBuffers.clear();
 }
 
 void CacheTree::Init(const std::vector<dReal>& weights, dReal maxdistance)
 {
-    Reset();
+    boost::unique_lock<boost::shared_mutex> lock(_mutex);
+    _Init(weights, maxdistance);
+}
+
+void CacheTree::_Init(const std::vector<dReal>& weights, dReal maxdistance)
+{
+    // set the dof before resetting since the node size of the pool depends on it
     _weights = weights;
     _statedof = (int)_weights.size();
+    _Reset();
     _numnodes = 0;
     _base = 2.0;
     _fBaseInv = 1/_base;
@@ -139,35 +162,36 @@ void CacheTree::Init(const std::vector<dReal>& weights, dReal maxdistance)
     _minlevel = _maxlevel - 1;
     _fMaxLevelBound = RavePow(_base, _maxlevel);
     int enclevel = _EncodeLevel(_maxlevel);
-    if( enclevel >= (int)_vsetLevelNodes.size() ) {
-        _vsetLevelNodes.resize(enclevel+1);
+    if( enclevel >= (int)_vvLevelNodes.size() ) {
+        _vvLevelNodes.resize(enclevel+1);
     }
 }
 
 void CacheTree::Reset()
 {
+    boost::unique_lock<boost::shared_mutex> lock(_mutex);
+    _Reset();
+}
 
-    _vnodes.resize(0);
-    _dummycs.resize(0);
+void CacheTree::_Reset()
+{
     _fulldirname.resize(0);
-    _mapNodeIndices.clear();
-    _collidingbodyname.resize(0);
+    _UnmapCache();
+    _mapVoxelNodes.clear();
+    _setUnindexedNodes.clear();
 
     // make sure all children are deleted
-    for(size_t ilevel = 0; ilevel < _vsetLevelNodes.size(); ++ilevel) {
-        FOREACH(itnode, _vsetLevelNodes[ilevel]) {
+    for(size_t ilevel = 0; ilevel < _vvLevelNodes.size(); ++ilevel) {
+        FOREACH(itnode, _vvLevelNodes[ilevel]) {
             (*itnode)->~CacheTreeNode();
         }
     }
-    FOREACH(itchildren, _vsetLevelNodes) {
+    FOREACH(itchildren, _vvLevelNodes) {
         itchildren->clear();
     }
-    FOREACH(itnode, _vnodes) {
-        (*itnode)->~CacheTreeNode();
-    }
     // purge_memory leaks!
     //_poolNodes.purge_memory();
-    _poolNodes.reset(new boost::pool<>(sizeof(CacheTreeNode)+sizeof(dReal)*_statedof));
+    _poolNodes.reset(new boost::pool<>(sizeof(CacheTreeNode)+sizeof(dReal)*_statedof+sizeof(AABB)*_numlinkaabbs));
     //_pNodesPool.reset(new boost::pool<>(sizeof(Node)+_dof*sizeof(dReal)));
     _numnodes = 0;
 }
@@ -176,7 +200,7 @@ void CacheTree::Reset()
 static int s_CacheTreeId = 0;
 #endif
 
-CacheTreeNodePtr CacheTree::_CreateCacheTreeNode(const std::vector<dReal>& cs, CollisionReportPtr report)
+CacheTreeNodePtr CacheTree::_CreateCacheTreeNode(const std::vector<dReal>& cs, CollisionReportPtr report, const std::vector<AABB>& vlinkaabbs)
 {
     // allocate memory for the structure and the internal state vectors
     void* pmemory;
@@ -184,8 +208,12 @@ CacheTreeNodePtr CacheTree::_CreateCacheTreeNode(const std::vector<dReal>& cs, C
         //boost::mutex::scoped_lock lock(_mutexpool);
         pmemory = _poolNodes->malloc();
     }
-    //Vector* plinkspheres = (Vector*)((uint8_t*)pmemory + sizeof(CacheTreeNode) + sizeof(dReal)*_statedof);
-    CacheTreeNodePtr newnode = new (pmemory) CacheTreeNode(cs, NULL);
+    AABB* plinkaabbs = NULL;
+    if( _numlinkaabbs > 0 && (int)vlinkaabbs.size() == _numlinkaabbs ) {
+        plinkaabbs = (AABB*)((uint8_t*)pmemory + sizeof(CacheTreeNode) + sizeof(dReal)*_statedof);
+        std::copy(vlinkaabbs.begin(), vlinkaabbs.end(), plinkaabbs);
+    }
+    CacheTreeNodePtr newnode = new (pmemory) CacheTreeNode(cs, plinkaabbs);
 #ifdef _DEBUG
     newnode->id = s_CacheTreeId++;
 #endif
@@ -201,13 +229,17 @@ CacheTreeNodePtr CacheTree::_CloneCacheTreeNode(CacheTreeNodeConstPtr refnode)
         //boost::mutex::scoped_lock lock(_mutexpool);
         pmemory = _poolNodes->malloc();
     }
-    //Vector* plinkspheres = (Vector*)((uint8_t*)pmemory + sizeof(CacheTreeNode) + sizeof(dReal)*_statedof);
-    CacheTreeNodePtr clonenode = new (pmemory) CacheTreeNode(refnode->GetConfigurationState(), _statedof, refnode->_plinkspheres);
+    AABB* plinkaabbs = NULL;
+    if( !!refnode->_plinkaabbs ) {
+        plinkaabbs = (AABB*)((uint8_t*)pmemory + sizeof(CacheTreeNode) + sizeof(dReal)*_statedof);
+        std::copy(refnode->_plinkaabbs, refnode->_plinkaabbs+_numlinkaabbs, plinkaabbs);
+    }
+    CacheTreeNodePtr clonenode = new (pmemory) CacheTreeNode(refnode->GetConfigurationState(), _statedof, plinkaabbs);
 #ifdef _DEBUG
     clonenode->id = s_CacheTreeId++;
 #endif
     clonenode->_conftype = refnode->_conftype;
-    clonenode->_hitcount = refnode->_hitcount;
+    clonenode->_hitcount = refnode->_hitcount.load();
     if( clonenode->IsInCollision() ) {
         clonenode->_collidinglink = refnode->_collidinglink;
         clonenode->_collidinglinktrans = refnode->_collidinglinktrans;
@@ -223,6 +255,91 @@ void CacheTree::_DeleteCacheTreeNode(CacheTreeNodePtr pnode)
     _poolNodes->free(pnode);
 }
 
+void CacheTree::_AddChild(CacheTreeNodePtr pnode, CacheTreeNodePtr pchild)
+{
+    if( pnode->_mappedindex >= 0 ) {
+        _MaterializeChildren(pnode);
+    }
+    int ichild = (int)pnode->_vchildren.size();
+    pnode->_vchildren.push_back(pchild);
+    if( ichild >= pnode->_childstride ) {
+        // grow all the dof rows
+        int newstride = max(4, 2*pnode->_childstride);
+        std::vector<dReal> vnewstates(newstride*_statedof);
+        for(int idof = 0; idof < _statedof; ++idof) {
+            std::copy(pnode->_vchildstates.begin()+idof*pnode->_childstride, pnode->_vchildstates.begin()+idof*pnode->_childstride+ichild, vnewstates.begin()+idof*newstride);
+        }
+        pnode->_vchildstates.swap(vnewstates);
+        pnode->_childstride = newstride;
+    }
+    const dReal* pchildstate = pchild->GetConfigurationState();
+    for(int idof = 0; idof < _statedof; ++idof) {
+        pnode->_vchildstates[idof*pnode->_childstride+ichild] = pchildstate[idof];
+    }
+}
+
+void CacheTree::_RemoveChild(CacheTreeNodePtr pnode, size_t ichild)
+{
+    size_t ilast = pnode->_vchildren.size()-1;
+    if( ichild != ilast ) {
+        pnode->_vchildren[ichild] = pnode->_vchildren[ilast];
+        for(int idof = 0; idof < _statedof; ++idof) {
+            pnode->_vchildstates[idof*pnode->_childstride+ichild] = pnode->_vchildstates[idof*pnode->_childstride+ilast];
+        }
+    }
+    pnode->_vchildren.pop_back();
+}
+
+void CacheTree::_UpdateChildStates(CacheTreeNodePtr pnode)
+{
+    pnode->_childstride = (int)pnode->_vchildren.size();
+    pnode->_vchildstates.resize(pnode->_childstride*_statedof);
+    for(int ichild = 0; ichild < pnode->_childstride; ++ichild) {
+        const dReal* pchildstate = pnode->_vchildren[ichild]->GetConfigurationState();
+        for(int idof = 0; idof < _statedof; ++idof) {
+            pnode->_vchildstates[idof*pnode->_childstride+ichild] = pchildstate[idof];
+        }
+    }
+}
+
+void CacheTree::_ComputeChildDistances2(CacheTreeNodeConstPtr pnode, const dReal* pquerystate, dReal* pdists2) const
+{
+    // loop over the children in the inner loop so that it can be vectorized, sums up the dofs in the same order as _ComputeDistance2
+    const int numchildren = (int)pnode->_vchildren.size();
+    for(int ichild = 0; ichild < numchildren; ++ichild) {
+        pdists2[ichild] = 0;
+    }
+    const dReal* pchildstates = pnode->_vchildstates.size() > 0 ? &pnode->_vchildstates[0] : NULL;
+    for(int idof = 0; idof < _statedof; ++idof) {
+        const dReal fquery = pquerystate[idof], fweight = _weights[idof];
+        const dReal* pdofstates = pchildstates + idof*pnode->_childstride;
+        for(int ichild = 0; ichild < numchildren; ++ichild) {
+            dReal f = (fquery - pdofstates[ichild]) * fweight;
+            pdists2[ichild] += f*f;
+        }
+    }
+}
+
+void CacheTree::_AddLevelNode(CacheTreeNodePtr pnode)
+{
+    int enclevel = _EncodeLevel(pnode->_level);
+    if( enclevel >= (int)_vvLevelNodes.size() ) {
+        _vvLevelNodes.resize(enclevel+1);
+    }
+    pnode->_levelindex = (int)_vvLevelNodes[enclevel].size();
+    _vvLevelNodes[enclevel].push_back(pnode);
+}
+
+void CacheTree::_RemoveLevelNode(CacheTreeNodePtr pnode)
+{
+    std::vector<CacheTreeNodePtr>& vlevelnodes = _vvLevelNodes.at(_EncodeLevel(pnode->_level));
+    BOOST_ASSERT(pnode->_levelindex >= 0 && pnode->_levelindex < (int)vlevelnodes.size() && vlevelnodes[pnode->_levelindex] == pnode);
+    vlevelnodes[pnode->_levelindex] = vlevelnodes.back();
+    vlevelnodes[pnode->_levelindex]->_levelindex = pnode->_levelindex;
+    vlevelnodes.pop_back();
+    pnode->_levelindex = -1;
+}
+
 dReal CacheTree::ComputeDistance(const std::vector<dReal>& cstatei, const std::vector<dReal>& cstatef) const
 {
     return RaveSqrt(_ComputeDistance2(&cstatei[0], &cstatef[0]));
@@ -240,26 +357,35 @@ dReal CacheTree::_ComputeDistance2(const dReal* cstatei, const dReal* cstatef) c
 
 void CacheTree::SetWeights(const std::vector<dReal>& weights)
 {
-    Reset();
+    boost::unique_lock<boost::shared_mutex> lock(_mutex);
     _weights = weights;
+    _statedof = (int)_weights.size();
+    _Reset();
 }
 
 void CacheTree::SetMaxDistance(dReal maxdistance)
 {
-    Reset();
+    boost::unique_lock<boost::shared_mutex> lock(_mutex);
+    _SetMaxDistance(maxdistance);
+}
+
+void CacheTree::_SetMaxDistance(dReal maxdistance)
+{
+    _Reset();
     _maxdistance = maxdistance;
     _maxlevel = ceilf(RaveLog(_maxdistance)/RaveLog(_base));
     _minlevel = _maxlevel - 1;
     _fMaxLevelBound = RavePow(_base, _maxlevel);
     int enclevel = _EncodeLevel(_maxlevel);
-    if( enclevel >= (int)_vsetLevelNodes.size() ) {
-        _vsetLevelNodes.resize(enclevel+1);
+    if( enclevel >= (int)_vvLevelNodes.size() ) {
+        _vvLevelNodes.resize(enclevel+1);
     }
 }
 
 void CacheTree::SetBase(dReal base)
 {
-    Reset();
+    boost::unique_lock<boost::shared_mutex> lock(_mutex);
+    _Reset();
     _statedof = (int)_weights.size();
     _base = base;
     _fBaseInv = 1/_base;
@@ -269,12 +395,77 @@ void CacheTree::SetBase(dReal base)
     _minlevel = _maxlevel - 1;
     _fMaxLevelBound = RavePow(_base, _maxlevel);
     int enclevel = _EncodeLevel(_maxlevel);
-    if( enclevel >= (int)_vsetLevelNodes.size() ) {
-        _vsetLevelNodes.resize(enclevel+1);
+    if( enclevel >= (int)_vvLevelNodes.size() ) {
+        _vvLevelNodes.resize(enclevel+1);
+    }
+}
+
+CacheTree::NearestNodeBuffersScope::NearestNodeBuffersScope(const CacheTree& tree) : buffers(tree._AcquireNearestNodeBuffers()), _tree(tree)
+{
+}
+
+CacheTree::NearestNodeBuffersScope::~NearestNodeBuffersScope()
+{
+    _tree._ReleaseNearestNodeBuffers(buffers);
+}
+
+CacheTree::NearestNodeBuffers& CacheTree::_AcquireNearestNodeBuffers() const
+{
+    boost::mutex::scoped_lock lock(_mutexNearestNodeBuffers);
+    if( _vFreeNearestNodeBuffers.size() == 0 ) {
+        return *new NearestNodeBuffers();
     }
+    NearestNodeBuffers* pbuffers = _vFreeNearestNodeBuffers.back();
+    _vFreeNearestNodeBuffers.pop_back();
+    return *pbuffers;
+}
+
+void CacheTree::_ReleaseNearestNodeBuffers(NearestNodeBuffers& buffers) const
+{
+    boost::mutex::scoped_lock lock(_mutexNearestNodeBuffers);
+    _vFreeNearestNodeBuffers.push_back(&buffers);
 }
 
 std::pair<CacheTreeNodeConstPtr, dReal> CacheTree::FindNearestNode(const std::vector<dReal>& vquerystate, dReal distancebound, ConfigurationNodeType conftype) const
+{
+    boost::shared_lock<boost::shared_mutex> lock(_mutex);
+    return _FindNearestNode(vquerystate, distancebound, conftype);
+}
+
+std::pair<CacheTreeNodeConstPtr, dReal> CacheTree::FindNearestNode(const std::vector<dReal>& vquerystate, dReal collisionthresh, dReal freespacethresh) const
+{
+    boost::shared_lock<boost::shared_mutex> lock(_mutex);
+    return _FindNearestNode(vquerystate, collisionthresh, freespacethresh);
+}
+
+dReal CacheTree::FindNearestNodeCollisionInfo(const std::vector<dReal>& vquerystate, dReal collisionthresh, dReal freespacethresh, bool& bcollision, int& robotlinkindex, KinBody::LinkConstPtr& collidinglink) const
+{
+    boost::shared_lock<boost::shared_mutex> lock(_mutex);
+    std::pair<CacheTreeNodeConstPtr, dReal> knn = _FindNearestNode(vquerystate, collisionthresh, freespacethresh);
+    if( !knn.first ) {
+        return -1;
+    }
+    bcollision = knn.first->IsInCollision();
+    if( bcollision ) {
+        robotlinkindex = knn.first->GetRobotLinkIndex();
+        collidinglink = knn.first->GetCollidingLink();
+    }
+    return knn.second;
+}
+
+dReal CacheTree::FindNearestNodeState(const std::vector<dReal>& vquerystate, dReal distancebound, ConfigurationNodeType conftype, std::vector<dReal>& vstate) const
+{
+    boost::shared_lock<boost::shared_mutex> lock(_mutex);
+    std::pair<CacheTreeNodeConstPtr, dReal> knn = _FindNearestNode(vquerystate, distancebound, conftype);
+    if( !knn.first ) {
+        return -1;
+    }
+    vstate.resize(_statedof);
+    std::copy(knn.first->GetConfigurationState(), knn.first->GetConfigurationState()+_statedof, vstate.begin());
+    return knn.second;
+}
+
+std::pair<CacheTreeNodeConstPtr, dReal> CacheTree::_FindNearestNode(const std::vector<dReal>& vquerystate, dReal distancebound, ConfigurationNodeType conftype) const
 {
     if( _numnodes == 0 ) {
         return make_pair(CacheTreeNodeConstPtr(), dReal(0));
@@ -285,12 +476,16 @@ std::pair<CacheTreeNodeConstPtr, dReal> CacheTree::FindNearestNode(const std::ve
     OPENRAVE_ASSERT_OP(vquerystate.size(),==,_weights.size());
     const dReal* pquerystate = &vquerystate[0];
 
+    NearestNodeBuffersScope buffersscope(*this);
+    std::vector< std::pair<CacheTreeNodePtr, dReal> >& _vCurrentLevelNodes = buffersscope.buffers.vCurrentLevelNodes;
+    std::vector< std::pair<CacheTreeNodePtr, dReal> >& _vNextLevelNodes = buffersscope.buffers.vNextLevelNodes;
+    std::vector<dReal>& vChildDistances = buffersscope.buffers.vChildDistances;
     dReal distancebound2 = Sqr(distancebound);
     int currentlevel = _maxlevel; // where the root node is
     // traverse all levels gathering up the children at each level
     dReal fLevelBound2 = Sqr(_fMaxLevelBound);
     _vCurrentLevelNodes.resize(1);
-    _vCurrentLevelNodes[0].first = *_vsetLevelNodes.at(_EncodeLevel(_maxlevel)).begin();
+    _vCurrentLevelNodes[0].first = _vvLevelNodes.at(_EncodeLevel(_maxlevel)).at(0);
     _vCurrentLevelNodes[0].second = _ComputeDistance2(pquerystate, _vCurrentLevelNodes[0].first->GetConfigurationState());
     if( (conftype == CNT_Any || _vCurrentLevelNodes[0].first->GetType() == conftype) && _vCurrentLevelNodes[0].first->_usenn ) {
         pbestnode = _vCurrentLevelNodes[0].first;
@@ -300,20 +495,32 @@ std::pair<CacheTreeNodeConstPtr, dReal> CacheTree::FindNearestNode(const std::ve
         _vNextLevelNodes.resize(0);
         dReal minchilddist2 = std::numeric_limits<dReal>::infinity();
         FOREACH(itcurrentnode, _vCurrentLevelNodes) {
+            if( itcurrentnode->first->_mappedindex >= 0 ) {
+                _MaterializeChildrenShared(itcurrentnode->first);
+            }
+            const std::vector<CacheTreeNodePtr>& vchildren = itcurrentnode->first->_vchildren;
+            if( vchildren.size() == 0 ) {
+                continue;
+            }
+            if( vChildDistances.size() < vchildren.size() ) {
+                vChildDistances.resize(vchildren.size());
+            }
+            _ComputeChildDistances2(itcurrentnode->first, pquerystate, &vChildDistances[0]);
             // only take the children whose distances are within the bound
-            FOREACHC(itchild, itcurrentnode->first->_vchildren) {
-                dReal curdist2 = _ComputeDistance2(pquerystate, (*itchild)->GetConfigurationState());
+            for(size_t ichild = 0; ichild < vchildren.size(); ++ichild) {
+                CacheTreeNodePtr pchild = vchildren[ichild];
+                dReal curdist2 = vChildDistances[ichild];
                 if( curdist2 < bestdist2 ) {
-                    if( (*itchild)->_usenn && (conftype == CNT_Any || (*itchild)->GetType() == conftype) ) {
+                    if( pchild->_usenn && (conftype == CNT_Any || pchild->GetType() == conftype) ) {
                         bestdist2 = curdist2;
-                        pbestnode = *itchild;
+                        pbestnode = pchild;
                         if( distancebound > 0 && bestdist2 <= distancebound2 ) {
-                            (*itchild)->IncreaseHitCount();
+                            pchild->IncreaseHitCount();
                             return make_pair(pbestnode, RaveSqrt(bestdist2));
                         }
                     }
                 }
-                _vNextLevelNodes.push_back(make_pair(*itchild, curdist2));
+                _vNextLevelNodes.push_back(make_pair(pchild, curdist2));
                 if( minchilddist2 > curdist2 ) {
                     minchilddist2 = curdist2;
                 }
@@ -341,7 +548,7 @@ std::pair<CacheTreeNodeConstPtr, dReal> CacheTree::FindNearestNode(const std::ve
     return make_pair(CacheTreeNodeConstPtr(), dReal(0));
 }
 
-std::pair<CacheTreeNodeConstPtr, dReal> CacheTree::FindNearestNode(const std::vector<dReal>& vquerystate, dReal collisionthresh, dReal freespacethresh) const
+std::pair<CacheTreeNodeConstPtr, dReal> CacheTree::_FindNearestNode(const std::vector<dReal>& vquerystate, dReal collisionthresh, dReal freespacethresh) const
 {
     std::pair<CacheTreeNodeConstPtr, dReal> bestnode;
     bestnode.first = NULL;
@@ -351,15 +558,20 @@ std::pair<CacheTreeNodeConstPtr, dReal> CacheTree::FindNearestNode(const std::ve
     }
 
     OPENRAVE_ASSERT_OP(vquerystate.size(),==,_weights.size());
+    NearestNodeBuffersScope buffersscope(*this);
+    std::vector< std::pair<CacheTreeNodePtr, dReal> >& _vCurrentLevelNodes = buffersscope.buffers.vCurrentLevelNodes;
+    std::vector< std::pair<CacheTreeNodePtr, dReal> >& _vNextLevelNodes = buffersscope.buffers.vNextLevelNodes;
+    std::vector<dReal>& vChildDistances = buffersscope.buffers.vChildDistances;
     // first localmax is distance from this node to the root
     const dReal* pquerystate = &vquerystate[0];
 
     dReal collisionthresh2 = Sqr(collisionthresh), freespacethresh2 = Sqr(freespacethresh);
+    dReal maxthresh2 = max(collisionthresh2, freespacethresh2);
     // traverse all levels gathering up the children at each level
     int currentlevel = _maxlevel; // where the root node is
     dReal fLevelBound = _fMaxLevelBound;
     {
-        CacheTreeNodePtr proot = *_vsetLevelNodes.at(_EncodeLevel(_maxlevel)).begin();
+        CacheTreeNodePtr proot = _vvLevelNodes.at(_EncodeLevel(_maxlevel)).at(0);
         dReal curdist2 = _ComputeDistance2(pquerystate, proot->GetConfigurationState());
         if( proot->_usenn ) {
             ConfigurationNodeType cntype = proot->GetType();
@@ -384,25 +596,38 @@ std::pair<CacheTreeNodeConstPtr, dReal> CacheTree::FindNearestNode(const std::ve
             if( itcurrentnode->second > pruneradius2 ) {
                 continue;
             }
+            if( itcurrentnode->first->_mappedindex >= 0 ) {
+                _MaterializeChildrenShared(itcurrentnode->first);
+            }
+            const std::vector<CacheTreeNodePtr>& vchildren = itcurrentnode->first->_vchildren;
+            if( vchildren.size() == 0 ) {
+                continue;
+            }
+            if( vChildDistances.size() < vchildren.size() ) {
+                vChildDistances.resize(vchildren.size());
+            }
+            _ComputeChildDistances2(itcurrentnode->first, pquerystate, &vChildDistances[0]);
             dReal comparedist2 = Sqr(minchilddist + fLevelBound);
             // only take the children whose distances are within the bound
-            FOREACHC(itchild, itcurrentnode->first->_vchildren) {
-                dReal curdist2 = _ComputeDistance2(pquerystate, (*itchild)->GetConfigurationState());
-                if( (*itchild)->_usenn ) {
-                    ConfigurationNodeType cntype = (*itchild)->GetType();
+            for(size_t ichild = 0; ichild < vchildren.size(); ++ichild) {
+                CacheTreeNodePtr pchild = vchildren[ichild];
+                dReal curdist2 = vChildDistances[ichild];
+                // only look at the node when it can be within the thresholds
+                if( curdist2 <= maxthresh2 && pchild->_usenn ) {
+                    ConfigurationNodeType cntype = pchild->GetType();
                     if( cntype == CNT_Collision && curdist2 <= collisionthresh2 ) {
-                        (*itchild)->_hitcount++;
-                        return make_pair(*itchild, RaveSqrt(curdist2));
+                        pchild->_hitcount++;
+                        return make_pair(pchild, RaveSqrt(curdist2));
                     }
                     else if( cntype == CNT_Free && curdist2 <= freespacethresh2 ) {
                         // there still could be a node lower in the hierarchy whose collision is closer...
                         if( curdist2 < bestnode.second ) {
-                            bestnode = make_pair(*itchild, curdist2);
+                            bestnode = make_pair(pchild, curdist2);
                         }
                     }
                 }
                 if( curdist2 < comparedist2 ) {
-                    _vNextLevelNodes.push_back(make_pair(*itchild, curdist2));
+                    _vNextLevelNodes.push_back(make_pair(pchild, curdist2));
                     if( Sqr(minchilddist) > curdist2 ) {
                         minchilddist = RaveSqrt(curdist2);
                         comparedist2 = Sqr(minchilddist + fLevelBound);
@@ -424,27 +649,32 @@ std::pair<CacheTreeNodeConstPtr, dReal> CacheTree::FindNearestNode(const std::ve
     return bestnode;
 }
 
-int CacheTree::InsertNode(const std::vector<dReal>& cs, CollisionReportPtr report, dReal fMinSeparationDist)
+int CacheTree::InsertNode(const std::vector<dReal>& cs, CollisionReportPtr report, dReal fMinSeparationDist, const std::vector<AABB>& vlinkaabbs)
 {
+    boost::unique_lock<boost::shared_mutex> lock(_mutex);
 
     OPENRAVE_ASSERT_OP(cs.size(),==,_weights.size());
-    CacheTreeNodePtr nodein = _CreateCacheTreeNode(cs, report);
+    CacheTreeNodePtr nodein = _CreateCacheTreeNode(cs, report, vlinkaabbs);
     // if there is no root, make this the root, otherwise call the lowlevel  insert
     if( _numnodes == 0 ) {
         // no root
-        _vsetLevelNodes.at(_EncodeLevel(_maxlevel)).insert(nodein); // add to the level
-        _numnodes += 1;
         nodein->_level = _maxlevel;
+        _AddLevelNode(nodein); // add to the level
+        _numnodes += 1;
+        _AddToWorkspaceIndex(nodein);
         return 1;
     }
 
     _vCurrentLevelNodes.resize(1);
-    _vCurrentLevelNodes[0].first = *_vsetLevelNodes.at(_EncodeLevel(_maxlevel)).begin();
+    _vCurrentLevelNodes[0].first = _vvLevelNodes.at(_EncodeLevel(_maxlevel)).at(0);
     _vCurrentLevelNodes[0].second = _ComputeDistance2(_vCurrentLevelNodes[0].first->GetConfigurationState(), &cs[0]);
     int nParentFound = _Insert(nodein, _vCurrentLevelNodes, _maxlevel, Sqr(_fMaxLevelBound), Sqr(fMinSeparationDist));
     if( nParentFound != 1 ) {
         _DeleteCacheTreeNode(nodein);
     }
+    else {
+        _AddToWorkspaceIndex(nodein);
+    }
     return nParentFound;
 }
 
@@ -460,7 +690,7 @@ int CacheTree::_Insert(CacheTreeNodePtr nodein, const std::vector< std::pair<Cac
     int enclevel = _EncodeLevel(currentlevel);
     dReal fChildLevelBound2 = fLevelBound2*Sqr(_fBaseChildMult);
     dReal fEpsilon = g_fEpsilon*_maxdistance; // min distance
-    if( enclevel < (int)_vsetLevelNodes.size() ) {
+    if( enclevel < (int)_vvLevelNodes.size() ) {
         // build the level below
         _vNextLevelNodes.resize(0);
         FOREACHC(itcurrentnode, vCurrentLevelNodes) {
@@ -490,11 +720,18 @@ int CacheTree::_Insert(CacheTreeNodePtr nodein, const std::vector< std::pair<Cac
                 _vNextLevelNodes.push_back(*itcurrentnode);
             }
             // only take the children whose distances are within the bound
-            if( itcurrentnode->first->_level == currentlevel ) {
-                FOREACHC(itchild, itcurrentnode->first->_vchildren) {
-                    dReal curdist = _ComputeDistance2(nodein->GetConfigurationState(), (*itchild)->GetConfigurationState());
-                    if( curdist <= fChildLevelBound2 ) {
-                        _vNextLevelNodes.push_back(make_pair(*itchild, curdist));
+            if( itcurrentnode->first->_level == currentlevel && itcurrentnode->first->_mappedindex >= 0 ) {
+                _MaterializeChildren(itcurrentnode->first);
+            }
+            if( itcurrentnode->first->_level == currentlevel && itcurrentnode->first->_vchildren.size() > 0 ) {
+                const std::vector<CacheTreeNodePtr>& vchildren = itcurrentnode->first->_vchildren;
+                if( _vChildDistances.size() < vchildren.size() ) {
+                    _vChildDistances.resize(vchildren.size());
+                }
+                _ComputeChildDistances2(itcurrentnode->first, nodein->GetConfigurationState(), &_vChildDistances[0]);
+                for(size_t ichild = 0; ichild < vchildren.size(); ++ichild) {
+                    if( _vChildDistances[ichild] <= fChildLevelBound2 ) {
+                        _vNextLevelNodes.push_back(make_pair(vchildren[ichild], _vChildDistances[ichild]));
                     }
                 }
             }
@@ -549,6 +786,9 @@ bool CacheTree::_InsertDirectly(CacheTreeNodePtr nodein, CacheTreeNodePtr parent
 {
     int insertlevel = maxinsertlevel;
     dReal fEpsilon = g_fEpsilon*_maxdistance; // min distance
+    if( parentnode->_mappedindex >= 0 ) {
+        _MaterializeChildren(parentnode);
+    }
     if( parentdist <= fEpsilon ) {
         // pretty close, so notify parent that there's a similar child already underneath it
         if( parentnode->_hasselfchild ) {
@@ -576,14 +816,11 @@ bool CacheTree::_InsertDirectly(CacheTreeNodePtr nodein, CacheTreeNodePtr parent
     while( parentnode->_level > insertlevel+1 ) {
         CacheTreeNodePtr clonenode = _CloneCacheTreeNode(parentnode);
         clonenode->_level = parentnode->_level-1;
-        parentnode->_vchildren.push_back(clonenode);
+        _AddChild(parentnode, clonenode);
         parentnode->_hasselfchild = 1;
-        int encclonelevel = _EncodeLevel(clonenode->_level);
-        if( encclonelevel >= (int)_vsetLevelNodes.size() ) {
-            _vsetLevelNodes.resize(encclonelevel+1);
-        }
-        _vsetLevelNodes.at(encclonelevel).insert(clonenode);
+        _AddLevelNode(clonenode);
         _numnodes +=1;
+        _AddToWorkspaceIndex(clonenode);
         parentnode = clonenode;
     }
 
@@ -591,12 +828,8 @@ bool CacheTree::_InsertDirectly(CacheTreeNodePtr nodein, CacheTreeNodePtr parent
         parentnode->_hasselfchild = 1;
     }
     nodein->_level = insertlevel;
-    int enclevel2 = _EncodeLevel(nodein->_level);
-    if( enclevel2 >= (int)_vsetLevelNodes.size() ) {
-        _vsetLevelNodes.resize(enclevel2+1);
-    }
-    _vsetLevelNodes.at(enclevel2).insert(nodein);
-    parentnode->_vchildren.push_back(nodein);
+    _AddLevelNode(nodein);
+    _AddChild(parentnode, nodein);
 
     if( _minlevel > nodein->_level ) {
         _minlevel = nodein->_level;
@@ -606,15 +839,57 @@ bool CacheTree::_InsertDirectly(CacheTreeNodePtr nodein, CacheTreeNodePtr parent
 
 bool CacheTree::RemoveNode(CacheTreeNodeConstPtr _removenode)
 {
+    boost::unique_lock<boost::shared_mutex> lock(_mutex);
     if( _numnodes == 0 ) {
         return false;
     }
 
     CacheTreeNodePtr removenode = const_cast<CacheTreeNodePtr>(_removenode);
+    _MaterializeAll();
+
+    // the clones of the node at the levels below have to be removed first, otherwise they would be moved up in its place
+    dReal fEpsilon = g_fEpsilon*_maxdistance;
+    std::vector<CacheTreeNodePtr> vclones(1, removenode);
+    while( vclones.back()->_hasselfchild ) {
+        CacheTreeNodePtr pselfchild = NULL;
+        FOREACH(itchild, vclones.back()->_vchildren) {
+            if( _ComputeDistance2(removenode->GetConfigurationState(), (*itchild)->GetConfigurationState()) <= fEpsilon ) {
+                pselfchild = *itchild;
+                break;
+            }
+        }
+        if( !pselfchild ) {
+            break;
+        }
+        vclones.push_back(pselfchild);
+    }
 
-    CacheTreeNodePtr proot = *_vsetLevelNodes.at(_EncodeLevel(_maxlevel)).begin();
+    bool bRemoved = false;
+    while( vclones.size() > 0 ) {
+        if( !_RemoveNode(vclones.back()) ) {
+            break;
+        }
+        bRemoved = true;
+        vclones.pop_back();
+        if( vclones.size() > 0 ) {
+            CacheTreeNodePtr pnode = vclones.back();
+            pnode->_hasselfchild = 0;
+            FOREACH(itchild, pnode->_vchildren) {
+                if( _ComputeDistance2(pnode->GetConfigurationState(), (*itchild)->GetConfigurationState()) <= fEpsilon ) {
+                    pnode->_hasselfchild = 1;
+                    break;
+                }
+            }
+        }
+    }
+    return bRemoved;
+}
+
+bool CacheTree::_RemoveNode(CacheTreeNodePtr removenode)
+{
+    CacheTreeNodePtr proot = _vvLevelNodes.at(_EncodeLevel(_maxlevel)).at(0);
     if( _numnodes == 1 && removenode == proot ) {
-        Reset();
+        _Reset();
         return true;
     }
 
@@ -627,15 +902,13 @@ bool CacheTree::RemoveNode(CacheTreeNodeConstPtr _removenode)
     _vvCacheNodes.at(0).push_back(proot);
     bool bRemoved = _Remove(removenode, _vvCacheNodes, _maxlevel, Sqr(_fMaxLevelBound));
     if( bRemoved ) {
+        _RemoveFromWorkspaceIndex(removenode);
         _DeleteCacheTreeNode(removenode);
     }
     if( removenode == proot ) {
-        BOOST_ASSERT(_vvCacheNodes.at(0).size()==2); // instead of root, another node should have been added
-        BOOST_ASSERT(_vsetLevelNodes.at(_EncodeLevel(_maxlevel)).size()==1);
-        //_vsetLevelNodes.at(_EncodeLevel(_maxlevel)).clear();
-        _vsetLevelNodes.at(_EncodeLevel(_maxlevel)).erase(proot);
-        bRemoved = true;
-        _numnodes--;
+        // _Remove already removed the root from its level, instead of root, another node should have been added
+        BOOST_ASSERT(_vvCacheNodes.at(0).size()==2);
+        BOOST_ASSERT(_vvLevelNodes.at(_EncodeLevel(_maxlevel)).size()==1);
     }
 
     return bRemoved;
@@ -644,12 +917,11 @@ bool CacheTree::RemoveNode(CacheTreeNodeConstPtr _removenode)
 bool CacheTree::_Remove(CacheTreeNodePtr removenode, std::vector< std::vector<CacheTreeNodePtr> >& vvCoverSetNodes, int currentlevel, dReal fLevelBound2)
 {
     int enclevel = _EncodeLevel(currentlevel);
-    if( enclevel >= (int)_vsetLevelNodes.size() ) {
+    if( enclevel >= (int)_vvLevelNodes.size() ) {
         return false;
     }
 
     // build the level below
-    std::set<CacheTreeNodePtr>& setLevelRawChildren = _vsetLevelNodes.at(enclevel);
     int coverindex = _maxlevel-(currentlevel-1);
     if( coverindex >= (int)vvCoverSetNodes.size() ) {
         vvCoverSetNodes.resize(coverindex+(_maxlevel-_minlevel)+1);
@@ -660,21 +932,22 @@ bool CacheTree::_Remove(CacheTreeNodePtr removenode, std::vector< std::vector<Ca
     bool bfound = false;
     FOREACH(itcurrentnode, vvCoverSetNodes.at(coverindex-1)) {
         // only take the children whose distances are within the bound
-        if( setLevelRawChildren.find(*itcurrentnode) != setLevelRawChildren.end() ) {
-            std::vector<CacheTreeNodePtr>::iterator itchild = (*itcurrentnode)->_vchildren.begin();
-            while(itchild != (*itcurrentnode)->_vchildren.end() ) {
-                dReal curdist = _ComputeDistance2(removenode->GetConfigurationState(), (*itchild)->GetConfigurationState());
-                if( *itchild == removenode ) {
+        if( (*itcurrentnode)->_level == currentlevel ) {
+            size_t ichild = 0;
+            while(ichild < (*itcurrentnode)->_vchildren.size() ) {
+                CacheTreeNodePtr pchild = (*itcurrentnode)->_vchildren[ichild];
+                if( pchild == removenode ) {
                     vNextLevelNodes.resize(0);
-                    vNextLevelNodes.push_back(*itchild);
-                    itchild = (*itcurrentnode)->_vchildren.erase(itchild);
+                    vNextLevelNodes.push_back(pchild);
+                    _RemoveChild(*itcurrentnode, ichild); // the last child moves to ichild
                     bfound = true;
                 }
                 else {
+                    dReal curdist = _ComputeDistance2(removenode->GetConfigurationState(), pchild->GetConfigurationState());
                     if( curdist <= fLevelBound2 ) {
-                        vNextLevelNodes.push_back(*itchild);
+                        vNextLevelNodes.push_back(pchild);
                     }
-                    ++itchild;
+                    ++ichild;
                 }
             }
         }
@@ -704,28 +977,13 @@ bool CacheTree::_Remove(CacheTreeNodePtr removenode, std::vector< std::vector<Ca
                     }
                 }
                 if( !!closestNode ) {
-                    CacheTreeNodePtr nodechild = *itchild;
-                    while( nodechild->_level < closestNode->_level-1 ) {
-                        CacheTreeNodePtr clonenode = _CloneCacheTreeNode(nodechild);
-                        clonenode->_level = nodechild->_level+1;
-                        clonenode->_vchildren.push_back(nodechild);
-                        clonenode->_hasselfchild = 1;
-                        int encclonelevel = _EncodeLevel(clonenode->_level);
-                        if( encclonelevel >= (int)_vsetLevelNodes.size() ) {
-                            _vsetLevelNodes.resize(encclonelevel+1);
-                        }
-                        _vsetLevelNodes.at(encclonelevel).insert(clonenode);
-                        _numnodes +=1;
-                        vvCoverSetNodes.at(_maxlevel-clonenode->_level).push_back(clonenode);
-                        nodechild = clonenode;
-                    }
+                    CacheTreeNodePtr nodechild = _CloneCacheTreeNodeUpTo(*itchild, closestNode->_level-1, vvCoverSetNodes);
 
                     if( closestdist <= fEpsilon ) {
                         closestNode->_hasselfchild = 1;
                     }
 
-                    //_vsetLevelNodes.at(enclevel2).insert(nodechild);
-                    closestNode->_vchildren.push_back(nodechild);
+                    _AddChild(closestNode, nodechild);
 
                     // closest node was found in parentlevel, so add to the children
                     break;
@@ -737,27 +995,46 @@ bool CacheTree::_Remove(CacheTreeNodePtr removenode, std::vector< std::vector<Ca
             }
             if( !closestNode ) {
                 BOOST_ASSERT(parentlevel>_maxlevel);
-                // occurs when root node is being removed and new children have no where to go?
-                _vsetLevelNodes.at(_EncodeLevel(_maxlevel)).insert(*itchild);
-                vvCoverSetNodes.at(0).push_back(*itchild);
+                // occurs when root node is being removed and new children have no where to go, so the child becomes the new root
+                CacheTreeNodePtr nodechild = _CloneCacheTreeNodeUpTo(*itchild, _maxlevel, vvCoverSetNodes);
+                if( nodechild == *itchild ) {
+                    vvCoverSetNodes.at(0).push_back(nodechild);
+                }
             }
         }
         // remove the node
-        size_t erased = setLevelRawChildren.erase(removenode);
-        BOOST_ASSERT(erased==1);
+        _RemoveLevelNode(removenode);
         bRemoved = true;
         _numnodes--;
     }
     return bRemoved;
 }
 
+CacheTreeNodePtr CacheTree::_CloneCacheTreeNodeUpTo(CacheTreeNodePtr pnode, int level, std::vector< std::vector<CacheTreeNodePtr> >& vvCoverSetNodes)
+{
+    while( pnode->_level < level ) {
+        CacheTreeNodePtr clonenode = _CloneCacheTreeNode(pnode);
+        clonenode->_level = pnode->_level+1;
+        _AddChild(clonenode, pnode);
+        clonenode->_hasselfchild = 1;
+        _AddLevelNode(clonenode);
+        _numnodes +=1;
+        _AddToWorkspaceIndex(clonenode);
+        vvCoverSetNodes.at(_maxlevel-clonenode->_level).push_back(clonenode);
+        pnode = clonenode;
+    }
+    return pnode;
+}
+
 void CacheTree::GetNodeValues(std::vector<dReal>& vals) const
 {
+    boost::shared_lock<boost::shared_mutex> lock(_mutex);
+    _MaterializeAllShared();
     vals.resize(0);
     if( (int)vals.capacity() < _numnodes*_statedof) {
         vals.reserve(_numnodes*_statedof);
     }
-    FOREACH(itlevelnodes, _vsetLevelNodes) {
+    FOREACH(itlevelnodes, _vvLevelNodes) {
         FOREACH(itnode, *itlevelnodes) {
             vals.insert(vals.end(), (*itnode)->GetConfigurationState(), (*itnode)->GetConfigurationState()+_statedof);
         }
@@ -766,19 +1043,23 @@ void CacheTree::GetNodeValues(std::vector<dReal>& vals) const
 
 void CacheTree::GetNodeValuesList(std::vector<CacheTreeNodePtr>& lvals)
 {
+    boost::shared_lock<boost::shared_mutex> lock(_mutex);
+    _MaterializeAllShared();
     lvals.resize(0);
     if (_numnodes > 0) {
-        FOREACH(itlevelnodes, _vsetLevelNodes) {
+        FOREACH(itlevelnodes, _vvLevelNodes) {
             lvals.insert(lvals.end(), itlevelnodes->begin(), itlevelnodes->end());
         }
     }
 }
 int CacheTree::RemoveCollisionConfigurations()
 {
+    boost::unique_lock<boost::shared_mutex> lock(_mutex);
+    _MaterializeAll();
 
     int nremoved=0;
     if (_numnodes > 0) {
-        FOREACH(itlevelnodes, _vsetLevelNodes) {
+        FOREACH(itlevelnodes, _vvLevelNodes) {
             FOREACH(itnode, *itlevelnodes) {
                 (*itnode)->SetType(CNT_Unknown);
                 nremoved += 1;
@@ -788,212 +1069,716 @@ int CacheTree::RemoveCollisionConfigurations()
     return nremoved;
 }
 
-int CacheTree::SaveCache(std::string filename)
-{
-    //boost::mutex::scoped_lock lock(_mutexpool);
-    _mapNodeIndices.clear();
-    int index=0;
-    int knownnodes=0;
-    FOREACH(itlevelnodes, _vsetLevelNodes) {
-        FOREACH(itnode, *itlevelnodes) {
-            if( (*itnode)->_conftype != CNT_Unknown) {
-                knownnodes++;
-            }
-            _mapNodeIndices[*itnode] = index++;
-        }
-    }
+static const char s_CacheFileMagic[8] = {'O','R','C','A','C','H','E','\0'};
+static const uint32_t s_CacheFileVersion = 1;
+static const int32_t s_CacheFileMaxLevel = 1024; ///< bound on the levels of a cache file, a tree with a base > 1 never gets close to it
 
-    _numnodes = knownnodes;
-    _fulldirname = RaveFindDatabaseFile(std::string("selfcache.")+filename,false);
+/// \brief the header of the cache files written by CacheTree::SaveCache
+///
+/// The header is followed by the sections at the given offsets: the weights, the node records, the children indices, the states, the link aabbs and the colliding body names. Every section starts at a multiple of 8 bytes, so the file can be mapped and read in place.
+struct CacheFileHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t realsize; ///< sizeof(dReal) of the writer
+    int32_t statedof;
+    int32_t numlinkaabbs; ///< 0 if the file has no link aabbs
+    int32_t numnodes, numknownnodes;
+    int32_t rootindex; ///< the record of the root
+    int32_t numbodies; ///< number of colliding body names
+    int32_t maxlevel, minlevel;
+    dReal maxdistance, base, fMaxLevelBound;
+    char robothash[64]; ///< robot kinematics and geometry the cache was built for
+    char envhash[64]; ///< environment geometry the cache was built for, empty if it does not depend on it
+    uint64_t weightsoffset, nodesoffset, childrenoffset, statesoffset, linkaabbsoffset, bodiesoffset, filesize;
+};
+
+struct CacheTree::CacheFileNode
+{
+    int32_t level;
+    int32_t conftype;
+    int32_t firstchild; ///< index of the first child in the children indices, the children of a node are consecutive
+    int32_t numchildren;
+    int32_t collidingbodyindex; ///< index of the colliding body name, -1 if none
+    int32_t collidinglinkindex;
+    int32_t robotlinkindex;
+    uint8_t hasselfchild, usenn, haslinkaabbs, reserved;
+};
+
+static inline uint64_t AlignCacheFileOffset(uint64_t offset)
+{
+    return (offset+7)&~uint64_t(7);
+}
 
-    RAVELOG_DEBUG_FORMAT("Writing cache to %s, size=%d", _fulldirname%_numnodes);
-    
-    FILE* pfile;
-    pfile = fopen(_fulldirname.c_str(),"wb");
-
-    fwrite(&_statedof, sizeof(_statedof), 1, pfile);
-    fwrite(&_weights[0], sizeof(_weights[0])*_weights.size(), 1, pfile);
-    fwrite(&_base, sizeof(_base), 1, pfile);
-    fwrite(&_fBaseInv, sizeof(_fBaseInv), 1, pfile);
-    fwrite(&_fBaseInv2, sizeof(_fBaseInv2), 1, pfile);
-    fwrite(&_fBaseChildMult, sizeof(_fBaseChildMult), 1, pfile);
-    fwrite(&_maxdistance, sizeof(_maxdistance), 1, pfile);
-    fwrite(&_maxlevel, sizeof(_maxlevel), 1, pfile);
-    fwrite(&_minlevel, sizeof(_minlevel), 1, pfile);
-    fwrite(&_numnodes, sizeof(_numnodes), 1, pfile);
-    fwrite(&_fMaxLevelBound, sizeof(_fMaxLevelBound), 1, pfile);
-
-    FOREACH(itlevelnodes, _vsetLevelNodes) {
-        FOREACH(itnode, *itlevelnodes) {
-            _newnode = *itnode;
-            // TODO save only configuration != CNT_Unknown without losing the validity of the tree
-            if (true) { //_newnode->_conftype != CNT_Unknown) {
-                fwrite(&_newnode->_level, sizeof(_newnode->_level), 1, pfile);
-                fwrite(_newnode->GetConfigurationState(), sizeof(dReal)*_statedof, 1, pfile);
-                fwrite(&_newnode->_conftype, sizeof(_newnode->_conftype), 1, pfile);
-
-                if (_newnode->_conftype == CNT_Collision ) {
-                    // note, this assumes the colliding body name never changes across environments, which is a false assumption
-                    _collidingbodyname = _newnode->GetCollidingLink()->GetParent()->GetName();
-                    int namelength = _collidingbodyname.size();
-                    fwrite(&namelength, sizeof(namelength), 1, pfile);
-                    fwrite(_collidingbodyname.c_str(), _collidingbodyname.size(), 1, pfile);
-                    int linkindex = _newnode->GetCollidingLink()->GetIndex();
-                    fwrite(&linkindex, sizeof(linkindex), 1, pfile);
-                    fwrite(&_newnode->_robotlinkindex, sizeof(_newnode->_robotlinkindex), 1, pfile);
-                }
+/// \brief writes size bytes and pads the file up to the next offset
+static void WriteCacheFileSection(std::ofstream& f, const void* pdata, uint64_t size, uint64_t nextoffset)
+{
+    if( size > 0 ) {
+        f.write((const char*)pdata, size);
+    }
+    for(uint64_t offset = (uint64_t)f.tellp(); offset < nextoffset; ++offset) {
+        f.put(0);
+    }
+}
 
-                fwrite(&_newnode->_hasselfchild, sizeof(_newnode->_hasselfchild), 1, pfile);
-                fwrite(&_newnode->_usenn, sizeof(_newnode->_usenn), 1, pfile);
-                int numchildren = _newnode->_vchildren.size();
-                fwrite(&numchildren, sizeof(numchildren), 1, pfile);
+int CacheTree::SaveCache(std::string filename, const std::string& robothash, const std::string& envhash)
+{
+    boost::unique_lock<boost::shared_mutex> lock(_mutex);
+    _MaterializeAll();
+    if( _numnodes == 0 ) {
+        return 0;
+    }
+    if( robothash.size() >= sizeof(CacheFileHeader().robothash) || envhash.size() >= sizeof(CacheFileHeader().envhash) ) {
+        throw OPENRAVE_EXCEPTION_FORMAT0("cache hashes are too long", ORE_InvalidArguments);
+    }
 
-                FOREACHC(itchild, (*itnode)->_vchildren) {
-                    int cindex = _mapNodeIndices[*itchild];
-                    fwrite(&cindex, sizeof(cindex), 1, pfile);
+    // nodes are written level by level, so the index of a node in the file is the offset of its level plus its _levelindex
+    std::vector<int> vlevelfileoffsets(_vvLevelNodes.size(), 0);
+    int numnodes = 0, numknownnodes = 0, numchildren = 0;
+    for(size_t enclevel = 0; enclevel < _vvLevelNodes.size(); ++enclevel) {
+        vlevelfileoffsets[enclevel] = numnodes;
+        numnodes += (int)_vvLevelNodes[enclevel].size();
+        FOREACHC(itnode, _vvLevelNodes[enclevel]) {
+            if( (*itnode)->_conftype != CNT_Unknown ) {
+                ++numknownnodes;
+            }
+            numchildren += (int)(*itnode)->_vchildren.size();
+        }
+    }
+    BOOST_ASSERT(numnodes == _numnodes);
+
+    std::vector<CacheFileNode> vnoderecords(numnodes);
+    std::vector<int32_t> vchildindices; vchildindices.reserve(numchildren);
+    std::vector<dReal> vstates; vstates.reserve((size_t)numnodes*_statedof);
+    std::vector<dReal> vlinkaabbs; vlinkaabbs.reserve(_numlinkaabbs > 0 ? (size_t)numnodes*_numlinkaabbs*6 : 0);
+    std::vector<std::string> vbodynames;
+    std::map<std::string, int> mapbodyindices;
+    int inode = 0;
+    FOREACHC(itlevelnodes, _vvLevelNodes) {
+        FOREACHC(itnode, *itlevelnodes) {
+            CacheTreeNodeConstPtr pnode = *itnode;
+            CacheFileNode& record = vnoderecords[inode++];
+            record.level = pnode->_level;
+            record.conftype = pnode->_conftype;
+            record.firstchild = (int32_t)vchildindices.size();
+            record.numchildren = (int32_t)pnode->_vchildren.size();
+            record.collidingbodyindex = -1;
+            record.collidinglinkindex = -1;
+            record.robotlinkindex = pnode->_robotlinkindex;
+            record.hasselfchild = pnode->_hasselfchild;
+            record.usenn = pnode->_usenn;
+            record.haslinkaabbs = !!pnode->_plinkaabbs;
+            record.reserved = 0;
+            if( pnode->_conftype == CNT_Collision && !!pnode->GetCollidingLink() ) {
+                // note, this assumes the colliding body name never changes across environments
+                const std::string& bodyname = pnode->GetCollidingLink()->GetParent()->GetName();
+                std::map<std::string, int>::iterator itbody = mapbodyindices.find(bodyname);
+                if( itbody == mapbodyindices.end() ) {
+                    itbody = mapbodyindices.insert(std::make_pair(bodyname, (int)vbodynames.size())).first;
+                    vbodynames.push_back(bodyname);
                 }
+                record.collidingbodyindex = itbody->second;
+                record.collidinglinkindex = pnode->GetCollidingLink()->GetIndex();
+            }
+            FOREACHC(itchild, pnode->_vchildren) {
+                vchildindices.push_back(vlevelfileoffsets.at(_EncodeLevel((*itchild)->_level)) + (*itchild)->_levelindex);
+            }
+            vstates.insert(vstates.end(), pnode->GetConfigurationState(), pnode->GetConfigurationState()+_statedof);
+            for(int iaabb = 0; iaabb < _numlinkaabbs; ++iaabb) {
+                AABB ab = !!pnode->_plinkaabbs ? pnode->_plinkaabbs[iaabb] : AABB();
+                dReal values[6] = {ab.pos.x, ab.pos.y, ab.pos.z, ab.extents.x, ab.extents.y, ab.extents.z};
+                vlinkaabbs.insert(vlinkaabbs.end(), values, values+6);
             }
         }
     }
 
-    fclose(pfile);
+    std::string sbodynames;
+    FOREACHC(itname, vbodynames) {
+        sbodynames.append(itname->c_str(), itname->size()+1);
+    }
+
+    CacheFileHeader header;
+    memset(&header, 0, sizeof(header));
+    std::copy(s_CacheFileMagic, s_CacheFileMagic+sizeof(s_CacheFileMagic), header.magic);
+    header.version = s_CacheFileVersion;
+    header.realsize = sizeof(dReal);
+    header.statedof = _statedof;
+    header.numlinkaabbs = _numlinkaabbs;
+    header.numnodes = numnodes;
+    header.numknownnodes = numknownnodes;
+    CacheTreeNodeConstPtr proot = _vvLevelNodes.at(_EncodeLevel(_maxlevel)).at(0);
+    header.rootindex = vlevelfileoffsets.at(_EncodeLevel(_maxlevel)) + proot->_levelindex;
+    header.numbodies = (int32_t)vbodynames.size();
+    header.maxlevel = _maxlevel;
+    header.minlevel = _minlevel;
+    header.maxdistance = _maxdistance;
+    header.base = _base;
+    header.fMaxLevelBound = _fMaxLevelBound;
+    std::copy(robothash.begin(), robothash.end(), header.robothash);
+    std::copy(envhash.begin(), envhash.end(), header.envhash);
+    header.weightsoffset = AlignCacheFileOffset(sizeof(header));
+    header.nodesoffset = AlignCacheFileOffset(header.weightsoffset + sizeof(dReal)*_statedof);
+    header.childrenoffset = AlignCacheFileOffset(header.nodesoffset + sizeof(CacheFileNode)*vnoderecords.size());
+    header.statesoffset = AlignCacheFileOffset(header.childrenoffset + sizeof(int32_t)*vchildindices.size());
+    header.linkaabbsoffset = AlignCacheFileOffset(header.statesoffset + sizeof(dReal)*vstates.size());
+    header.bodiesoffset = AlignCacheFileOffset(header.linkaabbsoffset + sizeof(dReal)*vlinkaabbs.size());
+    header.filesize = header.bodiesoffset + sbodynames.size();
+
+    _fulldirname = RaveFindDatabaseFile(filename,false);
+    RAVELOG_DEBUG_FORMAT("Writing cache to %s, size=%d", _fulldirname%_numnodes);
 
+    // write to a temporary file first so that a reader never maps a partially written cache
+    std::string tempfilename = _fulldirname + ".tmp";
+    {
+        std::ofstream f(tempfilename.c_str(), std::ios::binary|std::ios::trunc);
+        if( !f ) {
+            RAVELOG_WARN_FORMAT("failed to open %s for writing the cache", tempfilename);
+            return 0;
+        }
+        WriteCacheFileSection(f, &header, sizeof(header), header.weightsoffset);
+        WriteCacheFileSection(f, &_weights[0], sizeof(dReal)*_statedof, header.nodesoffset);
+        WriteCacheFileSection(f, vnoderecords.size() > 0 ? &vnoderecords[0] : NULL, sizeof(CacheFileNode)*vnoderecords.size(), header.childrenoffset);
+        WriteCacheFileSection(f, vchildindices.size() > 0 ? &vchildindices[0] : NULL, sizeof(int32_t)*vchildindices.size(), header.statesoffset);
+        WriteCacheFileSection(f, vstates.size() > 0 ? &vstates[0] : NULL, sizeof(dReal)*vstates.size(), header.linkaabbsoffset);
+        WriteCacheFileSection(f, vlinkaabbs.size() > 0 ? &vlinkaabbs[0] : NULL, sizeof(dReal)*vlinkaabbs.size(), header.bodiesoffset);
+        WriteCacheFileSection(f, sbodynames.c_str(), sbodynames.size(), header.filesize);
+        if( !f ) {
+            RAVELOG_WARN_FORMAT("failed to write the cache to %s", tempfilename);
+            return 0;
+        }
+    }
+    if( std::rename(tempfilename.c_str(), _fulldirname.c_str()) != 0 ) {
+        RAVELOG_WARN_FORMAT("failed to move the cache to %s", _fulldirname);
+        std::remove(tempfilename.c_str());
+        return 0;
+    }
     return 1;
 }
 
-int CacheTree::LoadCache(std::string filename, EnvironmentBasePtr penv)
+int CacheTree::LoadCache(std::string filename, EnvironmentBasePtr penv, const std::string& robothash, const std::string& envhash)
 {
-    //boost::mutex::scoped_lock lock(_mutexpool);
-    _fulldirname = RaveFindDatabaseFile(std::string("selfcache.")+filename,false);
-
-    FILE* pfile = fopen(_fulldirname.c_str(),"rb");
-    size_t outs;
+    boost::unique_lock<boost::shared_mutex> lock(_mutex);
+    std::string fullfilename = RaveFindDatabaseFile(filename,false);
+    if( fullfilename.size() == 0 ) {
+        return 0;
+    }
 
-    if (!pfile) {
+    boost::shared_ptr<boost::interprocess::file_mapping> pmappedfile;
+    boost::shared_ptr<boost::interprocess::mapped_region> pmappedregion;
+    try {
+        pmappedfile.reset(new boost::interprocess::file_mapping(fullfilename.c_str(), boost::interprocess::read_only));
+        pmappedregion.reset(new boost::interprocess::mapped_region(*pmappedfile, boost::interprocess::read_only));
+    }
+    catch(const boost::interprocess::interprocess_exception& ex) {
+        RAVELOG_WARN_FORMAT("failed to map cache %s: %s", fullfilename%ex.what());
         return 0;
     }
 
-    Reset();
-    outs = fread(&_statedof, sizeof(_statedof), 1, pfile);
-
-    _weights.resize(_statedof,1.0);
-    _curconf.resize(_statedof,1.0);
-    outs = fread(&_weights[0], sizeof(_weights[0])*_weights.size(), 1, pfile);
-
-    outs = fread(&_base, sizeof(_base), 1, pfile);
-    outs = fread(&_fBaseInv, sizeof(_fBaseInv), 1, pfile);
-    outs = fread(&_fBaseInv2, sizeof(_fBaseInv2), 1, pfile);
-    outs = fread(&_fBaseChildMult, sizeof(_fBaseChildMult), 1, pfile);
-    outs = fread(&_maxdistance, sizeof(_maxdistance), 1, pfile);
-    outs = fread(&_maxlevel, sizeof(_maxlevel), 1, pfile);
-    outs = fread(&_minlevel, sizeof(_minlevel), 1, pfile);
-    outs = fread(&_numnodes, sizeof(_numnodes), 1, pfile);
-    outs = fread(&_fMaxLevelBound, sizeof(_fMaxLevelBound), 1, pfile);
+    const uint8_t* pdata = (const uint8_t*)pmappedregion->get_address();
+    uint64_t datasize = pmappedregion->get_size();
+    if( datasize < sizeof(CacheFileHeader) || !std::equal(s_CacheFileMagic, s_CacheFileMagic+sizeof(s_CacheFileMagic), pdata) ) {
+        RAVELOG_WARN_FORMAT("%s is not a cache file or has an old format, ignoring", fullfilename);
+        return 0;
+    }
+    const CacheFileHeader& header = *(const CacheFileHeader*)pdata;
+    if( header.version != s_CacheFileVersion || header.realsize != sizeof(dReal) ) {
+        RAVELOG_WARN_FORMAT("cache %s has version %d with %d byte reals, expected version %d with %d byte reals, ignoring", fullfilename%header.version%header.realsize%s_CacheFileVersion%sizeof(dReal));
+        return 0;
+    }
+    if( header.statedof != _statedof ) {
+        RAVELOG_WARN_FORMAT("cache %s has %d dofs, expected %d, ignoring", fullfilename%header.statedof%_statedof);
+        return 0;
+    }
+    if( robothash != std::string(header.robothash, strnlen(header.robothash, sizeof(header.robothash))) || envhash != std::string(header.envhash, strnlen(header.envhash, sizeof(header.envhash))) ) {
+        RAVELOG_WARN_FORMAT("cache %s was saved for a different robot or environment, ignoring", fullfilename);
+        return 0;
+    }
+    if( !_CheckCacheFile(pdata, datasize) ) {
+        RAVELOG_WARN_FORMAT("cache %s is truncated or corrupted, ignoring", fullfilename);
+        return 0;
+    }
 
+    _Reset();
+    _fulldirname = fullfilename;
+    _weights.resize(_statedof);
+    std::copy((const dReal*)(pdata+header.weightsoffset), (const dReal*)(pdata+header.weightsoffset)+_statedof, _weights.begin());
+    _maxdistance = header.maxdistance;
+    _base = header.base;
+    _fBaseInv = 1/_base;
+    _fBaseInv2 = 1/Sqr(_base);
+    _fBaseChildMult = 1/(_base-1);
+    _maxlevel = header.maxlevel;
+    _minlevel = header.minlevel;
+    _fMaxLevelBound = header.fMaxLevelBound;
     int maxenclevel = max(_EncodeLevel(_maxlevel), _EncodeLevel(_minlevel));
-    _vsetLevelNodes.resize(maxenclevel+1);
+    if( maxenclevel >= (int)_vvLevelNodes.size() ) {
+        _vvLevelNodes.resize(maxenclevel+1);
+    }
+
+    _pmappedfile = pmappedfile;
+    _pmappedregion = pmappedregion;
+    _pmappednodes = (const CacheFileNode*)(pdata+header.nodesoffset);
+    _pmappedchildren = (const int32_t*)(pdata+header.childrenoffset);
+    _pmappedstates = (const dReal*)(pdata+header.statesoffset);
+    // the link aabbs can only be used when the robot still has the same number of links
+    _pmappedlinkaabbs = header.numlinkaabbs > 0 && header.numlinkaabbs == _numlinkaabbs ? (const dReal*)(pdata+header.linkaabbsoffset) : NULL;
+    _vmappedconftypes.resize(header.numnodes);
+    for(int index = 0; index < header.numnodes; ++index) {
+        _vmappedconftypes[index] = (uint8_t)_pmappednodes[index].conftype;
+    }
+    _vmappedbodies.resize(header.numbodies);
+    const char* pbodyname = (const char*)(pdata+header.bodiesoffset);
+    for(int ibody = 0; ibody < header.numbodies; ++ibody) {
+        std::string bodyname(pbodyname);
+        pbodyname += bodyname.size()+1;
+        if( !!penv ) {
+            _vmappedbodies[ibody] = penv->GetKinBody(bodyname);
+        }
+        if( !_vmappedbodies[ibody] ) {
+            RAVELOG_WARN_FORMAT("loading cache expected colliding body %s, but none found", bodyname);
+        }
+    }
+    _numnodes = header.numnodes;
+    _nummappednodes = header.numnodes;
+    _nummappedknownnodes = header.numknownnodes;
 
-    _vnodes.resize(_numnodes);
-    _dummycs.resize(_statedof, 0);
+    // only the root is created, everything else is materialized when it is reached
+    _MaterializeNode(header.rootindex);
+    if( _nummappednodes == 0 ) {
+        _UnmapCache();
+    }
+    RAVELOG_DEBUG_FORMAT("Mapped cache %s with %d nodes", _fulldirname%_numnodes);
+    return 1;
+}
 
-    for(int i = 0; i < _numnodes; ++i) {
-        _vnodes[i] = _CreateCacheTreeNode(_dummycs, CollisionReportPtr());
+bool CacheTree::_CheckCacheFile(const uint8_t* pdata, uint64_t datasize)
+{
+    const CacheFileHeader& header = *(const CacheFileHeader*)pdata;
+    // the dofs and links are bounded so that the section sizes cannot overflow
+    if( header.filesize != datasize || header.statedof <= 0 || header.statedof > 0xffff || header.numlinkaabbs < 0 || header.numlinkaabbs > 0xffff || header.numnodes <= 0 || header.numknownnodes < 0 || header.numbodies < 0 || header.rootindex < 0 || header.rootindex >= header.numnodes ) {
+        return false;
+    }
+    if( header.minlevel > header.maxlevel || header.maxlevel > s_CacheFileMaxLevel || header.minlevel < -s_CacheFileMaxLevel || !(header.maxdistance > 0) || !(header.base > 1) ) {
+        return false;
     }
 
-    for (int inode = 0; inode < _numnodes; ++inode)
-    {
-        _newnode = _vnodes.at(inode);
-        outs = fread(&_newnode->_level, sizeof(_newnode->_level), 1, pfile);
-        outs = fread(_newnode->_pcstate, sizeof(dReal)*_statedof, 1, pfile);
-        outs = fread(&_newnode->_conftype, sizeof(_newnode->_conftype), 1, pfile);
-
-        if( _newnode->_conftype == CNT_Collision ) {
-            int namelength;
-            outs = fread(&namelength, sizeof(namelength), 1, pfile);
-            _collidingbodyname.resize(namelength);
-            outs = fread(&_collidingbodyname[0], namelength, 1, pfile);
-            int collidinglinkindex;
-            outs = fread(&collidinglinkindex, sizeof(collidinglinkindex), 1, pfile);
-            _pcollidingbody = penv->GetKinBody(_collidingbodyname);
-            if( !_pcollidingbody ) {
-                RAVELOG_WARN_FORMAT("loading cache expected colliding body %s, but none found", _collidingbodyname);
+    // the sections have to be aligned, in order and must not overlap
+    const uint64_t numnodes = header.numnodes;
+    const uint64_t offsets[] = {header.weightsoffset, header.nodesoffset, header.childrenoffset, header.statesoffset, header.linkaabbsoffset, header.bodiesoffset};
+    const uint64_t sizes[] = {sizeof(dReal)*header.statedof, sizeof(CacheFileNode)*numnodes, 0, sizeof(dReal)*header.statedof*numnodes, sizeof(dReal)*6*header.numlinkaabbs*numnodes, 0};
+    uint64_t sectionstart = sizeof(CacheFileHeader);
+    for(size_t isection = 0; isection < sizeof(offsets)/sizeof(offsets[0]); ++isection) {
+        if( offsets[isection] != AlignCacheFileOffset(offsets[isection]) || offsets[isection] < sectionstart || offsets[isection] > datasize || sizes[isection] > datasize - offsets[isection] ) {
+            return false;
+        }
+        sectionstart = offsets[isection] + sizes[isection];
+    }
+
+    // every body name ends inside the file
+    const char* pbodyname = (const char*)(pdata+header.bodiesoffset);
+    const char* pend = (const char*)(pdata+datasize);
+    for(int ibody = 0; ibody < header.numbodies; ++ibody) {
+        const char* pnull = (const char*)memchr(pbodyname, 0, pend-pbodyname);
+        if( !pnull ) {
+            return false;
+        }
+        pbodyname = pnull+1;
+    }
+
+    // walk the tree from the root. Every node has to be reached exactly once and the children have to be below their parents, so there are no repeated children and no cycles
+    const CacheFileNode* pnodes = (const CacheFileNode*)(pdata+header.nodesoffset);
+    const int32_t* pchildren = (const int32_t*)(pdata+header.childrenoffset);
+    const uint64_t numchildindices = (header.statesoffset-header.childrenoffset)/sizeof(int32_t);
+    if( pnodes[header.rootindex].level != header.maxlevel ) {
+        return false;
+    }
+    std::vector<uint8_t> vreached(numnodes, 0);
+    std::vector<int> vstack(1, header.rootindex);
+    vreached[header.rootindex] = 1;
+    int numreached = 1, numknownnodes = 0;
+    while( vstack.size() > 0 ) {
+        const CacheFileNode& record = pnodes[vstack.back()];
+        vstack.pop_back();
+        if( record.conftype != CNT_Unknown && record.conftype != CNT_Collision && record.conftype != CNT_Free ) {
+            return false;
+        }
+        if( record.conftype != CNT_Unknown ) {
+            ++numknownnodes;
+        }
+        if( record.collidingbodyindex < -1 || record.collidingbodyindex >= header.numbodies || record.firstchild < 0 || record.numchildren < 0 || (uint64_t)record.firstchild + (uint64_t)record.numchildren > numchildindices ) {
+            return false;
+        }
+        for(int ichild = 0; ichild < record.numchildren; ++ichild) {
+            int32_t childindex = pchildren[record.firstchild+ichild];
+            if( childindex < 0 || childindex >= header.numnodes || vreached[childindex] || pnodes[childindex].level >= record.level || pnodes[childindex].level < header.minlevel ) {
+                return false;
             }
-            else {
-                _newnode->_collidinglink = _pcollidingbody->GetLinks().at(collidinglinkindex);
+            vreached[childindex] = 1;
+            ++numreached;
+            vstack.push_back(childindex);
+        }
+    }
+    return numreached == header.numnodes && numknownnodes == header.numknownnodes;
+}
+
+CacheTreeNodePtr CacheTree::_MaterializeNode(int mappedindex)
+{
+    const CacheFileNode& record = _pmappednodes[mappedindex];
+    void* pmemory = _poolNodes->malloc();
+    AABB* plinkaabbs = NULL;
+    if( !!_pmappedlinkaabbs && record.haslinkaabbs ) {
+        plinkaabbs = (AABB*)((uint8_t*)pmemory + sizeof(CacheTreeNode) + sizeof(dReal)*_statedof);
+        const dReal* pvalues = _pmappedlinkaabbs + (size_t)mappedindex*_numlinkaabbs*6;
+        for(int iaabb = 0; iaabb < _numlinkaabbs; ++iaabb, pvalues += 6) {
+            new (plinkaabbs+iaabb) AABB(Vector(pvalues[0], pvalues[1], pvalues[2]), Vector(pvalues[3], pvalues[4], pvalues[5]));
+        }
+    }
+    CacheTreeNodePtr pnode = new (pmemory) CacheTreeNode(_pmappedstates + (size_t)mappedindex*_statedof, _statedof, plinkaabbs);
+#ifdef _DEBUG
+    pnode->id = s_CacheTreeId++;
+#endif
+    pnode->_level = record.level;
+    pnode->_conftype = (ConfigurationNodeType)record.conftype;
+    pnode->_hasselfchild = record.hasselfchild;
+    pnode->_usenn = record.usenn;
+    if( _vmappedconftypes[mappedindex] != record.conftype ) {
+        // changed by an update while the node was in the file
+        pnode->SetType((ConfigurationNodeType)_vmappedconftypes[mappedindex]);
+    }
+    _vmappedconftypes[mappedindex] = CNT_Unknown;
+    if( pnode->_conftype == CNT_Collision ) {
+        pnode->_robotlinkindex = record.robotlinkindex;
+        if( record.collidingbodyindex >= 0 && !!_vmappedbodies.at(record.collidingbodyindex) ) {
+            KinBodyPtr pcollidingbody = _vmappedbodies[record.collidingbodyindex];
+            if( record.collidinglinkindex >= 0 && record.collidinglinkindex < (int)pcollidingbody->GetLinks().size() ) {
+                pnode->_collidinglink = pcollidingbody->GetLinks()[record.collidinglinkindex];
             }
-            outs = fread(&_newnode->_robotlinkindex, sizeof(_newnode->_robotlinkindex), 1, pfile);
         }
+    }
+    if( record.numchildren > 0 ) {
+        pnode->_mappedindex = mappedindex;
+    }
+    _AddLevelNode(pnode);
+    _AddToWorkspaceIndex(pnode);
+    _nummappednodes -= 1;
+    if( pnode->_conftype != CNT_Unknown ) {
+        _nummappedknownnodes -= 1;
+    }
+    return pnode;
+}
 
-        outs = fread(&_newnode->_hasselfchild, sizeof(_newnode->_hasselfchild), 1, pfile);
-        outs = fread(&_newnode->_usenn, sizeof(_newnode->_usenn), 1, pfile);
-        int numchildren;
-        outs = fread(&numchildren, sizeof(numchildren), 1, pfile);
-        _newnode->_vchildren.resize(numchildren);
+void CacheTree::_MaterializeChildren(CacheTreeNodePtr pnode)
+{
+    const CacheFileNode& record = _pmappednodes[pnode->_mappedindex];
+    BOOST_ASSERT(pnode->_vchildren.size() == 0);
+    pnode->_vchildren.reserve(record.numchildren);
+    for(int ichild = 0; ichild < record.numchildren; ++ichild) {
+        pnode->_vchildren.push_back(_MaterializeNode(_pmappedchildren[record.firstchild+ichild]));
+    }
+    _UpdateChildStates(pnode);
+    // concurrent queries only read the children once they see the node as materialized
+    pnode->_mappedindex = -1;
+    if( _nummappednodes == 0 ) {
+        _UnmapCache();
+    }
+}
 
-        // create the copies of the children and insert them
-        for(int i = 0; i < numchildren; ++i) {
-            int childid;
-            outs = fread(&childid, sizeof(childid), 1, pfile);
-            _newnode->_vchildren[i] = _vnodes.at(childid);
-        }
+void CacheTree::_MaterializeChildrenShared(CacheTreeNodePtr pnode) const
+{
+    boost::mutex::scoped_lock lock(_mutexMaterialize);
+    // another query might have materialized the children while waiting
+    if( pnode->_mappedindex >= 0 ) {
+        const_cast<CacheTree*>(this)->_MaterializeChildren(pnode);
+    }
+}
 
-        _vsetLevelNodes.at(_EncodeLevel(_newnode->_level)).insert(_newnode);
+void CacheTree::_MaterializeAllShared() const
+{
+    boost::mutex::scoped_lock lock(_mutexMaterialize);
+    const_cast<CacheTree*>(this)->_MaterializeAll();
+}
+
+void CacheTree::_MaterializeAll()
+{
+    if( !_pmappedregion ) {
+        return;
+    }
+    std::vector<CacheTreeNodePtr> vnodes;
+    FOREACH(itlevelnodes, _vvLevelNodes) {
+        FOREACH(itnode, *itlevelnodes) {
+            if( (*itnode)->_mappedindex >= 0 ) {
+                vnodes.push_back(*itnode);
+            }
+        }
+    }
+    while( vnodes.size() > 0 ) {
+        CacheTreeNodePtr pnode = vnodes.back();
+        vnodes.pop_back();
+        _MaterializeChildren(pnode);
+        FOREACH(itchild, pnode->_vchildren) {
+            if( (*itchild)->_mappedindex >= 0 ) {
+                vnodes.push_back(*itchild);
+            }
+        }
     }
+    BOOST_ASSERT(!_pmappedregion);
+}
 
-    fclose(pfile);
+void CacheTree::_UnmapCache()
+{
+    _pmappedregion.reset();
+    _pmappedfile.reset();
+    _pmappednodes = NULL;
+    _pmappedchildren = NULL;
+    _pmappedstates = NULL;
+    _pmappedlinkaabbs = NULL;
+    _vmappedbodies.clear();
+    _vmappedconftypes.clear();
+    _nummappednodes = 0;
+    _nummappedknownnodes = 0;
+}
 
-    _vnodes.resize(0);
+/// \brief returns true if pcollidingbody is pbody. The node might have been inserted by the cache of a cloned environment, so the bodies are compared with their environment ids.
+static bool IsCollidingBody(KinBodyPtr pcollidingbody, KinBodyPtr pbody)
+{
+    if( !pcollidingbody ) {
+        // body was destroyed with its environment
+        return false;
+    }
+    if( pcollidingbody == pbody ) {
+        return true;
+    }
+    return pcollidingbody->GetEnv() != pbody->GetEnv() && pcollidingbody->GetEnvironmentId() == pbody->GetEnvironmentId();
+}
 
-    int numloaded = GetNumKnownNodes();
-    OPENRAVE_ASSERT_OP(numloaded,==,_numnodes);
-    return 1;
+/// \brief returns true if the colliding link of the node belongs to pbody
+static bool IsCollidingBody(CacheTreeNodeConstPtr pnode, KinBodyPtr pbody)
+{
+    KinBody::LinkConstPtr pcollidinglink = pnode->GetCollidingLink();
+    if( !pcollidinglink ) {
+        return false;
+    }
+    return IsCollidingBody(pcollidinglink->GetParent(true), pbody);
 }
 
 int CacheTree::UpdateCollisionConfigurations(KinBodyPtr pbody)
 {
+    boost::unique_lock<boost::shared_mutex> lock(_mutex);
     int nremoved=0;
     if (_numnodes > 0) {
-        FOREACH(itlevelnodes, _vsetLevelNodes) {
+        FOREACH(itlevelnodes, _vvLevelNodes) {
             FOREACH(itnode, *itlevelnodes) {
-                _newnode = *itnode;
-                if ((_newnode->GetType() == CNT_Collision) && (pbody == _newnode->GetCollidingLink()->GetParent())) {
-                    _newnode->SetType(CNT_Unknown);
+                if (((*itnode)->GetType() == CNT_Collision) && IsCollidingBody(*itnode, pbody)) {
+                    (*itnode)->SetType(CNT_Unknown);
                     nremoved += 1;
                 }
             }
         }
-        int knum = GetNumKnownNodes();
+        // the records still in the mapped file are updated without materializing them
+        for(size_t index = 0; index < _vmappedconftypes.size(); ++index) {
+            const CacheFileNode& record = _pmappednodes[index];
+            if( _vmappedconftypes[index] == CNT_Collision && record.collidingbodyindex >= 0 && record.collidinglinkindex >= 0 && IsCollidingBody(_vmappedbodies.at(record.collidingbodyindex), pbody) ) {
+                _vmappedconftypes[index] = CNT_Unknown;
+                _nummappedknownnodes -= 1;
+                nremoved += 1;
+            }
+        }
+        int knum = _GetNumKnownNodes();
         RAVELOG_VERBOSE_FORMAT("removed %d nodes, %d known nodes left",nremoved%knum);
     }
     return nremoved;
 }
 
-int CacheTree::UpdateFreeConfigurations(KinBodyPtr pbody) //todo only remove those with overlaping linkspheres
+/// \brief returns true if any of the non-empty aabbs of the node overlaps with one of vaabbs
+static bool AreLinkAABBsOverlapping(const AABB* plinkaabbs, int numlinkaabbs, const std::vector<AABB>& vaabbs)
+{
+    for(int ilink = 0; ilink < numlinkaabbs; ++ilink) {
+        const AABB& ab = plinkaabbs[ilink];
+        if( ab.extents.x < 0 ) {
+            continue;
+        }
+        FOREACHC(itaabb, vaabbs) {
+            if( RaveFabs(ab.pos.x-itaabb->pos.x) <= ab.extents.x+itaabb->extents.x && RaveFabs(ab.pos.y-itaabb->pos.y) <= ab.extents.y+itaabb->extents.y && RaveFabs(ab.pos.z-itaabb->pos.z) <= ab.extents.z+itaabb->extents.z ) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+int CacheTree::UpdateFreeConfigurations(const std::vector<AABB>& vaabbs)
 {
+    boost::unique_lock<boost::shared_mutex> lock(_mutex);
     int nremoved=0;
     if (_numnodes > 0) {
-
-        FOREACH(itlevelnodes, _vsetLevelNodes) {
-            FOREACH(itnode, *itlevelnodes) {
-                if (((*itnode)->GetType() == CNT_Free)) {
+        if( !_IsWorkspaceIndexed() ) {
+            FOREACH(itlevelnodes, _vvLevelNodes) {
+                FOREACH(itnode, *itlevelnodes) {
+                    if (((*itnode)->GetType() == CNT_Free)) {
+                        (*itnode)->SetType(CNT_Unknown);
+                        nremoved += 1;
+                    }
+                }
+            }
+        }
+        else {
+            // gather the nodes touching the voxels of the region. If the region has more voxels than the index, cheaper to look at all nodes
+            _vCandidateNodes.resize(0);
+            if( _GetVoxelKeys(vaabbs.size() > 0 ? &vaabbs[0] : NULL, vaabbs.size(), _vVoxelKeys, max(_mapVoxelNodes.size(), size_t(1))) ) {
+                FOREACHC(itkey, _vVoxelKeys) {
+                    boost::unordered_map<uint64_t, std::vector<CacheTreeNodePtr> >::const_iterator itvoxel = _mapVoxelNodes.find(*itkey);
+                    if( itvoxel != _mapVoxelNodes.end() ) {
+                        _vCandidateNodes.insert(_vCandidateNodes.end(), itvoxel->second.begin(), itvoxel->second.end());
+                    }
+                }
+                std::sort(_vCandidateNodes.begin(), _vCandidateNodes.end());
+                _vCandidateNodes.erase(std::unique(_vCandidateNodes.begin(), _vCandidateNodes.end()), _vCandidateNodes.end());
+            }
+            else {
+                FOREACH(itlevelnodes, _vvLevelNodes) {
+                    _vCandidateNodes.insert(_vCandidateNodes.end(), itlevelnodes->begin(), itlevelnodes->end());
+                }
+            }
+            FOREACH(itnode, _vCandidateNodes) {
+                if( (*itnode)->GetType() == CNT_Free && !!(*itnode)->_plinkaabbs && AreLinkAABBsOverlapping((*itnode)->_plinkaabbs, _numlinkaabbs, vaabbs) ) {
+                    (*itnode)->SetType(CNT_Unknown);
+                    nremoved += 1;
+                }
+            }
+            FOREACH(itnode, _setUnindexedNodes) {
+                if( (*itnode)->GetType() == CNT_Free ) {
                     (*itnode)->SetType(CNT_Unknown);
                     nremoved += 1;
                 }
             }
         }
 
-        int knum = GetNumKnownNodes();
+        // the records still in the mapped file are updated without materializing them
+        std::vector<AABB> vlinkaabbs(_numlinkaabbs);
+        for(size_t index = 0; index < _vmappedconftypes.size(); ++index) {
+            if( _vmappedconftypes[index] != CNT_Free ) {
+                continue;
+            }
+            if( _IsWorkspaceIndexed() && !!_pmappedlinkaabbs && _pmappednodes[index].haslinkaabbs ) {
+                const dReal* pvalues = _pmappedlinkaabbs + index*_numlinkaabbs*6;
+                for(int iaabb = 0; iaabb < _numlinkaabbs; ++iaabb, pvalues += 6) {
+                    vlinkaabbs[iaabb] = AABB(Vector(pvalues[0], pvalues[1], pvalues[2]), Vector(pvalues[3], pvalues[4], pvalues[5]));
+                }
+                if( !AreLinkAABBsOverlapping(&vlinkaabbs[0], _numlinkaabbs, vaabbs) ) {
+                    continue;
+                }
+            }
+            _vmappedconftypes[index] = CNT_Unknown;
+            _nummappedknownnodes -= 1;
+            nremoved += 1;
+        }
+
+        int knum = _GetNumKnownNodes();
         RAVELOG_VERBOSE_FORMAT("removed %d nodes, %d known nodes left",nremoved%knum);
     }
 
     return nremoved;
 }
 
+void CacheTree::SetWorkspaceVoxelSize(dReal voxelsize)
+{
+    boost::unique_lock<boost::shared_mutex> lock(_mutex);
+    if( voxelsize == _fVoxelSize ) {
+        return;
+    }
+    _MaterializeAll();
+    _fVoxelSize = voxelsize;
+    _fVoxelSizeInv = voxelsize > 0 ? 1/voxelsize : 0;
+    _mapVoxelNodes.clear();
+    _setUnindexedNodes.clear();
+    FOREACH(itlevelnodes, _vvLevelNodes) {
+        FOREACH(itnode, *itlevelnodes) {
+            _AddToWorkspaceIndex(*itnode);
+        }
+    }
+}
+
+/// \brief packs the voxel coordinates into one key, every coordinate has 21 bits
+static inline uint64_t GetVoxelKey(int64_t ix, int64_t iy, int64_t iz)
+{
+    const int64_t offset = 1<<20, mask = (1<<21)-1;
+    return (uint64_t((ix+offset)&mask)<<42)|(uint64_t((iy+offset)&mask)<<21)|uint64_t((iz+offset)&mask);
+}
+
+bool CacheTree::_GetVoxelKeys(const AABB* paabbs, int numaabbs, std::vector<uint64_t>& vkeys, size_t maxkeys) const
+{
+    vkeys.resize(0);
+    for(int iaabb = 0; iaabb < numaabbs; ++iaabb) {
+        const AABB& ab = paabbs[iaabb];
+        if( ab.extents.x < 0 ) {
+            continue;
+        }
+        int64_t minx = (int64_t)std::floor((ab.pos.x-ab.extents.x)*_fVoxelSizeInv), maxx = (int64_t)std::floor((ab.pos.x+ab.extents.x)*_fVoxelSizeInv);
+        int64_t miny = (int64_t)std::floor((ab.pos.y-ab.extents.y)*_fVoxelSizeInv), maxy = (int64_t)std::floor((ab.pos.y+ab.extents.y)*_fVoxelSizeInv);
+        int64_t minz = (int64_t)std::floor((ab.pos.z-ab.extents.z)*_fVoxelSizeInv), maxz = (int64_t)std::floor((ab.pos.z+ab.extents.z)*_fVoxelSizeInv);
+        if( maxkeys > 0 && uint64_t((maxx-minx+1)*(maxy-miny+1)*(maxz-minz+1)) + vkeys.size() > maxkeys ) {
+            return false;
+        }
+        for(int64_t ix = minx; ix <= maxx; ++ix) {
+            for(int64_t iy = miny; iy <= maxy; ++iy) {
+                for(int64_t iz = minz; iz <= maxz; ++iz) {
+                    vkeys.push_back(GetVoxelKey(ix,iy,iz));
+                }
+            }
+        }
+    }
+    std::sort(vkeys.begin(), vkeys.end());
+    vkeys.erase(std::unique(vkeys.begin(), vkeys.end()), vkeys.end());
+    return true;
+}
+
+void CacheTree::_AddToWorkspaceIndex(CacheTreeNodePtr pnode)
+{
+    if( !_IsWorkspaceIndexed() ) {
+        return;
+    }
+    if( !pnode->_plinkaabbs ) {
+        _setUnindexedNodes.insert(pnode);
+        return;
+    }
+    _GetVoxelKeys(pnode->_plinkaabbs, _numlinkaabbs, _vVoxelKeys);
+    FOREACHC(itkey, _vVoxelKeys) {
+        _mapVoxelNodes[*itkey].push_back(pnode);
+    }
+}
+
+void CacheTree::_RemoveFromWorkspaceIndex(CacheTreeNodePtr pnode)
+{
+    if( !_IsWorkspaceIndexed() ) {
+        return;
+    }
+    if( !pnode->_plinkaabbs ) {
+        _setUnindexedNodes.erase(pnode);
+        return;
+    }
+    _GetVoxelKeys(pnode->_plinkaabbs, _numlinkaabbs, _vVoxelKeys);
+    FOREACHC(itkey, _vVoxelKeys) {
+        boost::unordered_map<uint64_t, std::vector<CacheTreeNodePtr> >::iterator itvoxel = _mapVoxelNodes.find(*itkey);
+        if( itvoxel != _mapVoxelNodes.end() ) {
+            std::vector<CacheTreeNodePtr>::iterator itnode = std::find(itvoxel->second.begin(), itvoxel->second.end(), pnode);
+            if( itnode != itvoxel->second.end() ) {
+                *itnode = itvoxel->second.back();
+                itvoxel->second.pop_back();
+            }
+            if( itvoxel->second.size() == 0 ) {
+                _mapVoxelNodes.erase(itvoxel);
+            }
+        }
+    }
+}
+
 int CacheTree::RemoveFreeConfigurations()
 {
+    boost::unique_lock<boost::shared_mutex> lock(_mutex);
+    _MaterializeAll();
     int nremoved=0;
     if (_numnodes > 0) {
-        FOREACH(itlevelnodes, _vsetLevelNodes) {
+        FOREACH(itlevelnodes, _vvLevelNodes) {
             FOREACH(itnode, *itlevelnodes) {
                 if (!!(*itnode)) {
                     if (((*itnode)->GetType() == CNT_Free)) {
@@ -1004,18 +1789,24 @@ int CacheTree::RemoveFreeConfigurations()
             }
         }
 
-        int knum = GetNumKnownNodes();
+        int knum = _GetNumKnownNodes();
         RAVELOG_VERBOSE_FORMAT("removed %d nodes, %d known nodes left",nremoved%knum);
     }
 
     return nremoved;
 }
 
-int CacheTree::GetNumKnownNodes()
+int CacheTree::GetNumKnownNodes() const
+{
+    boost::shared_lock<boost::shared_mutex> lock(_mutex);
+    return _GetNumKnownNodes();
+}
+
+int CacheTree::_GetNumKnownNodes() const
 {
-    int nknown=0;
+    int nknown=_nummappedknownnodes;
     if (_numnodes > 0) {
-        FOREACH(itlevelnodes, _vsetLevelNodes) {
+        FOREACH(itlevelnodes, _vvLevelNodes) {
             FOREACH(itnode, *itlevelnodes) {
                 if (((*itnode)->GetType() != CNT_Unknown) ) {
                     nknown += 1;
@@ -1028,12 +1819,14 @@ int CacheTree::GetNumKnownNodes()
 
 bool CacheTree::Validate()
 {
+    boost::shared_lock<boost::shared_mutex> lock(_mutex);
+    _MaterializeAllShared();
     if( _numnodes == 0 ) {
         return _numnodes==0;
     }
 
-    if( _vsetLevelNodes.at(_EncodeLevel(_maxlevel)).size() != 1 ) {
-        int nroots = _vsetLevelNodes.at(_EncodeLevel(_maxlevel)).size();
+    if( _vvLevelNodes.at(_EncodeLevel(_maxlevel)).size() != 1 ) {
+        int nroots = _vvLevelNodes.at(_EncodeLevel(_maxlevel)).size();
         RAVELOG_WARN_FORMAT("more than 1 root node (%d)\n",nroots);
         return false;
     }
@@ -1046,12 +1839,30 @@ bool CacheTree::Validate()
     dReal fEpsilon = g_fEpsilon*_maxdistance; // min distance
     for(int currentlevel = _maxlevel; currentlevel >= _minlevel; --currentlevel, fLevelBound *= _fBaseInv ) {
         int enclevel = _EncodeLevel(currentlevel);
-        if( enclevel >= (int)_vsetLevelNodes.size() ) {
+        if( enclevel >= (int)_vvLevelNodes.size() ) {
             continue;
         }
 
-        const std::set<CacheTreeNodePtr>& setLevelRawChildren = _vsetLevelNodes.at(enclevel);
-        FOREACHC(itnode, setLevelRawChildren) {
+        const std::vector<CacheTreeNodePtr>& vLevelRawChildren = _vvLevelNodes.at(enclevel);
+        for(size_t inode = 0; inode < vLevelRawChildren.size(); ++inode) {
+            std::vector<CacheTreeNodePtr>::const_iterator itnode = vLevelRawChildren.begin()+inode;
+            if( (*itnode)->_levelindex != (int)inode || (*itnode)->_level != currentlevel ) {
+                RAVELOG_WARN_FORMAT("node at level %d has wrong level index %d != %d", currentlevel%(*itnode)->_levelindex%inode);
+                return false;
+            }
+            if( (*itnode)->_childstride < (int)(*itnode)->_vchildren.size() || (int)(*itnode)->_vchildstates.size() < (*itnode)->_childstride*_statedof ) {
+                RAVELOG_WARN_FORMAT("node at level %d has a children states block too small for %d children", currentlevel%(*itnode)->_vchildren.size());
+                return false;
+            }
+            for(size_t ichild = 0; ichild < (*itnode)->_vchildren.size(); ++ichild) {
+                const dReal* pchildstate = (*itnode)->_vchildren[ichild]->GetConfigurationState();
+                for(int idof = 0; idof < _statedof; ++idof) {
+                    if( (*itnode)->_vchildstates[idof*(*itnode)->_childstride+ichild] != pchildstate[idof] ) {
+                        RAVELOG_WARN_FORMAT("node at level %d has children states that do not match its children", currentlevel);
+                        return false;
+                    }
+                }
+            }
             FOREACH(itchild, (*itnode)->_vchildren) {
                 dReal curdist = RaveSqrt(_ComputeDistance2((*itnode)->GetConfigurationState(), (*itchild)->GetConfigurationState()));
                 if( curdist > fLevelBound+fEpsilon ) {
@@ -1071,7 +1882,7 @@ bool CacheTree::Validate()
             if( currentlevel < _maxlevel ) {
                 // find its parents
                 int nfound = 0;
-                FOREACH(ittestnode, _vsetLevelNodes.at(_EncodeLevel(currentlevel+1))) {
+                FOREACH(ittestnode, _vvLevelNodes.at(_EncodeLevel(currentlevel+1))) {
                     if( find((*ittestnode)->_vchildren.begin(), (*ittestnode)->_vchildren.end(), *itnode) != (*ittestnode)->_vchildren.end() ) {
                         ++nfound;
                         mapNodeParents[*itnode] = *ittestnode;
@@ -1095,7 +1906,7 @@ bool CacheTree::Validate()
                 }
             }
         }
-        numnodes += setLevelRawChildren.size();
+        numnodes += vLevelRawChildren.size();
 
         for(size_t i = 0; i < vAccumNodes.size(); ++i) {
             for(size_t j = i+1; j < vAccumNodes.size(); ++j) {
@@ -1124,11 +1935,41 @@ bool CacheTree::Validate()
     return true;
 }
 
-ConfigurationCache::ConfigurationCache(RobotBasePtr pstaterobot, bool envupdates) : _cachetree(pstaterobot->GetDOF())
+void CacheTree::AddClient(CacheTreeClientStatisticsPtr stats)
+{
+    boost::mutex::scoped_lock lock(_mutexClients);
+    // remove the clients that are gone
+    std::list< boost::weak_ptr<CacheTreeClientStatistics> >::iterator it = _listClients.begin();
+    while(it != _listClients.end()) {
+        if( it->expired() ) {
+            it = _listClients.erase(it);
+        }
+        else {
+            ++it;
+        }
+    }
+    _listClients.push_back(stats);
+}
+
+void CacheTree::GetClientStatistics(std::vector<CacheTreeClientStatisticsPtr>& vstats) const
+{
+    boost::mutex::scoped_lock lock(_mutexClients);
+    vstats.resize(0);
+    FOREACHC(it, _listClients) {
+        CacheTreeClientStatisticsPtr stats = it->lock();
+        if( !!stats ) {
+            vstats.push_back(stats);
+        }
+    }
+}
+
+ConfigurationCache::ConfigurationCache(RobotBasePtr pstaterobot, bool envupdates) : _cachetree(new CacheTree(pstaterobot->GetDOF(), envupdates ? (int)pstaterobot->GetLinks().size() : 0))
 {
     _userdatakey = std::string("configurationcache") + boost::lexical_cast<std::string>(this);
     _pstaterobot = pstaterobot;
     _penv = pstaterobot->GetEnv();
+    _stats.reset(new CacheTreeClientStatistics(str(boost::format("%s:%d")%pstaterobot->GetName()%_penv->GetId())));
+    _cachetree->AddClient(_stats);
 
     _envupdates = envupdates;
 
@@ -1147,10 +1988,7 @@ ConfigurationCache::ConfigurationCache(RobotBasePtr pstaterobot, bool envupdates
         _penv->GetBodies(_vnewenvbodies);
         FOREACHC(itbody, _vnewenvbodies) {
             if( *itbody != pstaterobot && !pstaterobot->IsGrabbing(*itbody) ) {
-                KinBodyCachedDataPtr pinfo(new KinBodyCachedData());
-                pinfo->_changehandle = (*itbody)->RegisterChangeCallback(KinBody::Prop_LinkGeometry|KinBody::Prop_LinkEnable|KinBody::Prop_LinkTransforms, boost::bind(&ConfigurationCache::_UpdateUntrackedBody, this, *itbody));
-                (*itbody)->SetUserData(_userdatakey, pinfo);
-                _listCachedData.push_back(pinfo);
+                _TrackBody(*itbody);
             }
         }
 
@@ -1185,7 +2023,8 @@ ConfigurationCache::ConfigurationCache(RobotBasePtr pstaterobot, bool envupdates
     _collisionthresh = 1.0; // discretization distance used by the original collisionchecker
     _freespacethresh = 0.2; // half disc. distance used by the original collisionchecker
     _insertiondistancemult = 0.5;
-
+    _workspacemargin = 0;
+    _nEnvironmentStamp = 0;
 
     _handleJointLimitChange = pstaterobot->RegisterChangeCallback(KinBody::Prop_JointLimits, boost::bind(&ConfigurationCache::_UpdateRobotJointLimits, this));
     _handleGrabbedChange = pstaterobot->RegisterChangeCallback(KinBody::Prop_RobotGrabbed, boost::bind(&ConfigurationCache::_UpdateRobotGrabbed, this));
@@ -1198,11 +2037,14 @@ ConfigurationCache::ConfigurationCache(RobotBasePtr pstaterobot, bool envupdates
         maxdistance += f*f;
     }
 
-    _cachetree.Init(_vweights, RaveSqrt(maxdistance));
+    _cachetree->Init(_vweights, RaveSqrt(maxdistance));
+    if( _envupdates ) {
+        _ComputeLinkMotions();
+    }
 
     if (IS_DEBUGLEVEL(Level_Verbose)) {
         stringstream ss; ss << std::setprecision(std::numeric_limits<OpenRAVE::dReal>::digits10+1);
-        ss << "Initializing cache,  maxdistance " << _cachetree.GetMaxDistance() << ", weights [";
+        ss << "Initializing cache,  maxdistance " << _cachetree->GetMaxDistance() << ", weights [";
         for (size_t i = 0; i < _vweights.size(); ++i) {
             ss << _vweights[i] << " ";
         }
@@ -1225,7 +2067,8 @@ ConfigurationCache::ConfigurationCache(RobotBasePtr pstaterobot, bool envupdates
 
 ConfigurationCache::~ConfigurationCache()
 {
-    _cachetree.Reset();
+    // the tree is destroyed with the last cache using it
+    _cachetree.reset();
     // have to destroy all the change callbacks!
     FOREACH(it, _listCachedData) {
         KinBodyCachedDataPtr pdata = it->lock();
@@ -1238,7 +2081,16 @@ ConfigurationCache::~ConfigurationCache()
 
 void ConfigurationCache::SetWeights(const std::vector<dReal>& weights)
 {
-    _cachetree.SetWeights(weights);
+    _cachetree->SetWeights(weights);
+}
+
+void ConfigurationCache::SetFreeSpaceThresh(dReal freespacethresh)
+{
+    if( freespacethresh > _freespacethresh && _cachetree->GetNumNodes() > 0 ) {
+        // the link aabbs of the free configurations only cover how far the links move within the old threshold
+        RemoveFreeConfigurations();
+    }
+    _freespacethresh = freespacethresh;
 }
 
 bool ConfigurationCache::InsertConfiguration(const std::vector<dReal>& conf, CollisionReportPtr report, dReal distin)
@@ -1248,34 +2100,176 @@ bool ConfigurationCache::InsertConfiguration(const std::vector<dReal>& conf, Col
             std::swap(report->plink1, report->plink2);
         }
     }
-    int ret = _cachetree.InsertNode(conf, report, !report ? _freespacethresh*_insertiondistancemult : _collisionthresh*_insertiondistancemult);
+    // the workspace volume is only known if the robot is at conf, which is the case when inserting the result of a collision check
+    _vlinkaabbs.resize(0);
+    if( _cachetree->GetNumLinkAABBs() > 0 ) {
+        GetDOFValues(_vcurvalues);
+        bool bAtConfiguration = _vcurvalues.size() == conf.size();
+        for(size_t i = 0; i < conf.size() && bAtConfiguration; ++i) {
+            bAtConfiguration = RaveFabs(_vcurvalues[i] - conf[i]) <= g_fEpsilonLinear;
+        }
+        if( bAtConfiguration ) {
+            _ComputeLinkAABBs(_vlinkaabbs);
+        }
+    }
+    int ret = _cachetree->InsertNode(conf, report, !report ? _freespacethresh*_insertiondistancemult : _collisionthresh*_insertiondistancemult, _vlinkaabbs);
     BOOST_ASSERT(ret!=0);
+    if( ret == 1 ) {
+        _stats->numinserted++;
+    }
     return ret==1;
 }
 
 int ConfigurationCache::GetNumKnownNodes()
 {
-    return _cachetree.GetNumKnownNodes();
+    return _cachetree->GetNumKnownNodes();
 }
 
 int ConfigurationCache::RemoveCollisionConfigurations()
 {
-    return _cachetree.RemoveCollisionConfigurations();
+    return _cachetree->RemoveCollisionConfigurations();
 }
 
 int ConfigurationCache::UpdateCollisionConfigurations(KinBodyPtr pbody)
 {
-    return _cachetree.UpdateCollisionConfigurations(pbody);
+    return _cachetree->UpdateCollisionConfigurations(pbody);
 }
 
 int ConfigurationCache::UpdateFreeConfigurations(KinBodyPtr pbody)
 {
-    return _cachetree.UpdateFreeConfigurations(pbody);
+    // a disabled link cannot collide, so only the enabled links are part of the changed region
+    _vbodyaabbs.resize(0);
+    FOREACHC(itlink, pbody->GetLinks()) {
+        if( (*itlink)->IsEnabled() && (*itlink)->GetGeometries().size() > 0 ) {
+            _vbodyaabbs.push_back((*itlink)->ComputeAABB());
+        }
+    }
+    if( _vbodyaabbs.size() == 0 ) {
+        return 0;
+    }
+    return _cachetree->UpdateFreeConfigurations(_vbodyaabbs);
+}
+
+void ConfigurationCache::SetWorkspaceIndexParameters(dReal voxelsize, dReal margin)
+{
+    _cachetree->SetWorkspaceVoxelSize(voxelsize);
+    _workspacemargin = margin;
+}
+
+void ConfigurationCache::_ComputeLinkAABBs(std::vector<AABB>& vlinkaabbs)
+{
+    const std::vector<KinBody::LinkPtr>& vlinks = _pstaterobot->GetLinks();
+    vlinkaabbs.resize(vlinks.size());
+    for(size_t ilink = 0; ilink < vlinks.size(); ++ilink) {
+        if( vlinks[ilink]->GetGeometries().size() > 0 ) {
+            vlinkaabbs[ilink] = vlinks[ilink]->ComputeAABB();
+        }
+        else {
+            // empty, negative extents are skipped by the workspace index
+            vlinkaabbs[ilink].pos = vlinks[ilink]->GetTransform().trans;
+            vlinkaabbs[ilink].extents = Vector(-1,-1,-1);
+        }
+    }
+    _pstaterobot->GetGrabbedInfo(_vgrabbedinfos);
+    FOREACHC(itinfo, _vgrabbedinfos) {
+        KinBody::LinkPtr plink = _pstaterobot->GetLink((*itinfo)->_robotlinkname);
+        KinBodyPtr pgrabbed = _penv->GetKinBody((*itinfo)->_grabbedname);
+        if( !plink || !pgrabbed ) {
+            continue;
+        }
+        AABB abgrabbed = pgrabbed->ComputeAABB();
+        AABB& ab = vlinkaabbs.at(plink->GetIndex());
+        if( ab.extents.x < 0 ) {
+            ab = abgrabbed;
+        }
+        else {
+            Vector vmin = ab.pos - ab.extents, vmax = ab.pos + ab.extents;
+            Vector vgrabbedmin = abgrabbed.pos - abgrabbed.extents, vgrabbedmax = abgrabbed.pos + abgrabbed.extents;
+            for(int j = 0; j < 3; ++j) {
+                vmin[j] = min(vmin[j], vgrabbedmin[j]);
+                vmax[j] = max(vmax[j], vgrabbedmax[j]);
+            }
+            ab.pos = 0.5*(vmin+vmax);
+            ab.extents = 0.5*(vmax-vmin);
+        }
+    }
+    // Within the free space threshold d the weighted distance changes dof i by at most d/w_i. A point of a link moves at
+    // most sum_i |dq_i| r_i, where r_i is a bound of its distance to the axis of dof i, so by Cauchy-Schwarz at most d*sqrt(sum_i (r_i/w_i)^2).
+    const std::vector<dReal>& vweights = _cachetree->GetWeights();
+    for(size_t ilink = 0; ilink < vlinkaabbs.size(); ++ilink) {
+        AABB& ab = vlinkaabbs[ilink];
+        if( ab.extents.x < 0 ) {
+            continue;
+        }
+        // the points of the link and its grabbed bodies are at most this far from the link origin
+        dReal fpointdist = RaveSqrt((ab.pos - vlinks[ilink]->GetTransform().trans).lengthsqr3()) + RaveSqrt(ab.extents.lengthsqr3());
+        dReal fmotion2 = 0;
+        FOREACHC(itmotion, _vvlinkmotions.at(ilink)) {
+            dReal f = itmotion->fmult*(itmotion->brotation ? itmotion->fradius + fpointdist : itmotion->fradius)/vweights.at(itmotion->index);
+            fmotion2 += f*f;
+        }
+        dReal fmargin = _freespacethresh*RaveSqrt(fmotion2) + _workspacemargin;
+        ab.extents += Vector(fmargin, fmargin, fmargin);
+    }
+}
+
+void ConfigurationCache::_ComputeLinkMotions()
+{
+    const std::vector<KinBody::LinkPtr>& vlinks = _pstaterobot->GetLinks();
+    _vvlinkmotions.resize(0);
+    _vvlinkmotions.resize(vlinks.size());
+    FOREACHC(itlink, vlinks) {
+        std::vector<LinkDOFMotion>& vmotions = _vvlinkmotions.at((*itlink)->GetIndex());
+        LinkDOFMotion motion;
+        for(size_t i = 0; i < _vRobotActiveIndices.size(); ++i) {
+            KinBody::JointPtr pjoint = _pstaterobot->GetJointFromDOFIndex(_vRobotActiveIndices[i]);
+            if( !_pstaterobot->DoesAffect(pjoint->GetJointIndex(), (*itlink)->GetIndex()) ) {
+                continue;
+            }
+            motion.index = i;
+            motion.brotation = !pjoint->IsPrismatic(_vRobotActiveIndices[i]-pjoint->GetDOFIndex());
+            motion.fradius = motion.brotation ? _ComputeChainLength(pjoint->GetAnchor(), pjoint->GetHierarchyChildLink(), *itlink) : 1;
+            motion.fmult = 1;
+            vmotions.push_back(motion);
+        }
+        for(int i = 0; i < RaveGetAffineDOF(_nRobotAffineDOF); ++i) {
+            DOFAffine affinedof = RaveGetAffineDOFFromIndex(_nRobotAffineDOF, i);
+            motion.index = _vRobotActiveIndices.size() + i;
+            motion.brotation = affinedof != DOF_X && affinedof != DOF_Y && affinedof != DOF_Z;
+            // the robot rotates around the origin of its base link
+            motion.fradius = motion.brotation ? _ComputeChainLength(vlinks.at(0)->GetTransform().trans, vlinks.at(0), *itlink) : 1;
+            // the rotation angle of a quaternion changes twice as fast as its values
+            motion.fmult = affinedof == DOF_RotationQuat ? 2 : 1;
+            vmotions.push_back(motion);
+        }
+    }
+}
+
+dReal ConfigurationCache::_ComputeChainLength(const Vector& vstart, KinBody::LinkConstPtr pstartlink, KinBody::LinkConstPtr plink) const
+{
+    std::vector<KinBody::JointPtr> vjoints;
+    _pstaterobot->GetChain(pstartlink->GetIndex(), plink->GetIndex(), vjoints);
+    // consecutive anchors are attached to the same link, so only prismatic joints change their distance
+    dReal flength = 0;
+    Vector vprev = vstart;
+    std::vector<dReal> vlower, vupper;
+    FOREACHC(itjoint, vjoints) {
+        Vector vanchor = (*itjoint)->GetAnchor();
+        flength += RaveSqrt((vanchor - vprev).lengthsqr3());
+        (*itjoint)->GetLimits(vlower, vupper);
+        for(int iaxis = 0; iaxis < (*itjoint)->GetDOF(); ++iaxis) {
+            if( (*itjoint)->IsPrismatic(iaxis) ) {
+                flength += vupper.at(iaxis) - vlower.at(iaxis);
+            }
+        }
+        vprev = vanchor;
+    }
+    return flength + RaveSqrt((plink->GetTransform().trans - vprev).lengthsqr3());
 }
 
 int ConfigurationCache::RemoveFreeConfigurations()
 {
-    return _cachetree.RemoveFreeConfigurations();
+    return _cachetree->RemoveFreeConfigurations();
 }
 
 void ConfigurationCache::GetDOFValues(std::vector<dReal>& values)
@@ -1302,22 +2296,27 @@ void ConfigurationCache::GetDOFValues(std::vector<dReal>& values)
 
 int ConfigurationCache::CheckCollision(const std::vector<dReal>& conf, KinBody::LinkConstPtr& robotlink, KinBody::LinkConstPtr& collidinglink, dReal& closestdist)
 {
-    std::pair<CacheTreeNodeConstPtr, dReal> knn = _cachetree.FindNearestNode(conf, _collisionthresh, _freespacethresh);
-
-    if( !!knn.first ) {
-
-        closestdist = knn.second;
-        if( knn.first->IsInCollision()) {
-
-            if ((int)_pstaterobot->GetLinks().size() <= knn.first->GetRobotLinkIndex()) {
+    // copy the node information while the tree is locked since other caches sharing the tree could remove the node
+    bool bcollision = false;
+    int robotlinkindex = -1;
+    KinBody::LinkConstPtr nodecollidinglink;
+    dReal dist = _cachetree->FindNearestNodeCollisionInfo(conf, _collisionthresh, _freespacethresh, bcollision, robotlinkindex, nodecollidinglink);
+    _stats->numchecks++;
+    if( dist >= 0 ) {
+
+        closestdist = dist;
+        if( bcollision ) {
+            _stats->numcollisionhits++;
+            if ((int)_pstaterobot->GetLinks().size() <= robotlinkindex) {
                 robotlink = KinBody::LinkConstPtr(); //patch
             }
             else{
-                robotlink = _pstaterobot->GetLinks().at(knn.first->GetRobotLinkIndex());
+                robotlink = _pstaterobot->GetLinks().at(robotlinkindex);
             }
-            collidinglink = knn.first->GetCollidingLink();
+            collidinglink = _GetEnvironmentLink(nodecollidinglink);
             return 1;
         }
+        _stats->numfreehits++;
         return 0;
     }
     return -1;
@@ -1325,10 +2324,10 @@ int ConfigurationCache::CheckCollision(const std::vector<dReal>& conf, KinBody::
 
 std::pair<std::vector<dReal>, dReal> ConfigurationCache::FindNearestNode(const std::vector<dReal>& conf, dReal dist)
 {
-    std::pair<CacheTreeNodeConstPtr, dReal> knn = _cachetree.FindNearestNode(conf, dist, CNT_Any);
-
-    if( !!knn.first ) {
-        return make_pair(std::vector<dReal>(knn.first->GetConfigurationState(), knn.first->GetConfigurationState()+_lowerlimit.size()), knn.second);
+    std::pair<std::vector<dReal>, dReal> knn;
+    knn.second = _cachetree->FindNearestNodeState(conf, dist, CNT_Any, knn.first);
+    if( knn.second >= 0 ) {
+        return knn;
     }
     return make_pair(std::vector<dReal>(0), dReal(0));
 }
@@ -1343,21 +2342,159 @@ int ConfigurationCache::CheckCollision(KinBody::LinkConstPtr& robotlink, KinBody
 void ConfigurationCache::Reset()
 {
     RAVELOG_DEBUG("Resetting cache\n");
-    _cachetree.Reset();
+    if( IsCacheTreeShared() ) {
+        // the other caches keep their configurations
+        _UnshareCacheTree();
+    }
+    else {
+        _cachetree->Reset();
+    }
+}
+
+bool ConfigurationCache::ShareCacheTree(ConfigurationCacheConstPtr cache)
+{
+    if( cache->_cachetree == _cachetree ) {
+        return true;
+    }
+    if( cache->_cachetree->GetWeights() != _cachetree->GetWeights() || cache->_lowerlimit != _lowerlimit || cache->_upperlimit != _upperlimit || cache->_cachetree->GetNumLinkAABBs() != _cachetree->GetNumLinkAABBs() || cache->_vRobotActiveIndices != _vRobotActiveIndices || cache->_nRobotAffineDOF != _nRobotAffineDOF ) {
+        RAVELOG_WARN_FORMAT("cache of %s cannot share the cache tree of %s since their dofs, weights or limits are different", _stats->name%cache->_stats->name);
+        return false;
+    }
+    _cachetree = cache->_cachetree;
+    _cachetree->AddClient(_stats);
+    _collisionthresh = cache->_collisionthresh;
+    _freespacethresh = cache->_freespacethresh;
+    _insertiondistancemult = cache->_insertiondistancemult;
+    _workspacemargin = cache->_workspacemargin;
+    return true;
+}
+
+void ConfigurationCache::_UnshareCacheTree()
+{
+    RAVELOG_DEBUG_FORMAT("cache of %s stops sharing the cache tree", _stats->name);
+    CacheTreePtr cachetree(new CacheTree(_pstaterobot->GetDOF(), _cachetree->GetNumLinkAABBs()));
+    cachetree->Init(_cachetree->GetWeights(), _cachetree->GetMaxDistance());
+    cachetree->SetBase(_cachetree->GetBase());
+    cachetree->SetWorkspaceVoxelSize(_cachetree->GetWorkspaceVoxelSize());
+    _cachetree = cachetree;
+    // the statistics registered with the old tree stay with the caches still sharing it
+    _stats.reset(new CacheTreeClientStatistics(_stats->name));
+    _cachetree->AddClient(_stats);
+}
+
+void ConfigurationCache::_ChangeEnvironment()
+{
+    ++_nEnvironmentStamp;
+    if( IsCacheTreeShared() ) {
+        _UnshareCacheTree();
+    }
+}
+
+KinBody::LinkConstPtr ConfigurationCache::_GetEnvironmentLink(KinBody::LinkConstPtr plink) const
+{
+    if( !plink ) {
+        return plink;
+    }
+    KinBodyPtr pbody = plink->GetParent(true);
+    if( !pbody ) {
+        return KinBody::LinkConstPtr();
+    }
+    if( pbody->GetEnv() == _penv ) {
+        return plink;
+    }
+    // inserted by a cache of a cloned environment, which keeps the environment ids
+    KinBodyPtr penvbody = _penv->GetBodyFromEnvironmentId(pbody->GetEnvironmentId());
+    if( !penvbody || penvbody->GetName() != pbody->GetName() || plink->GetIndex() >= (int)penvbody->GetLinks().size() ) {
+        return KinBody::LinkConstPtr();
+    }
+    return penvbody->GetLinks().at(plink->GetIndex());
+}
+
+std::string ConfigurationCache::_GetRobotHash() const
+{
+    std::stringstream ss;
+    ss << _pstaterobot->GetRobotStructureHash();
+    std::vector<KinBodyPtr> vgrabbed;
+    _pstaterobot->GetGrabbed(vgrabbed);
+    FOREACHC(itgrabbed, vgrabbed) {
+        ss << (*itgrabbed)->GetKinematicsGeometryHash();
+    }
+    FOREACHC(itindex, _vRobotActiveIndices) {
+        ss << " " << *itindex;
+    }
+    // the dofs that are not part of the cache stay where they are for all the configurations in it. The values are computed from the link transforms and do not survive setting them exactly, so they are quantized.
+    std::vector<dReal> vdofvalues;
+    _pstaterobot->GetDOFValues(vdofvalues);
+    for(int idof = 0; idof < (int)vdofvalues.size(); ++idof) {
+        if( find(_vRobotActiveIndices.begin(), _vRobotActiveIndices.end(), idof) == _vRobotActiveIndices.end() ) {
+            ss << " " << idof << " " << (int64_t)std::floor(vdofvalues[idof]*1e5+0.5);
+        }
+    }
+    return utils::GetMD5HashString(ss.str());
+}
+
+std::string ConfigurationCache::_GetEnvironmentHash() const
+{
+    if( !_envupdates ) {
+        return std::string();
+    }
+    std::vector<KinBodyPtr> vbodies;
+    _penv->GetBodies(vbodies);
+    std::stringstream ss;
+    ss << std::setprecision(std::numeric_limits<OpenRAVE::dReal>::digits10+1);
+    std::vector<Transform> vlinktransforms;
+    if( _nRobotAffineDOF == 0 ) {
+        // the robot base is not part of the cache, so the configurations are only valid where the robot is now
+        ss << _pstaterobot->GetTransform() << std::endl;
+    }
+    FOREACHC(itbody, vbodies) {
+        if( *itbody == _pstaterobot || _pstaterobot->IsGrabbing(*itbody) ) {
+            continue;
+        }
+        ss << (*itbody)->GetName() << " " << (*itbody)->GetKinematicsGeometryHash() << " " << (*itbody)->IsEnabled();
+        (*itbody)->GetLinkTransformations(vlinktransforms);
+        FOREACHC(ittrans, vlinktransforms) {
+            ss << " " << *ittrans;
+        }
+        ss << std::endl;
+    }
+    return utils::GetMD5HashString(ss.str());
 }
 
 bool ConfigurationCache::Validate()
 {
-    return _cachetree.Validate();
+    return _cachetree->Validate();
+}
+
+bool ConfigurationCache::RemoveNode(const std::vector<dReal>& conf)
+{
+    std::pair<CacheTreeNodeConstPtr, dReal> knn = _cachetree->FindNearestNode(conf, g_fEpsilonLinear, CNT_Any);
+    if( !knn.first ) {
+        return false;
+    }
+    return _cachetree->RemoveNode(knn.first);
+}
+
+void ConfigurationCache::_TrackBody(KinBodyPtr pbody)
+{
+    KinBodyCachedDataPtr pinfo(new KinBodyCachedData());
+    pinfo->_changehandle = pbody->RegisterChangeCallback(KinBody::Prop_LinkGeometry|KinBody::Prop_LinkEnable|KinBody::Prop_LinkTransforms, boost::bind(&ConfigurationCache::_UpdateUntrackedBody, this, pbody));
+    pbody->SetUserData(_userdatakey, pinfo);
+    _listCachedData.push_back(pinfo);
 }
 
 void ConfigurationCache::_UpdateUntrackedBody(KinBodyPtr pbody)
 {
-    // body's state has changed, so remove collision space and invalidate free space.
+    // body's state has changed, so remove collision space and invalidate the free space overlapping with the body.
     if(_envupdates) {
+        if( _setgrabbedbodies.find(pbody) != _setgrabbedbodies.end() ) {
+            // moves with the robot, changes of the grabbed bodies are handled by _UpdateRobotGrabbed
+            return;
+        }
         RAVELOG_VERBOSE_FORMAT("%s %s","Updating untracked bodies"%pbody->GetName());
+        _ChangeEnvironment();
         UpdateCollisionConfigurations(pbody);
-        RemoveFreeConfigurations();
+        UpdateFreeConfigurations(pbody);
     }
 }
 
@@ -1365,18 +2502,17 @@ void ConfigurationCache::_UpdateAddRemoveBodies(KinBodyPtr pbody, int action)
 {
     if( action == 1 ) {
         if (_envupdates) {
-            // invalidate the freespace of a cache given a new body in the scene
-            if (RemoveFreeConfigurations() > 0) {
+            _ChangeEnvironment();
+            // invalidate the freespace of a cache overlapping with the new body in the scene
+            if (UpdateFreeConfigurations(pbody) > 0) {
                 RAVELOG_DEBUG_FORMAT("%s %s %d","Updating add/remove bodies"%pbody->GetName()%action);
             }
-            KinBodyCachedDataPtr pinfo(new KinBodyCachedData());
-            pinfo->_changehandle = pbody->RegisterChangeCallback(KinBody::Prop_LinkGeometry|KinBody::Prop_LinkEnable|KinBody::Prop_LinkTransforms, boost::bind(&ConfigurationCache::_UpdateUntrackedBody, this, pbody));
-            pbody->SetUserData(_userdatakey, pinfo);
-            _listCachedData.push_back(pinfo);
+            _TrackBody(pbody);
         }
     }
     else if( action == 0 ) {
         if (_envupdates) {
+            _ChangeEnvironment();
             if ( UpdateCollisionConfigurations(pbody) > 0) {
                 RAVELOG_DEBUG_FORMAT("%s %s %d","Updating add/remove bodies"%pbody->GetName()%action);
                 // remove all configurations that collide with this body
@@ -1397,46 +2533,50 @@ void ConfigurationCache::_UpdateRobotJointLimits()
 
         if (_newlowerlimit != _lowerlimit || _newupperlimit != _upperlimit)
         {
+            _ChangeEnvironment();
             // compute new max distance for cache
             // distance has to be computed in the same way as CacheTreeNode.GetDistance()
             // otherwise, distances larger than this value could be inserted into the tree
             dReal maxdistance = 0;
             for (size_t i = 0; i < _lowerlimit.size(); ++i) {
-                dReal f = (_upperlimit[i] - _lowerlimit[i]) * _cachetree.GetWeights().at(i);
+                dReal f = (_upperlimit[i] - _lowerlimit[i]) * _cachetree->GetWeights().at(i);
                 maxdistance += f*f;
             }
             maxdistance = RaveSqrt(maxdistance);
-            if( maxdistance > _cachetree.GetMaxDistance()+g_fEpsilonLinear ) {
-                _cachetree.SetMaxDistance(maxdistance);
+            if( maxdistance > _cachetree->GetMaxDistance()+g_fEpsilonLinear ) {
+                _cachetree->SetMaxDistance(maxdistance);
             }
 
             _lowerlimit = _newlowerlimit;
             _upperlimit = _newupperlimit;
+            // the chains are longer if the limits of prismatic joints changed
+            _ComputeLinkMotions();
         }
     }
 }
 
 void ConfigurationCache::_UpdateRobotGrabbed()
 {
-    bool newGrab = false;
-
     _vnewgrabbedbodies.resize(0);
     _pstaterobot->GetGrabbed(_vnewgrabbedbodies);
-    FOREACH(oldbody, _setgrabbedbodies){
-        FOREACH(newbody, _vnewgrabbedbodies){
-            if ((*oldbody) != (*newbody)) {
-                newGrab = true;
-                break;
-            }
-        }
-    }
+    std::set<KinBodyPtr> setnewgrabbedbodies(_vnewgrabbedbodies.begin(), _vnewgrabbedbodies.end());
 
-    if (newGrab) {
+    if (setnewgrabbedbodies != _setgrabbedbodies) {
         RAVELOG_DEBUG("Updating robot grabbed\n");
+        _ChangeEnvironment();
         FOREACH(newbody, _vnewgrabbedbodies){
             UpdateCollisionConfigurations((*newbody));
         }
-        _setgrabbedbodies.insert(_vnewgrabbedbodies.begin(), _vnewgrabbedbodies.end());
+        if (_envupdates) {
+            // released bodies are obstacles again, bodies grabbed when the cache was created were never tracked
+            FOREACH(oldbody, _setgrabbedbodies) {
+                if( setnewgrabbedbodies.find(*oldbody) == setnewgrabbedbodies.end() && !(*oldbody)->GetUserData(_userdatakey) && (*oldbody)->GetEnvironmentId() != 0 ) {
+                    _TrackBody(*oldbody);
+                }
+            }
+        }
+        _setgrabbedbodies.swap(setnewgrabbedbodies);
+        // the volume of the robot changed for all configurations
         RemoveFreeConfigurations();
     }
 }
@@ -18,6 +18,11 @@
 #include "openraveplugindefs.h"
 #include <deque>
 #include <boost/pool/pool.hpp>
+#include <boost/atomic.hpp>
+#include <boost/thread/shared_mutex.hpp>
+#include <boost/unordered_map.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
 
 #define _(msgid) OpenRAVE::RaveGetLocalizedTextForDomain("openrave_plugins_configurationcache", msgid)
 
@@ -118,6 +123,10 @@ public:
 
 protected:
     std::vector<CacheTreeNode*> _vchildren; ///< direct children of this node (for the next level down)
+    std::vector<dReal> _vchildstates; ///< the states of _vchildren packed by dof, i.e. _vchildstates[idof*_childstride+ichild], so that the distances to all the children can be computed with vectorized loops
+    int _childstride; ///< the number of children _vchildstates has space for on every dof
+    int _levelindex; ///< index of this node in the nodes of its level
+    boost::atomic<int> _mappedindex; ///< if >= 0, the children of the node are not materialized yet and are in the node record _mappedindex of the mapped cache file. Atomic since queries holding the shared lock materialize the children concurrently
     ConfigurationNodeType _conftype; ///< configuration type for this node
     KinBody::LinkConstPtr _collidinglink; ///< collidinglink in the collision report for this node
     Transform _collidinglinktrans; ///< the colliding link's transform. Valid if _conftype is CNT_Collision
@@ -131,19 +140,19 @@ protected:
     int16_t _level; ///< the level the node belongs to
     uint8_t _hasselfchild; ///< if 1, then _vchildren has contains a clone of this node in the level below it.
     uint8_t _usenn; ///< if 1, then use part of the nearest neighbor search, otherwise ignore
-    int _hitcount; /// number of cache hits
+    boost::atomic<int> _hitcount; /// number of cache hits, atomic since it is increased by concurrent queries
 
     // managed by pool
 #ifdef _DEBUG
     int id;
 #endif
-    Vector* _plinkspheres; ///< xyz is center, w is radius^2 of every link on the robot, pointer managed by outside pool so do not delete
+    AABB* _plinkaabbs; ///< world aabbs of every link on the robot at this configuration (grabbed bodies are merged into their grabbing links), NULL if unknown. The aabbs follow the state values in the allocation of the structure, pointer managed by outside pool so do not delete
     dReal _pcstate[0]; ///< the state values, pointer managed by outside pool so do not delete. The values always follow the allocation of the structure.
 
 private:
     /// \brief cache tree node needs to be created by a separte memory pool in order to initialize correct pointers
-    CacheTreeNode(const std::vector<dReal>& cs, Vector* plinkspheres);
-    CacheTreeNode(const dReal* pstate, int dof, Vector* plinkspheres);
+    CacheTreeNode(const std::vector<dReal>& cs, AABB* plinkaabbs);
+    CacheTreeNode(const dReal* pstate, int dof, AABB* plinkaabbs);
     //~CacheTreeNode();
 
     friend class CacheTree;
@@ -152,12 +161,34 @@ private:
 typedef CacheTreeNode* CacheTreeNodePtr; ///< boost::shared_ptr might be too slow, and we never expose the pointers outside of CacheTree, so can use raw pointers.
 typedef const CacheTreeNode* CacheTreeNodeConstPtr;
 
+/// \brief cache statistics of one of the ConfigurationCache instances using a CacheTree
+///
+/// The counters are only increased by the thread of the client, but can be read from any thread.
+class CacheTreeClientStatistics
+{
+public:
+    CacheTreeClientStatistics(const std::string& name) : name(name), numchecks(0), numcollisionhits(0), numfreehits(0), numinserted(0) {
+    }
+
+    std::string name; ///< identifies the client, usually the environment id and the robot name
+    boost::atomic<uint64_t> numchecks; ///< number of queries
+    boost::atomic<uint64_t> numcollisionhits; ///< number of queries answered with a collision node
+    boost::atomic<uint64_t> numfreehits; ///< number of queries answered with a free node
+    boost::atomic<uint64_t> numinserted; ///< number of configurations inserted into the tree
+};
+
+typedef boost::shared_ptr<CacheTreeClientStatistics> CacheTreeClientStatisticsPtr;
+
 /** Cache stores configuration information in a data structure based on the Cover Tree (Beygelzimer et al. 2006 http://hunch.net/~jl/projects/cover_tree/icml_final/final-icml.pdf)
 
     The tree contains nodes with configurations, collision/free-space information, distance/nn statistics (e.g., dispersion, upper bounds on minimum distance to collisions, and admissible nearest neighbor), collision reports, etc. To be expanded to include a lean workspace representation for each node, i.e., enclosing spheres for each link, and an approximation of a connected graph (there is a path from every configuration to every other configuration, possible by considering log(n) neighbors) that is constructed from collision checking procedures (of the form qi to qf) and can be used to attempt to plan with the cache before sampling new configurations.
 
     Shouldn't know anything about the openrave environment.
 
+    The tree can be shared by the caches of several cloned environments running in different threads. Nearest neighbor queries hold a shared lock and can run concurrently, everything modifying the tree holds an exclusive lock.
+
+    If the tree is created with link aabbs, every node can store the workspace volume of the robot at its configuration. The nodes are indexed by the voxels their link aabbs touch, so that a body changing in the workspace only invalidates the free nodes whose volume overlaps the body instead of all of them.
+
     d(p,q) < (1 + e)d(p,S)
     2^(1+i) (1 + 1/e) <= d(p,Qi)
  */
@@ -165,7 +196,8 @@ class CacheTree
 {
 public:
 
-    CacheTree(int statedof);
+    /// \param numlinkaabbs the number of link aabbs stored with every node for the workspace index. If 0, the tree has no workspace index.
+    CacheTree(int statedof, int numlinkaabbs=0);
 
     virtual ~CacheTree();
 
@@ -177,6 +209,7 @@ public:
 
     /// \brief finds the nearest neighbor in the cover tree of a particular type.
     ///
+    /// The returned node is only valid until another thread modifies the tree.
     /// \param distancebound If > 0, the distance bound such that any points as close as distancebound will be immediately returned
     /// \param conftype the type of node to find. If CNT_Any, will return any type.
     std::pair<CacheTreeNodeConstPtr, dReal> FindNearestNode(const std::vector<dReal>& cs, dReal distancebound=-1, ConfigurationNodeType conftype = CNT_Any) const;
@@ -188,11 +221,25 @@ public:
     /// \param freespacethresh assumes > 0
     std::pair<CacheTreeNodeConstPtr, dReal> FindNearestNode(const std::vector<dReal>& cs, dReal collisionthresh, dReal freespacethresh) const;
 
+    /// \brief like FindNearestNode(cs, collisionthresh, freespacethresh), but copies the collision information of the node while the tree is locked.
+    ///
+    /// Has to be used instead of FindNearestNode when other threads can modify the tree, since they can remove the returned node.
+    /// \param[out] robotlinkindex set if the node is in collision
+    /// \param[out] collidinglink set if the node is in collision
+    /// \return the distance to the node, or -1 if no node was found
+    dReal FindNearestNodeCollisionInfo(const std::vector<dReal>& cs, dReal collisionthresh, dReal freespacethresh, bool& bcollision, int& robotlinkindex, KinBody::LinkConstPtr& collidinglink) const;
+
+    /// \brief like FindNearestNode(cs, distancebound, conftype), but copies the configuration of the node while the tree is locked.
+    ///
+    /// \return the distance to the node, or -1 if no node was found
+    dReal FindNearestNodeState(const std::vector<dReal>& cs, dReal distancebound, ConfigurationNodeType conftype, std::vector<dReal>& vstate) const;
+
     /// \brief inserts node in the tree. If node is too close to other nodes in the tree, then does not insert.
     ///
     /// \param[in] fMinSeparationDist the max distance a node should be separated from its closest neighbor. If node is collision, then only applies to collision neighbors, free neighbors are ignored.
+    /// \param[in] vlinkaabbs the world aabbs of the robot links at cs for the workspace index. If empty, the node is not indexed and its free space is invalidated by any change.
     /// \return 1 if point is inserted and parent found. 0 if no parent found and point is not inserted. -1 if parent found but point not inserted since it is close to fMinSeparationDist
-    int InsertNode(const std::vector<dReal>& cs, CollisionReportPtr report, dReal fMinSeparationDist);
+    int InsertNode(const std::vector<dReal>& cs, CollisionReportPtr report, dReal fMinSeparationDist, const std::vector<AABB>& vlinkaabbs=std::vector<AABB>());
 
     /// \brief removes node from the tree
     ///
@@ -203,6 +250,8 @@ public:
     void UpdateCollisionNodes(KinBodyPtr pbody);
 
     /// \brief number of nodes in the tree; todo: also count nodes by type
+    ///
+    /// Not locked, the value can be stale if other threads insert into the tree
     int GetNumNodes() const {
         return _numnodes;
     }
@@ -216,7 +265,7 @@ public:
     /// \brief sets the weights
     void SetWeights(const std::vector<dReal>& weights);
 
-    /// \brief returns the current weights
+    /// \brief returns the current weights. Not locked, the weights only change with SetWeights.
     const std::vector<dReal>& GetWeights() const {
         return _weights;
     }
@@ -252,26 +301,150 @@ public:
     /// \brief sets all collision configurations with pbody in its report to CNT_Unknown
     int UpdateCollisionConfigurations(KinBodyPtr pbody);
 
-    /// \brief sets all free configurations to CNT_Unknown, TODO, only set those that overlap with the new body
-    int UpdateFreeConfigurations(KinBodyPtr pbody);
+    /// \brief sets all free configurations whose link aabbs overlap with any of vaabbs to CNT_Unknown.
+    ///
+    /// Uses the workspace index, if the tree does not have one, all free configurations are set to CNT_Unknown.
+    /// \param vaabbs the world aabbs of the region that changed, for example the links of a moved body
+    int UpdateFreeConfigurations(const std::vector<AABB>& vaabbs);
+
+    /// \brief sets the voxel size of the workspace index and rebuilds it. If 0, the index is disabled.
+    void SetWorkspaceVoxelSize(dReal voxelsize);
+
+    /// \brief returns the voxel size of the workspace index
+    dReal GetWorkspaceVoxelSize() const {
+        return _fVoxelSize;
+    }
+
+    /// \brief returns the number of link aabbs stored with every node
+    int GetNumLinkAABBs() const {
+        return _numlinkaabbs;
+    }
 
     /// \brief returns the number of configurations in the tree that are not CNT_Unknown
-    int GetNumKnownNodes();
+    int GetNumKnownNodes() const;
+
+    /// \brief saves the cache to disk in the versioned cache file format
+    ///
+    /// \param robothash identifies the robot kinematics and geometry the cache was built for
+    /// \param envhash identifies the environment geometry, empty if the cache does not depend on it (self collision)
+    int SaveCache(std::string filename, const std::string& robothash=std::string(), const std::string& envhash=std::string());
+
+    /// \brief maps a cache file saved with SaveCache into memory
+    ///
+    /// Only the root is created, the children of a node are materialized from the file the first time an operation reaches the node. Queries keep the shared lock and materialize the nodes one at a time. The updates of the collision and free configurations change the types of the records still in the file without materializing them, other operations that need all the nodes (validation, saving, removal) materialize the rest of the tree first.
+    /// The file is rejected if its sections or its tree structure are inconsistent.
+    /// \param robothash, envhash have to match the hashes the file was saved with, otherwise the file is not loaded
+    /// \return 1 if the file was loaded
+    int LoadCache(std::string filename, EnvironmentBasePtr penv, const std::string& robothash=std::string(), const std::string& envhash=std::string());
+
+    /// \brief returns the number of nodes that are still in the mapped cache file
+    int GetNumMappedNodes() const {
+        return _nummappednodes;
+    }
+
+    /// \brief registers a client of the tree for GetClientStatistics. The tree only keeps a weak pointer to the statistics.
+    void AddClient(CacheTreeClientStatisticsPtr stats);
 
-    /// \brief save cache to disk
-    int SaveCache(std::string filename);
+    /// \brief returns the statistics of all the clients still using the tree
+    void GetClientStatistics(std::vector<CacheTreeClientStatisticsPtr>& vstats) const;
 
-    /// \brief load cache from disk
-    int LoadCache(std::string filename, EnvironmentBasePtr penv);
+private:
+    /// \brief the buffers of the nearest neighbor queries, every running query has its own so that queries can run concurrently
+    struct NearestNodeBuffers
+    {
+        std::vector< std::pair<CacheTreeNodePtr, dReal> > vCurrentLevelNodes, vNextLevelNodes;
+        std::vector<dReal> vChildDistances;
+    };
+
+    /// \brief takes free buffers from the tree for one query and gives them back when destroyed
+    class NearestNodeBuffersScope
+    {
+public:
+        NearestNodeBuffersScope(const CacheTree& tree);
+        ~NearestNodeBuffersScope();
 
+        NearestNodeBuffers& buffers;
 private:
+        const CacheTree& _tree;
+    };
+
+    NearestNodeBuffers& _AcquireNearestNodeBuffers() const;
+    void _ReleaseNearestNodeBuffers(NearestNodeBuffers& buffers) const;
+
+    /// \brief FindNearestNode without locking
+    std::pair<CacheTreeNodeConstPtr, dReal> _FindNearestNode(const std::vector<dReal>& cs, dReal distancebound, ConfigurationNodeType conftype) const;
+    std::pair<CacheTreeNodeConstPtr, dReal> _FindNearestNode(const std::vector<dReal>& cs, dReal collisionthresh, dReal freespacethresh) const;
+
+    /// \brief Reset, Init, SetMaxDistance and SetBase without locking
+    void _Reset();
+    void _Init(const std::vector<dReal>& weights, dReal maxdistance);
+    void _SetMaxDistance(dReal maxdistance);
+    int _GetNumKnownNodes() const;
+
+    struct CacheFileNode;
+
+    /// \brief creates the node from its record in the mapped cache file. Its children are left in the file.
+    CacheTreeNodePtr _MaterializeNode(int mappedindex);
+
+    /// \brief creates the children of pnode from the mapped cache file. Needs the exclusive lock or _mutexMaterialize.
+    void _MaterializeChildren(CacheTreeNodePtr pnode);
+
+    /// \brief materializes all the nodes still in the mapped cache file and unmaps it. Needs the exclusive lock or _mutexMaterialize.
+    void _MaterializeAll();
+
+    /// \brief _MaterializeChildren and _MaterializeAll for queries holding the shared lock
+    void _MaterializeChildrenShared(CacheTreeNodePtr pnode) const;
+    void _MaterializeAllShared() const;
+
+    /// \brief releases the mapped cache file, the nodes not materialized yet are lost
+    void _UnmapCache();
+
+    /// \brief returns true if the sections of a mapped cache file are in bounds and its node records form one tree, so the nodes can be materialized without further checks
+    static bool _CheckCacheFile(const uint8_t* pdata, uint64_t datasize);
+
+    /// \brief adds a child to the node and its packed child states
+    void _AddChild(CacheTreeNodePtr pnode, CacheTreeNodePtr pchild);
+
+    /// \brief removes the child at index ichild, the last child takes its place
+    void _RemoveChild(CacheTreeNodePtr pnode, size_t ichild);
+
+    /// \brief packs the states of all the children of pnode, used when the children are set directly
+    void _UpdateChildStates(CacheTreeNodePtr pnode);
+
+    /// \brief computes the distances from the query state to all the children of pnode
+    ///
+    /// \param[out] pdists2 has to hold pnode->_vchildren.size() values, the squared distances in the same order as the children
+    void _ComputeChildDistances2(CacheTreeNodeConstPtr pnode, const dReal* pquerystate, dReal* pdists2) const;
+
+    /// \brief adds a node to the nodes of its level
+    void _AddLevelNode(CacheTreeNodePtr pnode);
+
+    /// \brief removes a node from the nodes of its level, the last node of the level takes its place
+    void _RemoveLevelNode(CacheTreeNodePtr pnode);
+
     /// \brief creates new node on the pool
-    CacheTreeNodePtr _CreateCacheTreeNode(const std::vector<dReal>& cs, CollisionReportPtr report);
+    CacheTreeNodePtr _CreateCacheTreeNode(const std::vector<dReal>& cs, CollisionReportPtr report, const std::vector<AABB>& vlinkaabbs=std::vector<AABB>());
     CacheTreeNodePtr _CloneCacheTreeNode(CacheTreeNodeConstPtr refnode);
 
     /// \brief deletes the node from the pool and calls its destructor.
     void _DeleteCacheTreeNode(CacheTreeNodePtr pnode);
 
+    /// \brief returns true if the free nodes can be invalidated with the workspace index
+    inline bool _IsWorkspaceIndexed() const {
+        return _numlinkaabbs > 0 && _fVoxelSize > 0;
+    }
+
+    /// \brief adds a node that is part of the tree to the workspace index
+    void _AddToWorkspaceIndex(CacheTreeNodePtr pnode);
+
+    /// \brief removes a node from the workspace index before it is deleted
+    void _RemoveFromWorkspaceIndex(CacheTreeNodePtr pnode);
+
+    /// \brief computes the keys of all the voxels touched by the aabbs. The keys are sorted and unique.
+    ///
+    /// \param maxkeys if > 0 and the aabbs touch more voxels, stops and returns false
+    bool _GetVoxelKeys(const AABB* paabbs, int numaabbs, std::vector<uint64_t>& vkeys, size_t maxkeys=0) const;
+
     /// \brief takes in the configurations of two nodes and returns the distance, currently returning square of L2 norm.
     ///
     /// note the distance metric has to satisfy triangle inequality
@@ -293,6 +466,14 @@ private:
     /// \param fInsetLevelBound pow(_base,maxinsertlevel)
     bool _InsertDirectly(CacheTreeNodePtr nodein, CacheTreeNodePtr parentnode, dReal parentdist, int maxinsertlevel, dReal fInsetLevelBound2);
 
+    /// \brief removes one node without its clones, has to be called with the exclusive lock and materialized nodes
+    bool _RemoveNode(CacheTreeNodePtr removenode);
+
+    /// \brief clones pnode up to level, every clone has the previous one as its self child
+    ///
+    /// The clones are added to the cover sets of their levels. Returns the highest clone, or pnode if it is already at level.
+    CacheTreeNodePtr _CloneCacheTreeNodeUpTo(CacheTreeNodePtr pnode, int level, std::vector< std::vector<CacheTreeNodePtr> >& vvCoverSetNodes);
+
     /// \param[inout] coversetnodes for every level starting at the max, the parent cover sets. coversetnodes[i] is the _maxlevel-i level
     bool _Remove(CacheTreeNodePtr node, std::vector< std::vector<CacheTreeNodePtr> >& vvCoverSetNodes, int level, dReal levelbound2);
 
@@ -318,12 +499,8 @@ private:
     std::vector<dReal> _curconf;
 
     std::string _fulldirname;
-    CacheTreeNodePtr _newnode; ///< for loading
-    std::string _collidingbodyname;
-    KinBodyPtr _pcollidingbody;
 
-    std::map<CacheTreeNodePtr, int> _mapNodeIndices;
-    std::vector< std::set<CacheTreeNodePtr> > _vsetLevelNodes; ///< _vsetLevelNodes[enc(level)][node] holds the indices of the children of "node" of a given the level. enc(level) maps (-inf,inf) into [0,inf) so it can be indexed by the vector. Every node has an entry in a map here. If the node doesn't hold any children, then it is at the leaf of the tree. _vsetLevelNodes.at(_EncodeLevel(_maxlevel)) is the root.
+    std::vector< std::vector<CacheTreeNodePtr> > _vvLevelNodes; ///< _vvLevelNodes[enc(level)] holds all the nodes of a given level, node->_levelindex is the index of the node. enc(level) maps (-inf,inf) into [0,inf) so it can be indexed by the vector. If the node doesn't hold any children, then it is at the leaf of the tree. _vvLevelNodes.at(_EncodeLevel(_maxlevel)).at(0) is the root.
 
     boost::shared_ptr<boost::pool<> > _poolNodes; ///< the dynamically growing memory pool of nodes. Since each node's size is determined during run-time, the pool constructor has to be called with the correct node size
 
@@ -333,19 +510,46 @@ private:
     int _statedof; ///< the state space DOF tree is configured for
     int _maxlevel; ///< the maximum allowed levels in the tree, this is where the root node starts (inclusive)
     int _minlevel; ///< the minimum allowed levels in the tree (inclusive)
-    int _numnodes; ///< the number of nodes in the current tree starting at the root at _vsetLevelNodes.at(_EncodeLevel(_maxlevel))
+    int _numnodes; ///< the number of nodes in the current tree starting at the root at _vvLevelNodes.at(_EncodeLevel(_maxlevel))
+    int _numlinkaabbs; ///< the number of link aabbs every node has memory for
     dReal _fMaxLevelBound; ///< pow(_base, _maxlevel)
 
-    // cache cache
-    mutable std::vector< std::pair<CacheTreeNodePtr, dReal> > _vCurrentLevelNodes, _vNextLevelNodes;
+    mutable boost::shared_mutex _mutex; ///< shared for nearest neighbor queries, exclusive for everything changing the tree
+    mutable boost::mutex _mutexNearestNodeBuffers;
+    mutable std::vector<NearestNodeBuffers*> _vFreeNearestNodeBuffers; ///< buffers not used by any query, there are as many as queries that ran at the same time. protected by _mutexNearestNodeBuffers, deleted with the tree
+    mutable boost::mutex _mutexClients;
+    std::list< boost::weak_ptr<CacheTreeClientStatistics> > _listClients; ///< protected by _mutexClients
+
+    // cache cache, only used with the exclusive lock
+    std::vector< std::pair<CacheTreeNodePtr, dReal> > _vCurrentLevelNodes, _vNextLevelNodes;
+    std::vector<dReal> _vChildDistances;
     mutable std::vector< std::vector<CacheTreeNodePtr> > _vvCacheNodes;
 
-    std::vector<CacheTreeNodePtr> _vnodes; ///< for loading
-    std::vector<dReal> _dummycs; ///< for loading
+    dReal _fVoxelSize, _fVoxelSizeInv; ///< edge length of the voxels of the workspace index
+    boost::unordered_map<uint64_t, std::vector<CacheTreeNodePtr> > _mapVoxelNodes; ///< for every voxel of the workspace, the nodes whose link aabbs touch it
+    std::set<CacheTreeNodePtr> _setUnindexedNodes; ///< nodes without link aabbs, their free space is invalidated by any change
+    std::vector<uint64_t> _vVoxelKeys; ///< cache, only used with the exclusive lock or _mutexMaterialize
+    std::vector<CacheTreeNodePtr> _vCandidateNodes; ///< cache, only used with the exclusive lock
+
+    boost::shared_ptr<boost::interprocess::file_mapping> _pmappedfile;
+    boost::shared_ptr<boost::interprocess::mapped_region> _pmappedregion; ///< the cache file the nodes are materialized from, reset once all nodes are materialized
+    const CacheFileNode* _pmappednodes; ///< node records in the mapped file
+    const int32_t* _pmappedchildren; ///< indices of the children of the node records
+    const dReal* _pmappedstates; ///< _statedof values for every node record
+    const dReal* _pmappedlinkaabbs; ///< 6 values (pos, extents) for every link aabb of every node record, NULL if the file has no link aabbs
+    std::vector<KinBodyPtr> _vmappedbodies; ///< the colliding bodies of the node records
+    std::vector<uint8_t> _vmappedconftypes; ///< the types of the node records, changed by the updates in place of the read-only records. CNT_Unknown once a record is materialized
+    mutable boost::mutex _mutexMaterialize; ///< serializes the materialization of queries holding the shared lock
+    int _nummappednodes; ///< number of node records not materialized yet
+    int _nummappedknownnodes; ///< number of node records not materialized yet whose type is not CNT_Unknown
 };
 
 typedef boost::shared_ptr<CacheTree> CacheTreePtr;
 
+class ConfigurationCache;
+typedef boost::shared_ptr<ConfigurationCache> ConfigurationCachePtr;
+typedef boost::shared_ptr<ConfigurationCache const> ConfigurationCacheConstPtr;
+
 /** Maintains an up-to-date cache tree synchronized to the openrave environment. Tracks bodies being added removed, states changing, etc.
    The state of cache consists of the active DOFs of the robot that is passed in at constructor time.
  */
@@ -375,9 +579,28 @@ public:
     /// \brief removes all free configurations
     int RemoveFreeConfigurations();
 
-    /// \brief removes all free configurations, to be updated to only remove those with linkspheres that overlap with the body
+    /// \brief removes the free configurations where the robot overlaps with the enabled links of pbody, used to update cache when bodies are added or moved
     int UpdateFreeConfigurations(KinBodyPtr pbody);
 
+    /// \brief sets the parameters of the workspace index used to invalidate free configurations selectively.
+    ///
+    /// Since a free configuration also stands for the configurations up to the free space threshold away, the link aabbs of the configurations are always grown by how far the links can move within that threshold.
+    /// \param voxelsize the edge length of the voxels in meters. If 0, all free configurations are invalidated when a body changes.
+    /// \param margin added to the link aabbs on top of that, for example to cover a padding of the geometry used by the collision checker.
+    void SetWorkspaceIndexParameters(dReal voxelsize, dReal margin);
+
+    /// \brief returns the voxel size of the workspace index
+    inline dReal GetWorkspaceVoxelSize() const
+    {
+        return _cachetree->GetWorkspaceVoxelSize();
+    }
+
+    /// \brief returns the margin added to the link aabbs of the configurations on top of how far the links can move within the free space threshold
+    inline dReal GetWorkspaceMargin() const
+    {
+        return _workspacemargin;
+    }
+
     /// \brief determine if current configuration is whithin threshold of a collision in the cache (_collisionthresh), known to be in collision, or requires an explicit collision check
     /// \return 1 if in collision, 0 if not in collision, -1 if unknown
     int CheckCollision(const std::vector<dReal>& cs, KinBody::LinkConstPtr& robotlink, KinBody::LinkConstPtr& collidinglink, dReal& closestdist);
@@ -387,13 +610,46 @@ public:
     /// \brief invalidate the entire cache
     void Reset();
 
+    /// \brief uses the cache tree of another cache, usually of the same robot in a cloned environment, and copies its thresholds.
+    ///
+    /// Afterwards all the caches sharing the tree see each other's configurations and invalidations. The robots have to have the same DOF and weights.
+    /// \return false if the cache is not compatible and cannot be shared
+    bool ShareCacheTree(ConfigurationCacheConstPtr cache);
+
+    /// \brief returns true if the cache tree is used by other caches
+    bool IsCacheTreeShared() const {
+        return _cachetree.use_count() > 1;
+    }
+
+    /// \brief returns the number of changes of the environment that invalidated the configurations of this cache.
+    ///
+    /// A cache of a cloned environment can only share the tree if the stamp did not change since the clone.
+    inline uint64_t GetEnvironmentStamp() const {
+        return _nEnvironmentStamp;
+    }
+
+    /// \brief returns the hash of the robot and the environment the configurations of this cache depend on. Caches of different environments can only share the tree if their hashes are the same.
+    inline std::string GetStateHash() const {
+        return _GetRobotHash() + _GetEnvironmentHash();
+    }
+
+    /// \brief returns the statistics of this cache
+    CacheTreeClientStatisticsPtr GetStatistics() const {
+        return _stats;
+    }
+
+    /// \brief returns the statistics of all the caches sharing the tree
+    void GetSharedStatistics(std::vector<CacheTreeClientStatisticsPtr>& vstats) const {
+        _cachetree->GetClientStatistics(vstats);
+    }
+
     void GetDOFValues(std::vector<dReal>& values);
 
     //int SynchronizeAll(KinBodyConstPtr pbody = KinBodyConstPtr());
 
     /// \brief number of nodes currently in the cover tree
     int GetNumNodes() const {
-        return _cachetree.GetNumNodes();
+        return _cachetree->GetNumNodes();
     }
 
     /// \brief number of nodes with known type, i.e., != CNT_Unknown
@@ -401,7 +657,7 @@ public:
 
     /// \brief return configuration values for all nodes in the tree, calls cachetree's function
     void GetNodeValues(std::vector<dReal>& vals) const {
-        _cachetree.GetNodeValues(vals);
+        _cachetree->GetNodeValues(vals);
     }
 
     /// \brief return nearest configuration and distance
@@ -409,7 +665,7 @@ public:
 
     /// \brief return distance between two configurations as computed by the tree (for testing)
     dReal ComputeDistance(const std::vector<dReal>& qi, const std::vector<dReal>& qf) const {
-        return _cachetree.ComputeDistance(qi,qf);
+        return _cachetree->ComputeDistance(qi,qf);
     }
 
     /// \brief the cache will assume a new configuration is in collision if the nearest node in the tree is below this distance
@@ -419,15 +675,12 @@ public:
     }
 
     /// \brief set the freespacethresh parameter
-    inline void SetFreeSpaceThresh(dReal freespacethresh)
-    {
-        _freespacethresh = freespacethresh;
-    }
+    void SetFreeSpaceThresh(dReal freespacethresh);
 
     /// \brief set the base parameter
     inline void SetBase(dReal base)
     {
-        _cachetree.SetBase(base);
+        _cachetree->SetBase(base);
     }
 
     /// \brief disable environment updates
@@ -472,7 +725,7 @@ public:
     /// \brief returns the base parameter
     inline dReal GetBase() const
     {
-        return _cachetree.GetBase();
+        return _cachetree->GetBase();
     }
 
     /// \brief returns the robot
@@ -486,19 +739,29 @@ public:
     /// \brief remove all nodes in collision with pbody, for testing
     inline void UpdateCollisionNodes(KinBodyPtr pbody)
     {
-        _cachetree.UpdateCollisionNodes(pbody);
+        _cachetree->UpdateCollisionNodes(pbody);
     }
 
-    /// \brief saves the cache to disk
-    inline void SaveCache(std::string filename)
+    /// \brief removes a node at the configuration from the tree, for testing
+    /// \return false if the tree has no node at the configuration
+    bool RemoveNode(const std::vector<dReal>& conf);
+
+    /// \brief saves the cache to a database file, tagged with the robot hash and, if the cache tracks the environment, with the environment hash
+    inline int SaveCache(std::string filename)
     {
-        _cachetree.SaveCache(filename);
+        return _cachetree->SaveCache(filename, _GetRobotHash(), _GetEnvironmentHash());
     }
 
-    /// \brief loads cache from disk
-    inline void LoadCache(std::string filename, EnvironmentBasePtr penv)
+    /// \brief maps a cache saved with SaveCache, nodes are materialized lazily. Fails if the robot or the environment changed since the cache was saved.
+    inline int LoadCache(std::string filename, EnvironmentBasePtr penv)
     {
-        _cachetree.LoadCache(filename, penv);
+        return _cachetree->LoadCache(filename, penv, _GetRobotHash(), _GetEnvironmentHash());
+    }
+
+    /// \brief returns the number of nodes of a loaded cache that are not materialized yet
+    inline int GetNumMappedNodes() const
+    {
+        return _cachetree->GetNumMappedNodes();
     }
 
 private:
@@ -514,7 +777,38 @@ private:
     /// \brief called when grabbeb bodies are updated
     void _UpdateRobotGrabbed();
 
-    CacheTree _cachetree; ///< cache tree datastructure with configurations and their collision information
+    /// \brief starts tracking the changes of a body of the environment
+    void _TrackBody(KinBodyPtr pbody);
+
+    /// \brief replaces the shared cache tree with an empty tree of the same parameters used only by this cache
+    void _UnshareCacheTree();
+
+    /// \brief called before the configurations are updated for a change of the environment of this cache. Since the
+    /// caches sharing the tree are in other environments, which did not change, stops sharing the tree with them.
+    void _ChangeEnvironment();
+
+    /// \brief computes the world aabbs of the robot links at its current configuration for the workspace index. The aabbs of grabbed bodies are merged into the aabbs of their grabbing links.
+    ///
+    /// The aabbs are grown by how far the links can move within the free space threshold and by the workspace margin.
+    void _ComputeLinkAABBs(std::vector<AABB>& vlinkaabbs);
+
+    /// \brief computes _vvlinkmotions from the kinematics of the robot and the dofs of the cache
+    void _ComputeLinkMotions();
+
+    /// \brief returns a bound of the distance of the origin of plink to the point vstart, which is attached to pstartlink, over all the configurations of the robot
+    dReal _ComputeChainLength(const Vector& vstart, KinBody::LinkConstPtr pstartlink, KinBody::LinkConstPtr plink) const;
+
+    /// \brief hash of the robot kinematics and geometry, its grabbed bodies, the dofs of the cache and the values of the other dofs
+    std::string _GetRobotHash() const;
+
+    /// \brief hash of the robot base transform, unless it is part of the cache, and of the geometry and the poses of all the other bodies except the grabbed ones. Empty if the cache does not track the environment.
+    std::string _GetEnvironmentHash() const;
+
+    /// \brief returns the link of the environment of this cache corresponding to a link of a node, which might have been inserted by a cache of another environment
+    KinBody::LinkConstPtr _GetEnvironmentLink(KinBody::LinkConstPtr plink) const;
+
+    CacheTreePtr _cachetree; ///< cache tree datastructure with configurations and their collision information, can be shared with other caches
+    CacheTreeClientStatisticsPtr _stats; ///< statistics of this cache, registered with the tree
 
     RobotBasePtr _pstaterobot;
     std::vector<int> _vRobotActiveIndices;
@@ -529,6 +823,19 @@ private:
     std::vector<dReal> _newupperlimit, _newlowerlimit;
     std::vector<CacheTreeNodePtr> _cachetreenodes;
     std::vector<dReal> _vweights;
+    std::vector<dReal> _vcurvalues; ///< cache
+    std::vector<AABB> _vlinkaabbs, _vbodyaabbs; ///< cache
+    std::vector<KinBody::GrabbedInfoPtr> _vgrabbedinfos; ///< cache
+
+    /// \brief how a dof of the cache moves a link, used to bound how far the link moves within the free space threshold
+    struct LinkDOFMotion
+    {
+        int index; ///< index of the dof in the configurations of the cache
+        bool brotation; ///< true if the dof rotates the link, otherwise it translates it
+        dReal fradius; ///< if brotation, a bound of the distance of the link origin to the rotation axis, otherwise 1
+        dReal fmult; ///< bound of the rotation angle or the translation per unit of the dof
+    };
+    std::vector< std::vector<LinkDOFMotion> > _vvlinkmotions; ///< for every link, the dofs moving it
 
     class KinBodyCachedData : public UserData
     {
@@ -543,6 +850,8 @@ public:
 
     dReal _collisionthresh; ///< configurations in this distance range (from a collsion configuration in the tree) will be assumed to be in collision
     dReal _freespacethresh; ///< configurations in this distance range (from a free configuration in the tree)  will be assumed to not be in collision
+    dReal _workspacemargin; ///< margin added to the link aabbs of the configurations for the workspace index
+    uint64_t _nEnvironmentStamp; ///< incremented on every change of the environment, see GetEnvironmentStamp
     dReal _insertiondistancemult; ///< only insert nodes if they are far from the nearest node in the tree. The distance is computed by multiplying this number of _collisionthresh or _freespacethresh. Distance a configuration must have from the nearest configuration in the tree in order for it be inserted
     std::string _userdatakey;
     UserDataPtr _handleJointLimitChange, _handleGrabbedChange; ///< handles for changes in the robot's joint limits and grabbed bodies
@@ -553,8 +862,6 @@ public:
 
 };
 
-typedef boost::shared_ptr<ConfigurationCache> ConfigurationCachePtr;
-
 }
 
 #endif
@@ -317,6 +317,22 @@ public:
         return _cache->Validate();
     }
 
+    bool RemoveNode(object ovalues) {
+        return _cache->RemoveNode(ExtractArray<dReal>(ovalues));
+    }
+
+    int SaveCache(const std::string& filename) {
+        return _cache->SaveCache(filename);
+    }
+
+    int LoadCache(const std::string& filename) {
+        return _cache->LoadCache(filename, _cache->GetRobot()->GetEnv());
+    }
+
+    int GetNumMappedNodes() {
+        return _cache->GetNumMappedNodes();
+    }
+
     object GetNodeValues() {
         std::vector<dReal> values;
         _cache->GetNodeValues(values);
@@ -367,6 +383,10 @@ BOOST_PYTHON_MODULE(openravepy_configurationcache)
     .def("GetRobot",&PyConfigurationCache::GetRobot)
     .def("GetNumNodes",&PyConfigurationCache::GetNumNodes)
     .def("Validate", &PyConfigurationCache::Validate)
+    .def("RemoveNode", &PyConfigurationCache::RemoveNode, args("values"))
+    .def("SaveCache", &PyConfigurationCache::SaveCache, args("filename"))
+    .def("LoadCache", &PyConfigurationCache::LoadCache, args("filename"))
+    .def("GetNumMappedNodes", &PyConfigurationCache::GetNumMappedNodes)
     .def("GetNodeValues", &PyConfigurationCache::GetNodeValues)
     .def("FindNearestNode", &PyConfigurationCache::FindNearestNode)
     .def("ComputeDistance", &PyConfigurationCache::ComputeDistance)
@@ -0,0 +1,99 @@
+// -*- coding: utf-8 -*-
+// Copyright (C) 2016 Rosen Diankov
+//
+// This program is free software: you can redistribute it and/or modify it under the terms of the
+// GNU Lesser General Public License as published by the Free Software Foundation, either version 3
+// of the License, or at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+// even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License along with this program.
+// If not, see <http://www.gnu.org/licenses/>.
+
+// Fills a standalone CacheTree with random configurations until it has numnodes nodes, then times
+// numqueries insertions, nearest neighbor queries and threshold queries on the full tree. The
+// thresholds are the defaults of ConfigurationCache and every dof has the same resolution.
+//
+// Usage: timecachetree [numnodes] [numqueries] [dof] [resolution]
+#include "configurationcachetree.h"
+
+using namespace configurationcache;
+
+/// \brief fills vconfs with uniformly random configurations between vlower and vupper
+static void SampleConfigurations(uint32_t& seed, const std::vector<dReal>& vlower, const std::vector<dReal>& vupper, std::vector< std::vector<dReal> >& vconfs)
+{
+    FOREACH(itconf, vconfs) {
+        for(size_t i = 0; i < vlower.size(); ++i) {
+            (*itconf)[i] = vlower[i] + rand_r(&seed)*(vupper[i]-vlower[i])/RAND_MAX;
+        }
+    }
+}
+
+static double GetRate(size_t num, uint64_t elapsedtime)
+{
+    return elapsedtime > 0 ? 1e9*num/elapsedtime : 0;
+}
+
+int main(int argc, char** argv)
+{
+    int numnodes = argc > 1 ? atoi(argv[1]) : 1000000;
+    int numqueries = argc > 2 ? atoi(argv[2]) : 10000;
+    int dof = argc > 3 ? atoi(argv[3]) : 7;
+    dReal resolution = argc > 4 ? atof(argv[4]) : 0.02;
+    if( numnodes <= 0 || numqueries <= 0 || dof <= 0 || resolution <= 0 ) {
+        RAVELOG_ERROR("usage: timecachetree [numnodes] [numqueries] [dof] [resolution]\n");
+        return 1;
+    }
+
+    // same weights, maxdistance and thresholds as a ConfigurationCache on a robot with these dofs
+    const dReal collisionthresh = 1.0, freespacethresh = 0.2, insertiondistancemult = 0.5;
+    std::vector<dReal> vweights(dof, 1/resolution), vlower(dof, -PI), vupper(dof, PI);
+    dReal maxdistance = 0;
+    for(int i = 0; i < dof; ++i) {
+        dReal f = (vupper[i] - vlower[i])*vweights[i];
+        maxdistance += f*f;
+    }
+    CacheTree cachetree(dof);
+    cachetree.Init(vweights, RaveSqrt(maxdistance));
+
+    uint32_t seed = 0;
+    std::vector< std::vector<dReal> > vfillconfs(1, vlower), vconfs(numqueries, vlower);
+    dReal fminseparation = freespacethresh*insertiondistancemult;
+
+    // samples closer than fminseparation to a node are rejected, so keep inserting until the tree has numnodes nodes.
+    // every insertion counts in the rate since a rejected one also searches the tree.
+    uint64_t starttime = utils::GetNanoPerformanceTime();
+    int numfillinserts = 0;
+    while(cachetree.GetNumNodes() < numnodes && numfillinserts < 10*numnodes) {
+        SampleConfigurations(seed, vlower, vupper, vfillconfs);
+        cachetree.InsertNode(vfillconfs[0], CollisionReportPtr(), fminseparation);
+        ++numfillinserts;
+    }
+    uint64_t filltime = utils::GetNanoPerformanceTime() - starttime;
+
+    // the rates at the full size, the queries are sampled before the time is measured
+    SampleConfigurations(seed, vlower, vupper, vconfs);
+    starttime = utils::GetNanoPerformanceTime();
+    FOREACHC(itconf, vconfs) {
+        cachetree.FindNearestNode(*itconf, -1, CNT_Any);
+    }
+    uint64_t querytime = utils::GetNanoPerformanceTime() - starttime;
+
+    starttime = utils::GetNanoPerformanceTime();
+    FOREACHC(itconf, vconfs) {
+        cachetree.FindNearestNode(*itconf, collisionthresh, freespacethresh);
+    }
+    uint64_t threshquerytime = utils::GetNanoPerformanceTime() - starttime;
+
+    starttime = utils::GetNanoPerformanceTime();
+    FOREACHC(itconf, vconfs) {
+        cachetree.InsertNode(*itconf, CollisionReportPtr(), fminseparation);
+    }
+    uint64_t inserttime = utils::GetNanoPerformanceTime() - starttime;
+
+    RAVELOG_INFO_FORMAT("%d dofs, tree filled to %d nodes at %f insertions per second", dof%cachetree.GetNumNodes()%GetRate(numfillinserts, filltime));
+    RAVELOG_INFO_FORMAT("on the full tree: %f insertions, %f nearest neighbor queries, %f threshold queries per second", GetRate(vconfs.size(), inserttime)%GetRate(vconfs.size(), querytime)%GetRate(vconfs.size(), threshquerytime));
+    return 0;
+}
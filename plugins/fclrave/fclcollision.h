@@ -598,7 +598,7 @@ public:
         }
 
         // We only want to consider the enabled links
-        int adjacentOptions = KinBody::AO_Enabled;
+        int adjacentOptions = KinBody::AO_Enabled|KinBody::AO_SampledColliding;
         if( (_options & OpenRAVE::CO_ActiveDOFs) && pbody->IsRobot() ) {
             adjacentOptions |= KinBody::AO_ActiveDOFs;
         }
@@ -646,7 +646,7 @@ public:
         }
 
         // We only want to consider the enabled links
-        int adjacentOptions = KinBody::AO_Enabled;
+        int adjacentOptions = KinBody::AO_Enabled|KinBody::AO_SampledColliding;
         if( (_options & OpenRAVE::CO_ActiveDOFs) && pbody->IsRobot() ) {
             adjacentOptions |= KinBody::AO_ActiveDOFs;
         }
@@ -0,0 +1,493 @@
+// -*- coding: utf-8 -*-
+// Copyright (C) 2006-2011 Rosen Diankov <rosen.diankov@gmail.com>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#ifndef OPENRAVE_GRASPER_CONVEXHULL_H
+#define OPENRAVE_GRASPER_CONVEXHULL_H
+
+#include "plugindefs.h"
+
+#include <algorithm>
+#include <cmath>
+
+/** \brief Quickhull in any dimension with simplicial facets.
+
+    Unlike qhull, which keeps its state in globals and has to be serialized, all the state is kept in the instance, so
+    every thread can compute hulls with its own instance. The buffers are kept between calls, so computing many small
+    hulls (like the 6D wrench spaces of the force closure analysis) does not allocate once the instance is warmed up.
+
+    Points closer than a small tolerance to the hull are treated as inside, so coplanar facets are not merged; every
+    facet is a simplex of dim vertices and the planes of coplanar facets are repeated. The facet planes are oriented
+    with an interior point, so the vertices of the facets are not ordered.
+ */
+class ConvexHullND
+{
+public:
+    ConvexHullND() : _dim(0), _numpoints(0), _ppoints(NULL), _epsilon(0), _volume(0), _visitstamp(0) {
+    }
+
+    /// \brief computes the convex hull of the points, the previous hull is discarded
+    ///
+    /// \param vpoints numpoints*dim coordinates
+    /// \return false if the points do not span dim dimensions or the hull could not be built because of numerical problems
+    bool Compute(const std::vector<double>& vpoints, int dim)
+    {
+        _dim = dim;
+        _numpoints = dim > 0 ? vpoints.size()/dim : 0;
+        _volume = 0;
+        _vfacetvertices.resize(0);
+        _vfacetneighbors.resize(0);
+        _vfacetplanes.resize(0);
+        _vfacetareas.resize(0);
+        _vfacetoutside.resize(0);
+        _vfacetfurthest.resize(0);
+        _vfacetvisit.resize(0);
+        _vfreefacets.resize(0);
+        _vpendingfacets.resize(0);
+        _visitstamp = 0;
+        if( dim < 2 || _numpoints < (size_t)dim+1 ) {
+            return false;
+        }
+        _ppoints = &vpoints[0];
+        double maxabs = 0;
+        for(size_t i = 0; i < vpoints.size(); ++i) {
+            maxabs = std::max(maxabs, std::fabs(vpoints[i]));
+        }
+        _epsilon = 1e-12*dim*std::max(maxabs, 1e-3);
+        _vpointnext.resize(_numpoints);
+        _vbasis.resize(dim*dim);
+        _vtemp.resize(dim);
+        _vcenter.resize(dim);
+
+        bool bsuccess = _ComputeInitialSimplex() && _Expand();
+        if( bsuccess ) {
+            for(int ifacet = 0; ifacet < (int)_vfacetvisit.size(); ++ifacet) {
+                if( _vfacetvisit[ifacet] >= 0 ) {
+                    // cone from the interior point
+                    _volume -= _vfacetareas[ifacet]*_ComputeDistance(ifacet, &_vcenter[0])/dim;
+                }
+            }
+        }
+        _ppoints = NULL;
+        return bsuccess;
+    }
+
+    /// \brief returns the planes of the facets, dim+1 values each: the outward unit normal and the offset. Points inside the hull satisfy normal.x + offset <= 0.
+    void GetPlanes(std::vector<double>& vplanes) const
+    {
+        vplanes.resize(0);
+        for(int ifacet = 0; ifacet < (int)_vfacetvisit.size(); ++ifacet) {
+            if( _vfacetvisit[ifacet] >= 0 ) {
+                vplanes.insert(vplanes.end(), _vfacetplanes.begin()+ifacet*(_dim+1), _vfacetplanes.begin()+(ifacet+1)*(_dim+1));
+            }
+        }
+    }
+
+    /// \brief returns the volume of the last computed hull
+    double GetVolume() const {
+        return _volume;
+    }
+
+private:
+    inline const double* _GetPoint(int ipoint) const {
+        return _ppoints + ipoint*_dim;
+    }
+
+    inline double _ComputeDistance(int ifacet, const double* ppoint) const
+    {
+        const double* pplane = &_vfacetplanes[ifacet*(_dim+1)];
+        double dist = pplane[_dim];
+        for(int i = 0; i < _dim; ++i) {
+            dist += pplane[i]*ppoint[i];
+        }
+        return dist;
+    }
+
+    /// \brief projects v onto the orthogonal complement of the first numbasis vectors of _vbasis, returns the norm of the result
+    inline double _Orthogonalize(double* v, int numbasis) const
+    {
+        for(int ibasis = 0; ibasis < numbasis; ++ibasis) {
+            const double* pbasis = &_vbasis[ibasis*_dim];
+            double dot = 0;
+            for(int i = 0; i < _dim; ++i) {
+                dot += pbasis[i]*v[i];
+            }
+            for(int i = 0; i < _dim; ++i) {
+                v[i] -= dot*pbasis[i];
+            }
+        }
+        double normsqr = 0;
+        for(int i = 0; i < _dim; ++i) {
+            normsqr += v[i]*v[i];
+        }
+        return std::sqrt(normsqr);
+    }
+
+    /// \brief picks dim+1 points spanning the largest simplex greedily and creates its facets
+    bool _ComputeInitialSimplex()
+    {
+        _vsimplex.resize(0);
+        int ifirst = 0;
+        for(int ipoint = 1; ipoint < (int)_numpoints; ++ipoint) {
+            if( _GetPoint(ipoint)[0] < _GetPoint(ifirst)[0] ) {
+                ifirst = ipoint;
+            }
+        }
+        _vsimplex.push_back(ifirst);
+        const double* pfirst = _GetPoint(ifirst);
+        for(int ibasis = 0; ibasis < _dim; ++ibasis) {
+            int ibest = -1;
+            double bestdist = _epsilon;
+            for(int ipoint = 0; ipoint < (int)_numpoints; ++ipoint) {
+                const double* ppoint = _GetPoint(ipoint);
+                for(int i = 0; i < _dim; ++i) {
+                    _vtemp[i] = ppoint[i]-pfirst[i];
+                }
+                double dist = _Orthogonalize(&_vtemp[0], ibasis);
+                if( dist > bestdist ) {
+                    bestdist = dist;
+                    ibest = ipoint;
+                }
+            }
+            if( ibest < 0 ) {
+                return false; // flat
+            }
+            const double* pbest = _GetPoint(ibest);
+            double* pbasis = &_vbasis[ibasis*_dim];
+            for(int i = 0; i < _dim; ++i) {
+                pbasis[i] = pbest[i]-pfirst[i];
+            }
+            double norm = _Orthogonalize(pbasis, ibasis);
+            for(int i = 0; i < _dim; ++i) {
+                pbasis[i] /= norm;
+            }
+            _vsimplex.push_back(ibest);
+        }
+
+        std::fill(_vcenter.begin(), _vcenter.end(), 0.0);
+        for(int ivertex = 0; ivertex <= _dim; ++ivertex) {
+            const double* ppoint = _GetPoint(_vsimplex[ivertex]);
+            for(int i = 0; i < _dim; ++i) {
+                _vcenter[i] += ppoint[i]/(_dim+1);
+            }
+        }
+
+        // facet i is opposite to simplex vertex i, the ridge opposite to vertex k of facet i is shared with facet k
+        for(int ifacet = 0; ifacet <= _dim; ++ifacet) {
+            int newfacet = _AllocateFacet();
+            int* pvertices = &_vfacetvertices[newfacet*_dim];
+            int* pneighbors = &_vfacetneighbors[newfacet*_dim];
+            int islot = 0;
+            for(int ivertex = 0; ivertex <= _dim; ++ivertex) {
+                if( ivertex != ifacet ) {
+                    pvertices[islot] = _vsimplex[ivertex];
+                    pneighbors[islot] = ivertex;
+                    ++islot;
+                }
+            }
+            if( !_ComputePlane(newfacet) ) {
+                return false;
+            }
+        }
+
+        // points of the simplex are never outside, so skip them
+        for(int ipoint = 0; ipoint < (int)_numpoints; ++ipoint) {
+            if( std::find(_vsimplex.begin(), _vsimplex.end(), ipoint) != _vsimplex.end() ) {
+                continue;
+            }
+            _AssignOutside(ipoint, 0, _dim+1);
+        }
+        for(int ifacet = 0; ifacet <= _dim; ++ifacet) {
+            if( _vfacetoutside[ifacet] >= 0 ) {
+                _vpendingfacets.push_back(ifacet);
+            }
+        }
+        return true;
+    }
+
+    /// \brief adds the furthest outside point of every facet until no point is outside
+    bool _Expand()
+    {
+        while(_vpendingfacets.size() > 0) {
+            int ifacet = _vpendingfacets.back();
+            _vpendingfacets.pop_back();
+            if( _vfacetvisit[ifacet] < 0 || _vfacetoutside[ifacet] < 0 ) {
+                continue;
+            }
+            int eyepoint = _vfacetfurthest[ifacet];
+            const double* peye = _GetPoint(eyepoint);
+
+            // find the facets visible from the eye point, the visible stamp is even, the invisible stamp is odd
+            _visitstamp += 2;
+            int visiblestamp = _visitstamp, invisiblestamp = _visitstamp+1;
+            _vvisible.resize(0);
+            _vhorizon.resize(0);
+            _vfacetvisit[ifacet] = visiblestamp;
+            _vvisible.push_back(ifacet);
+            for(size_t ivisible = 0; ivisible < _vvisible.size(); ++ivisible) {
+                int ivisiblefacet = _vvisible[ivisible];
+                for(int islot = 0; islot < _dim; ++islot) {
+                    int ineighbor = _vfacetneighbors[ivisiblefacet*_dim+islot];
+                    if( _vfacetvisit[ineighbor] == visiblestamp ) {
+                        continue;
+                    }
+                    if( _vfacetvisit[ineighbor] != invisiblestamp ) {
+                        if( _ComputeDistance(ineighbor, peye) > _epsilon ) {
+                            _vfacetvisit[ineighbor] = visiblestamp;
+                            _vvisible.push_back(ineighbor);
+                            continue;
+                        }
+                        _vfacetvisit[ineighbor] = invisiblestamp;
+                    }
+                    _vhorizon.push_back(ivisiblefacet*_dim+islot);
+                }
+            }
+
+            // cone of new facets from the horizon ridges to the eye point, the eye point replaces the vertex opposite to the ridge
+            _vnewfacets.resize(0);
+            for(size_t ihorizon = 0; ihorizon < _vhorizon.size(); ++ihorizon) {
+                int ivisiblefacet = _vhorizon[ihorizon]/_dim, islot = _vhorizon[ihorizon]%_dim;
+                int ineighbor = _vfacetneighbors[ivisiblefacet*_dim+islot];
+                int newfacet = _AllocateFacet();
+                std::copy(_vfacetvertices.begin()+ivisiblefacet*_dim, _vfacetvertices.begin()+(ivisiblefacet+1)*_dim, _vfacetvertices.begin()+newfacet*_dim);
+                _vfacetvertices[newfacet*_dim+islot] = eyepoint;
+                std::fill(_vfacetneighbors.begin()+newfacet*_dim, _vfacetneighbors.begin()+(newfacet+1)*_dim, -1);
+                _vfacetneighbors[newfacet*_dim+islot] = ineighbor;
+                int* pneighborneighbors = &_vfacetneighbors[ineighbor*_dim];
+                int* pneighborslot = std::find(pneighborneighbors, pneighborneighbors+_dim, ivisiblefacet);
+                if( pneighborslot == pneighborneighbors+_dim ) {
+                    return false;
+                }
+                *pneighborslot = newfacet;
+                if( !_ComputePlane(newfacet) ) {
+                    return false;
+                }
+                _vnewfacets.push_back(newfacet);
+            }
+            if( !_ConnectNewFacets(eyepoint) ) {
+                return false;
+            }
+
+            // the outside points of the visible facets are either outside of a new facet or inside the hull
+            for(size_t ivisible = 0; ivisible < _vvisible.size(); ++ivisible) {
+                int ivisiblefacet = _vvisible[ivisible];
+                int ipoint = _vfacetoutside[ivisiblefacet];
+                while(ipoint >= 0) {
+                    int inext = _vpointnext[ipoint];
+                    if( ipoint != eyepoint ) {
+                        _AssignOutside(ipoint, _vnewfacets);
+                    }
+                    ipoint = inext;
+                }
+                _FreeFacet(ivisiblefacet);
+            }
+            for(size_t inew = 0; inew < _vnewfacets.size(); ++inew) {
+                if( _vfacetoutside[_vnewfacets[inew]] >= 0 ) {
+                    _vpendingfacets.push_back(_vnewfacets[inew]);
+                }
+            }
+        }
+        return true;
+    }
+
+    /// \brief sets the neighbors of the new facets across the ridges containing the eye point
+    ///
+    /// The ridge opposite to a vertex of a new facet is identified by the other vertices except the eye point, every
+    /// such ridge has to be shared by exactly two new facets. The ridges are matched with an open addressing hash table.
+    bool _ConnectNewFacets(int eyepoint)
+    {
+        int keysize = _dim-2;
+        size_t numridges = _vnewfacets.size()*(_dim-1);
+        size_t tablesize = 16;
+        while(tablesize < 2*numridges) {
+            tablesize *= 2;
+        }
+        _vridgetable.resize(tablesize);
+        std::fill(_vridgetable.begin(), _vridgetable.end(), -1);
+        _vridgekeys.resize(numridges*keysize);
+        _vridgeslots.resize(0);
+        for(size_t inew = 0; inew < _vnewfacets.size(); ++inew) {
+            int newfacet = _vnewfacets[inew];
+            const int* pvertices = &_vfacetvertices[newfacet*_dim];
+            for(int islot = 0; islot < _dim; ++islot) {
+                if( pvertices[islot] == eyepoint ) {
+                    continue;
+                }
+                int iridge = _vridgeslots.size();
+                int* pkey = &_vridgekeys[iridge*keysize];
+                int* pkeyend = pkey;
+                for(int ivertex = 0; ivertex < _dim; ++ivertex) {
+                    if( ivertex != islot && pvertices[ivertex] != eyepoint ) {
+                        *pkeyend++ = pvertices[ivertex];
+                    }
+                }
+                std::sort(pkey, pkeyend);
+                uint32_t hash = 2166136261u;
+                for(int i = 0; i < keysize; ++i) {
+                    hash = (hash^(uint32_t)pkey[i])*16777619u;
+                }
+                _vridgeslots.push_back(newfacet*_dim+islot);
+
+                size_t ientry = hash&(tablesize-1);
+                while(_vridgetable[ientry] >= 0 && !std::equal(pkey, pkeyend, &_vridgekeys[_vridgetable[ientry]*keysize]) ) {
+                    ientry = (ientry+1)&(tablesize-1);
+                }
+                int imatch = _vridgetable[ientry];
+                if( imatch < 0 ) {
+                    _vridgetable[ientry] = iridge;
+                    continue;
+                }
+                int ifacetslot0 = _vridgeslots[imatch], ifacetslot1 = newfacet*_dim+islot;
+                if( _vfacetneighbors[ifacetslot0] >= 0 ) {
+                    return false; // more than two facets on a ridge
+                }
+                _vfacetneighbors[ifacetslot0] = ifacetslot1/_dim;
+                _vfacetneighbors[ifacetslot1] = ifacetslot0/_dim;
+            }
+        }
+        for(size_t inew = 0; inew < _vnewfacets.size(); ++inew) {
+            const int* pneighbors = &_vfacetneighbors[_vnewfacets[inew]*_dim];
+            if( std::find(pneighbors, pneighbors+_dim, -1) != pneighbors+_dim ) {
+                return false; // the horizon is not closed
+            }
+        }
+        return true;
+    }
+
+    /// \brief computes the outward plane and the area of a facet from its vertices and the interior point
+    bool _ComputePlane(int ifacet)
+    {
+        const int* pvertices = &_vfacetvertices[ifacet*_dim];
+        const double* porigin = _GetPoint(pvertices[0]);
+        double area = 1;
+        for(int iedge = 1; iedge < _dim; ++iedge) {
+            double* pbasis = &_vbasis[(iedge-1)*_dim];
+            const double* ppoint = _GetPoint(pvertices[iedge]);
+            for(int i = 0; i < _dim; ++i) {
+                pbasis[i] = ppoint[i]-porigin[i];
+            }
+            double norm = _Orthogonalize(pbasis, iedge-1);
+            if( norm <= 0 ) {
+                return false;
+            }
+            for(int i = 0; i < _dim; ++i) {
+                pbasis[i] /= norm;
+            }
+            area *= norm/iedge;
+        }
+        for(int i = 0; i < _dim; ++i) {
+            _vtemp[i] = _vcenter[i]-porigin[i];
+        }
+        double norm = _Orthogonalize(&_vtemp[0], _dim-1);
+        if( norm <= 0 ) {
+            return false;
+        }
+        double* pplane = &_vfacetplanes[ifacet*(_dim+1)];
+        double offset = 0;
+        for(int i = 0; i < _dim; ++i) {
+            pplane[i] = -_vtemp[i]/norm;
+            offset -= pplane[i]*porigin[i];
+        }
+        pplane[_dim] = offset;
+        _vfacetareas[ifacet] = area;
+        return true;
+    }
+
+    /// \brief adds the point to the outside set of the first facet in [ifacetstart, ifacetend) it is outside of
+    void _AssignOutside(int ipoint, int ifacetstart, int ifacetend)
+    {
+        for(int ifacet = ifacetstart; ifacet < ifacetend; ++ifacet) {
+            if( _AddOutside(ipoint, ifacet) ) {
+                return;
+            }
+        }
+    }
+
+    void _AssignOutside(int ipoint, const std::vector<int>& vfacets)
+    {
+        for(size_t ifacet = 0; ifacet < vfacets.size(); ++ifacet) {
+            if( _AddOutside(ipoint, vfacets[ifacet]) ) {
+                return;
+            }
+        }
+    }
+
+    inline bool _AddOutside(int ipoint, int ifacet)
+    {
+        double dist = _ComputeDistance(ifacet, _GetPoint(ipoint));
+        if( dist <= _epsilon ) {
+            return false;
+        }
+        _vpointnext[ipoint] = _vfacetoutside[ifacet];
+        _vfacetoutside[ifacet] = ipoint;
+        if( _vfacetfurthest[ifacet] < 0 || dist > _ComputeDistance(ifacet, _GetPoint(_vfacetfurthest[ifacet])) ) {
+            _vfacetfurthest[ifacet] = ipoint;
+        }
+        return true;
+    }
+
+    int _AllocateFacet()
+    {
+        int ifacet;
+        if( _vfreefacets.size() > 0 ) {
+            ifacet = _vfreefacets.back();
+            _vfreefacets.pop_back();
+        }
+        else {
+            ifacet = _vfacetvisit.size();
+            _vfacetvertices.resize((ifacet+1)*_dim);
+            _vfacetneighbors.resize((ifacet+1)*_dim);
+            _vfacetplanes.resize((ifacet+1)*(_dim+1));
+            _vfacetareas.resize(ifacet+1);
+            _vfacetoutside.resize(ifacet+1);
+            _vfacetfurthest.resize(ifacet+1);
+            _vfacetvisit.resize(ifacet+1);
+        }
+        _vfacetoutside[ifacet] = -1;
+        _vfacetfurthest[ifacet] = -1;
+        _vfacetvisit[ifacet] = 0;
+        return ifacet;
+    }
+
+    void _FreeFacet(int ifacet)
+    {
+        _vfacetvisit[ifacet] = -1;
+        _vfacetoutside[ifacet] = -1;
+        _vfreefacets.push_back(ifacet);
+    }
+
+    int _dim;
+    size_t _numpoints;
+    const double* _ppoints; ///< points of the current Compute call
+    double _epsilon; ///< points closer than this to a facet plane are not outside of it
+    double _volume;
+    int _visitstamp;
+
+    // facets, indexed by facet. The neighbor at a slot is the facet sharing the ridge opposite to the vertex at the same slot.
+    std::vector<int> _vfacetvertices, _vfacetneighbors; ///< dim per facet
+    std::vector<double> _vfacetplanes; ///< dim+1 per facet
+    std::vector<double> _vfacetareas;
+    std::vector<int> _vfacetoutside; ///< first point of the outside set, the sets are linked lists through _vpointnext
+    std::vector<int> _vfacetfurthest; ///< furthest outside point
+    std::vector<int> _vfacetvisit; ///< -1 if the facet is freed, otherwise the last visit stamp
+    std::vector<int> _vfreefacets, _vpendingfacets;
+    std::vector<int> _vpointnext;
+
+    // scratch buffers
+    std::vector<int> _vsimplex, _vvisible, _vhorizon, _vnewfacets;
+    std::vector<int> _vridgekeys, _vridgeslots, _vridgetable; ///< sorted vertices except the eye point and facet*dim+slot of the ridges of the new facets, hash table of ridge indices
+    std::vector<double> _vbasis, _vtemp, _vcenter;
+};
+
+#endif
@@ -14,10 +14,12 @@
 // You should have received a copy of the GNU Lesser General Public License
 // along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "plugindefs.h"
+#include "convexhull.h"
 
 #include <algorithm>
 #include <boost/thread/condition.hpp>
 #include <boost/thread/mutex.hpp>
+#include <boost/atomic.hpp>
 #include <cmath>
 
 #ifdef QHULL_FOUND
@@ -37,8 +39,9 @@ extern "C"
 #endif
 
 #include <boost/thread/once.hpp>
+#include <boost/thread/thread.hpp>
 
-static boost::mutex s_QhullMutex;
+static boost::mutex s_QhullMutex; ///< qhull keeps its state in globals, only used by _ComputeConvexHull
 
 #define GTS_M_ICOSAHEDRON_X /* sqrt(sqrt(5)+1)/sqrt(2*sqrt(5)) */   \
     (dReal)0.850650808352039932181540497063011072240401406
@@ -67,18 +70,26 @@ class GrasperModule : public ModuleBase
 public:
     GrasperModule(EnvironmentBasePtr penv, std::istream& sinput)  : ModuleBase(penv), outfile(NULL), errfile(NULL) {
         __description = ":Interface Author: Rosen Diankov\n\nUsed to simulate a hand grasping an object by closing its fingers until collision with all links. ";
+        _nGraspJobId = 0;
+        _numBusyGraspWorkers = 0;
+        _bStopGraspJob = false;
         RegisterCommand("Grasp",boost::bind(&GrasperModule::_GraspCommand,this,_1,_2),
                         "Performs a grasp and returns contact points");
         RegisterCommand("GraspThreaded",boost::bind(&GrasperModule::_GraspThreadedCommand,this,_1,_2),
-                        "Parllelizes the computation of the grasp planning and force closure. Number of threads can be specified with 'numthreads'.");
+                        "Parllelizes the computation of the grasp planning and force closure. Number of threads can be specified with 'numthreads'. The worker threads and their environment clones are kept between calls. Every worker starts with a contiguous range of the grasp ids and steals half of the remaining range of another worker when it runs out. Returns [nextid] [numgrasps] followed by the grasps. nextid is the lowest grasp id that is not complete. Returns as soon as 'maxgrasps' grasps with ids below nextid succeeded, only the grasps below nextid are returned, so a call is resumed with 'startindex nextid'. With 'returncompletedids 1', returns as soon as 'maxgrasps' grasps succeeded and returns [nextid] [numcompleted] [completed ids] [numgrasps] followed by all the grasps, the completed ids are the ones above nextid that were evaluated and whose result was returned. Grasps still being evaluated when the call returns are dropped. With 'async 1', returns immediately, the results are polled with GetGraspThreadedResults and the job stops as soon as 'maxgrasps' grasps succeeded. 'skipids num id0 id1 ...' skips grasp ids, so a call is resumed with 'startindex nextid skipids' and the completed ids without evaluating a grasp twice.");
+        RegisterCommand("GetGraspThreadedResults",boost::bind(&GrasperModule::_GetGraspThreadedResultsCommand,this,_1,_2),
+                        "Returns the grasps of the current GraspThreaded call that succeeded since the last poll. Format::\n\n  GetGraspThreadedResults [wait seconds]\n\nIf wait is given, waits until there is a new grasp or the call is done. Returns [done] [nextid] [numcompleted] [completed ids] [numgrasps] followed by the grasps in the format of GraspThreaded. The grasp ids below nextid and the completed ids are the ones whose evaluation finished so far, including the grasps returned by earlier polls.");
+        RegisterCommand("StopGraspThreaded",boost::bind(&GrasperModule::_StopGraspThreadedCommand,this,_1,_2),
+                        "Stops the current GraspThreaded call and waits for the workers to finish their grasps.");
         RegisterCommand("ComputeDistanceMap",boost::bind(&GrasperModule::_ComputeDistanceMapCommand,this,_1,_2),
                         "Computes a distance map around a particular point in space");
         RegisterCommand("GetStableContacts",boost::bind(&GrasperModule::_GetStableContactsCommand,this,_1,_2),
                         "Returns the stable contacts as defined by the closing direction");
         RegisterCommand("ConvexHull",boost::bind(&GrasperModule::_ConvexHullCommand,this,_1,_2),
-                        "Given a point cloud, returns information about its convex hull like normal planes, vertex indices, and triangle indices. Computed planes point outside the mesh, face indices are not ordered, triangles point outside the mesh (counter-clockwise)");
+                        "Given a point cloud, returns information about its convex hull like normal planes, vertex indices, and triangle indices. Computed planes point outside the mesh, face indices are not ordered, triangles point outside the mesh (counter-clockwise). Format::\n\n  ConvexHull points [N] [dim] [N*dim values] [returnplanes 1] [returnfaces 1] [returntriangles 1] [returnvolume 0] [reentrant 0]\n\nreentrant 1 computes the hull with the reentrant quickhull used by the force closure analysis instead of qhull, it only returns planes and the volume, and coplanar facets are not merged.");
     }
     virtual ~GrasperModule() {
+        _DestroyGraspWorkers();
         if( !!outfile )
             fclose(outfile);
         if( !!errfile )
@@ -87,6 +98,7 @@ public:
 
     virtual void Destroy()
     {
+        _DestroyGraspWorkers();
         _planner.reset();
         _robot.reset();
     }
@@ -375,7 +387,8 @@ public:
                 for(size_t i = 0; i < c.size(); ++i) {
                     c[i] = contacts[i].first;
                 }
-                analysis = _AnalyzeContacts3D(c,friction,8);
+                ConvexHullND hull;
+                analysis = _AnalyzeContacts3D(c,friction,8,&hull);
             }
             catch(const std::exception& ex) {
                 RAVELOG_WARN("AnalyzeContacts3D: %s\n",ex.what());
@@ -498,7 +511,7 @@ public:
     virtual bool _ConvexHullCommand(std::ostream& sout, std::istream& sinput)
     {
         string cmd;
-        bool bReturnFaces = true, bReturnPlanes = true, bReturnTriangles = true, bReturnVolume = false;
+        bool bReturnFaces = true, bReturnPlanes = true, bReturnTriangles = true, bReturnVolume = false, bReentrant = false;
         int dim=0;
         vector<double> vpoints;
         while(!sinput.eof()) {
@@ -528,6 +541,9 @@ public:
             else if( cmd == "returnvolume" ) {
                 sinput >> bReturnVolume;
             }
+            else if( cmd == "reentrant" ) {
+                sinput >> bReentrant;
+            }
             else {
                 RAVELOG_WARN(str(boost::format("unrecognized command: %s\n")%cmd));
                 break;
@@ -541,10 +557,24 @@ public:
 
         vector<double> vconvexplanes;
         boost::shared_ptr< vector<int> > vconvexfaces;
-        if( bReturnFaces || bReturnTriangles ) {
-            vconvexfaces.reset(new vector<int>);
+        dReal volume = 0;
+        if( bReentrant ) {
+            if( bReturnFaces || bReturnTriangles ) {
+                RAVELOG_WARN("reentrant hull does not return faces or triangles\n");
+                return false;
+            }
+            ConvexHullND hull;
+            if( hull.Compute(vpoints, dim) ) {
+                volume = hull.GetVolume();
+                hull.GetPlanes(vconvexplanes);
+            }
+        }
+        else {
+            if( bReturnFaces || bReturnTriangles ) {
+                vconvexfaces.reset(new vector<int>);
+            }
+            volume = _ComputeConvexHull(vpoints,vconvexplanes, vconvexfaces, dim);
         }
-        dReal volume = _ComputeConvexHull(vpoints,vconvexplanes, vconvexfaces, dim);
         if( volume == 0 ) {
             return false;
         }
@@ -638,6 +668,7 @@ public:
             forceclosurethreshold = 0;
             ffinestep = 0.001f;
             bCheckGraspIK = false;
+            collisionoptions = 0;
         }
 
         string targetname;
@@ -657,6 +688,7 @@ public:
         vector<int> vactiveindices;
         int affinedofs;
         Vector affineaxis;
+        int collisionoptions; ///< options of the collision checker of the main environment when the job started
 
         bool bCheckGraspIK;
     };
@@ -681,20 +713,83 @@ public:
     typedef boost::shared_ptr<GraspParametersThread> GraspParametersThreadPtr;
     typedef boost::shared_ptr<WorkerParameters> WorkerParametersPtr;
 
-    virtual bool _GraspThreadedCommand(std::ostream& sout, std::istream& sinput)
+    /// \brief the grasps of a GraspThreaded call, grasp ids enumerate standoffs, preshapes, rolls, approach rays and manipulator directions, in that order from the fastest changing
+    struct GraspJob
     {
-        EnvironmentMutex::scoped_lock lock(GetEnv()->GetMutex());
+        GraspJob() : id(0), numgrasps(0), maxgrasps(0), bresumefromnextid(false), nextid(0), numnextidresults(0) {
+        }
 
-        WorkerParametersPtr worker_params(new WorkerParameters());
-        int numthreads = 2;
-        string cmd;
+        GraspParametersThreadPtr CreateGrasp(size_t graspid) const
+        {
+            size_t istandoff = graspid % standoffs.size();
+            size_t ipreshape = (graspid / standoffs.size()) % preshapes.size();
+            size_t iroll = (graspid / (preshapes.size() * standoffs.size())) % rolls.size();
+            size_t iapproachray = (graspid / (rolls.size() * preshapes.size() * standoffs.size()))%approachrays.size();
+            size_t imanipulatordirection = (graspid / (rolls.size() * preshapes.size() * standoffs.size()*approachrays.size()));
+            GraspParametersThreadPtr grasp(new GraspParametersThread());
+            grasp->id = graspid;
+            grasp->vtargetposition = approachrays.at(iapproachray).first;
+            grasp->vtargetdirection = approachrays.at(iapproachray).second;
+            grasp->vmanipulatordirection = manipulatordirections.at(imanipulatordirection);
+            grasp->ftargetroll = rolls.at(iroll);
+            grasp->fstandoff = standoffs.at(istandoff);
+            grasp->preshape = preshapes.at(ipreshape);
+            return grasp;
+        }
+
+        int id;
+        std::string robotname;
+        WorkerParametersPtr worker_params;
         vector< pair<Vector, Vector> > approachrays;
         vector<dReal> rolls;
         vector< vector<dReal> > preshapes;
         vector<Vector> manipulatordirections;
         vector<dReal> standoffs;
+        size_t numgrasps, maxgrasps;
+        /// if true, the job stops once the ids below nextid have maxgrasps results and only those results are returned,
+        /// so that resuming with 'startindex nextid' evaluates every grasp once, as when the ids were handed out in order.
+        bool bresumefromnextid;
+        /// for every grasp id, 0 if it is not complete, 1 if it was skipped or failed, 2 if it succeeded and its result was queued. Protected by _mutexGrasp.
+        /// The skipped ids are set before the workers start, the other ids are only set by the worker that evaluated them
+        std::vector<uint8_t> vcompleted;
+        size_t nextid; ///< the lowest id that is not complete, protected by _mutexGrasp
+        size_t numnextidresults; ///< number of succeeded ids below nextid, protected by _mutexGrasp
+    };
+    typedef boost::shared_ptr<GraspJob> GraspJobPtr;
+
+    /// \brief thread of GraspThreaded, keeps its environment clone between calls
+    struct GraspWorker
+    {
+        GraspWorker() : index(0), bShutdown(false), beginid(0), endid(0) {
+        }
+        int index;
+        EnvironmentBasePtr penv;
+        boost::shared_ptr<boost::thread> thread;
+        bool bShutdown; ///< protected by _mutexGrasp
+        boost::mutex mutex; ///< protects the ids
+        size_t beginid, endid; ///< grasp ids left, the worker takes them from the front and the other workers steal from the back
+    };
+    typedef boost::shared_ptr<GraspWorker> GraspWorkerPtr;
+
+    virtual bool _GraspThreadedCommand(std::ostream& sout, std::istream& sinput)
+    {
+        EnvironmentMutex::scoped_lock lock(GetEnv()->GetMutex());
+
+        GraspJobPtr job(new GraspJob());
+        WorkerParametersPtr worker_params(new WorkerParameters());
+        job->worker_params = worker_params;
+        int numthreads = 2;
+        bool basync = false;
+        bool breturncompletedids = false;
+        string cmd;
+        vector< pair<Vector, Vector> >& approachrays = job->approachrays;
+        vector<dReal>& rolls = job->rolls;
+        vector< vector<dReal> >& preshapes = job->preshapes;
+        vector<Vector>& manipulatordirections = job->manipulatordirections;
+        vector<dReal>& standoffs = job->standoffs;
         size_t startindex = 0;
         size_t maxgrasps = 0;
+        std::vector<size_t> vskipids;
 
         while(!sinput.eof()) {
             sinput >> cmd;
@@ -717,6 +812,14 @@ public:
             else if( cmd == "maxgrasps" ) {
                 sinput >> maxgrasps;
             }
+            else if( cmd == "skipids" ) {
+                size_t numskipids = 0;
+                sinput >> numskipids;
+                vskipids.resize(numskipids);
+                FOREACH(it,vskipids) {
+                    sinput >> *it;
+                }
+            }
             else if( cmd == "onlycontacttarget" ) {
                 sinput >> worker_params->bonlycontacttarget;
             }
@@ -744,6 +847,12 @@ public:
             else if( cmd == "numthreads" ) {
                 sinput >> numthreads;
             }
+            else if( cmd == "async" ) {
+                sinput >> basync;
+            }
+            else if( cmd == "returncompletedids" ) {
+                sinput >> breturncompletedids;
+            }
             // grasp specific
             else if( cmd == "approachrays" ) {
                 int numapproachrays = 0;
@@ -803,94 +912,380 @@ public:
             }
         }
 
+        job->robotname = _robot->GetName();
         worker_params->manipname = _robot->GetActiveManipulator()->GetName();
         worker_params->vactiveindices = _robot->GetActiveDOFIndices();
         worker_params->affinedofs = _robot->GetAffineDOF();
         worker_params->affineaxis = _robot->GetAffineRotationAxis();
+        // the workers cannot read the checker of the main environment, it can change while they run
+        worker_params->collisionoptions = !!GetEnv()->GetCollisionChecker() ? GetEnv()->GetCollisionChecker()->GetCollisionOptions() : 0;
 
-        EnvironmentBasePtr pcloneenv = GetEnv()->CloneSelf(Clone_Bodies|Clone_Simulation);
-
-        _bContinueWorker = true;
-        // start worker threads
-        vector<boost::shared_ptr<boost::thread> > listthreads(numthreads);
-        FOREACH(itthread,listthreads) {
-            itthread->reset(new boost::thread(boost::bind(&GrasperModule::_WorkerThread,this,worker_params,pcloneenv)));
-        }
-
-        _listGraspResults.clear();
+        numthreads = max(numthreads, 1);
         size_t numgrasps = approachrays.size()*rolls.size()*preshapes.size()*standoffs.size()*manipulatordirections.size();
         if( maxgrasps == 0 ) {
             maxgrasps = numgrasps;
         }
+        job->numgrasps = numgrasps;
+        job->maxgrasps = maxgrasps;
+        startindex = min(startindex, numgrasps);
+        job->vcompleted.resize(numgrasps, 0);
+        std::fill(job->vcompleted.begin(), job->vcompleted.begin()+startindex, 1);
+        FOREACHC(itid, vskipids) {
+            if( *itid < numgrasps ) {
+                job->vcompleted[*itid] = 1;
+            }
+        }
+        job->nextid = startindex;
+        job->bresumefromnextid = !basync && !breturncompletedids;
         RAVELOG_INFO(str(boost::format("number of grasps to test: %d\n")%numgrasps));
-        size_t id = startindex;
-        for(id=startindex; id < numgrasps; ++id) {
-            size_t istandoff = id % standoffs.size();
-            size_t ipreshape = (id / standoffs.size()) % preshapes.size();
-            size_t iroll = (id / (preshapes.size() * standoffs.size())) % rolls.size();
-            size_t iapproachray = (id / (rolls.size() * preshapes.size() * standoffs.size()))%approachrays.size();
-            size_t imanipulatordirection = (id / (rolls.size() * preshapes.size() * standoffs.size()*approachrays.size()));
+        _StartGraspJob(job, numthreads, startindex);
+        if( basync ) {
+            return true;
+        }
+
+        // wait until enough grasps succeeded or all were evaluated, the grasps still evaluated by the workers are dropped
+        boost::mutex::scoped_lock lockgrasp(_mutexGrasp);
+        while(_numBusyGraspWorkers > 0 && !_bStopGraspJob) {
+            _condGraspResults.wait(lockgrasp);
+        }
+        _bStopGraspJob = true;
+        _WriteCompletedGraspIds(sout, *job, breturncompletedids);
+        if( job->bresumefromnextid ) {
+            // the results above nextid are evaluated again when resuming from nextid
+            list<GraspParametersThreadPtr>::iterator itresult = _listGraspResults.begin();
+            while(itresult != _listGraspResults.end()) {
+                if( (*itresult)->id >= job->nextid ) {
+                    itresult = _listGraspResults.erase(itresult);
+                }
+                else {
+                    ++itresult;
+                }
+            }
+        }
+        sout << _listGraspResults.size() << " ";
+        FOREACH(itresult, _listGraspResults) {
+            _WriteGraspResult(sout, *itresult);
+        }
+        _listGraspResults.clear();
+        return true;
+    }
 
-            boost::mutex::scoped_lock lock(_mutexGrasp);
-            if( _listGraspResults.size() >= maxgrasps ) {
+    virtual bool _GetGraspThreadedResultsCommand(std::ostream& sout, std::istream& sinput)
+    {
+        dReal fwait = -1;
+        string cmd;
+        while(!sinput.eof()) {
+            sinput >> cmd;
+            if( !sinput ) {
                 break;
             }
+            std::transform(cmd.begin(), cmd.end(), cmd.begin(), ::tolower);
 
-            // initialize _graspParamsWork
-            BOOST_ASSERT(!_graspParamsWork);
-            _graspParamsWork.reset(new GraspParametersThread());
-            _graspParamsWork->id = id;
-            _graspParamsWork->vtargetposition = approachrays.at(iapproachray).first;
-            _graspParamsWork->vtargetdirection = approachrays.at(iapproachray).second;
-            _graspParamsWork->vmanipulatordirection = manipulatordirections.at(imanipulatordirection);
-            _graspParamsWork->ftargetroll = rolls.at(iroll);
-            _graspParamsWork->fstandoff = standoffs.at(istandoff);
-            _graspParamsWork->preshape = preshapes.at(ipreshape);
-            _condGraspHasWork.notify_one();     // notify there is work
-            _condGraspReceivedWork.wait(lock);     // wait for more work
-        }
+            if( cmd == "wait" ) {
+                sinput >> fwait;
+            }
+            else {
+                RAVELOG_WARN(str(boost::format("unrecognized command: %s\n")%cmd));
+                break;
+            }
 
-        // wait for workers
-        _bContinueWorker = false;
-        FOREACH(itthread,listthreads) {
-            _condGraspHasWork.notify_all();     // signal
-            (*itthread)->join();
+            if( !sinput ) {
+                RAVELOG_ERROR(str(boost::format("failed processing command %s\n")%cmd));
+                return false;
+            }
         }
-        listthreads.clear();
 
-        // parse results to output
-        sout << id << " " << _listGraspResults.size() << " ";
+        boost::mutex::scoped_lock lock(_mutexGrasp);
+        if( !_graspjob ) {
+            return false;
+        }
+        if( fwait >= 0 && _listGraspResults.size() == 0 && _numBusyGraspWorkers > 0 && !_bStopGraspJob ) {
+            _condGraspResults.timed_wait(lock, boost::posix_time::microseconds(uint64_t(1e6*fwait)));
+        }
+        bool bdone = _numBusyGraspWorkers == 0 || _bStopGraspJob;
+        sout << bdone << " ";
+        _WriteCompletedGraspIds(sout, *_graspjob, true);
+        sout << _listGraspResults.size() << " ";
         FOREACH(itresult, _listGraspResults) {
-            sout << (*itresult)->vtargetposition.x << " " << (*itresult)->vtargetposition.y << " " << (*itresult)->vtargetposition.z << " ";
-            sout << (*itresult)->vtargetdirection.x << " " << (*itresult)->vtargetdirection.y << " " << (*itresult)->vtargetdirection.z << " ";
-            sout << (*itresult)->ftargetroll << " " << (*itresult)->fstandoff << " ";
-            sout << (*itresult)->vmanipulatordirection.x << " " << (*itresult)->vmanipulatordirection.y << " " << (*itresult)->vmanipulatordirection.z << " ";
-            sout << (*itresult)->mindist << " " << (*itresult)->volume << " ";
-            FOREACH(itangle, (*itresult)->preshape) {
-                sout << (*itangle) << " ";
+            _WriteGraspResult(sout, *itresult);
+        }
+        _listGraspResults.clear();
+        return true;
+    }
+
+    virtual bool _StopGraspThreadedCommand(std::ostream& sout, std::istream& sinput)
+    {
+        _StopGraspJob();
+        return true;
+    }
+
+    void _WriteGraspResult(std::ostream& sout, GraspParametersThreadPtr result)
+    {
+        sout << result->vtargetposition.x << " " << result->vtargetposition.y << " " << result->vtargetposition.z << " ";
+        sout << result->vtargetdirection.x << " " << result->vtargetdirection.y << " " << result->vtargetdirection.z << " ";
+        sout << result->ftargetroll << " " << result->fstandoff << " ";
+        sout << result->vmanipulatordirection.x << " " << result->vmanipulatordirection.y << " " << result->vmanipulatordirection.z << " ";
+        sout << result->mindist << " " << result->volume << " ";
+        FOREACH(itangle, result->preshape) {
+            sout << (*itangle) << " ";
+        }
+        sout << result->transfinal.rot.x << " " << result->transfinal.rot.y << " " << result->transfinal.rot.z << " " << result->transfinal.rot.w << " " << result->transfinal.trans.x << " " << result->transfinal.trans.y << " " << result->transfinal.trans.z << " ";
+        FOREACH(itangle, result->finalshape) {
+            sout << *itangle << " ";
+        }
+        sout << result->contacts.size() << " ";
+        FOREACH(itc, result->contacts) {
+            const CollisionReport::CONTACT& c = itc->first;
+            sout << c.pos.x << " " << c.pos.y << " " << c.pos.z << " " << c.norm.x << " " << c.norm.y << " " << c.norm.z << " ";
+        }
+    }
+
+    /// \brief returns a key of the bodies of the environment and of the state of the bodies that the workers do not move.
+    ///
+    /// While it does not change, only the state of the robot has to be copied to the worker environments instead of cloning them again.
+    std::string _GetGraspWorkersEnvironmentKey()
+    {
+        std::vector<KinBodyPtr> vbodies, vgrabbed;
+        GetEnv()->GetBodies(vbodies);
+        std::set<KinBodyPtr> setmovedbodies;
+        setmovedbodies.insert(_robot);
+        _robot->GetGrabbed(vgrabbed);
+        setmovedbodies.insert(vgrabbed.begin(), vgrabbed.end());
+        std::stringstream ss;
+        if( !!GetEnv()->GetCollisionChecker() ) {
+            ss << GetEnv()->GetCollisionChecker()->GetXMLId();
+        }
+        FOREACHC(itbody, vbodies) {
+            ss << " " << (*itbody)->GetEnvironmentId() << " " << (*itbody)->GetName() << " " << (*itbody)->GetKinematicsGeometryHash() << " " << (*itbody)->GetLinkEnableStatesMask();
+            if( setmovedbodies.find(*itbody) == setmovedbodies.end() ) {
+                ss << " " << (*itbody)->GetUpdateStamp();
+            }
+            if( (*itbody)->IsRobot() ) {
+                RaveInterfaceCast<RobotBase>(*itbody)->GetGrabbed(vgrabbed);
+                FOREACHC(itgrabbed, vgrabbed) {
+                    ss << " " << (*itgrabbed)->GetEnvironmentId();
+                }
             }
-            sout << (*itresult)->transfinal.rot.x << " " << (*itresult)->transfinal.rot.y << " " << (*itresult)->transfinal.rot.z << " " << (*itresult)->transfinal.rot.w << " " << (*itresult)->transfinal.trans.x << " " << (*itresult)->transfinal.trans.y << " " << (*itresult)->transfinal.trans.z << " ";
-            FOREACH(itangle, (*itresult)->finalshape) {
-                sout << *itangle << " ";
+        }
+        return ss.str();
+    }
+
+    /// \brief stops the previous job, updates the worker environments and hands out the grasp ids. The environment has to be locked.
+    ///
+    /// The worker environments are only cloned again when the environment changed since the last job, otherwise only the state of the robot is copied to them.
+    void _StartGraspJob(GraspJobPtr job, int numthreads, size_t startindex)
+    {
+        _StopGraspJob();
+        while((int)_vgraspworkers.size() > numthreads) {
+            _DestroyGraspWorker(_vgraspworkers.back());
+            _vgraspworkers.pop_back();
+        }
+        std::string environmentkey = _GetGraspWorkersEnvironmentKey();
+        FOREACH(itworker, _vgraspworkers) {
+            if( environmentkey != _sGraspWorkersEnvironmentKey ) {
+                (*itworker)->penv->Clone(GetEnv(), Clone_Bodies|Clone_Simulation);
             }
-            sout << (*itresult)->contacts.size() << " ";
-            FOREACH(itc, (*itresult)->contacts) {
-                const CollisionReport::CONTACT& c = itc->first;
-                sout << c.pos.x << " " << c.pos.y << " " << c.pos.z << " " << c.norm.x << " " << c.norm.y << " " << c.norm.z << " ";
+            else {
+                EnvironmentMutex::scoped_lock lockclone((*itworker)->penv->GetMutex());
+                RobotBasePtr pclonerobot = (*itworker)->penv->GetRobot(_robot->GetName());
+                if( !!pclonerobot ) {
+                    RobotBase::RobotStateSaver saver(_robot, KinBody::Save_LinkTransformation|KinBody::Save_ActiveDOF|KinBody::Save_ActiveManipulator);
+                    saver.Restore(pclonerobot);
+                }
             }
+            (*itworker)->penv->StopSimulation();
         }
-        return true;
+        while((int)_vgraspworkers.size() < numthreads) {
+            GraspWorkerPtr worker(new GraspWorker());
+            worker->penv = GetEnv()->CloneSelf(Clone_Bodies|Clone_Simulation);
+            // the workers do not simulate, the simulation thread of the clone would only take the environment lock from them
+            worker->penv->StopSimulation();
+            worker->index = _vgraspworkers.size();
+            worker->thread.reset(new boost::thread(boost::bind(&GrasperModule::_GraspWorkerThread,this,worker)));
+            _vgraspworkers.push_back(worker);
+        }
+        _sGraspWorkersEnvironmentKey = environmentkey;
+
+        // contiguous ranges, neighboring ids share the approach ray and roll
+        size_t numids = job->numgrasps-startindex;
+        for(int iworker = 0; iworker < numthreads; ++iworker) {
+            GraspWorker& worker = *_vgraspworkers[iworker];
+            boost::mutex::scoped_lock lock(worker.mutex);
+            worker.beginid = startindex + (numids*iworker)/numthreads;
+            worker.endid = startindex + (numids*(iworker+1))/numthreads;
+        }
+
+        boost::mutex::scoped_lock lock(_mutexGrasp);
+        job->id = ++_nGraspJobId;
+        _graspjob = job;
+        _listGraspResults.clear();
+        _numGraspResults = 0;
+        _bStopGraspJob = false;
+        _numBusyGraspWorkers = numthreads;
+        _condGraspHasWork.notify_all();
+    }
+
+    /// \brief stops the current job and waits for the workers to finish the grasps they are evaluating
+    void _StopGraspJob()
+    {
+        boost::mutex::scoped_lock lock(_mutexGrasp);
+        _bStopGraspJob = true;
+        while(_numBusyGraspWorkers > 0) {
+            _condGraspResults.wait(lock);
+        }
+    }
+
+    void _DestroyGraspWorkers()
+    {
+        _StopGraspJob();
+        FOREACH(itworker, _vgraspworkers) {
+            _DestroyGraspWorker(*itworker);
+        }
+        _vgraspworkers.clear();
+        _sGraspWorkersEnvironmentKey.resize(0);
+        boost::mutex::scoped_lock lock(_mutexGrasp);
+        _graspjob.reset();
+        _listGraspResults.clear();
     }
 
-    void _WorkerThread(const WorkerParametersPtr worker_params, EnvironmentBasePtr penv)
+    void _DestroyGraspWorker(GraspWorkerPtr worker)
     {
-        // clone environment
-        EnvironmentBasePtr pcloneenv = penv->CloneSelf(Clone_Bodies|Clone_Simulation);
+        {
+            boost::mutex::scoped_lock lock(_mutexGrasp);
+            worker->bShutdown = true;
+            _condGraspHasWork.notify_all();
+        }
+        worker->thread->join();
+        worker->penv->Destroy();
+    }
+
+    /// \brief marks a grasp id complete and stops the job once it has maxgrasps results. A failed grasp can also stop the
+    /// job when it moves nextid past enough results. _mutexGrasp has to be locked.
+    ///
+    /// \param bresult true if the grasp succeeded and its result was queued
+    void _CompleteGraspId(GraspJob& job, size_t id, bool bresult)
+    {
+        job.vcompleted[id] = bresult ? 2 : 1;
+        _AdvanceNextGraspId(job);
+        if( job.bresumefromnextid ? job.numnextidresults >= job.maxgrasps : (bresult && ++_numGraspResults >= job.maxgrasps) ) {
+            _bStopGraspJob = true;
+            _condGraspResults.notify_all();
+        }
+    }
+
+    /// \brief moves nextid past the completed ids. _mutexGrasp has to be locked.
+    void _AdvanceNextGraspId(GraspJob& job)
+    {
+        while(job.nextid < job.numgrasps && job.vcompleted[job.nextid]) {
+            if( job.vcompleted[job.nextid] == 2 ) {
+                ++job.numnextidresults;
+            }
+            ++job.nextid;
+        }
+    }
+
+    /// \brief writes [nextid], followed by [numcompleted] [completed ids above nextid] if bwriteids is true. The workers steal ranges, so the ids finish out of order. _mutexGrasp has to be locked.
+    void _WriteCompletedGraspIds(std::ostream& sout, GraspJob& job, bool bwriteids)
+    {
+        _AdvanceNextGraspId(job);
+        if( !bwriteids ) {
+            sout << job.nextid << " ";
+            return;
+        }
+        std::vector<size_t> vcompletedids;
+        for(size_t id = job.nextid+1; id < job.numgrasps; ++id) {
+            if( job.vcompleted[id] ) {
+                vcompletedids.push_back(id);
+            }
+        }
+        sout << job.nextid << " " << vcompletedids.size() << " ";
+        FOREACHC(itid, vcompletedids) {
+            sout << *itid << " ";
+        }
+    }
+
+    /// \brief takes the next grasp id from the range of the worker, or steals half of the largest range of the other workers
+    bool _PopGraspId(GraspWorker& worker, size_t& id)
+    {
+        {
+            boost::mutex::scoped_lock lock(worker.mutex);
+            if( worker.beginid < worker.endid ) {
+                id = worker.beginid++;
+                return true;
+            }
+        }
+        while(1) {
+            GraspWorkerPtr victim;
+            size_t maxremaining = 0;
+            FOREACH(itworker, _vgraspworkers) {
+                if( itworker->get() != &worker ) {
+                    boost::mutex::scoped_lock lock((*itworker)->mutex);
+                    if( (*itworker)->endid > (*itworker)->beginid + maxremaining ) {
+                        maxremaining = (*itworker)->endid - (*itworker)->beginid;
+                        victim = *itworker;
+                    }
+                }
+            }
+            if( !victim ) {
+                return false;
+            }
+            size_t beginid, endid;
+            {
+                boost::mutex::scoped_lock lock(victim->mutex);
+                if( victim->beginid >= victim->endid ) {
+                    continue; // emptied in the meantime
+                }
+                endid = victim->endid;
+                beginid = victim->beginid + (victim->endid-victim->beginid)/2;
+                victim->endid = beginid;
+            }
+            boost::mutex::scoped_lock lock(worker.mutex);
+            id = beginid;
+            worker.beginid = beginid+1;
+            worker.endid = endid;
+            return true;
+        }
+    }
+
+    void _GraspWorkerThread(GraspWorkerPtr worker)
+    {
+        int jobid = 0;
+        while(1) {
+            GraspJobPtr job;
+            {
+                boost::mutex::scoped_lock lock(_mutexGrasp);
+                while(!worker->bShutdown && (!_graspjob || _graspjob->id == jobid)) {
+                    _condGraspHasWork.wait(lock);
+                }
+                if( worker->bShutdown ) {
+                    break;
+                }
+                job = _graspjob;
+                jobid = job->id;
+            }
+            try {
+                _EvaluateGrasps(*worker, job);
+            }
+            catch(const std::exception& ex) {
+                RAVELOG_WARN_FORMAT("grasp worker %d failed: %s", worker->index%ex.what());
+            }
+            // the ids left when the job was stopped are not evaluated and stay incomplete
+            boost::mutex::scoped_lock lock(_mutexGrasp);
+            _numBusyGraspWorkers--;
+            _condGraspResults.notify_all();
+        }
+    }
+
+    /// \brief evaluates the grasps of the job in the environment of the worker until no grasp ids are left or the job is stopped
+    void _EvaluateGrasps(GraspWorker& worker, GraspJobPtr job)
+    {
+        const WorkerParametersPtr worker_params = job->worker_params;
+        EnvironmentBasePtr pcloneenv = worker.penv;
         {
             EnvironmentMutex::scoped_lock lock(pcloneenv->GetMutex());
             boost::shared_ptr<CollisionCheckerMngr> pcheckermngr(new CollisionCheckerMngr(pcloneenv, worker_params->collisionchecker));
             PlannerBasePtr planner = RaveCreatePlanner(pcloneenv,"Grasper");
-            RobotBasePtr probot = pcloneenv->GetRobot(_robot->GetName());
+            RobotBasePtr probot = pcloneenv->GetRobot(job->robotname);
             string strsavetraj;
 
             probot->SetActiveManipulator(worker_params->manipname);
@@ -916,27 +1311,30 @@ public:
             Transform trobotstart = probot->GetTransform();
 
             vector<dReal> vtrajpoint;
+            ConvexHullND hull; // force closure analysis of this thread, reuses its buffers between grasps
 
             // use CO_ActiveDOFs since might be calling FindIKSolution
-            int coloptions = GetEnv()->GetCollisionChecker()->GetCollisionOptions()|(worker_params->bCheckGraspIK ? CO_ActiveDOFs : 0);
+            int coloptions = worker_params->collisionoptions|(worker_params->bCheckGraspIK ? CO_ActiveDOFs : 0);
             coloptions &= ~CO_Contacts;
             pcloneenv->GetCollisionChecker()->SetCollisionOptions(coloptions|CO_Contacts);
 
-            while(_bContinueWorker) {
-                {
-                    // wait for work
+            size_t id = 0;
+            bool bfailed = false; // true if the previous grasp was evaluated and failed
+            while(1) {
+                if( bfailed ) {
+                    // a failed grasp is complete, a succeeded grasp only once its result is queued
                     boost::mutex::scoped_lock lock(_mutexGrasp);
-                    if( !_graspParamsWork ) {
-                        _condGraspHasWork.wait(lock);
-                        // after signal
-                        if( !_graspParamsWork ) {
-                            continue;
-                        }
-                    }
-                    grasp_params = _graspParamsWork;
-                    _graspParamsWork.reset();
-                    _condGraspReceivedWork.notify_all();
+                    _CompleteGraspId(*job, id, false);
+                }
+                bfailed = false;
+                if( _bStopGraspJob || !_PopGraspId(worker, id) ) {
+                    break;
+                }
+                if( job->vcompleted[id] ) {
+                    continue; // skipped, only set before the workers started
                 }
+                bfailed = true;
+                grasp_params = job->CreateGrasp(id);
 
                 RAVELOG_DEBUG(str(boost::format("grasp %d: start")%grasp_params->id));
 
@@ -1018,7 +1416,7 @@ public:
                         for(size_t i = 0; i < c.size(); ++i) {
                             c[i] = grasp_params->contacts[i].first;
                         }
-                        analysis = _AnalyzeContacts3D(c,worker_params->friction,8);
+                        analysis = _AnalyzeContacts3D(c,worker_params->friction,8,&hull);
                         if( analysis.mindist < worker_params->forceclosurethreshold ) {
                             RAVELOG_DEBUG(str(boost::format("grasp %d: force closure failed")%grasp_params->id));
                             continue;
@@ -1113,10 +1511,10 @@ public:
                         jointvaluesstd[i] = _vjointmaxlengths.at(i) * RaveSqrt(jointstd / dReal(vfinalvalues.size()));
                     }
                     dReal fmaxjointdisplacement = 0;
-                    FOREACHC(itlink, _robot->GetLinks()) {
+                    FOREACHC(itlink, probot->GetLinks()) {
                         dReal f = 0;
-                        for(size_t ijoint = 0; ijoint < _robot->GetJoints().size(); ++ijoint) {
-                            if( _robot->DoesAffect(ijoint, (*itlink)->GetIndex()) ) {
+                        for(size_t ijoint = 0; ijoint < probot->GetJoints().size(); ++ijoint) {
+                            if( probot->DoesAffect(ijoint, (*itlink)->GetIndex()) ) {
                                 f += jointvaluesstd.at(ijoint);
                             }
                         }
@@ -1135,18 +1533,27 @@ public:
 
                 RAVELOG_DEBUG(str(boost::format("grasp %d: success")%grasp_params->id));
 
+                bfailed = false;
                 boost::mutex::scoped_lock lock(_mutexGrasp);
-                _listGraspResults.push_back(grasp_params);
+                if( !_bStopGraspJob ) {
+                    _listGraspResults.push_back(grasp_params);
+                    _CompleteGraspId(*job, id, true);
+                    _condGraspResults.notify_all();
+                }
             }
         }
-        pcloneenv->Destroy();
     }
 
-    bool _bContinueWorker;
-    boost::mutex _mutexGrasp;
-    GraspParametersThreadPtr _graspParamsWork;
-    list<GraspParametersThreadPtr> _listGraspResults;
-    boost::condition _condGraspHasWork, _condGraspReceivedWork;
+    boost::mutex _mutexGrasp; ///< protects the job, the results and the busy workers
+    GraspJobPtr _graspjob; ///< the job of the last GraspThreaded call
+    int _nGraspJobId;
+    std::vector<GraspWorkerPtr> _vgraspworkers;
+    std::string _sGraspWorkersEnvironmentKey; ///< key of the environment the clones of _vgraspworkers are up to date with
+    int _numBusyGraspWorkers; ///< workers still evaluating grasps of the job
+    boost::atomic<bool> _bStopGraspJob; ///< set under _mutexGrasp, atomic since the workers read it without the lock before every grasp
+    list<GraspParametersThreadPtr> _listGraspResults; ///< succeeded grasps not returned yet
+    size_t _numGraspResults; ///< succeeded grasps of the job
+    boost::condition _condGraspHasWork, _condGraspResults;
 
 protected:
     void _ComputeJointMaxLengths(vector<dReal>& vjointlengths)
@@ -1530,10 +1937,13 @@ protected:
         }
     }
 
-    virtual GRASPANALYSIS _AnalyzeContacts3D(const vector<CollisionReport::CONTACT>& contacts, dReal mu, int Nconepoints)
+    /// \brief analyzes the force closure of the contacts with friction cones of Nconepoints edges
+    ///
+    /// \param phull computes the wrench space hull, can be used from several threads at once if every thread has its own hull. If NULL or if it fails, uses the serialized qhull.
+    virtual GRASPANALYSIS _AnalyzeContacts3D(const vector<CollisionReport::CONTACT>& contacts, dReal mu, int Nconepoints, ConvexHullND* phull)
     {
         if( mu == 0 ) {
-            return _AnalyzeContacts3D(contacts);
+            return _AnalyzeContacts3D(contacts, phull);
         }
 
         if( contacts.size() > 16 ) {
@@ -1543,7 +1953,7 @@ protected:
             for(size_t i = 0; i < reducedcontacts.capacity(); ++i) {
                 reducedcontacts.push_back( contacts.at((i*contacts.size())/reducedcontacts.capacity()) );
             }
-            GRASPANALYSIS analysis = _AnalyzeContacts3D(reducedcontacts, mu, Nconepoints);
+            GRASPANALYSIS analysis = _AnalyzeContacts3D(reducedcontacts, mu, Nconepoints, phull);
             if( analysis.mindist > 1e-9 ) {
                 return analysis;
             }
@@ -1569,10 +1979,10 @@ protected:
                 newcontacts.push_back(CollisionReport::CONTACT(itcontact->pos, (itcontact->norm + mu*it->first*right + mu*it->second*up).normalize3(),0));
             }
         }
-        return _AnalyzeContacts3D(newcontacts);
+        return _AnalyzeContacts3D(newcontacts, phull);
     }
 
-    virtual GRASPANALYSIS _AnalyzeContacts3D(const vector<CollisionReport::CONTACT>& contacts)
+    virtual GRASPANALYSIS _AnalyzeContacts3D(const vector<CollisionReport::CONTACT>& contacts, ConvexHullND* phull)
     {
         if( contacts.size() < 7 ) {
             RAVELOG_DEBUG("need at least 7 contact wrenches to have force closure in 3D\n");
@@ -1592,7 +2002,14 @@ protected:
             *itpoint++ = v.z;
         }
 
-        analysis.volume = _ComputeConvexHull(vpoints,vconvexplanes,boost::shared_ptr< vector<int> >(),6);
+        if( !!phull && phull->Compute(vpoints, 6) ) {
+            analysis.volume = phull->GetVolume();
+            phull->GetPlanes(vconvexplanes);
+        }
+        else {
+            // the reentrant hull also fails on numerical problems that qhull might still handle
+            analysis.volume = _ComputeConvexHull(vpoints,vconvexplanes,boost::shared_ptr< vector<int> >(),6);
+        }
         if( vconvexplanes.size() == 0 ) {
             return analysis;
         }
@@ -35,6 +35,38 @@ public:
         IkReturnPtr ikreturn;
     };
 
+    typedef boost::shared_ptr< ikfast::IkSolutionListArena<IkReal> > IkSolutionListArenaPtr;
+
+    /// \brief takes a solution list from the pool of the solver for the scope of one ik call
+    ///
+    /// Filters can call back into the solver and the parallel search calls it from several threads, so every call needs its own list.
+    /// Returning the lists to the pool lets the next calls reuse their memory.
+    class SolutionListHolder
+    {
+public:
+        SolutionListHolder(IkFastSolver<IkReal>& solver) : _solver(solver) {
+            boost::mutex::scoped_lock lock(_solver._mutexSolutionLists);
+            if( _solver._vsolutionlistpool.size() > 0 ) {
+                _plist = _solver._vsolutionlistpool.back();
+                _solver._vsolutionlistpool.pop_back();
+            }
+            else {
+                _plist.reset(new ikfast::IkSolutionListArena<IkReal>());
+            }
+            _plist->Clear();
+        }
+        ~SolutionListHolder() {
+            boost::mutex::scoped_lock lock(_solver._mutexSolutionLists);
+            _solver._vsolutionlistpool.push_back(_plist);
+        }
+        ikfast::IkSolutionListArena<IkReal>& GetList() {
+            return *_plist;
+        }
+private:
+        IkFastSolver<IkReal>& _solver;
+        IkSolutionListArenaPtr _plist;
+    };
+
 public:
     IkFastSolver(EnvironmentBasePtr penv, std::istream& sinput, boost::shared_ptr<ikfast::IkFastFunctions<IkReal> > ikfunctions, const vector<dReal>& vfreeinc, dReal ikthreshold=1e-4) : IkSolverBase(penv), _ikfunctions(ikfunctions), _vFreeInc(vfreeinc), _ikthreshold(ikthreshold) {
         OPENRAVE_ASSERT_OP(ikfunctions->_GetIkRealSize(),==,sizeof(IkReal));
@@ -77,10 +109,15 @@ public:
         RegisterCommand("SetBackTraceSelfCollisionLinks",boost::bind(&IkFastSolver<IkReal>::_SetBackTraceSelfCollisionLinksCommand,this,_1,_2),
                         "format: int int\n\n\
 for numBacktraceLinksForSelfCollisionWithNonMoving numBacktraceLinksForSelfCollisionWithFree, when pruning self collisions, the number of links to look at. If the tip of the manip self collides with the base, then can safely quit the IK.");
+        RegisterCommand("SetParallelSearch",boost::bind(&IkFastSolver<IkReal>::_SetParallelSearchCommand,this,_1,_2),
+                        "format: int\n\n\
+number of threads to split the free parameter search of Solve/SolveAll across. Each thread checks its part of the discretization on its own clone of the environment, the results are merged in the same order as the serial search. 0 or 1 disables the parallel search. The serial search is always used when custom filters are registered.");
         _numBacktraceLinksForSelfCollisionWithNonMoving = 2;
         _numBacktraceLinksForSelfCollisionWithFree = 0;
+        _nParallelThreads = 0;
     }
     virtual ~IkFastSolver() {
+        _DestroyParallelEnvironments();
     }
 
     inline boost::shared_ptr<IkFastSolver<IkReal> > shared_solver() {
@@ -188,6 +225,20 @@ for numBacktraceLinksForSelfCollisionWithNonMoving numBacktraceLinksForSelfColli
         return true;
     }
 
+    bool _SetParallelSearchCommand(ostream& sout, istream& sinput)
+    {
+        int nthreads = 0;
+        sinput >> nthreads;
+        if( !sinput ) {
+            return false;
+        }
+        _nParallelThreads = max(0, nthreads);
+        if( _nParallelThreads <= 1 ) {
+            _DestroyParallelEnvironments();
+        }
+        return true;
+    }
+
     virtual IkReturnAction CallFilters(const IkParameterization& param, IkReturnPtr ikreturn, int minpriority, int maxpriority) {
         // have to convert to the manipulator's base coordinate system
         RobotBase::ManipulatorPtr pmanip(_pmanip);
@@ -653,7 +704,10 @@ protected:
         std::vector<IkReal> vfree(_vfreeparams.size());
         StateCheckEndEffector stateCheck(probot,_vchildlinks,_vindependentlinks,filteroptions);
         CollisionOptionsStateSaver optionstate(GetEnv()->GetCollisionChecker(),GetEnv()->GetCollisionChecker()->GetCollisionOptions()|CO_ActiveDOFs,false);
-        IkReturnAction retaction = ComposeSolution(_vfreeparams, vfree, 0, q0, boost::bind(&IkFastSolver::_SolveSingle,shared_solver(), boost::ref(param),boost::ref(vfree),boost::ref(q0),filteroptions,ikreturn,boost::ref(stateCheck)), _vFreeInc);
+        IkReturnAction retaction;
+        if( !_SolveParallel(param, q0, filteroptions, ikreturn, NULL, retaction) ) {
+            retaction = ComposeSolution(_vfreeparams, vfree, 0, q0, boost::bind(&IkFastSolver::_SolveSingle,shared_solver(), boost::ref(param),boost::ref(vfree),boost::ref(q0),filteroptions,ikreturn,boost::ref(stateCheck)), _vFreeInc);
+        }
         if( !!ikreturn ) {
             ikreturn->_action = retaction;
         }
@@ -672,7 +726,10 @@ protected:
         std::vector<IkReal> vfree(_vfreeparams.size());
         StateCheckEndEffector stateCheck(probot,_vchildlinks,_vindependentlinks,filteroptions);
         CollisionOptionsStateSaver optionstate(GetEnv()->GetCollisionChecker(),GetEnv()->GetCollisionChecker()->GetCollisionOptions()|CO_ActiveDOFs,false);
-        IkReturnAction retaction = ComposeSolution(_vfreeparams, vfree, 0, vector<dReal>(), boost::bind(&IkFastSolver::_SolveAll,shared_solver(), param,boost::ref(vfree),filteroptions,boost::ref(vikreturns), boost::ref(stateCheck)), _vFreeInc);
+        IkReturnAction retaction;
+        if( !_SolveParallel(param, vector<dReal>(), filteroptions, IkReturnPtr(), &vikreturns, retaction) ) {
+            retaction = ComposeSolution(_vfreeparams, vfree, 0, vector<dReal>(), boost::bind(&IkFastSolver::_SolveAll,shared_solver(), param,boost::ref(vfree),filteroptions,boost::ref(vikreturns), boost::ref(stateCheck)), _vFreeInc);
+        }
         if( retaction & IKRA_Quit ) {
             return false;
         }
@@ -766,6 +823,7 @@ protected:
         _vchildlinks.resize(0);
         _vchildlinkindices.resize(0);
         _vindependentlinks.resize(0);
+        _vIndependentLinksIncludingFreeJoints.resize(0);
         RobotBase::ManipulatorPtr rmanip = r->_pmanip.lock();
         if( !!rmanip ) {
             RobotBasePtr probot = GetEnv()->GetRobot(rmanip->GetRobot()->GetName());
@@ -782,6 +840,10 @@ protected:
                     }
                     pmanip->GetIndependentLinks(_vindependentlinks);
                 }
+                _vIndependentLinksIncludingFreeJoints.resize(0);
+                FOREACHC(itlink, r->_vIndependentLinksIncludingFreeJoints) {
+                    _vIndependentLinksIncludingFreeJoints.push_back(probot->GetLinks().at((*itlink)->GetIndex()));
+                }
             }
         }
         _vfreeparams = r->_vfreeparams;
@@ -810,6 +872,7 @@ protected:
 #endif
 
         _bEmptyTransform6D = r->_bEmptyTransform6D;
+        // the parallel search settings are not cloned since the parallel workers are clones themselves
     }
 
 protected:
@@ -901,8 +964,177 @@ protected:
         return static_cast<IkReturnAction>(allres);
     }
 
+    /// \brief state shared by the threads of one parallel free parameter search
+    struct ParallelSearchState
+    {
+        ParallelSearchState(size_t num) : _nextindex(0), _stopindex(num), _vresults(num, IKRA_Reject), _vikreturns(num) {
+        }
+        boost::mutex _mutex;
+        size_t _nextindex; ///< next index of the free parameter grid to solve
+        size_t _stopindex; ///< indices >= _stopindex do not have to be solved since the serial search would have stopped before them
+        std::vector<int> _vresults; ///< the action returned for every index of the grid
+        std::vector< std::vector<IkReturnPtr> > _vikreturns; ///< the solutions found for every index of the grid
+        std::string _error; ///< set if any of the threads threw an exception
+    };
+
+    IkReturnAction _RecordFreeValues(const vector<IkReal>& vfree, std::vector< std::vector<IkReal> >& vfreegrid)
+    {
+        vfreegrid.push_back(vfree);
+        return IKRA_Reject;
+    }
+
+    void _DestroyParallelEnvironments()
+    {
+        _vparallelsolvers.resize(0);
+        FOREACH(itenv, _vparallelenvs) {
+            (*itenv)->Destroy();
+        }
+        _vparallelenvs.resize(0);
+    }
+
+    /// \brief splits the free parameter search of Solve/SolveAll across _nParallelThreads threads
+    ///
+    /// The grid is enumerated with ComposeSolution so it is visited in exactly the same order as the serial search. Threads take
+    /// the grid indices in order and solve them on their own environment clone. As soon as an index ends the search (success for Solve or quit),
+    /// the indices after it are skipped. The results are merged in grid order, so the returned solutions are the same as the serial search.
+    /// \param pvikreturns if not NULL, then solves for all solutions, otherwise returns the first solution in ikreturn
+    /// \return false if the parallel search cannot be used and the serial search should be called
+    bool _SolveParallel(const IkParameterization& param, const vector<dReal>& q0, int filteroptions, IkReturnPtr ikreturn, std::vector<IkReturnPtr>* pvikreturns, IkReturnAction& retaction)
+    {
+        // custom filters can keep state and call back into this solver, so they have to run serially
+        if( _nParallelThreads <= 1 || _vfreeparams.size() == 0 || (!(filteroptions & IKFO_IgnoreCustomFilters) && _HasFilterInRange(IKSP_MinPriority, IKSP_MaxPriority)) ) {
+            return false;
+        }
+
+        std::vector< std::vector<IkReal> > vfreegrid;
+        std::vector<IkReal> vfree(_vfreeparams.size());
+        ComposeSolution(_vfreeparams, vfree, 0, q0, boost::bind(&IkFastSolver::_RecordFreeValues,shared_solver(), boost::ref(vfree), boost::ref(vfreegrid)), _vFreeInc);
+        int numthreads = min(_nParallelThreads, (int)vfreegrid.size());
+        if( numthreads <= 1 ) {
+            return false;
+        }
+
+        RobotBase::ManipulatorPtr pmanip(_pmanip);
+        RobotBasePtr probot = pmanip->GetRobot();
+        for(int ithread = 0; ithread < numthreads; ++ithread) {
+            if( ithread < (int)_vparallelenvs.size() ) {
+                _vparallelenvs[ithread]->Clone(GetEnv(), Clone_Bodies);
+            }
+            else {
+                _vparallelenvs.push_back(GetEnv()->CloneSelf(Clone_Bodies));
+                std::stringstream sinput;
+                _vparallelsolvers.push_back(boost::shared_ptr< IkFastSolver<IkReal> >(new IkFastSolver<IkReal>(_vparallelenvs.back(), sinput, _ikfunctions, _vFreeInc, _ikthreshold)));
+            }
+            // the simulation thread of a clone would step the bodies under the worker
+            _vparallelenvs[ithread]->StopSimulation();
+            // always copy the settings since they could have changed since the last call
+            _vparallelsolvers[ithread]->Clone(shared_solver(), 0);
+            if( !_vparallelsolvers[ithread]->_pmanip.lock() ) {
+                RAVELOG_WARN_FORMAT("failed to find manipulator %s:%s in cloned environment, using serial ik search", probot->GetName()%pmanip->GetName());
+                return false;
+            }
+        }
+
+        bool bsolveall = pvikreturns != NULL;
+        ParallelSearchState state(vfreegrid.size());
+        boost::thread_group threads;
+        for(int ithread = 0; ithread < numthreads; ++ithread) {
+            threads.create_thread(boost::bind(&IkFastSolver<IkReal>::_SolveParallelWorker, _vparallelsolvers[ithread], boost::cref(param), boost::cref(q0), filteroptions, bsolveall, boost::cref(vfreegrid), boost::ref(state)));
+        }
+        threads.join_all();
+        if( state._error.size() > 0 ) {
+            throw OPENRAVE_EXCEPTION_FORMAT(_("parallel ik search failed: %s"), state._error, ORE_Failed);
+        }
+
+        // merge in the order of the serial search
+        int allres = IKRA_Reject;
+        std::vector<IkReturnPtr> vmerged;
+        size_t stopindex = min(state._stopindex, vfreegrid.size());
+        for(size_t index = 0; index < stopindex; ++index) {
+            int res = state._vresults[index];
+            vmerged.insert(vmerged.end(), state._vikreturns[index].begin(), state._vikreturns[index].end());
+            if( !(res & IKRA_Reject) || (res & IKRA_Quit) ) {
+                allres = res;
+                break;
+            }
+            allres |= res;
+        }
+        retaction = static_cast<IkReturnAction>(allres);
+
+        if( !bsolveall && !!(retaction & IKRA_Reject) ) {
+            // the solution of a rejected index is not returned
+            vmerged.resize(0);
+        }
+
+        // the workers do not have the finish callbacks, so call them here with the robot set to each solution
+        FOREACH(itikreturn, vmerged) {
+            probot->SetActiveDOFValues((*itikreturn)->_vsolution, false);
+            IkParameterization paramnewglobal = pmanip->GetBase()->GetTransform() * pmanip->GetIkParameterization(param, false);
+            _CallFinishCallbacks(*itikreturn, pmanip, paramnewglobal);
+        }
+
+        if( bsolveall ) {
+            pvikreturns->insert(pvikreturns->end(), vmerged.begin(), vmerged.end());
+        }
+        else if( vmerged.size() > 0 && !!ikreturn ) {
+            *ikreturn = *vmerged.at(0);
+        }
+        return true;
+    }
+
+    /// \brief thread function of the parallel search, called on the solvers of the cloned environments
+    void _SolveParallelWorker(const IkParameterization& param, const vector<dReal>& q0, int filteroptions, bool bsolveall, const std::vector< std::vector<IkReal> >& vfreegrid, ParallelSearchState& state)
+    {
+        try {
+            EnvironmentMutex::scoped_lock lock(GetEnv()->GetMutex());
+            RobotBase::ManipulatorPtr pmanip(_pmanip);
+            RobotBasePtr probot = pmanip->GetRobot();
+            RobotBase::RobotStateSaver saver(probot);
+            probot->SetActiveDOFs(pmanip->GetArmIndices());
+            StateCheckEndEffector stateCheck(probot,_vchildlinks,_vindependentlinks,filteroptions);
+            CollisionOptionsStateSaver optionstate(GetEnv()->GetCollisionChecker(),GetEnv()->GetCollisionChecker()->GetCollisionOptions()|CO_ActiveDOFs,false);
+            std::vector<IkReturnPtr> vikreturns;
+            while(1) {
+                size_t index;
+                {
+                    boost::mutex::scoped_lock lock(state._mutex);
+                    if( state._nextindex >= state._stopindex || state._error.size() > 0 ) {
+                        break;
+                    }
+                    index = state._nextindex++;
+                }
+
+                IkReturnAction res;
+                vikreturns.resize(0);
+                if( bsolveall ) {
+                    res = _SolveAll(param, vfreegrid[index], filteroptions, vikreturns, stateCheck);
+                }
+                else {
+                    IkReturnPtr localikreturn(new IkReturn(IKRA_Success));
+                    res = _SolveSingle(param, vfreegrid[index], q0, filteroptions, localikreturn, stateCheck);
+                    if( !(res & IKRA_Reject) ) {
+                        vikreturns.push_back(localikreturn);
+                    }
+                }
+
+                boost::mutex::scoped_lock lock(state._mutex);
+                state._vresults[index] = res;
+                state._vikreturns[index].swap(vikreturns);
+                if( (!(res & IKRA_Reject) || (res & IKRA_Quit)) && index < state._stopindex ) {
+                    state._stopindex = index+1;
+                }
+            }
+        }
+        catch(const std::exception& ex) {
+            boost::mutex::scoped_lock lock(state._mutex);
+            if( state._error.size() == 0 ) {
+                state._error = ex.what();
+            }
+        }
+    }
+
     /// \param tLocalTool _pmanip->GetLocalToolTransform()
-    inline bool _CallIk(const IkParameterization& param, const vector<IkReal>& vfree, const Transform& tLocalTool, ikfast::IkSolutionList<IkReal>& solutions)
+    inline bool _CallIk(const IkParameterization& param, const vector<IkReal>& vfree, const Transform& tLocalTool, ikfast::IkSolutionListBase<IkReal>& solutions)
     {
         bool bsuccess = false;
         if( !!_ikfunctions->_ComputeIk2 ) {
@@ -914,7 +1146,7 @@ protected:
         return bsuccess;
     }
 
-    bool _CallIk1(const IkParameterization& param, const vector<IkReal>& vfree, const Transform& tLocalTool, ikfast::IkSolutionList<IkReal>& solutions)
+    bool _CallIk1(const IkParameterization& param, const vector<IkReal>& vfree, const Transform& tLocalTool, ikfast::IkSolutionListBase<IkReal>& solutions)
     {
         try {
             switch(param.GetType()) {
@@ -1050,7 +1282,7 @@ protected:
         throw openrave_exception(str(boost::format(_("don't support ik parameterization 0x%x"))%param.GetType()),ORE_InvalidArguments);
     }
 
-    bool _CallIk2(const IkParameterization& param, const vector<IkReal>& vfree, const Transform& tLocalTool, ikfast::IkSolutionList<IkReal>& solutions)
+    bool _CallIk2(const IkParameterization& param, const vector<IkReal>& vfree, const Transform& tLocalTool, ikfast::IkSolutionListBase<IkReal>& solutions)
     {
         RobotBase::ManipulatorPtr pmanip = _pmanip.lock();
         try {
@@ -1241,7 +1473,8 @@ protected:
     IkReturnAction _SolveSingle(const IkParameterization& param, const vector<IkReal>& vfree, const vector<dReal>& q0, int filteroptions, IkReturnPtr ikreturn, StateCheckEndEffector& stateCheck)
     {
         RobotBase::ManipulatorPtr pmanip(_pmanip);
-        ikfast::IkSolutionList<IkReal> solutions;
+        SolutionListHolder solutionsholder(*this);
+        ikfast::IkSolutionListArena<IkReal>& solutions = solutionsholder.GetList();
         if( !_CallIk(param,vfree, pmanip->GetLocalToolTransform(), solutions) ) {
             return IKRA_RejectKinematics;
         }
@@ -1773,7 +2006,8 @@ protected:
     {
         RobotBase::ManipulatorPtr pmanip(_pmanip);
         RobotBasePtr probot = pmanip->GetRobot();
-        ikfast::IkSolutionList<IkReal> solutions;
+        SolutionListHolder solutionsholder(*this);
+        ikfast::IkSolutionListArena<IkReal>& solutions = solutionsholder.GetList();
         if( _CallIk(param,vfree, pmanip->GetLocalToolTransform(), solutions) ) {
             vector<IkReal> vsolfree;
             std::vector<IkReal> sol(pmanip->GetArmIndices().size());
@@ -2337,6 +2571,13 @@ protected:
 
     bool _bEmptyTransform6D; ///< if true, then the iksolver has been built with identity of the manipulator transform. Only valid for Transform6D IKs.
 
+    boost::mutex _mutexSolutionLists; ///< protects _vsolutionlistpool
+    std::vector<IkSolutionListArenaPtr> _vsolutionlistpool; ///< solution lists that are not used by any ik call right now
+
+    int _nParallelThreads; ///< if > 1, the number of threads the free parameter search is split across
+    std::vector<EnvironmentBasePtr> _vparallelenvs; ///< cloned environments of the parallel search, kept across Solve calls so bodies are only re-synced
+    std::vector< boost::shared_ptr< IkFastSolver<IkReal> > > _vparallelsolvers; ///< solvers in _vparallelenvs attached to the cloned manipulator
+
 };
 
 #ifdef OPENRAVE_IKFAST_FLOAT32
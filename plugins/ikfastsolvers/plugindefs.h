@@ -83,6 +83,7 @@ IkSolverBasePtr CreateIkFastSolver(EnvironmentBasePtr penv, std::istream& sinput
 BOOST_TYPEOF_REGISTER_TEMPLATE(IkSingleDOFSolutionBase, 1)
 BOOST_TYPEOF_REGISTER_TEMPLATE(IkSolution, 1)
 BOOST_TYPEOF_REGISTER_TEMPLATE(IkSolutionList, 1)
+BOOST_TYPEOF_REGISTER_TEMPLATE(IkSolutionListArena, 1)
 #endif
 
 #define _(msgid) OpenRAVE::RaveGetLocalizedTextForDomain("openrave_plugins_ikfastsolvers", msgid)
@@ -0,0 +1,106 @@
+// -*- coding: utf-8 -*-
+// Copyright (C) 2016 Rosen Diankov
+//
+// This program is free software: you can redistribute it and/or modify it under the terms of the
+// GNU Lesser General Public License as published by the Free Software Foundation, either version 3
+// of the License, or at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+// even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License along with this program.
+// If not, see <http://www.gnu.org/licenses/>.
+
+// Times the raw ComputeIk calls of the shipped ikfast solvers with a new ikfast::IkSolutionList per
+// call and with a reused ikfast::IkSolutionListArena. The generated solvers are compiled in
+// directly, so nothing goes through the IkFastSolver interface.
+//
+// Usage: timeiksolutionlist [num]
+#include "plugindefs.h"
+#include <openrave/utils.h>
+
+#define IKFAST_HAS_LIBRARY
+#define IKFAST_NAMESPACE ik_barrettwam
+#include "ikfast.h"
+#undef IKFAST_NAMESPACE
+#define IKFAST_NAMESPACE ik_pa10
+#include "ikfast.h"
+#undef IKFAST_NAMESPACE
+#define IKFAST_NAMESPACE ik_puma
+#include "ikfast.h"
+#undef IKFAST_NAMESPACE
+
+struct SolverFunctions
+{
+    const char* name;
+    void (*computefk)(const double*, double*, double*);
+    bool (*computeik)(const double*, const double*, const double*, ikfast::IkSolutionListBase<double>&);
+    int (*getnumjoints)();
+    int (*getnumfreeparameters)();
+    int* (*getfreeparameters)();
+};
+
+/// \return false if the two containers did not receive the same solutions
+static bool TimeSolutionList(const SolverFunctions& fns, int num, uint32_t seed)
+{
+    // the poses are computed before timing so both runs solve the same problems
+    const int numjoints = fns.getnumjoints(), numfree = fns.getnumfreeparameters();
+    std::vector<double> vjoints(numjoints), vposes(12*num), vfrees(numfree*num);
+    for(int i = 0; i < num; ++i) {
+        for(int j = 0; j < numjoints; ++j) {
+            vjoints[j] = rand_r(&seed)*2*PI/RAND_MAX;
+        }
+        for(int j = 0; j < numfree; ++j) {
+            vfrees[i*numfree+j] = vjoints[fns.getfreeparameters()[j]];
+        }
+        fns.computefk(&vjoints[0], &vposes[12*i], &vposes[12*i+3]);
+    }
+
+    size_t numlistsolutions = 0, numarenasolutions = 0;
+    uint64_t starttime = utils::GetNanoPerformanceTime();
+    for(int i = 0; i < num; ++i) {
+        ikfast::IkSolutionList<double> solutions;
+        fns.computeik(&vposes[12*i], &vposes[12*i+3], numfree > 0 ? &vfrees[i*numfree] : NULL, solutions);
+        numlistsolutions += solutions.GetNumSolutions();
+    }
+    uint64_t listtime = utils::GetNanoPerformanceTime()-starttime;
+
+    ikfast::IkSolutionListArena<double> arena;
+    starttime = utils::GetNanoPerformanceTime();
+    for(int i = 0; i < num; ++i) {
+        arena.Clear();
+        fns.computeik(&vposes[12*i], &vposes[12*i+3], numfree > 0 ? &vfrees[i*numfree] : NULL, arena);
+        numarenasolutions += arena.GetNumSolutions();
+    }
+    uint64_t arenatime = utils::GetNanoPerformanceTime()-starttime;
+
+    double listrate = (1e9*num)/max(listtime,uint64_t(1)), arenarate = (1e9*num)/max(arenatime,uint64_t(1));
+    RAVELOG_INFO_FORMAT("%s ComputeIk calls/s: list=%f, arena=%f, speedup=%f, solutions=%d", fns.name%listrate%arenarate%(arenarate/listrate)%numlistsolutions);
+    if( numlistsolutions != numarenasolutions ) {
+        RAVELOG_ERROR_FORMAT("%s: the list received %d solutions, the arena %d", fns.name%numlistsolutions%numarenasolutions);
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    int num = argc > 1 ? atoi(argv[1]) : 2000;
+    if( num <= 0 ) {
+        RAVELOG_ERROR("usage: timeiksolutionlist [num]\n");
+        return 1;
+    }
+    const SolverFunctions solvers[] = {
+        { "barrettwam", ik_barrettwam::ComputeFk, ik_barrettwam::ComputeIk, ik_barrettwam::GetNumJoints, ik_barrettwam::GetNumFreeParameters, ik_barrettwam::GetFreeParameters },
+        { "pa10", ik_pa10::ComputeFk, ik_pa10::ComputeIk, ik_pa10::GetNumJoints, ik_pa10::GetNumFreeParameters, ik_pa10::GetFreeParameters },
+        { "puma", ik_puma::ComputeFk, ik_puma::ComputeIk, ik_puma::GetNumJoints, ik_puma::GetNumFreeParameters, ik_puma::GetFreeParameters },
+    };
+    int numfailures = 0;
+    for(size_t i = 0; i < sizeof(solvers)/sizeof(solvers[0]); ++i) {
+        if( !TimeSolutionList(solvers[i], num, 5) ) {
+            ++numfailures;
+        }
+    }
+    return numfailures > 0 ? 1 : 0;
+}
@@ -0,0 +1,807 @@
+// -*- coding: utf-8 -*-
+// Copyright (C) 2011 Rosen Diankov <rosen.diankov@gmail.com>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+/** \file statelog.h
+    \brief Binary format of the body state logs written by StateRecorder and read by StateReplayer.
+
+    A log is a file header followed by chunks of frames and terminated by a chunk index and a footer:
+
+    \verbatim
+    FileHeader
+    ChunkHeader payload  (repeated)
+    ChunkIndexEntry      (repeated, one per chunk)
+    FileFooter
+    \endverbatim
+
+    Every frame stores the published state of the bodies that changed since the previous frame of the same chunk. The
+    first frame of a chunk stores all bodies, so every chunk can be decoded without the chunks before it and seeking
+    only needs the index. Real numbers are stored losslessly as the XOR of their bits with the previous value of the
+    same field, with the leading and trailing zero bytes stripped. Values that did not change are skipped with
+    bitmasks. If the recording was interrupted before the index was written, the reader rebuilds it by walking the
+    chunk headers.
+
+    All integers are in the byte order of the recording machine, FileHeader::byteorder is used to detect mismatches.
+ */
+#ifndef OPENRAVE_LOGGING_STATELOG_H
+#define OPENRAVE_LOGGING_STATELOG_H
+
+#include "plugindefs.h"
+#include <cstring>
+
+namespace statelog {
+
+static const char s_filemagic[8] = { 'O','R','S','T','A','T','E','1'};
+static const char s_footermagic[8] = { 'O','R','S','I','N','D','X','1'};
+static const uint32_t s_chunkmagic = 0x4b4e4843; // CHNK
+static const uint32_t s_version = 1;
+static const uint32_t s_byteorder = 0x01020304;
+
+struct FileHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t byteorder;
+    double samplerate; ///< requested samples per second
+    uint64_t starttime; ///< utils::GetMicroTime() when the recording started, frame timestamps are relative to it
+};
+
+struct ChunkHeader
+{
+    uint32_t magic;
+    uint32_t numframes;
+    uint64_t payloadsize; ///< size in bytes of the encoded frames following the header
+    uint64_t firsttime, lasttime; ///< timestamps of the first and last frame
+};
+
+struct ChunkIndexEntry
+{
+    uint64_t offset; ///< file offset of the ChunkHeader
+    uint64_t firsttime, lasttime;
+    uint32_t numframes;
+    uint32_t reserved;
+};
+
+struct FileFooter
+{
+    uint64_t indexoffset; ///< file offset of the first ChunkIndexEntry
+    uint64_t numchunks;
+    char magic[8];
+};
+
+/// \brief which fields of a body are stored in a frame
+enum BodyRecordFlags
+{
+    BRF_Define=1, ///< name, uri, number of links and DOFs, the body was not in the previous frame of the chunk
+    BRF_Transforms=2, ///< bitmask of the changed links followed by their transforms
+    BRF_DOFValues=4, ///< bitmask of the changed DOFs followed by their values
+    BRF_Grabbed=8, ///< all grabbed bodies
+    BRF_ActiveManipulator=16, ///< name of the active manipulator
+};
+
+/// \brief the published state of all recorded bodies at one point in time
+class Frame
+{
+public:
+    Frame() : timestamp(0), simtime(0) {
+    }
+    uint64_t timestamp; ///< microseconds since FileHeader::starttime
+    uint64_t simtime; ///< simulation time of the environment in microseconds
+    std::vector<KinBody::BodyState> vbodies; ///< pbody is always empty
+};
+typedef boost::shared_ptr<Frame> FramePtr;
+
+inline bool IsSameGrabbed(const std::vector<KinBody::GrabbedInfoPtr>& v0, const std::vector<KinBody::GrabbedInfoPtr>& v1)
+{
+    if( v0.size() != v1.size() ) {
+        return false;
+    }
+    for(size_t i = 0; i < v0.size(); ++i) {
+        const KinBody::GrabbedInfo& info0 = *v0[i], &info1 = *v1[i];
+        if( info0._grabbedname != info1._grabbedname || info0._robotlinkname != info1._robotlinkname || info0._setRobotLinksToIgnore != info1._setRobotLinksToIgnore ) {
+            return false;
+        }
+        for(int j = 0; j < 4; ++j) {
+            if( info0._trelative.rot[j] != info1._trelative.rot[j] ) {
+                return false;
+            }
+        }
+        for(int j = 0; j < 3; ++j) {
+            if( info0._trelative.trans[j] != info1._trelative.trans[j] ) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+/// \brief encodes frames into chunks and writes them to a file
+class StateLogWriter
+{
+public:
+    /// \param framesperchunk number of frames after which a new chunk with a full state is started
+    /// \param maxchunksize size of the encoded frames in bytes after which a new chunk is started
+    StateLogWriter(uint32_t framesperchunk, size_t maxchunksize) : _framesperchunk(max(framesperchunk,(uint32_t)1)), _maxchunksize(maxchunksize), _numframes(0), _prevtimestamp(0), _prevsimtime(0), _numbyteswritten(0) {
+    }
+    virtual ~StateLogWriter() {
+        if( _ofile.is_open() ) {
+            try {
+                Close();
+            }
+            catch(const std::exception& ex) {
+                RAVELOG_WARN_FORMAT("failed to close state log: %s", ex.what());
+            }
+        }
+    }
+
+    virtual void Open(const std::string& filename, double samplerate, uint64_t starttime)
+    {
+        _ofile.open(filename.c_str(), std::ios::out|std::ios::binary|std::ios::trunc);
+        if( !_ofile ) {
+            throw OPENRAVE_EXCEPTION_FORMAT("failed to open state log %s for writing", filename, ORE_InvalidArguments);
+        }
+        _filename = filename;
+        FileHeader header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, s_filemagic, sizeof(header.magic));
+        header.version = s_version;
+        header.byteorder = s_byteorder;
+        header.samplerate = samplerate;
+        header.starttime = starttime;
+        _Write(&header, sizeof(header));
+        _vindex.resize(0);
+        _StartChunk();
+    }
+
+    /// \brief appends a frame, writes the current chunk once it is full
+    virtual void WriteFrame(const Frame& frame)
+    {
+        if( _chunk.numframes == 0 ) {
+            _chunk.firsttime = frame.timestamp;
+            _prevtimestamp = frame.timestamp;
+            _prevsimtime = 0;
+            _mapprevious.clear();
+        }
+        _chunk.lasttime = frame.timestamp;
+        _WriteVarUInt(frame.timestamp - _prevtimestamp);
+        _WriteVarUInt(_ZigZag((int64_t)(frame.simtime - _prevsimtime)));
+        _prevtimestamp = frame.timestamp;
+        _prevsimtime = frame.simtime;
+
+        // bodies that disappeared
+        _vseenids.resize(0);
+        FOREACHC(itbody, frame.vbodies) {
+            _vseenids.push_back(itbody->environmentid);
+        }
+        std::sort(_vseenids.begin(), _vseenids.end());
+        _vremovedids.resize(0);
+        FOREACHC(itprev, _mapprevious) {
+            if( !std::binary_search(_vseenids.begin(), _vseenids.end(), itprev->first) ) {
+                _vremovedids.push_back(itprev->first);
+            }
+        }
+        _WriteVarUInt(_vremovedids.size());
+        FOREACHC(itid, _vremovedids) {
+            _WriteVarUInt(*itid);
+            _mapprevious.erase(*itid);
+        }
+
+        // bodies that changed
+        _vrecords.resize(0);
+        for(size_t ibody = 0; ibody < frame.vbodies.size(); ++ibody) {
+            const KinBody::BodyState& state = frame.vbodies[ibody];
+            std::map<int, KinBody::BodyState>::const_iterator itprev = _mapprevious.find(state.environmentid);
+            uint8_t flags = 0;
+            if( itprev == _mapprevious.end() || itprev->second.strname != state.strname || itprev->second.uri != state.uri || itprev->second.vectrans.size() != state.vectrans.size() || itprev->second.jointvalues.size() != state.jointvalues.size() ) {
+                flags = BRF_Define|BRF_Transforms|BRF_DOFValues;
+                if( state.vGrabbedInfos.size() > 0 ) {
+                    flags |= BRF_Grabbed;
+                }
+                if( state.activeManipulatorName.size() > 0 ) {
+                    flags |= BRF_ActiveManipulator;
+                }
+            }
+            else {
+                const KinBody::BodyState& prev = itprev->second;
+                // the update stamp changes with every modification of the links, so the values only need to be compared when it changed
+                if( prev.updatestamp != state.updatestamp ) {
+                    if( !_IsSameTransforms(prev.vectrans, state.vectrans) ) {
+                        flags |= BRF_Transforms;
+                    }
+                    if( prev.jointvalues != state.jointvalues ) {
+                        flags |= BRF_DOFValues;
+                    }
+                }
+                if( !IsSameGrabbed(prev.vGrabbedInfos, state.vGrabbedInfos) ) {
+                    flags |= BRF_Grabbed;
+                }
+                if( prev.activeManipulatorName != state.activeManipulatorName ) {
+                    flags |= BRF_ActiveManipulator;
+                }
+            }
+            if( flags != 0 ) {
+                _vrecords.push_back(std::make_pair(ibody, flags));
+            }
+        }
+        _WriteVarUInt(_vrecords.size());
+        FOREACHC(itrecord, _vrecords) {
+            const KinBody::BodyState& state = frame.vbodies[itrecord->first];
+            uint8_t flags = itrecord->second;
+            _WriteVarUInt(state.environmentid);
+            _vbuffer.push_back(flags);
+            KinBody::BodyState& prev = _mapprevious[state.environmentid];
+            if( flags & BRF_Define ) {
+                _WriteString(state.strname);
+                _WriteString(state.uri);
+                _WriteVarUInt(state.vectrans.size());
+                _WriteVarUInt(state.jointvalues.size());
+                prev = KinBody::BodyState();
+                prev.environmentid = state.environmentid;
+                prev.strname = state.strname;
+                prev.uri = state.uri;
+                prev.vectrans.resize(state.vectrans.size(), Transform());
+                prev.jointvalues.resize(state.jointvalues.size(), 0);
+            }
+            if( flags & BRF_Transforms ) {
+                size_t offset = _WriteBitmaskSpace(state.vectrans.size());
+                for(size_t ilink = 0; ilink < state.vectrans.size(); ++ilink) {
+                    const Transform& t = state.vectrans[ilink];
+                    Transform& tprev = prev.vectrans[ilink];
+                    if( !(flags & BRF_Define) && _IsSameTransform(t, tprev) ) {
+                        continue;
+                    }
+                    _vbuffer[offset+ilink/8] |= 1<<(ilink%8);
+                    for(int j = 0; j < 4; ++j) {
+                        _WriteReal(tprev.rot[j], t.rot[j]);
+                    }
+                    for(int j = 0; j < 3; ++j) {
+                        _WriteReal(tprev.trans[j], t.trans[j]);
+                    }
+                    tprev = t;
+                }
+            }
+            if( flags & BRF_DOFValues ) {
+                size_t offset = _WriteBitmaskSpace(state.jointvalues.size());
+                for(size_t idof = 0; idof < state.jointvalues.size(); ++idof) {
+                    if( !(flags & BRF_Define) && state.jointvalues[idof] == prev.jointvalues[idof] ) {
+                        continue;
+                    }
+                    _vbuffer[offset+idof/8] |= 1<<(idof%8);
+                    _WriteReal(prev.jointvalues[idof], state.jointvalues[idof]);
+                    prev.jointvalues[idof] = state.jointvalues[idof];
+                }
+            }
+            if( flags & BRF_Grabbed ) {
+                _WriteVarUInt(state.vGrabbedInfos.size());
+                FOREACHC(itinfo, state.vGrabbedInfos) {
+                    const KinBody::GrabbedInfo& info = **itinfo;
+                    _WriteString(info._grabbedname);
+                    _WriteString(info._robotlinkname);
+                    for(int j = 0; j < 4; ++j) {
+                        _WriteReal(0, info._trelative.rot[j]);
+                    }
+                    for(int j = 0; j < 3; ++j) {
+                        _WriteReal(0, info._trelative.trans[j]);
+                    }
+                    _WriteVarUInt(info._setRobotLinksToIgnore.size());
+                    FOREACHC(itlink, info._setRobotLinksToIgnore) {
+                        _WriteVarUInt(*itlink);
+                    }
+                }
+                prev.vGrabbedInfos = state.vGrabbedInfos;
+            }
+            if( flags & BRF_ActiveManipulator ) {
+                _WriteString(state.activeManipulatorName);
+                prev.activeManipulatorName = state.activeManipulatorName;
+            }
+        }
+        // the stamp of unchanged bodies is kept up to date so that their values are not compared again
+        FOREACHC(itbody, frame.vbodies) {
+            _mapprevious[itbody->environmentid].updatestamp = itbody->updatestamp;
+        }
+
+        _chunk.numframes++;
+        _numframes++;
+        if( _chunk.numframes >= _framesperchunk || _vbuffer.size() >= _maxchunksize ) {
+            _WriteChunk();
+        }
+    }
+
+    /// \brief writes the last chunk, the index, and closes the file
+    virtual void Close()
+    {
+        if( !_ofile.is_open() ) {
+            return;
+        }
+        _WriteChunk();
+        FileFooter footer;
+        memset(&footer, 0, sizeof(footer));
+        footer.indexoffset = _numbyteswritten;
+        footer.numchunks = _vindex.size();
+        memcpy(footer.magic, s_footermagic, sizeof(footer.magic));
+        if( _vindex.size() > 0 ) {
+            _Write(&_vindex[0], _vindex.size()*sizeof(_vindex[0]));
+        }
+        _Write(&footer, sizeof(footer));
+        _ofile.close();
+        RAVELOG_DEBUG_FORMAT("wrote state log %s, %d frames in %d chunks, %d bytes", _filename%_numframes%_vindex.size()%_numbyteswritten);
+    }
+
+    inline uint64_t GetNumFrames() const {
+        return _numframes;
+    }
+    inline uint64_t GetNumBytesWritten() const {
+        return _numbyteswritten;
+    }
+
+protected:
+    void _StartChunk()
+    {
+        memset(&_chunk, 0, sizeof(_chunk));
+        _chunk.magic = s_chunkmagic;
+        _vbuffer.resize(0);
+    }
+
+    void _WriteChunk()
+    {
+        if( _chunk.numframes == 0 ) {
+            return;
+        }
+        ChunkIndexEntry entry;
+        memset(&entry, 0, sizeof(entry));
+        entry.offset = _numbyteswritten;
+        entry.firsttime = _chunk.firsttime;
+        entry.lasttime = _chunk.lasttime;
+        entry.numframes = _chunk.numframes;
+        _chunk.payloadsize = _vbuffer.size();
+        _Write(&_chunk, sizeof(_chunk));
+        _Write(&_vbuffer[0], _vbuffer.size());
+        // flush so that an interrupted recording loses at most the current chunk
+        _ofile.flush();
+        _vindex.push_back(entry);
+        _StartChunk();
+    }
+
+    void _Write(const void* pdata, size_t size)
+    {
+        _ofile.write(static_cast<const char*>(pdata), size);
+        if( !_ofile ) {
+            throw OPENRAVE_EXCEPTION_FORMAT("failed to write %d bytes to state log %s", size%_filename, ORE_Failed);
+        }
+        _numbyteswritten += size;
+    }
+
+    inline void _WriteVarUInt(uint64_t value)
+    {
+        while( value >= 0x80 ) {
+            _vbuffer.push_back((uint8_t)(value|0x80));
+            value >>= 7;
+        }
+        _vbuffer.push_back((uint8_t)value);
+    }
+
+    static inline uint64_t _ZigZag(int64_t value)
+    {
+        return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+    }
+
+    inline void _WriteString(const std::string& s)
+    {
+        _WriteVarUInt(s.size());
+        _vbuffer.insert(_vbuffer.end(), s.begin(), s.end());
+    }
+
+    /// \brief writes the XOR of the bits of the two values as a control byte holding the number of leading (low nibble) and trailing (high nibble) zero bytes followed by the remaining bytes
+    inline void _WriteReal(double prevvalue, double value)
+    {
+        uint64_t prevbits, bits;
+        memcpy(&prevbits, &prevvalue, sizeof(prevbits));
+        memcpy(&bits, &value, sizeof(bits));
+        uint64_t diff = prevbits ^ bits;
+        if( diff == 0 ) {
+            _vbuffer.push_back(8);
+            return;
+        }
+        int leading = 0, trailing = 0;
+        while( !(diff & (0xffULL<<(56-8*leading))) ) {
+            ++leading;
+        }
+        while( !(diff & (0xffULL<<(8*trailing))) ) {
+            ++trailing;
+        }
+        _vbuffer.push_back((uint8_t)(leading|(trailing<<4)));
+        for(int i = trailing; i < 8-leading; ++i) {
+            _vbuffer.push_back((uint8_t)(diff>>(8*i)));
+        }
+    }
+
+    /// \brief reserves zeroed space for a bitmask of num bits and returns its offset in the buffer
+    inline size_t _WriteBitmaskSpace(size_t num)
+    {
+        size_t offset = _vbuffer.size();
+        _vbuffer.resize(offset + (num+7)/8, 0);
+        return offset;
+    }
+
+    static inline bool _IsSameTransform(const Transform& t0, const Transform& t1)
+    {
+        return t0.rot.x == t1.rot.x && t0.rot.y == t1.rot.y && t0.rot.z == t1.rot.z && t0.rot.w == t1.rot.w && t0.trans.x == t1.trans.x && t0.trans.y == t1.trans.y && t0.trans.z == t1.trans.z;
+    }
+
+    static bool _IsSameTransforms(const std::vector<Transform>& v0, const std::vector<Transform>& v1)
+    {
+        for(size_t i = 0; i < v0.size(); ++i) {
+            if( !_IsSameTransform(v0[i], v1[i]) ) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    std::ofstream _ofile;
+    std::string _filename;
+    uint32_t _framesperchunk;
+    size_t _maxchunksize;
+    uint64_t _numframes;
+    ChunkHeader _chunk; ///< header of the chunk being encoded
+    std::vector<uint8_t> _vbuffer; ///< encoded frames of the current chunk
+    std::vector<ChunkIndexEntry> _vindex;
+    std::map<int, KinBody::BodyState> _mapprevious; ///< last stored state of every body in the current chunk indexed by environment id
+    uint64_t _prevtimestamp, _prevsimtime;
+    uint64_t _numbyteswritten;
+
+    // cache
+    std::vector<int> _vseenids, _vremovedids;
+    std::vector< std::pair<size_t, uint8_t> > _vrecords;
+};
+
+typedef boost::shared_ptr<StateLogWriter> StateLogWriterPtr;
+
+/// \brief reads the chunk index of a log and decodes its frames
+///
+/// The decoded state of all bodies is kept by the reader and updated by every call to ReadFrame.
+class StateLogReader
+{
+public:
+    StateLogReader() : _ichunk(-1), _payloadpos(0), _numchunkframesread(0), _timestamp(0), _simtime(0) {
+        memset(&_header, 0, sizeof(_header));
+    }
+    virtual ~StateLogReader() {
+    }
+
+    /// \brief opens the log and loads its chunk index, rebuilds the index if the log was not closed properly
+    virtual void Open(const std::string& filename)
+    {
+        _ifile.close();
+        _ifile.clear();
+        _ifile.open(filename.c_str(), std::ios::in|std::ios::binary);
+        if( !_ifile ) {
+            throw OPENRAVE_EXCEPTION_FORMAT("failed to open state log %s", filename, ORE_InvalidArguments);
+        }
+        _filename = filename;
+        _vindex.resize(0);
+        _ichunk = -1;
+        if( !_Read(&_header, sizeof(_header)) || memcmp(_header.magic, s_filemagic, sizeof(_header.magic)) != 0 ) {
+            throw OPENRAVE_EXCEPTION_FORMAT("%s is not a state log", filename, ORE_InvalidArguments);
+        }
+        if( _header.byteorder != s_byteorder ) {
+            throw OPENRAVE_EXCEPTION_FORMAT("state log %s was recorded with a different byte order", filename, ORE_InvalidArguments);
+        }
+        if( _header.version != s_version ) {
+            throw OPENRAVE_EXCEPTION_FORMAT("state log %s has version %d, expected %d", filename%_header.version%s_version, ORE_InvalidArguments);
+        }
+
+        _ifile.seekg(0, std::ios::end);
+        uint64_t filesize = _ifile.tellg();
+        FileFooter footer;
+        bool bhasindex = false;
+        if( filesize >= sizeof(FileHeader) + sizeof(FileFooter) ) {
+            _ifile.seekg(filesize - sizeof(footer));
+            if( _Read(&footer, sizeof(footer)) && memcmp(footer.magic, s_footermagic, sizeof(footer.magic)) == 0 && footer.indexoffset + footer.numchunks*sizeof(ChunkIndexEntry) + sizeof(footer) == filesize ) {
+                _vindex.resize(footer.numchunks);
+                _ifile.seekg(footer.indexoffset);
+                bhasindex = _vindex.size() == 0 || _Read(&_vindex[0], _vindex.size()*sizeof(_vindex[0]));
+            }
+        }
+        if( !bhasindex ) {
+            RAVELOG_WARN_FORMAT("state log %s has no index, it was probably not closed properly. rebuilding the index from the chunks", filename);
+            _vindex.resize(0);
+            uint64_t offset = sizeof(FileHeader);
+            while( offset + sizeof(ChunkHeader) <= filesize ) {
+                ChunkHeader chunk;
+                _ifile.seekg(offset);
+                if( !_Read(&chunk, sizeof(chunk)) || chunk.magic != s_chunkmagic || offset + sizeof(chunk) + chunk.payloadsize > filesize ) {
+                    break;
+                }
+                ChunkIndexEntry entry;
+                memset(&entry, 0, sizeof(entry));
+                entry.offset = offset;
+                entry.firsttime = chunk.firsttime;
+                entry.lasttime = chunk.lasttime;
+                entry.numframes = chunk.numframes;
+                _vindex.push_back(entry);
+                offset += sizeof(chunk) + chunk.payloadsize;
+            }
+        }
+        _ifile.clear();
+    }
+
+    inline const FileHeader& GetHeader() const {
+        return _header;
+    }
+    inline const std::vector<ChunkIndexEntry>& GetIndex() const {
+        return _vindex;
+    }
+
+    /// \brief returns the index of the last chunk starting at or before timestamp, 0 if timestamp is before the first chunk
+    int FindChunk(uint64_t timestamp) const
+    {
+        int low = 0, high = (int)_vindex.size();
+        while( high - low > 1 ) {
+            int mid = (low+high)/2;
+            if( _vindex[mid].firsttime <= timestamp ) {
+                low = mid;
+            }
+            else {
+                high = mid;
+            }
+        }
+        return low;
+    }
+
+    /// \brief reads the frames of a chunk and resets the decoded state, the next ReadFrame returns its first frame
+    virtual void LoadChunk(int ichunk)
+    {
+        const ChunkIndexEntry& entry = _vindex.at(ichunk);
+        ChunkHeader chunk;
+        _ifile.seekg(entry.offset);
+        if( !_Read(&chunk, sizeof(chunk)) || chunk.magic != s_chunkmagic ) {
+            throw OPENRAVE_EXCEPTION_FORMAT("state log %s: invalid chunk %d", _filename%ichunk, ORE_InvalidState);
+        }
+        _vbuffer.resize(chunk.payloadsize);
+        if( chunk.payloadsize > 0 && !_Read(&_vbuffer[0], chunk.payloadsize) ) {
+            throw OPENRAVE_EXCEPTION_FORMAT("state log %s: chunk %d is truncated", _filename%ichunk, ORE_InvalidState);
+        }
+        _ichunk = ichunk;
+        _payloadpos = 0;
+        _numchunkframesread = 0;
+        _timestamp = chunk.firsttime;
+        _simtime = 0;
+        _mapbodies.clear();
+    }
+
+    /// \brief decodes the next frame into the state returned by GetFrame
+    ///
+    /// \param bcrosschunks if true, loads the next chunk when the current one is finished
+    /// \return false if there are no more frames
+    virtual bool ReadFrame(bool bcrosschunks=true)
+    {
+        if( _ichunk < 0 || _numchunkframesread >= _vindex.at(_ichunk).numframes ) {
+            if( !bcrosschunks || _ichunk+1 >= (int)_vindex.size() ) {
+                return false;
+            }
+            LoadChunk(_ichunk+1);
+        }
+        _vchangedids.resize(0);
+        _vremovedids.resize(0);
+        _timestamp += _ReadVarUInt();
+        uint64_t simtimeencoded = _ReadVarUInt();
+        _simtime += (uint64_t)(int64_t)((simtimeencoded>>1) ^ -(int64_t)(simtimeencoded&1));
+
+        uint64_t numremoved = _ReadVarUInt();
+        for(uint64_t i = 0; i < numremoved; ++i) {
+            int id = (int)_ReadVarUInt();
+            _mapbodies.erase(id);
+            _vremovedids.push_back(id);
+        }
+        uint64_t numrecords = _ReadVarUInt();
+        for(uint64_t irecord = 0; irecord < numrecords; ++irecord) {
+            int id = (int)_ReadVarUInt();
+            uint8_t flags = _ReadByte();
+            KinBody::BodyState& state = _mapbodies[id];
+            if( flags & BRF_Define ) {
+                state = KinBody::BodyState();
+                state.environmentid = id;
+                state.strname = _ReadString();
+                state.uri = _ReadString();
+                state.vectrans.resize(_ReadVarUInt(), Transform());
+                state.jointvalues.resize(_ReadVarUInt(), 0);
+            }
+            else if( state.environmentid != id ) {
+                throw OPENRAVE_EXCEPTION_FORMAT("state log %s: chunk %d references undefined body %d", _filename%_ichunk%id, ORE_InvalidState);
+            }
+            if( flags & BRF_Transforms ) {
+                size_t offset = _ReadBitmask(state.vectrans.size());
+                for(size_t ilink = 0; ilink < state.vectrans.size(); ++ilink) {
+                    if( _vbuffer[offset+ilink/8] & (1<<(ilink%8)) ) {
+                        Transform& t = state.vectrans[ilink];
+                        for(int j = 0; j < 4; ++j) {
+                            t.rot[j] = _ReadReal(t.rot[j]);
+                        }
+                        for(int j = 0; j < 3; ++j) {
+                            t.trans[j] = _ReadReal(t.trans[j]);
+                        }
+                    }
+                }
+            }
+            if( flags & BRF_DOFValues ) {
+                size_t offset = _ReadBitmask(state.jointvalues.size());
+                for(size_t idof = 0; idof < state.jointvalues.size(); ++idof) {
+                    if( _vbuffer[offset+idof/8] & (1<<(idof%8)) ) {
+                        state.jointvalues[idof] = _ReadReal(state.jointvalues[idof]);
+                    }
+                }
+            }
+            if( flags & BRF_Grabbed ) {
+                state.vGrabbedInfos.resize(_ReadVarUInt());
+                FOREACH(itinfo, state.vGrabbedInfos) {
+                    itinfo->reset(new KinBody::GrabbedInfo());
+                    KinBody::GrabbedInfo& info = **itinfo;
+                    info._grabbedname = _ReadString();
+                    info._robotlinkname = _ReadString();
+                    for(int j = 0; j < 4; ++j) {
+                        info._trelative.rot[j] = _ReadReal(0);
+                    }
+                    for(int j = 0; j < 3; ++j) {
+                        info._trelative.trans[j] = _ReadReal(0);
+                    }
+                    uint64_t numignore = _ReadVarUInt();
+                    for(uint64_t i = 0; i < numignore; ++i) {
+                        info._setRobotLinksToIgnore.insert((int)_ReadVarUInt());
+                    }
+                }
+            }
+            if( flags & BRF_ActiveManipulator ) {
+                state.activeManipulatorName = _ReadString();
+            }
+            _vchangedids.push_back(id);
+        }
+        _numchunkframesread++;
+        return true;
+    }
+
+    /// \brief gets the timestamp of the frame the next ReadFrame(false) decodes without decoding it
+    ///
+    /// \return false if all frames of the loaded chunk were read
+    bool PeekTimestamp(uint64_t& timestamp)
+    {
+        if( _ichunk < 0 || _numchunkframesread >= _vindex.at(_ichunk).numframes ) {
+            return false;
+        }
+        size_t payloadpos = _payloadpos;
+        timestamp = _timestamp + _ReadVarUInt();
+        _payloadpos = payloadpos;
+        return true;
+    }
+
+    /// \brief timestamp of the last frame in microseconds since FileHeader::starttime
+    inline uint64_t GetTimestamp() const {
+        return _timestamp;
+    }
+    /// \brief simulation time of the last frame in microseconds
+    inline uint64_t GetSimulationTime() const {
+        return _simtime;
+    }
+    /// \brief the decoded state of all bodies after the last ReadFrame indexed by environment id
+    inline const std::map<int, KinBody::BodyState>& GetBodyStates() const {
+        return _mapbodies;
+    }
+    /// \brief decoded state of a body after the last ReadFrame, 0 if the body is not in the frame
+    inline const KinBody::BodyState* GetBodyState(int environmentid) const {
+        std::map<int, KinBody::BodyState>::const_iterator it = _mapbodies.find(environmentid);
+        return it != _mapbodies.end() ? &it->second : NULL;
+    }
+    /// \brief environment ids of the bodies stored in the last frame. On the first frame of a chunk, these are all bodies
+    inline const std::vector<int>& GetChangedIds() const {
+        return _vchangedids;
+    }
+    /// \brief environment ids of the bodies that were removed in the last frame
+    inline const std::vector<int>& GetRemovedIds() const {
+        return _vremovedids;
+    }
+    /// \brief true if the last frame is the first frame of its chunk
+    inline bool IsChunkStart() const {
+        return _numchunkframesread == 1;
+    }
+
+protected:
+    bool _Read(void* pdata, size_t size)
+    {
+        _ifile.read(static_cast<char*>(pdata), size);
+        return !!_ifile && (size_t)_ifile.gcount() == size;
+    }
+
+    inline void _CheckAvailable(size_t size)
+    {
+        if( _payloadpos + size > _vbuffer.size() ) {
+            throw OPENRAVE_EXCEPTION_FORMAT("state log %s: chunk %d is corrupted", _filename%_ichunk, ORE_InvalidState);
+        }
+    }
+
+    inline uint8_t _ReadByte()
+    {
+        _CheckAvailable(1);
+        return _vbuffer[_payloadpos++];
+    }
+
+    inline uint64_t _ReadVarUInt()
+    {
+        uint64_t value = 0;
+        for(int shift = 0; shift < 64; shift += 7) {
+            uint8_t b = _ReadByte();
+            value |= (uint64_t)(b&0x7f) << shift;
+            if( !(b & 0x80) ) {
+                return value;
+            }
+        }
+        throw OPENRAVE_EXCEPTION_FORMAT("state log %s: chunk %d has an invalid integer", _filename%_ichunk, ORE_InvalidState);
+    }
+
+    inline std::string _ReadString()
+    {
+        uint64_t size = _ReadVarUInt();
+        _CheckAvailable(size);
+        std::string s(_vbuffer.begin()+_payloadpos, _vbuffer.begin()+_payloadpos+size);
+        _payloadpos += size;
+        return s;
+    }
+
+    inline dReal _ReadReal(double prevvalue)
+    {
+        uint8_t control = _ReadByte();
+        int leading = control&0xf, trailing = control>>4;
+        if( leading + trailing > 8 ) {
+            throw OPENRAVE_EXCEPTION_FORMAT("state log %s: chunk %d has an invalid value", _filename%_ichunk, ORE_InvalidState);
+        }
+        _CheckAvailable(8-leading-trailing);
+        uint64_t diff = 0;
+        for(int i = trailing; i < 8-leading; ++i) {
+            diff |= (uint64_t)_vbuffer[_payloadpos++] << (8*i);
+        }
+        uint64_t bits;
+        memcpy(&bits, &prevvalue, sizeof(bits));
+        bits ^= diff;
+        double value;
+        memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+
+    /// \brief skips a bitmask of num bits and returns its offset in the buffer
+    inline size_t _ReadBitmask(size_t num)
+    {
+        size_t offset = _payloadpos;
+        _CheckAvailable((num+7)/8);
+        _payloadpos += (num+7)/8;
+        return offset;
+    }
+
+    std::ifstream _ifile;
+    std::string _filename;
+    FileHeader _header;
+    std::vector<ChunkIndexEntry> _vindex;
+    int _ichunk; ///< the loaded chunk, -1 if none
+    std::vector<uint8_t> _vbuffer; ///< encoded frames of the loaded chunk
+    size_t _payloadpos;
+    uint32_t _numchunkframesread;
+    std::map<int, KinBody::BodyState> _mapbodies; ///< decoded state indexed by environment id
+    uint64_t _timestamp, _simtime;
+    std::vector<int> _vchangedids, _vremovedids;
+};
+
+typedef boost::shared_ptr<StateLogReader> StateLogReaderPtr;
+
+} // end namespace statelog
+
+#endif
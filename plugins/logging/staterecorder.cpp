@@ -0,0 +1,297 @@
+// -*- coding: utf-8 -*-
+// Copyright (C) 2011 Rosen Diankov <rosen.diankov@gmail.com>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#include "statelog.h"
+
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition.hpp>
+
+using namespace statelog;
+
+class StateRecorder : public ModuleBase
+{
+public:
+    StateRecorder(EnvironmentBasePtr penv, std::istream& sinput) : ModuleBase(penv)
+    {
+        __description = ":Interface Author: Rosen Diankov\n\nRecords the published state of the bodies (link transforms, DOF values, grabbed bodies, active manipulator) at a fixed rate into a binary log that can be played back with the StateReplayer module. The bodies are sampled with EnvironmentBase::GetPublishedBodies, so the environment is never locked and the recorded states are as fresh as the last EnvironmentBase::UpdatePublishedBodies, which the simulation thread calls regularly. Samples where no body changed are skipped. A background thread encodes the samples and writes them to the file, only the bodies and values that changed since the previous sample are stored. Every chunk of frames starts with the full state, and the chunk index at the end of the file allows seeking.";
+        RegisterCommand("Start",boost::bind(&StateRecorder::_StartCommand,this,_1,_2),
+                        "Starts recording to a file, stops any previous recording and overwrites the file. Format::\n\n  Start [rate samplespersecond] [framesperchunk num] [maxqueue num] [bodies num name0 name1 ...] filename [filename]\\n\n\nrate defaults to 100, framesperchunk to 200, maxqueue (number of samples waiting to be written before samples are dropped) to 1000. If bodies is not given, all bodies are recorded. The filename is read until the end of the line.");
+        RegisterCommand("Stop",boost::bind(&StateRecorder::_StopCommand,this,_1,_2),
+                        "Stops recording, writes the remaining samples and the index, and closes the file. Format::\n\n  Stop\n\n");
+        RegisterCommand("GetStatistics",boost::bind(&StateRecorder::_GetStatisticsCommand,this,_1,_2),
+                        "Returns the statistics of the current or last recording: [numsampled] [numunchanged] [numdropped] [numwritten] [numbytes]");
+        _samplerate = 100;
+        _framesperchunk = 200;
+        _maxqueue = 1000;
+        _bStopRecord = true;
+        _starttime = 0;
+        _numsampled = _numunchanged = _numdropped = _numwritten = _numbytes = 0;
+    }
+    virtual ~StateRecorder()
+    {
+        RAVELOG_VERBOSE("~StateRecorder\n");
+        _Reset();
+    }
+
+    virtual void Destroy() {
+        _Reset();
+    }
+
+protected:
+    bool _StartCommand(ostream& sout, istream& sinput)
+    {
+        _Reset();
+        std::string filename;
+        dReal samplerate = 100;
+        uint32_t framesperchunk = 200;
+        size_t maxqueue = 1000;
+        std::vector<std::string> vbodynames;
+        string cmd;
+        while(!sinput.eof()) {
+            sinput >> cmd;
+            if( !sinput ) {
+                break;
+            }
+            std::transform(cmd.begin(), cmd.end(), cmd.begin(), ::tolower);
+            if( cmd == "rate" ) {
+                sinput >> samplerate;
+            }
+            else if( cmd == "framesperchunk" ) {
+                sinput >> framesperchunk;
+            }
+            else if( cmd == "maxqueue" ) {
+                sinput >> maxqueue;
+            }
+            else if( cmd == "bodies" ) {
+                size_t numbodies = 0;
+                sinput >> numbodies;
+                vbodynames.resize(numbodies);
+                FOREACH(itname, vbodynames) {
+                    sinput >> *itname;
+                }
+            }
+            else if( cmd == "filename" ) {
+                if( !getline(sinput, filename) ) {
+                    return false;
+                }
+                boost::trim(filename);
+            }
+            else {
+                RAVELOG_WARN(str(boost::format("unrecognized command: %s\n")%cmd));
+                break;
+            }
+            if( !sinput ) {
+                RAVELOG_ERROR(str(boost::format("failed processing command %s\n")%cmd));
+                return false;
+            }
+        }
+        if( filename.size() == 0 ) {
+            RAVELOG_WARN("StateRecorder needs a filename\n");
+            return false;
+        }
+        if( samplerate <= 0 ) {
+            RAVELOG_WARN_FORMAT("invalid sample rate %f", samplerate);
+            return false;
+        }
+
+        try {
+            _starttime = utils::GetMicroTime();
+            StateLogWriterPtr writer(new StateLogWriter(framesperchunk, 1<<20));
+            writer->Open(filename, samplerate, _starttime);
+            boost::mutex::scoped_lock lock(_mutex);
+            _writer = writer;
+            _filename = filename;
+            _samplerate = samplerate;
+            _framesperchunk = framesperchunk;
+            _maxqueue = max(maxqueue, (size_t)1);
+            _setbodynames = std::set<std::string>(vbodynames.begin(), vbodynames.end());
+            _numsampled = _numunchanged = _numdropped = _numwritten = _numbytes = 0;
+            _bStopRecord = false;
+            _threadsample.reset(new boost::thread(boost::bind(&StateRecorder::_SampleThread,this)));
+            _threadwrite.reset(new boost::thread(boost::bind(&StateRecorder::_WriteThread,this)));
+        }
+        catch(const std::exception& ex) {
+            RAVELOG_WARN(str(boost::format("StateRecorder: %s\n")%ex.what()));
+            _Reset();
+            return false;
+        }
+        RAVELOG_DEBUG_FORMAT("StateRecorder recording to %s at %f samples/s", filename%samplerate);
+        return true;
+    }
+
+    bool _StopCommand(ostream& sout, istream& sinput)
+    {
+        _Reset();
+        return true;
+    }
+
+    bool _GetStatisticsCommand(ostream& sout, istream& sinput)
+    {
+        boost::mutex::scoped_lock lock(_mutex);
+        sout << _numsampled << " " << _numunchanged << " " << _numdropped << " " << _numwritten << " " << _numbytes;
+        return true;
+    }
+
+    /// \brief samples the published bodies at _samplerate and queues the samples for _WriteThread
+    void _SampleThread()
+    {
+        uint64_t period = max((uint64_t)1, (uint64_t)(1000000.0/_samplerate));
+        uint64_t nexttime = utils::GetMicroTime();
+        std::vector<KinBody::BodyState> vbodies;
+        std::vector< std::pair<int, int> > vlaststamps, vstamps; // environment id and update stamp of the last queued sample
+        std::vector<std::string> vlastmanipnames, vmanipnames;
+        while(!_bStopRecord) {
+            try {
+                GetEnv()->GetPublishedBodies(vbodies, 100000);
+            }
+            catch(const std::exception& ex) {
+                RAVELOG_VERBOSE_FORMAT("failed to get published bodies: %s", ex.what());
+                vbodies.resize(0);
+            }
+            uint64_t timestamp = utils::GetMicroTime();
+            uint64_t simtime = GetEnv()->GetSimulationTime();
+
+            FramePtr frame(new Frame());
+            frame->timestamp = timestamp - _starttime;
+            frame->simtime = simtime;
+            frame->vbodies.reserve(vbodies.size());
+            vstamps.resize(0);
+            vmanipnames.resize(0);
+            FOREACH(itbody, vbodies) {
+                if( _setbodynames.size() > 0 && _setbodynames.find(itbody->strname) == _setbodynames.end() ) {
+                    continue;
+                }
+                // do not keep the bodies alive while the sample waits in the queue
+                itbody->pbody.reset();
+                vstamps.push_back(std::make_pair(itbody->environmentid, itbody->updatestamp));
+                vmanipnames.push_back(itbody->activeManipulatorName);
+                frame->vbodies.push_back(*itbody);
+            }
+
+            {
+                boost::mutex::scoped_lock lock(_mutex);
+                _numsampled++;
+                if( vstamps == vlaststamps && vmanipnames == vlastmanipnames ) {
+                    _numunchanged++;
+                }
+                else if( _listFrames.size() >= _maxqueue ) {
+                    _numdropped++;
+                }
+                else {
+                    _listFrames.push_back(frame);
+                    _condframes.notify_all();
+                    vlaststamps.swap(vstamps);
+                    vlastmanipnames.swap(vmanipnames);
+                }
+            }
+
+            // sleep until the next sample, skip the samples that were missed
+            nexttime += period;
+            uint64_t curtime = utils::GetMicroTime();
+            if( nexttime < curtime ) {
+                nexttime = curtime;
+            }
+            boost::mutex::scoped_lock lock(_mutex);
+            if( !_bStopRecord && nexttime > curtime ) {
+                _condstop.timed_wait(lock, boost::posix_time::microseconds(nexttime-curtime));
+            }
+        }
+    }
+
+    /// \brief encodes and writes the queued samples until the recording is stopped and the queue is empty
+    void _WriteThread()
+    {
+        std::list<FramePtr> listFrames;
+        while(1) {
+            {
+                boost::mutex::scoped_lock lock(_mutex);
+                while( _listFrames.size() == 0 && !_bStopRecord ) {
+                    _condframes.wait(lock);
+                }
+                if( _listFrames.size() == 0 ) {
+                    break;
+                }
+                listFrames.swap(_listFrames);
+            }
+            try {
+                FOREACH(itframe, listFrames) {
+                    _writer->WriteFrame(**itframe);
+                }
+            }
+            catch(const std::exception& ex) {
+                RAVELOG_ERROR_FORMAT("StateRecorder failed to write %s, stopping: %s", _filename%ex.what());
+                boost::mutex::scoped_lock lock(_mutex);
+                _bStopRecord = true;
+                _listFrames.clear();
+                _condstop.notify_all();
+                break;
+            }
+            listFrames.clear();
+            boost::mutex::scoped_lock lock(_mutex);
+            _numwritten = _writer->GetNumFrames();
+            _numbytes = _writer->GetNumBytesWritten();
+        }
+
+        try {
+            _writer->Close();
+        }
+        catch(const std::exception& ex) {
+            RAVELOG_ERROR_FORMAT("StateRecorder failed to close %s: %s", _filename%ex.what());
+        }
+        boost::mutex::scoped_lock lock(_mutex);
+        _numwritten = _writer->GetNumFrames();
+        _numbytes = _writer->GetNumBytesWritten();
+    }
+
+    /// \brief stops the threads, the queued samples are still written before the file is closed
+    void _Reset()
+    {
+        {
+            boost::mutex::scoped_lock lock(_mutex);
+            _bStopRecord = true;
+            _condstop.notify_all();
+            _condframes.notify_all();
+        }
+        if( !!_threadsample ) {
+            _threadsample->join();
+            _threadsample.reset();
+        }
+        if( !!_threadwrite ) {
+            _threadwrite->join();
+            _threadwrite.reset();
+        }
+        _writer.reset();
+    }
+
+    boost::mutex _mutex; ///< protects the queue and the statistics
+    boost::condition _condframes, _condstop;
+    boost::shared_ptr<boost::thread> _threadsample, _threadwrite;
+    bool _bStopRecord;
+    std::list<FramePtr> _listFrames; ///< samples waiting to be written
+    StateLogWriterPtr _writer;
+    std::string _filename;
+    dReal _samplerate;
+    uint32_t _framesperchunk;
+    size_t _maxqueue;
+    std::set<std::string> _setbodynames; ///< bodies to record, all if empty
+    uint64_t _starttime;
+    uint64_t _numsampled, _numunchanged, _numdropped, _numwritten, _numbytes;
+};
+
+ModuleBasePtr CreateStateRecorder(EnvironmentBasePtr penv, std::istream& sinput)
+{
+    return ModuleBasePtr(new StateRecorder(penv,sinput));
+}
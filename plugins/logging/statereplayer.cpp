@@ -0,0 +1,417 @@
+// -*- coding: utf-8 -*-
+// Copyright (C) 2011 Rosen Diankov <rosen.diankov@gmail.com>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#include "statelog.h"
+
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition.hpp>
+
+using namespace statelog;
+
+class StateReplayer : public ModuleBase
+{
+public:
+    StateReplayer(EnvironmentBasePtr penv, std::istream& sinput) : ModuleBase(penv)
+    {
+        __description = ":Interface Author: Rosen Diankov\n\nPlays back a log recorded by the StateRecorder module by setting the link transforms, grabbed bodies, and active manipulators of the bodies in the environment with the same names. The environment has to contain the recorded bodies, bodies that are not found are skipped. Playback can be scaled to any multiple of the recorded speed or run as fast as possible, which is useful for offline analysis. Seeking uses the chunk index of the log, so it only decodes the frames of one chunk.";
+        RegisterCommand("Open",boost::bind(&StateReplayer::_OpenCommand,this,_1,_2),
+                        "Opens a state log, the filename is read until the end of the line. Returns the same as GetInfo. Format::\n\n  Open [filename]\n\n");
+        RegisterCommand("GetInfo",boost::bind(&StateReplayer::_GetInfoCommand,this,_1,_2),
+                        "Returns information of the opened log: [numchunks] [numframes] [duration in seconds] [sample rate]");
+        RegisterCommand("Seek",boost::bind(&StateReplayer::_SeekCommand,this,_1,_2),
+                        "Stops playback and sets the environment to the last state recorded at or before the time in seconds since the start of the recording. Format::\n\n  Seek [time]\n\n");
+        RegisterCommand("Play",boost::bind(&StateReplayer::_PlayCommand,this,_1,_2),
+                        "Plays the log in a background thread. speed is the multiple of the recorded speed (default 1), 0 plays as fast as possible. start and end are in seconds since the start of the recording, start defaults to the current position. If wait is 1, plays in the calling thread instead and returns [numframes] [seconds taken] when finished. Format::\n\n  Play [speed s] [start t] [end t] [wait 0/1]\n\n");
+        RegisterCommand("Stop",boost::bind(&StateReplayer::_StopCommand,this,_1,_2),
+                        "Stops playback. Format::\n\n  Stop\n\n");
+        RegisterCommand("GetTime",boost::bind(&StateReplayer::_GetTimeCommand,this,_1,_2),
+                        "Returns [time in seconds of the last applied state] [1 if playing]");
+        _bStopPlay = true;
+        _bPlaying = false;
+        _curtime = 0;
+        _numframesplayed = 0;
+        _playseconds = 0;
+    }
+    virtual ~StateReplayer()
+    {
+        RAVELOG_VERBOSE("~StateReplayer\n");
+        _StopPlayback();
+    }
+
+    virtual void Destroy() {
+        _StopPlayback();
+        _reader.reset();
+    }
+
+protected:
+    bool _OpenCommand(ostream& sout, istream& sinput)
+    {
+        _StopPlayback();
+        std::string filename;
+        if( !getline(sinput, filename) ) {
+            return false;
+        }
+        boost::trim(filename);
+        try {
+            StateLogReaderPtr reader(new StateLogReader());
+            reader->Open(filename);
+            _reader = reader;
+        }
+        catch(const std::exception& ex) {
+            RAVELOG_WARN(str(boost::format("StateReplayer: %s\n")%ex.what()));
+            _reader.reset();
+            return false;
+        }
+        _mapbodies.clear();
+        _setwarnedbodies.clear();
+        _curtime = 0;
+        return _GetInfoCommand(sout, sinput);
+    }
+
+    bool _GetInfoCommand(ostream& sout, istream& sinput)
+    {
+        if( !_reader ) {
+            return false;
+        }
+        const std::vector<ChunkIndexEntry>& vindex = _reader->GetIndex();
+        uint64_t numframes = 0;
+        FOREACHC(itentry, vindex) {
+            numframes += itentry->numframes;
+        }
+        sout << vindex.size() << " " << numframes << " " << (vindex.size() > 0 ? 1e-6*vindex.back().lasttime : 0.0) << " " << _reader->GetHeader().samplerate;
+        return true;
+    }
+
+    bool _SeekCommand(ostream& sout, istream& sinput)
+    {
+        if( !_reader ) {
+            return false;
+        }
+        dReal time = 0;
+        sinput >> time;
+        if( !sinput ) {
+            return false;
+        }
+        _StopPlayback();
+        try {
+            if( !_Seek((uint64_t)(max(time,dReal(0))*1000000)) ) {
+                return false;
+            }
+            EnvironmentMutex::scoped_lock lockenv(GetEnv()->GetMutex());
+            _ApplyState(true);
+        }
+        catch(const std::exception& ex) {
+            RAVELOG_WARN(str(boost::format("StateReplayer: %s\n")%ex.what()));
+            return false;
+        }
+        return true;
+    }
+
+    bool _PlayCommand(ostream& sout, istream& sinput)
+    {
+        if( !_reader ) {
+            return false;
+        }
+        dReal speed = 1, starttime = -1, endtime = -1;
+        bool bwait = false;
+        string cmd;
+        while(!sinput.eof()) {
+            sinput >> cmd;
+            if( !sinput ) {
+                break;
+            }
+            std::transform(cmd.begin(), cmd.end(), cmd.begin(), ::tolower);
+            if( cmd == "speed" ) {
+                sinput >> speed;
+            }
+            else if( cmd == "start" ) {
+                sinput >> starttime;
+            }
+            else if( cmd == "end" ) {
+                sinput >> endtime;
+            }
+            else if( cmd == "wait" ) {
+                sinput >> bwait;
+            }
+            else {
+                RAVELOG_WARN(str(boost::format("unrecognized command: %s\n")%cmd));
+                break;
+            }
+            if( !sinput ) {
+                RAVELOG_ERROR(str(boost::format("failed processing command %s\n")%cmd));
+                return false;
+            }
+        }
+
+        _StopPlayback();
+        try {
+            if( !_Seek(starttime >= 0 ? (uint64_t)(starttime*1000000) : _curtime) ) {
+                return false;
+            }
+        }
+        catch(const std::exception& ex) {
+            RAVELOG_WARN(str(boost::format("StateReplayer: %s\n")%ex.what()));
+            return false;
+        }
+        {
+            boost::mutex::scoped_lock lock(_mutex);
+            _bStopPlay = false;
+            _bPlaying = true;
+            _numframesplayed = 0;
+            _playseconds = 0;
+        }
+        uint64_t endtimestamp = endtime >= 0 ? (uint64_t)(endtime*1000000) : std::numeric_limits<uint64_t>::max();
+        if( bwait ) {
+            // the caller might hold the environment lock, so play in its thread instead of waiting for another thread that needs the lock
+            _Play(speed, endtimestamp, false);
+            boost::mutex::scoped_lock lock(_mutex);
+            sout << _numframesplayed << " " << _playseconds;
+        }
+        else {
+            _threadplay.reset(new boost::thread(boost::bind(&StateReplayer::_Play,this,speed,endtimestamp,true)));
+        }
+        return true;
+    }
+
+    bool _StopCommand(ostream& sout, istream& sinput)
+    {
+        _StopPlayback();
+        return true;
+    }
+
+    bool _GetTimeCommand(ostream& sout, istream& sinput)
+    {
+        boost::mutex::scoped_lock lock(_mutex);
+        sout << 1e-6*_curtime << " " << (int)_bPlaying;
+        return true;
+    }
+
+    /// \brief decodes the frames until the last frame at or before timestamp
+    ///
+    /// \return false if the log has no frames
+    bool _Seek(uint64_t timestamp)
+    {
+        if( _reader->GetIndex().size() == 0 ) {
+            RAVELOG_WARN("StateReplayer: log has no frames\n");
+            return false;
+        }
+        _reader->LoadChunk(_reader->FindChunk(timestamp));
+        if( !_reader->ReadFrame(false) ) {
+            return false;
+        }
+        uint64_t nexttimestamp = 0;
+        while( _reader->PeekTimestamp(nexttimestamp) && nexttimestamp <= timestamp ) {
+            _reader->ReadFrame(false);
+        }
+        boost::mutex::scoped_lock lock(_mutex);
+        _curtime = _reader->GetTimestamp();
+        return true;
+    }
+
+    /// \brief plays the frames following the current one, the current frame is applied with the full state
+    ///
+    /// \param bthread true if called from the playback thread, which must not block on the environment lock since \ref _StopPlayback joins it
+    void _Play(dReal speed, uint64_t endtime, bool bthread)
+    {
+        uint64_t playstarttime = utils::GetMicroTime();
+        uint64_t firsttimestamp = _reader->GetTimestamp();
+        try {
+            bool ballbodies = true;
+            while( !_bStopPlay && _reader->GetTimestamp() <= endtime ) {
+                if( speed > 0 ) {
+                    uint64_t targettime = playstarttime + (uint64_t)((_reader->GetTimestamp()-firsttimestamp)/speed);
+                    boost::mutex::scoped_lock lock(_mutex);
+                    while( !_bStopPlay ) {
+                        uint64_t curtime = utils::GetMicroTime();
+                        if( curtime >= targettime ) {
+                            break;
+                        }
+                        _condstop.timed_wait(lock, boost::posix_time::microseconds(targettime-curtime));
+                    }
+                    if( _bStopPlay ) {
+                        break;
+                    }
+                }
+                {
+                    EnvironmentMutex::scoped_try_lock lockenv(GetEnv()->GetMutex(), boost::defer_lock_t());
+                    if( bthread ) {
+                        if( !_TryLockEnvironment(lockenv) ) {
+                            break;
+                        }
+                    }
+                    else {
+                        lockenv.lock();
+                    }
+                    _ApplyState(ballbodies);
+                }
+                {
+                    boost::mutex::scoped_lock lock(_mutex);
+                    _curtime = _reader->GetTimestamp();
+                    _numframesplayed++;
+                }
+                if( !_reader->ReadFrame() ) {
+                    break;
+                }
+                // the first frame of a chunk lists all bodies, otherwise only the changed ones
+                ballbodies = false;
+            }
+        }
+        catch(const std::exception& ex) {
+            RAVELOG_ERROR_FORMAT("StateReplayer stopped playing: %s", ex.what());
+        }
+        boost::mutex::scoped_lock lock(_mutex);
+        _playseconds = 1e-6*(utils::GetMicroTime()-playstarttime);
+        _bPlaying = false;
+        RAVELOG_DEBUG_FORMAT("StateReplayer played %d frames in %fs", _numframesplayed%_playseconds);
+    }
+
+    /// \brief locks the environment unless playback is stopped first
+    ///
+    /// Stop and Open join the playback thread, and their caller might hold the environment lock, so the thread keeps checking for the stop request instead of blocking on the lock.
+    /// \return false if playback was stopped before the lock was acquired
+    bool _TryLockEnvironment(EnvironmentMutex::scoped_try_lock& lockenv)
+    {
+        while( !lockenv.try_lock() ) {
+            boost::mutex::scoped_lock lock(_mutex);
+            if( _bStopPlay ) {
+                return false;
+            }
+            _condstop.timed_wait(lock, boost::posix_time::milliseconds(1));
+        }
+        return true;
+    }
+
+    /// \brief sets the decoded state of the reader to the bodies in the environment, the environment has to be locked
+    ///
+    /// \param ballbodies if true, sets all bodies in the frame, otherwise only the ones that changed in the last frame
+    void _ApplyState(bool ballbodies)
+    {
+        _vapplyids.resize(0);
+        if( ballbodies ) {
+            FOREACHC(itstate, _reader->GetBodyStates()) {
+                _vapplyids.push_back(itstate->first);
+            }
+        }
+        else {
+            _vapplyids = _reader->GetChangedIds();
+        }
+
+        _vgrabbing.resize(0);
+        FOREACHC(itid, _vapplyids) {
+            const KinBody::BodyState* pstate = _reader->GetBodyState(*itid);
+            if( !pstate ) {
+                continue;
+            }
+            KinBodyPtr pbody = _GetBody(*pstate);
+            if( !pbody ) {
+                continue;
+            }
+            pbody->SetLinkTransformations(pstate->vectrans, pstate->jointvalues);
+            if( pstate->activeManipulatorName.size() > 0 && pbody->IsRobot() ) {
+                RobotBasePtr probot = RaveInterfaceCast<RobotBase>(pbody);
+                if( !probot->GetActiveManipulator() || probot->GetActiveManipulator()->GetName() != pstate->activeManipulatorName ) {
+                    try {
+                        probot->SetActiveManipulator(pstate->activeManipulatorName);
+                    }
+                    catch(const std::exception& ex) {
+                        RAVELOG_WARN_FORMAT("failed to set active manipulator of %s: %s", pbody->GetName()%ex.what());
+                    }
+                }
+            }
+            _vgrabbing.push_back(std::make_pair(pbody, pstate));
+        }
+
+        // grab after all links are set so that the relative transforms of the grabbed bodies are the recorded ones
+        std::vector<KinBody::GrabbedInfoPtr> vcurgrabbed;
+        FOREACH(itgrabbing, _vgrabbing) {
+            KinBodyPtr pbody = itgrabbing->first;
+            const std::vector<KinBody::GrabbedInfoPtr>& vgrabbedinfos = itgrabbing->second->vGrabbedInfos;
+            pbody->GetGrabbedInfo(vcurgrabbed);
+            // the ignored links are recomputed when grabbing, so only compare which bodies are grabbed with which links
+            bool bsame = vcurgrabbed.size() == vgrabbedinfos.size();
+            for(size_t i = 0; i < vcurgrabbed.size() && bsame; ++i) {
+                bsame = vcurgrabbed[i]->_grabbedname == vgrabbedinfos[i]->_grabbedname && vcurgrabbed[i]->_robotlinkname == vgrabbedinfos[i]->_robotlinkname;
+            }
+            if( !bsame ) {
+                std::vector<KinBody::GrabbedInfoConstPtr> vconstinfos(vgrabbedinfos.begin(), vgrabbedinfos.end());
+                try {
+                    pbody->ResetGrabbed(vconstinfos);
+                }
+                catch(const std::exception& ex) {
+                    RAVELOG_WARN_FORMAT("failed to set grabbed bodies of %s: %s", pbody->GetName()%ex.what());
+                }
+            }
+        }
+    }
+
+    /// \brief returns the body in the environment that corresponds to the recorded state, empty if the body does not exist or has a different structure
+    KinBodyPtr _GetBody(const KinBody::BodyState& state)
+    {
+        std::pair<std::string, KinBodyWeakPtr>& cachedbody = _mapbodies[state.environmentid];
+        KinBodyPtr pbody = cachedbody.second.lock();
+        if( !pbody || cachedbody.first != state.strname || pbody->GetName() != state.strname ) {
+            pbody = GetEnv()->GetKinBody(state.strname);
+            cachedbody.first = state.strname;
+            cachedbody.second = pbody;
+        }
+        if( !pbody ) {
+            if( _setwarnedbodies.insert(state.strname).second ) {
+                RAVELOG_WARN_FORMAT("StateReplayer: body %s is not in the environment, skipping", state.strname);
+            }
+            return KinBodyPtr();
+        }
+        if( pbody->GetLinks().size() != state.vectrans.size() || pbody->GetDOF() != (int)state.jointvalues.size() ) {
+            if( _setwarnedbodies.insert(state.strname).second ) {
+                RAVELOG_WARN_FORMAT("StateReplayer: body %s has %d links and %d DOF, but the log has %d links and %d DOF, skipping", state.strname%pbody->GetLinks().size()%pbody->GetDOF()%state.vectrans.size()%state.jointvalues.size());
+            }
+            return KinBodyPtr();
+        }
+        return pbody;
+    }
+
+    void _StopPlayback()
+    {
+        {
+            boost::mutex::scoped_lock lock(_mutex);
+            _bStopPlay = true;
+            _condstop.notify_all();
+        }
+        if( !!_threadplay ) {
+            _threadplay->join();
+            _threadplay.reset();
+        }
+    }
+
+    boost::mutex _mutex; ///< protects the playback state
+    boost::condition _condstop;
+    boost::shared_ptr<boost::thread> _threadplay;
+    bool _bStopPlay, _bPlaying;
+    StateLogReaderPtr _reader; ///< only used by the playback thread while playing
+    uint64_t _curtime; ///< timestamp of the last applied frame
+    uint64_t _numframesplayed;
+    dReal _playseconds;
+    std::map<int, std::pair<std::string, KinBodyWeakPtr> > _mapbodies; ///< bodies in the environment indexed by the recorded environment id
+    std::set<std::string> _setwarnedbodies;
+
+    // cache
+    std::vector<int> _vapplyids;
+    std::vector< std::pair<KinBodyPtr, const KinBody::BodyState*> > _vgrabbing;
+};
+
+ModuleBasePtr CreateStateReplayer(EnvironmentBasePtr penv, std::istream& sinput)
+{
+    return ModuleBasePtr(new StateReplayer(penv,sinput));
+}
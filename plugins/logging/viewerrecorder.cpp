@@ -96,11 +96,25 @@ class ViewerRecorder : public ModuleBase
         bool _bProcessed;
     };
 
+    /// \brief what the viewer thread does with a new image when the queue of frames waiting to be encoded is full
+    enum FrameDropPolicy
+    {
+        FDP_DropOldest=0, ///< drop the oldest queued frame, the encoder repeats the previous frame in its place
+        FDP_DropNewest=1, ///< drop the new image
+        FDP_Block=2, ///< wait for the encoder, this throttles the viewer. always used when the viewer controls the simulation time
+    };
+
     boost::mutex _mutex; // for video data passing
     boost::mutex _mutexlibrary; // for video encoding library resources
-    boost::condition _condnewframe;
+    boost::condition _condnewframe, _condframeconsumed;
     bool _bContinueThread, _bStopRecord;
     boost::shared_ptr<boost::thread> _threadrecord;
+    size_t _nMaxQueuedFrames; ///< maximum size of _listAddFrames
+    FrameDropPolicy _dropPolicy;
+
+    // statistics of the current recording, protected by _mutex
+    uint64_t _nFramesReceived, _nFramesDropped, _nFramesEncoded, _nFramesRepeated;
+    uint64_t _nConvertTime, _nEncodeTime; ///< total microseconds spent converting and encoding the unique frames
 
     boost::multi_array<uint32_t,2> _vwatermarkimage;
     int _nFrameCount, _nVideoWidth, _nVideoHeight;
@@ -111,21 +125,24 @@ class ViewerRecorder : public ModuleBase
     UserDataPtr _callback;
     int _nUseSimulationTime; // 0 to record as is, 1 to record with respect to simulation, 2 to control simulation to viewer updates
     dReal _fSimulationTimeMultiplier; // how many times to make the simulation time faster
-    list<boost::shared_ptr<VideoFrame> > _listAddFrames, _listFinishedFrames;
+    list<boost::shared_ptr<VideoFrame> > _listAddFrames, _listFinishedFrames; ///< frames waiting to be encoded and free frames to reuse
     boost::shared_ptr<VideoFrame> _frameLastAdded;
+    boost::shared_ptr<VideoFrame> _frameEncoding; ///< frame used by _RecordThread outside of _mutex
 
 public:
     ViewerRecorder(EnvironmentBasePtr penv, std::istream& sinput) : ModuleBase(penv)
     {
         __description = ":Interface Author: Rosen Diankov\n\nRecords the images produced from a viewer into video file. The recordings can be synchronized to real-time or simulation time, by default simulation time is used. Each instance can record only one file at a time. To record multiple files simultaneously, create multiple VideoRecorder instances";
         RegisterCommand("Start",boost::bind(&ViewerRecorder::_StartCommand,this,_1,_2),
-                        "Starts recording a file, this will stop all previous recordings and overwrite any previous files stored in this location. Format::\n\n  Start [width] [height] [framerate] codec [codec] timing [simtime/realtime/controlsimtime[=timestepmult]] viewer [name]\\n filename [filename]\\n\n\nBecause the viewer and filenames can have spaces, the names are ready until a newline is encountered");
+                        "Starts recording a file, this will stop all previous recordings and overwrite any previous files stored in this location. Format::\n\n  Start [width] [height] [framerate] codec [codec] timing [simtime/realtime/controlsimtime[=timestepmult]] maxqueue [num] droppolicy [oldest/newest/block] threads [num] viewer [name]\\n filename [filename]\\n\n\nBecause the viewer and filenames can have spaces, the names are ready until a newline is encountered. maxqueue is the number of images that can wait for the encoder (default 8). When the queue is full, droppolicy decides whether the oldest queued image (default) or the new image is dropped, or whether the viewer waits for the encoder. The viewer always waits when it controls the simulation time. threads is the number of threads converting the images to the colorspace of the codec, by default the number of cores.");
         RegisterCommand("Stop",boost::bind(&ViewerRecorder::_StopCommand,this,_1,_2),
                         "Stops recording and saves the file. Format::\n\n  Stop\n\n");
         RegisterCommand("GetCodecs",boost::bind(&ViewerRecorder::_GetCodecsCommand,this,_1,_2),
                         "Return all the possible codecs, one codec per line:[video_codec id] [name]");
         RegisterCommand("SetWatermark",boost::bind(&ViewerRecorder::_SetWatermarkCommand,this,_1,_2),
                         "Set a WxHx4 image as a watermark. Each color is an unsigned integer ordered as A|B|G|R. The origin should be the top left corner");
+        RegisterCommand("GetStatistics",boost::bind(&ViewerRecorder::_GetStatisticsCommand,this,_1,_2),
+                        "Returns the statistics of the current or last recording: [received images] [dropped images] [encoded frames] [repeated frames] [queued images] [average conversion time of a frame in seconds] [average encoding time of a frame in seconds]");
         _nFrameCount = _nVideoWidth = _nVideoHeight = 0;
         _framerate = 0;
         _nUseSimulationTime = 1;
@@ -134,6 +151,10 @@ public:
         _bContinueThread = true;
         _bStopRecord = true;
         _frameindex = 0;
+        _nMaxQueuedFrames = 8;
+        _dropPolicy = FDP_DropOldest;
+        _nFramesReceived = _nFramesDropped = _nFramesEncoded = _nFramesRepeated = 0;
+        _nConvertTime = _nEncodeTime = 0;
 #ifdef _WIN32
         _pfile = NULL;
         _ps = NULL;
@@ -145,12 +166,16 @@ public:
         _bWroteHeader = false;
         _output = NULL;
         _stream = NULL;
-        _picture = NULL;
         _yuv420p = NULL;
         _picture_buf = NULL;
         _outbuf = NULL;
         _picture_size = 0;
         _outbuf_size = 0;
+        _nConvertThreads = 1;
+        _bStopConvertWorkers = false;
+        _bConvertFailed = false;
+        _pConvertImage = NULL;
+        _nConvertBands = _nNextConvertBand = _nConvertBandsDone = 0;
 #endif
         _threadrecord.reset(new boost::thread(boost::bind(&ViewerRecorder::_RecordThread,this)));
     }
@@ -164,6 +189,9 @@ public:
             _condnewframe.notify_all();
         }
         _threadrecord->join();
+#ifndef _WIN32
+        _StopConvertWorkers();
+#endif
     }
 
     virtual void Destroy() {
@@ -180,6 +208,7 @@ protected:
             ViewerBasePtr pviewer;
             int codecid=-1;
             _Reset();
+            int numconvertthreads = boost::thread::hardware_concurrency();
             sinput >> _nVideoWidth >> _nVideoHeight >> _framerate;
             string cmd;
             while(!sinput.eof()) {
@@ -217,6 +246,29 @@ protected:
                         RAVELOG_WARN("unknown cmd");
                     }
                 }
+                else if( cmd == "maxqueue" ) {
+                    sinput >> _nMaxQueuedFrames;
+                    _nMaxQueuedFrames = max(_nMaxQueuedFrames, (size_t)1);
+                }
+                else if( cmd == "droppolicy" ) {
+                    string type;
+                    sinput >> type;
+                    if( type == "oldest" ) {
+                        _dropPolicy = FDP_DropOldest;
+                    }
+                    else if( type == "newest" ) {
+                        _dropPolicy = FDP_DropNewest;
+                    }
+                    else if( type == "block" ) {
+                        _dropPolicy = FDP_Block;
+                    }
+                    else {
+                        RAVELOG_WARN(str(boost::format("unknown drop policy %s")%type));
+                    }
+                }
+                else if( cmd == "threads" ) {
+                    sinput >> numconvertthreads;
+                }
                 else if( cmd == "viewer" ) {
                     string name;
                     if( !getline(sinput, name) ) {
@@ -243,6 +295,11 @@ protected:
             }
             RAVELOG_INFO("video filename: %s, %d x %d @ %f frames/sec\n",_filename.c_str(),_nVideoWidth,_nVideoHeight,_framerate);
             _StartVideo(_filename,_framerate,_nVideoWidth,_nVideoHeight,24,codecid);
+#ifndef _WIN32
+            _nConvertThreads = max(1, numconvertthreads);
+#endif
+            _nFramesReceived = _nFramesDropped = _nFramesEncoded = _nFramesRepeated = 0;
+            _nConvertTime = _nEncodeTime = 0;
             _starttime = 0;
             if( _nUseSimulationTime == 2 ) {
                 _frametime = (uint64_t)(1000000.0f*_fSimulationTimeMultiplier/_framerate);
@@ -282,46 +339,91 @@ protected:
         return !!sinput;
     }
 
-    void _ViewerImageCallback(const uint8_t* memory, int width, int height, int pixeldepth)
+    bool _GetStatisticsCommand(ostream& sout, istream& sinput)
     {
         boost::mutex::scoped_lock lock(_mutex);
-        if( !GetEnv() || !_callback ) {
-            // recorder already destroyed and this thread is just remaining
-            return;
-        }
-        uint64_t timestamp = _nUseSimulationTime ? GetEnv()->GetSimulationTime() : utils::GetMicroTime();
-        boost::shared_ptr<VideoFrame> frame;
+        uint64_t numconverted = _nFramesEncoded - _nFramesRepeated;
+        sout << _nFramesReceived << " " << _nFramesDropped << " " << _nFramesEncoded << " " << _nFramesRepeated << " " << _listAddFrames.size() << " ";
+        sout << (numconverted > 0 ? 1e-6*_nConvertTime/numconverted : 0.0) << " " << (numconverted > 0 ? 1e-6*_nEncodeTime/numconverted : 0.0);
+        return true;
+    }
 
-        if( _listAddFrames.size() > 0 ) {
-            BOOST_ASSERT( timestamp-_starttime >= _listAddFrames.back()->_timestamp-_starttime );
-            if( _listAddFrames.back()->_timestamp == timestamp ) {
-                // if the timestamps match, then take the newest frame
-                frame = _listAddFrames.back();
-                _listAddFrames.pop_back();
+    /// \brief called by the viewer thread for every rendered image
+    ///
+    /// Only the copy of the image and the queue operations happen in the viewer thread, the encoding is done by _RecordThread.
+    void _ViewerImageCallback(const uint8_t* memory, int width, int height, int pixeldepth)
+    {
+        boost::shared_ptr<VideoFrame> frame;
+        uint64_t timestamp;
+        {
+            boost::mutex::scoped_lock lock(_mutex);
+            if( !GetEnv() || !_callback ) {
+                // recorder already destroyed and this thread is just remaining
+                return;
             }
-        }
-        if( !frame ) {
-            if( _listFinishedFrames.size() > 0 ) {
-                frame = _listFinishedFrames.back();
-                _listFinishedFrames.pop_back();
+            timestamp = _nUseSimulationTime ? GetEnv()->GetSimulationTime() : utils::GetMicroTime();
+            _nFramesReceived++;
+
+            if( _listAddFrames.size() > 0 ) {
+                BOOST_ASSERT( timestamp-_starttime >= _listAddFrames.back()->_timestamp-_starttime );
+                if( _listAddFrames.back()->_timestamp == timestamp && _listAddFrames.back() != _frameLastAdded && _listAddFrames.back() != _frameEncoding ) {
+                    // if the timestamps match, then take the newest frame
+                    frame = _listAddFrames.back();
+                    _listAddFrames.pop_back();
+                }
             }
-            else {
-                frame.reset(new VideoFrame());
+            if( !frame && _listAddFrames.size() >= _nMaxQueuedFrames ) {
+                FrameDropPolicy policy = _nUseSimulationTime == 2 ? FDP_Block : _dropPolicy;
+                if( policy == FDP_DropNewest ) {
+                    _nFramesDropped++;
+                    return;
+                }
+                else if( policy == FDP_DropOldest ) {
+                    _RecycleFrame(_listAddFrames.front());
+                    _listAddFrames.pop_front();
+                    _nFramesDropped++;
+                }
+                else {
+                    while( _listAddFrames.size() >= _nMaxQueuedFrames && !!_callback && !_bStopRecord && _bContinueThread ) {
+                        _condframeconsumed.wait(lock);
+                    }
+                    if( !_callback || _bStopRecord || !_bContinueThread ) {
+                        return;
+                    }
+                }
+            }
+            if( !frame ) {
+                if( _listFinishedFrames.size() > 0 ) {
+                    frame = _listFinishedFrames.back();
+                    _listFinishedFrames.pop_back();
+                }
+                else {
+                    frame.reset(new VideoFrame());
+                }
             }
         }
+
+        // the frame is not in any list, so it can be filled without blocking the record thread
         frame->_width = width;
         frame->_height = height;
         frame->_pixeldepth = pixeldepth;
         //RAVELOG_VERBOSE("image frame is %d x %d\n",width,height);
         frame->_timestamp = timestamp;
+        frame->_bProcessed = false;
         frame->_vimagememory.resize(width*height*pixeldepth);
         std::copy(memory,memory+width*height*pixeldepth,frame->_vimagememory.begin());
-        _listAddFrames.push_back(frame);
-        if( _starttime == 0 ) {
-            _starttime = timestamp;
+        {
+            boost::mutex::scoped_lock lock(_mutex);
+            if( !_callback ) {
+                return;
+            }
+            _listAddFrames.push_back(frame);
+            if( _starttime == 0 ) {
+                _starttime = timestamp;
+            }
+            RAVELOG_VERBOSE(str(boost::format("new frame %d\n")%(timestamp-_starttime)));
+            _condnewframe.notify_one();
         }
-        RAVELOG_VERBOSE(str(boost::format("new frame %d\n")%(timestamp-_starttime)));
-        _condnewframe.notify_one();
         if( _nUseSimulationTime == 2 ) {
             // calls the environment lock, which might be taken if the environment is destroying the problem
             // therefore need to take it first
@@ -356,11 +458,21 @@ protected:
         return lockenv;
     }
 
+    /// \brief returns a frame that was removed from _listAddFrames to the pool of free frames. _mutex has to be locked
+    void _RecycleFrame(boost::shared_ptr<VideoFrame> frame)
+    {
+        if( frame != _frameLastAdded && frame != _frameEncoding && _listFinishedFrames.size() < _nMaxQueuedFrames ) {
+            _listFinishedFrames.push_back(frame);
+        }
+    }
+
     void _RecordThread()
     {
+        VideoFrame* plastencoded = NULL; // frame whose image was encoded last, if it is repeated it does not have to be converted again
         while(_bContinueThread) {
             boost::shared_ptr<VideoFrame> frame;
             uint64_t numstores=0;
+            bool bkeepframe = false; // true if the frame was taken out of _listAddFrames and has to be queued again after encoding
             {
                 boost::mutex::scoped_lock lock(_mutex);
                 if( !_bContinueThread ) {
@@ -385,6 +497,7 @@ protected:
                     uint64_t lastoffset = _listAddFrames.back()->_timestamp - _starttime;
                     if( lastoffset < _frametime ) {
                         // not enough frames to predict what's coming next so wait
+                        _condnewframe.wait(lock);
                         continue;
                     }
                     list<boost::shared_ptr<VideoFrame> >::iterator itframe = _listAddFrames.begin(), itbest = _listAddFrames.end();
@@ -403,16 +516,24 @@ protected:
                     }
                     frame = *itbest;
                     size_t prevsize = _listAddFrames.size();
-                    _listAddFrames.erase(_listAddFrames.begin(),itbest);
-                    if( frame->_timestamp-_starttime <= _frametime ) {
-                        // the frame is before the next mark, so erase it
-                        _listAddFrames.erase(itbest);
+                    for(itframe = _listAddFrames.begin(); itframe != itbest; ++itframe) {
+                        _RecycleFrame(*itframe);
                     }
+                    _listAddFrames.erase(_listAddFrames.begin(),itbest);
+                    // the frame is never left in the queue while its memory is read outside of _mutex. If it is after the next
+                    // mark, it is the best candidate for the next frame too, so it is put back to the front once encoded.
+                    bkeepframe = frame->_timestamp-_starttime > _frametime;
+                    _listAddFrames.erase(itbest);
                     RAVELOG_VERBOSE(str(boost::format("frame size: %d -> %d\n")%prevsize%_listAddFrames.size()));
                     numstores = 1;
                 }
+                // the viewer thread cannot reuse the frame while it is encoded
+                _frameEncoding = frame;
+                _condframeconsumed.notify_all();
             }
 
+            bool bnewimage = !frame->_bProcessed || frame.get() != plastencoded;
+            uint64_t starttime = utils::GetMicroTime(), converttime = 0;
             if( !frame->_bProcessed ) {
                 _AddWatermarkToImage(&frame->_vimagememory.at(0), frame->_width, frame->_height, frame->_pixeldepth);
                 frame->_bProcessed = true;
@@ -420,14 +541,39 @@ protected:
 
             try {
                 _starttime += _frametime*numstores;
-                for(uint64_t i = 0; i < numstores; ++i) {
-                    _AddFrame(&frame->_vimagememory.at(0));
-                }
-                _frameLastAdded = frame;
+                _AddFrames(&frame->_vimagememory.at(0), numstores, bnewimage, converttime);
+                plastencoded = frame.get();
             }
             catch(const std::exception& ex) {
                 RAVELOG_WARN("%s\n",ex.what());
             }
+            uint64_t endtime = utils::GetMicroTime();
+
+            boost::mutex::scoped_lock lock(_mutex);
+            if( _frameEncoding != frame ) {
+                // _Reset was called while encoding, so the frame belongs to a previous recording
+                continue;
+            }
+            if( bkeepframe ) {
+                _listAddFrames.push_front(frame);
+            }
+            if( frame != _frameLastAdded ) {
+                boost::shared_ptr<VideoFrame> framelast = _frameLastAdded;
+                _frameLastAdded = frame;
+                if( !!framelast && find(_listAddFrames.begin(), _listAddFrames.end(), framelast) == _listAddFrames.end() ) {
+                    _RecycleFrame(framelast);
+                }
+            }
+            _frameEncoding.reset();
+            _nFramesEncoded += numstores;
+            if( bnewimage ) {
+                _nFramesRepeated += numstores-1;
+                _nConvertTime += converttime;
+                _nEncodeTime += endtime-starttime-converttime;
+            }
+            else {
+                _nFramesRepeated += numstores;
+            }
         }
     }
 
@@ -466,7 +612,12 @@ protected:
             _listAddFrames.clear();
             _listFinishedFrames.clear();
             _frameLastAdded.reset();
+            _frameEncoding.reset();
             _filename = "";
+            _nMaxQueuedFrames = 8;
+            _dropPolicy = FDP_DropOldest;
+            // wake up a viewer thread waiting for space in the queue
+            _condframeconsumed.notify_all();
         }
         {
             RAVELOG_DEBUG("ViewerRecorder _ResetLibrary\n");
@@ -621,12 +772,16 @@ protected:
         BOOST_ASSERT(hr == AVIERR_OK);
     }
 
-    void _AddFrame(void* pdata)
+    /// \brief writes the image numstores times, the raw images do not need to be converted
+    void _AddFrames(void* pdata, uint64_t numstores, bool bnewimage, uint64_t& converttime)
     {
         boost::mutex::scoped_lock lock(_mutexlibrary);
-        HRESULT hr = AVIStreamWrite(_psCompressed /*stream pointer*/, _nFrameCount /*time of this frame*/, 1 /*number to write*/, pdata, _biSizeImage /*size of this frame*/, AVIIF_KEYFRAME /*flags....*/, NULL, NULL);
-        BOOST_ASSERT(hr == AVIERR_OK);
-        _nFrameCount++;
+        converttime = 0;
+        for(uint64_t i = 0; i < numstores; ++i) {
+            HRESULT hr = AVIStreamWrite(_psCompressed /*stream pointer*/, _nFrameCount /*time of this frame*/, 1 /*number to write*/, pdata, _biSizeImage /*size of this frame*/, AVIIF_KEYFRAME /*flags....*/, NULL, NULL);
+            BOOST_ASSERT(hr == AVIERR_OK);
+            _nFrameCount++;
+        }
     }
 
     void _AddText(int time, char *szText)
@@ -640,17 +795,34 @@ protected:
 
     AVFormatContext *_output;
     AVStream *_stream;
-    AVFrame *_picture;
     AVFrame *_yuv420p;
     char *_picture_buf, *_outbuf;
     int _picture_size;
     int _outbuf_size;
     bool _bWroteURL, _bWroteHeader;
 
+    // parallel colorspace conversion
+    int _nConvertThreads; ///< number of threads converting an image, including _RecordThread
+    std::vector<boost::shared_ptr<boost::thread> > _vConvertWorkers; ///< started on the first parallel conversion
+    boost::mutex _mutexconvert; ///< protects the band counters
+    boost::condition _condconvertwork, _condconvertdone;
+    bool _bStopConvertWorkers;
+    bool _bConvertFailed; ///< true if a band of the image being converted failed
+    const uint8_t* _pConvertImage; ///< image being converted
+    int _nConvertBandHeight, _nConvertBands, _nNextConvertBand, _nConvertBandsDone;
+#ifdef HAVE_NEW_FFMPEG
+    std::vector<struct SwsContext*> _vConvertContexts; ///< one per band, each converts its band as a separate image. A context cannot be used by two threads at once.
+#endif
+
     void _ResetLibrary()
     {
+#ifdef HAVE_NEW_FFMPEG
+        FOREACH(itcontext, _vConvertContexts) {
+            sws_freeContext(*itcontext);
+        }
+        _vConvertContexts.clear();
+#endif
         free(_picture_buf); _picture_buf = NULL;
-        free(_picture); _picture = NULL;
         free(_yuv420p); _yuv420p = NULL;
         free(_outbuf); _outbuf = NULL;
         if( !!_stream ) {
@@ -813,10 +985,8 @@ protected:
         _bWroteHeader = true;
 
 #if LIBAVFORMAT_VERSION_INT >= (55<<16)
-        _picture = av_frame_alloc();
         _yuv420p = av_frame_alloc();
 #else
-        _picture = avcodec_alloc_frame();
         _yuv420p = avcodec_alloc_frame();
 #endif
 
@@ -839,46 +1009,185 @@ protected:
 #endif
     }
 
-    void _AddFrame(void* pdata)
+    /// \brief converts the image if it is new and encodes it numstores times
+    ///
+    /// \param converttime filled with the microseconds spent converting the image
+    void _AddFrames(void* pdata, uint64_t numstores, bool bnewimage, uint64_t& converttime)
     {
         boost::mutex::scoped_lock lock(_mutexlibrary);
+        converttime = 0;
         if( !_output ) {
             RAVELOG_DEBUG("video resources destroyed\n");
             return;
         }
-
-        // flip vertically
-        static vector<char> newdata;
-        newdata.resize(_stream->codec->height*_stream->codec->width*3);
-        char* penddata = (char*)pdata + _stream->codec->height*_stream->codec->width*3;
-
-        for(int i = 0; i < _stream->codec->height; ++i) {
-            memcpy(&newdata[i*_stream->codec->width*3], (char*)penddata - (i+1)*_stream->codec->width*3, _stream->codec->width*3);
+        if( bnewimage ) {
+            uint64_t starttime = utils::GetMicroTime();
+            _ConvertImage((const uint8_t*)pdata);
+            converttime = utils::GetMicroTime()-starttime;
         }
+        for(uint64_t i = 0; i < numstores; ++i) {
+            _EncodeFrame();
+        }
+    }
 
-        _picture->data[0] = (uint8_t*)&newdata[0];
-        _picture->linesize[0] = _stream->codec->width * 3;
+    /// \brief converts rows [y0,y1) of the bottom-up BGR24 image into _yuv420p. y0 has to be even.
+    ///
+    /// The origin of the viewer images is the bottom left corner, so the rows are read bottom-up with a negative stride.
+    void _ConvertBand(const uint8_t* pimage, int width, int height, int y0, int y1, int iband)
+    {
+        uint8_t* psrc[4] = { const_cast<uint8_t*>(pimage) + (size_t)(height-1-y0)*width*3, NULL, NULL, NULL };
+        int srcstride[4] = { -width*3, 0, 0, 0 };
+#ifdef HAVE_NEW_FFMPEG
+        uint8_t* pdst[4] = { _yuv420p->data[0] + (size_t)y0*_yuv420p->linesize[0], _yuv420p->data[1] + (size_t)(y0/2)*_yuv420p->linesize[1], _yuv420p->data[2] + (size_t)(y0/2)*_yuv420p->linesize[2], NULL };
+        int dststride[4] = { _yuv420p->linesize[0], _yuv420p->linesize[1], _yuv420p->linesize[2], 0 };
+        if( sws_scale(_vConvertContexts.at(iband), psrc, srcstride, 0, y1-y0, pdst, dststride) <= 0 ) {
+            throw OPENRAVE_EXCEPTION_FORMAT0("ADD_FRAME sws_scale failed",ORE_Assert);
+        }
+#else
+        AVPicture picture;
+        memset(&picture, 0, sizeof(picture));
+        std::copy(psrc, psrc+4, picture.data);
+        std::copy(srcstride, srcstride+4, picture.linesize);
+        if( img_convert((AVPicture*)_yuv420p, PIX_FMT_YUV420P, &picture, PIX_FMT_BGR24, width, height) ) {
+            throw OPENRAVE_EXCEPTION_FORMAT0("ADD_FRAME img_convert failed",ORE_Assert);
+        }
+#endif
+    }
 
+    /// \brief converts the image into _yuv420p. The rows are split into bands that _RecordThread and the worker threads convert in parallel.
+    ///
+    /// _mutexlibrary has to be locked, it keeps the stream and the picture valid until all bands are done.
+    void _ConvertImage(const uint8_t* pimage)
+    {
+        int width = _stream->codec->width, height = _stream->codec->height;
 #ifdef HAVE_NEW_FFMPEG
-        struct SwsContext *img_convert_ctx;
+        int numthreads = max(1, min(_nConvertThreads, height/16));
+#else
+        // img_convert can only convert whole images
+        int numthreads = 1;
+#endif
+        // several bands per thread so that a descheduled thread does not hold up the others
+        int bandheight = numthreads > 1 ? max(2, ((height + 4*numthreads-1)/(4*numthreads) + 1) & ~1) : height;
+        int numbands = (height + bandheight-1)/bandheight;
+#ifdef HAVE_NEW_FFMPEG
+        // swscale cannot start a slice in the middle of an image, so every band is converted by its own context as a separate image
+        for(size_t iband = numbands; iband < _vConvertContexts.size(); ++iband) {
+            sws_freeContext(_vConvertContexts[iband]);
+        }
+        _vConvertContexts.resize(numbands, NULL);
+        for(int iband = 0; iband < numbands; ++iband) {
+            int h = min(bandheight, height - iband*bandheight);
 #if LIBAVFORMAT_VERSION_INT >= (55<<16)
-        img_convert_ctx = sws_getContext(_stream->codec->width, _stream->codec->height, AV_PIX_FMT_BGR24, _stream->codec->width, _stream->codec->height, AV_PIX_FMT_YUV420P, SWS_BICUBIC /* flags */, NULL, NULL, NULL);
+            _vConvertContexts[iband] = sws_getCachedContext(_vConvertContexts[iband], width, h, AV_PIX_FMT_BGR24, width, h, AV_PIX_FMT_YUV420P, SWS_BICUBIC /* flags */, NULL, NULL, NULL);
 #else
-        img_convert_ctx = sws_getContext(_stream->codec->width, _stream->codec->height, PIX_FMT_BGR24, _stream->codec->width, _stream->codec->height, AV_PIX_FMT_YUV420P, SWS_BICUBIC /* flags */, NULL, NULL, NULL);
+            _vConvertContexts[iband] = sws_getCachedContext(_vConvertContexts[iband], width, h, PIX_FMT_BGR24, width, h, AV_PIX_FMT_YUV420P, SWS_BICUBIC /* flags */, NULL, NULL, NULL);
 #endif
-        if (!sws_scale(img_convert_ctx, _picture->data, _picture->linesize, 0, _stream->codec->height, _yuv420p->data, _yuv420p->linesize)) {
-            sws_freeContext(img_convert_ctx);
+            if( !_vConvertContexts[iband] ) {
+                throw OPENRAVE_EXCEPTION_FORMAT0("ADD_FRAME sws_getCachedContext failed",ORE_Assert);
+            }
+        }
+#endif
+        if( numbands <= 1 ) {
+            _ConvertBand(pimage, width, height, 0, height, 0);
+            return;
+        }
+        while( (int)_vConvertWorkers.size() < numthreads-1 ) {
+            _vConvertWorkers.push_back(boost::shared_ptr<boost::thread>(new boost::thread(boost::bind(&ViewerRecorder::_ConvertWorkerThread, this))));
+        }
+        {
+            boost::mutex::scoped_lock lock(_mutexconvert);
+            _pConvertImage = pimage;
+            _bConvertFailed = false;
+            _nConvertBandHeight = bandheight;
+            _nConvertBands = numbands;
+            _nNextConvertBand = 0;
+            _nConvertBandsDone = 0;
+            _condconvertwork.notify_all();
+        }
+        // the calling thread converts bands too
+        _ConvertBands();
+        boost::mutex::scoped_lock lock(_mutexconvert);
+        while( _nConvertBandsDone < _nConvertBands ) {
+            _condconvertdone.wait(lock);
+        }
+        _pConvertImage = NULL;
+        if( _bConvertFailed ) {
             throw OPENRAVE_EXCEPTION_FORMAT0("ADD_FRAME sws_scale failed",ORE_Assert);
         }
+    }
 
-        sws_freeContext(img_convert_ctx);
-#else
-        if( img_convert((AVPicture*)_yuv420p, PIX_FMT_YUV420P, (AVPicture*)_picture, PIX_FMT_BGR24, _stream->codec->width, _stream->codec->height) ) {
-            throw OPENRAVE_EXCEPTION_FORMAT0("ADD_FRAME img_convert failed",ORE_Assert);
+    /// \brief converts bands of _pConvertImage until none are left
+    void _ConvertBands()
+    {
+        while(1) {
+            int width, height, y0, y1, iband;
+            const uint8_t* pimage;
+            {
+                boost::mutex::scoped_lock lock(_mutexconvert);
+                if( _nNextConvertBand >= _nConvertBands ) {
+                    return;
+                }
+                // the stream is valid until the taken band is done
+                width = _stream->codec->width;
+                height = _stream->codec->height;
+                iband = _nNextConvertBand;
+                y0 = iband*_nConvertBandHeight;
+                y1 = min(height, y0 + _nConvertBandHeight);
+                pimage = _pConvertImage;
+                _nNextConvertBand++;
+            }
+            bool bsuccess = true;
+            try {
+                _ConvertBand(pimage, width, height, y0, y1, iband);
+            }
+            catch(const std::exception& ex) {
+                // reported by _ConvertImage, the other bands are still counted so that it does not wait forever
+                RAVELOG_WARN_FORMAT("failed to convert band %d: %s", iband%ex.what());
+                bsuccess = false;
+            }
+            boost::mutex::scoped_lock lock(_mutexconvert);
+            if( !bsuccess ) {
+                _bConvertFailed = true;
+            }
+            if( ++_nConvertBandsDone == _nConvertBands ) {
+                _condconvertdone.notify_all();
+            }
         }
-#endif
+    }
+
+    void _ConvertWorkerThread()
+    {
+        while(1) {
+            {
+                boost::mutex::scoped_lock lock(_mutexconvert);
+                while( !_bStopConvertWorkers && _nNextConvertBand >= _nConvertBands ) {
+                    _condconvertwork.wait(lock);
+                }
+                if( _bStopConvertWorkers ) {
+                    return;
+                }
+            }
+            _ConvertBands();
+        }
+    }
 
+    void _StopConvertWorkers()
+    {
+        {
+            boost::mutex::scoped_lock lock(_mutexconvert);
+            _bStopConvertWorkers = true;
+            _condconvertwork.notify_all();
+        }
+        FOREACH(itworker, _vConvertWorkers) {
+            (*itworker)->join();
+        }
+        _vConvertWorkers.clear();
+        _bStopConvertWorkers = false;
+    }
 
+    /// \brief encodes the picture in _yuv420p as the next frame
+    void _EncodeFrame()
+    {
 #if LIBAVFORMAT_VERSION_INT >= (54<<16)
         int got_packet = 0;
         AVPacket pkt;
@@ -719,7 +719,7 @@ public:
             return false;
         }
 
-        int adjacentoptions = KinBody::AO_Enabled;
+        int adjacentoptions = KinBody::AO_Enabled|KinBody::AO_SampledColliding;
         if( (_options&OpenRAVE::CO_ActiveDOFs) && pbody->IsRobot() ) {
             adjacentoptions |= KinBody::AO_ActiveDOFs;
         }
@@ -776,7 +776,7 @@ public:
             return false;
         }
 
-        int adjacentoptions = KinBody::AO_Enabled;
+        int adjacentoptions = KinBody::AO_Enabled|KinBody::AO_SampledColliding;
         if( (_options&OpenRAVE::CO_ActiveDOFs) && pbody->IsRobot() ) {
             adjacentoptions |= KinBody::AO_ActiveDOFs;
         }
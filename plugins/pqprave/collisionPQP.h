@@ -48,6 +48,7 @@ public:
         _rel_err = 200.0;     //temporary change
         _abs_err = 0.001;       //temporary change
         _tolerance = 0.0;
+        _options = 0;
 
         //enable or disable various features
         _benablecol = true;
@@ -364,7 +365,7 @@ public:
             report->Reset(_options);
         }
         _InitKinBody(pbody);
-        int adjacentoptions = KinBody::AO_Enabled;
+        int adjacentoptions = KinBody::AO_Enabled|KinBody::AO_SampledColliding;
         if( (_options&OpenRAVE::CO_ActiveDOFs) && pbody->IsRobot() ) {
             adjacentoptions |= KinBody::AO_ActiveDOFs;
         }
@@ -389,7 +390,7 @@ public:
             report->Reset(_options);
         }
         _SetActiveBody(plink->GetParent());
-        int adjacentoptions = KinBody::AO_Enabled;
+        int adjacentoptions = KinBody::AO_Enabled|KinBody::AO_SampledColliding;
         if( (_options&OpenRAVE::CO_ActiveDOFs) && pbody->IsRobot() ) {
             adjacentoptions |= KinBody::AO_ActiveDOFs;
         }
@@ -0,0 +1,496 @@
+// -*- coding: utf-8 -*-
+// Copyright (C) 2006-2012 Rosen Diankov <rosen.diankov@gmail.com>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#include "plugindefs.h"
+
+#include <boost/thread/thread.hpp>
+#include <cstdio>
+
+// kdtree_single_index.h uses the flann logger and distances without including them
+#include <flann/util/logger.h>
+#include <flann/algorithms/dist.h>
+#include <flann/algorithms/kdtree_single_index.h>
+
+/// \brief exact fixed radius neighbor queries of D-dimensional points with the single kd-tree of the bundled flann.
+///
+/// The ANN kd-trees used by pyANN keep the query state in global variables, so they cannot be searched from
+/// several threads. The flann tree only updates a leaf counter when searched, so every thread searches its own
+/// KDTreeIndex built over the same points. Building the tree shuffles the points with std::rand.
+template <int D>
+class KDTreeIndex
+{
+public:
+    /// \param vpoints flattened array of D-dimensional points, has to outlive the index
+    void Init(const std::vector<dReal>& vpoints)
+    {
+        _pindex.reset();
+        if( vpoints.size() >= D ) {
+            flann::Matrix<dReal> dataset(const_cast<dReal*>(&vpoints[0]), vpoints.size()/D, D);
+            _pindex.reset(new flann::KDTreeSingleIndex< flann::L2<dReal> >(dataset, flann::KDTreeSingleIndexParams(10)));
+            _pindex->buildIndex();
+        }
+    }
+
+    /// \brief appends all points with squared distance < fradiussqr to vneighbors
+    void RadiusSearch(const dReal* pquery, dReal fradiussqr, std::vector<int>& vneighbors)
+    {
+        if( !!_pindex ) {
+            RadiusResultSet resultset(fradiussqr, vneighbors);
+            _pindex->findNeighbors(resultset, pquery, flann::SearchParams());
+        }
+    }
+
+protected:
+    /// \brief the result set of flann copies to preallocated arrays, so appends to a vector instead
+    class RadiusResultSet : public flann::ResultSet<dReal>
+    {
+public:
+        RadiusResultSet(dReal fradiussqr, std::vector<int>& vneighbors) : _fradiussqr(fradiussqr), _vneighbors(vneighbors) {
+        }
+        bool full() const {
+            return true;
+        }
+        void addPoint(dReal dist, int index) {
+            if( dist < _fradiussqr ) {
+                _vneighbors.push_back(index);
+            }
+        }
+        dReal worstDist() const {
+            return _fradiussqr;
+        }
+
+        dReal _fradiussqr;
+        std::vector<int>& _vneighbors;
+    };
+
+    boost::shared_ptr< flann::KDTreeSingleIndex< flann::L2<dReal> > > _pindex;
+};
+
+/// \brief computes the equivalence classes of the inverse reachability database.
+///
+/// Does the nearest neighbor heavy part of InverseReachabilityModel.generate, the statistics of every class are
+/// still computed in python.
+class InverseReachabilityModule : public ModuleBase
+{
+public:
+    InverseReachabilityModule(EnvironmentBasePtr penv) : ModuleBase(penv)
+    {
+        __description = ":Interface Author: Rosen Diankov\n\nClusters the reachable poses of a manipulator into inverse reachability equivalence classes. Used by the inversereachability python database.";
+        RegisterCommand("ComputeEquivalenceClasses",boost::bind(&InverseReachabilityModule::ComputeEquivalenceClassesCommand,this,_1,_2),
+                        "Clusters the robot base poses modulo rotation around the z-axis and xy translation. Parameters:\n\n\
+- posesfile - binary file of N*8 float64 values, every row is the quaternion and translation of the base with respect to the end effector followed by the number of solutions\n\n\
+- numposes - N\n\n\
+- heightthresh - height threshold of a class (default is 0.05)\n\n\
+- quatthresh - rotation threshold of a class (default is 0.15)\n\n\
+- numthreads - number of threads to compute the density of the poses with (default is 1)\n\n\
+- filename - file to write the classes to. Every class is an int32 count followed by the int32 indices of its poses sorted by density.\n\n\
+Returns the number of classes.");
+    }
+
+    virtual ~InverseReachabilityModule() {
+    }
+
+    int main(const std::string& cmd)
+    {
+        return 0;
+    }
+
+protected:
+    bool ComputeEquivalenceClassesCommand(std::ostream& sout, std::istream& sinput)
+    {
+        std::string posesfile, filename, cmd;
+        size_t numposes = 0;
+        dReal heightthresh = 0.05, quatthresh = 0.15;
+        int numthreads = 1;
+        while(!sinput.eof()) {
+            sinput >> cmd;
+            if( !sinput ) {
+                break;
+            }
+            std::transform(cmd.begin(), cmd.end(), cmd.begin(), ::tolower);
+
+            if( cmd == "posesfile" ) {
+                sinput >> posesfile;
+            }
+            else if( cmd == "numposes" ) {
+                sinput >> numposes;
+            }
+            else if( cmd == "heightthresh" ) {
+                sinput >> heightthresh;
+            }
+            else if( cmd == "quatthresh" ) {
+                sinput >> quatthresh;
+            }
+            else if( cmd == "numthreads" ) {
+                sinput >> numthreads;
+            }
+            else if( cmd == "filename" ) {
+                sinput >> filename;
+            }
+            else {
+                RAVELOG_WARN(str(boost::format("unrecognized command: %s\n")%cmd));
+                break;
+            }
+
+            if( !sinput ) {
+                RAVELOG_ERROR(str(boost::format("failed processing command %s\n")%cmd));
+                return false;
+            }
+        }
+
+        if( posesfile.size() == 0 || filename.size() == 0 || numposes == 0 ) {
+            return false;
+        }
+        std::vector<double> vposes(numposes*8);
+        FILE* f = fopen(posesfile.c_str(),"rb");
+        if( !f ) {
+            RAVELOG_WARN(str(boost::format("failed to open %s\n")%posesfile));
+            return false;
+        }
+        size_t numread = fread(&vposes[0],sizeof(double),vposes.size(),f);
+        fclose(f);
+        if( numread != vposes.size() ) {
+            RAVELOG_WARN(str(boost::format("%s has %d values, expected %d\n")%posesfile%numread%vposes.size()));
+            return false;
+        }
+
+        uint32_t starttime = utils::GetMilliTime();
+        // same metric as kinematicreachability.ReachabilityModel.QuaternionKDTree, every pose is added twice with q and -q
+        dReal transmult = quatthresh/heightthresh;
+        dReal quateucdist2 = (1-RaveCos(quatthresh))*(1-RaveCos(quatthresh)) + RaveSin(quatthresh)*RaveSin(quatthresh);
+        std::vector<dReal> vsearchposes(2*numposes*5);
+        for(size_t i = 0; i < numposes; ++i) {
+            for(int j = 0; j < 4; ++j) {
+                vsearchposes[5*i+j] = vposes[8*i+j];
+                vsearchposes[5*(numposes+i)+j] = -vposes[8*i+j];
+            }
+            vsearchposes[5*i+4] = vsearchposes[5*(numposes+i)+4] = vposes[8*i+6]*transmult;
+        }
+
+        // density of every pose, computed in parallel since every pose is independent
+        std::vector<int> vdensity(numposes,0);
+        numthreads = max(1,numthreads);
+        std::vector<boost::shared_ptr<boost::thread> > listthreads(numthreads);
+        for(int i = 0; i < numthreads; ++i) {
+            listthreads[i].reset(new boost::thread(boost::bind(&InverseReachabilityModule::_ComputeDensityThread, boost::cref(vsearchposes), 0.25*quateucdist2, (numposes*i)/numthreads, (numposes*(i+1))/numthreads, boost::ref(vdensity))));
+        }
+        FOREACH(itthread,listthreads) {
+            (*itthread)->join();
+        }
+        listthreads.clear();
+
+        std::vector< std::pair<int, int> > vorder(numposes);
+        for(size_t i = 0; i < numposes; ++i) {
+            vorder[i] = make_pair(-vdensity[i], (int)i);
+        }
+        std::sort(vorder.begin(), vorder.end());
+        std::vector<int> vrank(numposes);
+        for(size_t i = 0; i < numposes; ++i) {
+            vrank[vorder[i].second] = (int)i;
+        }
+
+        std::vector<Vector> vquatrolls;
+        for(dReal roll = 0; roll < 2*PI; roll += quatthresh*0.5) {
+            vquatrolls.push_back(quatFromAxisAngle(Vector(0,0,1),roll));
+        }
+
+        // every class starts from the densest pose not yet assigned
+        KDTreeIndex<5> kdtree;
+        kdtree.Init(vsearchposes);
+        std::vector<uint8_t> vassigned(numposes,0);
+        std::vector< std::vector<int> > vclasses;
+        std::vector<int> vneighbors;
+        dReal querypoint[5];
+        size_t numassigned = 0;
+        FOREACHC(itorder, vorder) {
+            int seedindex = itorder->second;
+            if( vassigned[seedindex] ) {
+                continue;
+            }
+            Vector qseed(vposes[8*seedindex+0], vposes[8*seedindex+1], vposes[8*seedindex+2], vposes[8*seedindex+3]);
+            vclasses.push_back(std::vector<int>());
+            std::vector<int>& vclass = vclasses.back();
+            FOREACHC(itroll, vquatrolls) {
+                Vector q = quatMultiply(*itroll, qseed);
+                querypoint[0] = q.x; querypoint[1] = q.y; querypoint[2] = q.z; querypoint[3] = q.w;
+                querypoint[4] = vsearchposes[5*seedindex+4];
+                vneighbors.resize(0);
+                kdtree.RadiusSearch(querypoint, quateucdist2, vneighbors);
+                FOREACHC(itneigh, vneighbors) {
+                    int index = *itneigh >= (int)numposes ? *itneigh-(int)numposes : *itneigh;
+                    if( !vassigned[index] ) {
+                        vassigned[index] = 1;
+                        vclass.push_back(index);
+                    }
+                }
+            }
+            // same order as the python generator, which keeps the poses sorted by density
+            std::vector< std::pair<int,int> > vsorted(vclass.size());
+            for(size_t i = 0; i < vclass.size(); ++i) {
+                vsorted[i] = make_pair(vrank[vclass[i]], vclass[i]);
+            }
+            std::sort(vsorted.begin(), vsorted.end());
+            for(size_t i = 0; i < vclass.size(); ++i) {
+                vclass[i] = vsorted[i].second;
+            }
+            numassigned += vclass.size();
+            RAVELOG_DEBUG(str(boost::format("new equivalence class: %d, left over trans: %d")%vclass.size()%(numposes-numassigned)));
+        }
+        RAVELOG_INFO(str(boost::format("computed %d equivalence classes of %d poses in %fs\n")%vclasses.size()%numposes%(0.001*(utils::GetMilliTime()-starttime))));
+
+        f = fopen(filename.c_str(),"wb");
+        if( !f ) {
+            RAVELOG_WARN(str(boost::format("failed to open %s for writing\n")%filename));
+            return false;
+        }
+        FOREACHC(itclass, vclasses) {
+            int32_t num = (int32_t)itclass->size();
+            fwrite(&num,sizeof(num),1,f);
+            std::vector<int32_t> vindices(itclass->begin(), itclass->end());
+            fwrite(&vindices[0],sizeof(int32_t),vindices.size(),f);
+        }
+        fclose(f);
+        sout << vclasses.size();
+        return true;
+    }
+
+    static void _ComputeDensityThread(const std::vector<dReal>& vsearchposes, dReal fradiussqr, size_t startindex, size_t endindex, std::vector<int>& vdensity)
+    {
+        KDTreeIndex<5> kdtree;
+        kdtree.Init(vsearchposes);
+        std::vector<int> vneighbors;
+        for(size_t i = startindex; i < endindex; ++i) {
+            vneighbors.resize(0);
+            kdtree.RadiusSearch(&vsearchposes[5*i], fradiussqr, vneighbors);
+            vdensity[i] = (int)vneighbors.size();
+        }
+    }
+};
+
+/// \brief samples robot base placements from the aggregate inverse reachability distribution of a set of grasps.
+class BasePlacementSampler : public SpaceSamplerBase
+{
+public:
+    BasePlacementSampler(EnvironmentBasePtr penv, std::istream& sinput) : SpaceSamplerBase(penv), _rotweight(1), _baseheight(0), _bandwidthweight(1), _fsearchradiussqr(0)
+    {
+        _vbandwidth[0] = _vbandwidth[1] = _vbandwidth[2] = 0;
+        __description = ":Interface Author: Rosen Diankov\n\n\
+Samples robot base placements from the inverse reachability distribution computed by InverseReachabilityModel.computeAggregateBaseDistribution. Every sample is 8 values: the quaternion and translation of the robot followed by the index of the grasp it was sampled for.\n\n\
+The distribution is set with the SetDistribution command. When creating can pass the name of the uniform sampler to use, default is 'mt19937'.\n";
+        RegisterCommand("SetDistribution",boost::bind(&BasePlacementSampler::SetDistributionCommand,this,_1,_2),
+                        "Sets the kernel density. Parameters:\n\n\
+- rotweight - weight of the z angle with respect to xy offset\n\n\
+- bandwidth - 3 values for the kernel bandwidth of the z angle, x and y\n\n\
+- robotpose - 7 values, pose of the robot with respect to the manipulator base\n\n\
+- baseheight - z of the manipulator base\n\n\
+- points N - N points of (zangle, x, y, weight, graspindex)\n");
+        RegisterCommand("SetBandwidthWeight",boost::bind(&BasePlacementSampler::SetBandwidthWeightCommand,this,_1,_2),
+                        "Multiplies the kernel bandwidth when sampling (default is 1).");
+        RegisterCommand("ComputeDensity",boost::bind(&BasePlacementSampler::ComputeDensityCommand,this,_1,_2),
+                        "Given N followed by N robot poses (quaternion and translation), returns the kernel density of every pose.");
+        std::string samplername;
+        sinput >> samplername;
+        if( samplername.size() == 0 ) {
+            samplername = "mt19937";
+        }
+        _psampler = RaveCreateSpaceSampler(penv,samplername);
+    }
+
+    void SetSeed(uint32_t seed) {
+        _psampler->SetSeed(seed);
+    }
+
+    void SetSpaceDOF(int dof) {
+        BOOST_ASSERT(dof==8);
+    }
+    int GetDOF() const {
+        return 8;
+    }
+    int GetNumberOfValues() const {
+        return 8;
+    }
+    /// \brief only supports real samples once SetDistribution has been called
+    bool Supports(SampleDataType type) const {
+        return !!_psampler && type==SDT_Real && _vcumweights.size() > 0;
+    }
+
+    void GetLimits(std::vector<dReal>& vLowerLimit, std::vector<dReal>& vUpperLimit) const
+    {
+        vLowerLimit.resize(8);
+        vUpperLimit.resize(8);
+        for(int i = 0; i < 4; ++i) {
+            vLowerLimit[i] = -1;
+            vUpperLimit[i] = 1;
+        }
+        for(int i = 0; i < 3; ++i) {
+            vLowerLimit[4+i] = -std::numeric_limits<dReal>::infinity();
+            vUpperLimit[4+i] = std::numeric_limits<dReal>::infinity();
+        }
+        vLowerLimit[7] = 0;
+        vUpperLimit[7] = _vgraspindices.size() > 0 ? *max_element(_vgraspindices.begin(),_vgraspindices.end()) : 0;
+    }
+
+    int SampleSequence(std::vector<dReal>& samples, size_t num=1,IntervalType interval=IT_Closed)
+    {
+        if( _vcumweights.size() == 0 ) {
+            return 0;
+        }
+        samples.resize(8*num);
+        for(size_t inum = 0; inum < num; ++inum) {
+            dReal r = _psampler->SampleSequenceOneReal(IT_OpenEnd);
+            size_t pointindex = std::upper_bound(_vcumweights.begin(), _vcumweights.end(), r*_vcumweights.back()) - _vcumweights.begin();
+            pointindex = min(pointindex, _vcumweights.size()-1);
+            dReal sample[3];
+            for(int j = 0; j < 3; ++j) {
+                sample[j] = _vpoints[3*pointindex+j] + _SampleNormal()*_vbandwidth[j]*_bandwidthweight;
+            }
+            dReal halfangle = sample[0]*0.5/_rotweight;
+            Transform t = _trobot * Transform(Vector(RaveCos(halfangle),0,0,RaveSin(halfangle)), Vector(sample[1],sample[2],_baseheight));
+            samples[8*inum+0] = t.rot.x; samples[8*inum+1] = t.rot.y; samples[8*inum+2] = t.rot.z; samples[8*inum+3] = t.rot.w;
+            samples[8*inum+4] = t.trans.x; samples[8*inum+5] = t.trans.y; samples[8*inum+6] = t.trans.z;
+            samples[8*inum+7] = _vgraspindices[pointindex];
+        }
+        return (int)num;
+    }
+
+protected:
+    bool SetDistributionCommand(std::ostream& sout, std::istream& sinput)
+    {
+        std::string cmd;
+        std::vector<dReal> vpoints, vweights;
+        std::vector<int> vgraspindices;
+        dReal vbandwidth[3] = {_vbandwidth[0], _vbandwidth[1], _vbandwidth[2]};
+        while(!sinput.eof()) {
+            sinput >> cmd;
+            if( !sinput ) {
+                break;
+            }
+            std::transform(cmd.begin(), cmd.end(), cmd.begin(), ::tolower);
+
+            if( cmd == "rotweight" ) {
+                sinput >> _rotweight;
+            }
+            else if( cmd == "bandwidth" ) {
+                sinput >> vbandwidth[0] >> vbandwidth[1] >> vbandwidth[2];
+            }
+            else if( cmd == "robotpose" ) {
+                sinput >> _trobot.rot.x >> _trobot.rot.y >> _trobot.rot.z >> _trobot.rot.w >> _trobot.trans.x >> _trobot.trans.y >> _trobot.trans.z;
+            }
+            else if( cmd == "baseheight" ) {
+                sinput >> _baseheight;
+            }
+            else if( cmd == "points" ) {
+                size_t numpoints = 0;
+                sinput >> numpoints;
+                vpoints.resize(3*numpoints);
+                vweights.resize(numpoints);
+                vgraspindices.resize(numpoints);
+                for(size_t i = 0; i < numpoints; ++i) {
+                    sinput >> vpoints[3*i+0] >> vpoints[3*i+1] >> vpoints[3*i+2] >> vweights[i] >> vgraspindices[i];
+                }
+            }
+            else {
+                RAVELOG_WARN(str(boost::format("unrecognized command: %s\n")%cmd));
+                break;
+            }
+
+            if( !sinput ) {
+                RAVELOG_ERROR(str(boost::format("failed processing command %s\n")%cmd));
+                return false;
+            }
+        }
+        for(int j = 0; j < 3; ++j) {
+            // a zero bandwidth would divide by zero in the kernel
+            if( !(vbandwidth[j] > 0) ) {
+                throw OPENRAVE_EXCEPTION_FORMAT("bandwidth %f of dimension %d has to be positive", vbandwidth[j]%j, ORE_InvalidArguments);
+            }
+        }
+        std::copy(vbandwidth, vbandwidth+3, _vbandwidth);
+
+        _vpoints.swap(vpoints);
+        _vgraspindices.swap(vgraspindices);
+        _vweights.swap(vweights);
+        _vcumweights.resize(_vweights.size());
+        dReal fcum = 0;
+        for(size_t i = 0; i < _vweights.size(); ++i) {
+            // points are stored with the angle scaled by rotweight, same as the python kernel density
+            _vpoints[3*i] *= _rotweight;
+            fcum += _vweights[i];
+            _vcumweights[i] = fcum;
+        }
+        _fsearchradiussqr = 9*(_vbandwidth[0]*_vbandwidth[0]+_vbandwidth[1]*_vbandwidth[1]+_vbandwidth[2]*_vbandwidth[2]);
+        _kdtree.Init(_vpoints);
+        return true;
+    }
+
+    bool SetBandwidthWeightCommand(std::ostream& sout, std::istream& sinput)
+    {
+        sinput >> _bandwidthweight;
+        return !!sinput;
+    }
+
+    bool ComputeDensityCommand(std::ostream& sout, std::istream& sinput)
+    {
+        size_t numposes = 0;
+        sinput >> numposes;
+        std::vector<int> vneighbors;
+        for(size_t i = 0; i < numposes; ++i) {
+            Transform t;
+            sinput >> t.rot.x >> t.rot.y >> t.rot.z >> t.rot.w >> t.trans.x >> t.trans.y >> t.trans.z;
+            if( !sinput ) {
+                return false;
+            }
+            // same as openravepy_ext.normalizeZRotation
+            dReal query[3] = { 2*RaveAtan2(t.rot.w,t.rot.x)*_rotweight, t.trans.x, t.trans.y };
+            vneighbors.resize(0);
+            _kdtree.RadiusSearch(query, _fsearchradiussqr, vneighbors);
+            dReal prob = 0;
+            FOREACHC(itindex, vneighbors) {
+                dReal fexp = 0;
+                for(int j = 0; j < 3; ++j) {
+                    dReal f = _vpoints[3*(*itindex)+j]-query[j];
+                    fexp += -0.5*f*f/(_vbandwidth[j]*_vbandwidth[j]);
+                }
+                prob += _vweights[*itindex]*RaveExp(fexp);
+            }
+            sout << prob << " ";
+        }
+        return true;
+    }
+
+    /// \brief box-muller transform of the uniform samples
+    dReal _SampleNormal()
+    {
+        dReal u1 = _psampler->SampleSequenceOneReal(IT_OpenStart);
+        dReal u2 = _psampler->SampleSequenceOneReal(IT_Closed);
+        return RaveSqrt(-2*RaveLog(u1))*RaveCos(2*PI*u2);
+    }
+
+    SpaceSamplerBasePtr _psampler;
+    std::vector<dReal> _vpoints, _vweights, _vcumweights;
+    std::vector<int> _vgraspindices;
+    KDTreeIndex<3> _kdtree;
+    Transform _trobot;
+    dReal _vbandwidth[3];
+    dReal _rotweight, _baseheight, _bandwidthweight, _fsearchradiussqr;
+};
+
+ModuleBasePtr CreateInverseReachabilityModule(EnvironmentBasePtr penv) {
+    return ModuleBasePtr(new InverseReachabilityModule(penv));
+}
+
+SpaceSamplerBasePtr CreateBasePlacementSampler(EnvironmentBasePtr penv, std::istream& sinput) {
+    return SpaceSamplerBasePtr(new BasePlacementSampler(penv,sinput));
+}
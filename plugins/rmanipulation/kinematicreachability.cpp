@@ -0,0 +1,388 @@
+// -*- coding: utf-8 -*-
+// Copyright (C) 2006-2012 Rosen Diankov <rosen.diankov@gmail.com>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#include "plugindefs.h"
+
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <cstdio>
+
+/// \brief computes the 6D reachability map of a manipulator with a pool of threads working on cloned environments.
+///
+/// The results are written in a flat binary file so that python can read them with numpy.fromfile and store them
+/// directly into the hdf5 database. The layout in host byte order is:
+///
+/// - char[8] magic "ORREACH"
+/// - uint32 version
+/// - uint32 shape[3]
+/// - uint64 numstats
+/// - float64 pointscale[2]
+/// - float64 reachabilitydensity3d[shape[0]*shape[1]*shape[2]]
+/// - float64 reachability3d[shape[0]*shape[1]*shape[2]]
+/// - float64 reachabilitystats[numstats][8] (quaternion, translation, number of solutions)
+class KinematicReachability : public ModuleBase
+{
+    struct ReachabilityParameters
+    {
+        ReachabilityParameters() : usefreespace(false), xyzdelta(0.04), maxradius(0), nsteps(0) {
+        }
+        std::string robotname, manipname;
+        std::vector<Vector> vrotations; ///< quaternions to test at every point
+        bool usefreespace;
+        dReal xyzdelta, maxradius;
+        int nsteps;
+        Transform trobot; ///< robot transform that places the manipulator base at the origin
+        Vector baseanchor;
+        std::vector<int> venabledlinks; ///< link indices to enable, all others are disabled
+        std::vector<int> vinsideinds; ///< indices of the grid points within maxradius
+    };
+    typedef boost::shared_ptr<ReachabilityParameters> ReachabilityParametersPtr;
+
+    /// \brief per-point results
+    struct PointResult
+    {
+        PointResult() : numvalid(0), numrotvalid(0) {
+        }
+        std::vector<dReal> vstats; ///< 8 values for every reachable rotation
+        int numvalid, numrotvalid;
+    };
+
+public:
+    KinematicReachability(EnvironmentBasePtr penv) : ModuleBase(penv)
+    {
+        __description = ":Interface Author: Rosen Diankov\n\nComputes the kinematic reachability map of a manipulator natively. Used by the kinematicreachability python database.";
+        RegisterCommand("ComputeReachability",boost::bind(&KinematicReachability::ComputeReachabilityCommand,this,_1,_2),
+                        "Computes the reachability of a manipulator by sampling a translation grid and a set of rotations. Parameters:\n\n\
+- robot - name of the robot\n\n\
+- manipname - name of the manipulator, if not specified uses the active manipulator\n\n\
+- xyzdelta - discretization of the translation grid (default is 0.04)\n\n\
+- maxradius - maximum radius of the grid, if <= 0 computes it from the arm length\n\n\
+- rotations N q0 ... - N quaternions (w,x,y,z) to test at every grid point\n\n\
+- usefreespace - if 1, counts all IK solutions at every pose instead of finding only one\n\n\
+- numthreads - number of worker threads, each with its own cloned environment (default is 1)\n\n\
+- filename - file to write the binary results to\n\n\
+Returns the number of grid points, the grid shape, the number of reachable poses, and maxradius.");
+    }
+
+    virtual ~KinematicReachability() {
+    }
+
+    int main(const std::string& cmd)
+    {
+        return 0;
+    }
+
+protected:
+    bool ComputeReachabilityCommand(std::ostream& sout, std::istream& sinput)
+    {
+        ReachabilityParametersPtr params(new ReachabilityParameters());
+        int numthreads = 1;
+        std::string filename, cmd;
+        while(!sinput.eof()) {
+            sinput >> cmd;
+            if( !sinput ) {
+                break;
+            }
+            std::transform(cmd.begin(), cmd.end(), cmd.begin(), ::tolower);
+
+            if( cmd == "robot" ) {
+                sinput >> params->robotname;
+            }
+            else if( cmd == "manipname" ) {
+                sinput >> params->manipname;
+            }
+            else if( cmd == "xyzdelta" ) {
+                sinput >> params->xyzdelta;
+            }
+            else if( cmd == "maxradius" ) {
+                sinput >> params->maxradius;
+            }
+            else if( cmd == "rotations" ) {
+                int numrotations = 0;
+                sinput >> numrotations;
+                params->vrotations.resize(numrotations);
+                FOREACH(it,params->vrotations) {
+                    sinput >> it->x >> it->y >> it->z >> it->w;
+                }
+            }
+            else if( cmd == "usefreespace" ) {
+                sinput >> params->usefreespace;
+            }
+            else if( cmd == "numthreads" ) {
+                sinput >> numthreads;
+            }
+            else if( cmd == "filename" ) {
+                sinput >> filename;
+            }
+            else {
+                RAVELOG_WARN(str(boost::format("unrecognized command: %s\n")%cmd));
+                break;
+            }
+
+            if( !sinput ) {
+                RAVELOG_ERROR(str(boost::format("failed processing command %s\n")%cmd));
+                return false;
+            }
+        }
+
+        if( filename.size() == 0 || params->xyzdelta <= 0 ) {
+            return false;
+        }
+        if( params->vrotations.size() == 0 ) {
+            params->vrotations.push_back(Vector(1,0,0,0));
+        }
+        numthreads = max(1,numthreads);
+
+        std::vector<EnvironmentBasePtr> vcloneenvs(numthreads);
+        {
+            EnvironmentMutex::scoped_lock lock(GetEnv()->GetMutex());
+            RobotBasePtr probot = GetEnv()->GetRobot(params->robotname);
+            if( !probot ) {
+                RAVELOG_WARN(str(boost::format("could not find robot %s\n")%params->robotname));
+                return false;
+            }
+            RobotBase::ManipulatorPtr pmanip = params->manipname.size() > 0 ? probot->GetManipulator(params->manipname) : probot->GetActiveManipulator();
+            if( !pmanip || !pmanip->GetIkSolver() ) {
+                RAVELOG_WARN(str(boost::format("robot %s has no manipulator %s with an ik solver\n")%params->robotname%params->manipname));
+                return false;
+            }
+            params->manipname = pmanip->GetName();
+            if( !_InitParameters(probot, pmanip, params) ) {
+                return false;
+            }
+
+            // clone the environment in the original state since the workers set their own transforms
+            FOREACH(itenv, vcloneenvs) {
+                *itenv = GetEnv()->CloneSelf(Clone_Bodies);
+            }
+        }
+
+        RAVELOG_INFO(str(boost::format("radius: %f, xyzsamples: %d, rot samples: %d, freespace: %d, threads: %d\n")%params->maxradius%params->vinsideinds.size()%params->vrotations.size()%params->usefreespace%numthreads));
+
+        std::vector<PointResult> vresults(params->vinsideinds.size());
+        _nextindex = 0;
+        uint32_t starttime = utils::GetMilliTime();
+        std::vector<boost::shared_ptr<boost::thread> > listthreads(numthreads);
+        for(int i = 0; i < numthreads; ++i) {
+            listthreads[i].reset(new boost::thread(boost::bind(&KinematicReachability::_WorkerThread,this,params,vcloneenvs[i],boost::ref(vresults))));
+        }
+        FOREACH(itthread,listthreads) {
+            (*itthread)->join();
+        }
+        listthreads.clear();
+        FOREACH(itenv, vcloneenvs) {
+            (*itenv)->Destroy();
+        }
+        vcloneenvs.clear();
+        RAVELOG_INFO(str(boost::format("computed reachability of %d points in %fs\n")%vresults.size()%(0.001*(utils::GetMilliTime()-starttime))));
+
+        // gather in the order of the grid points so the results do not depend on the thread scheduling
+        uint32_t gridsize = 2*params->nsteps;
+        uint32_t shape[3] = {gridsize, gridsize, gridsize};
+        size_t numgrid = (size_t)gridsize*gridsize*gridsize;
+        std::vector<double> vdensity(numgrid,0), vreachability(numgrid,0);
+        uint64_t numstats = 0;
+        for(size_t i = 0; i < vresults.size(); ++i) {
+            vdensity.at(params->vinsideinds[i]) = vresults[i].numvalid/double(params->vrotations.size());
+            vreachability.at(params->vinsideinds[i]) = vresults[i].numrotvalid/double(params->vrotations.size());
+            numstats += vresults[i].vstats.size()/8;
+        }
+
+        FILE* f = fopen(filename.c_str(),"wb");
+        if( !f ) {
+            RAVELOG_WARN(str(boost::format("failed to open %s for writing\n")%filename));
+            return false;
+        }
+        char magic[8] = {'O','R','R','E','A','C','H',0};
+        uint32_t version = 1;
+        double pointscale[2] = { 1.0/params->xyzdelta, double(params->nsteps) };
+        fwrite(magic,sizeof(magic),1,f);
+        fwrite(&version,sizeof(version),1,f);
+        fwrite(shape,sizeof(shape),1,f);
+        fwrite(&numstats,sizeof(numstats),1,f);
+        fwrite(pointscale,sizeof(pointscale),1,f);
+        fwrite(&vdensity[0],sizeof(double),vdensity.size(),f);
+        fwrite(&vreachability[0],sizeof(double),vreachability.size(),f);
+        std::vector<double> vstats;
+        FOREACHC(itresult, vresults) {
+            if( itresult->vstats.size() > 0 ) {
+                vstats.assign(itresult->vstats.begin(),itresult->vstats.end());
+                fwrite(&vstats[0],sizeof(double),vstats.size(),f);
+            }
+        }
+        fclose(f);
+
+        sout << vresults.size() << " " << shape[0] << " " << shape[1] << " " << shape[2] << " " << numstats << " " << params->maxradius;
+        return true;
+    }
+
+    /// \brief sets the robot in the same state as kinematicreachability.py and computes the grid points
+    bool _InitParameters(RobotBasePtr probot, RobotBase::ManipulatorPtr pmanip, ReachabilityParametersPtr params)
+    {
+        RobotBase::RobotStateSaver saver(probot);
+        Transform tbase = pmanip->GetBase()->GetTransform();
+        params->trobot = tbase.inverse()*probot->GetTransform();
+        probot->SetTransform(params->trobot);
+
+        std::vector<KinBody::LinkPtr> vmaniplinks;
+        _GetManipulatorLinks(pmanip, vmaniplinks);
+        FOREACHC(itlink, vmaniplinks) {
+            params->venabledlinks.push_back((*itlink)->GetIndex());
+        }
+
+        std::vector<KinBody::JointPtr> varmjoints;
+        FOREACHC(itjoint, probot->GetDependencyOrderedJoints()) {
+            if( find(pmanip->GetArmIndices().begin(),pmanip->GetArmIndices().end(),(*itjoint)->GetJointIndex()) != pmanip->GetArmIndices().end() ) {
+                varmjoints.push_back(*itjoint);
+            }
+        }
+        if( varmjoints.size() == 0 ) {
+            RAVELOG_WARN(str(boost::format("manipulator %s has no arm joints\n")%pmanip->GetName()));
+            return false;
+        }
+        params->baseanchor = varmjoints.at(0)->GetAnchor();
+        if( params->maxradius <= 0 ) {
+            // the best estimate of arm length is to sum up the distances of the anchors of all the points in between the chain
+            Vector eetrans = pmanip->GetTransform().trans;
+            dReal armlength = 0;
+            FOREACHR(itjoint, varmjoints) {
+                armlength += RaveSqrt((eetrans-(*itjoint)->GetAnchor()).lengthsqr3());
+                eetrans = (*itjoint)->GetAnchor();
+            }
+            params->maxradius = armlength+params->xyzdelta*RaveSqrt(3.0)*1.05;
+        }
+
+        // same ordering as numpy.mgrid[-nsteps:nsteps,-nsteps:nsteps,-nsteps:nsteps]
+        params->nsteps = (int)floor(params->maxradius/params->xyzdelta);
+        int gridsize = 2*params->nsteps;
+        dReal fmaxradiussqr = params->maxradius*params->maxradius;
+        params->vinsideinds.resize(0);
+        for(int ix = 0; ix < gridsize; ++ix) {
+            for(int iy = 0; iy < gridsize; ++iy) {
+                for(int iz = 0; iz < gridsize; ++iz) {
+                    Vector v(ix-params->nsteps, iy-params->nsteps, iz-params->nsteps);
+                    if( (v*params->xyzdelta).lengthsqr3() < fmaxradiussqr ) {
+                        params->vinsideinds.push_back((ix*gridsize+iy)*gridsize+iz);
+                    }
+                }
+            }
+        }
+        return true;
+    }
+
+    /// \brief the links of the arm and the links connecting it to the base, same as ReachabilityModel.getManipulatorLinks
+    static void _GetManipulatorLinks(RobotBase::ManipulatorPtr pmanip, std::vector<KinBody::LinkPtr>& vlinks)
+    {
+        RobotBasePtr probot = pmanip->GetRobot();
+        pmanip->GetChildLinks(vlinks);
+        std::vector<int> vdofindices = pmanip->GetArmIndices();
+        std::vector<KinBody::JointPtr> vtobasejoints;
+        probot->GetChain(0,pmanip->GetBase()->GetIndex(),vtobasejoints);
+        FOREACHC(itjoint, vtobasejoints) {
+            if( (*itjoint)->GetDOFIndex() >= 0 && !(*itjoint)->IsStatic() ) {
+                for(int idof = 0; idof < (*itjoint)->GetDOF(); ++idof) {
+                    vdofindices.push_back((*itjoint)->GetDOFIndex()+idof);
+                }
+            }
+        }
+        FOREACHC(itindex, vdofindices) {
+            KinBody::JointPtr pjoint = probot->GetJointFromDOFIndex(*itindex);
+            if( !!pjoint->GetFirstAttached() && find(vlinks.begin(),vlinks.end(),pjoint->GetFirstAttached()) == vlinks.end() ) {
+                vlinks.push_back(pjoint->GetFirstAttached());
+            }
+            if( !!pjoint->GetSecondAttached() && find(vlinks.begin(),vlinks.end(),pjoint->GetSecondAttached()) == vlinks.end() ) {
+                vlinks.push_back(pjoint->GetSecondAttached());
+            }
+        }
+        std::vector<KinBody::LinkPtr> vattachedlinks;
+        size_t numlinks = vlinks.size();
+        for(size_t i = 0; i < numlinks; ++i) {
+            vlinks[i]->GetRigidlyAttachedLinks(vattachedlinks);
+            FOREACHC(itlink, vattachedlinks) {
+                if( find(vlinks.begin(),vlinks.end(),*itlink) == vlinks.end() ) {
+                    vlinks.push_back(*itlink);
+                }
+            }
+        }
+    }
+
+    /// \brief returns the next block of grid points to process, false if there are none left
+    bool _GetNextBlock(size_t numpoints, size_t& startindex, size_t& endindex)
+    {
+        boost::mutex::scoped_lock lock(_mutexWork);
+        if( _nextindex >= numpoints ) {
+            return false;
+        }
+        startindex = _nextindex;
+        endindex = min(numpoints, _nextindex+16);
+        // log progress in the same increments as the python generator
+        if( startindex/1000 != endindex/1000 || startindex == 0 ) {
+            RAVELOG_INFO(str(boost::format("%d/%d\n")%startindex%numpoints));
+        }
+        _nextindex = endindex;
+        return true;
+    }
+
+    void _WorkerThread(ReachabilityParametersPtr params, EnvironmentBasePtr pcloneenv, std::vector<PointResult>& vresults)
+    {
+        EnvironmentMutex::scoped_lock lock(pcloneenv->GetMutex());
+        RobotBasePtr probot = pcloneenv->GetRobot(params->robotname);
+        RobotBase::ManipulatorPtr pmanip = probot->GetManipulator(params->manipname);
+        probot->SetActiveManipulator(pmanip);
+        probot->SetTransform(params->trobot);
+        FOREACHC(itlink, probot->GetLinks()) {
+            (*itlink)->Enable(find(params->venabledlinks.begin(),params->venabledlinks.end(),(*itlink)->GetIndex()) != params->venabledlinks.end());
+        }
+
+        int gridsize = 2*params->nsteps;
+        std::vector<dReal> vsolution;
+        std::vector< std::vector<dReal> > vsolutions;
+        size_t startindex=0, endindex=0;
+        while(_GetNextBlock(vresults.size(), startindex, endindex)) {
+            for(size_t i = startindex; i < endindex; ++i) {
+                int ind = params->vinsideinds[i];
+                Transform t;
+                t.trans = Vector((ind/(gridsize*gridsize))-params->nsteps, ((ind/gridsize)%gridsize)-params->nsteps, (ind%gridsize)-params->nsteps)*params->xyzdelta + params->baseanchor;
+                PointResult& result = vresults[i];
+                FOREACHC(itrot, params->vrotations) {
+                    t.rot = *itrot;
+                    int numsolutions = 0;
+                    if( params->usefreespace ) {
+                        if( pmanip->FindIKSolutions(IkParameterization(t), vsolutions, 0) ) {
+                            numsolutions = (int)vsolutions.size();
+                        }
+                    }
+                    else if( pmanip->FindIKSolution(IkParameterization(t), vsolution, 0) ) {
+                        numsolutions = 1;
+                    }
+                    if( numsolutions > 0 ) {
+                        result.vstats.push_back(t.rot.x); result.vstats.push_back(t.rot.y); result.vstats.push_back(t.rot.z); result.vstats.push_back(t.rot.w);
+                        result.vstats.push_back(t.trans.x); result.vstats.push_back(t.trans.y); result.vstats.push_back(t.trans.z);
+                        result.vstats.push_back(numsolutions);
+                        result.numvalid += numsolutions;
+                        result.numrotvalid += 1;
+                    }
+                }
+            }
+        }
+    }
+
+    boost::mutex _mutexWork;
+    size_t _nextindex;
+};
+
+ModuleBasePtr CreateKinematicReachability(EnvironmentBasePtr penv) {
+    return ModuleBasePtr(new KinematicReachability(penv));
+}
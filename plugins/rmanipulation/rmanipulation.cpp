@@ -20,6 +20,9 @@ ModuleBasePtr CreateBaseManipulation(EnvironmentBasePtr penv);
 ModuleBasePtr CreateTaskCaging(EnvironmentBasePtr penv);
 ModuleBasePtr CreateTaskManipulation(EnvironmentBasePtr penv);
 ModuleBasePtr CreateVisualFeedback(EnvironmentBasePtr penv);
+ModuleBasePtr CreateKinematicReachability(EnvironmentBasePtr penv);
+ModuleBasePtr CreateInverseReachabilityModule(EnvironmentBasePtr penv);
+SpaceSamplerBasePtr CreateBasePlacementSampler(EnvironmentBasePtr penv, std::istream& sinput);
 
 InterfaceBasePtr CreateInterfaceValidated(InterfaceType type, const std::string& interfacename, std::istream& sinput, EnvironmentBasePtr penv)
 {
@@ -37,6 +40,17 @@ InterfaceBasePtr CreateInterfaceValidated(InterfaceType type, const std::string&
         else if( interfacename == "visualfeedback") {
             return CreateVisualFeedback(penv);
         }
+        else if( interfacename == "kinematicreachability") {
+            return CreateKinematicReachability(penv);
+        }
+        else if( interfacename == "inversereachability") {
+            return CreateInverseReachabilityModule(penv);
+        }
+        break;
+    case PT_SpaceSampler:
+        if( interfacename == "baseplacement") {
+            return CreateBasePlacementSampler(penv,sinput);
+        }
         break;
     default:
         break;
@@ -50,6 +64,9 @@ void GetPluginAttributesValidated(PLUGININFO& info)
     info.interfacenames[PT_Module].push_back("TaskManipulation");
     info.interfacenames[PT_Module].push_back("TaskCaging");
     info.interfacenames[PT_Module].push_back("VisualFeedback");
+    info.interfacenames[PT_Module].push_back("KinematicReachability");
+    info.interfacenames[PT_Module].push_back("InverseReachability");
+    info.interfacenames[PT_SpaceSampler].push_back("BasePlacement");
 }
 
 OPENRAVE_PLUGIN_API void DestroyPlugin()
@@ -0,0 +1,80 @@
+// -*- coding: utf-8 -*-
+// Copyright (C) 2016 Rosen Diankov
+//
+// This program is free software: you can redistribute it and/or modify it under the terms of the
+// GNU Lesser General Public License as published by the Free Software Foundation, either version 3
+// of the License, or at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+// even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License along with this program.
+// If not, see <http://www.gnu.org/licenses/>.
+#ifndef OPENRAVE_CLONED_PARAMETERS_H
+#define OPENRAVE_CLONED_PARAMETERS_H
+
+#include "openraveplugindefs.h"
+
+namespace rplanners {
+
+template <typename Fn>
+inline bool _IsDefaultPlannerFunction(const Fn& fn, const Fn& fnspec, const Fn& fnactive)
+{
+    if( !fn ) {
+        return !fnspec;
+    }
+    return (!!fnspec && fn.target_type() == fnspec.target_type()) || (!!fnactive && fn.target_type() == fnactive.target_type());
+}
+
+/// \brief Returns true if the state and constraint functions of params are the ones that
+/// SetConfigurationSpecification or SetRobotActiveJoints create.
+///
+/// Only then can the parameters be re-created on an environment clone with
+/// SetConfigurationSpecification without changing the constraints that are checked. Functions set by
+/// the caller, like the jacobian constraints of BaseManipulation, have other types. The environment
+/// has to be locked.
+///
+/// \param probot if not empty, the types of SetRobotActiveJoints on it are also accepted
+/// \param[out] fnname the name of the first function that is not a default one
+inline bool AreDefaultPlannerFunctions(EnvironmentBasePtr penv, RobotBasePtr probot, PlannerBase::PlannerParametersConstPtr params, std::string& fnname)
+{
+    PlannerBase::PlannerParametersPtr pspec(new PlannerBase::PlannerParameters()), pactive(new PlannerBase::PlannerParameters());
+    try {
+        pspec->SetConfigurationSpecification(penv, params->_configurationspecification);
+    }
+    catch(const std::exception& ex) {
+        RAVELOG_VERBOSE_FORMAT("env=%d, cannot set the configuration specification: %s", penv->GetId()%ex.what());
+        fnname = "_configurationspecification";
+        return false;
+    }
+    if( !!probot ) {
+        try {
+            pactive->SetRobotActiveJoints(probot);
+        }
+        catch(const std::exception& ex) {
+            RAVELOG_VERBOSE_FORMAT("env=%d, cannot set the active joints of %s: %s", penv->GetId()%probot->GetName()%ex.what());
+            pactive.reset(new PlannerBase::PlannerParameters());
+        }
+    }
+
+#define CHECK_PLANNER_FUNCTION(name) \
+    if( !_IsDefaultPlannerFunction(params->name, pspec->name, pactive->name) ) { \
+        fnname = #name; \
+        return false; \
+    }
+    CHECK_PLANNER_FUNCTION(_distmetricfn)
+    CHECK_PLANNER_FUNCTION(_checkpathvelocityconstraintsfn)
+    CHECK_PLANNER_FUNCTION(_samplefn)
+    CHECK_PLANNER_FUNCTION(_sampleneighfn)
+    CHECK_PLANNER_FUNCTION(_setstatevaluesfn)
+    CHECK_PLANNER_FUNCTION(_getstatefn)
+    CHECK_PLANNER_FUNCTION(_diffstatefn)
+    CHECK_PLANNER_FUNCTION(_neighstatefn)
+#undef CHECK_PLANNER_FUNCTION
+    return true;
+}
+
+} // end namespace rplanners
+
+#endif
@@ -0,0 +1,98 @@
+// -*- coding: utf-8 -*-
+// Copyright (C) 2016 Rosen Diankov
+//
+// This program is free software: you can redistribute it and/or modify it under the terms of the
+// GNU Lesser General Public License as published by the Free Software Foundation, either version 3
+// of the License, or at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+// even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License along with this program.
+// If not, see <http://www.gnu.org/licenses/>.
+#ifndef OPENRAVE_FEASIBILITY_MEMO_H
+#define OPENRAVE_FEASIBILITY_MEMO_H
+
+#include "openraveplugindefs.h"
+#include <boost/unordered_map.hpp>
+
+namespace rplanners {
+
+/// \brief Remembers the results of the configuration feasibility checks of a smoother during one plan
+/// so that the same configuration is not sent to CheckPathAllConstraints twice.
+///
+/// The keys are the check options and the exact values, so a result is only reused for the very same
+/// check and the smoothed path does not depend on the order the checks were done in. The memo is only
+/// valid as long as the environment and the parameters do not change, so it has to be reset at the
+/// start of every plan.
+template <typename CheckReturnT>
+class FeasibilityMemo
+{
+public:
+    struct Statistics
+    {
+        Statistics() : nconfigqueries(0), nconfighits(0) {
+        }
+        int nconfigqueries, nconfighits;
+    };
+
+    /// \brief forgets all the results and the statistics
+    void Reset()
+    {
+        _mapconfigs.clear();
+        _stats = Statistics();
+    }
+
+    /// \brief returns the result of a previous check of the configuration or NULL
+    const CheckReturnT* FindConfig(const std::vector<dReal>& q, const std::vector<dReal>& dq, int options)
+    {
+        ++_stats.nconfigqueries;
+        if( !_MakeKey(options, q, dq) ) {
+            return NULL;
+        }
+        typename boost::unordered_map<std::vector<dReal>, CheckReturnT>::const_iterator it = _mapconfigs.find(_vkey);
+        if( it == _mapconfigs.end() ) {
+            return NULL;
+        }
+        ++_stats.nconfighits;
+        return &it->second;
+    }
+
+    void InsertConfig(const std::vector<dReal>& q, const std::vector<dReal>& dq, int options, const CheckReturnT& ret)
+    {
+        if( _MakeKey(options, q, dq) ) {
+            _mapconfigs[_vkey] = ret;
+        }
+    }
+
+    const Statistics& GetStatistics() const {
+        return _stats;
+    }
+
+private:
+    /// \brief fills _vkey with the options and the values, returns false if a value is not finite
+    bool _MakeKey(int options, const std::vector<dReal>& q, const std::vector<dReal>& dq)
+    {
+        _vkey.resize(0);
+        _vkey.push_back(options);
+        const std::vector<dReal>* pvalues[2] = { &q, &dq };
+        for(int ivalues = 0; ivalues < 2; ++ivalues) {
+            FOREACHC(itvalue, *pvalues[ivalues]) {
+                if( !(RaveFabs(*itvalue) <= std::numeric_limits<dReal>::max()) ) { // also false for nan
+                    return false;
+                }
+                _vkey.push_back(*itvalue);
+            }
+        }
+        return true;
+    }
+
+    boost::unordered_map<std::vector<dReal>, CheckReturnT> _mapconfigs;
+    std::vector<dReal> _vkey; ///< cache
+    Statistics _stats;
+};
+
+} // end namespace rplanners
+
+#endif
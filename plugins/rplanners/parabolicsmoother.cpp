@@ -20,6 +20,7 @@
 
 #include "manipconstraints.h"
 #include "ParabolicPathSmooth/DynamicPath.h"
+#include "feasibilitymemo.h"
 
 namespace rplanners {
 
@@ -27,6 +28,8 @@ namespace ParabolicRamp = ParabolicRampInternal;
 
 class ParabolicSmoother : public PlannerBase, public ParabolicRamp::FeasibilityCheckerBase, public ParabolicRamp::RandomNumberGeneratorBase
 {
+    typedef FeasibilityMemo<ParabolicRamp::CheckReturn> RampFeasibilityMemo;
+
     class MyRampFeasibilityChecker : public ParabolicRamp::RampFeasibilityChecker
     {
 public:
@@ -209,6 +212,7 @@ public:
             _parameters->_nMaxIterations = 100;
         }
         _bUsePerturbation = true;
+        _feasibilitymemo.Reset();
 
         _bmanipconstraints = _parameters->manipname.size() > 0 && (_parameters->maxmanipspeed>0 || _parameters->maxmanipaccel>0);
 
@@ -246,6 +250,8 @@ public:
         if( !!_uniformsampler ) {
             _uniformsampler->SetSeed(_parameters->_nRandomGeneratorSeed);
         }
+        // the environment might have changed since the last plan
+        _feasibilitymemo.Reset();
 
         if( IS_DEBUGLEVEL(Level_Verbose) ) {
             // store the trajectory
@@ -737,6 +743,10 @@ public:
             return PS_Failed;
         }
         RAVELOG_DEBUG_FORMAT("env=%d, path optimizing - computation time=%fs", GetEnv()->GetId()%(0.001f*(float)(utils::GetMilliTime()-basetime)));
+        if( IS_DEBUGLEVEL(Level_Debug) ) {
+            const RampFeasibilityMemo::Statistics& stats = _feasibilitymemo.GetStatistics();
+            RAVELOG_DEBUG_FORMAT("env=%d, feasibility memo hits: configs %d/%d", GetEnv()->GetId()%stats.nconfighits%stats.nconfigqueries);
+        }
         //====================================================================================================
         if (IS_DEBUGLEVEL(Level_Debug)) {
             RAVELOG_DEBUG("start sampling the trajectory (verification purpose) after shortcutting");
@@ -778,12 +788,17 @@ public:
         if( _bUsePerturbation ) {
             options |= CFO_CheckWithPerturbation;
         }
+        const ParabolicRamp::CheckReturn* pmemoret = _feasibilitymemo.FindConfig(a, da, options);
+        if( !!pmemoret ) {
+            return *pmemoret;
+        }
         try {
             int ret = _parameters->CheckPathAllConstraints(a,a, da, da, 0, IT_OpenStart, options);
             ParabolicRamp::CheckReturn checkret(ret);
             if( ret == CFO_CheckTimeBasedConstraints ) {
                 checkret.fTimeBasedSurpassMult = 0.8; // don't have any other info, so just pick a multiple
             }
+            _feasibilitymemo.InsertConfig(a, da, options, checkret);
             return checkret;
         }
         catch(const std::exception& ex) {
@@ -962,6 +977,10 @@ public:
             }
         }
 
+        if( !bExpectModifiedConfigurations ) {
+            // the end configuration was checked with the ramp
+            _feasibilitymemo.InsertConfig(b, db, options & ~CFO_FillCheckedConfiguration, ParabolicRamp::CheckReturn(0));
+        }
         return ParabolicRamp::CheckReturn(0);
     }
 
@@ -2503,6 +2522,7 @@ protected:
     ConstraintFilterReturnPtr _constraintreturn;
     MyRampFeasibilityChecker _feasibilitychecker;
     boost::shared_ptr<ManipConstraintChecker> _manipconstraintchecker;
+    RampFeasibilityMemo _feasibilitymemo; ///< results of the feasibility checks of the current plan
 
     //@{ cache
     ParabolicRamp::DynamicPath _cacheintermediate, _cacheintermediate2, _cachedynamicpath;
@@ -14,11 +14,13 @@
 #include "openraveplugindefs.h"
 #include <fstream>
 #include <openrave/planningutils.h>
+#include <boost/thread/condition.hpp>
 
 #include "rampoptimizer/interpolator.h"
 #include "rampoptimizer/parabolicchecker.h"
 #include "rampoptimizer/feasibilitychecker.h"
 #include "manipconstraints2.h"
+#include "clonedparameters.h"
 
 namespace rplanners {
 
@@ -224,10 +226,54 @@ private:
 
     }; // end class MyRampNDFeasibilityChecker
 
+    /// \brief a smoother checking candidate shortcuts in its own clone of the environment
+    struct ShortcutWorker
+    {
+        EnvironmentBasePtr _penv;
+        boost::shared_ptr<ParabolicSmoother2> _smoother;
+        ConstraintTrajectoryTimingParametersPtr _parameters; ///< the constraint functions of the clone only hold weak references to it
+    };
+
+    /// \brief a candidate shortcut of a round of parallel shortcutting
+    struct ShortcutCandidate
+    {
+        ShortcutCandidate() : t0(0), t1(0), iter(0), ret(1), fStartTimeVelMult(1), fStartTimeAccelMult(1), fCurVelMult(1), fCurAccelMult(1), numSlowDowns(0), diff(0) {
+        }
+        dReal t0, t1;
+        int iter; ///< shortcut iteration the times were sampled at
+        int ret; ///< return value of _ComputeShortcut
+        dReal fStartTimeVelMult, fStartTimeAccelMult;
+        dReal fCurVelMult, fCurAccelMult;
+        int numSlowDowns;
+        dReal diff; ///< time saved by the shortcut
+        std::vector<RampOptimizer::RampND> vrampnds; ///< the checked shortcut
+    };
+
+    /// \brief the arguments of a round of parallel shortcutting passed to the worker threads
+    struct ShortcutRound
+    {
+        ShortcutRound() : pparabolicpath(NULL), numcandidates(0), minTimeStep(0), numIters(0) {
+        }
+        const RampOptimizer::ParabolicPath* pparabolicpath;
+        size_t numcandidates;
+        dReal minTimeStep;
+        int numIters;
+    };
+
 public:
     ParabolicSmoother2(EnvironmentBasePtr penv, std::istream& sinput) : PlannerBase(penv), _feasibilitychecker(this)
     {
         __description = "";
+        RegisterCommand("SetParallelShortcut",boost::bind(&ParabolicSmoother2::_SetParallelShortcutCommand,this,_1,_2),
+                        "format: int numcandidates [int numthreads]\n\n\
+number of candidate shortcuts sampled per round and checked concurrently on clones of the environment, the non-overlapping successful ones are committed at the end of each round starting with the largest time savings. 0 or 1 (default) shortcuts serially. numthreads is the number of environment clones, 0 (default) uses the number of cores. The result only depends on _nRandomGeneratorSeed and numcandidates, not on numthreads.\n\n\
+The parameters are re-created on the clones from the configuration specification. If the state or constraint functions of the parameters are not the ones created by SetConfigurationSpecification or SetRobotActiveJoints, the clones could not check the same constraints, so the path is shortcut serially instead.");
+        _nShortcutCandidates = 0;
+        _nNumThreads = 0;
+        _nNextShortcutCandidate = 0;
+        _nShortcutRound = 0;
+        _nShortcutThreadsRunning = 0;
+        _bStopShortcutThreads = false;
         _bmanipconstraints = false;
         _constraintreturn.reset(new ConstraintFilterReturn());
         _logginguniformsampler = RaveCreateSpaceSampler(GetEnv(), "mt19937");
@@ -235,12 +281,16 @@ public:
             _logginguniformsampler->SetSeed(utils::GetMicroTime());
         }
     }
+    virtual ~ParabolicSmoother2() {
+        _DestroyShortcutWorkers();
+    }
 
     virtual bool InitPlan(RobotBasePtr pbase, PlannerParametersConstPtr params)
     {
         EnvironmentMutex::scoped_lock lock(GetEnv()->GetMutex());
         _parameters.reset(new ConstraintTrajectoryTimingParameters());
         _parameters->copy(params);
+        _robot = pbase;
         return _InitPlan();
     }
 
@@ -249,6 +299,7 @@ public:
         EnvironmentMutex::scoped_lock lock(GetEnv()->GetMutex());
         _parameters.reset(new ConstraintTrajectoryTimingParameters());
         isParameters >> *_parameters;
+        _robot = pbase;
         return _InitPlan();
     }
 
@@ -525,7 +576,12 @@ public:
 
             int numShortcuts = 0;
             if( !!parameters->_setstatevaluesfn || !!parameters->_setstatefn ) {
-                numShortcuts = _Shortcut(parabolicpath, parameters->_nMaxIterations, this, parameters->_fStepLength*0.99);
+                if( _nShortcutCandidates > 1 ) {
+                    numShortcuts = _ShortcutParallel(parabolicpath, parameters->_nMaxIterations, this, parameters->_fStepLength*0.99);
+                }
+                else {
+                    numShortcuts = _Shortcut(parabolicpath, parameters->_nMaxIterations, this, parameters->_fStepLength*0.99);
+                }
                 if( numShortcuts < 0 ) {
                     return PS_Interrupted;
                 }
@@ -1011,6 +1067,19 @@ public:
 
 protected:
 
+    bool _SetParallelShortcutCommand(std::ostream& sout, std::istream& sinput)
+    {
+        int numcandidates = 0, numthreads = 0;
+        sinput >> numcandidates;
+        if( !sinput ) {
+            return false;
+        }
+        sinput >> numthreads;
+        _nShortcutCandidates = max(0, numcandidates);
+        _nNumThreads = max(0, numthreads);
+        return true;
+    }
+
     /// \brief Time-parameterize the ordered set of waypoints to a trajectory that stops at every
     /// waypoint. _SetMilestones also adds some extra waypoints to the original set if any two
     /// consecutive waypoints are too far apart.
@@ -1237,17 +1306,12 @@ protected:
         fileindex = fileindex%_fileIndexMod;
         _DumpParabolicPath(parabolicpath, _dumplevel, fileindex, 0);
 
-        std::vector<RampOptimizer::RampND> rampndVect = parabolicpath.GetRampNDVect(); // for convenience
-
         // Caching stuff
-        std::vector<RampOptimizer::RampND>& shortcutRampNDVect = _cacheRampNDVect; // for storing interpolated trajectory
-        std::vector<RampOptimizer::RampND>& shortcutRampNDVectOut = _cacheRampNDVectOut, &shortcutRampNDVectOut1 = _cacheRampNDVectOut1; // for storing checked trajectory
+        std::vector<RampOptimizer::RampND>& shortcutRampNDVectOut = _cacheRampNDVectOut; // for storing checked trajectory
         std::vector<dReal>& x0Vect = _cacheX0Vect, &x1Vect = _cacheX1Vect, &v0Vect = _cacheV0Vect, &v1Vect = _cacheV1Vect;
         const dReal tOriginal = parabolicpath.GetDuration(); // the original trajectory duration before being shortcut
         dReal tTotal = tOriginal; // keeps track of the latest trajectory duration
 
-        std::vector<dReal>& vellimits = _cacheVellimits, &accellimits = _cacheAccelLimits;
-
         // Various parameters for shortcutting
         int numSlowDowns = 0; // counts the number of times we slow down the trajectory (via vel/accel scaling) because of manip constraints
         dReal fiSearchVelAccelMult = 1.0/_parameters->fSearchVelAccelMult; // magic constant
@@ -1266,11 +1330,6 @@ protected:
         dReal iCurrentBestScore = 1.0;
         dReal cutoffRatio = 1e-3;          // we stop shortcutting if the progress made is considered too little (score/currentBestScore < cutoffRatio)
 
-        dReal specialShortcutWeight = 0.1; // if the sampled number is less than this weight, we sample t0 and t1 around a zerovelpoint
-                                           // (instead of randomly sample in the whole range) to try to shortcut and remove it.
-        dReal specialShortcutCutoffTime = 0.75; // when doind special shortcut, we sample one of the remaining zero-velocity waypoints. Then we try to
-                                                // shortcut in the range twaypoint +/- specialShortcutCutoffTime
-
         // Main shortcut loop
         int iters = 0;
         for (iters = 0; iters < numIters; ++iters) {
@@ -1285,42 +1344,8 @@ protected:
                 break;
             }
 
-            // Sample t0 and t1. We could possibly add some heuristics here to get higher quality
-            // shortcuts
             dReal t0, t1;
-            if( iters == 0 ) {
-                t0 = 0;
-                t1 = tTotal;
-            }
-            else if( (_zeroVelPoints.size() > 0 && rng->Rand() <= specialShortcutWeight) || (numIters - iters <= (int)_zeroVelPoints.size()) ) {
-                /* We consider shortcutting around a zerovelpoint (the time instant of an original
-                   waypoint which has not yet been shortcut) when there are some zerovelpoints left
-                   and either
-                   - the random number falls below the threshold, or
-                   - there are not so many shortcut iterations left (compared to the number of zerovelpoints)
-                 */
-                size_t index = _uniformsampler->SampleSequenceOneUInt32()%_zeroVelPoints.size();
-                dReal t = _zeroVelPoints[index];
-                t0 = t - rng->Rand()*min(specialShortcutCutoffTime, t);
-                t1 = t + rng->Rand()*min(specialShortcutCutoffTime, tTotal - t);
-
-                if( numIters - iters <= (int)_zeroVelPoints.size() ) {
-                    // By the time we reach here, it is likely that these multipliers have been
-                    // scaled down to be very small. Try resetting it in hopes that it helps produce
-                    // some successful shortcuts.
-                    fStartTimeVelMult = max(0.8, fStartTimeVelMult);
-                    fStartTimeAccelMult = max(0.8, fStartTimeAccelMult);
-                }
-            }
-            else {
-                // Proceed normally
-                t0 = rng->Rand()*tTotal;
-                t1 = rng->Rand()*tTotal;
-                if( t0 > t1 ) {
-                    RampOptimizer::Swap(t0, t1);
-                }
-            }
-
+            _SampleShortcutTimes(iters, numIters, tTotal, rng, t0, t1, fStartTimeVelMult, fStartTimeAccelMult);
             if( t1 - t0 < minTimeStep ) {
                 // The sampled t0 and t1 are too close to be useful
                 continue;
@@ -1330,404 +1355,914 @@ protected:
 
             // Perform shortcut
             try {
-                int i0, i1;
-                dReal u0, u1;
-                parabolicpath.FindRampNDIndex(t0, i0, u0);
-                parabolicpath.FindRampNDIndex(t1, i1, u1);
-
-                rampndVect[i0].EvalPos(u0, x0Vect);
-                if( _parameters->SetStateValues(x0Vect) != 0 ) {
-                    continue;
+                dReal fCurVelMult, fCurAccelMult;
+                int ret = _ComputeShortcut(parabolicpath, t0, t1, minTimeStep, iters, numIters, fStartTimeVelMult, fStartTimeAccelMult, fCurVelMult, fCurAccelMult, numSlowDowns, iIterProgress, shortcutRampNDVectOut);
+                if( ret < 0 ) {
+                    return -1;
                 }
-                iIterProgress +=  0x10000000;
-                _parameters->_getstatefn(x0Vect);
-                iIterProgress += 0x10000000;
-
-                rampndVect[i1].EvalPos(u1, x1Vect);
-                if( _parameters->SetStateValues(x1Vect) != 0 ) {
+                else if( ret > 0 ) {
+                    // Shortcut failed. Continue to the next iteration.
                     continue;
                 }
-                iIterProgress +=  0x10000000;
-                _parameters->_getstatefn(x1Vect);
 
-                rampndVect[i0].EvalVel(u0, v0Vect);
-                rampndVect[i1].EvalVel(u1, v1Vect);
-                ++_progress._iteration;
+                // Now this shortcut is really successful
+                ++numShortcuts;
 
-                vellimits = _parameters->_vConfigVelocityLimit;
-                accellimits = _parameters->_vConfigAccelerationLimit;
+                // Keep track of zero-velocity waypoints
+                dReal segmentTime = 0;
+                FOREACHC(itrampnd, shortcutRampNDVectOut) {
+                    segmentTime += itrampnd->GetDuration();
+                }
+                dReal diff = (t1 - t0) - segmentTime;
 
-                for (size_t j = 0; j < _parameters->_vConfigVelocityLimit.size(); ++j) {
-                    // Adjust vellimits and accellimits
-                    dReal fminvel = max(RaveFabs(v0Vect[j]), RaveFabs(v1Vect[j]));
-                    if( vellimits[j] < fminvel ) {
-                        vellimits[j] = fminvel;
+                size_t writeIndex = 0;
+                for (size_t readIndex = 0; readIndex < _zeroVelPoints.size(); ++readIndex) {
+                    if( _zeroVelPoints[readIndex] <= t0 ) {
+                        writeIndex += 1;
+                    }
+                    else if( _zeroVelPoints[readIndex] <= t1 ) {
+                        // Do nothing.
                     }
                     else {
-                        dReal f = max(fminvel, fStartTimeVelMult * _parameters->_vConfigVelocityLimit[j]);
-                        if( vellimits[j] > f ) {
-                            vellimits[j] = f;
-                        }
+                        _zeroVelPoints[writeIndex++] = _zeroVelPoints[readIndex] - diff;
                     }
+                }
+                _zeroVelPoints.resize(writeIndex);
+
+                // Keep track of the multipliers
+                fStartTimeVelMult = min(1.0, fCurVelMult * fiSearchVelAccelMult);
+                fStartTimeAccelMult = min(1.0, fCurAccelMult * fiSearchVelAccelMult);
+
+                // Now replace the original trajectory segment by the shortcut
+                parabolicpath.ReplaceSegment(t0, t1, shortcutRampNDVectOut);
+                iIterProgress += 0x10000000;
+
+                // Check consistency
+                if( IS_DEBUGLEVEL(Level_Verbose) ) {
+                    const std::vector<RampOptimizer::RampND>& rampndVect = parabolicpath.GetRampNDVect();
+                    rampndVect.front().GetX0Vect(x0Vect);
+                    rampndVect.back().GetX1Vect(x1Vect);
+                    rampndVect.front().GetV0Vect(v0Vect);
+                    rampndVect.back().GetV1Vect(v1Vect);
+                    RampOptimizer::ParabolicCheckReturn parabolicret = RampOptimizer::CheckRampNDs(rampndVect, _parameters->_vConfigLowerLimit, _parameters->_vConfigUpperLimit, _parameters->_vConfigVelocityLimit, _parameters->_vConfigAccelerationLimit, x0Vect, x1Vect, v0Vect, v1Vect);
+                    OPENRAVE_ASSERT_OP(parabolicret, ==, RampOptimizer::PCR_Normal);
+                }
+                iIterProgress += 0x10000000;
+
+                tTotal = parabolicpath.GetDuration();
+                RAVELOG_VERBOSE_FORMAT("env=%d: shortcut iter = %d/%d successful, numSlowDowns = %d, tTotal = %.15e", GetEnv()->GetId()%iters%numIters%numSlowDowns%tTotal);
+
+                // Calculate the score
+                score = diff/nItersFromPrevSuccessful;
+                if( score > currentBestScore) {
+                    currentBestScore = score;
+                    iCurrentBestScore = 1.0/currentBestScore;
+                }
+                nItersFromPrevSuccessful = 0;
+
+                if( (score*iCurrentBestScore < cutoffRatio) && (numShortcuts > 5)) {
+                    // We have already shortcut for a bit (numShortcuts > 5). The progress made in
+                    // this iteration is below the curoff ratio. If we continue, it is unlikely that
+                    // we will make much more progress. So stop here.
+                    break;
+                }
+            }
+            catch (const std::exception& ex) {
+                RAVELOG_WARN_FORMAT("env=%d: An exception happened during shortcut iteration progress = 0x%x: %s", GetEnv()->GetId()%iIterProgress%ex.what());
+            }
+        }
+
+        // Report status
+        if( iters == numIters ) {
+            RAVELOG_DEBUG_FORMAT("env=%d, finished at shortcut iter=%d (normal exit), successful=%d, slowdowns=%d, endTime: %.15e -> %.15e; diff = %.15e", GetEnv()->GetId()%iters%numShortcuts%numSlowDowns%tOriginal%tTotal%(tOriginal - tTotal));
+        }
+        else if( score*iCurrentBestScore < cutoffRatio ) {
+            RAVELOG_DEBUG_FORMAT("env=%d, finished at shortcut iter=%d (current score falls below %.15e), successful=%d, slowdowns=%d, endTime: %.15e -> %.15e; diff = %.15e", GetEnv()->GetId()%iters%cutoffRatio%numShortcuts%numSlowDowns%tOriginal%tTotal%(tOriginal - tTotal));
+        }
+        else if( nItersFromPrevSuccessful > nCutoffIters ) {
+            RAVELOG_DEBUG_FORMAT("env=%d, finished at shortcut iter=%d (did not make progress in the last %d iterations), successful=%d, slowdowns=%d, endTime: %.15e -> %.15e; diff = %.15e", GetEnv()->GetId()%iters%nCutoffIters%numShortcuts%numSlowDowns%tOriginal%tTotal%(tOriginal - tTotal));
+        }
+        _DumpParabolicPath(parabolicpath, _dumplevel, fileindex, 1);
+
+        return numShortcuts;
+    }
+
+    /// \brief Sample the times t0 <= t1 between which iteration iters of the shortcut loop tries to
+    /// shortcut. When some zero-velocity points are left, they are targeted with a small
+    /// probability and systematically during the last iterations.
+    void _SampleShortcutTimes(int iters, int numIters, dReal tTotal, RampOptimizer::RandomNumberGeneratorBase* rng, dReal& t0, dReal& t1, dReal& fStartTimeVelMult, dReal& fStartTimeAccelMult)
+    {
+        dReal specialShortcutWeight = 0.1; // if the sampled number is less than this weight, we sample t0 and t1 around a zerovelpoint
+                                           // (instead of randomly sample in the whole range) to try to shortcut and remove it.
+        dReal specialShortcutCutoffTime = 0.75; // when doind special shortcut, we sample one of the remaining zero-velocity waypoints. Then we try to
+                                                // shortcut in the range twaypoint +/- specialShortcutCutoffTime
+
+        // Sample t0 and t1. We could possibly add some heuristics here to get higher quality
+        // shortcuts
+        if( iters == 0 ) {
+            t0 = 0;
+            t1 = tTotal;
+        }
+        else if( (_zeroVelPoints.size() > 0 && rng->Rand() <= specialShortcutWeight) || (numIters - iters <= (int)_zeroVelPoints.size()) ) {
+            /* We consider shortcutting around a zerovelpoint (the time instant of an original
+               waypoint which has not yet been shortcut) when there are some zerovelpoints left
+               and either
+               - the random number falls below the threshold, or
+               - there are not so many shortcut iterations left (compared to the number of zerovelpoints)
+             */
+            size_t index = _uniformsampler->SampleSequenceOneUInt32()%_zeroVelPoints.size();
+            dReal t = _zeroVelPoints[index];
+            t0 = t - rng->Rand()*min(specialShortcutCutoffTime, t);
+            t1 = t + rng->Rand()*min(specialShortcutCutoffTime, tTotal - t);
+
+            if( numIters - iters <= (int)_zeroVelPoints.size() ) {
+                // By the time we reach here, it is likely that these multipliers have been
+                // scaled down to be very small. Try resetting it in hopes that it helps produce
+                // some successful shortcuts.
+                fStartTimeVelMult = max(0.8, fStartTimeVelMult);
+                fStartTimeAccelMult = max(0.8, fStartTimeAccelMult);
+            }
+        }
+        else {
+            // Proceed normally
+            t0 = rng->Rand()*tTotal;
+            t1 = rng->Rand()*tTotal;
+            if( t0 > t1 ) {
+                RampOptimizer::Swap(t0, t1);
+            }
+        }
+    }
+
+    /// \brief Compute a shortcut replacing the segment [t0, t1] of parabolicpath and check it with
+    /// _feasibilitychecker, slowing it down while time-based constraints are violated. Only this
+    /// smoother's own parameters, checker and caches are used, so shortcut workers can call it on
+    /// their own instance concurrently.
+    ///
+    /// \param fCurVelMult, fCurAccelMult are set to the multipliers of the vel/accel limits the shortcut succeeded with
+    /// \param shortcutRampNDVectOut holds the checked shortcut if successful
+    /// \return 0 if successful, 1 if no feasible shortcut was found, -1 if interrupted
+    int _ComputeShortcut(const RampOptimizer::ParabolicPath& parabolicpath, dReal t0, dReal t1, dReal minTimeStep, int iters, int numIters, dReal fStartTimeVelMult, dReal fStartTimeAccelMult, dReal& fCurVelMult, dReal& fCurAccelMult, int& numSlowDowns, uint32_t& iIterProgress, std::vector<RampOptimizer::RampND>& shortcutRampNDVectOut)
+    {
+        // Caching stuff
+        const std::vector<RampOptimizer::RampND>& rampndVect = parabolicpath.GetRampNDVect();
+        std::vector<RampOptimizer::RampND>& shortcutRampNDVect = _cacheRampNDVect; // for storing interpolated trajectory
+        std::vector<RampOptimizer::RampND>& shortcutRampNDVectOut1 = _cacheRampNDVectOut1; // for storing checked trajectory
+        std::vector<dReal>& x0Vect = _cacheX0Vect, &x1Vect = _cacheX1Vect, &v0Vect = _cacheV0Vect, &v1Vect = _cacheV1Vect;
+        std::vector<dReal>& vellimits = _cacheVellimits, &accellimits = _cacheAccelLimits;
+
+        int i0, i1;
+        dReal u0, u1;
+        parabolicpath.FindRampNDIndex(t0, i0, u0);
+        parabolicpath.FindRampNDIndex(t1, i1, u1);
+
+        rampndVect[i0].EvalPos(u0, x0Vect);
+        if( _parameters->SetStateValues(x0Vect) != 0 ) {
+            return 1;
+        }
+        iIterProgress +=  0x10000000;
+        _parameters->_getstatefn(x0Vect);
+        iIterProgress += 0x10000000;
+
+        rampndVect[i1].EvalPos(u1, x1Vect);
+        if( _parameters->SetStateValues(x1Vect) != 0 ) {
+            return 1;
+        }
+        iIterProgress +=  0x10000000;
+        _parameters->_getstatefn(x1Vect);
+
+        rampndVect[i0].EvalVel(u0, v0Vect);
+        rampndVect[i1].EvalVel(u1, v1Vect);
+        ++_progress._iteration;
+
+        vellimits = _parameters->_vConfigVelocityLimit;
+        accellimits = _parameters->_vConfigAccelerationLimit;
+
+        for (size_t j = 0; j < _parameters->_vConfigVelocityLimit.size(); ++j) {
+            // Adjust vellimits and accellimits
+            dReal fminvel = max(RaveFabs(v0Vect[j]), RaveFabs(v1Vect[j]));
+            if( vellimits[j] < fminvel ) {
+                vellimits[j] = fminvel;
+            }
+            else {
+                dReal f = max(fminvel, fStartTimeVelMult * _parameters->_vConfigVelocityLimit[j]);
+                if( vellimits[j] > f ) {
+                    vellimits[j] = f;
+                }
+            }
+
+            {
+                dReal f = fStartTimeAccelMult * _parameters->_vConfigAccelerationLimit[j];
+                if( accellimits[j] > f ) {
+                    accellimits[j] = f;
+                }
+            }
+        }
+
+        fCurVelMult = fStartTimeVelMult;
+        fCurAccelMult = fStartTimeAccelMult;
+        RAVELOG_VERBOSE_FORMAT("env=%d: iter = %d/%d, start shortcutting from t0 = %.15e to t1 = %.15e", GetEnv()->GetId()%iters%numIters%t0%t1);
+
+        bool bSuccess = false;
+        size_t maxSlowDownTries = 4;
+        for (size_t iSlowDown = 0; iSlowDown < maxSlowDownTries; ++iSlowDown) {
+#ifdef SMOOTHER_TIMING_DEBUG
+            _nCallsInterpolator += 1;
+            _tStartInterpolator = utils::GetMicroTime();
+#endif
+            bool res = _interpolator.ComputeArbitraryVelNDTrajectory(x0Vect, x1Vect, v0Vect, v1Vect, _parameters->_vConfigLowerLimit, _parameters->_vConfigUpperLimit, vellimits, accellimits, shortcutRampNDVect, false);
+#ifdef SMOOTHER_TIMING_DEBUG
+            _tEndInterpolator = utils::GetMicroTime();
+            _totalTimeInterpolator += 0.000001f*(float)(_tEndInterpolator - _tStartInterpolator);
+#endif
+            iIterProgress += 0x1000;
+            if( !res ) {
+                RAVELOG_VERBOSE_FORMAT("env=%d: shortcut iter = %d/%d, initial interpolation failed.\n", GetEnv()->GetId()%iters%numIters);
+                break;
+            }
+
+            // Check if the shortcut makes a significant improvement
+            dReal segmentTime = 0;
+            FOREACHC(itrampnd, shortcutRampNDVect) {
+                segmentTime += itrampnd->GetDuration();
+            }
+            if( segmentTime + minTimeStep > t1 - t0 ) {
+                RAVELOG_VERBOSE_FORMAT("env=%d: shortcut iter = %d/%d, rejecting shortcut from t0 = %.15e to t1 = %.15e, %.15e > %.15e, minTimeStep = %.15e, final trajectory duration = %.15e s.",
+                                       GetEnv()->GetId()%iters%numIters%t0%t1%segmentTime%(t1 - t0)%minTimeStep%parabolicpath.GetDuration());
+                break;
+            }
+
+            if( _CallCallbacks(_progress) == PA_Interrupt ) {
+                return -1;
+            }
+            iIterProgress += 0x1000;
+
+            RampOptimizer::CheckReturn retcheck(0);
+            iIterProgress += 0x10;
+
+            do { // Start checking constraints.
+                if( _parameters->SetStateValues(x1Vect) != 0 ) {
+                    std::stringstream s;
+                    s << std::setprecision(RampOptimizer::g_nPrec) << "x1 = [";
+                    SerializeValues(s, x1Vect);
+                    s << "];";
+                    RAVELOG_VERBOSE_FORMAT("env=%d: shortcut iter = %d/%d, cannot set state: %s", GetEnv()->GetId()%iters%numIters%s.str());
+                    retcheck.retcode = CFO_StateSettingError;
+                    break;
+                }
+                _parameters->_getstatefn(x1Vect);
+                iIterProgress += 0x10;
+
+                retcheck = _feasibilitychecker.Check2(shortcutRampNDVect, 0xffff, shortcutRampNDVectOut);
+                iIterProgress += 0x10;
+
+                if( retcheck.retcode != 0 ) {
+                    // Shortcut does not pass CheckPathAllConstraints
+                    RAVELOG_VERBOSE_FORMAT("env=%d: shortcut iter = %d/%d, iSlowDown = %d, shortcut does not pass Check2, retcode = 0x%x.\n", GetEnv()->GetId()%iters%numIters%iSlowDown%retcheck.retcode);
+                    break;
+                }
 
-                    {
-                        dReal f = fStartTimeAccelMult * _parameters->_vConfigAccelerationLimit[j];
-                        if( accellimits[j] > f ) {
-                            accellimits[j] = f;
+                // CheckPathAllConstraints (called viaSegmentFeasible2 inside Check2) may be
+                // modifying the original shortcutcurvesnd due to constraints. Therefore, we
+                // have to reset vellimits and accellimits so that they are above those of
+                // the modified trajectory.
+                for (size_t irampnd = 0; irampnd < shortcutRampNDVectOut.size(); ++irampnd) {
+                    for (size_t jdof = 0; jdof < shortcutRampNDVectOut[irampnd].GetDOF(); ++jdof) {
+                        dReal fminvel = max(RaveFabs(shortcutRampNDVectOut[irampnd].GetV0At(jdof)), RaveFabs(shortcutRampNDVectOut[irampnd].GetV1At(jdof)));
+                        if( vellimits[jdof] < fminvel ) {
+                            vellimits[jdof] = fminvel;
                         }
                     }
                 }
 
-                dReal fCurVelMult = fStartTimeVelMult;
-                dReal fCurAccelMult = fStartTimeAccelMult;
-                RAVELOG_VERBOSE_FORMAT("env=%d: iter = %d/%d, start shortcutting from t0 = %.15e to t1 = %.15e", GetEnv()->GetId()%iters%numIters%t0%t1);
+                // The interpolated segment passes constraints checking. Now see if it is modified such that it does not end with the desired velocity.
+                if( retcheck.bDifferentVelocity && shortcutRampNDVectOut.size() > 0 ) {
+                    RAVELOG_VERBOSE_FORMAT("env=%d: new shortcut is *not* aligned with boundary values after running Check2. Start fixing the last segment.", GetEnv()->GetId());
+                    // Modification inside Check2 results in the shortcut trajectory not ending at the desired velocity v1.
+                    dReal allowedStretchTime = (t1 - t0) - (segmentTime + minTimeStep); // the time that this segment is allowed to stretch out such that it is still a useful shortcut
 
-                bool bSuccess = false;
-                size_t maxSlowDownTries = 4;
-                for (size_t iSlowDown = 0; iSlowDown < maxSlowDownTries; ++iSlowDown) {
+                    shortcutRampNDVectOut.back().GetX0Vect(x0Vect);
+                    shortcutRampNDVectOut.back().GetV0Vect(v0Vect);
 #ifdef SMOOTHER_TIMING_DEBUG
                     _nCallsInterpolator += 1;
                     _tStartInterpolator = utils::GetMicroTime();
 #endif
-                    bool res = _interpolator.ComputeArbitraryVelNDTrajectory(x0Vect, x1Vect, v0Vect, v1Vect, _parameters->_vConfigLowerLimit, _parameters->_vConfigUpperLimit, vellimits, accellimits, shortcutRampNDVect, false);
+                    bool res2 = _interpolator.ComputeArbitraryVelNDTrajectory(x0Vect, x1Vect, v0Vect, v1Vect, _parameters->_vConfigLowerLimit, _parameters->_vConfigUpperLimit, vellimits, accellimits, shortcutRampNDVect, true);
 #ifdef SMOOTHER_TIMING_DEBUG
                     _tEndInterpolator = utils::GetMicroTime();
                     _totalTimeInterpolator += 0.000001f*(float)(_tEndInterpolator - _tStartInterpolator);
 #endif
-                    iIterProgress += 0x1000;
-                    if( !res ) {
-                        RAVELOG_VERBOSE_FORMAT("env=%d: shortcut iter = %d/%d, initial interpolation failed.\n", GetEnv()->GetId()%iters%numIters);
+                    if( !res2 ) {
+                        // This may be because we cannot fix joint limit violation
+                        RAVELOG_WARN_FORMAT("env=%d: failed to InterpolateArbitraryVelND to correct the final velocity", GetEnv()->GetId());
+                        retcheck.retcode = CFO_FinalValuesNotReached;
                         break;
                     }
 
-                    // Check if the shortcut makes a significant improvement
-                    dReal segmentTime = 0;
+                    dReal lastSegmentTime = 0;
                     FOREACHC(itrampnd, shortcutRampNDVect) {
-                        segmentTime += itrampnd->GetDuration();
+                        lastSegmentTime += itrampnd->GetDuration();
                     }
-                    if( segmentTime + minTimeStep > t1 - t0 ) {
-                        RAVELOG_VERBOSE_FORMAT("env=%d: shortcut iter = %d/%d, rejecting shortcut from t0 = %.15e to t1 = %.15e, %.15e > %.15e, minTimeStep = %.15e, final trajectory duration = %.15e s.",
-                                               GetEnv()->GetId()%iters%numIters%t0%t1%segmentTime%(t1 - t0)%minTimeStep%parabolicpath.GetDuration());
+                    if( lastSegmentTime - shortcutRampNDVectOut.back().GetDuration() > allowedStretchTime ) {
+                        RAVELOG_VERBOSE_FORMAT("env=%d: the modified last segment duration is too long to be useful(%.15e s.)", GetEnv()->GetId()%lastSegmentTime);
+                        retcheck.retcode = CFO_FinalValuesNotReached;
                         break;
                     }
 
-                    if( _CallCallbacks(_progress) == PA_Interrupt ) {
-                        return -1;
+                    retcheck = _feasibilitychecker.Check2(shortcutRampNDVect, 0xffff, shortcutRampNDVectOut1);
+                    if( retcheck.retcode != 0 ) {
+                        RAVELOG_VERBOSE_FORMAT("env=%d: final segment fixing failed. retcode = 0x%x", GetEnv()->GetId()%retcheck.retcode);
+                        break;
                     }
-                    iIterProgress += 0x1000;
+                    else if( retcheck.bDifferentVelocity ) {
+                        RAVELOG_WARN_FORMAT("env=%d: after final segment fixing, shortcutRampND does not end at the desired velocity", GetEnv()->GetId());
+                        retcheck.retcode = CFO_FinalValuesNotReached;
+                        break;
+                    }
+                    else {
+                        // Otherwise, this segment is good.
+                        RAVELOG_VERBOSE_FORMAT("env=%d: final velocity correction for the last segment successful", GetEnv()->GetId());
+                        shortcutRampNDVectOut.pop_back();
+                        shortcutRampNDVectOut.insert(shortcutRampNDVectOut.end(), shortcutRampNDVectOut1.begin(), shortcutRampNDVectOut1.end());
+
+                        // Check consistency
+                        if( IS_DEBUGLEVEL(Level_Verbose) ) {
+                            shortcutRampNDVectOut.front().GetX0Vect(x0Vect);
+                            shortcutRampNDVectOut.back().GetX1Vect(x1Vect);
+                            shortcutRampNDVectOut.front().GetV0Vect(v0Vect);
+                            shortcutRampNDVectOut.back().GetV1Vect(v1Vect);
+                            RampOptimizer::ParabolicCheckReturn parabolicret = RampOptimizer::CheckRampNDs(shortcutRampNDVectOut, _parameters->_vConfigLowerLimit, _parameters->_vConfigUpperLimit, _parameters->_vConfigVelocityLimit, _parameters->_vConfigAccelerationLimit, x0Vect, x1Vect, v0Vect, v1Vect);
+                            OPENRAVE_ASSERT_OP(parabolicret, ==, RampOptimizer::PCR_Normal);
+                        }
+                    }
+                }
+                else {
+                    RAVELOG_VERBOSE_FORMAT("env=%d: new shortcut is aligned with boundary values after running Check2", GetEnv()->GetId());
+                    break;
+                }
+            } while (0);
+            // Finished checking constraints. Now see what retcheck.retcode is
+            iIterProgress += 0x1000;
 
-                    RampOptimizer::CheckReturn retcheck(0);
-                    iIterProgress += 0x10;
+            if( retcheck.retcode == 0 ) {
+                // Shortcut is successful.
+                bSuccess = true;
+                break;
+            }
+            else if( retcheck.retcode == CFO_CheckTimeBasedConstraints ) {
+                // CFO_CheckTimeBasedConstraints can be returned because of two things: torque limit violation and manip constraint violation
+
+                // Scale down vellimits and/or accellimits
+                if( _bmanipconstraints && _manipconstraintchecker ) {
+                    // Scale down vellimits and accellimits independently according to the violated constraint (manipspeed/manipaccel)
+                    if( iSlowDown == 0 ) {
+                        // Try computing estimates of vellimits and accellimits before scaling down
+
+                        {// Need to make sure that x0, x1, v0, v1 hold the correct values
+                            rampndVect[i0].EvalPos(u0, x0Vect);
+                            rampndVect[i1].EvalPos(u1, x1Vect);
+                            rampndVect[i0].EvalVel(u0, v0Vect);
+                            rampndVect[i1].EvalVel(u1, v1Vect);
+                        }
 
-                    do { // Start checking constraints.
-                        if( _parameters->SetStateValues(x1Vect) != 0 ) {
-                            std::stringstream s;
-                            s << std::setprecision(RampOptimizer::g_nPrec) << "x1 = [";
-                            SerializeValues(s, x1Vect);
-                            s << "];";
-                            RAVELOG_VERBOSE_FORMAT("env=%d: shortcut iter = %d/%d, cannot set state: %s", GetEnv()->GetId()%iters%numIters%s.str());
-                            retcheck.retcode = CFO_StateSettingError;
+                        if( _parameters->SetStateValues(x0Vect) != 0 ) {
+                            RAVELOG_VERBOSE("state setting error");
                             break;
                         }
-                        _parameters->_getstatefn(x1Vect);
-                        iIterProgress += 0x10;
-
-                        retcheck = _feasibilitychecker.Check2(shortcutRampNDVect, 0xffff, shortcutRampNDVectOut);
-                        iIterProgress += 0x10;
+                        _manipconstraintchecker->GetMaxVelocitiesAccelerations(v0Vect, vellimits, accellimits);
 
-                        if( retcheck.retcode != 0 ) {
-                            // Shortcut does not pass CheckPathAllConstraints
-                            RAVELOG_VERBOSE_FORMAT("env=%d: shortcut iter = %d/%d, iSlowDown = %d, shortcut does not pass Check2, retcode = 0x%x.\n", GetEnv()->GetId()%iters%numIters%iSlowDown%retcheck.retcode);
+                        if( _parameters->SetStateValues(x1Vect) != 0 ) {
+                            RAVELOG_VERBOSE("state setting error");
                             break;
                         }
+                        _manipconstraintchecker->GetMaxVelocitiesAccelerations(v1Vect, vellimits, accellimits);
 
-                        // CheckPathAllConstraints (called viaSegmentFeasible2 inside Check2) may be
-                        // modifying the original shortcutcurvesnd due to constraints. Therefore, we
-                        // have to reset vellimits and accellimits so that they are above those of
-                        // the modified trajectory.
-                        for (size_t irampnd = 0; irampnd < shortcutRampNDVectOut.size(); ++irampnd) {
-                            for (size_t jdof = 0; jdof < shortcutRampNDVectOut[irampnd].GetDOF(); ++jdof) {
-                                dReal fminvel = max(RaveFabs(shortcutRampNDVectOut[irampnd].GetV0At(jdof)), RaveFabs(shortcutRampNDVectOut[irampnd].GetV1At(jdof)));
-                                if( vellimits[jdof] < fminvel ) {
-                                    vellimits[jdof] = fminvel;
-                                }
+                        for (size_t j = 0; j < _parameters->_vConfigVelocityLimit.size(); ++j) {
+                            dReal fMinVel = max(RaveFabs(v0Vect[j]), RaveFabs(v1Vect[j]));
+                            if( vellimits[j] < fMinVel ) {
+                                vellimits[j] = fMinVel;
                             }
                         }
-
-                        // The interpolated segment passes constraints checking. Now see if it is modified such that it does not end with the desired velocity.
-                        if( retcheck.bDifferentVelocity && shortcutRampNDVectOut.size() > 0 ) {
-                            RAVELOG_VERBOSE_FORMAT("env=%d: new shortcut is *not* aligned with boundary values after running Check2. Start fixing the last segment.", GetEnv()->GetId());
-                            // Modification inside Check2 results in the shortcut trajectory not ending at the desired velocity v1.
-                            dReal allowedStretchTime = (t1 - t0) - (segmentTime + minTimeStep); // the time that this segment is allowed to stretch out such that it is still a useful shortcut
-
-                            shortcutRampNDVectOut.back().GetX0Vect(x0Vect);
-                            shortcutRampNDVectOut.back().GetV0Vect(v0Vect);
-#ifdef SMOOTHER_TIMING_DEBUG
-                            _nCallsInterpolator += 1;
-                            _tStartInterpolator = utils::GetMicroTime();
-#endif
-                            bool res2 = _interpolator.ComputeArbitraryVelNDTrajectory(x0Vect, x1Vect, v0Vect, v1Vect, _parameters->_vConfigLowerLimit, _parameters->_vConfigUpperLimit, vellimits, accellimits, shortcutRampNDVect, true);
-#ifdef SMOOTHER_TIMING_DEBUG
-                            _tEndInterpolator = utils::GetMicroTime();
-                            _totalTimeInterpolator += 0.000001f*(float)(_tEndInterpolator - _tStartInterpolator);
-#endif
-                            if( !res2 ) {
-                                // This may be because we cannot fix joint limit violation
-                                RAVELOG_WARN_FORMAT("env=%d: failed to InterpolateArbitraryVelND to correct the final velocity", GetEnv()->GetId());
-                                retcheck.retcode = CFO_FinalValuesNotReached;
+                    }
+                    else {
+                        // After computing the new vellimits and accellimits and they don't work, we gradually scale vellimits/accellimits down
+                        dReal fVelMult, fAccelMult;
+                        if( retcheck.fMaxManipSpeed > _parameters->maxmanipspeed ) {
+                            // Manipspeed is violated. We don't scale down accellimts.
+                            fVelMult = retcheck.fTimeBasedSurpassMult;
+                            fCurVelMult *= fVelMult;
+                            if( fCurVelMult < 0.01 ) {
+                                RAVELOG_VERBOSE_FORMAT("env=%d: shortcut iter = %d/%d: fCurVelMult is too small (%.15e). continue to the next iteration", GetEnv()->GetId()%iters%numIters%fCurVelMult);
                                 break;
                             }
-
-                            dReal lastSegmentTime = 0;
-                            FOREACHC(itrampnd, shortcutRampNDVect) {
-                                lastSegmentTime += itrampnd->GetDuration();
-                            }
-                            if( lastSegmentTime - shortcutRampNDVectOut.back().GetDuration() > allowedStretchTime ) {
-                                RAVELOG_VERBOSE_FORMAT("env=%d: the modified last segment duration is too long to be useful(%.15e s.)", GetEnv()->GetId()%lastSegmentTime);
-                                retcheck.retcode = CFO_FinalValuesNotReached;
-                                break;
+                            for (size_t j = 0; j < vellimits.size(); ++j) {
+                                dReal fMinVel = max(RaveFabs(v0Vect[j]), RaveFabs(v1Vect[j]));
+                                vellimits[j] = max(fMinVel, fVelMult * vellimits[j]);
                             }
+                        }
 
-                            retcheck = _feasibilitychecker.Check2(shortcutRampNDVect, 0xffff, shortcutRampNDVectOut1);
-                            if( retcheck.retcode != 0 ) {
-                                RAVELOG_VERBOSE_FORMAT("env=%d: final segment fixing failed. retcode = 0x%x", GetEnv()->GetId()%retcheck.retcode);
-                                break;
-                            }
-                            else if( retcheck.bDifferentVelocity ) {
-                                RAVELOG_WARN_FORMAT("env=%d: after final segment fixing, shortcutRampND does not end at the desired velocity", GetEnv()->GetId());
-                                retcheck.retcode = CFO_FinalValuesNotReached;
+                        if( retcheck.fMaxManipAccel > _parameters->maxmanipaccel ) {
+                            // Manipaccel is violated. We scale both vellimits and accellimits down.
+                            fAccelMult = retcheck.fTimeBasedSurpassMult;
+                            fCurAccelMult *= fAccelMult;
+                            if( fCurAccelMult < 0.01 ) {
+                                RAVELOG_VERBOSE_FORMAT("env=%d: shortcut iter = %d/%d: fCurAccelMult is too small (%.15e). continue to the next iteration", GetEnv()->GetId()%iters%numIters%fCurAccelMult);
                                 break;
                             }
-                            else {
-                                // Otherwise, this segment is good.
-                                RAVELOG_VERBOSE_FORMAT("env=%d: final velocity correction for the last segment successful", GetEnv()->GetId());
-                                shortcutRampNDVectOut.pop_back();
-                                shortcutRampNDVectOut.insert(shortcutRampNDVectOut.end(), shortcutRampNDVectOut1.begin(), shortcutRampNDVectOut1.end());
-
-                                // Check consistency
-                                if( IS_DEBUGLEVEL(Level_Verbose) ) {
-                                    shortcutRampNDVectOut.front().GetX0Vect(x0Vect);
-                                    shortcutRampNDVectOut.back().GetX1Vect(x1Vect);
-                                    shortcutRampNDVectOut.front().GetV0Vect(v0Vect);
-                                    shortcutRampNDVectOut.back().GetV1Vect(v1Vect);
-                                    RampOptimizer::ParabolicCheckReturn parabolicret = RampOptimizer::CheckRampNDs(shortcutRampNDVectOut, _parameters->_vConfigLowerLimit, _parameters->_vConfigUpperLimit, _parameters->_vConfigVelocityLimit, _parameters->_vConfigAccelerationLimit, x0Vect, x1Vect, v0Vect, v1Vect);
-                                    OPENRAVE_ASSERT_OP(parabolicret, ==, RampOptimizer::PCR_Normal);
+                            {
+                                fVelMult = RaveSqrt(fAccelMult); // larger scaling factor, less reduction. Use a square root here since the velocity has the factor t while the acceleration has t^2
+                                fCurVelMult *= fVelMult;
+                                if( fCurVelMult < 0.01 ) {
+                                    RAVELOG_VERBOSE_FORMAT("env=%d: shortcut iter = %d/%d: fCurVelMult is too small (%.15e). continue to the next iteration", GetEnv()->GetId()%iters%numIters%fCurVelMult);
+                                    break;
+                                }
+                                for (size_t j = 0; j < vellimits.size(); ++j) {
+                                    dReal fMinVel = max(RaveFabs(v0Vect[j]), RaveFabs(v1Vect[j]));
+                                    vellimits[j] = max(fMinVel, fVelMult * vellimits[j]);
                                 }
                             }
+                            for (size_t j = 0; j < accellimits.size(); ++j) {
+                                accellimits[j] *= fAccelMult;
+                            }
                         }
-                        else {
-                            RAVELOG_VERBOSE_FORMAT("env=%d: new shortcut is aligned with boundary values after running Check2", GetEnv()->GetId());
-                            break;
-                        }
-                    } while (0);
-                    // Finished checking constraints. Now see what retcheck.retcode is
-                    iIterProgress += 0x1000;
 
-                    if( retcheck.retcode == 0 ) {
-                        // Shortcut is successful.
-                        bSuccess = true;
+                        numSlowDowns += 1;
+                        RAVELOG_VERBOSE_FORMAT("env=%d: fTimeBasedSurpassMult = %.15e; fCurVelMult = %.15e; fCurAccelMult = %.15e", GetEnv()->GetId()%retcheck.fTimeBasedSurpassMult%fCurVelMult%fCurAccelMult);
+                    }
+                }
+                else {
+                    // Scale down vellimits and accellimits using the normal procedure
+                    fCurVelMult *= retcheck.fTimeBasedSurpassMult;
+                    fCurAccelMult *= retcheck.fTimeBasedSurpassMult;
+                    if( fCurVelMult < 0.01 ) {
+                        RAVELOG_VERBOSE_FORMAT("env=%d: shortcut iter = %d/%d: fCurVelMult is too small (%.15e). continue to the next iteration", GetEnv()->GetId()%iters%numIters%fCurVelMult);
+                        break;
+                    }
+                    if( fCurAccelMult < 0.01 ) {
+                        RAVELOG_VERBOSE_FORMAT("env=%d: shortcut iter = %d/%d: fCurAccelMult is too small (%.15e). continue to the next iteration", GetEnv()->GetId()%iters%numIters%fCurAccelMult);
                         break;
                     }
-                    else if( retcheck.retcode == CFO_CheckTimeBasedConstraints ) {
-                        // CFO_CheckTimeBasedConstraints can be returned because of two things: torque limit violation and manip constraint violation
-
-                        // Scale down vellimits and/or accellimits
-                        if( _bmanipconstraints && _manipconstraintchecker ) {
-                            // Scale down vellimits and accellimits independently according to the violated constraint (manipspeed/manipaccel)
-                            if( iSlowDown == 0 ) {
-                                // Try computing estimates of vellimits and accellimits before scaling down
-
-                                {// Need to make sure that x0, x1, v0, v1 hold the correct values
-                                    rampndVect[i0].EvalPos(u0, x0Vect);
-                                    rampndVect[i1].EvalPos(u1, x1Vect);
-                                    rampndVect[i0].EvalVel(u0, v0Vect);
-                                    rampndVect[i1].EvalVel(u1, v1Vect);
-                                }
 
-                                if( _parameters->SetStateValues(x0Vect) != 0 ) {
-                                    RAVELOG_VERBOSE("state setting error");
-                                    break;
-                                }
-                                _manipconstraintchecker->GetMaxVelocitiesAccelerations(v0Vect, vellimits, accellimits);
+                    numSlowDowns += 1;
+                    for (size_t j = 0; j < vellimits.size(); ++j) {
+                        dReal fMinVel =  max(RaveFabs(v0Vect[j]), RaveFabs(v1Vect[j]));
+                        vellimits[j] = max(fMinVel, retcheck.fTimeBasedSurpassMult * vellimits[j]);
+                        accellimits[j] *= retcheck.fTimeBasedSurpassMult;
+                    }
+                }
+            }
+            else {
+                RAVELOG_VERBOSE_FORMAT("env=%d: shortcut iter = %d/%d, rejecting shortcut due to constraint 0x%x", GetEnv()->GetId()%iters%numIters%retcheck.retcode);
+                break;
+            }
+            iIterProgress += 0x1000;
+        } // Finished slowing down the shortcut
 
-                                if( _parameters->SetStateValues(x1Vect) != 0 ) {
-                                    RAVELOG_VERBOSE("state setting error");
-                                    break;
-                                }
-                                _manipconstraintchecker->GetMaxVelocitiesAccelerations(v1Vect, vellimits, accellimits);
+        if( !bSuccess ) {
+            return 1;
+        }
 
-                                for (size_t j = 0; j < _parameters->_vConfigVelocityLimit.size(); ++j) {
-                                    dReal fMinVel = max(RaveFabs(v0Vect[j]), RaveFabs(v1Vect[j]));
-                                    if( vellimits[j] < fMinVel ) {
-                                        vellimits[j] = fMinVel;
-                                    }
-                                }
-                            }
-                            else {
-                                // After computing the new vellimits and accellimits and they don't work, we gradually scale vellimits/accellimits down
-                                dReal fVelMult, fAccelMult;
-                                if( retcheck.fMaxManipSpeed > _parameters->maxmanipspeed ) {
-                                    // Manipspeed is violated. We don't scale down accellimts.
-                                    fVelMult = retcheck.fTimeBasedSurpassMult;
-                                    fCurVelMult *= fVelMult;
-                                    if( fCurVelMult < 0.01 ) {
-                                        RAVELOG_VERBOSE_FORMAT("env=%d: shortcut iter = %d/%d: fCurVelMult is too small (%.15e). continue to the next iteration", GetEnv()->GetId()%iters%numIters%fCurVelMult);
-                                        break;
-                                    }
-                                    for (size_t j = 0; j < vellimits.size(); ++j) {
-                                        dReal fMinVel = max(RaveFabs(v0Vect[j]), RaveFabs(v1Vect[j]));
-                                        vellimits[j] = max(fMinVel, fVelMult * vellimits[j]);
-                                    }
-                                }
+        if( shortcutRampNDVectOut.size() == 0 ) {
+            RAVELOG_WARN("shortcutpath is empty!\n");
+            return 1;
+        }
 
-                                if( retcheck.fMaxManipAccel > _parameters->maxmanipaccel ) {
-                                    // Manipaccel is violated. We scale both vellimits and accellimits down.
-                                    fAccelMult = retcheck.fTimeBasedSurpassMult;
-                                    fCurAccelMult *= fAccelMult;
-                                    if( fCurAccelMult < 0.01 ) {
-                                        RAVELOG_VERBOSE_FORMAT("env=%d: shortcut iter = %d/%d: fCurAccelMult is too small (%.15e). continue to the next iteration", GetEnv()->GetId()%iters%numIters%fCurAccelMult);
-                                        break;
-                                    }
-                                    {
-                                        fVelMult = RaveSqrt(fAccelMult); // larger scaling factor, less reduction. Use a square root here since the velocity has the factor t while the acceleration has t^2
-                                        fCurVelMult *= fVelMult;
-                                        if( fCurVelMult < 0.01 ) {
-                                            RAVELOG_VERBOSE_FORMAT("env=%d: shortcut iter = %d/%d: fCurVelMult is too small (%.15e). continue to the next iteration", GetEnv()->GetId()%iters%numIters%fCurVelMult);
-                                            break;
-                                        }
-                                        for (size_t j = 0; j < vellimits.size(); ++j) {
-                                            dReal fMinVel = max(RaveFabs(v0Vect[j]), RaveFabs(v1Vect[j]));
-                                            vellimits[j] = max(fMinVel, fVelMult * vellimits[j]);
-                                        }
-                                    }
-                                    for (size_t j = 0; j < accellimits.size(); ++j) {
-                                        accellimits[j] *= fAccelMult;
-                                    }
-                                }
+        return 0;
+    }
 
-                                numSlowDowns += 1;
-                                RAVELOG_VERBOSE_FORMAT("env=%d: fTimeBasedSurpassMult = %.15e; fCurVelMult = %.15e; fCurAccelMult = %.15e", GetEnv()->GetId()%retcheck.fTimeBasedSurpassMult%fCurVelMult%fCurAccelMult);
-                            }
-                        }
-                        else {
-                            // Scale down vellimits and accellimits using the normal procedure
-                            fCurVelMult *= retcheck.fTimeBasedSurpassMult;
-                            fCurAccelMult *= retcheck.fTimeBasedSurpassMult;
-                            if( fCurVelMult < 0.01 ) {
-                                RAVELOG_VERBOSE_FORMAT("env=%d: shortcut iter = %d/%d: fCurVelMult is too small (%.15e). continue to the next iteration", GetEnv()->GetId()%iters%numIters%fCurVelMult);
-                                break;
-                            }
-                            if( fCurAccelMult < 0.01 ) {
-                                RAVELOG_VERBOSE_FORMAT("env=%d: shortcut iter = %d/%d: fCurAccelMult is too small (%.15e). continue to the next iteration", GetEnv()->GetId()%iters%numIters%fCurAccelMult);
-                                break;
-                            }
+    /// \brief Shortcut parabolicpath by rounds of _nShortcutCandidates candidate shortcuts which are
+    /// checked concurrently on clones of the environment. The candidates are sampled in this thread
+    /// the same way as in _Shortcut, and at the end of each round the non-overlapping successful ones
+    /// are committed in the order of decreasing time savings. So the result only depends on the seed
+    /// and on _nShortcutCandidates, not on the number of threads. Return the number of successful
+    /// shortcuts.
+    int _ShortcutParallel(RampOptimizer::ParabolicPath& parabolicpath, int numIters, RampOptimizer::RandomNumberGeneratorBase* rng, dReal minTimeStep)
+    {
+        std::string fnname;
+        bool bdefaultfunctions;
+        {
+            EnvironmentMutex::scoped_lock lock(GetEnv()->GetMutex());
+            bdefaultfunctions = AreDefaultPlannerFunctions(GetEnv(), _robot, _parameters, fnname);
+        }
+        if( !bdefaultfunctions ) {
+            RAVELOG_WARN_FORMAT("env=%d: %s of the parameters cannot be re-created on the environment clones, shortcutting serially", GetEnv()->GetId()%fnname);
+            return _Shortcut(parabolicpath, numIters, rng, minTimeStep);
+        }
+        int numworkers = min(_nShortcutCandidates, _nNumThreads > 0 ? _nNumThreads : max(1, (int)boost::thread::hardware_concurrency()));
+        if( !_InitShortcutWorkers(numworkers) ) {
+            RAVELOG_WARN_FORMAT("env=%d: failed to set up the shortcut workers, shortcutting serially", GetEnv()->GetId());
+            return _Shortcut(parabolicpath, numIters, rng, minTimeStep);
+        }
 
-                            numSlowDowns += 1;
-                            for (size_t j = 0; j < vellimits.size(); ++j) {
-                                dReal fMinVel =  max(RaveFabs(v0Vect[j]), RaveFabs(v1Vect[j]));
-                                vellimits[j] = max(fMinVel, retcheck.fTimeBasedSurpassMult * vellimits[j]);
-                                accellimits[j] *= retcheck.fTimeBasedSurpassMult;
-                            }
-                        }
-                    }
-                    else {
-                        RAVELOG_VERBOSE_FORMAT("env=%d: shortcut iter = %d/%d, rejecting shortcut due to constraint 0x%x", GetEnv()->GetId()%iters%numIters%retcheck.retcode);
-                        break;
-                    }
-                    iIterProgress += 0x1000;
-                } // Finished slowing down the shortcut
+        int numShortcuts = 0;
 
-                if( !bSuccess ) {
-                    // Shortcut failed. Continue to the next iteration.
+        uint32_t fileindex;
+        if( !!_logginguniformsampler ) {
+            fileindex = _logginguniformsampler->SampleSequenceOneUInt32();
+        }
+        else {
+            fileindex = RaveRandomInt();
+        }
+        fileindex = fileindex%_fileIndexMod;
+        _DumpParabolicPath(parabolicpath, _dumplevel, fileindex, 0);
+
+        std::vector<ShortcutCandidate>& vcandidates = _vshortcutcandidates;
+        if( (int)vcandidates.size() < _nShortcutCandidates ) {
+            vcandidates.resize(_nShortcutCandidates);
+        }
+        std::vector< std::pair<dReal, int> >& vsortedcandidates = _vsortedshortcutcandidates; // (-time saved, candidate index)
+        std::vector< std::pair<dReal, int> >& vcommitted = _vcommittedshortcutcandidates;     // (-t0, candidate index)
+        std::vector<dReal>& x0Vect = _cacheX0Vect, &x1Vect = _cacheX1Vect, &v0Vect = _cacheV0Vect, &v1Vect = _cacheV1Vect;
+        const dReal tOriginal = parabolicpath.GetDuration();
+        dReal tTotal = tOriginal;
+
+        // Same parameters as in _Shortcut, a round counts as many iterations as candidates it samples
+        int numSlowDowns = 0;
+        dReal fiSearchVelAccelMult = 1.0/_parameters->fSearchVelAccelMult;
+        dReal fStartTimeVelMult = 1.0;
+        dReal fStartTimeAccelMult = 1.0;
+
+        size_t nItersFromPrevSuccessful = 0;
+        size_t nCutoffIters = min(100, numIters/2);
+
+        dReal score = 1.0;
+        dReal currentBestScore = 1.0;
+        dReal iCurrentBestScore = 1.0;
+        dReal cutoffRatio = 1e-3;
+
+        int iters = 0;
+        int numrounds = 0;
+        while( iters < numIters && nItersFromPrevSuccessful < nCutoffIters ) {
+            if( tTotal < minTimeStep ) {
+                RAVELOG_VERBOSE_FORMAT("env=%d; tTotal = %.15e is too short to continue shortcutting", GetEnv()->GetId()%tTotal);
+                break;
+            }
+
+            // Sample the candidates of this round
+            size_t numcandidates = 0;
+            while( (int)numcandidates < _nShortcutCandidates && iters < numIters && nItersFromPrevSuccessful < nCutoffIters ) {
+                ShortcutCandidate& candidate = vcandidates[numcandidates];
+                _SampleShortcutTimes(iters, numIters, tTotal, rng, candidate.t0, candidate.t1, fStartTimeVelMult, fStartTimeAccelMult);
+                candidate.iter = iters;
+                ++iters;
+                nItersFromPrevSuccessful += 1;
+                if( candidate.t1 - candidate.t0 < minTimeStep ) {
                     continue;
                 }
+                candidate.fStartTimeVelMult = fStartTimeVelMult;
+                candidate.fStartTimeAccelMult = fStartTimeAccelMult;
+                candidate.ret = 1;
+                ++numcandidates;
+            }
+            if( numcandidates == 0 ) {
+                continue;
+            }
 
-                if( shortcutRampNDVectOut.size() == 0 ) {
-                    RAVELOG_WARN("shortcutpath is empty!\n");
-                    continue;
+            _progress._iteration += numcandidates;
+            if( _CallCallbacks(_progress) == PA_Interrupt ) {
+                return -1;
+            }
+
+            // Check the candidates, this thread works with the first worker and wakes up the threads of the others
+            ++numrounds;
+            {
+                boost::mutex::scoped_lock lockcandidates(_mutexshortcutcandidates);
+                _nNextShortcutCandidate = 0;
+                _shortcutround.pparabolicpath = &parabolicpath;
+                _shortcutround.numcandidates = numcandidates;
+                _shortcutround.minTimeStep = minTimeStep;
+                _shortcutround.numIters = numIters;
+                _nShortcutThreadsRunning = _vshortcutthreads.size();
+                ++_nShortcutRound;
+                _condShortcutRound.notify_all();
+            }
+            _CheckShortcutCandidates(0, numcandidates, parabolicpath, minTimeStep, numIters);
+            {
+                boost::mutex::scoped_lock lockcandidates(_mutexshortcutcandidates);
+                while(_nShortcutThreadsRunning > 0) {
+                    _condShortcutRoundDone.wait(lockcandidates);
                 }
+            }
 
-                // Now this shortcut is really successful
+            // Commit the best non-overlapping shortcuts. Shortcuts are applied from the end of the
+            // path so that the times of the remaining ones stay valid.
+            vsortedcandidates.resize(0);
+            for(size_t icandidate = 0; icandidate < numcandidates; ++icandidate) {
+                ShortcutCandidate& candidate = vcandidates[icandidate];
+                if( candidate.ret < 0 ) {
+                    return -1;
+                }
+                else if( candidate.ret == 0 ) {
+                    dReal segmentTime = 0;
+                    FOREACHC(itrampnd, candidate.vrampnds) {
+                        segmentTime += itrampnd->GetDuration();
+                    }
+                    candidate.diff = (candidate.t1 - candidate.t0) - segmentTime;
+                    vsortedcandidates.push_back(std::make_pair(-candidate.diff, (int)icandidate));
+                }
+            }
+            if( vsortedcandidates.size() == 0 ) {
+                continue;
+            }
+            std::sort(vsortedcandidates.begin(), vsortedcandidates.end());
+
+            vcommitted.resize(0);
+            FOREACHC(itsorted, vsortedcandidates) {
+                const ShortcutCandidate& candidate = vcandidates[itsorted->second];
+                bool bOverlap = false;
+                FOREACHC(itcommitted, vcommitted) {
+                    const ShortcutCandidate& committed = vcandidates[itcommitted->second];
+                    if( candidate.t0 < committed.t1 && committed.t0 < candidate.t1 ) {
+                        bOverlap = true;
+                        break;
+                    }
+                }
+                if( !bOverlap ) {
+                    vcommitted.push_back(std::make_pair(-candidate.t0, itsorted->second));
+                }
+            }
+
+            // Keep track of the multipliers of the best shortcut
+            const ShortcutCandidate& bestcandidate = vcandidates[vsortedcandidates[0].second];
+            fStartTimeVelMult = min(1.0, bestcandidate.fCurVelMult * fiSearchVelAccelMult);
+            fStartTimeAccelMult = min(1.0, bestcandidate.fCurAccelMult * fiSearchVelAccelMult);
+
+            std::sort(vcommitted.begin(), vcommitted.end());
+            dReal totaldiff = 0;
+            FOREACHC(itcommitted, vcommitted) {
+                const ShortcutCandidate& candidate = vcandidates[itcommitted->second];
                 ++numShortcuts;
+                numSlowDowns += candidate.numSlowDowns;
+                totaldiff += candidate.diff;
 
                 // Keep track of zero-velocity waypoints
-                dReal segmentTime = 0;
-                FOREACHC(itrampnd, shortcutRampNDVectOut) {
-                    segmentTime += itrampnd->GetDuration();
-                }
-                dReal diff = (t1 - t0) - segmentTime;
-
                 size_t writeIndex = 0;
                 for (size_t readIndex = 0; readIndex < _zeroVelPoints.size(); ++readIndex) {
-                    if( _zeroVelPoints[readIndex] <= t0 ) {
+                    if( _zeroVelPoints[readIndex] <= candidate.t0 ) {
                         writeIndex += 1;
                     }
-                    else if( _zeroVelPoints[readIndex] <= t1 ) {
+                    else if( _zeroVelPoints[readIndex] <= candidate.t1 ) {
                         // Do nothing.
                     }
                     else {
-                        _zeroVelPoints[writeIndex++] = _zeroVelPoints[readIndex] - diff;
+                        _zeroVelPoints[writeIndex++] = _zeroVelPoints[readIndex] - candidate.diff;
                     }
                 }
                 _zeroVelPoints.resize(writeIndex);
 
-                // Keep track of the multipliers
-                fStartTimeVelMult = min(1.0, fCurVelMult * fiSearchVelAccelMult);
-                fStartTimeAccelMult = min(1.0, fCurAccelMult * fiSearchVelAccelMult);
+                parabolicpath.ReplaceSegment(candidate.t0, candidate.t1, candidate.vrampnds);
+            }
 
-                // Now replace the original trajectory segment by the shortcut
-                parabolicpath.ReplaceSegment(t0, t1, shortcutRampNDVectOut);
-                iIterProgress += 0x10000000;
+            // Check consistency
+            if( IS_DEBUGLEVEL(Level_Verbose) ) {
+                const std::vector<RampOptimizer::RampND>& rampndVect = parabolicpath.GetRampNDVect();
+                rampndVect.front().GetX0Vect(x0Vect);
+                rampndVect.back().GetX1Vect(x1Vect);
+                rampndVect.front().GetV0Vect(v0Vect);
+                rampndVect.back().GetV1Vect(v1Vect);
+                RampOptimizer::ParabolicCheckReturn parabolicret = RampOptimizer::CheckRampNDs(rampndVect, _parameters->_vConfigLowerLimit, _parameters->_vConfigUpperLimit, _parameters->_vConfigVelocityLimit, _parameters->_vConfigAccelerationLimit, x0Vect, x1Vect, v0Vect, v1Vect);
+                OPENRAVE_ASSERT_OP(parabolicret, ==, RampOptimizer::PCR_Normal);
+            }
 
-                rampndVect = parabolicpath.GetRampNDVect();
+            tTotal = parabolicpath.GetDuration();
+            RAVELOG_VERBOSE_FORMAT("env=%d: shortcut round %d (iter = %d/%d) committed %d/%d shortcuts, tTotal = %.15e", GetEnv()->GetId()%numrounds%iters%numIters%vcommitted.size()%vsortedcandidates.size()%tTotal);
 
-                // Check consistency
-                if( IS_DEBUGLEVEL(Level_Verbose) ) {
-                    rampndVect.front().GetX0Vect(x0Vect);
-                    rampndVect.back().GetX1Vect(x1Vect);
-                    rampndVect.front().GetV0Vect(v0Vect);
-                    rampndVect.back().GetV1Vect(v1Vect);
-                    RampOptimizer::ParabolicCheckReturn parabolicret = RampOptimizer::CheckRampNDs(rampndVect, _parameters->_vConfigLowerLimit, _parameters->_vConfigUpperLimit, _parameters->_vConfigVelocityLimit, _parameters->_vConfigAccelerationLimit, x0Vect, x1Vect, v0Vect, v1Vect);
-                    OPENRAVE_ASSERT_OP(parabolicret, ==, RampOptimizer::PCR_Normal);
-                }
-                iIterProgress += 0x10000000;
+            // Calculate the score
+            score = totaldiff/nItersFromPrevSuccessful;
+            if( score > currentBestScore) {
+                currentBestScore = score;
+                iCurrentBestScore = 1.0/currentBestScore;
+            }
+            nItersFromPrevSuccessful = 0;
 
-                tTotal = parabolicpath.GetDuration();
-                RAVELOG_VERBOSE_FORMAT("env=%d: shortcut iter = %d/%d successful, numSlowDowns = %d, tTotal = %.15e", GetEnv()->GetId()%iters%numIters%numSlowDowns%tTotal);
+            if( (score*iCurrentBestScore < cutoffRatio) && (numShortcuts > 5)) {
+                break;
+            }
+        }
 
-                // Calculate the score
-                score = diff/nItersFromPrevSuccessful;
-                if( score > currentBestScore) {
-                    currentBestScore = score;
-                    iCurrentBestScore = 1.0/currentBestScore;
+        RAVELOG_DEBUG_FORMAT("env=%d, finished parallel shortcutting at iter=%d after %d rounds of %d candidates with %d workers, successful=%d, slowdowns=%d, endTime: %.15e -> %.15e; diff = %.15e", GetEnv()->GetId()%iters%numrounds%_nShortcutCandidates%numworkers%numShortcuts%numSlowDowns%tOriginal%tTotal%(tOriginal - tTotal));
+        _DumpParabolicPath(parabolicpath, _dumplevel, fileindex, 1);
+
+        return numShortcuts;
+    }
+
+    /// \brief Thread of shortcut worker iworker, checks the candidates of every round started after
+    /// round nround until the threads are stopped.
+    void _ShortcutWorkerThread(int iworker, int nround)
+    {
+        while(1) {
+            ShortcutRound round;
+            {
+                boost::mutex::scoped_lock lockcandidates(_mutexshortcutcandidates);
+                while(!_bStopShortcutThreads && _nShortcutRound == nround) {
+                    _condShortcutRound.wait(lockcandidates);
                 }
-                nItersFromPrevSuccessful = 0;
+                if( _bStopShortcutThreads ) {
+                    break;
+                }
+                nround = _nShortcutRound;
+                round = _shortcutround;
+            }
+            _CheckShortcutCandidates(iworker, round.numcandidates, *round.pparabolicpath, round.minTimeStep, round.numIters);
+            {
+                boost::mutex::scoped_lock lockcandidates(_mutexshortcutcandidates);
+                if( --_nShortcutThreadsRunning == 0 ) {
+                    _condShortcutRoundDone.notify_all();
+                }
+            }
+        }
+    }
 
-                if( (score*iCurrentBestScore < cutoffRatio) && (numShortcuts > 5)) {
-                    // We have already shortcut for a bit (numShortcuts > 5). The progress made in
-                    // this iteration is below the curoff ratio. If we continue, it is unlikely that
-                    // we will make much more progress. So stop here.
+    /// \brief Start a thread for every shortcut worker except the first one, which is run by the
+    /// thread calling _ShortcutParallel. Has to be called between rounds.
+    void _StartShortcutThreads()
+    {
+        for(size_t iworker = _vshortcutthreads.size()+1; iworker < _vshortcutworkers.size(); ++iworker) {
+            _vshortcutthreads.push_back(boost::shared_ptr<boost::thread>(new boost::thread(boost::bind(&ParabolicSmoother2::_ShortcutWorkerThread, this, (int)iworker, _nShortcutRound))));
+        }
+    }
+
+    void _StopShortcutThreads()
+    {
+        {
+            boost::mutex::scoped_lock lockcandidates(_mutexshortcutcandidates);
+            _bStopShortcutThreads = true;
+            _condShortcutRound.notify_all();
+        }
+        FOREACH(itthread, _vshortcutthreads) {
+            (*itthread)->join();
+        }
+        _vshortcutthreads.resize(0);
+        _bStopShortcutThreads = false;
+    }
+
+    /// \brief Check the candidate shortcuts of the current round on the environment clone of worker
+    /// iworker until none is left. The candidates are taken in any order since the result of a
+    /// check does not depend on the worker.
+    void _CheckShortcutCandidates(int iworker, size_t numcandidates, const RampOptimizer::ParabolicPath& parabolicpath, dReal minTimeStep, int numIters)
+    {
+        ShortcutWorker& worker = _vshortcutworkers.at(iworker);
+        EnvironmentMutex::scoped_lock lock(worker._penv->GetMutex());
+        while(1) {
+            size_t icandidate;
+            {
+                boost::mutex::scoped_lock lockcandidates(_mutexshortcutcandidates);
+                if( _nNextShortcutCandidate >= numcandidates ) {
                     break;
                 }
+                icandidate = _nNextShortcutCandidate++;
+            }
+            ShortcutCandidate& candidate = _vshortcutcandidates[icandidate];
+            uint32_t iIterProgress = 0;
+            candidate.numSlowDowns = 0;
+            try {
+                candidate.ret = worker._smoother->_ComputeShortcut(parabolicpath, candidate.t0, candidate.t1, minTimeStep, candidate.iter, numIters, candidate.fStartTimeVelMult, candidate.fStartTimeAccelMult, candidate.fCurVelMult, candidate.fCurAccelMult, candidate.numSlowDowns, iIterProgress, candidate.vrampnds);
             }
             catch (const std::exception& ex) {
-                RAVELOG_WARN_FORMAT("env=%d: An exception happened during shortcut iteration progress = 0x%x: %s", GetEnv()->GetId()%iIterProgress%ex.what());
+                RAVELOG_WARN_FORMAT("env=%d: An exception happened during shortcut iteration progress = 0x%x: %s", worker._penv->GetId()%iIterProgress%ex.what());
+                candidate.ret = 1;
             }
         }
+    }
 
-        // Report status
-        if( iters == numIters ) {
-            RAVELOG_DEBUG_FORMAT("env=%d, finished at shortcut iter=%d (normal exit), successful=%d, slowdowns=%d, endTime: %.15e -> %.15e; diff = %.15e", GetEnv()->GetId()%iters%numShortcuts%numSlowDowns%tOriginal%tTotal%(tOriginal - tTotal));
+    /// \brief Return a key of the environment that changes whenever the clones of the shortcut
+    /// workers have to be cloned again. The state of the bodies used by the configuration
+    /// specification and of the bodies they grab is left out since the smoothing itself changes
+    /// it, these bodies are returned in vusedbodies so that their state can be copied instead.
+    std::string _GetShortcutWorkersEnvironmentKey(std::vector<KinBodyPtr>& vusedbodies)
+    {
+        _parameters->_configurationspecification.ExtractUsedBodies(GetEnv(), vusedbodies);
+        std::vector<KinBodyPtr> vbodies, vgrabbed;
+        GetEnv()->GetBodies(vbodies);
+        std::set<KinBodyPtr> setmovedbodies(vusedbodies.begin(), vusedbodies.end());
+        FOREACHC(itbody, vusedbodies) {
+            if( (*itbody)->IsRobot() ) {
+                RaveInterfaceCast<RobotBase>(*itbody)->GetGrabbed(vgrabbed);
+                setmovedbodies.insert(vgrabbed.begin(), vgrabbed.end());
+            }
         }
-        else if( score*iCurrentBestScore < cutoffRatio ) {
-            RAVELOG_DEBUG_FORMAT("env=%d, finished at shortcut iter=%d (current score falls below %.15e), successful=%d, slowdowns=%d, endTime: %.15e -> %.15e; diff = %.15e", GetEnv()->GetId()%iters%cutoffRatio%numShortcuts%numSlowDowns%tOriginal%tTotal%(tOriginal - tTotal));
+        std::stringstream ss;
+        if( !!GetEnv()->GetCollisionChecker() ) {
+            ss << GetEnv()->GetCollisionChecker()->GetXMLId();
         }
-        else if( nItersFromPrevSuccessful > nCutoffIters ) {
-            RAVELOG_DEBUG_FORMAT("env=%d, finished at shortcut iter=%d (did not make progress in the last %d iterations), successful=%d, slowdowns=%d, endTime: %.15e -> %.15e; diff = %.15e", GetEnv()->GetId()%iters%nCutoffIters%numShortcuts%numSlowDowns%tOriginal%tTotal%(tOriginal - tTotal));
+        FOREACHC(itbody, vbodies) {
+            ss << " " << (*itbody)->GetEnvironmentId() << " " << (*itbody)->GetName() << " " << (*itbody)->GetKinematicsGeometryHash() << " " << (*itbody)->GetLinkEnableStatesMask();
+            if( setmovedbodies.find(*itbody) == setmovedbodies.end() ) {
+                ss << " " << (*itbody)->GetUpdateStamp();
+            }
+            if( (*itbody)->IsRobot() ) {
+                RaveInterfaceCast<RobotBase>(*itbody)->GetGrabbed(vgrabbed);
+                FOREACHC(itgrabbed, vgrabbed) {
+                    ss << " " << (*itgrabbed)->GetEnvironmentId();
+                }
+            }
         }
-        _DumpParabolicPath(parabolicpath, _dumplevel, fileindex, 1);
+        return ss.str();
+    }
 
-        return numShortcuts;
+    /// \brief Update the environment clones of the shortcut workers and initialize their smoothers
+    /// with the parameters re-created on the clones. The clones are only cloned again when the
+    /// environment changed since the last time, otherwise only the state of the used bodies is
+    /// copied to them.
+    bool _InitShortcutWorkers(int numworkers)
+    {
+        if( (int)_vshortcutworkers.size() != numworkers ) {
+            // the threads hold the index of their worker
+            _StopShortcutThreads();
+        }
+        EnvironmentMutex::scoped_lock lock(GetEnv()->GetMutex());
+        std::vector<KinBodyPtr> vusedbodies;
+        std::string environmentkey = _GetShortcutWorkersEnvironmentKey(vusedbodies);
+        if( environmentkey != _sShortcutWorkersEnvironmentKey ) {
+            // the clones are updated below
+            _sShortcutWorkersEnvironmentKey.resize(0);
+        }
+        if( (int)_vshortcutworkers.size() > numworkers ) {
+            for(size_t iworker = numworkers; iworker < _vshortcutworkers.size(); ++iworker) {
+                _vshortcutworkers[iworker]._smoother.reset();
+                _vshortcutworkers[iworker]._parameters.reset();
+                _vshortcutworkers[iworker]._penv->Destroy();
+            }
+            _vshortcutworkers.resize(numworkers);
+        }
+        for(int iworker = 0; iworker < numworkers; ++iworker) {
+            if( iworker < (int)_vshortcutworkers.size() ) {
+                if( _sShortcutWorkersEnvironmentKey.size() == 0 ) {
+                    _vshortcutworkers[iworker]._penv->Clone(GetEnv(), Clone_Bodies);
+                }
+                else {
+                    EnvironmentMutex::scoped_lock lockclone(_vshortcutworkers[iworker]._penv->GetMutex());
+                    FOREACHC(itbody, vusedbodies) {
+                        KinBodyPtr pclonebody = _vshortcutworkers[iworker]._penv->GetBodyFromEnvironmentId((*itbody)->GetEnvironmentId());
+                        if( !pclonebody ) {
+                            continue;
+                        }
+                        if( (*itbody)->IsRobot() ) {
+                            RobotBase::RobotStateSaver saver(RaveInterfaceCast<RobotBase>(*itbody), KinBody::Save_LinkTransformation|KinBody::Save_ActiveDOF|KinBody::Save_ActiveManipulator);
+                            saver.Restore(RaveInterfaceCast<RobotBase>(pclonebody));
+                        }
+                        else {
+                            KinBody::KinBodyStateSaver saver(*itbody, KinBody::Save_LinkTransformation);
+                            saver.Restore(pclonebody);
+                        }
+                    }
+                }
+            }
+            else {
+                _vshortcutworkers.push_back(ShortcutWorker());
+                ShortcutWorker& worker = _vshortcutworkers.back();
+                worker._penv = GetEnv()->CloneSelf(Clone_Bodies);
+                std::stringstream sinput;
+                worker._smoother.reset(new ParabolicSmoother2(worker._penv, sinput));
+            }
+            ShortcutWorker& worker = _vshortcutworkers[iworker];
+            // the simulation thread of a clone would compete with the worker for the environment lock and the cores
+            worker._penv->StopSimulation();
+            try {
+                EnvironmentMutex::scoped_lock lockclone(worker._penv->GetMutex());
+                if( !!GetEnv()->GetCollisionChecker() && !!worker._penv->GetCollisionChecker() ) {
+                    // callers like planningutils set CO_ActiveDOFs for the duration of the smoothing
+                    worker._penv->GetCollisionChecker()->SetCollisionOptions(GetEnv()->GetCollisionChecker()->GetCollisionOptions());
+                }
+                ConstraintTrajectoryTimingParametersPtr params(new ConstraintTrajectoryTimingParameters());
+                params->copy(_parameters);
+                params->SetConfigurationSpecification(worker._penv, _parameters->_configurationspecification);
+                // SetConfigurationSpecification resets the limits from the cloned bodies
+                params->_vConfigLowerLimit = _parameters->_vConfigLowerLimit;
+                params->_vConfigUpperLimit = _parameters->_vConfigUpperLimit;
+                params->_vConfigVelocityLimit = _parameters->_vConfigVelocityLimit;
+                params->_vConfigAccelerationLimit = _parameters->_vConfigAccelerationLimit;
+                params->_vConfigResolution = _parameters->_vConfigResolution;
+                params->_sPostProcessingPlanner = "";
+                params->_sPostProcessingParameters = "";
+                worker._parameters = params;
+                if( !worker._smoother->InitPlan(RobotBasePtr(), params) ) {
+                    return false;
+                }
+                worker._smoother->_feasibilitychecker.tol = _feasibilitychecker.tol;
+                worker._smoother->_bUsePerturbation = _bUsePerturbation;
+            }
+            catch(const std::exception& ex) {
+                RAVELOG_WARN_FORMAT("env=%d, failed to set up shortcut worker %d: %s", GetEnv()->GetId()%iworker%ex.what());
+                return false;
+            }
+        }
+        _sShortcutWorkersEnvironmentKey = environmentkey;
+        _StartShortcutThreads();
+        return true;
+    }
+
+    void _DestroyShortcutWorkers()
+    {
+        _StopShortcutThreads();
+        FOREACH(itworker, _vshortcutworkers) {
+            itworker->_smoother.reset();
+            itworker->_parameters.reset();
+            if( !!itworker->_penv ) {
+                itworker->_penv->Destroy();
+            }
+        }
+        _vshortcutworkers.resize(0);
+        _sShortcutWorkersEnvironmentKey.resize(0);
     }
 
     void _DumpParabolicPath(RampOptimizer::ParabolicPath& parabolicpath, DebugLevel level=Level_Verbose, uint32_t fileindex=10000, int option=-1) const
@@ -1793,6 +2328,7 @@ protected:
 
     /// Members
     ConstraintTrajectoryTimingParametersPtr _parameters;
+    RobotBasePtr _robot; ///< the robot passed to InitPlan, the functions of SetRobotActiveJoints on it can be re-created on the clones
     SpaceSamplerBasePtr _uniformsampler;        ///< used for planning, seed is controlled
     ConstraintFilterReturnPtr _constraintreturn;
     MyRampNDFeasibilityChecker _feasibilitychecker;
@@ -1835,6 +2371,23 @@ protected:
 
     // in _Shortcut
 
+    // for parallel shortcutting
+    int _nShortcutCandidates; ///< number of candidate shortcuts per round, parallel shortcutting is used if > 1
+    int _nNumThreads; ///< number of shortcut workers, 0 for the number of cores
+    std::vector<ShortcutWorker> _vshortcutworkers;
+    std::string _sShortcutWorkersEnvironmentKey; ///< key of the environment the clones of _vshortcutworkers are up to date with, empty if they have to be cloned again
+    std::vector<ShortcutCandidate> _vshortcutcandidates; ///< candidates of the current round
+    std::vector< std::pair<dReal, int> > _vsortedshortcutcandidates, _vcommittedshortcutcandidates;
+    std::vector< boost::shared_ptr<boost::thread> > _vshortcutthreads; ///< the threads of the shortcut workers 1 and up, they wait for the next round between rounds
+    boost::mutex _mutexshortcutcandidates; ///< protects _nNextShortcutCandidate and the state of the rounds below
+    boost::condition _condShortcutRound; ///< notified when a round is started or the threads are stopped
+    boost::condition _condShortcutRoundDone; ///< notified when the last thread finished checking the candidates of a round
+    size_t _nNextShortcutCandidate; ///< next candidate of the current round to be checked by a worker
+    ShortcutRound _shortcutround; ///< the current round
+    int _nShortcutRound; ///< incremented every time a round is started
+    int _nShortcutThreadsRunning; ///< number of threads still checking the candidates of the current round
+    bool _bStopShortcutThreads;
+
 #ifdef SMOOTHER_TIMING_DEBUG
     // Statistics
     size_t _nCallsCheckManip;
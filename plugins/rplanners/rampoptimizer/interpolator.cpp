@@ -34,6 +34,7 @@ ParabolicInterpolator::ParabolicInterpolator(size_t ndof)
     _cacheV0Vect.resize(_ndof);
     _cacheV1Vect.resize(_ndof);
     _cacheAVect.resize(_ndof);
+    _cacheDurationsVect.resize(_ndof);
     _cacheCurvesVect.resize(_ndof);
 }
 
@@ -47,6 +48,7 @@ void ParabolicInterpolator::Initialize(size_t ndof)
     _cacheV0Vect.resize(_ndof);
     _cacheV1Vect.resize(_ndof);
     _cacheAVect.resize(_ndof);
+    _cacheDurationsVect.resize(_ndof);
     _cacheCurvesVect.resize(_ndof);
 }
 
@@ -221,25 +223,19 @@ bool ParabolicInterpolator::ComputeArbitraryVelNDTrajectory(const std::vector<dR
         }
     }
 
-    // First compute the minimum trajectory duration for each joint.
-    dReal maxDuration = 0;
-    size_t maxIndex = 0;
-    for (size_t idof = 0; idof < _ndof; ++idof) {
-        if( !Compute1DTrajectory(x0Vect[idof], x1Vect[idof], v0Vect[idof], v1Vect[idof], vmVect[idof], amVect[idof], _cacheCurvesVect[idof], BCHECK_1D_TRAJ) ) {
-            return false;
-        }
-        if( _cacheCurvesVect[idof].GetDuration() > maxDuration ) {
-            maxDuration = _cacheCurvesVect[idof].GetDuration();
-            maxIndex = idof;
-        }
+    // First compute the minimum trajectory duration for each joint. Only the curve of the slowest
+    // joint is needed, all the others are going to be stretched.
+    size_t maxIndex = ComputeNDMinimumDurations(x0Vect, x1Vect, v0Vect, v1Vect, vmVect, amVect, _cacheDurationsVect);
+    if( !Compute1DTrajectory(x0Vect[maxIndex], x1Vect[maxIndex], v0Vect[maxIndex], v1Vect[maxIndex], vmVect[maxIndex], amVect[maxIndex], _cacheCurvesVect[maxIndex], BCHECK_1D_TRAJ) ) {
+        return false;
     }
 
-    //RAVELOG_VERBOSE_FORMAT("Joint %d has the longest duration of %.15e s.", maxIndex%maxDuration);
+    //RAVELOG_VERBOSE_FORMAT("Joint %d has the longest duration of %.15e s.", maxIndex%_cacheCurvesVect[maxIndex].GetDuration());
 
     // Now stretch all the trajectories to some duration t. If not tryHarder, t will be
     // maxDuration. Otherwise, t will be the maximum of maxDuration and tbound (computed by taking
     // into account inoperative time intervals.
-    if( !_RecomputeNDTrajectoryFixedDuration(_cacheCurvesVect, vmVect, amVect, maxIndex, tryHarder) ) {
+    if( !_RecomputeNDTrajectoryFixedDuration(x0Vect, x1Vect, v0Vect, v1Vect, vmVect, amVect, maxIndex, tryHarder, _cacheCurvesVect) ) {
         // Note, however, that even with tryHarder = true, the above interpolation may fail due to
         // inability to fix joint limits violation.
         return false;
@@ -280,14 +276,14 @@ bool ParabolicInterpolator::ComputeArbitraryVelNDTrajectory(const std::vector<dR
     return true;
 }
 
-bool ParabolicInterpolator::_RecomputeNDTrajectoryFixedDuration(std::vector<ParabolicCurve>& curvesVect, const std::vector<dReal>& vmVect, const std::vector<dReal>& amVect, size_t maxIndex, bool tryHarder)
+bool ParabolicInterpolator::_RecomputeNDTrajectoryFixedDuration(const std::vector<dReal>& x0Vect, const std::vector<dReal>& x1Vect, const std::vector<dReal>& v0Vect, const std::vector<dReal>& v1Vect, const std::vector<dReal>& vmVect, const std::vector<dReal>& amVect, size_t maxIndex, bool tryHarder, std::vector<ParabolicCurve>& curvesVect)
 {
     dReal newDuration = curvesVect[maxIndex].GetDuration();
     bool isPrevDurationSafe = true;
     if( tryHarder ) {
         for (size_t idof = 0; idof < _ndof; ++idof) {
             dReal tBound;
-            if( !_CalculateLeastUpperBoundInoperavtiveTimeInterval(curvesVect[idof].GetX0(), curvesVect[idof].GetX1(), curvesVect[idof].GetV0(), curvesVect[idof].GetV1(), vmVect[idof], amVect[idof], tBound) ) {
+            if( !_CalculateLeastUpperBoundInoperavtiveTimeInterval(x0Vect[idof], x1Vect[idof], v0Vect[idof], v1Vect[idof], vmVect[idof], amVect[idof], tBound) ) {
                 return false;
             }
             if( tBound > newDuration ) {
@@ -306,11 +302,11 @@ bool ParabolicInterpolator::_RecomputeNDTrajectoryFixedDuration(std::vector<Para
             //RAVELOG_VERBOSE_FORMAT("joint %d is already the slowest DOF, continue to the next DOF (if any)", idof);
             continue;
         }
-        if( !Compute1DTrajectoryFixedDuration(curvesVect[idof].GetX0(), curvesVect[idof].GetX1(), curvesVect[idof].GetV0(), curvesVect[idof].GetV1(), vmVect[idof], amVect[idof], newDuration, _cacheCurve) ) {
+        if( !Compute1DTrajectoryFixedDuration(x0Vect[idof], x1Vect[idof], v0Vect[idof], v1Vect[idof], vmVect[idof], amVect[idof], newDuration, _cacheCurve) ) {
             return false;
         }
-        // Store the result back in the input curvesVect
-        curvesVect[idof] = _cacheCurve;
+        // Store the result back in the input curvesVect. Swapping keeps the storage of both curves.
+        curvesVect[idof].Swap(_cacheCurve);
     }
 
     return true;
@@ -370,7 +366,7 @@ bool ParabolicInterpolator::ComputeNDTrajectoryFixedDuration(const std::vector<d
             return false;
         }
 
-        _cacheCurvesVect[idof] = _cacheCurve;
+        _cacheCurvesVect[idof].Swap(_cacheCurve);
     }
 
     //RAVELOG_VERBOSE("Successfully computed ND trajectory with joint limits and fixed duration");
@@ -543,6 +539,63 @@ bool ParabolicInterpolator::Compute1DTrajectory(dReal x0, dReal x1, dReal v0, dR
     return true;
 }
 
+size_t ParabolicInterpolator::ComputeNDMinimumDurations(const std::vector<dReal>& x0Vect, const std::vector<dReal>& x1Vect, const std::vector<dReal>& v0Vect, const std::vector<dReal>& v1Vect, const std::vector<dReal>& vmVect, const std::vector<dReal>& amVect, std::vector<dReal>& durationsOut)
+{
+    OPENRAVE_ASSERT_OP(x0Vect.size(), ==, _ndof);
+    OPENRAVE_ASSERT_OP(x1Vect.size(), ==, _ndof);
+    OPENRAVE_ASSERT_OP(v0Vect.size(), ==, _ndof);
+    OPENRAVE_ASSERT_OP(v1Vect.size(), ==, _ndof);
+    OPENRAVE_ASSERT_OP(vmVect.size(), ==, _ndof);
+    OPENRAVE_ASSERT_OP(amVect.size(), ==, _ndof);
+    durationsOut.resize(_ndof);
+
+    // The arithmetic below follows Compute1DTrajectory operation by operation so that the
+    // durations are exactly the same.
+    const dReal *px0 = &x0Vect[0], *px1 = &x1Vect[0], *pv0 = &v0Vect[0], *pv1 = &v1Vect[0], *pvm = &vmVect[0], *pam = &amVect[0];
+    dReal* pdurations = &durationsOut[0];
+    for (size_t idof = 0; idof < _ndof; ++idof) {
+        dReal d = px1[idof] - px0[idof];
+        dReal v0 = pv0[idof], v1 = pv1[idof], vm = pvm[idof], am = pam[idof];
+        dReal dv = v1 - v0;
+        dReal v0Sqr = v0*v0;
+        dReal v1Sqr = v1*v1;
+        dReal dVSqr = v1Sqr - v0Sqr;
+        dReal dStraight = dv > 0 ? 0.5*dVSqr/am : (dv < 0 ? -0.5*dVSqr/am : 0);
+
+        // One ramp: v1 is reached from v0 by the acceleration am or -am.
+        dReal aStraight = dv > 0 ? am : -am;
+        dReal durationStraight = dv/aStraight;
+
+        // Two ramps: accelerate to the peak velocity vp then decelerate.
+        dReal sumVSqr = v0Sqr + v1Sqr;
+        dReal a0 = d > dStraight ? am : -am;
+        dReal vpAbs = Sqrt(Max((0.5*sumVSqr) + (a0*d), 0)); // the argument is only negative when this case is not selected
+        dReal vp = d > dStraight ? vpAbs : -vpAbs;
+        dReal a0inv = 1/a0;
+        dReal t0 = (vp - v0)*a0inv, t1 = (vp - v1)*a0inv;
+        dReal durationTwoRamps = t0 + t1;
+
+        // Three ramps: the peak velocity is cut at vm by a middle ramp.
+        dReal h = vpAbs - vm;
+        dReal t = h*Abs(a0inv);
+        dReal durationThreeRamps = ((t0 - t) + (2*t + ((h*h)/(am*vm)))) + (t1 - t);
+
+        dReal duration = vpAbs > vm + g_fRampEpsilon ? durationThreeRamps : durationTwoRamps;
+        duration = FuzzyEquals(d, dStraight, g_fRampEpsilon) ? durationStraight : duration;
+        pdurations[idof] = (dv == 0 && d == 0) ? 0 : duration;
+    }
+
+    dReal maxDuration = 0;
+    size_t maxIndex = 0;
+    for (size_t idof = 0; idof < _ndof; ++idof) {
+        if( pdurations[idof] > maxDuration ) {
+            maxDuration = pdurations[idof];
+            maxIndex = idof;
+        }
+    }
+    return maxIndex;
+}
+
 bool ParabolicInterpolator::_ImposeJointLimitFixedDuration(ParabolicCurve& curve, dReal xmin, dReal xmax, dReal vm, dReal am, bool bCheck)
 {
     dReal bmin, bmax;
@@ -576,12 +629,21 @@ bool ParabolicInterpolator::_ImposeJointLimitFixedDuration(ParabolicCurve& curve
         bx1 = xmax;
         ba1 = SolveBrakeAccel(x1, -v1, xmax);
     }
-    else if( v0 < 0 ) {
+    else if( v1 > 0 ) {
         bt1 = SolveBrakeTime(x1, -v1, xmin);
         bx1 = xmin;
         ba1 = SolveBrakeAccel(x1, -v1, xmin);
     }
 
+    // A bound that is reached while moving back into the limits, e.g. x1 = xmax with v1 < 0, gives a
+    // degenerate braking ramp that does not reach the velocity. Such a curve cannot be bounded.
+    if( !FuzzyZero(v0 + ba0*bt0, g_fRampEpsilon) ) {
+        bt0 = g_fRampInf;
+    }
+    if( !FuzzyEquals(ba1*bt1, v1, g_fRampEpsilon) ) {
+        bt1 = g_fRampInf;
+    }
+
     _cacheRampsVect.resize(0);
 
     if( (bt0 < duration) && (Abs(ba0) <= am + g_fRampEpsilon) ) {
@@ -1506,13 +1568,15 @@ bool ParabolicInterpolator::_SolveForT0(dReal A, dReal B, dReal t, dReal l, dRea
     double tSqr = t*t;
     double tCube = tSqr*t;
 
+    // Only the roots in [l, u] are needed, so search for them directly instead of computing all the
+    // complex roots with mathextra::polyroots, which used to take most of the time of the stretching.
     if( Abs(A) < g_fRampEpsilon ) {
         dReal coeffs[4] = {2*B, -3*B*t, 3*B*tSqr, -B*tCube};
-        OpenRAVE::mathextra::polyroots<dReal, 3>(&coeffs[0], &rawRoots[0], numRoots);
+        numRoots = SolvePolyInInterval(&coeffs[0], 3, l, u, &rawRoots[0]);
     }
     else {
         dReal coeffs[5] = {2*A, -4*A*t + 2*B, 3*A*tSqr - 3*B*t, -A*tCube + 3*B*tSqr, -B*tCube};
-        OpenRAVE::mathextra::polyroots<dReal, 4>(&coeffs[0], &rawRoots[0], numRoots);
+        numRoots = SolvePolyInInterval(&coeffs[0], 4, l, u, &rawRoots[0]);
     }
 
     if( numRoots == 0 ) {
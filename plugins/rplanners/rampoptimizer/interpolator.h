@@ -85,13 +85,18 @@ public:
        trajectory duration. Otherwise, t will be calculated by taking into account inoperative time
        intervals of every joint.
 
-       \param curvesVect the input vector of ParabolicCurves. This will also carry the resulting ParabolicCurves.
+       \param x0Vect initial position
+       \param x1Vect final position
+       \param v0Vect initial velocity
+       \param v1Vect final velocity
        \param vmVect velocity limts
        \param amVect acceleration limits
        \param maxIndex the index of the trajectory with the longest duration
        \param tryHarder
+       \param curvesVect curvesVect[maxIndex] is the minimum-time ParabolicCurve of the slowest
+       joint. This will also carry the resulting ParabolicCurves.
      */
-    bool _RecomputeNDTrajectoryFixedDuration(std::vector<ParabolicCurve>& curvesVect, const std::vector<dReal>& vmVect, const std::vector<dReal>& amVect, size_t maxIndex, bool tryHarder);
+    bool _RecomputeNDTrajectoryFixedDuration(const std::vector<dReal>& x0Vect, const std::vector<dReal>& x1Vect, const std::vector<dReal>& v0Vect, const std::vector<dReal>& v1Vect, const std::vector<dReal>& vmVect, const std::vector<dReal>& amVect, size_t maxIndex, bool tryHarder, std::vector<ParabolicCurve>& curvesVect);
 
     /**
 
@@ -117,6 +122,18 @@ public:
      */
     bool Compute1DTrajectory(dReal x0, dReal x1, dReal v0, dReal v1, dReal vm, dReal am, ParabolicCurve& curveOut, bool bCheck=true);
 
+    /**
+       \brief Compute the durations of the minimum-time 1D trajectories of all DOFs, i.e. the
+       durations of the ParabolicCurves Compute1DTrajectory would give, without constructing the
+       curves. All the cases of Compute1DTrajectory are evaluated for every DOF and the result is
+       selected afterwards, so the loop has no data-dependent branches and can be vectorized by the
+       compiler. The inputs are assumed to be valid (see ComputeArbitraryVelNDTrajectory).
+
+       \param durationsOut the minimum duration of each DOF
+       \return the index of the DOF with the longest duration
+     */
+    size_t ComputeNDMinimumDurations(const std::vector<dReal>& x0Vect, const std::vector<dReal>& x1Vect, const std::vector<dReal>& v0Vect, const std::vector<dReal>& v1Vect, const std::vector<dReal>& vmVect, const std::vector<dReal>& amVect, std::vector<dReal>& durationsOut);
+
     /**
        \brief Impose the given joint limits to a 1D parabolic trajectory while maintaining the
        original duration of the trajectory. This function is only called from ND trajectory
@@ -196,6 +213,7 @@ private:
     // Caching stuff
     std::vector<dReal> _cacheVect, _cacheSwitchpointsList;
     std::vector<dReal> _cacheX0Vect, _cacheX1Vect, _cacheV0Vect, _cacheV1Vect, _cacheAVect;
+    std::vector<dReal> _cacheDurationsVect; // for using in ComputeArbitraryVelNDTrajectory
     Ramp _cacheRamp;
     std::vector<Ramp> _cacheRampsVect;
     std::vector<Ramp> _cacheRampsVect2; // for using in Compute1DTrajectoryFixedDuration
@@ -88,6 +88,82 @@ bool SafeEqSolve(dReal a,dReal b,dReal epsilon,dReal xmin,dReal xmax,dReal& x)
     return true;
 }
 
+int SolvePolyInInterval(const dReal* coeffs, int degree, dReal l, dReal u, dReal* roots)
+{
+    OPENRAVE_ASSERT_OP(degree, <=, 4);
+    while( degree > 0 && coeffs[0] == 0 ) {
+        ++coeffs;
+        --degree;
+    }
+    if( degree == 0 || !(l <= u) ) {
+        return 0;
+    }
+    if( degree == 1 ) {
+        dReal x = -coeffs[1]/coeffs[0];
+        if( x >= l && x <= u ) {
+            roots[0] = x;
+            return 1;
+        }
+        return 0;
+    }
+
+    // The roots of the derivative split [l, u] into pieces on which the polynomial is monotonic,
+    // so every piece contains at most one root, which is bracketed by a sign change.
+    dReal dcoeffs[4];
+    for (int i = 0; i < degree; ++i) {
+        dcoeffs[i] = (degree - i)*coeffs[i];
+    }
+    dReal bounds[5];
+    bounds[0] = l;
+    int numbounds = 1 + SolvePolyInInterval(dcoeffs, degree - 1, l, u, &bounds[1]);
+    bounds[numbounds++] = u;
+
+    int numroots = 0;
+    dReal pa = EvalPoly(coeffs, degree, bounds[0]);
+    if( pa == 0 ) {
+        roots[numroots++] = bounds[0];
+    }
+    for (int ibound = 1; ibound < numbounds; ++ibound) {
+        dReal a = bounds[ibound - 1], b = bounds[ibound];
+        dReal pb = EvalPoly(coeffs, degree, b);
+        if( pb == 0 ) {
+            if( numroots == 0 || roots[numroots - 1] != b ) {
+                roots[numroots++] = b;
+            }
+        }
+        else if( pa != 0 && (pa < 0) != (pb < 0) ) {
+            // Newton's method safeguarded by bisection
+            bool bnegativea = pa < 0;
+            dReal x = 0.5*(a + b);
+            for (int iter = 0; iter < 100; ++iter) {
+                dReal p = EvalPoly(coeffs, degree, x);
+                if( p == 0 ) {
+                    break;
+                }
+                if( (p < 0) == bnegativea ) {
+                    a = x;
+                }
+                else {
+                    b = x;
+                }
+                dReal dp = EvalPoly(dcoeffs, degree - 1, x);
+                dReal xnew = x - p/dp;
+                if( !(xnew > a && xnew < b) ) {
+                    xnew = 0.5*(a + b);
+                }
+                if( Abs(xnew - x) <= 4*std::numeric_limits<dReal>::epsilon()*Abs(x) || xnew == a || xnew == b ) {
+                    x = xnew;
+                    break;
+                }
+                x = xnew;
+            }
+            roots[numroots++] = x;
+        }
+        pa = pb;
+    }
+    return numroots;
+}
+
 } // end namespace RampOptimizerInternal
 
 } // end namespace OpenRAVE
@@ -175,6 +175,25 @@ inline int SolveQuadratic(dReal a, dReal b, dReal c, dReal& x1, dReal& x2)
 /// problems choose x = 0
 bool SafeEqSolve(dReal a, dReal b, dReal epsilon, dReal xmin, dReal xmax, dReal& x);
 
+/// \brief Evaluate the polynomial coeffs[0]*x^degree + ... + coeffs[degree] at x
+inline dReal EvalPoly(const dReal* coeffs, int degree, dReal x)
+{
+    dReal p = coeffs[0];
+    for (int i = 1; i <= degree; ++i) {
+        p = p*x + coeffs[i];
+    }
+    return p;
+}
+
+/// \brief Find the real roots in [l, u] of the polynomial coeffs[0]*x^degree + ... + coeffs[degree]
+/// of degree at most 4 and store them in increasing order in roots. Unlike mathextra::polyroots,
+/// which finds all the complex roots, only the sign changes of the polynomial in [l, u] are
+/// searched for, so a root of even multiplicity is only found if the polynomial is exactly zero
+/// there.
+///
+/// \return the number of roots found
+int SolvePolyInInterval(const dReal* coeffs, int degree, dReal l, dReal u, dReal* roots);
+
 } // end namespace RampOptimizerInternal
 
 } // end namespace OpenRAVE
@@ -0,0 +1,142 @@
+// -*- coding: utf-8 -*-
+// Copyright (C) 2016 Puttichai Lertkultanon & Rosen Diankov
+//
+// This program is free software: you can redistribute it and/or modify it under the terms of the
+// GNU Lesser General Public License as published by the Free Software Foundation, either version 3
+// of the License, or at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+// even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License along with this program.
+// If not, see <http://www.gnu.org/licenses/>.
+#include "interpolator.h"
+#include <openrave/mathextra.h>
+#include <algorithm>
+
+using namespace OpenRAVE;
+using namespace OpenRAVE::RampOptimizerInternal;
+
+static int s_numfailures = 0;
+
+#define CHECK_INTERPOLATOR(expr) if( !(expr) ) { RAVELOG_ERROR("%s:%d: %s failed\n", __FILE__, __LINE__, #expr); ++s_numfailures; }
+
+int main()
+{
+    const size_t ndof = 7;
+    const int numtests = 20000;
+    const dReal xmin[ndof] = {-2.6, -2.0, -2.8, -0.9, -4.76, -1.6, -3.0}, xmax[ndof] = {2.6, 2.0, 2.8, 3.1, 1.24, 1.6, 3.0};
+    const dReal vm[ndof] = {1.0, 1.0, 2.0, 2.0, 3.0, 3.0, 3.0}, am[ndof] = {3.0, 2.0, 4.0, 4.0, 5.0, 6.0, 7.0};
+    std::vector<dReal> xminVect(xmin, xmin + ndof), xmaxVect(xmax, xmax + ndof), vmVect(vm, vm + ndof), amVect(am, am + ndof);
+    std::vector<dReal> x0Vect(ndof), x1Vect(ndof), v0Vect(ndof), v1Vect(ndof), durationsVect;
+    ParabolicInterpolator interpolator(ndof);
+    ParabolicCurve curve;
+    uint32_t seed = 3;
+
+    // ComputeNDMinimumDurations gives exactly the durations of Compute1DTrajectory
+    int nummismatches = 0;
+    for (int itest = 0; itest < numtests; ++itest) {
+        for (size_t idof = 0; idof < ndof; ++idof) {
+            dReal r[4];
+            for (int i = 0; i < 4; ++i) {
+                r[i] = rand_r(&seed)/(dReal)RAND_MAX;
+            }
+            x0Vect[idof] = xmin[idof] + r[0]*(xmax[idof] - xmin[idof]);
+            // also stationary, straight and short motions
+            switch( (itest + idof) % 5 ) {
+            case 0:
+                x1Vect[idof] = x0Vect[idof];
+                v0Vect[idof] = v1Vect[idof] = 0;
+                break;
+            case 1:
+                v0Vect[idof] = (2*r[2] - 1)*vm[idof];
+                v1Vect[idof] = (2*r[3] - 1)*vm[idof];
+                x1Vect[idof] = x0Vect[idof] + 0.5*(v1Vect[idof]*v1Vect[idof] - v0Vect[idof]*v0Vect[idof])/(v1Vect[idof] > v0Vect[idof] ? am[idof] : -am[idof]);
+                break;
+            case 2:
+                x1Vect[idof] = x0Vect[idof] + 0.01*(r[1] - 0.5);
+                v0Vect[idof] = 0;
+                v1Vect[idof] = (2*r[3] - 1)*vm[idof];
+                break;
+            default:
+                x1Vect[idof] = xmin[idof] + r[1]*(xmax[idof] - xmin[idof]);
+                v0Vect[idof] = (2*r[2] - 1)*vm[idof];
+                v1Vect[idof] = (2*r[3] - 1)*vm[idof];
+                break;
+            }
+        }
+        size_t maxIndex = interpolator.ComputeNDMinimumDurations(x0Vect, x1Vect, v0Vect, v1Vect, vmVect, amVect, durationsVect);
+        dReal maxDuration = 0;
+        for (size_t idof = 0; idof < ndof; ++idof) {
+            if( !interpolator.Compute1DTrajectory(x0Vect[idof], x1Vect[idof], v0Vect[idof], v1Vect[idof], vm[idof], am[idof], curve, false) || curve.GetDuration() != durationsVect[idof] ) {
+                if( nummismatches < 5 ) {
+                    RAVELOG_ERROR_FORMAT("test %d dof %d: duration %.17e, Compute1DTrajectory %.17e", itest%idof%durationsVect[idof]%curve.GetDuration());
+                }
+                ++nummismatches;
+            }
+            maxDuration = std::max(maxDuration, durationsVect[idof]);
+        }
+        CHECK_INTERPOLATOR(durationsVect[maxIndex] == maxDuration);
+    }
+    CHECK_INTERPOLATOR(nummismatches == 0);
+
+    // SolvePolyInInterval finds the real roots of mathextra::polyroots in the interval
+    int numrootmismatches = 0;
+    for (int itest = 0; itest < numtests; ++itest) {
+        dReal coeffs[5], roots[4], rawroots[4], l = -1 + rand_r(&seed)/(dReal)RAND_MAX, u = l + 2*rand_r(&seed)/(dReal)RAND_MAX;
+        for (int i = 0; i < 5; ++i) {
+            coeffs[i] = 2*rand_r(&seed)/(dReal)RAND_MAX - 1;
+        }
+        int numroots = SolvePolyInInterval(coeffs, 4, l, u, roots), numrawroots = 0;
+        mathextra::polyroots<dReal, 4>(coeffs, rawroots, numrawroots);
+        std::sort(rawroots, rawroots + numrawroots);
+        for (int i = 0; i < numrawroots; ++i) {
+            // roots close to the bounds may fall on either side of them
+            if( rawroots[i] >= l + 1e-8 && rawroots[i] <= u - 1e-8 ) {
+                bool bfound = false;
+                for (int j = 0; j < numroots; ++j) {
+                    bfound |= Abs(roots[j] - rawroots[i]) <= 1e-8;
+                }
+                numrootmismatches += !bfound;
+            }
+        }
+        for (int j = 0; j < numroots; ++j) {
+            numrootmismatches += roots[j] < l || roots[j] > u || (j > 0 && roots[j] < roots[j - 1]) || Abs(EvalPoly(coeffs, 4, roots[j])) > 1e-10;
+        }
+    }
+    CHECK_INTERPOLATOR(numrootmismatches == 0);
+
+    // reaching an upper limit while moving down is infeasible and fails without throwing
+    const dReal limitinputs[2][4][ndof] = {
+        {{-1.2656194006398409, 0.43068156132040603, -0.025400532607641413, 3.0966014288350014, 0.6240921304114595, 0.32679218143541, -1.8256733598307118},
+         {-1.2612103046272929, 0.42899621947388905, -0.021416201822653601, 3.1, 0.62023803647851505, 0.32559308533584375, -1.8296141297717645},
+         {0, 0, 0, 0, 0, 0, 0},
+         {-0.23152461248986642, -0.12800783558190237, 1.3199225484020649, -1.2584043545920425, -0.034107688457755359, -0.073059738088892615, -0.70223563681460721}},
+        {{0.88782159326962251, -0.81107701119551301, 2.351081044762898, 1.9769694039956525, -1.9851640135539528, 1.598932212590674, 2.1758862143270141},
+         {0.88782843867914196, -0.81560417131548946, 2.3556224886843102, 1.9780515390089954, -1.9840700029670586, 1.6, 2.1731488779551111},
+         {0.20198482172656096, 0.63541322491849472, -1.50992961074688, 0.13092398277061257, -1.800080707389899, -1.8204388034625163, -0.70143524329244877},
+         {-0.73732794669332358, 0.17163746923750145, 0.68774117635923493, 1.2803393630685003, -0.29116422137765402, -0.59881413420607077, 1.2495601186759584}},
+    };
+    std::vector<RampND> rampnds;
+    for (int itest = 0; itest < 2; ++itest) {
+        x0Vect.assign(limitinputs[itest][0], limitinputs[itest][0] + ndof);
+        x1Vect.assign(limitinputs[itest][1], limitinputs[itest][1] + ndof);
+        v0Vect.assign(limitinputs[itest][2], limitinputs[itest][2] + ndof);
+        v1Vect.assign(limitinputs[itest][3], limitinputs[itest][3] + ndof);
+        try {
+            CHECK_INTERPOLATOR(!interpolator.ComputeArbitraryVelNDTrajectory(x0Vect, x1Vect, v0Vect, v1Vect, xminVect, xmaxVect, vmVect, amVect, rampnds, false));
+        }
+        catch(const std::exception& ex) {
+            RAVELOG_ERROR_FORMAT("test %d: ComputeArbitraryVelNDTrajectory threw: %s", itest%ex.what());
+            ++s_numfailures;
+        }
+    }
+
+    if( s_numfailures > 0 ) {
+        RAVELOG_ERROR("%d checks of the interpolator failed\n", s_numfailures);
+        return 1;
+    }
+    RAVELOG_INFO("all checks of the interpolator passed\n");
+    return 0;
+}
@@ -49,6 +49,9 @@ InterfaceBasePtr CreateInterfaceValidated(InterfaceType type, const std::string&
             RAVELOG_WARN("rBiRRT is deprecated, use BiRRT\n");
             return InterfaceBasePtr(new BirrtPlanner(penv));
         }
+        else if( interfacename == "parallelbirrt") {
+            return InterfaceBasePtr(new ParallelBirrtPlanner(penv));
+        }
         else if( interfacename == "basicrrt") {
             return InterfaceBasePtr(new BasicRrtPlanner(penv));
         }
@@ -99,6 +102,7 @@ void GetPluginAttributesValidated(PLUGININFO& info)
 {
     info.interfacenames[PT_Planner].push_back("RAStar");
     info.interfacenames[PT_Planner].push_back("BiRRT");
+    info.interfacenames[PT_Planner].push_back("ParallelBiRRT");
     info.interfacenames[PT_Planner].push_back("BasicRRT");
     info.interfacenames[PT_Planner].push_back("ExplorationRRT");
     info.interfacenames[PT_Planner].push_back("GraspGradient");
@@ -78,18 +78,20 @@ typedef NodeBase* NodeBasePtr;
 class SimpleNode : public NodeBase
 {
 public:
-    SimpleNode(SimpleNode* parent, const vector<dReal>& config) : rrtparent(parent) {
+    SimpleNode(SimpleNode* parent, const vector<dReal>& config) : rrtparent(parent), _clonesource(NULL) {
         std::copy(config.begin(), config.end(), q);
         _level = 0;
         _hasselfchild = 0;
         _usenn = 1;
+        _edgechecked = 1;
         _userdata = 0;
     }
-    SimpleNode(SimpleNode* parent, const dReal* pconfig, int dof) : rrtparent(parent) {
+    SimpleNode(SimpleNode* parent, const dReal* pconfig, int dof) : rrtparent(parent), _clonesource(NULL) {
         std::copy(pconfig, pconfig+dof, q);
         _level = 0;
         _hasselfchild = 0;
         _usenn = 1;
+        _edgechecked = 1;
         _userdata = 0;
     }
     ~SimpleNode() {
@@ -97,9 +99,13 @@ public:
 
     SimpleNode* rrtparent; ///< pointer to the RRT tree parent
     std::vector<SimpleNode*> _vchildren; ///< cache tree direct children of this node (for the next cache level down). Has nothing to do with the RRT tree.
+    SimpleNode* _clonesource; ///< if not NULL, this node is a clone in another level of the cache tree of the node created by InsertNode, which is the same RRT node
+    std::vector<SimpleNode*> _vclones; ///< the clones of this node, only kept by the node created by InsertNode
+    std::vector<SimpleNode*> _vrrtchildren; ///< the nodes created by InsertNode with this node or one of its clones as rrtparent, only kept by the node created by InsertNode
     int16_t _level; ///< the level the node belongs to
     uint8_t _hasselfchild; ///< if 1, then _vchildren has contains a clone of this node in the level below it.
     uint8_t _usenn; ///< if 1, then use part of the nearest neighbor search, otherwise ignore
+    uint8_t _edgechecked; ///< if 0, the path from rrtparent to this node has not been checked for constraints yet (lazy collision checking)
     uint32_t _userdata; ///< user specified data tagging this node
 
 #ifdef _DEBUG
@@ -159,6 +165,7 @@ public:
         _maxlevel = 0;
         _minlevel = 0;
         _fMaxLevelBound = 0;
+        _bLazyCollisionChecking = false;
     }
 
     ~SpatialTree() {
@@ -237,30 +244,36 @@ public:
         return _InsertNode((NodePtr)parent, config, userdata);
     }
 
+    /// \brief if true, Extend only checks the constraints of the new configurations and marks their edges as unchecked
+    ///
+    /// The edges have to be checked by the planner before a path through them is returned.
+    void SetLazyCollisionChecking(bool bLazyCollisionChecking)
+    {
+        _bLazyCollisionChecking = bLazyCollisionChecking;
+    }
+
+    /// \brief removes the node, its clones and all the nodes after them in the RRT from the nearest neighbor search
+    ///
+    /// Only visits the removed nodes, the RRT children are kept by the nodes.
     virtual void InvalidateNodesWithParent(NodeBasePtr parentbase)
     {
         //BOOST_ASSERT(Validate());
         uint64_t starttime = utils::GetNanoPerformanceTime();
-        // first gather all the nodes, and then delete them in reverse order they were originally added in
-        NodePtr parent = (NodePtr)parentbase;
-        parent->_usenn = 0;
-        _setchildcache.clear(); _setchildcache.insert(parent);
-        int numruns=0;
-        bool bchanged=true;
-        while(bchanged) {
-            bchanged=false;
-            FOREACHC(itchildren, _vsetLevelNodes) {
-                FOREACHC(itchild, *itchildren) {
-                    if( _setchildcache.find(*itchild) == _setchildcache.end() && _setchildcache.find((*itchild)->rrtparent) != _setchildcache.end() ) {
-                        (*itchild)->_usenn = 0;
-                        _setchildcache.insert(*itchild);
-                        bchanged=true;
-                    }
-                }
+        _vchildcache.resize(0);
+        _vchildcache.push_back(_GetCloneSource((NodePtr)parentbase));
+        int numinvalidated = 0;
+        while(_vchildcache.size() > 0) {
+            NodePtr node = _vchildcache.back();
+            _vchildcache.pop_back();
+            // the clones of the node in the other levels of the cover tree are the same RRT node
+            node->_usenn = 0;
+            FOREACHC(itclone, node->_vclones) {
+                (*itclone)->_usenn = 0;
             }
-            ++numruns;
+            _vchildcache.insert(_vchildcache.end(), node->_vrrtchildren.begin(), node->_vrrtchildren.end());
+            ++numinvalidated;
         }
-        RAVELOG_VERBOSE("computed in %fs", (1e-9*(utils::GetNanoPerformanceTime()-starttime)));
+        RAVELOG_VERBOSE("invalidated %d nodes in %fs", numinvalidated, (1e-9*(utils::GetNanoPerformanceTime()-starttime)));
     }
 
     /// deletes all nodes that have parentindex as their parent
@@ -358,7 +371,13 @@ public:
                 return ET_Failed;
             }
 
-            if( _fromgoal ) {
+            if( _bLazyCollisionChecking ) {
+                // only check the new configuration, the edge is checked once it is part of a path
+                if( params->CheckPathAllConstraints(_vNewConfig, _vNewConfig, std::vector<dReal>(), std::vector<dReal>(), 0, IT_OpenStart) != 0 ) {
+                    return bHasAdded ? ET_Sucess : ET_Failed;
+                }
+            }
+            else if( _fromgoal ) {
                 if( params->CheckPathAllConstraints(_vNewConfig, _vCurConfig, std::vector<dReal>(), std::vector<dReal>(), 0, IT_OpenEnd) != 0 ) {
                     return bHasAdded ? ET_Sucess : ET_Failed;
                 }
@@ -391,6 +410,7 @@ public:
 
             NodePtr pnewnode = _InsertNode(pnode, _vNewConfig, 0); ///< set userdata to 0
             if( !!pnewnode ) {
+                pnewnode->_edgechecked = !_bLazyCollisionChecking;
                 pnode = pnewnode;
                 lastnode = pnode;
                 bHasAdded = true;
@@ -586,7 +606,10 @@ private:
         // allocate memory for the structur and the internal state vectors
         void* pmemory = _pNodesPool->malloc();
         NodePtr node = new (pmemory) Node(refnode->rrtparent, refnode->q, _dof);
+        node->_edgechecked = refnode->_edgechecked;
         node->_userdata = refnode->_userdata;
+        node->_clonesource = _GetCloneSource(refnode);
+        node->_clonesource->_vclones.push_back(node);
 #ifdef _DEBUG
         node->id = GetNewStaticId();
 #endif
@@ -596,11 +619,52 @@ private:
     void _DeleteNode(Node* p)
     {
         if( !!p ) {
+            _UnregisterNode(p);
             p->~Node();
             _pNodesPool->free(p);
         }
     }
 
+    /// \brief returns the node created by InsertNode that node is a clone of, or node itself
+    static inline NodePtr _GetCloneSource(NodePtr node)
+    {
+        return !!node->_clonesource ? node->_clonesource : node;
+    }
+
+    /// \brief removes node from the clones and the RRT children kept by the other nodes
+    ///
+    /// If node was created by InsertNode and has clones, the first clone keeps the clones and the RRT children from now on.
+    void _UnregisterNode(NodePtr node)
+    {
+        if( !!node->_clonesource ) {
+            std::vector<NodePtr>& vclones = node->_clonesource->_vclones;
+            vclones.erase(std::find(vclones.begin(), vclones.end(), node));
+            return;
+        }
+        NodePtr newsource = NULL;
+        if( node->_vclones.size() > 0 ) {
+            newsource = node->_vclones[0];
+            newsource->_clonesource = NULL;
+            newsource->_vclones.assign(node->_vclones.begin()+1, node->_vclones.end());
+            FOREACH(itclone, newsource->_vclones) {
+                (*itclone)->_clonesource = newsource;
+            }
+            newsource->_vrrtchildren.swap(node->_vrrtchildren);
+        }
+        if( !!node->rrtparent ) {
+            std::vector<NodePtr>& vrrtchildren = _GetCloneSource(node->rrtparent)->_vrrtchildren;
+            typename std::vector<NodePtr>::iterator itchild = std::find(vrrtchildren.begin(), vrrtchildren.end(), node);
+            if( itchild != vrrtchildren.end() ) {
+                if( !!newsource ) {
+                    *itchild = newsource;
+                }
+                else {
+                    vrrtchildren.erase(itchild);
+                }
+            }
+        }
+    }
+
     inline int _EncodeLevel(int level) const {
         if( level <= 0 ) {
             return -2*level;
@@ -637,7 +701,7 @@ private:
                 // only take the children whose distances are within the bound
                 FOREACHC(itchild, itcurrentnode->first->_vchildren) {
                     dReal curdist = _ComputeDistance((*itchild)->q, vquerystate);
-                    if( !bestnode.first || (curdist < bestnode.second && bestnode.first->_usenn)) {
+                    if( (*itchild)->_usenn && curdist < bestnode.second ) {
                         bestnode = make_pair(*itchild, curdist);
                     }
                     _vNextLevelNodes.push_back(make_pair(*itchild, curdist));
@@ -687,6 +751,9 @@ private:
                 return NodePtr();
             }
         }
+        if( !!parent ) {
+            _GetCloneSource(parent)->_vrrtchildren.push_back(newnode);
+        }
         //BOOST_ASSERT(Validate());
         return newnode;
     }
@@ -1006,6 +1073,7 @@ private:
     dReal _fStepLength;
     int _dof; ///< the number of values of each state
     int _fromgoal;
+    bool _bLazyCollisionChecking; ///< if true, the edges added by Extend are not checked
 
     // cover tree data structures
     boost::shared_ptr< boost::pool<> > _pNodesPool; ///< pool nodes are created from
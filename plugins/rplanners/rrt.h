@@ -17,7 +17,12 @@
 #define  BIRRT_PLANNER_H
 
 #include "rplanners.h"
+#include "clonedparameters.h"
 #include <boost/algorithm/string.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition.hpp>
+#include <boost/atomic.hpp>
 
 static const dReal g_fEpsilonDotProduct = RavePow(g_fEpsilon,0.8);
 
@@ -280,7 +285,16 @@ Some python code to display data::\n\
   robot.SetActiveDOFValues(sourcetree[argmin(sourcedist)])\n\
 \n\
 ");
+        RegisterCommand("SetLazyCollisionChecking", boost::bind(&BirrtPlanner::_SetLazyCollisionCheckingCommand,this,_1,_2),
+                        "format: int\n\n\
+if 1, the trees are grown by only checking the constraints of the new configurations. Once the trees connect, the edges of the path are checked starting with the ones closest to the configurations where previous edges failed. If an edge fails, the nodes after it are removed from the nearest neighbor search and the trees continue growing. 0 (default) checks every edge when it is added.");
+        RegisterCommand("GetLazyStatistics", boost::bind(&BirrtPlanner::_GetLazyStatisticsCommand,this,_1,_2),
+                        "returns the statistics of the lazy collision checking of the last plan: [edges checked] [repairs of the trees]");
         _nValidGoals = 0;
+        _bLazyCollisionChecking = false;
+        _nLazyEdgeChecks = 0;
+        _nLazyRepairs = 0;
+        _nNextLazyFailure = 0;
     }
     virtual ~BirrtPlanner() {
     }
@@ -310,6 +324,12 @@ Some python code to display data::\n\
 
         // TODO perhaps distmetricfn should take into number of revolutions of circular joints
         _treeBackward.Init(shared_planner(), _parameters->GetDOF(), _parameters->_distmetricfn, _parameters->_fStepLength, _parameters->_distmetricfn(_parameters->_vConfigLowerLimit, _parameters->_vConfigUpperLimit));
+        _treeForward.SetLazyCollisionChecking(_bLazyCollisionChecking);
+        _treeBackward.SetLazyCollisionChecking(_bLazyCollisionChecking);
+        _vLazyFailures.resize(0);
+        _nNextLazyFailure = 0;
+        _nLazyEdgeChecks = 0;
+        _nLazyRepairs = 0;
 
         //read in all goals
         if( (_parameters->vgoalconfig.size() % _parameters->GetDOF()) != 0 ) {
@@ -468,6 +488,13 @@ Some python code to display data::\n\
 
             et = TreeB->Extend(TreeA->GetVectorConfig(iConnectedA), iConnectedB);     // extend B toward A
 
+            if( et == ET_Connected && _bLazyCollisionChecking ) {
+                if( !_CheckLazyPath(TreeA == &_treeForward ? iConnectedA : iConnectedB, TreeA == &_treeBackward ? iConnectedA : iConnectedB) ) {
+                    // the trees were repaired, so keep growing them
+                    et = ET_Sucess;
+                }
+            }
+
             if( et == ET_Connected ) {
                 // connected, process goal
                 _vgoalpaths.push_back(GOALPATH());
@@ -519,6 +546,9 @@ Some python code to display data::\n\
         }
         ptraj->Insert(ptraj->GetNumWaypoints(), itbest->qall, _parameters->_configurationspecification);
         RAVELOG_DEBUG_FORMAT("env=%d, plan success, iters=%d, path=%d points, computation time=%fs\n", GetEnv()->GetId()%progress._iteration%ptraj->GetNumWaypoints()%(0.001f*(float)(utils::GetMilliTime()-basetime)));
+        if( _bLazyCollisionChecking ) {
+            RAVELOG_DEBUG_FORMAT("env=%d, lazy collision checking checked %d edges, repaired the trees %d times", GetEnv()->GetId()%_nLazyEdgeChecks%_nLazyRepairs);
+        }
         return _ProcessPostPlanners(_robot,ptraj);
     }
 
@@ -628,6 +658,12 @@ Some python code to display data::\n\
         return _parameters;
     }
 
+    /// \brief if true, the edges are only checked once they are part of a path connecting the trees. Applies from the next InitPlan on.
+    void SetLazyCollisionChecking(bool bLazyCollisionChecking)
+    {
+        _bLazyCollisionChecking = bLazyCollisionChecking;
+    }
+
     virtual bool _DumpTreeCommand(std::ostream& os, std::istream& is) {
         std::string filename = RaveGetHomeDirectory() + string("/birrtdump.txt");
         getline(is, filename);
@@ -641,12 +677,115 @@ Some python code to display data::\n\
     }
 
 protected:
+    bool _SetLazyCollisionCheckingCommand(std::ostream& sout, std::istream& sinput)
+    {
+        int blazy = 0;
+        sinput >> blazy;
+        if( !sinput ) {
+            return false;
+        }
+        SetLazyCollisionChecking(blazy != 0);
+        return true;
+    }
+
+    bool _GetLazyStatisticsCommand(std::ostream& sout, std::istream& sinput)
+    {
+        sout << _nLazyEdgeChecks << " " << _nLazyRepairs;
+        return true;
+    }
+
+    /// \brief checks the unchecked edges of the path through the connected nodes, the ones closest to previous failures first
+    ///
+    /// If an edge fails, the nodes after it are removed from the nearest neighbor search of their tree.
+    /// \return true if all the edges are valid
+    bool _CheckLazyPath(NodeBase* iConnectedForward, NodeBase* iConnectedBackward)
+    {
+        const int dof = _parameters->GetDOF();
+        _vLazyEdges.resize(0);
+        for(int itree = 0; itree < 2; ++itree) {
+            SimpleNode* pnode = (SimpleNode*)(itree == 0 ? iConnectedForward : iConnectedBackward);
+            while(!!pnode->rrtparent) {
+                if( !pnode->_edgechecked ) {
+                    _vLazyEdges.push_back(make_pair(_ComputeLazyFailureDistance(pnode), make_pair(pnode, itree)));
+                }
+                pnode = pnode->rrtparent;
+            }
+        }
+        std::stable_sort(_vLazyEdges.begin(), _vLazyEdges.end(), _CompareLazyEdges);
+
+        _vLazyParentConfig.resize(dof);
+        _vLazyChildConfig.resize(dof);
+        FOREACHC(itedge, _vLazyEdges) {
+            SimpleNode* pnode = itedge->second.first;
+            std::copy(pnode->rrtparent->q, pnode->rrtparent->q+dof, _vLazyParentConfig.begin());
+            std::copy(pnode->q, pnode->q+dof, _vLazyChildConfig.begin());
+            ++_nLazyEdgeChecks;
+            // the configurations of the nodes were checked when they were added. Keep the direction of the path from the initial to the goal configurations
+            int ret;
+            if( itedge->second.second == 0 ) {
+                ret = _parameters->CheckPathAllConstraints(_vLazyParentConfig, _vLazyChildConfig, std::vector<dReal>(), std::vector<dReal>(), 0, IT_Open, 0xffff, _filterreturn);
+            }
+            else {
+                ret = _parameters->CheckPathAllConstraints(_vLazyChildConfig, _vLazyParentConfig, std::vector<dReal>(), std::vector<dReal>(), 0, IT_Open, 0xffff, _filterreturn);
+            }
+            if( ret != 0 ) {
+                ++_nLazyRepairs;
+                if( (int)_filterreturn->_invalidvalues.size() == dof ) {
+                    if( _vLazyFailures.size() < s_nMaxLazyFailures*dof ) {
+                        _vLazyFailures.insert(_vLazyFailures.end(), _filterreturn->_invalidvalues.begin(), _filterreturn->_invalidvalues.end());
+                    }
+                    else {
+                        std::copy(_filterreturn->_invalidvalues.begin(), _filterreturn->_invalidvalues.end(), _vLazyFailures.begin()+_nNextLazyFailure*dof);
+                        _nNextLazyFailure = (_nNextLazyFailure+1)%s_nMaxLazyFailures;
+                    }
+                }
+                if( itedge->second.second == 0 ) {
+                    _treeForward.InvalidateNodesWithParent(pnode);
+                }
+                else {
+                    _treeBackward.InvalidateNodesWithParent(pnode);
+                }
+                RAVELOG_VERBOSE_FORMAT("env=%d, lazy edge %d/%d failed, repaired the trees", GetEnv()->GetId()%(itedge-_vLazyEdges.begin())%_vLazyEdges.size());
+                return false;
+            }
+            pnode->_edgechecked = 1;
+        }
+        return true;
+    }
+
+    /// \brief distance from the edge of pnode to the closest configuration where an edge failed, infinity if there are none
+    dReal _ComputeLazyFailureDistance(SimpleNode* pnode) const
+    {
+        const int dof = _parameters->GetDOF();
+        VectorWrapper<dReal> vchild(pnode->q, pnode->q+dof), vparent(pnode->rrtparent->q, pnode->rrtparent->q+dof);
+        dReal fmindist = std::numeric_limits<dReal>::infinity();
+        for(size_t ifailure = 0; ifailure < _vLazyFailures.size(); ifailure += dof) {
+            VectorWrapper<dReal> vfailure(&_vLazyFailures[ifailure], &_vLazyFailures[ifailure]+dof);
+            fmindist = min(fmindist, min(_parameters->_distmetricfn(vfailure, vchild), _parameters->_distmetricfn(vfailure, vparent)));
+        }
+        return fmindist;
+    }
+
+    static bool _CompareLazyEdges(const std::pair<dReal, std::pair<SimpleNode*, int> >& edge0, const std::pair<dReal, std::pair<SimpleNode*, int> >& edge1)
+    {
+        return edge0.first < edge1.first;
+    }
+
+    static const size_t s_nMaxLazyFailures = 64; ///< number of failed configurations remembered for ordering the lazy edge checks
+
     RRTParametersPtr _parameters;
     SpatialTree< SimpleNode > _treeBackward;
     dReal _fGoalBiasProb;
     std::vector< NodeBase* > _vecGoalNodes;
     size_t _nValidGoals; ///< num valid goals
     std::vector<GOALPATH> _vgoalpaths;
+
+    bool _bLazyCollisionChecking; ///< if true, the edges are only checked once they are part of a path connecting the trees
+    std::vector< std::pair<dReal, std::pair<SimpleNode*, int> > > _vLazyEdges; ///< the unchecked edges of a path with their distance to the closest failure and their tree (0 forward, 1 backward)
+    std::vector<dReal> _vLazyFailures; ///< the configurations where lazy edges failed
+    size_t _nNextLazyFailure; ///< the failure replaced next once _vLazyFailures is full
+    std::vector<dReal> _vLazyParentConfig, _vLazyChildConfig;
+    int _nLazyEdgeChecks, _nLazyRepairs; ///< statistics of the last plan
 };
 
 class BasicRrtPlanner : public RrtPlanner<SimpleNode>
@@ -999,6 +1138,464 @@ private:
 
 };
 
+/// \brief runs several BiRRTs with different seeds in parallel, each on its own clone of the environment
+class ParallelBirrtPlanner : public PlannerBase
+{
+    /// \brief a BiRRT planning in its own environment clone
+    struct Worker
+    {
+        Worker() : _status(PS_Failed), _iterations(0), _seed(0), _planningtime(0), _pathlength(0) {
+        }
+        Worker(const Worker& r) : _penv(r._penv), _planner(r._planner), _callbackhandle(r._callbackhandle), _ptraj(r._ptraj), _parameters(r._parameters), _robotname(r._robotname), _status(r._status), _iterations(r._iterations.load()), _seed(r._seed), _planningtime(r._planningtime), _pathlength(r._pathlength) {
+        }
+        EnvironmentBasePtr _penv;
+        boost::shared_ptr<BirrtPlanner> _planner;
+        UserDataPtr _callbackhandle;
+        TrajectoryBasePtr _ptraj;
+        RRTParametersPtr _parameters;
+        std::string _robotname;
+        PlannerStatus _status;
+        boost::atomic<int> _iterations; ///< written by the worker thread, read by the thread calling the plan callbacks
+        uint32_t _seed;
+        dReal _planningtime, _pathlength;
+    };
+
+public:
+    ParallelBirrtPlanner(EnvironmentBasePtr penv) : PlannerBase(penv)
+    {
+        __description = ":Interface Author: Rosen Diankov\n\n\
+Runs several Bi-directional RRTs in parallel, each with its own seed on its own clone of the environment. Worker 0 uses the seed of the parameters, so with one worker the result is the same as the BiRRT planner. Worker k uses the seed plus k times 0x9e3779b9, so the results are reproducible for a given number of workers. By default the first solution is returned and the other workers are stopped.\n\n\
+The parameters are re-created on the clones from the configuration specification. If the state, sampling or constraint functions of the parameters are not the ones created by SetConfigurationSpecification or SetRobotActiveJoints, the workers could not check the same constraints, so the query is planned by a single BiRRT in this environment instead. Otherwise _samplegoalfn and _sampleinitialfn are ignored. The post-processing planner is run once on the returned path.";
+        RegisterCommand("SetNumThreads",boost::bind(&ParallelBirrtPlanner::_SetNumThreadsCommand,this,_1,_2),
+                        "format: int\n\n\
+number of BiRRTs to run in parallel. 0 (default) uses the number of cores.");
+        RegisterCommand("SetReturnMode",boost::bind(&ParallelBirrtPlanner::_SetReturnModeCommand,this,_1,_2),
+                        "format: first/best\n\n\
+first (default) returns the first solution found and stops the other workers. best waits for all workers to finish and returns the shortest path. Use _nMaxPlanningTime to give a time budget.");
+        RegisterCommand("SetLazyCollisionChecking",boost::bind(&ParallelBirrtPlanner::_SetLazyCollisionCheckingCommand,this,_1,_2),
+                        "format: int\n\n\
+if 1, the BiRRTs of the workers and of the benchmark check the edges lazily, see the SetLazyCollisionChecking command of the BiRRT planner. 0 (default) checks every edge when it is added.");
+        RegisterCommand("GetStatistics",boost::bind(&ParallelBirrtPlanner::_GetStatisticsCommand,this,_1,_2),
+                        "returns the statistics of the last plan: [numworkers] [returned worker index] [seconds]\n\n\
+followed by one line per worker: [status] [iterations] [seed] [seconds] [path length]. numworkers is 0 if the query was planned by a single BiRRT.");
+        RegisterCommand("Benchmark",boost::bind(&ParallelBirrtPlanner::_BenchmarkCommand,this,_1,_2),
+                        "format: [numruns int]\n\n\
+plans the initialized query numruns times (default 10) with the serial BiRRT planner and with the parallel planner, using the seeds _nRandomGeneratorSeed+run. The post-processing planner is not run. Returns: [serial successes] [parallel successes] [serial average seconds] [parallel average seconds] [speedup]");
+        _nNumThreads = 0;
+        _bReturnFirst = true;
+        _bLazyCollisionChecking = false;
+        _bStopWorkers = false;
+        _nFinishedWorkers = 0;
+        _nFirstSolvedWorker = -1;
+        _nReturnedWorker = -1;
+        _planningtime = 0;
+    }
+    virtual ~ParallelBirrtPlanner() {
+        _DestroyWorkers();
+    }
+
+    virtual bool InitPlan(RobotBasePtr pbase, PlannerParametersConstPtr pparams)
+    {
+        EnvironmentMutex::scoped_lock lock(GetEnv()->GetMutex());
+        _parameters.reset(new RRTParameters());
+        _parameters->copy(pparams);
+        _robot = pbase;
+        try {
+            _parameters->Validate();
+        }
+        catch(const std::exception& ex) {
+            RAVELOG_WARN_FORMAT("env=%d, invalid parameters: %s", GetEnv()->GetId()%ex.what());
+            _parameters.reset();
+            return false;
+        }
+        if( _parameters->_configurationspecification.GetDOF() == 0 || !_robot ) {
+            RAVELOG_WARN("ParallelBirrtPlanner::InitPlan - needs a robot and a configuration specification\n");
+            _parameters.reset();
+            return false;
+        }
+        if( _parameters->vgoalconfig.size() == 0 || _parameters->vinitialconfig.size() == 0 ) {
+            RAVELOG_WARN("ParallelBirrtPlanner::InitPlan - needs initial and goal configurations\n");
+            _parameters.reset();
+            return false;
+        }
+        _serialcallbackhandle.reset();
+        _serialplanner.reset();
+        std::string fnname;
+        if( !rplanners::AreDefaultPlannerFunctions(GetEnv(), _robot, _parameters, fnname) ) {
+            RAVELOG_WARN_FORMAT("env=%d, %s of the parameters cannot be re-created on the environment clones, planning with a single BiRRT", GetEnv()->GetId()%fnname);
+            _serialplanner.reset(new BirrtPlanner(GetEnv()));
+            _serialplanner->SetLazyCollisionChecking(_bLazyCollisionChecking);
+            _serialcallbackhandle = _serialplanner->RegisterPlanCallback(boost::bind(&ParallelBirrtPlanner::_SerialCallback,this,_1));
+            if( !_serialplanner->InitPlan(pbase, pparams) ) {
+                _serialcallbackhandle.reset();
+                _serialplanner.reset();
+                _parameters.reset();
+                return false;
+            }
+        }
+        return true;
+    }
+
+    virtual PlannerStatus PlanPath(TrajectoryBasePtr ptraj)
+    {
+        if(!_parameters) {
+            RAVELOG_ERROR("ParallelBirrtPlanner::PlanPath - Error, planner not initialized\n");
+            return PS_Failed;
+        }
+        EnvironmentMutex::scoped_lock lock(GetEnv()->GetMutex());
+        if( !!_serialplanner ) {
+            // runs the post-processing planner itself
+            _nReturnedWorker = -1;
+            uint64_t basetime = utils::GetMicroTime();
+            PlannerStatus status = _serialplanner->PlanPath(ptraj);
+            _planningtime = 1e-6*(utils::GetMicroTime()-basetime);
+            return status;
+        }
+        PlannerStatus status = _PlanParallel(_GetNumWorkers(), _parameters->_nRandomGeneratorSeed, true, ptraj);
+        if( status != PS_HasSolution ) {
+            return status;
+        }
+        return _ProcessPostPlanners(_robot,ptraj);
+    }
+
+    virtual PlannerParametersConstPtr GetParameters() const {
+        return _parameters;
+    }
+
+protected:
+    bool _SetNumThreadsCommand(std::ostream& sout, std::istream& sinput)
+    {
+        int nthreads = 0;
+        sinput >> nthreads;
+        if( !sinput ) {
+            return false;
+        }
+        _nNumThreads = max(0, nthreads);
+        return true;
+    }
+
+    bool _SetReturnModeCommand(std::ostream& sout, std::istream& sinput)
+    {
+        std::string mode;
+        sinput >> mode;
+        if( mode == "first" ) {
+            _bReturnFirst = true;
+        }
+        else if( mode == "best" ) {
+            _bReturnFirst = false;
+        }
+        else {
+            RAVELOG_WARN_FORMAT("unknown return mode %s", mode);
+            return false;
+        }
+        return true;
+    }
+
+    bool _SetLazyCollisionCheckingCommand(std::ostream& sout, std::istream& sinput)
+    {
+        int blazy = 0;
+        sinput >> blazy;
+        if( !sinput ) {
+            return false;
+        }
+        _bLazyCollisionChecking = blazy != 0;
+        return true;
+    }
+
+    bool _GetStatisticsCommand(std::ostream& sout, std::istream& sinput)
+    {
+        if( !!_serialplanner ) {
+            sout << 0 << " " << _nReturnedWorker << " " << _planningtime << std::endl;
+            return true;
+        }
+        sout << _vworkers.size() << " " << _nReturnedWorker << " " << _planningtime << std::endl;
+        FOREACHC(itworker, _vworkers) {
+            sout << itworker->_status << " " << itworker->_iterations.load() << " " << itworker->_seed << " " << itworker->_planningtime << " " << itworker->_pathlength << std::endl;
+        }
+        return true;
+    }
+
+    bool _BenchmarkCommand(std::ostream& sout, std::istream& sinput)
+    {
+        int numruns = 10;
+        sinput >> numruns;
+        if( !_parameters ) {
+            RAVELOG_WARN("planner not initialized\n");
+            return false;
+        }
+        if( !!_serialplanner ) {
+            RAVELOG_WARN("the query is planned by a single BiRRT, nothing to compare\n");
+            return false;
+        }
+        EnvironmentMutex::scoped_lock lock(GetEnv()->GetMutex());
+        int numworkers = _GetNumWorkers();
+        boost::shared_ptr<BirrtPlanner> serialplanner(new BirrtPlanner(GetEnv()));
+        serialplanner->SetLazyCollisionChecking(_bLazyCollisionChecking);
+        RRTParametersPtr params(new RRTParameters());
+        params->copy(_parameters);
+        params->_sPostProcessingPlanner = "";
+        params->_sPostProcessingParameters = "";
+        TrajectoryBasePtr ptraj = RaveCreateTrajectory(GetEnv(), "");
+        int numserialsuccess = 0, numparallelsuccess = 0;
+        uint64_t serialtime = 0, paralleltime = 0;
+        for(int irun = 0; irun < numruns; ++irun) {
+            params->_nRandomGeneratorSeed = _parameters->_nRandomGeneratorSeed + irun;
+            uint64_t starttime = utils::GetMicroTime();
+            ptraj->Init(_parameters->_configurationspecification);
+            if( serialplanner->InitPlan(_robot, params) && serialplanner->PlanPath(ptraj) == PS_HasSolution ) {
+                numserialsuccess++;
+            }
+            serialtime += utils::GetMicroTime() - starttime;
+
+            starttime = utils::GetMicroTime();
+            ptraj->Init(_parameters->_configurationspecification);
+            if( _PlanParallel(numworkers, params->_nRandomGeneratorSeed, false, ptraj) == PS_HasSolution ) {
+                numparallelsuccess++;
+            }
+            paralleltime += utils::GetMicroTime() - starttime;
+        }
+        dReal serialavg = numruns > 0 ? 1e-6*serialtime/numruns : 0, parallelavg = numruns > 0 ? 1e-6*paralleltime/numruns : 0;
+        sout << numserialsuccess << " " << numparallelsuccess << " " << serialavg << " " << parallelavg << " " << (parallelavg > 0 ? serialavg/parallelavg : 0);
+        return true;
+    }
+
+    int _GetNumWorkers() const
+    {
+        return _nNumThreads > 0 ? _nNumThreads : max(1, (int)boost::thread::hardware_concurrency());
+    }
+
+    /// \brief plans with numworkers BiRRTs and appends the returned path to ptraj. The environment has to be locked.
+    ///
+    /// \param bcallbacks if true, calls the registered plan callbacks while the workers run
+    PlannerStatus _PlanParallel(int numworkers, uint32_t seed, bool bcallbacks, TrajectoryBasePtr ptraj)
+    {
+        uint64_t basetime = utils::GetMicroTime();
+        _nReturnedWorker = -1;
+        if( !_InitWorkers(numworkers, seed) ) {
+            return PS_Failed;
+        }
+
+        _bStopWorkers = false;
+        _nFinishedWorkers = 0;
+        boost::thread_group threads;
+        for(int iworker = 0; iworker < numworkers; ++iworker) {
+            threads.create_thread(boost::bind(&ParallelBirrtPlanner::_WorkerThread, this, iworker));
+        }
+
+        // the user callbacks are called from this thread since they expect the environment of the planner
+        bool binterrupted = false;
+        PlannerProgress progress;
+        while(1) {
+            {
+                boost::mutex::scoped_lock lock(_mutexworkers);
+                if( _nFinishedWorkers < numworkers ) {
+                    _condworkers.timed_wait(lock, boost::posix_time::milliseconds(10));
+                }
+                if( _nFinishedWorkers >= numworkers ) {
+                    break;
+                }
+            }
+            if( bcallbacks ) {
+                progress._iteration = 0;
+                FOREACHC(itworker, _vworkers) {
+                    progress._iteration = max(progress._iteration, itworker->_iterations.load());
+                }
+                if( _CallCallbacks(progress) == PA_Interrupt ) {
+                    _bStopWorkers = true;
+                    binterrupted = true;
+                }
+            }
+        }
+        threads.join_all();
+
+        // choose the returned path in the main thread, the distance metric of _parameters uses the bodies of this environment
+        int ireturned = -1;
+        for(int iworker = 0; iworker < numworkers; ++iworker) {
+            Worker& worker = _vworkers[iworker];
+            if( worker._status != PS_HasSolution ) {
+                continue;
+            }
+            worker._pathlength = _ComputePathLength(worker._ptraj);
+            if( ireturned < 0 || (!_bReturnFirst && worker._pathlength < _vworkers[ireturned]._pathlength) ) {
+                ireturned = iworker;
+            }
+        }
+        if( _bReturnFirst && _nFirstSolvedWorker >= 0 ) {
+            ireturned = _nFirstSolvedWorker;
+        }
+        _planningtime = 1e-6*(utils::GetMicroTime()-basetime);
+        if( binterrupted ) {
+            return PS_Interrupted;
+        }
+        if( ireturned < 0 ) {
+            RAVELOG_WARN_FORMAT("env=%d, plan failed with %d workers, %fs", GetEnv()->GetId()%numworkers%_planningtime);
+            return PS_Failed;
+        }
+
+        _nReturnedWorker = ireturned;
+        std::vector<dReal> vdata;
+        TrajectoryBasePtr pworkertraj = _vworkers[ireturned]._ptraj;
+        pworkertraj->GetWaypoints(0, pworkertraj->GetNumWaypoints(), vdata, _parameters->_configurationspecification);
+        if( ptraj->GetConfigurationSpecification().GetDOF() == 0 ) {
+            ptraj->Init(_parameters->_configurationspecification);
+        }
+        ptraj->Insert(ptraj->GetNumWaypoints(), vdata, _parameters->_configurationspecification);
+        RAVELOG_DEBUG_FORMAT("env=%d, plan success from worker %d/%d, iters=%d, path=%d points, computation time=%fs", GetEnv()->GetId()%ireturned%numworkers%_vworkers[ireturned]._iterations.load()%pworkertraj->GetNumWaypoints()%_planningtime);
+        return PS_HasSolution;
+    }
+
+    /// \brief updates the environment clones and the parameters of the workers. The environment has to be locked.
+    bool _InitWorkers(int numworkers, uint32_t seed)
+    {
+        if( (int)_vworkers.size() > numworkers ) {
+            for(size_t iworker = numworkers; iworker < _vworkers.size(); ++iworker) {
+                _vworkers[iworker]._callbackhandle.reset();
+                _vworkers[iworker]._planner.reset();
+                _vworkers[iworker]._penv->Destroy();
+            }
+            _vworkers.resize(numworkers);
+        }
+        _nFirstSolvedWorker = -1;
+        for(int iworker = 0; iworker < numworkers; ++iworker) {
+            if( iworker < (int)_vworkers.size() ) {
+                _vworkers[iworker]._penv->Clone(GetEnv(), Clone_Bodies);
+            }
+            else {
+                _vworkers.push_back(Worker());
+                Worker& worker = _vworkers.back();
+                worker._penv = GetEnv()->CloneSelf(Clone_Bodies);
+                worker._planner.reset(new BirrtPlanner(worker._penv));
+                worker._callbackhandle = worker._planner->RegisterPlanCallback(boost::bind(&ParallelBirrtPlanner::_WorkerCallback,this,iworker,_1));
+            }
+            Worker& worker = _vworkers[iworker];
+            // the simulation thread of a clone would compete with the worker for the environment lock and the cores
+            worker._penv->StopSimulation();
+            worker._robotname = _robot->GetName();
+            worker._seed = seed + (uint32_t)iworker*0x9e3779b9;
+            worker._status = PS_Failed;
+            worker._iterations = 0;
+            worker._planningtime = 0;
+            worker._pathlength = 0;
+            try {
+                EnvironmentMutex::scoped_lock lockclone(worker._penv->GetMutex());
+                RRTParametersPtr params(new RRTParameters());
+                params->copy(_parameters);
+                params->SetConfigurationSpecification(worker._penv, _parameters->_configurationspecification);
+                // SetConfigurationSpecification resets the query and the limits from the cloned bodies
+                params->vinitialconfig = _parameters->vinitialconfig;
+                params->vgoalconfig = _parameters->vgoalconfig;
+                params->_vConfigLowerLimit = _parameters->_vConfigLowerLimit;
+                params->_vConfigUpperLimit = _parameters->_vConfigUpperLimit;
+                params->_vConfigVelocityLimit = _parameters->_vConfigVelocityLimit;
+                params->_vConfigAccelerationLimit = _parameters->_vConfigAccelerationLimit;
+                params->_vConfigResolution = _parameters->_vConfigResolution;
+                params->_samplegoalfn.clear();
+                params->_sampleinitialfn.clear();
+                params->_sPostProcessingPlanner = "";
+                params->_sPostProcessingParameters = "";
+                params->_nRandomGeneratorSeed = worker._seed;
+                worker._parameters = params;
+                worker._planner->SetLazyCollisionChecking(_bLazyCollisionChecking);
+                worker._ptraj = RaveCreateTrajectory(worker._penv, "");
+                worker._ptraj->Init(_parameters->_configurationspecification);
+            }
+            catch(const std::exception& ex) {
+                RAVELOG_WARN_FORMAT("env=%d, failed to set up parallel worker %d: %s", GetEnv()->GetId()%iworker%ex.what());
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void _WorkerThread(int iworker)
+    {
+        Worker& worker = _vworkers[iworker];
+        uint64_t starttime = utils::GetMicroTime();
+        PlannerStatus status = PS_Failed;
+        try {
+            RobotBasePtr probot = worker._penv->GetRobot(worker._robotname);
+            if( !probot ) {
+                RAVELOG_WARN_FORMAT("failed to find robot %s in the environment clone", worker._robotname);
+            }
+            else if( worker._planner->InitPlan(probot, worker._parameters) ) {
+                status = worker._planner->PlanPath(worker._ptraj);
+            }
+        }
+        catch(const std::exception& ex) {
+            RAVELOG_WARN_FORMAT("parallel worker %d failed: %s", iworker%ex.what());
+            status = PS_Failed;
+        }
+        worker._status = status;
+        worker._planningtime = 1e-6*(utils::GetMicroTime()-starttime);
+
+        boost::mutex::scoped_lock lock(_mutexworkers);
+        if( status == PS_HasSolution && _nFirstSolvedWorker < 0 ) {
+            _nFirstSolvedWorker = iworker;
+            if( _bReturnFirst ) {
+                _bStopWorkers = true;
+            }
+        }
+        _nFinishedWorkers++;
+        _condworkers.notify_all();
+    }
+
+    /// \brief called by the BiRRT of a worker every iteration
+    PlannerAction _WorkerCallback(int iworker, const PlannerProgress& progress)
+    {
+        _vworkers[iworker]._iterations = progress._iteration;
+        return _bStopWorkers ? PA_Interrupt : PA_None;
+    }
+
+    /// \brief called by the BiRRT planning the queries that the workers cannot plan
+    PlannerAction _SerialCallback(const PlannerProgress& progress)
+    {
+        return _CallCallbacks(progress);
+    }
+
+    /// \brief sum of the distances between the waypoints
+    dReal _ComputePathLength(TrajectoryBasePtr ptraj)
+    {
+        std::vector<dReal> vdata;
+        ptraj->GetWaypoints(0, ptraj->GetNumWaypoints(), vdata, _parameters->_configurationspecification);
+        int dof = _parameters->GetDOF();
+        std::vector<dReal> q0(dof), q1(dof);
+        dReal length = 0;
+        for(size_t i = dof; i+dof <= vdata.size(); i += dof) {
+            std::copy(vdata.begin()+i-dof, vdata.begin()+i, q0.begin());
+            std::copy(vdata.begin()+i, vdata.begin()+i+dof, q1.begin());
+            length += _parameters->_distmetricfn(q0, q1);
+        }
+        return length;
+    }
+
+    void _DestroyWorkers()
+    {
+        FOREACH(itworker, _vworkers) {
+            itworker->_callbackhandle.reset();
+            itworker->_planner.reset();
+            if( !!itworker->_penv ) {
+                itworker->_penv->Destroy();
+            }
+        }
+        _vworkers.resize(0);
+    }
+
+    RRTParametersPtr _parameters;
+    RobotBasePtr _robot;
+    boost::shared_ptr<BirrtPlanner> _serialplanner; ///< if not empty, plans the initialized query instead of the workers since the workers cannot use the functions of the parameters
+    UserDataPtr _serialcallbackhandle;
+    int _nNumThreads; ///< number of workers, 0 for the number of cores
+    bool _bReturnFirst; ///< if true, returns the first solution, otherwise the shortest one
+    bool _bLazyCollisionChecking; ///< if true, the BiRRTs of the workers check their edges lazily
+    std::vector<Worker> _vworkers;
+    boost::mutex _mutexworkers; ///< protects _nFinishedWorkers and _nFirstSolvedWorker
+    boost::condition _condworkers; ///< notified when a worker finishes
+    boost::atomic<bool> _bStopWorkers; ///< if true, the workers interrupt their BiRRT. Atomic since every worker reads it every iteration without taking _mutexworkers
+    int _nFinishedWorkers, _nFirstSolvedWorker;
+    int _nReturnedWorker; ///< worker whose path was returned by the last plan
+    dReal _planningtime; ///< seconds taken by the last plan
+};
+
 #ifdef RAVE_REGISTER_BOOST
 #include BOOST_TYPEOF_INCREMENT_REGISTRATION_GROUP()
 BOOST_TYPEOF_REGISTER_TYPE(BirrtPlanner::GOALPATH)
@@ -0,0 +1,66 @@
+// -*- coding: utf-8 -*-
+// Copyright (C) 2016 Rosen Diankov
+//
+// This program is free software: you can redistribute it and/or modify it under the terms of the
+// GNU Lesser General Public License as published by the Free Software Foundation, either version 3
+// of the License, or at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+// even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License along with this program.
+// If not, see <http://www.gnu.org/licenses/>.
+#include "feasibilitymemo.h"
+#include <boost/math/special_functions/next.hpp>
+
+using namespace rplanners;
+
+struct TestCheckReturn
+{
+    TestCheckReturn(int retcode=0) : retcode(retcode) {
+    }
+    int retcode;
+};
+
+typedef FeasibilityMemo<TestCheckReturn> TestFeasibilityMemo;
+
+static int s_numfailures = 0;
+
+#define CHECK_MEMO(expr) if( !(expr) ) { RAVELOG_ERROR("%s:%d: %s failed\n", __FILE__, __LINE__, #expr); ++s_numfailures; }
+
+int main()
+{
+    TestFeasibilityMemo memo;
+    memo.Reset();
+
+    // only the exact values are found
+    std::vector<dReal> q(3), dq(3), q2, dq2;
+    q[0] = 0.1; q[1] = -0.2; q[2] = 0.3;
+    dq[0] = 0.5; dq[1] = 0; dq[2] = -1;
+    memo.InsertConfig(q, dq, CFO_CheckEnvCollisions, TestCheckReturn(3));
+    const TestCheckReturn* pret = memo.FindConfig(q, dq, CFO_CheckEnvCollisions);
+    CHECK_MEMO(!!pret && pret->retcode == 3);
+    q2 = q; q2[1] = boost::math::float_next(q2[1]);
+    CHECK_MEMO(!memo.FindConfig(q2, dq, CFO_CheckEnvCollisions));
+    dq2 = dq; dq2[2] = boost::math::float_prior(dq2[2]);
+    CHECK_MEMO(!memo.FindConfig(q, dq2, CFO_CheckEnvCollisions));
+    CHECK_MEMO(!memo.FindConfig(q, dq, CFO_CheckEnvCollisions|CFO_CheckSelfCollisions));
+    // values that are not finite are never stored
+    q2 = q; q2[0] = std::numeric_limits<dReal>::quiet_NaN();
+    memo.InsertConfig(q2, dq, CFO_CheckEnvCollisions, TestCheckReturn(0));
+    CHECK_MEMO(!memo.FindConfig(q2, dq, CFO_CheckEnvCollisions));
+    CHECK_MEMO(memo.GetStatistics().nconfighits == 1 && memo.GetStatistics().nconfigqueries == 5);
+
+    // every plan starts with an empty memo
+    memo.Reset();
+    CHECK_MEMO(memo.GetStatistics().nconfigqueries == 0);
+    CHECK_MEMO(!memo.FindConfig(q, dq, CFO_CheckEnvCollisions));
+
+    if( s_numfailures > 0 ) {
+        RAVELOG_ERROR("%d checks of the feasibility memo failed\n", s_numfailures);
+        return 1;
+    }
+    RAVELOG_INFO("all checks of the feasibility memo passed\n");
+    return 0;
+}
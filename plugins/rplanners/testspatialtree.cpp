@@ -0,0 +1,132 @@
+// -*- coding: utf-8 -*-
+// Copyright (C) 2016 Rosen Diankov
+//
+// This program is free software: you can redistribute it and/or modify it under the terms of the
+// GNU Lesser General Public License as published by the Free Software Foundation, either version 3
+// of the License, or at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+// even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License along with this program.
+// If not, see <http://www.gnu.org/licenses/>.
+#include "rplanners.h"
+
+static int s_numfailures = 0;
+
+#define CHECK_TREE(expr) if( !(expr) ) { RAVELOG_ERROR("%s:%d: %s failed\n", __FILE__, __LINE__, #expr); ++s_numfailures; }
+
+static dReal ComputeDistance(const std::vector<dReal>& q0, const std::vector<dReal>& q1)
+{
+    dReal dist = 0;
+    for(size_t i = 0; i < q0.size(); ++i) {
+        dist += (q0[i]-q1[i])*(q0[i]-q1[i]);
+    }
+    return RaveSqrt(dist);
+}
+
+int main()
+{
+    boost::function<dReal(const std::vector<dReal>&, const std::vector<dReal>&)> distmetricfn = ComputeDistance;
+    SpatialTree<SimpleNode> tree(0);
+    std::vector<dReal> q(1);
+
+    // the nodes after an invalidated node are never returned, even when they are closer than the valid ones
+    tree.Init(boost::weak_ptr<PlannerBase>(), 1, distmetricfn, 0.1, 10);
+    q[0] = 0; NodeBase* proot = tree.InsertNode(NULL, q, 0);
+    q[0] = 1; NodeBase* pnode1 = tree.InsertNode(proot, q, 0);
+    q[0] = 1.1; NodeBase* pnode2 = tree.InsertNode(pnode1, q, 0);
+    q[0] = 1.2; tree.InsertNode(pnode2, q, 0);
+    q[0] = -1; NodeBase* pnode4 = tree.InsertNode(proot, q, 0);
+    q[0] = 1.15;
+    CHECK_TREE(tree.FindNearestNode(q).first == pnode2);
+    tree.InvalidateNodesWithParent(pnode1);
+    std::pair<NodeBase*, dReal> nn = tree.FindNearestNode(q);
+    CHECK_TREE(nn.first == proot && RaveFabs(nn.second - 1.15) <= 1e-12);
+    q[0] = -0.9;
+    CHECK_TREE(tree.FindNearestNode(q).first == pnode4);
+    tree.InvalidateNodesWithParent(proot);
+    CHECK_TREE(!tree.FindNearestNode(q).first);
+
+    // on random trees only valid nodes are returned. The search of the cover tree is not exact, so the distances are not compared
+    const int dof = 3, numnodes = 500, numqueries = 1000;
+    uint32_t seed = 5;
+    q.resize(dof);
+    tree.Init(boost::weak_ptr<PlannerBase>(), dof, distmetricfn, 0.1, 2*RaveSqrt(dReal(dof)));
+    std::vector<NodeBase*> vnodes;
+    std::vector<int> vparents;
+    std::vector< std::vector<dReal> > vconfigs;
+    std::vector<uint8_t> vvalid;
+    for(int inode = 0; inode < numnodes; ++inode) {
+        for(int idof = 0; idof < dof; ++idof) {
+            q[idof] = 2*rand_r(&seed)/dReal(RAND_MAX) - 1;
+        }
+        // attach to the nearest node like Extend does, which can be a clone of the parent
+        NodeBase* pparent = tree.FindNearestNode(q).first;
+        int iparent = -1;
+        if( !!pparent ) {
+            iparent = find(vconfigs.begin(), vconfigs.end(), tree.GetVectorConfig(pparent)) - vconfigs.begin();
+        }
+        NodeBase* pnode = tree.InsertNode(pparent, q, 0);
+        if( !pnode ) {
+            // too close to an existing node
+            continue;
+        }
+        vnodes.push_back(pnode);
+        vparents.push_back(iparent);
+        vconfigs.push_back(q);
+        vvalid.push_back(1);
+    }
+    for(int iinvalid = 0; iinvalid < 5; ++iinvalid) {
+        int iparent = 1 + rand_r(&seed)%(vnodes.size()-1);
+        tree.InvalidateNodesWithParent(vnodes[iparent]);
+        vvalid[iparent] = 0;
+    }
+    // parents are inserted before their children
+    for(size_t inode = 0; inode < vnodes.size(); ++inode) {
+        if( vparents[inode] >= 0 && !vvalid[vparents[inode]] ) {
+            vvalid[inode] = 0;
+        }
+    }
+    int numinvalidnodes = 0;
+    for(int iquery = 0; iquery < numqueries; ++iquery) {
+        for(int idof = 0; idof < dof; ++idof) {
+            q[idof] = 2*rand_r(&seed)/dReal(RAND_MAX) - 1;
+        }
+        nn = tree.FindNearestNode(q);
+        bool bvalidnode = false;
+        if( !!nn.first ) {
+            // the nearest node can be a clone in a lower level of the cover tree, so compare the configurations
+            std::vector< std::vector<dReal> >::iterator itconfig = find(vconfigs.begin(), vconfigs.end(), tree.GetVectorConfig(nn.first));
+            bvalidnode = itconfig != vconfigs.end() && vvalid[itconfig-vconfigs.begin()];
+        }
+        if( !bvalidnode ) {
+            ++numinvalidnodes;
+        }
+    }
+    CHECK_TREE(numinvalidnodes == 0);
+
+    // every node, clone and RRT child after an invalidated node is invalid, also after deleting nodes moved the clones
+    std::vector<NodeBase*> vtreenodes;
+    tree.GetNodesVector(vtreenodes);
+    int numtreenodes = tree.GetNumNodes();
+    tree._DeleteNodesWithParent(vnodes[vnodes.size()/2]);
+    CHECK_TREE(tree.GetNumNodes() < numtreenodes && tree.Validate());
+    tree.InvalidateNodesWithParent(vnodes[0]);
+    tree.GetNodesVector(vtreenodes);
+    int numvalidnodes = 0;
+    FOREACHC(itnode, vtreenodes) {
+        numvalidnodes += ((SimpleNode*)*itnode)->_usenn;
+    }
+    CHECK_TREE(numvalidnodes == 0);
+    q[0] = 0.5;
+    CHECK_TREE(!tree.FindNearestNode(q).first);
+
+    if( s_numfailures > 0 ) {
+        RAVELOG_ERROR("%d checks of the spatial tree failed\n", s_numfailures);
+        return 1;
+    }
+    RAVELOG_INFO("all checks of the spatial tree passed\n");
+    return 0;
+}
@@ -113,12 +113,69 @@ public:
     boost::shared_ptr<void const> _handle;
 };
 
+#ifdef OPENRAVE_BININGS_PYARRAY
+
+/// \brief numpy type number corresponding to T, -1 if T has no numpy equivalent
+template <typename T> struct select_npy_type {
+    static const int type = -1;
+};
+template <> struct select_npy_type<float> {
+    static const int type = NPY_FLOAT;
+};
+template <> struct select_npy_type<double> {
+    static const int type = NPY_DOUBLE;
+};
+template <> struct select_npy_type<int> {
+    static const int type = NPY_INT;
+};
+template <> struct select_npy_type<uint8_t> {
+    static const int type = NPY_UINT8;
+};
+template <> struct select_npy_type<uint32_t> {
+    static const int type = NPY_UINT32;
+};
+template <> struct select_npy_type<uint64_t> {
+    static const int type = NPY_UINT64;
+};
+
+/// \brief if o is a 1D numpy array that can be safely cast to T, reads its buffer directly into v.
+///
+/// Arrays that are already contiguous with the correct type are read without any conversion.
+/// \return false if o has to be extracted element by element
+template <typename T>
+inline bool ExtractNumpyArray(const object& o, std::vector<T>& v)
+{
+    if( select_npy_type<T>::type < 0 || !PyArray_Check(o.ptr()) || PyArray_NDIM((PyArrayObject*)o.ptr()) != 1 ) {
+        return false;
+    }
+    // returns a new reference to o itself if no conversion is necessary
+    PyObject* pycontiguous = PyArray_ContiguousFromAny(o.ptr(), select_npy_type<T>::type, 1, 1);
+    if( !pycontiguous ) {
+        PyErr_Clear();
+        return false;
+    }
+    const T* pvalues = (const T*)PyArray_DATA((PyArrayObject*)pycontiguous);
+    v.assign(pvalues, pvalues+PyArray_DIM((PyArrayObject*)pycontiguous,0));
+    Py_DECREF(pycontiguous);
+    return true;
+}
+
+#endif
+
 template <typename T>
 inline std::vector<T> ExtractArray(const object& o)
 {
     if( IS_PYTHONOBJECT_NONE(o) ) {
         return std::vector<T>();
     }
+#ifdef OPENRAVE_BININGS_PYARRAY
+    {
+        std::vector<T> v;
+        if( ExtractNumpyArray(o, v) ) {
+            return v;
+        }
+    }
+#endif
     std::vector<T> v(len(o));
     for(size_t i = 0; i < v.size(); ++i) {
         v[i] = extract<T>(o[i]);
@@ -523,6 +580,62 @@ inline numeric::array toPyArrayN(const uint32_t* pvalues, size_t N)
     return static_cast<numeric::array>(handle<>(pyvalues));
 }
 
+#if PY_VERSION_HEX >= 0x02070000
+template <typename T>
+inline void _ReleaseVectorCapsule(PyObject* pycapsule)
+{
+    delete static_cast<std::vector<T>*>(PyCapsule_GetPointer(pycapsule, NULL));
+}
+#endif
+
+/// \brief returns a numpy array of shape dims that takes over the memory of v instead of copying it.
+///
+/// The array keeps the memory alive through its base object, v is left empty.
+template <typename T>
+inline numeric::array toPyArrayOwned(std::vector<T>& v, std::vector<npy_intp>& dims)
+{
+    BOOST_ASSERT(select_npy_type<T>::type >= 0 && dims.size() > 0);
+    size_t totalsize = 1;
+    FOREACH(it,dims) {
+        totalsize *= *it;
+    }
+    BOOST_ASSERT(totalsize == v.size());
+#if PY_VERSION_HEX >= 0x02070000
+    if( totalsize > 0 ) {
+        std::vector<T>* pvalues = new std::vector<T>();
+        pvalues->swap(v);
+        PyObject* pycapsule = PyCapsule_New(pvalues, NULL, _ReleaseVectorCapsule<T>);
+        if( !pycapsule ) {
+            delete pvalues;
+            throw_error_already_set();
+        }
+        PyObject *pyvalues = PyArray_SimpleNewFromData(dims.size(), &dims[0], select_npy_type<T>::type, &(*pvalues)[0]);
+        if( !pyvalues ) {
+            Py_DECREF(pycapsule);
+            throw_error_already_set();
+        }
+#ifdef NPY_1_7_API_VERSION
+        PyArray_SetBaseObject((PyArrayObject*)pyvalues, pycapsule);
+#else
+        PyArray_BASE(pyvalues) = pycapsule;
+#endif
+        return static_cast<numeric::array>(handle<>(pyvalues));
+    }
+#endif
+    PyObject *pyvalues = PyArray_SimpleNew(dims.size(), &dims[0], select_npy_type<T>::type);
+    if( totalsize > 0 ) {
+        memcpy(PyArray_DATA(pyvalues),&v[0],totalsize*sizeof(T));
+    }
+    return static_cast<numeric::array>(handle<>(pyvalues));
+}
+
+template <typename T>
+inline numeric::array toPyArrayOwned(std::vector<T>& v)
+{
+    std::vector<npy_intp> dims(1, npy_intp(v.size()));
+    return toPyArrayOwned(v, dims);
+}
+
 template <typename T>
 inline object toPyList(const std::vector<T>& v)
 {
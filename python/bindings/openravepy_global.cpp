@@ -726,7 +726,15 @@ std::string openravepyCompilerVersion()
 void raveLog(const string &s, int level)
 {
     if( s.size() > 0 ) {
-        RavePrintfA(s,level);
+        if( OpenRAVE::RaveIsAsyncLogging() ) {
+            // keep the python logs in order with the ones of the C++ threads
+            if( int(OpenRAVE::RaveGetDebugLevel()&OpenRAVE::Level_OutputMask) >= level ) {
+                RAVELOG_ASYNCA(level, s);
+            }
+        }
+        else {
+            RavePrintfA(s,level);
+        }
     }
 }
 
@@ -755,6 +763,18 @@ void raveLogVerbose(const string &s)
     raveLog(s,Level_Verbose);
 }
 
+object pyRaveGetAsyncLoggingStatistics()
+{
+    AsyncLoggingStatistics stats = OpenRAVE::RaveGetAsyncLoggingStatistics();
+    boost::python::dict ostats;
+    ostats["numlogged"] = stats.numlogged;
+    ostats["numdropped"] = stats.numdropped;
+    ostats["numtruncated"] = stats.numtruncated;
+    ostats["numflushes"] = stats.numflushes;
+    ostats["numthreads"] = stats.numthreads;
+    return ostats;
+}
+
 int pyGetIntFromPy(object olevel, int defaultvalue)
 {
     int level = defaultvalue;
@@ -1113,6 +1133,7 @@ string poseSerialization(object o)
 
 BOOST_PYTHON_FUNCTION_OVERLOADS(RaveInitialize_overloads, pyRaveInitialize, 0, 2)
 BOOST_PYTHON_FUNCTION_OVERLOADS(RaveFindLocalFile_overloads, OpenRAVE::RaveFindLocalFile, 1, 2)
+BOOST_PYTHON_FUNCTION_OVERLOADS(RaveSetAsyncLogging_overloads, OpenRAVE::RaveSetAsyncLogging, 1, 3)
 BOOST_PYTHON_FUNCTION_OVERLOADS(InterpolateQuatSlerp_overloads, openravepy::InterpolateQuatSlerp, 3, 4)
 BOOST_PYTHON_FUNCTION_OVERLOADS(InterpolateQuatSquad_overloads, openravepy::InterpolateQuatSquad, 5, 6)
 BOOST_PYTHON_FUNCTION_OVERLOADS(ComputePoseDistSqr_overloads, openravepy::ComputePoseDistSqr, 2, 3)
@@ -1329,6 +1350,10 @@ void init_openravepy_global()
 
     def("RaveSetDebugLevel",openravepy::pyRaveSetDebugLevel,args("level"), DOXY_FN1(RaveSetDebugLevel));
     def("RaveGetDebugLevel",OpenRAVE::RaveGetDebugLevel,DOXY_FN1(RaveGetDebugLevel));
+    def("RaveSetAsyncLogging",OpenRAVE::RaveSetAsyncLogging,RaveSetAsyncLogging_overloads(args("enable","buffersize","flushperiod"), DOXY_FN1(RaveSetAsyncLogging)));
+    def("RaveIsAsyncLogging",OpenRAVE::RaveIsAsyncLogging,DOXY_FN1(RaveIsAsyncLogging));
+    def("RaveFlushLog",OpenRAVE::RaveFlushLog,DOXY_FN1(RaveFlushLog));
+    def("RaveGetAsyncLoggingStatistics",openravepy::pyRaveGetAsyncLoggingStatistics,"Returns the statistics of the asynchronous logging backend as a dictionary with keys numlogged, numdropped, numtruncated, numflushes and numthreads");
     def("RaveSetDataAccess",openravepy::pyRaveSetDataAccess,args("accessoptions"), DOXY_FN1(RaveSetDataAccess));
     def("RaveGetDataAccess",OpenRAVE::RaveGetDataAccess, DOXY_FN1(RaveGetDataAccess));
     def("RaveGetDefaultViewerType", OpenRAVE::RaveGetDefaultViewerType, DOXY_FN1(RaveGetDefaultViewerType));
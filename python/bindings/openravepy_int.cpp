@@ -486,9 +486,9 @@ protected:
         return PyInterfaceBasePtr();
     }
 
-    void _BodyCallback(object fncallback, KinBodyPtr pbody, int action)
+    void _BodyCallback(const object& fncallback, KinBodyPtr pbody, int action)
     {
-        object res;
+        // might be called from a thread that released the GIL, so have to acquire it before touching any python object
         PyGILState_STATE gstate = PyGILState_Ensure();
         try {
             fncallback(openravepy::toPyKinBody(pbody, shared_from_this()), action);
@@ -500,30 +500,33 @@ protected:
         PyGILState_Release(gstate);
     }
 
-    CollisionAction _CollisionCallback(object fncallback, CollisionReportPtr preport, bool bFromPhysics)
+    CollisionAction _CollisionCallback(const object& fncallback, CollisionReportPtr preport, bool bFromPhysics)
     {
-        object res;
+        // might be called from a thread that released the GIL, so have to acquire it before touching any python object
         PyGILState_STATE gstate = PyGILState_Ensure();
-        try {
-            res = fncallback(openravepy::toPyCollisionReport(preport,shared_from_this()),bFromPhysics);
-        }
-        catch(...) {
-            RAVELOG_ERROR("exception occured in python collision callback:\n");
-            PyErr_Print();
-        }
         CollisionAction ret = CA_DefaultAction;
-        if( IS_PYTHONOBJECT_NONE(res) || !res ) {
-            ret = CA_DefaultAction;
-            RAVELOG_WARN("collision callback nothing returning, so executing default action\n");
-        }
-        else {
-            extract<int> xi(res);
-            if( xi.check() ) {
-                ret = (CollisionAction)(int) xi;
+        {
+            object res;
+            try {
+                res = fncallback(openravepy::toPyCollisionReport(preport,shared_from_this()),bFromPhysics);
             }
-            else {
+            catch(...) {
+                RAVELOG_ERROR("exception occured in python collision callback:\n");
+                PyErr_Print();
+            }
+            if( IS_PYTHONOBJECT_NONE(res) || !res ) {
+                ret = CA_DefaultAction;
                 RAVELOG_WARN("collision callback nothing returning, so executing default action\n");
             }
+            else {
+                extract<int> xi(res);
+                if( xi.check() ) {
+                    ret = (CollisionAction)(int) xi;
+                }
+                else {
+                    RAVELOG_WARN("collision callback nothing returning, so executing default action\n");
+                }
+            }
         }
         PyGILState_Release(gstate);
         return ret;
@@ -597,29 +600,78 @@ public:
     }
     bool CheckCollision(PyKinBodyPtr pbody1)
     {
-        CHECK_POINTER(pbody1);
-        return _penv->CheckCollision(KinBodyConstPtr(openravepy::GetKinBody(pbody1)));
+        return CheckCollision(pbody1, false);
     }
     bool CheckCollision(PyKinBodyPtr pbody1, PyCollisionReportPtr pReport)
+    {
+        return CheckCollision(pbody1, pReport, false);
+    }
+
+    bool CheckCollision(PyKinBodyPtr pbody1, PyKinBodyPtr pbody2)
+    {
+        return CheckCollision(pbody1, pbody2, false);
+    }
+
+    bool CheckCollision(PyKinBodyPtr pbody1, PyKinBodyPtr pbody2, PyCollisionReportPtr pReport)
+    {
+        return CheckCollision(pbody1, pbody2, pReport, false);
+    }
+
+    // the body checks only touch c++ objects, so the GIL can be released while checking in order to let other python threads run
+    bool CheckCollision(PyKinBodyPtr pbody1, bool releasegil)
+    {
+        CHECK_POINTER(pbody1);
+        KinBodyConstPtr pkinbody1 = openravepy::GetKinBody(pbody1);
+        openravepy::PythonThreadSaverPtr statesaver;
+        if( releasegil ) {
+            statesaver.reset(new openravepy::PythonThreadSaver());
+        }
+        return _penv->CheckCollision(pkinbody1);
+    }
+
+    bool CheckCollision(PyKinBodyPtr pbody1, PyCollisionReportPtr pReport, bool releasegil)
     {
         CHECK_POINTER(pbody1);
-        bool bCollision = _penv->CheckCollision(KinBodyConstPtr(openravepy::GetKinBody(pbody1)), openravepy::GetCollisionReport(pReport));
+        KinBodyConstPtr pkinbody1 = openravepy::GetKinBody(pbody1);
+        CollisionReportPtr preport = openravepy::GetCollisionReport(pReport);
+        bool bCollision;
+        {
+            openravepy::PythonThreadSaverPtr statesaver;
+            if( releasegil ) {
+                statesaver.reset(new openravepy::PythonThreadSaver());
+            }
+            bCollision = _penv->CheckCollision(pkinbody1, preport);
+        }
         openravepy::UpdateCollisionReport(pReport,shared_from_this());
         return bCollision;
     }
 
-    bool CheckCollision(PyKinBodyPtr pbody1, PyKinBodyPtr pbody2)
+    bool CheckCollision(PyKinBodyPtr pbody1, PyKinBodyPtr pbody2, bool releasegil)
     {
         CHECK_POINTER(pbody1);
         CHECK_POINTER(pbody2);
-        return _penv->CheckCollision(KinBodyConstPtr(openravepy::GetKinBody(pbody1)), KinBodyConstPtr(openravepy::GetKinBody(pbody2)));
+        KinBodyConstPtr pkinbody1 = openravepy::GetKinBody(pbody1), pkinbody2 = openravepy::GetKinBody(pbody2);
+        openravepy::PythonThreadSaverPtr statesaver;
+        if( releasegil ) {
+            statesaver.reset(new openravepy::PythonThreadSaver());
+        }
+        return _penv->CheckCollision(pkinbody1, pkinbody2);
     }
 
-    bool CheckCollision(PyKinBodyPtr pbody1, PyKinBodyPtr pbody2, PyCollisionReportPtr pReport)
+    bool CheckCollision(PyKinBodyPtr pbody1, PyKinBodyPtr pbody2, PyCollisionReportPtr pReport, bool releasegil)
     {
         CHECK_POINTER(pbody1);
         CHECK_POINTER(pbody2);
-        bool bCollision = _penv->CheckCollision(KinBodyConstPtr(openravepy::GetKinBody(pbody1)), KinBodyConstPtr(openravepy::GetKinBody(pbody2)), openravepy::GetCollisionReport(pReport));
+        KinBodyConstPtr pkinbody1 = openravepy::GetKinBody(pbody1), pkinbody2 = openravepy::GetKinBody(pbody2);
+        CollisionReportPtr preport = openravepy::GetCollisionReport(pReport);
+        bool bCollision;
+        {
+            openravepy::PythonThreadSaverPtr statesaver;
+            if( releasegil ) {
+                statesaver.reset(new openravepy::PythonThreadSaver());
+            }
+            bCollision = _penv->CheckCollision(pkinbody1, pkinbody2, preport);
+        }
         openravepy::UpdateCollisionReport(pReport,shared_from_this());
         return bCollision;
     }
@@ -933,7 +985,7 @@ public:
         return bCollision;
     }
 
-    object CheckCollisionRays(object rays, PyKinBodyPtr pbody,bool bFrontFacingOnly=false)
+    object CheckCollisionRays(object rays, PyKinBodyPtr pbody,bool bFrontFacingOnly=false, bool releasegil=false)
     {
         object shape = rays.attr("shape");
         int num = extract<int>(shape[0]);
@@ -943,6 +995,11 @@ public:
         if( extract<int>(shape[1]) != 6 ) {
             throw openrave_exception(_("rays object needs to be a Nx6 vector\n"));
         }
+        // gather all rays before touching the collision checker so that the GIL can be released for the whole batch
+        size_t ncols = 0;
+        std::vector<dReal> vrays = ExtractArray2D(rays, ncols);
+        KinBodyConstPtr pkinbody = !pbody ? KinBodyConstPtr() : KinBodyConstPtr(openravepy::GetKinBody(pbody));
+
         CollisionReport report;
         CollisionReportPtr preport(&report,null_deleter());
 
@@ -952,32 +1009,38 @@ public:
         dReal* ppos = (dReal*)PyArray_DATA(pypos);
         PyObject* pycollision = PyArray_SimpleNew(1,&dims[0], PyArray_BOOL);
         bool* pcollision = (bool*)PyArray_DATA(pycollision);
-        for(int i = 0; i < num; ++i, ppos += 6) {
-            vector<dReal> ray = ExtractArray<dReal>(rays[i]);
-            r.pos.x = ray[0];
-            r.pos.y = ray[1];
-            r.pos.z = ray[2];
-            r.dir.x = ray[3];
-            r.dir.y = ray[4];
-            r.dir.z = ray[5];
-            bool bCollision;
-            if( !pbody ) {
-                bCollision = _penv->CheckCollision(r, preport);
+        {
+            openravepy::PythonThreadSaverPtr statesaver;
+            if( releasegil ) {
+                statesaver.reset(new openravepy::PythonThreadSaver());
             }
-            else {
-                bCollision = _penv->CheckCollision(r, KinBodyConstPtr(openravepy::GetKinBody(pbody)), preport);
-            }
-            pcollision[i] = false;
-            ppos[0] = 0; ppos[1] = 0; ppos[2] = 0; ppos[3] = 0; ppos[4] = 0; ppos[5] = 0;
-            if( bCollision &&( report.contacts.size() > 0) ) {
-                if( !bFrontFacingOnly ||( report.contacts[0].norm.dot3(r.dir)<0) ) {
-                    pcollision[i] = true;
-                    ppos[0] = report.contacts[0].pos.x;
-                    ppos[1] = report.contacts[0].pos.y;
-                    ppos[2] = report.contacts[0].pos.z;
-                    ppos[3] = report.contacts[0].norm.x;
-                    ppos[4] = report.contacts[0].norm.y;
-                    ppos[5] = report.contacts[0].norm.z;
+            const dReal* pray = &vrays[0];
+            for(int i = 0; i < num; ++i, ppos += 6, pray += 6) {
+                r.pos.x = pray[0];
+                r.pos.y = pray[1];
+                r.pos.z = pray[2];
+                r.dir.x = pray[3];
+                r.dir.y = pray[4];
+                r.dir.z = pray[5];
+                bool bCollision;
+                if( !pkinbody ) {
+                    bCollision = _penv->CheckCollision(r, preport);
+                }
+                else {
+                    bCollision = _penv->CheckCollision(r, pkinbody, preport);
+                }
+                pcollision[i] = false;
+                ppos[0] = 0; ppos[1] = 0; ppos[2] = 0; ppos[3] = 0; ppos[4] = 0; ppos[5] = 0;
+                if( bCollision &&( report.contacts.size() > 0) ) {
+                    if( !bFrontFacingOnly ||( report.contacts[0].norm.dot3(r.dir)<0) ) {
+                        pcollision[i] = true;
+                        ppos[0] = report.contacts[0].pos.x;
+                        ppos[1] = report.contacts[0].pos.y;
+                        ppos[2] = report.contacts[0].pos.z;
+                        ppos[3] = report.contacts[0].norm.x;
+                        ppos[4] = report.contacts[0].norm.y;
+                        ppos[5] = report.contacts[0].norm.z;
+                    }
                 }
             }
         }
@@ -1269,6 +1332,47 @@ public:
     uint64_t GetSimulationTime() {
         return _penv->GetSimulationTime();
     }
+    void SetSimulationStepThreads(int numthreads) {
+        _penv->SetSimulationStepThreads(numthreads);
+    }
+    int GetSimulationStepThreads() {
+        return _penv->GetSimulationStepThreads();
+    }
+    void SetSimulationScheduler(bool bFixedRate, dReal fRealTimeFactor=1, EnvironmentBase::CatchUpPolicy catchuppolicy=EnvironmentBase::CUP_Skip, int maxcatchupsteps=10, uint64_t histogrambinsize=50, int numhistogrambins=40) {
+        EnvironmentBase::SimulationSchedulerParameters parameters;
+        parameters.bFixedRate = bFixedRate;
+        parameters.fRealTimeFactor = fRealTimeFactor;
+        parameters.catchuppolicy = catchuppolicy;
+        parameters.maxcatchupsteps = maxcatchupsteps;
+        parameters.histogrambinsize = histogrambinsize;
+        parameters.numhistogrambins = numhistogrambins;
+        _penv->SetSimulationScheduler(parameters);
+    }
+    object GetSimulationSchedulerStatistics(bool bReset=false) {
+        EnvironmentBase::SimulationSchedulerStatistics statistics = _penv->GetSimulationSchedulerStatistics(bReset);
+        boost::python::dict ostatistics;
+        ostatistics["numsteps"] = statistics.numsteps;
+        ostatistics["numoverruns"] = statistics.numoverruns;
+        ostatistics["numskippedsteps"] = statistics.numskippedsteps;
+        ostatistics["totalsteptime"] = statistics.totalsteptime;
+        ostatistics["maxsteptime"] = statistics.maxsteptime;
+        ostatistics["totaljitter"] = statistics.totaljitter;
+        ostatistics["maxjitter"] = statistics.maxjitter;
+        ostatistics["histogrambinsize"] = statistics.histogrambinsize;
+        ostatistics["steptimehistogram"] = toPyArray(statistics.vsteptimehistogram);
+        return ostatistics;
+    }
+    object GetSimulationStepTimes() {
+        EnvironmentBase::SimulationStepTimes steptimes = _penv->GetSimulationStepTimes();
+        boost::python::dict otimes;
+        otimes["physics"] = steptimes.physics;
+        otimes["bodies"] = steptimes.bodies;
+        otimes["modules"] = steptimes.modules;
+        otimes["parallelsensors"] = steptimes.parallelsensors;
+        otimes["sensors"] = steptimes.sensors;
+        otimes["total"] = steptimes.total;
+        return otimes;
+    }
     bool IsSimulationRunning() {
         return _penv->IsSimulationRunning();
     }
@@ -1893,10 +1997,12 @@ PyInterfaceBasePtr RaveCreateInterface(PyEnvironmentBasePtr pyenv, InterfaceType
 BOOST_PYTHON_MEMBER_FUNCTION_OVERLOADS(LoadURI_overloads, LoadURI, 1, 2)
 BOOST_PYTHON_MEMBER_FUNCTION_OVERLOADS(SetCamera_overloads, SetCamera, 2, 4)
 BOOST_PYTHON_MEMBER_FUNCTION_OVERLOADS(StartSimulation_overloads, StartSimulation, 1, 2)
+BOOST_PYTHON_MEMBER_FUNCTION_OVERLOADS(SetSimulationScheduler_overloads, SetSimulationScheduler, 1, 6)
+BOOST_PYTHON_MEMBER_FUNCTION_OVERLOADS(GetSimulationSchedulerStatistics_overloads, GetSimulationSchedulerStatistics, 0, 1)
 BOOST_PYTHON_MEMBER_FUNCTION_OVERLOADS(StopSimulation_overloads, StopSimulation, 0, 1)
 BOOST_PYTHON_MEMBER_FUNCTION_OVERLOADS(SetViewer_overloads, SetViewer, 1, 2)
 BOOST_PYTHON_MEMBER_FUNCTION_OVERLOADS(SetDefaultViewer_overloads, SetDefaultViewer, 0, 1)
-BOOST_PYTHON_MEMBER_FUNCTION_OVERLOADS(CheckCollisionRays_overloads, CheckCollisionRays, 2, 3)
+BOOST_PYTHON_MEMBER_FUNCTION_OVERLOADS(CheckCollisionRays_overloads, CheckCollisionRays, 2, 4)
 BOOST_PYTHON_MEMBER_FUNCTION_OVERLOADS(plot3_overloads, plot3, 2, 4)
 BOOST_PYTHON_MEMBER_FUNCTION_OVERLOADS(drawlinestrip_overloads, drawlinestrip, 2, 4)
 BOOST_PYTHON_MEMBER_FUNCTION_OVERLOADS(drawlinelist_overloads, drawlinelist, 2, 4)
@@ -2038,6 +2144,10 @@ Because race conditions can pop up when trying to lock the openrave environment
         bool (PyEnvironmentBase::*pcolybr)(boost::shared_ptr<PyRay>, PyKinBodyPtr, PyCollisionReportPtr) = &PyEnvironmentBase::CheckCollision;
         bool (PyEnvironmentBase::*pcoly)(boost::shared_ptr<PyRay>) = &PyEnvironmentBase::CheckCollision;
         bool (PyEnvironmentBase::*pcolyr)(boost::shared_ptr<PyRay>, PyCollisionReportPtr) = &PyEnvironmentBase::CheckCollision;
+        bool (PyEnvironmentBase::*pcolbg)(PyKinBodyPtr, bool) = &PyEnvironmentBase::CheckCollision;
+        bool (PyEnvironmentBase::*pcolbrg)(PyKinBodyPtr, PyCollisionReportPtr, bool) = &PyEnvironmentBase::CheckCollision;
+        bool (PyEnvironmentBase::*pcolbbg)(PyKinBodyPtr, PyKinBodyPtr, bool) = &PyEnvironmentBase::CheckCollision;
+        bool (PyEnvironmentBase::*pcolbbrg)(PyKinBodyPtr, PyKinBodyPtr, PyCollisionReportPtr, bool) = &PyEnvironmentBase::CheckCollision;
 
         void (PyEnvironmentBase::*Lock1)() = &PyEnvironmentBase::Lock;
         bool (PyEnvironmentBase::*Lock2)(float) = &PyEnvironmentBase::Lock;
@@ -2098,9 +2208,14 @@ Because race conditions can pop up when trying to lock the openrave environment
                     .def("CheckCollision",pcolybr,args("ray","body","report"), DOXY_FN(EnvironmentBase,CheckCollision "const RAY; KinBodyConstPtr; CollisionReportPtr"))
                     .def("CheckCollision",pcoly,args("ray"), DOXY_FN(EnvironmentBase,CheckCollision "const RAY; CollisionReportPtr"))
                     .def("CheckCollision",pcolyr,args("ray"), DOXY_FN(EnvironmentBase,CheckCollision "const RAY; CollisionReportPtr"))
+                    // registered last so that they are tried before the object overloads
+                    .def("CheckCollision",pcolbg,args("body","releasegil"), "Same as CheckCollision(body), if releasegil is True, the python GIL is released while checking.")
+                    .def("CheckCollision",pcolbrg,args("body","report","releasegil"), "Same as CheckCollision(body,report), if releasegil is True, the python GIL is released while checking.")
+                    .def("CheckCollision",pcolbbg,args("body1","body2","releasegil"), "Same as CheckCollision(body1,body2), if releasegil is True, the python GIL is released while checking.")
+                    .def("CheckCollision",pcolbbrg,args("body1","body2","report","releasegil"), "Same as CheckCollision(body1,body2,report), if releasegil is True, the python GIL is released while checking.")
                     .def("CheckCollisionRays",&PyEnvironmentBase::CheckCollisionRays,
-                         CheckCollisionRays_overloads(args("rays","body","front_facing_only"),
-                                                      "Check if any rays hit the body and returns their contact points along with a vector specifying if a collision occured or not. Rays is a Nx6 array, first 3 columsn are position, last 3 are direction*range."))
+                         CheckCollisionRays_overloads(args("rays","body","front_facing_only","releasegil"),
+                                                      "Check if any rays hit the body and returns their contact points along with a vector specifying if a collision occured or not. Rays is a Nx6 array, first 3 columsn are position, last 3 are direction*range. If releasegil is True, the python GIL is released while the rays are checked."))
                     .def("LoadURI",&PyEnvironmentBase::LoadURI,LoadURI_overloads(args("filename","atts"), DOXY_FN(EnvironmentBase,LoadURI)))
                     .def("Load",load1,args("filename"), DOXY_FN(EnvironmentBase,Load))
                     .def("Load",load2,args("filename","atts"), DOXY_FN(EnvironmentBase,Load))
@@ -2163,6 +2278,11 @@ Because race conditions can pop up when trying to lock the openrave environment
                     .def("StartSimulation",&PyEnvironmentBase::StartSimulation,StartSimulation_overloads(args("timestep","realtime"), DOXY_FN(EnvironmentBase,StartSimulation)))
                     .def("StopSimulation",&PyEnvironmentBase::StopSimulation, StopSimulation_overloads(args("shutdownthread"), DOXY_FN(EnvironmentBase,StopSimulation)))
                     .def("GetSimulationTime",&PyEnvironmentBase::GetSimulationTime, DOXY_FN(EnvironmentBase,GetSimulationTime))
+                    .def("SetSimulationStepThreads",&PyEnvironmentBase::SetSimulationStepThreads, args("numthreads"), DOXY_FN(EnvironmentBase,SetSimulationStepThreads))
+                    .def("GetSimulationStepThreads",&PyEnvironmentBase::GetSimulationStepThreads, DOXY_FN(EnvironmentBase,GetSimulationStepThreads))
+                    .def("SetSimulationScheduler",&PyEnvironmentBase::SetSimulationScheduler, SetSimulationScheduler_overloads(args("fixedrate","realtimefactor","catchuppolicy","maxcatchupsteps","histogrambinsize","numhistogrambins"), DOXY_FN(EnvironmentBase,SetSimulationScheduler)))
+                    .def("GetSimulationSchedulerStatistics",&PyEnvironmentBase::GetSimulationSchedulerStatistics, GetSimulationSchedulerStatistics_overloads(args("reset"), "Returns a dictionary with the timing telemetry of the fixed-rate simulation scheduler in microseconds: numsteps, numoverruns, numskippedsteps, totalsteptime, maxsteptime, totaljitter, maxjitter, histogrambinsize and steptimehistogram."))
+                    .def("GetSimulationStepTimes",&PyEnvironmentBase::GetSimulationStepTimes, "Returns a dictionary of the microseconds spent in each stage of the last StepSimulation call: physics, bodies, modules, parallelsensors, sensors and total.")
                     .def("IsSimulationRunning",&PyEnvironmentBase::IsSimulationRunning, DOXY_FN(EnvironmentBase,IsSimulationRunning))
                     .def("Lock",Lock1,"Locks the environment mutex.")
                     .def("Lock",Lock2,args("timeout"), "Locks the environment mutex with a timeout.")
@@ -2216,6 +2336,10 @@ Because race conditions can pop up when trying to lock the openrave environment
                                   .value("AllExceptBody",EnvironmentBase::SO_AllExceptBody)
         ;
         env.attr("TriangulateOptions") = selectionoptions;
+        enum_<EnvironmentBase::CatchUpPolicy>("CatchUpPolicy" DOXY_ENUM(CatchUpPolicy))
+        .value("Skip",EnvironmentBase::CUP_Skip)
+        .value("Burst",EnvironmentBase::CUP_Burst)
+        ;
     }
 
     {
@@ -188,6 +188,42 @@ public:
 
 typedef boost::shared_ptr<PythonThreadSaver> PythonThreadSaverPtr;
 
+/// \brief extracts a NxM array in row-major order, numpy arrays are read through their buffer.
+///
+/// \param[out] ncols is set to M
+inline std::vector<dReal> ExtractArray2D(const object& o, size_t& ncols)
+{
+    std::vector<dReal> values;
+    ncols = 0;
+    if( IS_PYTHONOBJECT_NONE(o) ) {
+        return values;
+    }
+    if( PyArray_Check(o.ptr()) ) {
+        PyObject* pyvalues = PyArray_ContiguousFromAny(o.ptr(), sizeof(dReal)==8 ? PyArray_DOUBLE : PyArray_FLOAT, 2, 2);
+        if( !!pyvalues ) {
+            ncols = PyArray_DIM((PyArrayObject*)pyvalues,1);
+            const dReal* pvalues = (const dReal*)PyArray_DATA((PyArrayObject*)pyvalues);
+            values.assign(pvalues, pvalues+PyArray_DIM((PyArrayObject*)pyvalues,0)*ncols);
+            Py_DECREF(pyvalues);
+            return values;
+        }
+        PyErr_Clear();
+    }
+    size_t num = len(o);
+    for(size_t i = 0; i < num; ++i) {
+        std::vector<dReal> vrow = ExtractArray<dReal>(o[i]);
+        if( i == 0 ) {
+            ncols = vrow.size();
+            values.reserve(num*ncols);
+        }
+        else if( vrow.size() != ncols ) {
+            throw OPENRAVE_EXCEPTION_FORMAT(_("row %d has %d values, expected %d"),i%vrow.size()%ncols,ORE_InvalidArguments);
+        }
+        values.insert(values.end(), vrow.begin(), vrow.end());
+    }
+    return values;
+}
+
 inline RaveVector<float> ExtractFloat3(const object& o)
 {
     return RaveVector<float>(extract<float>(o[0]), extract<float>(o[1]), extract<float>(o[2]));
@@ -647,6 +683,13 @@ object toPyKinBodyJoint(KinBody::JointPtr pjoint, PyEnvironmentBasePtr);
 KinBody::JointPtr GetKinBodyJoint(object);
 std::string reprPyKinBodyJoint(object);
 std::string strPyKinBodyJoint(object);
+/// \brief calls fn(body, index) for every index in [0,num) with the environment of pbody locked once for the whole batch.
+///
+/// When numthreads > 1, the extra threads work on clones of the environment, so fn should only use the body it is passed and write its results by index.
+/// The state of pbody is restored afterwards. The GIL should be released before calling.
+void RunKinBodyBatch(KinBodyPtr pbody, size_t num, int numthreads, const boost::function<void(KinBodyPtr, size_t)>& fn);
+/// \brief writes t into pdata as a 4x4 matrix or a 7 value pose depending on GetReturnTransformQuaternions, returns the next free position
+dReal* WriteReturnTransform(dReal* pdata, const Transform& t, bool bquaternions);
 void init_openravepy_module();
 ModuleBasePtr GetModule(PyModuleBasePtr);
 PyInterfaceBasePtr toPyModule(ModuleBasePtr, PyEnvironmentBasePtr);
@@ -1892,14 +1892,119 @@ object PyKinBody::GetTransformPose() const {
     return toPyArray(_pbody->GetTransform());
 }
 
-object PyKinBody::GetLinkTransformations(bool returndoflastvlaues) const
+static void _ComputeLinkTransformationsBatch(KinBodyPtr pbody, size_t index, const std::vector<dReal>& vdofvalues, const std::vector<int>& vdofindices, bool bquaternions, std::vector<dReal>& vtransforms)
+{
+    size_t ndof = vdofindices.size() > 0 ? vdofindices.size() : pbody->GetDOF();
+    size_t nlinks = pbody->GetLinks().size();
+    std::vector<dReal> vvalues(vdofvalues.begin()+index*ndof, vdofvalues.begin()+(index+1)*ndof);
+    pbody->SetDOFValues(vvalues, KinBody::CLA_CheckLimits, vdofindices);
+    dReal* pdata = &vtransforms.at(index*nlinks*(bquaternions ? 7 : 16));
+    FOREACHC(itlink, pbody->GetLinks()) {
+        pdata = WriteReturnTransform(pdata, (*itlink)->GetTransform(), bquaternions);
+    }
+}
+
+static void _CheckCollisionBatch(KinBodyPtr pbody, size_t index, const std::vector<dReal>& vdofvalues, const std::vector<int>& vdofindices, bool bcheckself, bool bdistance, std::vector<uint8_t>& vcollisions, std::vector<dReal>& vdistances)
+{
+    size_t ndof = vdofindices.size() > 0 ? vdofindices.size() : pbody->GetDOF();
+    std::vector<dReal> vvalues(vdofvalues.begin()+index*ndof, vdofvalues.begin()+(index+1)*ndof);
+    pbody->SetDOFValues(vvalues, KinBody::CLA_CheckLimits, vdofindices);
+    CollisionReport report;
+    CollisionReportPtr preport;
+    if( bdistance ) {
+        preport.reset(&report,utils::null_deleter());
+    }
+    bool bCollision = pbody->GetEnv()->CheckCollision(KinBodyConstPtr(pbody), preport);
+    if( bdistance ) {
+        vdistances.at(index) = report.minDistance;
+    }
+    if( !bCollision && bcheckself ) {
+        bCollision = pbody->CheckSelfCollision();
+    }
+    vcollisions.at(index) = bCollision;
+}
+
+object PyKinBody::ComputeLinkTransformationsBatch(object odofvalues, object odofindices, int numthreads)
+{
+    std::vector<int> vdofindices = IS_PYTHONOBJECT_NONE(odofindices) ? std::vector<int>() : ExtractArray<int>(odofindices);
+    size_t ndof = vdofindices.size() > 0 ? vdofindices.size() : _pbody->GetDOF();
+    size_t ncols = 0;
+    std::vector<dReal> vdofvalues = ExtractArray2D(odofvalues, ncols);
+    size_t num = ncols > 0 ? vdofvalues.size()/ncols : 0;
+    if( num > 0 && ncols != ndof ) {
+        throw OPENRAVE_EXCEPTION_FORMAT(_("dof values have %d columns, expected %d"),ncols%ndof,ORE_InvalidArguments);
+    }
+    bool bquaternions = GetReturnTransformQuaternions();
+    size_t nlinks = _pbody->GetLinks().size();
+    std::vector<dReal> vtransforms(num*nlinks*(bquaternions ? 7 : 16));
+    {
+        openravepy::PythonThreadSaver statesaver;
+        RunKinBodyBatch(_pbody, num, numthreads, boost::bind(_ComputeLinkTransformationsBatch, _1, _2, boost::cref(vdofvalues), boost::cref(vdofindices), bquaternions, boost::ref(vtransforms)));
+    }
+    std::vector<npy_intp> dims;
+    dims.push_back(num);
+    dims.push_back(nlinks);
+    if( bquaternions ) {
+        dims.push_back(7);
+    }
+    else {
+        dims.push_back(4);
+        dims.push_back(4);
+    }
+    return toPyArrayOwned(vtransforms, dims);
+}
+
+object PyKinBody::CheckCollisionBatch(object odofvalues, object odofindices, bool checkself, bool returndistances, int numthreads)
+{
+    std::vector<int> vdofindices = IS_PYTHONOBJECT_NONE(odofindices) ? std::vector<int>() : ExtractArray<int>(odofindices);
+    size_t ndof = vdofindices.size() > 0 ? vdofindices.size() : _pbody->GetDOF();
+    size_t ncols = 0;
+    std::vector<dReal> vdofvalues = ExtractArray2D(odofvalues, ncols);
+    size_t num = ncols > 0 ? vdofvalues.size()/ncols : 0;
+    if( num > 0 && ncols != ndof ) {
+        throw OPENRAVE_EXCEPTION_FORMAT(_("dof values have %d columns, expected %d"),ncols%ndof,ORE_InvalidArguments);
+    }
+    std::vector<uint8_t> vcollisions(num,0);
+    std::vector<dReal> vdistances(returndistances ? num : 0);
+    {
+        openravepy::PythonThreadSaver statesaver;
+        RunKinBodyBatch(_pbody, num, numthreads, boost::bind(_CheckCollisionBatch, _1, _2, boost::cref(vdofvalues), boost::cref(vdofindices), checkself, returndistances, boost::ref(vcollisions), boost::ref(vdistances)));
+    }
+    npy_intp dims[] = { npy_intp(num) };
+    PyObject* pycollisions = PyArray_SimpleNew(1,dims, PyArray_BOOL);
+    if( num > 0 ) {
+        memcpy(PyArray_DATA(pycollisions), &vcollisions[0], num*sizeof(uint8_t));
+    }
+    object ocollisions = static_cast<numeric::array>(handle<>(pycollisions));
+    if( returndistances ) {
+        return boost::python::make_tuple(ocollisions, toPyArrayOwned(vdistances));
+    }
+    return ocollisions;
+}
+
+object PyKinBody::GetLinkTransformations(bool returndoflastvlaues, bool asarray) const
 {
-    boost::python::list otransforms;
     vector<Transform> vtransforms;
     std::vector<dReal> vdoflastsetvalues;
     _pbody->GetLinkTransformations(vtransforms, vdoflastsetvalues);
-    FOREACHC(it, vtransforms) {
-        otransforms.append(ReturnTransform(*it));
+    object otransforms;
+    if( asarray ) {
+        // one Nx4x4 (or Nx7 for quaternions) array filled in place instead of a list of small arrays
+        bool bquaternions = GetReturnTransformQuaternions();
+        npy_intp dims[] = { npy_intp(vtransforms.size()), bquaternions ? 7 : 4, 4 };
+        PyObject *pyvalues = PyArray_SimpleNew(bquaternions ? 2 : 3, dims, sizeof(dReal)==8 ? PyArray_DOUBLE : PyArray_FLOAT);
+        dReal* pdata = (dReal*)PyArray_DATA(pyvalues);
+        FOREACHC(it, vtransforms) {
+            pdata = WriteReturnTransform(pdata, *it, bquaternions);
+        }
+        otransforms = static_cast<numeric::array>(handle<>(pyvalues));
+    }
+    else {
+        boost::python::list olisttransforms;
+        FOREACHC(it, vtransforms) {
+            olisttransforms.append(ReturnTransform(*it));
+        }
+        otransforms = olisttransforms;
     }
     if( returndoflastvlaues ) {
         return boost::python::make_tuple(otransforms, toPyArray(vdoflastsetvalues));
@@ -2362,9 +2467,18 @@ PyInterfaceBasePtr PyKinBody::GetSelfCollisionChecker()
     return openravepy::toPyCollisionChecker(_pbody->GetSelfCollisionChecker(), _pyenv);
 }
 
-bool PyKinBody::CheckSelfCollision(PyCollisionReportPtr pReport, PyCollisionCheckerBasePtr pycollisionchecker)
+bool PyKinBody::CheckSelfCollision(PyCollisionReportPtr pReport, PyCollisionCheckerBasePtr pycollisionchecker, bool releasegil)
 {
-    bool bCollision = _pbody->CheckSelfCollision(openravepy::GetCollisionReport(pReport), openravepy::GetCollisionChecker(pycollisionchecker));
+    CollisionReportPtr preport = openravepy::GetCollisionReport(pReport);
+    CollisionCheckerBasePtr pchecker = openravepy::GetCollisionChecker(pycollisionchecker);
+    bool bCollision;
+    {
+        openravepy::PythonThreadSaverPtr statesaver;
+        if( releasegil ) {
+            statesaver.reset(new openravepy::PythonThreadSaver());
+        }
+        bCollision = _pbody->CheckSelfCollision(preport, pchecker);
+    }
     openravepy::UpdateCollisionReport(pReport,GetEnv());
     return bCollision;
 }
@@ -2392,6 +2506,20 @@ void PyKinBody::SetNonCollidingConfiguration()
 {
     _pbody->SetNonCollidingConfiguration();
 }
+void PyKinBody::ComputeSampledCollidingLinks(int numsamples, int numthreads, bool usecache)
+{
+    openravepy::PythonThreadSaver statesaver;
+    _pbody->ComputeSampledCollidingLinks(numsamples, numthreads, usecache);
+}
+object PyKinBody::GetSampledAlwaysCollidingLinks() const
+{
+    boost::python::list oalwayscolliding;
+    const std::vector<int>& alwayscolliding = _pbody->GetSampledAlwaysCollidingLinks();
+    FOREACHC(it,alwayscolliding) {
+        oalwayscolliding.append(boost::python::make_tuple((int)(*it)&0xffff,(int)(*it)>>16));
+    }
+    return oalwayscolliding;
+}
 
 object PyKinBody::GetConfigurationSpecification(const std::string& interpolation) const
 {
@@ -2694,6 +2822,109 @@ std::string strPyKinBodyJoint(object o)
     return std::string();
 }
 
+dReal* WriteReturnTransform(dReal* pdata, const Transform& t, bool bquaternions)
+{
+    if( bquaternions ) {
+        pdata[0] = t.rot.x; pdata[1] = t.rot.y; pdata[2] = t.rot.z; pdata[3] = t.rot.w;
+        pdata[4] = t.trans.x; pdata[5] = t.trans.y; pdata[6] = t.trans.z;
+        return pdata+7;
+    }
+    TransformMatrix tm(t);
+    pdata[0] = tm.m[0]; pdata[1] = tm.m[1]; pdata[2] = tm.m[2]; pdata[3] = tm.trans.x;
+    pdata[4] = tm.m[4]; pdata[5] = tm.m[5]; pdata[6] = tm.m[6]; pdata[7] = tm.trans.y;
+    pdata[8] = tm.m[8]; pdata[9] = tm.m[9]; pdata[10] = tm.m[10]; pdata[11] = tm.trans.z;
+    pdata[12] = 0; pdata[13] = 0; pdata[14] = 0; pdata[15] = 1;
+    return pdata+16;
+}
+
+/// \brief shared state of the threads of one RunKinBodyBatch call
+struct KinBodyBatchState
+{
+    KinBodyBatchState(size_t num, const boost::function<void(KinBodyPtr, size_t)>& fn) : _num(num), _nextindex(0), _fn(fn) {
+    }
+
+    /// \brief processes blocks of indices until all are taken or another thread failed
+    void Run(KinBodyPtr pbody)
+    {
+        // the calling thread already holds the lock of the original environment, the workers lock their clone
+        EnvironmentMutex::scoped_lock lock(pbody->GetEnv()->GetMutex());
+        KinBody::KinBodyStateSaver saver(pbody);
+        const size_t nblock = 16;
+        while(1) {
+            size_t istart, iend;
+            {
+                boost::mutex::scoped_lock lock(_mutex);
+                if( _nextindex >= _num || _error.size() > 0 ) {
+                    break;
+                }
+                istart = _nextindex;
+                iend = min(_num, istart+nblock);
+                _nextindex = iend;
+            }
+            try {
+                for(size_t index = istart; index < iend; ++index) {
+                    _fn(pbody, index);
+                }
+            }
+            catch(const std::exception& ex) {
+                boost::mutex::scoped_lock lock(_mutex);
+                if( _error.size() == 0 ) {
+                    _error = ex.what();
+                }
+                break;
+            }
+        }
+    }
+
+    size_t _num, _nextindex;
+    const boost::function<void(KinBodyPtr, size_t)>& _fn;
+    boost::mutex _mutex;
+    std::string _error;
+};
+
+void RunKinBodyBatch(KinBodyPtr pbody, size_t num, int numthreads, const boost::function<void(KinBodyPtr, size_t)>& fn)
+{
+    EnvironmentBasePtr penv = pbody->GetEnv();
+    EnvironmentMutex::scoped_lock lock(penv->GetMutex());
+    KinBodyBatchState state(num, fn);
+    // cloning is expensive, so only use the threads that will get at least a couple of blocks
+    numthreads = max(1, min(numthreads, int(num/32)));
+    std::vector<EnvironmentBasePtr> vclones;
+    boost::thread_group workers;
+    try {
+        for(int ithread = 1; ithread < numthreads; ++ithread) {
+            EnvironmentBasePtr pclone = penv->CloneSelf(Clone_Bodies);
+            vclones.push_back(pclone);
+            // the simulation thread of a clone would step the bodies under the worker
+            pclone->StopSimulation();
+            KinBodyPtr pclonebody = pclone->GetKinBody(pbody->GetName());
+            if( !pclonebody ) {
+                throw OPENRAVE_EXCEPTION_FORMAT(_("failed to find body %s in cloned environment"),pbody->GetName(),ORE_InvalidState);
+            }
+            workers.create_thread(boost::bind(&KinBodyBatchState::Run, &state, pclonebody));
+        }
+        state.Run(pbody);
+    }
+    catch(...) {
+        {
+            boost::mutex::scoped_lock lockstate(state._mutex);
+            state._nextindex = num;
+        }
+        workers.join_all();
+        FOREACH(itclone, vclones) {
+            (*itclone)->Destroy();
+        }
+        throw;
+    }
+    workers.join_all();
+    FOREACH(itclone, vclones) {
+        (*itclone)->Destroy();
+    }
+    if( state._error.size() > 0 ) {
+        throw openrave_exception(state._error);
+    }
+}
+
 KinBodyPtr GetKinBody(object o)
 {
     extract<PyKinBodyPtr> pykinbody(o);
@@ -2924,7 +3155,10 @@ BOOST_PYTHON_MEMBER_FUNCTION_OVERLOADS(GetMaxTorque_overloads, GetMaxTorque, 0,
 BOOST_PYTHON_MEMBER_FUNCTION_OVERLOADS(GetInstantaneousTorqueLimits_overloads, GetInstantaneousTorqueLimits, 0, 1)
 BOOST_PYTHON_MEMBER_FUNCTION_OVERLOADS(GetNominalTorqueLimits_overloads, GetNominalTorqueLimits, 0, 1)
 BOOST_PYTHON_MEMBER_FUNCTION_OVERLOADS(GetMaxInertia_overloads, GetMaxInertia, 0, 1)
-BOOST_PYTHON_MEMBER_FUNCTION_OVERLOADS(GetLinkTransformations_overloads, GetLinkTransformations, 0, 1)
+BOOST_PYTHON_MEMBER_FUNCTION_OVERLOADS(GetLinkTransformations_overloads, GetLinkTransformations, 0, 2)
+BOOST_PYTHON_MEMBER_FUNCTION_OVERLOADS(ComputeSampledCollidingLinks_overloads, ComputeSampledCollidingLinks, 0, 3)
+BOOST_PYTHON_MEMBER_FUNCTION_OVERLOADS(ComputeLinkTransformationsBatch_overloads, ComputeLinkTransformationsBatch, 1, 3)
+BOOST_PYTHON_MEMBER_FUNCTION_OVERLOADS(CheckCollisionBatch_overloads, CheckCollisionBatch, 1, 5)
 BOOST_PYTHON_MEMBER_FUNCTION_OVERLOADS(SetLinkTransformations_overloads, SetLinkTransformations, 1, 2)
 BOOST_PYTHON_MEMBER_FUNCTION_OVERLOADS(SetDOFLimits_overloads, SetDOFLimits, 2, 3)
 BOOST_PYTHON_MEMBER_FUNCTION_OVERLOADS(SubtractDOFValues_overloads, SubtractDOFValues, 2, 3)
@@ -2939,7 +3173,7 @@ BOOST_PYTHON_MEMBER_FUNCTION_OVERLOADS(SetConfigurationValues_overloads, SetConf
 BOOST_PYTHON_MEMBER_FUNCTION_OVERLOADS(GetFloatParameters_overloads, GetFloatParameters, 0, 2)
 BOOST_PYTHON_MEMBER_FUNCTION_OVERLOADS(GetIntParameters_overloads, GetIntParameters, 0, 2)
 BOOST_PYTHON_MEMBER_FUNCTION_OVERLOADS(GetStringParameters_overloads, GetStringParameters, 0, 1)
-BOOST_PYTHON_MEMBER_FUNCTION_OVERLOADS(CheckSelfCollision_overloads, CheckSelfCollision, 0, 2)
+BOOST_PYTHON_MEMBER_FUNCTION_OVERLOADS(CheckSelfCollision_overloads, CheckSelfCollision, 0, 3)
 BOOST_PYTHON_MEMBER_FUNCTION_OVERLOADS(GetLinkAccelerations_overloads, GetLinkAccelerations, 1, 2)
 BOOST_PYTHON_MEMBER_FUNCTION_OVERLOADS(InitCollisionMesh_overloads, InitCollisionMesh, 0, 1)
 BOOST_PYTHON_MEMBER_FUNCTION_OVERLOADS(InitFromBoxes_overloads, InitFromBoxes, 1, 3)
@@ -3169,8 +3403,10 @@ void init_openravepy_kinbody()
                         .def("GetJointFromDOFIndex",&PyKinBody::GetJointFromDOFIndex,args("dofindex"), DOXY_FN(KinBody,GetJointFromDOFIndex))
                         .def("GetTransform",&PyKinBody::GetTransform, DOXY_FN(KinBody,GetTransform))
                         .def("GetTransformPose",&PyKinBody::GetTransformPose, DOXY_FN(KinBody,GetTransform))
-                        .def("GetLinkTransformations",&PyKinBody::GetLinkTransformations, GetLinkTransformations_overloads(args("returndoflastvlaues"), DOXY_FN(KinBody,GetLinkTransformations)))
-                        .def("GetBodyTransformations",&PyKinBody::GetLinkTransformations, DOXY_FN(KinBody,GetLinkTransformations))
+                        .def("GetLinkTransformations",&PyKinBody::GetLinkTransformations, GetLinkTransformations_overloads(args("returndoflastvlaues","asarray"), DOXY_FN(KinBody,GetLinkTransformations)))
+                        .def("GetBodyTransformations",&PyKinBody::GetLinkTransformations, GetLinkTransformations_overloads(args("returndoflastvlaues","asarray"), DOXY_FN(KinBody,GetLinkTransformations)))
+                        .def("ComputeLinkTransformationsBatch",&PyKinBody::ComputeLinkTransformationsBatch, ComputeLinkTransformationsBatch_overloads(args("dofvalues","dofindices","numthreads"), "Computes the link transformations for every row of the NxDOF dofvalues array and returns a NxLx4x4 array (NxLx7 when returning quaternions). The environment is locked once for the whole batch and the GIL is released. If numthreads > 1, the rows are split across clones of the environment. The state of the body is restored afterwards."))
+                        .def("CheckCollisionBatch",&PyKinBody::CheckCollisionBatch, CheckCollisionBatch_overloads(args("dofvalues","dofindices","checkself","returndistances","numthreads"), "Checks the body against the environment (and itself if checkself is True) for every row of the NxDOF dofvalues array and returns a boolean array of size N. If returndistances is True, also returns the minimum distances of the environment checks, which requires the collision checker to have the CO_Distance option set. Locking, threading and the GIL are handled as in ComputeLinkTransformationsBatch."))
                         .def("SetLinkTransformations",&PyKinBody::SetLinkTransformations,SetLinkTransformations_overloads(args("transforms","doflastsetvalues"), DOXY_FN(KinBody,SetLinkTransformations)))
                         .def("SetBodyTransformations",&PyKinBody::SetLinkTransformations,args("transforms"), DOXY_FN(KinBody,SetLinkTransformations))
                         .def("SetLinkVelocities",&PyKinBody::SetLinkVelocities,args("velocities"), DOXY_FN(KinBody,SetLinkVelocities))
@@ -3221,11 +3457,13 @@ void init_openravepy_kinbody()
                         .def("ComputeInverseDynamics",&PyKinBody::ComputeInverseDynamics, ComputeInverseDynamics_overloads(args("dofaccelerations","externalforcetorque","returncomponents"), sComputeInverseDynamicsDoc.c_str()))
                         .def("SetSelfCollisionChecker",&PyKinBody::SetSelfCollisionChecker,args("collisionchecker"), DOXY_FN(KinBody,SetSelfCollisionChecker))
                         .def("GetSelfCollisionChecker",&PyKinBody::GetSelfCollisionChecker,args("collisionchecker"), DOXY_FN(KinBody,GetSelfCollisionChecker))
-                        .def("CheckSelfCollision",&PyKinBody::CheckSelfCollision, CheckSelfCollision_overloads(args("report","collisionchecker"), DOXY_FN(KinBody,CheckSelfCollision)))
+                        .def("CheckSelfCollision",&PyKinBody::CheckSelfCollision, CheckSelfCollision_overloads(args("report","collisionchecker","releasegil"), DOXY_FN(KinBody,CheckSelfCollision)))
                         .def("IsAttached",&PyKinBody::IsAttached,args("body"), DOXY_FN(KinBody,IsAttached))
                         .def("GetAttached",&PyKinBody::GetAttached, DOXY_FN(KinBody,GetAttached))
                         .def("SetZeroConfiguration",&PyKinBody::SetZeroConfiguration, DOXY_FN(KinBody,SetZeroConfiguration))
                         .def("SetNonCollidingConfiguration",&PyKinBody::SetNonCollidingConfiguration, DOXY_FN(KinBody,SetNonCollidingConfiguration))
+                        .def("ComputeSampledCollidingLinks",&PyKinBody::ComputeSampledCollidingLinks, ComputeSampledCollidingLinks_overloads(args("numsamples","numthreads","usecache"), DOXY_FN(KinBody,ComputeSampledCollidingLinks)))
+                        .def("GetSampledAlwaysCollidingLinks",&PyKinBody::GetSampledAlwaysCollidingLinks, DOXY_FN(KinBody,GetSampledAlwaysCollidingLinks))
                         .def("GetConfigurationSpecification",&PyKinBody::GetConfigurationSpecification, GetConfigurationSpecification_overloads(args("interpolation"), DOXY_FN(KinBody,GetConfigurationSpecification)))
                         .def("GetConfigurationSpecificationIndices",&PyKinBody::GetConfigurationSpecificationIndices, GetConfigurationSpecificationIndices_overloads(args("indices","interpolation"), DOXY_FN(KinBody,GetConfigurationSpecificationIndices)))
                         .def("SetConfigurationValues",&PyKinBody::SetConfigurationValues, SetConfigurationValues_overloads(args("values","checklimits"), DOXY_FN(KinBody,SetConfigurationValues)))
@@ -3277,6 +3515,7 @@ void init_openravepy_kinbody()
         enum_<KinBody::AdjacentOptions>("AdjacentOptions" DOXY_ENUM(AdjacentOptions))
         .value("Enabled",KinBody::AO_Enabled)
         .value("ActiveDOFs",KinBody::AO_ActiveDOFs)
+        .value("SampledColliding",KinBody::AO_SampledColliding)
         ;
         kinbody.attr("JointType") = jointtype;
         kinbody.attr("LinkInfo") = linkinfo;
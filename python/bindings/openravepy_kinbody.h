@@ -188,7 +188,9 @@ public:
     object GetJointFromDOFIndex(int dofindex) const;
     object GetTransform() const;
     object GetTransformPose() const;
-    object GetLinkTransformations(bool returndoflastvlaues=false) const;
+    object GetLinkTransformations(bool returndoflastvlaues=false, bool asarray=false) const;
+    object ComputeLinkTransformationsBatch(object odofvalues, object odofindices=object(), int numthreads=1);
+    object CheckCollisionBatch(object odofvalues, object odofindices=object(), bool checkself=true, bool returndistances=false, int numthreads=1);
     void SetLinkTransformations(object transforms, object odoflastvalues=object());
     void SetLinkVelocities(object ovelocities);
     object GetLinkEnableStates() const;
@@ -231,11 +233,13 @@ public:
     object ComputeInverseDynamics(object odofaccelerations, object oexternalforcetorque=object(), bool returncomponents=false);
     void SetSelfCollisionChecker(PyCollisionCheckerBasePtr pycollisionchecker);
     PyInterfaceBasePtr GetSelfCollisionChecker();
-    bool CheckSelfCollision(PyCollisionReportPtr pReport=PyCollisionReportPtr(), PyCollisionCheckerBasePtr pycollisionchecker=PyCollisionCheckerBasePtr());
+    bool CheckSelfCollision(PyCollisionReportPtr pReport=PyCollisionReportPtr(), PyCollisionCheckerBasePtr pycollisionchecker=PyCollisionCheckerBasePtr(), bool releasegil=false);
     bool IsAttached(PyKinBodyPtr pattachbody);
     object GetAttached() const;
     void SetZeroConfiguration();
     void SetNonCollidingConfiguration();
+    void ComputeSampledCollidingLinks(int numsamples=10000, int numthreads=1, bool usecache=false);
+    object GetSampledAlwaysCollidingLinks() const;
     object GetConfigurationSpecification(const std::string& interpolation="") const;
     object GetConfigurationSpecificationIndices(object oindices,const std::string& interpolation="") const;
     void SetConfigurationValues(object ovalues, uint32_t checklimits=KinBody::CLA_CheckLimits);
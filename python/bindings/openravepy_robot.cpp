@@ -412,6 +412,85 @@ public:
             }
         }
 
+        static void _FindIKSolutionsBatch(KinBodyPtr pbody, size_t index, const std::string& manipname, const std::vector<IkParameterization>& vikparams, int filteroptions, std::vector<std::vector<std::vector<dReal> > >& vsolutions)
+        {
+            RobotBase::ManipulatorPtr pmanip = RaveInterfaceCast<RobotBase>(pbody)->GetManipulator(manipname);
+            pmanip->FindIKSolutions(vikparams.at(index), vsolutions.at(index), filteroptions);
+        }
+
+        object FindIKSolutionsBatch(object oparams, int filteroptions, int numthreads=1) const
+        {
+            std::vector<IkParameterization> vikparams;
+            if( PyArray_Check(oparams.ptr()) && PyArray_NDIM((PyArrayObject*)oparams.ptr()) == 3 ) {
+                // Nx3x4 or Nx4x4 transformation matrices
+                PyObject* pyvalues = PyArray_ContiguousFromAny(oparams.ptr(), sizeof(dReal)==8 ? PyArray_DOUBLE : PyArray_FLOAT, 3, 3);
+                if( !pyvalues ) {
+                    throw_error_already_set();
+                }
+                handle<> hvalues(pyvalues);
+                npy_intp* dims = PyArray_DIMS((PyArrayObject*)pyvalues);
+                if( (dims[1] != 3 && dims[1] != 4) || dims[2] != 4 ) {
+                    throw OPENRAVE_EXCEPTION_FORMAT(_("transformations need to be Nx4x4, not Nx%dx%d"),dims[1]%dims[2],ORE_InvalidArguments);
+                }
+                const dReal* pvalues = (const dReal*)PyArray_DATA((PyArrayObject*)pyvalues);
+                vikparams.resize(dims[0]);
+                for(npy_intp i = 0; i < dims[0]; ++i, pvalues += dims[1]*4) {
+                    TransformMatrix t;
+                    for(int j = 0; j < 3; ++j) {
+                        t.m[4*j+0] = pvalues[4*j+0];
+                        t.m[4*j+1] = pvalues[4*j+1];
+                        t.m[4*j+2] = pvalues[4*j+2];
+                        t.trans[j] = pvalues[4*j+3];
+                    }
+                    vikparams[i].SetTransform6D(t);
+                }
+            }
+            else if( PyArray_Check(oparams.ptr()) ) {
+                // Nx7 poses
+                size_t ncols = 0;
+                std::vector<dReal> vposes = ExtractArray2D(oparams, ncols);
+                if( vposes.size() > 0 && ncols != 7 ) {
+                    throw OPENRAVE_EXCEPTION_FORMAT(_("poses need to be Nx7, not Nx%d"),ncols,ORE_InvalidArguments);
+                }
+                vikparams.resize(ncols > 0 ? vposes.size()/ncols : 0);
+                for(size_t i = 0; i < vikparams.size(); ++i) {
+                    const dReal* ppose = &vposes[7*i];
+                    vikparams[i].SetTransform6D(Transform(Vector(ppose[0],ppose[1],ppose[2],ppose[3]),Vector(ppose[4],ppose[5],ppose[6])));
+                }
+            }
+            else {
+                size_t num = len(oparams);
+                vikparams.resize(num);
+                for(size_t i = 0; i < num; ++i) {
+                    object oparam = oparams[i];
+                    if( !ExtractIkParameterization(oparam,vikparams[i]) ) {
+                        vikparams[i].SetTransform6D(ExtractTransform(oparam));
+                    }
+                }
+            }
+
+            std::vector<std::vector<std::vector<dReal> > > vsolutions(vikparams.size());
+            {
+                openravepy::PythonThreadSaver statesaver;
+                RunKinBodyBatch(_pmanip->GetRobot(), vikparams.size(), numthreads, boost::bind(_FindIKSolutionsBatch, _1, _2, _pmanip->GetName(), boost::cref(vikparams), filteroptions, boost::ref(vsolutions)));
+            }
+
+            boost::python::list osolutions;
+            npy_intp narm = _pmanip->GetArmIndices().size();
+            FOREACH(itsolutions, vsolutions) {
+                npy_intp dims[] = { npy_intp(itsolutions->size()), narm };
+                PyObject *pysolutions = PyArray_SimpleNew(2,dims, sizeof(dReal)==8 ? PyArray_DOUBLE : PyArray_FLOAT);
+                dReal* ppos = (dReal*)PyArray_DATA(pysolutions);
+                FOREACH(itsol,*itsolutions) {
+                    BOOST_ASSERT(itsol->size()==size_t(narm));
+                    std::copy(itsol->begin(),itsol->end(),ppos);
+                    ppos += itsol->size();
+                }
+                osolutions.append(static_cast<numeric::array>(handle<>(pysolutions)));
+            }
+            return osolutions;
+        }
+
         object FindIKSolutions(object oparam, object freeparams, int filteroptions, bool ikreturn=false, bool releasegil=false) const
         {
             vector<dReal> vfreeparams = ExtractArray<dReal>(freeparams);
@@ -1375,6 +1454,7 @@ BOOST_PYTHON_MEMBER_FUNCTION_OVERLOADS(CheckEndEffectorSelfCollision_overloads,
 BOOST_PYTHON_MEMBER_FUNCTION_OVERLOADS(FindIKSolution_overloads, FindIKSolution, 2, 4)
 BOOST_PYTHON_MEMBER_FUNCTION_OVERLOADS(FindIKSolutionFree_overloads, FindIKSolution, 3, 5)
 BOOST_PYTHON_MEMBER_FUNCTION_OVERLOADS(FindIKSolutions_overloads, FindIKSolutions, 2, 4)
+BOOST_PYTHON_MEMBER_FUNCTION_OVERLOADS(FindIKSolutionsBatch_overloads, FindIKSolutionsBatch, 2, 3)
 BOOST_PYTHON_MEMBER_FUNCTION_OVERLOADS(FindIKSolutionsFree_overloads, FindIKSolutions, 3, 5)
 BOOST_PYTHON_MEMBER_FUNCTION_OVERLOADS(GetArmConfigurationSpecification_overloads, GetArmConfigurationSpecification, 0, 1)
 BOOST_PYTHON_MEMBER_FUNCTION_OVERLOADS(GetIkConfigurationSpecification_overloads, GetIkConfigurationSpecification, 1, 2)
@@ -1565,6 +1645,7 @@ void init_openravepy_robot()
         .def("FindIKSolution",pmanipikf,FindIKSolutionFree_overloads(args("param","freevalues","filteroptions","ikreturn","releasegil"), DOXY_FN(RobotBase::Manipulator,FindIKSolution "const IkParameterization; const std::vector; std::vector; int")))
         .def("FindIKSolutions",pmanipiks,FindIKSolutions_overloads(args("param","filteroptions","ikreturn","releasegil"), DOXY_FN(RobotBase::Manipulator,FindIKSolutions "const IkParameterization; std::vector; int")))
         .def("FindIKSolutions",pmanipiksf,FindIKSolutionsFree_overloads(args("param","freevalues","filteroptions","ikreturn","releasegil"), DOXY_FN(RobotBase::Manipulator,FindIKSolutions "const IkParameterization; const std::vector; std::vector; int")))
+        .def("FindIKSolutionsBatch",&PyRobotBase::PyManipulator::FindIKSolutionsBatch,FindIKSolutionsBatch_overloads(args("params","filteroptions","numthreads"), "Finds all the ik solutions for every entry of params, which is a Nx4x4 array of transformations, a Nx7 array of poses or a list of IkParameterization objects. Returns a list of KxDOF arrays, one for every entry. The environment is locked once for the whole batch and the GIL is released. If numthreads > 1, the entries are split across clones of the environment."))
         .def("GetIkParameterization",&PyRobotBase::PyManipulator::GetIkParameterization, GetIkParameterization_overloads(args("iktype","inworld"), GetIkParameterization_doc.c_str()))
         .def("GetBase",&PyRobotBase::PyManipulator::GetBase, DOXY_FN(RobotBase::Manipulator,GetBase))
         .def("GetEndEffector",&PyRobotBase::PyManipulator::GetEndEffector, DOXY_FN(RobotBase::Manipulator,GetEndEffector))
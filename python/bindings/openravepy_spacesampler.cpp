@@ -65,31 +65,55 @@ public:
         throw OPENRAVE_EXCEPTION_FORMAT(_("%d sampling type not supported"),type,ORE_InvalidArguments);
     }
 
-    object SampleSequence(SampleDataType type, size_t num,IntervalType interval=IT_Closed)
+    object SampleSequence(SampleDataType type, size_t num,IntervalType interval=IT_Closed, bool releasegil=false)
     {
         if( type == SDT_Real ) {
             std::vector<dReal> samples;
-            _pspacesampler->SampleSequence(samples,num,interval);
-            return toPyArray(samples);
+            {
+                openravepy::PythonThreadSaverPtr statesaver;
+                if( releasegil ) {
+                    statesaver.reset(new openravepy::PythonThreadSaver());
+                }
+                _pspacesampler->SampleSequence(samples,num,interval);
+            }
+            return toPyArrayOwned(samples);
         }
         else if( type == SDT_Uint32 ) {
             std::vector<uint32_t> samples;
-            _pspacesampler->SampleSequence(samples,num);
-            return toPyArray(samples);
+            {
+                openravepy::PythonThreadSaverPtr statesaver;
+                if( releasegil ) {
+                    statesaver.reset(new openravepy::PythonThreadSaver());
+                }
+                _pspacesampler->SampleSequence(samples,num);
+            }
+            return toPyArrayOwned(samples);
         }
         throw OPENRAVE_EXCEPTION_FORMAT(_("%d sampling type not supported"),type,ORE_InvalidArguments);
     }
 
-    object SampleSequence2D(SampleDataType type, size_t num,IntervalType interval=IT_Closed)
+    object SampleSequence2D(SampleDataType type, size_t num,IntervalType interval=IT_Closed, bool releasegil=false)
     {
         if( type == SDT_Real ) {
             std::vector<dReal> samples;
-            _pspacesampler->SampleSequence(samples,num,interval);
+            {
+                openravepy::PythonThreadSaverPtr statesaver;
+                if( releasegil ) {
+                    statesaver.reset(new openravepy::PythonThreadSaver());
+                }
+                _pspacesampler->SampleSequence(samples,num,interval);
+            }
             return _ReturnSamples2D(samples);
         }
         else if( type == SDT_Uint32 ) {
             std::vector<uint32_t> samples;
-            _pspacesampler->SampleSequence(samples,num);
+            {
+                openravepy::PythonThreadSaverPtr statesaver;
+                if( releasegil ) {
+                    statesaver.reset(new openravepy::PythonThreadSaver());
+                }
+                _pspacesampler->SampleSequence(samples,num);
+            }
             return _ReturnSamples2D(samples);
         }
         throw OPENRAVE_EXCEPTION_FORMAT(_("%d sampling type not supported"),type,ORE_InvalidArguments);
@@ -105,58 +129,82 @@ public:
         return _pspacesampler->SampleSequenceOneUInt32();
     }
 
-    object SampleComplete(SampleDataType type, size_t num,IntervalType interval=IT_Closed)
+    object SampleComplete(SampleDataType type, size_t num,IntervalType interval=IT_Closed, bool releasegil=false)
     {
         if( type == SDT_Real ) {
             std::vector<dReal> samples;
-            _pspacesampler->SampleComplete(samples,num,interval);
-            return toPyArray(samples);
+            {
+                openravepy::PythonThreadSaverPtr statesaver;
+                if( releasegil ) {
+                    statesaver.reset(new openravepy::PythonThreadSaver());
+                }
+                _pspacesampler->SampleComplete(samples,num,interval);
+            }
+            return toPyArrayOwned(samples);
         }
         else if( type == SDT_Uint32 ) {
             std::vector<uint32_t> samples;
-            _pspacesampler->SampleComplete(samples,num);
-            return toPyArray(samples);
+            {
+                openravepy::PythonThreadSaverPtr statesaver;
+                if( releasegil ) {
+                    statesaver.reset(new openravepy::PythonThreadSaver());
+                }
+                _pspacesampler->SampleComplete(samples,num);
+            }
+            return toPyArrayOwned(samples);
         }
         throw OPENRAVE_EXCEPTION_FORMAT(_("%d sampling type not supported"),type,ORE_InvalidArguments);
     }
 
-    object SampleComplete2D(SampleDataType type, size_t num,IntervalType interval=IT_Closed)
+    object SampleComplete2D(SampleDataType type, size_t num,IntervalType interval=IT_Closed, bool releasegil=false)
     {
         if( type == SDT_Real ) {
             std::vector<dReal> samples;
-            _pspacesampler->SampleComplete(samples,num,interval);
+            {
+                openravepy::PythonThreadSaverPtr statesaver;
+                if( releasegil ) {
+                    statesaver.reset(new openravepy::PythonThreadSaver());
+                }
+                _pspacesampler->SampleComplete(samples,num,interval);
+            }
             return _ReturnSamples2D(samples);
         }
         else if( type == SDT_Uint32 ) {
             std::vector<uint32_t> samples;
-            _pspacesampler->SampleComplete(samples,num);
+            {
+                openravepy::PythonThreadSaverPtr statesaver;
+                if( releasegil ) {
+                    statesaver.reset(new openravepy::PythonThreadSaver());
+                }
+                _pspacesampler->SampleComplete(samples,num);
+            }
             return _ReturnSamples2D(samples);
         }
         throw OPENRAVE_EXCEPTION_FORMAT(_("%d sampling type not supported"),type,ORE_InvalidArguments);
     }
 protected:
-    object _ReturnSamples2D(const std::vector<dReal>&samples)
+    object _ReturnSamples2D(std::vector<dReal>&samples)
     {
         if( samples.size() == 0 ) {
             return static_cast<numeric::array>(numeric::array(boost::python::list()).astype("f8"));
         }
         int dim = _pspacesampler->GetNumberOfValues();
-        npy_intp dims[] = { npy_intp(samples.size()/dim), npy_intp(dim) };
-        PyObject *pyvalues = PyArray_SimpleNew(2,dims, sizeof(dReal)==8 ? PyArray_DOUBLE : PyArray_FLOAT);
-        memcpy(PyArray_DATA(pyvalues),&samples.at(0),samples.size()*sizeof(samples[0]));
-        return static_cast<numeric::array>(handle<>(pyvalues));
+        std::vector<npy_intp> dims(2);
+        dims[0] = samples.size()/dim;
+        dims[1] = dim;
+        return toPyArrayOwned(samples, dims);
     }
 
-    object _ReturnSamples2D(const std::vector<uint32_t>&samples)
+    object _ReturnSamples2D(std::vector<uint32_t>&samples)
     {
         if( samples.size() == 0 ) {
             return static_cast<numeric::array>(numeric::array(boost::python::list()).astype("u4"));
         }
         int dim = _pspacesampler->GetNumberOfValues();
-        npy_intp dims[] = { npy_intp(samples.size()/dim), npy_intp(dim) };
-        PyObject *pyvalues = PyArray_SimpleNew(2,dims, PyArray_UINT32);
-        memcpy(PyArray_DATA(pyvalues),&samples.at(0),samples.size()*sizeof(samples[0]));
-        return static_cast<numeric::array>(handle<>(pyvalues));
+        std::vector<npy_intp> dims(2);
+        dims[0] = samples.size()/dim;
+        dims[1] = dim;
+        return toPyArrayOwned(samples, dims);
     }
 };
 
@@ -180,10 +228,10 @@ PySpaceSamplerBasePtr RaveCreateSpaceSampler(PyEnvironmentBasePtr pyenv, const s
 }
 
 BOOST_PYTHON_MEMBER_FUNCTION_OVERLOADS(SampleSequenceOneReal_overloads, SampleSequenceOneReal, 0, 1)
-BOOST_PYTHON_MEMBER_FUNCTION_OVERLOADS(SampleSequence_overloads, SampleSequence, 2, 3)
-BOOST_PYTHON_MEMBER_FUNCTION_OVERLOADS(SampleSequence2D_overloads, SampleSequence2D, 2, 3)
-BOOST_PYTHON_MEMBER_FUNCTION_OVERLOADS(SampleComplete_overloads, SampleComplete, 2, 3)
-BOOST_PYTHON_MEMBER_FUNCTION_OVERLOADS(SampleComplete2D_overloads, SampleComplete2D, 2, 3)
+BOOST_PYTHON_MEMBER_FUNCTION_OVERLOADS(SampleSequence_overloads, SampleSequence, 2, 4)
+BOOST_PYTHON_MEMBER_FUNCTION_OVERLOADS(SampleSequence2D_overloads, SampleSequence2D, 2, 4)
+BOOST_PYTHON_MEMBER_FUNCTION_OVERLOADS(SampleComplete_overloads, SampleComplete, 2, 4)
+BOOST_PYTHON_MEMBER_FUNCTION_OVERLOADS(SampleComplete2D_overloads, SampleComplete2D, 2, 4)
 
 void init_openravepy_spacesampler()
 {
@@ -195,12 +243,12 @@ void init_openravepy_spacesampler()
                              .def("GetNumberOfValues",&PySpaceSamplerBase::GetNumberOfValues, args("seed"), DOXY_FN(SpaceSamplerBase,GetNumberOfValues))
                              .def("Supports",&PySpaceSamplerBase::Supports, args("seed"), DOXY_FN(SpaceSamplerBase,Supports))
                              .def("GetLimits",&PySpaceSamplerBase::GetLimits, args("seed"), DOXY_FN(SpaceSamplerBase,GetLimits))
-                             .def("SampleSequence",&PySpaceSamplerBase::SampleSequence, SampleSequence_overloads(args("type", "num","interval"), DOXY_FN(SpaceSamplerBase,SampleSequence "std::vector; size_t; IntervalType")))
-                             .def("SampleSequence2D",&PySpaceSamplerBase::SampleSequence2D, SampleSequence2D_overloads(args("type", "num","interval"), DOXY_FN(SpaceSamplerBase,SampleSequence "std::vector; size_t; IntervalType")))
+                             .def("SampleSequence",&PySpaceSamplerBase::SampleSequence, SampleSequence_overloads(args("type", "num","interval","releasegil"), DOXY_FN(SpaceSamplerBase,SampleSequence "std::vector; size_t; IntervalType")))
+                             .def("SampleSequence2D",&PySpaceSamplerBase::SampleSequence2D, SampleSequence2D_overloads(args("type", "num","interval","releasegil"), DOXY_FN(SpaceSamplerBase,SampleSequence "std::vector; size_t; IntervalType")))
                              .def("SampleSequenceOneReal", &PySpaceSamplerBase::SampleSequenceOneReal, SampleSequenceOneReal_overloads(args("interval"), DOXY_FN(SpaceSamplerBase,SampleSequenceOneReal)))
                              .def("SampleSequenceOneUInt32", &PySpaceSamplerBase::SampleSequenceOneUInt32, DOXY_FN(SpaceSamplerBase,SampleSequenceOneUInt32))
-                             .def("SampleComplete",&PySpaceSamplerBase::SampleComplete, SampleComplete_overloads(args("type", "num","interval"), DOXY_FN(SpaceSamplerBase,SampleComplete "std::vector; size_t; IntervalType")))
-                             .def("SampleComplete2D",&PySpaceSamplerBase::SampleComplete2D, SampleComplete2D_overloads(args("type", "num","interval"), DOXY_FN(SpaceSamplerBase,SampleComplete "std::vector; size_t; IntervalType")))
+                             .def("SampleComplete",&PySpaceSamplerBase::SampleComplete, SampleComplete_overloads(args("type", "num","interval","releasegil"), DOXY_FN(SpaceSamplerBase,SampleComplete "std::vector; size_t; IntervalType")))
+                             .def("SampleComplete2D",&PySpaceSamplerBase::SampleComplete2D, SampleComplete2D_overloads(args("type", "num","interval","releasegil"), DOXY_FN(SpaceSamplerBase,SampleComplete "std::vector; size_t; IntervalType")))
         ;
     }
 
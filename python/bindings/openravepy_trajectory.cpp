@@ -66,14 +66,14 @@ public:
     {
         vector<dReal> values;
         _ptrajectory->Sample(values,time);
-        return toPyArray(values);
+        return toPyArrayOwned(values);
     }
 
     object Sample(dReal time, PyConfigurationSpecificationPtr pyspec) const
     {
         vector<dReal> values;
         _ptrajectory->Sample(values,time,openravepy::GetConfigurationSpecification(pyspec), true);
-        return toPyArray(values);
+        return toPyArrayOwned(values);
     }
 
     object SampleFromPrevious(object odata, dReal time, PyConfigurationSpecificationPtr pyspec) const
@@ -84,33 +84,51 @@ public:
     }
 
     object SamplePoints2D(object otimes) const
+    {
+        return SamplePoints2D(otimes, false);
+    }
+
+    object SamplePoints2D(object otimes, PyConfigurationSpecificationPtr pyspec) const
+    {
+        return SamplePoints2D(otimes, pyspec, false);
+    }
+
+    object SamplePoints2D(object otimes, bool releasegil) const
     {
         vector<dReal> values;
         std::vector<dReal> vtimes = ExtractArray<dReal>(otimes);
-        _ptrajectory->SamplePoints(values,vtimes);
+        {
+            openravepy::PythonThreadSaverPtr statesaver;
+            if( releasegil ) {
+                statesaver.reset(new openravepy::PythonThreadSaver());
+            }
+            _ptrajectory->SamplePoints(values,vtimes);
+        }
 
         int numdof = _ptrajectory->GetConfigurationSpecification().GetDOF();
-        npy_intp dims[] = { npy_intp(values.size()/numdof), npy_intp(numdof) };
-        PyObject *pypos = PyArray_SimpleNew(2,dims, sizeof(dReal)==8 ? PyArray_DOUBLE : PyArray_FLOAT);
-        if( values.size() > 0 ) {
-            memcpy(PyArray_DATA(pypos), &values[0], values.size()*sizeof(values[0]));
-        }
-        return static_cast<numeric::array>(handle<>(pypos));
+        std::vector<npy_intp> dims(2);
+        dims[0] = values.size()/numdof;
+        dims[1] = numdof;
+        return toPyArrayOwned(values, dims);
     }
 
-    object SamplePoints2D(object otimes, PyConfigurationSpecificationPtr pyspec) const
+    object SamplePoints2D(object otimes, PyConfigurationSpecificationPtr pyspec, bool releasegil) const
     {
         vector<dReal> values;
         ConfigurationSpecification spec = openravepy::GetConfigurationSpecification(pyspec);
         std::vector<dReal> vtimes = ExtractArray<dReal>(otimes);
-        _ptrajectory->SamplePoints(values, vtimes, spec);
-
-        npy_intp dims[] = { npy_intp(values.size()/spec.GetDOF()), npy_intp(spec.GetDOF()) };
-        PyObject *pypos = PyArray_SimpleNew(2,dims, sizeof(dReal)==8 ? PyArray_DOUBLE : PyArray_FLOAT);
-        if( values.size() > 0 ) {
-            memcpy(PyArray_DATA(pypos), &values[0], values.size()*sizeof(values[0]));
+        {
+            openravepy::PythonThreadSaverPtr statesaver;
+            if( releasegil ) {
+                statesaver.reset(new openravepy::PythonThreadSaver());
+            }
+            _ptrajectory->SamplePoints(values, vtimes, spec);
         }
-        return static_cast<numeric::array>(handle<>(pypos));
+
+        std::vector<npy_intp> dims(2);
+        dims[0] = values.size()/spec.GetDOF();
+        dims[1] = spec.GetDOF();
+        return toPyArrayOwned(values, dims);
     }
 
     object GetConfigurationSpecification() const {
@@ -125,14 +143,14 @@ public:
     {
         vector<dReal> values;
         _ptrajectory->GetWaypoints(startindex,endindex,values);
-        return toPyArray(values);
+        return toPyArrayOwned(values);
     }
 
     object GetWaypoints(size_t startindex, size_t endindex, PyConfigurationSpecificationPtr pyspec) const
     {
         vector<dReal> values;
         _ptrajectory->GetWaypoints(startindex,endindex,values,openravepy::GetConfigurationSpecification(pyspec));
-        return toPyArray(values);
+        return toPyArrayOwned(values);
     }
 
     // similar to GetWaypoints except returns a 2D array, one row for every waypoint
@@ -141,12 +159,10 @@ public:
         vector<dReal> values;
         _ptrajectory->GetWaypoints(startindex,endindex,values);
         int numdof = _ptrajectory->GetConfigurationSpecification().GetDOF();
-        npy_intp dims[] = { npy_intp(values.size()/numdof), npy_intp(numdof) };
-        PyObject *pypos = PyArray_SimpleNew(2,dims, sizeof(dReal)==8 ? PyArray_DOUBLE : PyArray_FLOAT);
-        if( values.size() > 0 ) {
-            memcpy(PyArray_DATA(pypos), &values[0], values.size()*sizeof(values[0]));
-        }
-        return static_cast<numeric::array>(handle<>(pypos));
+        std::vector<npy_intp> dims(2);
+        dims[0] = values.size()/numdof;
+        dims[1] = numdof;
+        return toPyArrayOwned(values, dims);
     }
 
     object GetAllWaypoints2D() const
@@ -159,12 +175,10 @@ public:
         vector<dReal> values;
         ConfigurationSpecification spec = openravepy::GetConfigurationSpecification(pyspec);
         _ptrajectory->GetWaypoints(startindex,endindex,values,spec);
-        npy_intp dims[] = { npy_intp(values.size()/spec.GetDOF()), npy_intp(spec.GetDOF()) };
-        PyObject *pypos = PyArray_SimpleNew(2,dims, sizeof(dReal)==8 ? PyArray_DOUBLE : PyArray_FLOAT);
-        if( values.size() > 0 ) {
-            memcpy(PyArray_DATA(pypos), &values[0], values.size()*sizeof(values[0]));
-        }
-        return static_cast<numeric::array>(handle<>(pypos));
+        std::vector<npy_intp> dims(2);
+        dims[0] = values.size()/spec.GetDOF();
+        dims[1] = spec.GetDOF();
+        return toPyArrayOwned(values, dims);
     }
 
     object GetAllWaypoints2D(PyConfigurationSpecificationPtr pyspec) const
@@ -280,6 +294,8 @@ void init_openravepy_trajectory()
     object (PyTrajectoryBase::*Sample2)(dReal, PyConfigurationSpecificationPtr) const = &PyTrajectoryBase::Sample;
     object (PyTrajectoryBase::*SamplePoints2D1)(object) const = &PyTrajectoryBase::SamplePoints2D;
     object (PyTrajectoryBase::*SamplePoints2D2)(object, PyConfigurationSpecificationPtr) const = &PyTrajectoryBase::SamplePoints2D;
+    object (PyTrajectoryBase::*SamplePoints2D3)(object, bool) const = &PyTrajectoryBase::SamplePoints2D;
+    object (PyTrajectoryBase::*SamplePoints2D4)(object, PyConfigurationSpecificationPtr, bool) const = &PyTrajectoryBase::SamplePoints2D;
     object (PyTrajectoryBase::*GetWaypoints1)(size_t,size_t) const = &PyTrajectoryBase::GetWaypoints;
     object (PyTrajectoryBase::*GetWaypoints2)(size_t,size_t,PyConfigurationSpecificationPtr) const = &PyTrajectoryBase::GetWaypoints;
     object (PyTrajectoryBase::*GetWaypoints2D1)(size_t,size_t) const = &PyTrajectoryBase::GetWaypoints2D;
@@ -300,6 +316,8 @@ void init_openravepy_trajectory()
     .def("SampleFromPrevious",&PyTrajectoryBase::SampleFromPrevious,args("data","time","spec"),DOXY_FN(TrajectoryBase,Sample "std::vector; dReal; const ConfigurationSpecification"))
     .def("SamplePoints2D",SamplePoints2D1,args("times"),DOXY_FN(TrajectoryBase,SamplePoints2D "std::vector; std::vector"))
     .def("SamplePoints2D",SamplePoints2D2,args("times","spec"),DOXY_FN(TrajectoryBase,SamplePoints2D "std::vector; std::vector; const ConfigurationSpecification"))
+    .def("SamplePoints2D",SamplePoints2D3,args("times","releasegil"),"Same as SamplePoints2D(times), if releasegil is True, the python GIL is released while sampling.")
+    .def("SamplePoints2D",SamplePoints2D4,args("times","spec","releasegil"),"Same as SamplePoints2D(times,spec), if releasegil is True, the python GIL is released while sampling.")
     .def("GetConfigurationSpecification",&PyTrajectoryBase::GetConfigurationSpecification,DOXY_FN(TrajectoryBase,GetConfigurationSpecification))
     .def("GetNumWaypoints",&PyTrajectoryBase::GetNumWaypoints,DOXY_FN(TrajectoryBase,GetNumWaypoints))
     .def("GetWaypoints",GetWaypoints1,args("startindex","endindex"),DOXY_FN(TrajectoryBase, GetWaypoints "size_t; size_t; std::vector"))
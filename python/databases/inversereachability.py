@@ -56,7 +56,7 @@ if not __openravepy_build_doc__:
 else:
     from numpy import array
 
-from ..openravepy_int import RaveFindDatabaseFile, RaveCreateRobot, IkParameterization, rotationMatrixFromAxisAngle, poseFromMatrix, matrixFromPose, matrixFromQuat, matrixFromAxisAngle, poseMult, quatFromAxisAngle, IkFilterOptions
+from ..openravepy_int import RaveFindDatabaseFile, RaveCreateRobot, RaveCreateModule, RaveCreateSpaceSampler, IkParameterization, rotationMatrixFromAxisAngle, poseFromMatrix, matrixFromPose, matrixFromQuat, matrixFromAxisAngle, poseMult, quatFromAxisAngle, IkFilterOptions
 from ..openravepy_ext import quatArrayTMult, quatArrayTDist, poseMultArrayT, normalizeZRotation
 from . import DatabaseGenerator
 from .. import pyANN
@@ -64,6 +64,8 @@ from . import kinematicreachability, linkstatistics, inversekinematics
 
 import numpy
 import os.path
+from os import remove
+from tempfile import mkstemp
 from optparse import OptionParser
 
 import logging
@@ -155,7 +157,9 @@ class InverseReachabilityModel(DatabaseGenerator):
         heightthresh=None
         quatthresh=None
         Nminimum=None
+        numthreads=None
         if options is not None:
+            numthreads=options.numthreads
             if options.heightthresh is not None:
                 heightthresh=options.heightthresh
             if options.quatthresh is not None:
@@ -170,12 +174,16 @@ class InverseReachabilityModel(DatabaseGenerator):
                 heightthresh=0.05
             if quatthresh is None:
                 quatthresh=0.15            
-        self.generate(heightthresh=heightthresh,quatthresh=quatthresh,Nminimum=Nminimum)
+        self.generate(heightthresh=heightthresh,quatthresh=quatthresh,Nminimum=Nminimum,numthreads=numthreads)
         self.save()
-    def generate(self,heightthresh=None,quatthresh=None,Nminimum=None):
+    def generate(self,heightthresh=None,quatthresh=None,Nminimum=None,numthreads=None,usenative=True):
         """First transform all end effectors to the identity and get the robot positions,
         then cluster the robot position modulo in-plane rotation (z-axis) and position (xy),
-        then compute statistics for each cluster."""
+        then compute statistics for each cluster.
+
+        :param numthreads: number of threads the native InverseReachability module computes the densities with
+        :param usenative: if True and the InverseReachability module is present, uses it to find the clusters
+        """
         # disable every body but the target and robot
         bodies = [(b,b.IsEnabled()) for b in self.env.GetBodies() if b != self.robot]
         for b in bodies:
@@ -199,65 +207,111 @@ class InverseReachabilityModel(DatabaseGenerator):
             self.robot.SetDOFValues(*self.necessaryjointstate())
             # get base of link manipulator with respect to base link
             Tbase = dot(linalg.inv(self.robot.GetTransform()),self.manip.GetBase().GetTransform())
-            # convert the quatthresh to a loose euclidean distance
             self.xyzdelta = self.rmodel.xyzdelta
             self.quatdelta = self.rmodel.quatdelta
             self.rotweight = heightthresh/quatthresh
-            quateucdist2 = (1-cos(quatthresh))**2+sin(quatthresh)**2
             # find the density
             basetrans = array(self._GetValue(self.rmodel.reachabilitystats))
             assert len(basetrans) > 0
             basetrans[:,0:7] = poseMultArrayT(poseFromMatrix(Tbase),basetrans[:,0:7])
-            # find the density of the points
-            searchtrans = c_[basetrans[:,0:4],basetrans[:,6:7]]
-            kdtree = kinematicreachability.ReachabilityModel.QuaternionKDTree(searchtrans,1.0/self.rotweight)
-            transdensity = kdtree.kFRSearchArray(searchtrans,0.25*quateucdist2,0,quatthresh*0.2)[2]
-            basetrans = basetrans[argsort(-transdensity),:]
             Nminimum = max(Nminimum,4)
-            # find all equivalence classes
-            quatrolls = array([quatFromAxisAngle(array((0,0,1)),roll) for roll in arange(0,2*pi,quatthresh*0.5)])
             self.equivalenceclasses = []
-            while len(basetrans) > 0:
-                searchtrans = c_[basetrans[:,0:4],basetrans[:,6:7]]
-                kdtree = kinematicreachability.ReachabilityModel.QuaternionKDTree(searchtrans,1.0/self.rotweight)
-                querypoints = c_[quatArrayTMult(quatrolls, searchtrans[0][0:4]),tile(searchtrans[0][4:],(len(quatrolls),1))]
-                foundindices = zeros(len(searchtrans),bool)
-                for querypoint in querypoints:
-                    k = min(len(searchtrans),1000)
-                    neighs,dists,kball = kdtree.kFRSearchArray(reshape(querypoint,(1,5)),quateucdist2,k,quatthresh*0.01)
-                    if k < kball:
-                        neighs,dists,kball = kdtree.kFRSearchArray(reshape(querypoint,(1,5)),quateucdist2,kball,quatthresh*0.01)
-                    foundindices[neighs] = True
-                equivalenttrans = basetrans[flatnonzero(foundindices),:]
-                normalizedqarray,zangles = normalizeZRotation(equivalenttrans[:,0:4])
-                # get the 'mean' of the normalized quaternions best describing the distribution
-                # for initialization, make sure all quaternions are on the same hemisphere
-                identityquat = tile(array((1.0,0,0,0)),(normalizedqarray.shape[0],1))
-                normalizedqarray[flatnonzero(sum((normalizedqarray+identityquat)**2,1) < sum((normalizedqarray-identityquat)**2, 1)),0:4] *= -1
-                q0 = sum(normalizedqarray,axis=0)
-                q0 /= sqrt(sum(q0**2))
-                if len(normalizedqarray) >= Nminimum:
-                    qmean,success = leastsq(lambda q: quatArrayTDist(q/sqrt(sum(q**2)),normalizedqarray), normalizedqarray[0],maxfev=10000)
-                    qmean /= sqrt(sum(qmean**2))
-                else:
-                    qmean = q0
-                qstd = sqrt(sum(quatArrayTDist(qmean,normalizedqarray)**2)/len(normalizedqarray))
-                # compute statistics, store the angle, xy offset, and remaining unprocessed data
-                czangles = cos(zangles)
-                szangles = sin(zangles)
-                equivalenttransinv = -c_[czangles*equivalenttrans[:,4]+szangles*equivalenttrans[:,5],-szangles*equivalenttrans[:,4]+czangles*equivalenttrans[:,5]]
-                equivalenceclass = (r_[qmean,mean(equivalenttrans[:,6])],
-                                    r_[qstd,std(equivalenttrans[:,6])],
-                                    c_[-zangles,equivalenttransinv,equivalenttrans[:,7:]])
+            module = RaveCreateModule(self.env,'inversereachability') if usenative else None
+            if module is not None:
+                classindices = self.computeEquivalenceClassIndices(module,basetrans,heightthresh,quatthresh,numthreads)
+            else:
+                classindices = self.computeEquivalenceClassIndicesPython(basetrans,heightthresh,quatthresh)
+            for indices in classindices:
+                equivalenceclass = self.computeEquivalenceClass(basetrans[indices,:],Nminimum)
                 self.equivalenceclasses.append(equivalenceclass)
-                basetrans = basetrans[flatnonzero(foundindices==False),:]
-                log.info('new equivalence class outliers: %d/%d, left over trans: %d',self.testEquivalenceClass(equivalenceclass)*len(zangles),len(zangles),len(basetrans))
+                log.info('new equivalence class outliers: %d/%d',self.testEquivalenceClass(equivalenceclass)*len(indices),len(indices))
         finally:
             statesaver.Release()
             for b,enable in bodies:
                 b.Enable(enable)
         self.preprocess()
         
+    def computeEquivalenceClassIndices(self,module,basetrans,heightthresh,quatthresh,numthreads=None):
+        """Clusters basetrans with the native InverseReachability module.
+
+        :return: a list of index arrays into basetrans, one for every equivalence class, sorted by density
+        """
+        fd,posesfile = mkstemp(suffix='.poses')
+        os.close(fd)
+        fd,classesfile = mkstemp(suffix='.classes')
+        os.close(fd)
+        try:
+            numpy.ascontiguousarray(basetrans[:,0:8],dtype=float64).tofile(posesfile)
+            res = module.SendCommand('ComputeEquivalenceClasses posesfile %s numposes %d heightthresh %.15e quatthresh %.15e numthreads %d filename %s'%(posesfile,len(basetrans),heightthresh,quatthresh,numthreads if numthreads is not None else 1,classesfile))
+            if res is None:
+                raise ValueError('ComputeEquivalenceClasses failed')
+            data = numpy.fromfile(classesfile,dtype=int32)
+        finally:
+            remove(posesfile)
+            remove(classesfile)
+        classindices = []
+        offset = 0
+        while offset < len(data):
+            classindices.append(data[offset+1:offset+1+data[offset]])
+            offset += 1+data[offset]
+        return classindices
+
+    def computeEquivalenceClassIndicesPython(self,basetrans,heightthresh,quatthresh):
+        """Clusters basetrans with pyANN, same result as computeEquivalenceClassIndices.
+
+        :return: a list of index arrays into basetrans, one for every equivalence class, sorted by density
+        """
+        # convert the quatthresh to a loose euclidean distance
+        quateucdist2 = (1-cos(quatthresh))**2+sin(quatthresh)**2
+        rotweight = heightthresh/quatthresh
+        # find the density of the points. sort stably so that poses with the same density keep their order like the native module
+        searchtrans = c_[basetrans[:,0:4],basetrans[:,6:7]]
+        kdtree = kinematicreachability.ReachabilityModel.QuaternionKDTree(searchtrans,1.0/rotweight)
+        transdensity = kdtree.kFRSearchArray(searchtrans,0.25*quateucdist2,0,quatthresh*0.2)[2]
+        leftindices = argsort(-transdensity,kind='mergesort')
+        # find all equivalence classes
+        quatrolls = array([quatFromAxisAngle(array((0,0,1)),roll) for roll in arange(0,2*pi,quatthresh*0.5)])
+        classindices = []
+        while len(leftindices) > 0:
+            searchtrans = c_[basetrans[leftindices,0:4],basetrans[leftindices,6:7]]
+            kdtree = kinematicreachability.ReachabilityModel.QuaternionKDTree(searchtrans,1.0/rotweight)
+            querypoints = c_[quatArrayTMult(quatrolls, searchtrans[0][0:4]),tile(searchtrans[0][4:],(len(quatrolls),1))]
+            foundindices = zeros(len(searchtrans),bool)
+            for querypoint in querypoints:
+                k = min(len(searchtrans),1000)
+                neighs,dists,kball = kdtree.kFRSearchArray(reshape(querypoint,(1,5)),quateucdist2,k,quatthresh*0.01)
+                if k < kball:
+                    neighs,dists,kball = kdtree.kFRSearchArray(reshape(querypoint,(1,5)),quateucdist2,kball,quatthresh*0.01)
+                foundindices[neighs] = True
+            classindices.append(leftindices[flatnonzero(foundindices)])
+            leftindices = leftindices[flatnonzero(foundindices==False)]
+            log.debug('new equivalence class: %d, left over trans: %d',len(classindices[-1]),len(leftindices))
+        return classindices
+
+    def computeEquivalenceClass(self,equivalenttrans,Nminimum):
+        """Computes the statistics of one equivalence class given all its base poses.
+        """
+        normalizedqarray,zangles = normalizeZRotation(equivalenttrans[:,0:4])
+        # get the 'mean' of the normalized quaternions best describing the distribution
+        # for initialization, make sure all quaternions are on the same hemisphere
+        identityquat = tile(array((1.0,0,0,0)),(normalizedqarray.shape[0],1))
+        normalizedqarray[flatnonzero(sum((normalizedqarray+identityquat)**2,1) < sum((normalizedqarray-identityquat)**2, 1)),0:4] *= -1
+        q0 = sum(normalizedqarray,axis=0)
+        q0 /= sqrt(sum(q0**2))
+        if len(normalizedqarray) >= Nminimum:
+            qmean,success = leastsq(lambda q: quatArrayTDist(q/sqrt(sum(q**2)),normalizedqarray), normalizedqarray[0],maxfev=10000)
+            qmean /= sqrt(sum(qmean**2))
+        else:
+            qmean = q0
+        qstd = sqrt(sum(quatArrayTDist(qmean,normalizedqarray)**2)/len(normalizedqarray))
+        # compute statistics, store the angle, xy offset, and remaining unprocessed data
+        czangles = cos(zangles)
+        szangles = sin(zangles)
+        equivalenttransinv = -c_[czangles*equivalenttrans[:,4]+szangles*equivalenttrans[:,5],-szangles*equivalenttrans[:,4]+czangles*equivalenttrans[:,5]]
+        return (r_[qmean,mean(equivalenttrans[:,6])],
+                r_[qstd,std(equivalenttrans[:,6])],
+                c_[-zangles,equivalenttransinv,equivalenttrans[:,7:]])
+
     def getEquivalenceClass(self,Tgrasp):
         with self.env:
             Tbase = self.manip.GetBase().GetTransform()
@@ -342,28 +396,24 @@ class InverseReachabilityModel(DatabaseGenerator):
             return poseMultArrayT(poserobot,c_[cos(samples[:,0]),zeros((N,2)),sin(samples[:,0]),samples[:,1:3],tile(Tbase[2,3],N)]),self.necessaryjointstate()
         return gaussiankerneldensity,gaussiankernelsampler,bounds
 
-    def computeAggregateBaseDistribution(self,Tgrasps,logllthresh=2.0,zaxis=None):
-        """Return a function of the distribution of possible positions of the robot such that any grasp from Tgrasps is reachable.
-        Also computes a sampler function that returns a random position of the robot along with the index into Tgrasps"""
-        if zaxis is not None:
-            raise NotImplementedError('cannot specify a custom zaxis yet')
+    def _computeAggregateBasePoints(self,Tgrasps,logllthresh=2.0):
+        """Gathers the equivalence class points of all the grasps in the global coordinate system.
+
+        :return: points,weights,graspindices,graspindexoffsets,bandwidth,poserobot,Tbase. points is None if no grasp has a distribution.
+        """
         with self.env:
             Tbase = self.manip.GetBase().GetTransform()
             poserobot = poseFromMatrix(dot(self.robot.GetTransform(),linalg.inv(Tbase)))
         
         rotweight = self.rotweight
-        irotweight = 1.0/rotweight
         posebase = poseFromMatrix(Tbase)
         qbaserobotnorm,zbaseangle = normalizeZRotation(reshape(posebase[0:4],(1,4)))
         if quatArrayTDist([1.0,0,0,0],qbaserobotnorm) > 0.05:
             raise planning_error('out of plane rotations for base are not supported')
         
         bandwidth = array((rotweight*self.quatdelta ,self.xyzdelta,self.xyzdelta))
-        ibandwidth=-0.5/bandwidth**2
         # normalization for the weights so that integrated volume is 1. this is necessary when comparing across different distributions?
         normalizationconst = (1.0/sqrt(pi**3*sum(bandwidth**2)))
-        searchradius=9.0*sum(bandwidth**2)
-        searcheps=bandwidth[0]*0.1
         
         points = zeros((0,3))
         weights = array(())
@@ -390,11 +440,48 @@ class InverseReachabilityModel(DatabaseGenerator):
 
         if len(points) == 0:
             log.info('inversereachability: could not find base distribution, logllthresh too high? logll=%f', highestlogll)
-            return None,None,None
+            return None,None,None,None,bandwidth,poserobot,Tbase
         
         # transform points by the base pose
         points[:,0] += zbaseangle
         points[:,1:3] = dot(points[:,1:3],transpose(rotationMatrixFromAxisAngle([0,0,1],zbaseangle)[0:2,0:2])) + tile(posebase[4:6], (len(points),1))
+        return points,weights,graspindices,graspindexoffsets,bandwidth,poserobot,Tbase
+
+    def createBaseSampler(self,Tgrasps,logllthresh=2.0,weight=1.0):
+        """Creates a native BasePlacement space sampler of the aggregate base distribution of Tgrasps so that base placements can be sampled inside C++ planning loops.
+        Every sample of the sampler is the robot pose followed by the index into Tgrasps it was sampled for.
+
+        :return: the sampler, or None if no grasp has a distribution
+        """
+        points,weights,graspindices,graspindexoffsets,bandwidth,poserobot,Tbase = self._computeAggregateBasePoints(Tgrasps,logllthresh)
+        if points is None:
+            return None
+        sampler = RaveCreateSpaceSampler(self.env,'baseplacement')
+        if sampler is None:
+            return None
+        pointgraspindices = zeros(len(points),int)
+        for graspindex,offset in zip(graspindices,graspindexoffsets):
+            pointgraspindices[offset:] = graspindex
+        cmd = 'SetDistribution rotweight %.15e bandwidth %s robotpose %s baseheight %.15e points %d '%(self.rotweight,' '.join('%.15e'%f for f in bandwidth),' '.join('%.15e'%f for f in poserobot),Tbase[2,3],len(points))
+        cmd += ' '.join('%.15e %.15e %.15e %.15e %d'%(p[0],p[1],p[2],w,g) for p,w,g in zip(points,weights,pointgraspindices))
+        sampler.SendCommand(cmd)
+        sampler.SendCommand('SetBandwidthWeight %.15e'%weight)
+        return sampler
+
+    def computeAggregateBaseDistribution(self,Tgrasps,logllthresh=2.0,zaxis=None):
+        """Return a function of the distribution of possible positions of the robot such that any grasp from Tgrasps is reachable.
+        Also computes a sampler function that returns a random position of the robot along with the index into Tgrasps"""
+        if zaxis is not None:
+            raise NotImplementedError('cannot specify a custom zaxis yet')
+        points,weights,graspindices,graspindexoffsets,bandwidth,poserobot,Tbase = self._computeAggregateBasePoints(Tgrasps,logllthresh)
+        if points is None:
+            return None,None,None
+
+        rotweight = self.rotweight
+        irotweight = 1.0/rotweight
+        ibandwidth=-0.5/bandwidth**2
+        searchradius=9.0*sum(bandwidth**2)
+        searcheps=bandwidth[0]*0.1
         
         bounds = array((numpy.min(points,0)-bandwidth,numpy.max(points,0)+bandwidth))
         if bounds[1,0]-bounds[0,0] > 2*pi:
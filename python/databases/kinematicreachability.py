@@ -57,7 +57,7 @@ if not __openravepy_build_doc__:
 else:
     from numpy import array
 
-from ..openravepy_int import RaveFindDatabaseFile, IkParameterization, rotationMatrixFromQArray, poseFromMatrix
+from ..openravepy_int import RaveFindDatabaseFile, RaveCreateModule, IkParameterization, rotationMatrixFromQArray, poseFromMatrix
 from ..openravepy_ext import transformPoints, quatArrayTDist
 from .. import metaclass, pyANN
 from ..misc import SpaceSamplerExtra
@@ -67,7 +67,8 @@ from . import convexdecomposition, inversekinematics
 import numpy
 import time
 import os.path
-from os import makedirs
+from os import makedirs, remove
+from tempfile import mkstemp
 from heapq import nsmallest # for nth smallest element
 from optparse import OptionParser
 
@@ -226,7 +227,9 @@ class ReachabilityModel(DatabaseGenerator):
         xyzdelta=None
         quatdelta=None
         usefreespace=False
+        numthreads=None
         if options is not None:
+            numthreads=options.numthreads
             if options.maxradius is not None:
                 maxradius = options.maxradius
             if options.xyzdelta is not None:
@@ -242,7 +245,7 @@ class ReachabilityModel(DatabaseGenerator):
                 xyzdelta = 0.03
             if quatdelta is None:
                 quatdelta = 0.2
-        return maxradius,translationonly,xyzdelta,quatdelta,usefreespace
+        return maxradius,translationonly,xyzdelta,quatdelta,usefreespace,numthreads
 
     def getOrderedArmJoints(self):
         return [j for j in self.robot.GetDependencyOrderedJoints() if j.GetJointIndex() in self.manip.GetArmIndices()]
@@ -268,6 +271,63 @@ class ReachabilityModel(DatabaseGenerator):
                     links.append(newlink)
         return links
 
+    def generate(self,maxradius=None,translationonly=False,xyzdelta=None,quatdelta=None,usefreespace=False,numthreads=None,usenative=True):
+        """Generates the reachability map. Uses the native KinematicReachability module when available since it is much faster than the python loop.
+
+        :param numthreads: number of threads the native module computes with. If None, uses 1.
+        :param usenative: if False, always uses the python producer/consumer/gatherer generator
+        """
+        if usenative:
+            module = RaveCreateModule(self.env,'kinematicreachability')
+            if module is not None:
+                self.generatenative(module,maxradius,translationonly,xyzdelta,quatdelta,usefreespace,numthreads)
+                return
+            log.warn('KinematicReachability module not found, reverting to python generator')
+        DatabaseGenerator.generate(self,maxradius,translationonly,xyzdelta,quatdelta,usefreespace)
+
+    def generatenative(self,module,maxradius=None,translationonly=False,xyzdelta=None,quatdelta=None,usefreespace=False,numthreads=None):
+        """Computes the reachability map with the native KinematicReachability module and reads back its binary results.
+        """
+        starttime = time.time()
+        if not self.ikmodel.load():
+            self.ikmodel.autogenerate()
+        if xyzdelta is None:
+            xyzdelta=0.04
+        if quatdelta is None:
+            quatdelta=0.5
+        self.kdtree3d = self.kdtree6d = None
+        qarray = array([[1.0,0,0,0]]) if translationonly else SpaceSamplerExtra().sampleSO3(quatdelta=quatdelta)
+        self.xyzdelta = xyzdelta
+        self.quatdelta = 0
+        if not translationonly:
+            # for rotations, get the average distance to the nearest rotation
+            neighdists = []
+            for q in qarray:
+                neighdists.append(nsmallest(2,quatArrayTDist(q,qarray))[1])
+            self.quatdelta = mean(neighdists)
+        fd,filename = mkstemp(suffix='.reach')
+        os.close(fd)
+        try:
+            cmd = 'ComputeReachability robot %s manipname %s xyzdelta %.15e usefreespace %d numthreads %d filename %s '%(self.robot.GetName(),self.manip.GetName(),xyzdelta,usefreespace,numthreads if numthreads is not None else 1,filename)
+            if maxradius is not None:
+                cmd += 'maxradius %.15e '%maxradius
+            cmd += 'rotations %d '%len(qarray) + ' '.join('%.15e'%f for f in qarray.flat)
+            res = module.SendCommand(cmd)
+            if res is None:
+                raise ValueError('ComputeReachability failed')
+            headerdtype = numpy.dtype([('magic','S8'),('version','u4'),('shape','u4',3),('numstats','u8'),('pointscale','f8',2)])
+            with open(filename,'rb') as f:
+                header = numpy.fromfile(f,dtype=headerdtype,count=1)[0]
+                numgrid = int(prod(header['shape']))
+                shape = tuple(int(x) for x in header['shape'])
+                self.reachabilitydensity3d = reshape(numpy.fromfile(f,dtype=float64,count=numgrid),shape)
+                self.reachability3d = reshape(numpy.fromfile(f,dtype=float64,count=numgrid),shape)
+                self.reachabilitystats = reshape(numpy.fromfile(f,dtype=float64,count=int(header['numstats'])*8),(int(header['numstats']),8))
+                self.pointscale = array(header['pointscale'])
+        finally:
+            remove(filename)
+        log.info('database %s finished in %fs',self.__class__.__name__,time.time()-starttime)
+
     def generatepcg(self,maxradius=None,translationonly=False,xyzdelta=None,quatdelta=None,usefreespace=False):
         """Generate producer, consumer, and gatherer functions allowing parallelization
         """
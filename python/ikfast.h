@@ -266,6 +266,53 @@ protected:
     std::list< IkSolution<T> > _listsolutions;
 };
 
+/// \brief Contiguous implementation of \ref IkSolutionListBase that keeps its memory across \ref Clear calls
+///
+/// \ref Clear only resets the number of valid solutions, so the buffers of the stored solutions are reused by the next \ref AddSolution
+/// calls and an ik call does not allocate once the list has grown to the number of solutions it returns. \ref GetSolution is O(1).
+/// Unlike \ref IkSolutionList, adding solutions past the reserved capacity invalidates references returned by \ref GetSolution.
+template <typename T>
+class IkSolutionListArena : public IkSolutionListBase<T>
+{
+public:
+    IkSolutionListArena(std::size_t capacity=16) : _numsolutions(0) {
+        _vsolutions.reserve(capacity);
+    }
+
+    virtual size_t AddSolution(const std::vector<IkSingleDOFSolutionBase<T> >& vinfos, const std::vector<int>& vfree)
+    {
+        if( _numsolutions < _vsolutions.size() ) {
+            // assigning keeps the capacity of the previous solution's vectors
+            _vsolutions[_numsolutions]._vbasesol = vinfos;
+            _vsolutions[_numsolutions]._vfree = vfree;
+        }
+        else {
+            _vsolutions.push_back(IkSolution<T>(vinfos,vfree));
+        }
+        return _numsolutions++;
+    }
+
+    virtual const IkSolutionBase<T>& GetSolution(size_t index) const
+    {
+        if( index >= _numsolutions ) {
+            throw std::runtime_error("GetSolution index is invalid");
+        }
+        return _vsolutions[index];
+    }
+
+    virtual size_t GetNumSolutions() const {
+        return _numsolutions;
+    }
+
+    virtual void Clear() {
+        _numsolutions = 0;
+    }
+
+protected:
+    std::vector< IkSolution<T> > _vsolutions; ///< the first _numsolutions are valid, the rest are kept for reuse
+    std::size_t _numsolutions;
+};
+
 }
 
 #endif // OPENRAVE_IKFAST_HEADER
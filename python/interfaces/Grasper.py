@@ -111,8 +111,13 @@ class Grasper:
         contacts = reshape(array([float64(s) for s in resvalues],float64),(len(resvalues)/6,6))
         return contacts,finalconfig,mindist,volume
 
-    def GraspThreaded(self,approachrays,standoffs,preshapes,rolls,manipulatordirections=None,target=None,transformrobot=True,onlycontacttarget=True,tightgrasp=False,graspingnoise=None,forceclosurethreshold=None,collisionchecker=None,translationstepmult=None,numthreads=None,startindex=None,maxgrasps=None,finestep=None):
+    def GraspThreaded(self,approachrays,standoffs,preshapes,rolls,manipulatordirections=None,target=None,transformrobot=True,onlycontacttarget=True,tightgrasp=False,graspingnoise=None,forceclosurethreshold=None,collisionchecker=None,translationstepmult=None,numthreads=None,startindex=None,maxgrasps=None,finestep=None,asynchronous=False,skipids=None,returncompletedids=False):
         """See :ref:`module-grasper-graspthreaded`
+
+        :param asynchronous: if True, returns immediately with (None,[]), the grasps are polled with GetGraspThreadedResults
+        :param skipids: grasp ids that are not evaluated. A call with returncompletedids is resumed with startindex=nextid and skipids=completedids of the previous call
+        :param returncompletedids: if True, also returns the completed grasp ids above nextid and their grasps. Otherwise only the grasps below nextid are returned and a call is resumed with startindex=nextid
+        :return: (nextid, grasps), or (nextid, completedids, grasps) if returncompletedids is True. The grasp ids below nextid and the ones in completedids are complete
         """
         cmd = 'GraspThreaded '
         if target is not None:
@@ -124,6 +129,8 @@ class Grasper:
             cmd += 'startindex %d '%startindex
         if maxgrasps is not None:
             cmd += 'maxgrasps %d '%maxgrasps
+        if skipids is not None:
+            cmd += 'skipids %d '%len(skipids) + ' '.join(str(id) for id in skipids) + ' '
         for link in self.avoidlinks:
             cmd += 'avoidlink %s '%link.GetName()
         if graspingnoise is not None:
@@ -134,6 +141,10 @@ class Grasper:
             cmd += 'finestep %.15e '%finestep
         if numthreads is not None:
             cmd += 'numthreads %d '%numthreads
+        if asynchronous:
+            cmd += 'async 1 '
+        if returncompletedids:
+            cmd += 'returncompletedids 1 '
         cmd += 'approachrays %d '%len(approachrays)
         for f in approachrays.flat:
             cmd += str(f) + ' '
@@ -152,9 +163,38 @@ class Grasper:
         res = self.prob.SendCommand(cmd)
         if res is None:
             raise PlanningError('Grasp failed')
+        if asynchronous:
+            return (None, [], []) if returncompletedids else (None, [])
         resultgrasps = res.split()
-        resvalues=[]
+        if not returncompletedids:
+            nextid = int(resultgrasps.pop(0))
+            return nextid, self._ParseGraspResults(resultgrasps)
+        nextid, completedids = self._ParseCompletedIds(resultgrasps)
+        return nextid, completedids, self._ParseGraspResults(resultgrasps)
+
+    def GetGraspThreadedResults(self,wait=None):
+        """See :ref:`module-grasper-getgraspthreadedresults`
+
+        :return: (done, nextid, completedids, grasps) with the grasps that succeeded since the last poll. The grasp ids below nextid and the ones in completedids are complete, including the ones of earlier polls
+        """
+        cmd = 'GetGraspThreadedResults '
+        if wait is not None:
+            cmd += 'wait %.15e '%wait
+        res = self.prob.SendCommand(cmd)
+        if res is None:
+            raise PlanningError('GetGraspThreadedResults failed')
+        resultgrasps = res.split()
+        done = int(resultgrasps.pop(0))
+        nextid, completedids = self._ParseCompletedIds(resultgrasps)
+        return done, nextid, completedids, self._ParseGraspResults(resultgrasps)
+
+    def _ParseCompletedIds(self,resultgrasps):
         nextid = int(resultgrasps.pop(0))
+        completedids = [int(resultgrasps.pop(0)) for i in range(int(resultgrasps.pop(0)))]
+        return nextid, completedids
+
+    def _ParseGraspResults(self,resultgrasps):
+        resvalues=[]
         preshapelen = len(self.robot.GetActiveManipulator().GetGripperIndices())
         for i in range(int(resultgrasps.pop(0))):
             position = array([float64(resultgrasps.pop(0)) for i in range(3)])
@@ -171,7 +211,7 @@ class Grasper:
             contacts=[float64(resultgrasps.pop(0)) for i in range(contacts_num*6)]
             contacts = reshape(contacts,(contacts_num,6))
             resvalues.append([position, direction, roll, standoff, manipulatordirection, mindist, volume, preshape,Tfinal,finalshape,contacts])
-        return nextid, resvalues
+        return resvalues
 
     def ConvexHull(self,points,returnplanes=True,returnfaces=True,returntriangles=True):
         """See :ref:`module-grasper-convexhull`
@@ -0,0 +1,258 @@
+/** \file orbenchmark.h
+    \author Rosen Diankov
+
+    Included by the OpenRAVE C++ benchmarks and command line tools.
+ */
+#include <openrave-core.h>
+#include <openrave/utils.h>
+#include <string>
+#include <vector>
+#include <iostream>
+#include <sstream>
+
+#include <boost/bind.hpp>
+#include <boost/function.hpp>
+#include <boost/format.hpp>
+#include <boost/lexical_cast.hpp>
+
+namespace cppexamples {
+
+/** \brief Parses the "--name value" options of a command line.
+
+    Every option is registered with the variable that receives its value, the arguments after the options are kept as positional arguments:
+
+    \code
+    CommandLineOptions options("orbenchmark", "logfilename");
+    int numsamples = 100;
+    options.AddOption("--numsamples", "num", "number of samples", numsamples);
+    int exitcode = 0;
+    if( !options.Parse(argc, argv, exitcode) ) {
+        return exitcode;
+    }
+    \endcode
+ */
+class CommandLineOptions
+{
+public:
+    /// \param positionalusage describes the positional arguments in the usage, if empty no positional arguments are accepted
+    CommandLineOptions(const std::string& programname, const std::string& positionalusage="") : _programname(programname), _positionalusage(positionalusage) {
+    }
+
+    template <typename T>
+    void AddOption(const std::string& name, const std::string& argname, const std::string& description, T& value)
+    {
+        Option option;
+        option.name = name;
+        option.argname = argname;
+        option.description = description;
+        std::stringstream ssdefault;
+        ssdefault << value;
+        option.defaultvalue = ssdefault.str();
+        option.setvalue = boost::bind(&CommandLineOptions::_SetValue<T>, _1, boost::ref(value));
+        _voptions.push_back(option);
+    }
+
+    /// \brief parses the command line, prints the usage when asked for or when an argument is not valid
+    ///
+    /// \param exitcode set to the exit code of the program when returning false
+    /// \return true if the program should continue
+    bool Parse(int argc, char ** argv, int& exitcode)
+    {
+        exitcode = 0;
+        int i = 1;
+        while(i < argc && argv[i][0] == '-' ) {
+            std::string arg = argv[i];
+            if( arg == "-h" || arg == "-?" || arg == "/?" || arg == "--help" || arg == "-help" ) {
+                PrintUsage();
+                return false;
+            }
+            std::vector<Option>::iterator itoption = _voptions.begin();
+            while(itoption != _voptions.end() && itoption->name != arg) {
+                ++itoption;
+            }
+            if( itoption == _voptions.end() || i+1 >= argc || !itoption->setvalue(argv[i+1]) ) {
+                RAVELOG_ERROR("invalid option %s\n", arg.c_str());
+                PrintUsage();
+                exitcode = 1;
+                return false;
+            }
+            i += 2;
+        }
+        _vpositional.assign(argv+i, argv+argc);
+        if( _positionalusage.size() == 0 && _vpositional.size() > 0 ) {
+            RAVELOG_ERROR("unexpected argument %s\n", _vpositional[0].c_str());
+            PrintUsage();
+            exitcode = 1;
+            return false;
+        }
+        return true;
+    }
+
+    void PrintUsage() const
+    {
+        std::stringstream ss;
+        ss << _programname;
+        for(std::vector<Option>::const_iterator itoption = _voptions.begin(); itoption != _voptions.end(); ++itoption) {
+            ss << " [" << itoption->name << " " << itoption->argname << "]";
+        }
+        if( _positionalusage.size() > 0 ) {
+            ss << " " << _positionalusage;
+        }
+        ss << std::endl;
+        for(std::vector<Option>::const_iterator itoption = _voptions.begin(); itoption != _voptions.end(); ++itoption) {
+            ss << "  " << itoption->name << " - " << itoption->description;
+            if( itoption->defaultvalue.size() > 0 ) {
+                ss << ", default is " << itoption->defaultvalue;
+            }
+            ss << std::endl;
+        }
+        RAVELOG_INFO(ss.str());
+    }
+
+    const std::vector<std::string>& GetPositionalArguments() const {
+        return _vpositional;
+    }
+
+private:
+    struct Option
+    {
+        std::string name, argname, description, defaultvalue;
+        boost::function<bool(const std::string&)> setvalue;
+    };
+
+    template <typename T>
+    static bool _SetValue(const std::string& s, T& value)
+    {
+        try {
+            value = boost::lexical_cast<T>(s);
+            return true;
+        }
+        catch(const boost::bad_lexical_cast&) {
+            return false;
+        }
+    }
+
+    std::string _programname, _positionalusage;
+    std::vector<Option> _voptions;
+    std::vector<std::string> _vpositional;
+};
+
+/** \brief A simple framework for the C++ benchmarks.
+
+    Parses the command line with \ref options, then initializes OpenRAVE and creates an environment around \ref run.
+    Errors are reported by throwing from run. In order to use, derive from it:
+
+    \code
+    class CollisionBenchmark : public OpenRAVEBenchmark
+    {
+    public:
+        CollisionBenchmark() : OpenRAVEBenchmark("orcollisionbenchmark"), numconfigs(1000) {
+            options.AddOption("--numconfigs", "num", "number of random configurations", numconfigs);
+        }
+        virtual void run() {
+            RobotBasePtr probot = LoadRobot("data/lab1.env.xml");
+            // insert the measurements here
+        }
+        int numconfigs;
+    };
+    \endcode
+ */
+class OpenRAVEBenchmark
+{
+public:
+    OpenRAVEBenchmark(const std::string& programname, const std::string& positionalusage="") : options(programname, positionalusage), _bLoadAllPlugins(true), _level(OpenRAVE::Level_Info) {
+    }
+    virtual ~OpenRAVEBenchmark() {
+    }
+
+    virtual int main(int argc, char ** argv)
+    {
+        int exitcode = 0;
+        if( !options.Parse(argc, argv, exitcode) ) {
+            return exitcode;
+        }
+        OpenRAVE::RaveInitialize(_bLoadAllPlugins, _level);
+        penv = OpenRAVE::RaveCreateEnvironment();
+        try {
+            run();
+        }
+        catch(const std::exception& ex) {
+            RAVELOG_ERROR("%s\n", ex.what());
+            exitcode = 1;
+        }
+        penv.reset();
+        OpenRAVE::RaveDestroy();
+        return exitcode;
+    }
+
+    virtual void run() = 0;
+
+protected:
+    /// \brief loads the scene and returns its first robot with the arm of the active manipulator as the active DOFs
+    OpenRAVE::RobotBasePtr LoadRobot(const std::string& scenefilename)
+    {
+        std::vector<OpenRAVE::RobotBasePtr> vrobots;
+        penv->Load(scenefilename);
+        penv->GetRobots(vrobots);
+        if( vrobots.size() == 0 ) {
+            throw OPENRAVE_EXCEPTION_FORMAT("no robots in %s", scenefilename, OpenRAVE::ORE_InvalidArguments);
+        }
+        OpenRAVE::EnvironmentMutex::scoped_lock lock(penv->GetMutex());
+        vrobots[0]->SetActiveDOFs(vrobots[0]->GetActiveManipulator()->GetArmIndices());
+        return vrobots[0];
+    }
+
+    /// \brief returns an interface created by the factory, throws if it is not available
+    template <typename T>
+    static boost::shared_ptr<T> CheckInterface(boost::shared_ptr<T> pinterface, const std::string& name)
+    {
+        if( !pinterface ) {
+            throw OPENRAVE_EXCEPTION_FORMAT("failed to create %s, check that its plugin is loaded", name, OpenRAVE::ORE_InvalidPlugin);
+        }
+        return pinterface;
+    }
+
+    /// \brief returns the output of a command of the interface
+    static std::string SendCommand(OpenRAVE::InterfaceBasePtr pinterface, const std::string& cmd)
+    {
+        std::stringstream sout, sinput(cmd);
+        if( !pinterface->SendCommand(sout, sinput) ) {
+            RAVELOG_WARN("command '%s' failed\n", cmd.c_str());
+        }
+        return sout.str();
+    }
+
+    /// \brief returns numsamples uniformly distributed values between vlower and vupper, one after the other
+    static std::vector< std::vector<OpenRAVE::dReal> > SampleUniform(OpenRAVE::SpaceSamplerBasePtr sampler, const std::vector<OpenRAVE::dReal>& vlower, const std::vector<OpenRAVE::dReal>& vupper, int numsamples)
+    {
+        std::vector<OpenRAVE::dReal> vsamples;
+        sampler->SampleSequence(vsamples, numsamples*vlower.size());
+        std::vector< std::vector<OpenRAVE::dReal> > vvalues(numsamples, vlower);
+        std::vector<OpenRAVE::dReal>::const_iterator itsample = vsamples.begin();
+        for(int isample = 0; isample < numsamples; ++isample) {
+            for(size_t i = 0; i < vlower.size(); ++i, ++itsample) {
+                vvalues[isample][i] = vlower[i] + *itsample*(vupper[i]-vlower[i]);
+            }
+        }
+        return vvalues;
+    }
+
+    /// \brief returns the seconds since starttime, at least 1ns so that the rates stay finite
+    static double GetElapsedTime(uint64_t starttime)
+    {
+        return std::max(1e-9, 1e-9*(OpenRAVE::utils::GetNanoPerformanceTime()-starttime));
+    }
+
+    /// \brief prints a line of the results to stderr, so that it is not mixed with the log
+    static void PrintResult(const boost::format& f)
+    {
+        std::cerr << f << std::endl;
+    }
+
+    CommandLineOptions options;
+    OpenRAVE::EnvironmentBasePtr penv;
+    bool _bLoadAllPlugins; ///< passed to RaveInitialize
+    int _level; ///< passed to RaveInitialize
+};
+
+} // end namespace cppexamples
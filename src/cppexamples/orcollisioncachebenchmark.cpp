@@ -0,0 +1,106 @@
+/** \example orcollisioncachebenchmark.cpp
+    \author Rosen Diankov
+
+    Measures the collision cache of the CacheChecker on random configurations of the active manipulator of the first
+    robot of a scene. The configurations are first checked with the internal checker alone, then with the CacheChecker
+    while it fills its cache, and then once more with the CacheChecker, where every check is answered by the cache.
+    A check that the cache cannot answer queries the cache, runs the internal checker and inserts the result, so the
+    time that the cache adds to such a check is the difference of the first two passes. The insertions per second are
+    computed from all the checks that tried to insert, not only from the ones that added a node.
+
+    The cache tree alone, at up to 1M nodes and without any collision checking, is measured by the timecachetree
+    executable of the configurationcache plugin.
+
+    Usage:
+    \verbatim
+    orcollisioncachebenchmark [--scene filename] [--checker name] [--numconfigs num] [--seed num]
+    \endverbatim
+
+    - \b --scene - the scene to load, default is data/lab1.env.xml
+    - \b --checker - the internal collision checker of the CacheChecker, default is ode
+    - \b --numconfigs - number of random configurations
+    - \b --seed - seed of the random configurations
+
+    <b>Full Example Code:</b>
+ */
+#include <openrave-core.h>
+#include <vector>
+#include <sstream>
+
+#include "orbenchmark.h"
+
+using namespace OpenRAVE;
+using namespace std;
+
+namespace cppexamples {
+
+class CollisionCacheBenchmark : public OpenRAVEBenchmark
+{
+public:
+    CollisionCacheBenchmark() : OpenRAVEBenchmark("orcollisioncachebenchmark"), scenefilename("data/lab1.env.xml"), checkername("ode"), numconfigs(20000), seed(0) {
+        options.AddOption("--scene", "filename", "the scene to load", scenefilename);
+        options.AddOption("--checker", "name", "the internal collision checker of the CacheChecker", checkername);
+        options.AddOption("--numconfigs", "num", "number of random configurations", numconfigs);
+        options.AddOption("--seed", "num", "seed of the random configurations", seed);
+    }
+
+    /// checks all the configurations and returns the elapsed seconds
+    static double Measure(CollisionCheckerBasePtr pchecker, RobotBasePtr probot, const std::vector< std::vector<dReal> >& vconfigs, int& numcollisions)
+    {
+        numcollisions = 0;
+        uint64_t starttime = utils::GetNanoPerformanceTime();
+        for(std::vector< std::vector<dReal> >::const_iterator itconfig = vconfigs.begin(); itconfig != vconfigs.end(); ++itconfig) {
+            probot->SetActiveDOFValues(*itconfig);
+            if( pchecker->CheckCollision(KinBodyConstPtr(probot)) ) {
+                ++numcollisions;
+            }
+        }
+        return GetElapsedTime(starttime);
+    }
+
+    virtual void run()
+    {
+        numconfigs = max(1, numconfigs);
+        RobotBasePtr probot = LoadRobot(scenefilename);
+        EnvironmentMutex::scoped_lock lock(penv->GetMutex());
+        CollisionCheckerBasePtr prawchecker = CheckInterface(RaveCreateCollisionChecker(penv, checkername), checkername);
+        CollisionCheckerBasePtr pcachechecker = CheckInterface(RaveCreateCollisionChecker(penv, "CacheChecker " + checkername), "CacheChecker");
+        SpaceSamplerBasePtr sampler = CheckInterface(RaveCreateSpaceSampler(penv, "mt19937"), "mt19937");
+        prawchecker->InitEnvironment();
+        penv->SetCollisionChecker(pcachechecker);
+        SendCommand(pcachechecker, "TrackRobotState " + probot->GetName());
+
+        std::vector<dReal> vlower, vupper;
+        probot->GetActiveDOFLimits(vlower, vupper);
+        sampler->SetSeed(seed);
+        std::vector< std::vector<dReal> > vconfigs = SampleUniform(sampler, vlower, vupper, numconfigs);
+
+        int numrawcollisions = 0, numfillcollisions = 0, numhitcollisions = 0;
+        double rawtime = Measure(prawchecker, probot, vconfigs, numrawcollisions);
+        SendCommand(pcachechecker, "GetCacheStatistics");
+        double filltime = Measure(pcachechecker, probot, vconfigs, numfillcollisions);
+        int numchecks = 0, numcollisionhits = 0, numfreehits = 0, numnodes = 0;
+        std::stringstream(SendCommand(pcachechecker, "GetCacheStatistics")) >> numchecks >> numcollisionhits >> numfreehits >> numnodes;
+        double hittime = Measure(pcachechecker, probot, vconfigs, numhitcollisions);
+
+        // the cache answers the checks without inserting once it is filled
+        int numinserts = numchecks - numcollisionhits - numfreehits;
+        PrintResult(boost::format("%d configurations of %s, %d nodes in the cache")%numconfigs%probot->GetName()%numnodes);
+        PrintResult(boost::format("%s checks per second: %.1f")%checkername%(numconfigs/rawtime));
+        PrintResult(boost::format("checks per second while filling: %.1f, %d of them queried and inserted into the cache at %.1f per second")%(numconfigs/filltime)%numinserts%(filltime > rawtime ? numinserts/(filltime-rawtime) : 0));
+        PrintResult(boost::format("checks per second answered by the cache: %.1f")%(numconfigs/hittime));
+        PrintResult(boost::format("collisions found by the %s checker %d, while filling %d, by the cache %d")%checkername%numrawcollisions%numfillcollisions%numhitcollisions);
+    }
+
+    std::string scenefilename, checkername;
+    int numconfigs;
+    uint32_t seed;
+};
+
+} // end namespace cppexamples
+
+int main(int argc, char ** argv)
+{
+    cppexamples::CollisionCacheBenchmark benchmark;
+    return benchmark.main(argc,argv);
+}
@@ -0,0 +1,167 @@
+/** \example orforceclosurebenchmark.cpp
+    \author Rosen Diankov
+
+    Measures the force closure analysis of the grasper module on random contact sets in grasps/second, once with qhull
+    and once with the reentrant hull. The contacts lie on a sphere of 5cm with normals tilted from the center, so that
+    some of the grasps are in force closure. Every contact is replaced by the edges of its friction cone and the wrench
+    space hull is computed with the ConvexHull command of the grasper, a grasp is in force closure if the origin is
+    strictly inside the hull. qhull keeps its state in globals, so its calls are serialized, while the reentrant hull
+    can run on all threads at once. The grasps are analyzed with 1, 2, 4, ... up to the given number of threads.
+
+    Usage:
+    \verbatim
+    orforceclosurebenchmark [--numgrasps num] [--numcontacts num] [--friction mu] [--maxthreads num] [--seed num]
+    \endverbatim
+
+    - \b --numgrasps - number of random grasps
+    - \b --numcontacts - number of contacts of every grasp
+    - \b --friction - friction coefficient of the contacts
+    - \b --maxthreads - largest number of threads
+    - \b --seed - seed of the random contacts
+
+    <b>Full Example Code:</b>
+ */
+#include <openrave-core.h>
+#include <vector>
+#include <sstream>
+#include <iomanip>
+#include <limits>
+
+#include <boost/thread/thread.hpp>
+#include <boost/bind.hpp>
+
+#include "orbenchmark.h"
+
+using namespace OpenRAVE;
+using namespace std;
+
+namespace cppexamples {
+
+class ForceClosureBenchmark : public OpenRAVEBenchmark
+{
+public:
+    ForceClosureBenchmark() : OpenRAVEBenchmark("orforceclosurebenchmark"), numgrasps(200), numcontacts(4), maxthreads(boost::thread::hardware_concurrency()), friction(0.4), seed(0) {
+        options.AddOption("--numgrasps", "num", "number of random grasps", numgrasps);
+        options.AddOption("--numcontacts", "num", "number of contacts of every grasp", numcontacts);
+        options.AddOption("--friction", "mu", "friction coefficient of the contacts", friction);
+        options.AddOption("--maxthreads", "num", "largest number of threads", maxthreads);
+        options.AddOption("--seed", "num", "seed of the random contacts", seed);
+    }
+
+    /// returns the ConvexHull command computing the 6D wrench space hull of the contacts with friction cones of numconepoints edges
+    std::string GetWrenchHullCommand(const std::vector<CollisionReport::CONTACT>& contacts, int numconepoints, bool breentrant)
+    {
+        std::stringstream ss;
+        ss << std::setprecision(std::numeric_limits<dReal>::digits10+1);
+        ss << "ConvexHull points " << contacts.size()*numconepoints << " 6 ";
+        for(std::vector<CollisionReport::CONTACT>::const_iterator itcontact = contacts.begin(); itcontact != contacts.end(); ++itcontact) {
+            // find a coordinate system where z is the normal
+            TransformMatrix torient = matrixFromQuat(quatRotateDirection(Vector(0,0,1),itcontact->norm));
+            Vector right(torient.m[0],torient.m[4],torient.m[8]);
+            Vector up(torient.m[1],torient.m[5],torient.m[9]);
+            for(int i = 0; i < numconepoints; ++i) {
+                dReal fang = 2*PI*i/numconepoints;
+                Vector norm = (itcontact->norm + friction*RaveSin(fang)*right + friction*RaveCos(fang)*up).normalize3();
+                Vector torque = itcontact->pos.cross(norm);
+                ss << norm.x << " " << norm.y << " " << norm.z << " " << torque.x << " " << torque.y << " " << torque.z << " ";
+            }
+        }
+        ss << "returnplanes 1 returnfaces 0 returntriangles 0 returnvolume 0 reentrant " << breentrant;
+        return ss.str();
+    }
+
+    /// analyzes grasps ithread, ithread+numthreads, ... and stores whether they are in force closure
+    void AnalyzeThread(ModuleBasePtr pgrasper, const std::vector<std::string>* pvcommands, int ithread, int numthreads, std::vector<int>* pvforceclosure)
+    {
+        for(size_t igrasp = ithread; igrasp < pvcommands->size(); igrasp += numthreads) {
+            std::stringstream sout, sinput(pvcommands->at(igrasp));
+            int bforceclosure = 0;
+            if( pgrasper->SendCommand(sout, sinput) ) {
+                // the origin is inside the hull if all plane offsets are negative
+                int numplanes = 0;
+                sout >> numplanes;
+                bforceclosure = numplanes > 0;
+                for(int iplane = 0; iplane < numplanes; ++iplane) {
+                    dReal plane[7];
+                    for(int j = 0; j < 7; ++j) {
+                        sout >> plane[j];
+                    }
+                    if( plane[6] > -1e-15 ) {
+                        bforceclosure = 0;
+                    }
+                }
+            }
+            pvforceclosure->at(igrasp) = bforceclosure;
+        }
+    }
+
+    /// analyzes all the grasps with numthreads threads and returns the elapsed seconds
+    double Measure(ModuleBasePtr pgrasper, const std::vector<std::string>& vcommands, int numthreads, std::vector<int>& vforceclosure)
+    {
+        uint64_t starttime = utils::GetNanoPerformanceTime();
+        boost::thread_group threads;
+        for(int ithread = 0; ithread < numthreads; ++ithread) {
+            threads.create_thread(boost::bind(&ForceClosureBenchmark::AnalyzeThread, this, pgrasper, &vcommands, ithread, numthreads, &vforceclosure));
+        }
+        threads.join_all();
+        return GetElapsedTime(starttime);
+    }
+
+    virtual void run()
+    {
+        numgrasps = max(1, numgrasps);
+        numcontacts = max(1, numcontacts);
+        maxthreads = max(1, maxthreads);
+        ModuleBasePtr pgrasper = CheckInterface(RaveCreateModule(penv, "grasper"), "grasper");
+        SpaceSamplerBasePtr sampler = CheckInterface(RaveCreateSpaceSampler(penv, "mt19937"), "mt19937");
+        penv->AddModule(pgrasper, "");
+
+        // contacts on a sphere of 5cm with normals tilted from the center
+        sampler->SetSeed(seed);
+        std::vector<dReal> vsamples;
+        sampler->SampleSequence(vsamples, numgrasps*numcontacts*6);
+        std::vector<dReal>::const_iterator itsample = vsamples.begin();
+        std::vector<std::string> vqhullcommands(numgrasps), vcommands(numgrasps);
+        std::vector<CollisionReport::CONTACT> contacts(numcontacts);
+        for(int igrasp = 0; igrasp < numgrasps; ++igrasp) {
+            for(std::vector<CollisionReport::CONTACT>::iterator itcontact = contacts.begin(); itcontact != contacts.end(); ++itcontact) {
+                Vector dir(2*itsample[0]-1, 2*itsample[1]-1, 2*itsample[2]-1);
+                Vector tilt(2*itsample[3]-1, 2*itsample[4]-1, 2*itsample[5]-1);
+                itsample += 6;
+                dir.normalize3();
+                itcontact->pos = 0.05*dir;
+                itcontact->norm = (-dir + tilt).normalize3();
+            }
+            vqhullcommands[igrasp] = GetWrenchHullCommand(contacts, 8, false);
+            vcommands[igrasp] = GetWrenchHullCommand(contacts, 8, true);
+        }
+
+        std::vector<int> vqhullforceclosure(numgrasps), vforceclosure(numgrasps);
+        PrintResult(boost::format("%d grasps with %d contacts, grasps per second")%numgrasps%numcontacts);
+        PrintResult(boost::format("%8s %12s %12s")%"threads"%"qhull"%"reentrant");
+        for(int numthreads = 1; numthreads <= maxthreads; numthreads = numthreads < maxthreads && 2*numthreads > maxthreads ? maxthreads : 2*numthreads) {
+            double qhulltime = Measure(pgrasper, vqhullcommands, numthreads, vqhullforceclosure);
+            double reentranttime = Measure(pgrasper, vcommands, numthreads, vforceclosure);
+            PrintResult(boost::format("%8d %12.1f %12.1f")%numthreads%(numgrasps/qhulltime)%(numgrasps/reentranttime));
+        }
+
+        int numforceclosure = 0, numdifferent = 0;
+        for(int igrasp = 0; igrasp < numgrasps; ++igrasp) {
+            numforceclosure += vforceclosure[igrasp];
+            numdifferent += vforceclosure[igrasp] != vqhullforceclosure[igrasp];
+        }
+        PrintResult(boost::format("%d grasps in force closure, the hulls disagree on %d grasps")%numforceclosure%numdifferent);
+    }
+
+    int numgrasps, numcontacts, maxthreads;
+    dReal friction;
+    uint32_t seed;
+};
+
+} // end namespace cppexamples
+
+int main(int argc, char ** argv)
+{
+    cppexamples::ForceClosureBenchmark benchmark;
+    return benchmark.main(argc,argv);
+}
@@ -0,0 +1,137 @@
+/** \example orlazybirrtbenchmark.cpp
+    \author Rosen Diankov
+
+    Compares the BiRRT planner checking every edge when it is added with the BiRRT planner checking the edges lazily,
+    where only the edges of a path that connects the two trees are checked. The queries are random collision-free
+    initial and goal configurations of the active manipulator of the first robot of a scene and every query is planned
+    several times with different seeds of the planner. Every returned path is checked again edge by edge, so a lazy
+    planner that returns an invalid path shows up in the number of invalid paths.
+
+    Usage:
+    \verbatim
+    orlazybirrtbenchmark [--scene filename] [--numqueries num] [--numruns num] [--seed num]
+    \endverbatim
+
+    - \b --scene - the scene to load, default is data/lab1.env.xml
+    - \b --numqueries - number of random queries
+    - \b --numruns - number of plans of every query with different seeds of the planner
+    - \b --seed - seed of the random queries
+
+    <b>Full Example Code:</b>
+ */
+#include <openrave-core.h>
+#include <openrave/plannerparameters.h>
+#include <vector>
+#include <sstream>
+
+#include "orbenchmark.h"
+
+using namespace OpenRAVE;
+using namespace std;
+
+namespace cppexamples {
+
+class LazyBirrtBenchmark : public OpenRAVEBenchmark
+{
+public:
+    LazyBirrtBenchmark() : OpenRAVEBenchmark("orlazybirrtbenchmark"), scenefilename("data/lab1.env.xml"), numqueries(10), numruns(5), seed(0) {
+        options.AddOption("--scene", "filename", "the scene to load", scenefilename);
+        options.AddOption("--numqueries", "num", "number of random queries", numqueries);
+        options.AddOption("--numruns", "num", "number of plans of every query with different seeds of the planner", numruns);
+        options.AddOption("--seed", "num", "seed of the random queries", seed);
+    }
+
+    /// returns true if all the edges of the path satisfy the constraints of the parameters
+    static bool CheckPath(PlannerBase::PlannerParametersConstPtr params, TrajectoryBasePtr ptraj)
+    {
+        std::vector<dReal> vwaypoints;
+        ptraj->GetWaypoints(0, ptraj->GetNumWaypoints(), vwaypoints, params->_configurationspecification);
+        int dof = params->GetDOF();
+        std::vector<dReal> q0(dof), q1(dof);
+        for(size_t iwaypoint = 1; iwaypoint < ptraj->GetNumWaypoints(); ++iwaypoint) {
+            std::copy(vwaypoints.begin()+(iwaypoint-1)*dof, vwaypoints.begin()+iwaypoint*dof, q0.begin());
+            std::copy(vwaypoints.begin()+iwaypoint*dof, vwaypoints.begin()+(iwaypoint+1)*dof, q1.begin());
+            if( params->CheckPathAllConstraints(q0, q1, std::vector<dReal>(), std::vector<dReal>(), 0, IT_OpenStart) != 0 ) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    virtual void run()
+    {
+        numqueries = max(1, numqueries);
+        numruns = max(1, numruns);
+        RobotBasePtr probot = LoadRobot(scenefilename);
+        EnvironmentMutex::scoped_lock lock(penv->GetMutex());
+        SpaceSamplerBasePtr sampler = CheckInterface(RaveCreateSpaceSampler(penv, "mt19937"), "mt19937");
+        CheckInterface(RaveCreatePlanner(penv, "BiRRT"), "BiRRT");
+        std::vector<dReal> vlower, vupper;
+        probot->GetActiveDOFLimits(vlower, vupper);
+        sampler->SetSeed(seed);
+
+        // sample all the queries before the time is measured
+        std::vector< std::vector<dReal> > vconfigs;
+        while(vconfigs.size() < 2*(size_t)numqueries) {
+            std::vector<dReal> vsample = SampleUniform(sampler, vlower, vupper, 1).at(0);
+            probot->SetActiveDOFValues(vsample);
+            if( !penv->CheckCollision(KinBodyConstPtr(probot)) && !probot->CheckSelfCollision() ) {
+                vconfigs.push_back(vsample);
+            }
+        }
+
+        TrajectoryBasePtr ptraj = RaveCreateTrajectory(penv, "");
+        int numsucceeded[2] = {0, 0}, numinvalid[2] = {0, 0}, numedgechecks = 0, numrepairs = 0;
+        double plantime[2] = {0, 0};
+        for(int iquery = 0; iquery < numqueries; ++iquery) {
+            for(int irun = 0; irun < numruns; ++irun) {
+                for(int ilazy = 0; ilazy < 2; ++ilazy) {
+                    probot->SetActiveDOFValues(vconfigs[2*iquery]);
+                    RRTParametersPtr params(new RRTParameters());
+                    params->SetRobotActiveJoints(probot);
+                    params->vinitialconfig = vconfigs[2*iquery];
+                    params->vgoalconfig = vconfigs[2*iquery+1];
+                    params->_nRandomGeneratorSeed = irun;
+                    params->_sPostProcessingPlanner = "";
+                    PlannerBasePtr planner = RaveCreatePlanner(penv, "BiRRT");
+                    SendCommand(planner, ilazy ? "SetLazyCollisionChecking 1" : "SetLazyCollisionChecking 0");
+                    ptraj->Init(params->_configurationspecification);
+                    uint64_t starttime = utils::GetNanoPerformanceTime();
+                    bool bsuccess = planner->InitPlan(probot, params) && planner->PlanPath(ptraj) == PS_HasSolution;
+                    plantime[ilazy] += GetElapsedTime(starttime);
+                    if( bsuccess ) {
+                        ++numsucceeded[ilazy];
+                        if( !CheckPath(params, ptraj) ) {
+                            ++numinvalid[ilazy];
+                        }
+                    }
+                    if( ilazy ) {
+                        int nedgechecks = 0, nrepairs = 0;
+                        std::stringstream(SendCommand(planner, "GetLazyStatistics")) >> nedgechecks >> nrepairs;
+                        numedgechecks += nedgechecks;
+                        numrepairs += nrepairs;
+                    }
+                }
+            }
+        }
+
+        int numplans = numqueries*numruns;
+        double eagertime = plantime[0]/numplans, lazytime = plantime[1]/numplans;
+        PrintResult(boost::format("%d queries of %s with %d dofs, %d plans each")%numqueries%probot->GetName()%vlower.size()%numruns);
+        PrintResult(boost::format("eager: succeeded %d/%d, invalid paths %d, average time %.4fs")%numsucceeded[0]%numplans%numinvalid[0]%eagertime);
+        PrintResult(boost::format("lazy: succeeded %d/%d, invalid paths %d, average time %.4fs")%numsucceeded[1]%numplans%numinvalid[1]%lazytime);
+        PrintResult(boost::format("lazy speedup %.2f, average edges checked %.1f, average repairs %.1f")%(eagertime/lazytime)%(double(numedgechecks)/numplans)%(double(numrepairs)/numplans));
+    }
+
+    std::string scenefilename;
+    int numqueries, numruns;
+    uint32_t seed;
+};
+
+} // end namespace cppexamples
+
+int main(int argc, char ** argv)
+{
+    cppexamples::LazyBirrtBenchmark benchmark;
+    return benchmark.main(argc,argv);
+}
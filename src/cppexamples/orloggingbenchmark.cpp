@@ -0,0 +1,134 @@
+/** \example orloggingbenchmark.cpp
+    \author Rosen Diankov
+
+    Measures the per-call cost of the RAVELOG_* macros on the calling thread with the synchronous and the asynchronous
+    logging backends, both for a disabled level and for an enabled level. The timings are printed to stderr, so
+    redirect stdout to keep the terminal from dominating the synchronous numbers. The background thread of the
+    asynchronous backend is held off while measuring, instead every thread writes the queued messages after each chunk
+    of calls outside of the timed section. The ring buffers have to hold one chunk, otherwise the numbers include drops.
+
+    Usage:
+    \verbatim
+    orloggingbenchmark [--iterations num] [--chunk num] [--threads num] [--buffersize bytes] > /dev/null
+    \endverbatim
+
+    - \b --iterations - number of log calls per thread and measurement
+    - \b --chunk - number of log calls between two writes of the queued messages
+    - \b --threads - number of threads logging at the same time
+    - \b --buffersize - size of every per-thread ring buffer of the asynchronous backend
+
+    <b>Full Example Code:</b>
+ */
+#include <openrave-core.h>
+#include <vector>
+
+#include <boost/thread/thread.hpp>
+#include <boost/bind.hpp>
+
+#include "orbenchmark.h"
+
+using namespace OpenRAVE;
+using namespace std;
+
+namespace cppexamples {
+
+class LoggingBenchmark : public OpenRAVEBenchmark
+{
+public:
+    enum BenchmarkCall {
+        BC_Printf=0,
+        BC_Format=1,
+        BC_DisabledPrintf=2,
+        BC_DisabledFormat=3,
+    };
+
+    LoggingBenchmark() : OpenRAVEBenchmark("orloggingbenchmark"), numiterations(100000), chunksize(1000), numthreads(1), buffersize(1<<20) {
+        options.AddOption("--iterations", "num", "number of log calls per thread and measurement", numiterations);
+        options.AddOption("--chunk", "num", "number of log calls between two writes of the queued messages", chunksize);
+        options.AddOption("--threads", "num", "number of threads logging at the same time", numthreads);
+        options.AddOption("--buffersize", "bytes", "size of every per-thread ring buffer of the asynchronous backend", buffersize);
+        // only the logging is measured
+        _bLoadAllPlugins = false;
+        _level = Level_Debug;
+    }
+
+    /// logs the same message numiterations times and returns the average time of a call in nanoseconds
+    ///
+    /// the pending messages are written every chunksize calls outside of the timed sections
+    void LogThread(BenchmarkCall call, double* pnanoseconds)
+    {
+        std::string name = "manip";
+        dReal value = 0.5;
+        uint64_t totaltime = 0;
+        for(int ichunk = 0; ichunk < numiterations; ichunk += chunksize) {
+            int chunkend = min(numiterations, ichunk + chunksize);
+            uint64_t starttime = utils::GetNanoPerformanceTime();
+            for(int i = ichunk; i < chunkend; ++i) {
+                switch(call) {
+                case BC_Printf:
+                    RAVELOG_DEBUG("iteration %d of %s, error=%f\n", i, name.c_str(), value);
+                    break;
+                case BC_Format:
+                    RAVELOG_DEBUG_FORMAT("iteration %d of %s, error=%f", i%name%value);
+                    break;
+                case BC_DisabledPrintf:
+                    RAVELOG_VERBOSE("iteration %d of %s, error=%f\n", i, name.c_str(), value);
+                    break;
+                case BC_DisabledFormat:
+                    RAVELOG_VERBOSE_FORMAT("iteration %d of %s, error=%f", i%name%value);
+                    break;
+                }
+            }
+            totaltime += utils::GetNanoPerformanceTime() - starttime;
+            RaveFlushLog();
+        }
+        *pnanoseconds = (double)totaltime/numiterations;
+    }
+
+    /// runs the call on all threads and returns the average time of a call in nanoseconds
+    double Measure(BenchmarkCall call)
+    {
+        std::vector<double> vnanoseconds(numthreads, 0);
+        boost::thread_group threads;
+        for(int ithread = 0; ithread < numthreads; ++ithread) {
+            threads.create_thread(boost::bind(&LoggingBenchmark::LogThread, this, call, &vnanoseconds[ithread]));
+        }
+        threads.join_all();
+        double total = 0;
+        for(int ithread = 0; ithread < numthreads; ++ithread) {
+            total += vnanoseconds[ithread];
+        }
+        return total/numthreads;
+    }
+
+    virtual void run()
+    {
+        chunksize = max(1, chunksize);
+        numthreads = max(1, numthreads);
+        const char* callnames[] = { "printf enabled", "format enabled", "printf disabled", "format disabled" };
+        PrintResult(boost::format("%d threads x %d calls, ns per call")%numthreads%numiterations);
+        PrintResult(boost::format("%-18s %12s %12s")%"call"%"sync"%"async");
+        for(int icall = 0; icall < 4; ++icall) {
+            RaveSetAsyncLogging(false);
+            double synctime = Measure((BenchmarkCall)icall);
+            RaveSetAsyncLogging(true, buffersize, 3600000);
+            double asynctime = Measure((BenchmarkCall)icall);
+            PrintResult(boost::format("%-18s %12.1f %12.1f")%callnames[icall]%synctime%asynctime);
+        }
+        RaveSetAsyncLogging(false);
+
+        AsyncLoggingStatistics stats = RaveGetAsyncLoggingStatistics();
+        PrintResult(boost::format("async: %d logged, %d dropped, %d truncated, %d flushes")%stats.numlogged%stats.numdropped%stats.numtruncated%stats.numflushes);
+    }
+
+    int numiterations, chunksize, numthreads;
+    uint32_t buffersize;
+};
+
+} // end namespace cppexamples
+
+int main(int argc, char ** argv)
+{
+    cppexamples::LoggingBenchmark benchmark;
+    return benchmark.main(argc,argv);
+}
@@ -0,0 +1,107 @@
+/** \example orparabolicinterpolationbenchmark.cpp
+    \author Rosen Diankov
+
+    Measures the parabolic interpolation between arbitrary positions and velocities of the active manipulator of the
+    first robot of a scene. Every trajectory has two random waypoints within the joint limits with random velocities of
+    at most 80% of the velocity limits and is retimed by parabolictrajectoryretimer2 with the velocities kept, which
+    interpolates the waypoints with the minimum-time ND interpolation of the smoothers and then writes it out with the
+    fixed-duration interpolation. All the waypoints are sampled before the time is measured.
+
+    Usage:
+    \verbatim
+    orparabolicinterpolationbenchmark [--scene filename] [--planner name] [--numtrajectories num] [--seed num]
+    \endverbatim
+
+    - \b --scene - the scene to load, default is data/lab1.env.xml
+    - \b --planner - the retimer, default is parabolictrajectoryretimer2
+    - \b --numtrajectories - number of random trajectories
+    - \b --seed - seed of the random waypoints
+
+    <b>Full Example Code:</b>
+ */
+#include <openrave-core.h>
+#include <openrave/plannerparameters.h>
+#include <vector>
+
+#include "orbenchmark.h"
+
+using namespace OpenRAVE;
+using namespace std;
+
+namespace cppexamples {
+
+class ParabolicInterpolationBenchmark : public OpenRAVEBenchmark
+{
+public:
+    ParabolicInterpolationBenchmark() : OpenRAVEBenchmark("orparabolicinterpolationbenchmark"), scenefilename("data/lab1.env.xml"), plannername("parabolictrajectoryretimer2"), numtrajectories(20000), seed(0) {
+        options.AddOption("--scene", "filename", "the scene to load", scenefilename);
+        options.AddOption("--planner", "name", "the retimer to measure", plannername);
+        options.AddOption("--numtrajectories", "num", "number of random trajectories", numtrajectories);
+        options.AddOption("--seed", "num", "seed of the random trajectories", seed);
+    }
+
+    virtual void run()
+    {
+        numtrajectories = max(1, numtrajectories);
+        RobotBasePtr probot = LoadRobot(scenefilename);
+        EnvironmentMutex::scoped_lock lock(penv->GetMutex());
+        PlannerBasePtr planner = CheckInterface(RaveCreatePlanner(penv, plannername), plannername);
+        SpaceSamplerBasePtr sampler = CheckInterface(RaveCreateSpaceSampler(penv, "mt19937"), "mt19937");
+        TrajectoryTimingParametersPtr params(new TrajectoryTimingParameters());
+        params->SetRobotActiveJoints(probot);
+        params->_sPostProcessingPlanner = "";
+        params->_hasvelocities = true;
+        if( !planner->InitPlan(probot, params) ) {
+            throw OPENRAVE_EXCEPTION_FORMAT("failed to init the %s planner", plannername, ORE_Failed);
+        }
+
+        // every waypoint holds the positions followed by the velocities
+        ConfigurationSpecification spec = probot->GetActiveConfigurationSpecification();
+        spec.AddDerivativeGroups(1, false);
+        size_t ndof = params->GetDOF();
+        std::vector<dReal> vsamples;
+        sampler->SetSeed(seed);
+        sampler->SampleSequence(vsamples, numtrajectories*4*ndof);
+        std::vector<dReal>::iterator itsample = vsamples.begin();
+        for(int itraj = 0; itraj < 2*numtrajectories; ++itraj) {
+            for(size_t idof = 0; idof < ndof; ++idof, ++itsample) {
+                *itsample = params->_vConfigLowerLimit[idof] + *itsample*(params->_vConfigUpperLimit[idof]-params->_vConfigLowerLimit[idof]);
+            }
+            for(size_t idof = 0; idof < ndof; ++idof, ++itsample) {
+                *itsample = 0.8*(2*(*itsample)-1)*params->_vConfigVelocityLimit[idof];
+            }
+        }
+
+        TrajectoryBasePtr ptraj = RaveCreateTrajectory(penv, "");
+        std::vector<dReal> vwaypoints;
+        int numsucceeded = 0;
+        dReal totalduration = 0;
+        uint64_t starttime = utils::GetNanoPerformanceTime();
+        for(int itraj = 0; itraj < numtrajectories; ++itraj) {
+            vwaypoints.assign(vsamples.begin()+itraj*4*ndof, vsamples.begin()+(itraj+1)*4*ndof);
+            ptraj->Init(spec);
+            ptraj->Insert(0, vwaypoints);
+            if( planner->PlanPath(ptraj) == PS_HasSolution ) {
+                ++numsucceeded;
+                totalduration += ptraj->GetDuration();
+            }
+        }
+        double elapsedtime = GetElapsedTime(starttime);
+
+        PrintResult(boost::format("%d trajectories of %s with %d dofs")%numtrajectories%probot->GetName()%ndof);
+        PrintResult(boost::format("%s retimings per second: %.1f")%plannername%(numtrajectories/elapsedtime));
+        PrintResult(boost::format("retimings succeeded %d, their total duration %.6fs")%numsucceeded%totalduration);
+    }
+
+    std::string scenefilename, plannername;
+    int numtrajectories;
+    uint32_t seed;
+};
+
+} // end namespace cppexamples
+
+int main(int argc, char ** argv)
+{
+    cppexamples::ParabolicInterpolationBenchmark benchmark;
+    return benchmark.main(argc,argv);
+}
@@ -0,0 +1,127 @@
+/** \example orstatereplay.cpp
+    \author Rosen Diankov
+
+    Plays back a body state log written by the StateRecorder module of the logging plugin into an environment loaded
+    from a scene file. The bodies of the scene are matched to the recorded bodies by name. The log can be played at
+    any multiple of the recorded speed, or as fast as possible for offline analysis when no viewer is shown.
+
+    Usage:
+    \verbatim
+    orstatereplay [--scene filename] [--speed s] [--start t] [--end t] [--viewer name] logfilename
+    \endverbatim
+
+    - \b --scene - The filename of the scene containing the recorded bodies.
+    - \b --speed - Multiple of the recorded speed, 0 plays as fast as possible. Default is 1.
+    - \b --start - Time in seconds since the start of the recording to start playing at, negative starts at the beginning.
+    - \b --end - Time in seconds since the start of the recording to stop playing at, negative plays to the end.
+    - \b --viewer - Shows the playback in a viewer.
+
+    Example:
+    \verbatim
+    ./orstatereplay --scene data/lab1.env.xml --speed 4 --viewer qtcoin lab1.state
+    \endverbatim
+
+    The log can be recorded with:
+    \verbatim
+    staterecorder = RaveCreateModule(env,'staterecorder')
+    env.Add(staterecorder)
+    staterecorder.SendCommand('Start rate 100 filename lab1.state\n')
+    \endverbatim
+
+    <b>Full Example Code:</b>
+ */
+#include <openrave-core.h>
+#include <vector>
+#include <sstream>
+
+#include <boost/thread/thread.hpp>
+#include <boost/bind.hpp>
+
+#include "orbenchmark.h"
+
+using namespace OpenRAVE;
+using namespace std;
+
+namespace cppexamples {
+
+class StateReplay : public OpenRAVEBenchmark
+{
+public:
+    StateReplay() : OpenRAVEBenchmark("orstatereplay", "logfilename"), speed(1), starttime(-1), endtime(-1) {
+        options.AddOption("--scene", "filename", "the scene containing the recorded bodies", scenefilename);
+        options.AddOption("--speed", "s", "multiple of the recorded speed, 0 plays as fast as possible", speed);
+        options.AddOption("--start", "t", "seconds since the start of the recording to start playing at", starttime);
+        options.AddOption("--end", "t", "seconds since the start of the recording to stop playing at", endtime);
+        options.AddOption("--viewer", "name", "shows the playback in a viewer", viewername);
+    }
+
+    void PlayThread(ModuleBasePtr replayer, ViewerBasePtr viewer)
+    {
+        stringstream ss;
+        ss << "Play wait 1 speed " << speed << " start " << starttime << " end " << endtime;
+        stringstream sout, sinput(ss.str());
+        if( replayer->SendCommand(sout, sinput) ) {
+            unsigned long long numframes = 0;
+            double seconds = 0;
+            sout >> numframes >> seconds;
+            RAVELOG_INFO("played %llu frames in %fs\n", numframes, seconds);
+        }
+        else {
+            RAVELOG_ERROR("failed to play\n");
+        }
+        if( !!viewer ) {
+            viewer->quitmainloop();
+        }
+    }
+
+    virtual void run()
+    {
+        if( options.GetPositionalArguments().size() != 1 ) {
+            options.PrintUsage();
+            throw OPENRAVE_EXCEPTION_FORMAT0("expecting one log filename", ORE_InvalidArguments);
+        }
+        std::string logfilename = options.GetPositionalArguments().at(0);
+        if( scenefilename.size() > 0 && !penv->Load(scenefilename) ) {
+            throw OPENRAVE_EXCEPTION_FORMAT("failed to load scene %s", scenefilename, ORE_InvalidArguments);
+        }
+
+        ModuleBasePtr replayer = CheckInterface(RaveCreateModule(penv, "statereplayer"), "statereplayer");
+        penv->Add(replayer);
+        stringstream sout, sinput("Open " + logfilename);
+        if( !replayer->SendCommand(sout, sinput) ) {
+            throw OPENRAVE_EXCEPTION_FORMAT("failed to open %s", logfilename, ORE_InvalidArguments);
+        }
+        size_t numchunks = 0, numframes = 0;
+        double duration = 0;
+        sout >> numchunks >> numframes >> duration;
+        RAVELOG_INFO("%s: %d frames in %d chunks, %fs\n", logfilename.c_str(), (int)numframes, (int)numchunks, duration);
+
+        ViewerBasePtr viewer;
+        if( viewername.size() > 0 ) {
+            viewer = RaveCreateViewer(penv, viewername);
+            if( !viewer ) {
+                RAVELOG_WARN("failed to create viewer %s\n", viewername.c_str());
+            }
+            else {
+                penv->Add(viewer);
+            }
+        }
+
+        boost::thread thplay(boost::bind(&StateReplay::PlayThread, this, replayer, viewer));
+        if( !!viewer ) {
+            viewer->main(true); // the viewer has to run in the main thread, quits when playback is done
+        }
+        thplay.join();
+    }
+
+    std::string scenefilename, viewername;
+    double speed, starttime, endtime;
+};
+
+} // end namespace cppexamples
+
+int main(int argc, char ** argv)
+{
+    cppexamples::StateReplay replay;
+    return replay.main(argc,argv);
+}
@@ -126,6 +126,12 @@ public:
         _bInit = false;
         _bEnableSimulation = true;     // need to start by default
         _unit = std::make_pair("meter",1.0); //default unit settings
+        _nSimulationStepThreads = 1;
+        _ResetSchedulerStatistics();
+        _nNextStepSensor = 0;
+        _nStepSensorsRemaining = 0;
+        _fStepSensorsTimeStep = 0;
+        _bShutdownStepWorkers = false;
 
         _handlegenericrobot = RaveRegisterInterface(PT_Robot,"GenericRobot", RaveGetInterfaceHash(PT_Robot), GetHash(), CreateGenericRobot);
         _handlegenerictrajectory = RaveRegisterInterface(PT_Trajectory,"GenericTrajectory", RaveGetInterfaceHash(PT_Trajectory), GetHash(), CreateGenericTrajectory);
@@ -225,6 +231,7 @@ public:
 
         RAVELOG_VERBOSE("Environment destructor\n");
         _StopSimulationThread();
+        _StopStepWorkers();
 
         // destroy the modules (their destructors could attempt to lock environment, so have to do it before global lock)
         // however, do not clear the _listModules yet
@@ -1033,8 +1040,14 @@ public:
         uint64_t step = (uint64_t)ceil(1000000.0 * (double)fTimeStep);
         fTimeStep = (dReal)((double)step * 0.000001);
 
+        SimulationStepTimes steptimes;
+        uint64_t starttime = utils::GetMicroTime(), stagetime = starttime;
+
         // call the physics first to get forces
         _pPhysicsEngine->SimulateStep(fTimeStep);
+        uint64_t curtime = utils::GetMicroTime();
+        steptimes.physics = curtime - stagetime;
+        stagetime = curtime;
 
         // make a copy instead of locking the mutex pointer since will be calling into user functions
         vector<KinBodyPtr> vecbodies;
@@ -1054,24 +1067,110 @@ public:
                 (*it)->SimulationStep(fTimeStep);
             }
         }
+        curtime = utils::GetMicroTime();
+        steptimes.bodies = curtime - stagetime;
+        stagetime = curtime;
+
         FOREACH(itmodule, listModules) {
             itmodule->first->SimulationStep(fTimeStep);
         }
+        curtime = utils::GetMicroTime();
+        steptimes.modules = curtime - stagetime;
+        stagetime = curtime;
 
         // simulate the sensors last (ie, they always reflect the most recent bodies
+        std::vector<SensorBasePtr> vsensors, vparallelsensors;
+        vsensors.reserve(listSensors.size());
         FOREACH(itsensor, listSensors) {
-            (*itsensor)->SimulationStep(fTimeStep);
+            vsensors.push_back(*itsensor);
         }
         FOREACH(itrobot, vecrobots) {
             FOREACH(itsensor, (*itrobot)->GetAttachedSensors()) {
                 if( !!(*itsensor)->GetSensor() ) {
-                    (*itsensor)->GetSensor()->SimulationStep(fTimeStep);
+                    vsensors.push_back((*itsensor)->GetSensor());
+                }
+            }
+        }
+        if( _nSimulationStepThreads > 1 ) {
+            std::vector<SensorBasePtr> vserialsensors;
+            vserialsensors.reserve(vsensors.size());
+            FOREACH(itsensor, vsensors) {
+                if( (*itsensor)->IsSimulationStepThreadSafe() ) {
+                    vparallelsensors.push_back(*itsensor);
+                }
+                else {
+                    vserialsensors.push_back(*itsensor);
                 }
             }
+            vsensors.swap(vserialsensors);
+        }
+        if( vparallelsensors.size() > 0 ) {
+            _StepSensorsParallel(vparallelsensors, fTimeStep);
+            curtime = utils::GetMicroTime();
+            steptimes.parallelsensors = curtime - stagetime;
+            stagetime = curtime;
+        }
+        FOREACH(itsensor, vsensors) {
+            (*itsensor)->SimulationStep(fTimeStep);
         }
+        curtime = utils::GetMicroTime();
+        steptimes.sensors = curtime - stagetime;
+        steptimes.total = curtime - starttime;
+        _simulationsteptimes = steptimes;
         _nCurSimTime += step;
     }
 
+    virtual void SetSimulationStepThreads(int numthreads)
+    {
+        EnvironmentMutex::scoped_lock lockenv(GetMutex());
+        _nSimulationStepThreads = max(1, numthreads);
+    }
+
+    virtual int GetSimulationStepThreads() const
+    {
+        return _nSimulationStepThreads;
+    }
+
+    virtual SimulationStepTimes GetSimulationStepTimes() const
+    {
+        EnvironmentMutex::scoped_lock lockenv(GetMutex());
+        return _simulationsteptimes;
+    }
+
+    virtual void SetSimulationScheduler(const SimulationSchedulerParameters& parameters)
+    {
+        if( parameters.fRealTimeFactor <= 0 ) {
+            throw OPENRAVE_EXCEPTION_FORMAT(_("real-time factor %f has to be positive"), parameters.fRealTimeFactor, ORE_InvalidArguments);
+        }
+        boost::mutex::scoped_lock lock(_mutexSimulationScheduler);
+        _schedulerparameters = parameters;
+        _ResetSchedulerStatistics();
+    }
+
+    virtual SimulationSchedulerParameters GetSimulationScheduler() const
+    {
+        boost::mutex::scoped_lock lock(_mutexSimulationScheduler);
+        return _schedulerparameters;
+    }
+
+    virtual SimulationSchedulerStatistics GetSimulationSchedulerStatistics(bool bReset)
+    {
+        boost::mutex::scoped_lock lock(_mutexSimulationScheduler);
+        SimulationSchedulerStatistics statistics = _schedulerstatistics;
+        if( bReset ) {
+            _ResetSchedulerStatistics();
+        }
+        return statistics;
+    }
+
+    /// \brief _mutexSimulationScheduler has to be locked
+    void _ResetSchedulerStatistics()
+    {
+        _schedulerstatistics = SimulationSchedulerStatistics();
+        _schedulerstatistics.histogrambinsize = max((uint64_t)1, _schedulerparameters.histogrambinsize);
+        _schedulerstatistics.vsteptimehistogram.resize(max(1, _schedulerparameters.numhistogrambins), 0);
+    }
+
     virtual EnvironmentMutex& GetMutex() const {
         return _mutexEnvironment;
     }
@@ -2041,6 +2140,7 @@ public:
             state.uri = (*itbody)->GetURI();
             state.updatestamp = (*itbody)->GetUpdateStamp();
             state.environmentid = (*itbody)->GetEnvironmentId();
+            (*itbody)->GetGrabbedInfo(state.vGrabbedInfos);
             if( (*itbody)->IsRobot() ) {
                 RobotBasePtr probot = RaveInterfaceCast<RobotBase>(*itbody);
                 if( !!probot ) {
@@ -2051,7 +2151,6 @@ public:
                     }
                 }
             }
-            _vPublishedBodies.push_back(state);
         }
     }
 
@@ -2410,6 +2509,8 @@ protected:
             _bEnableSimulation = r->_bEnableSimulation;
             _nCurSimTime = r->_nCurSimTime;
             _nSimStartTime = r->_nSimStartTime;
+            _nSimulationStepThreads = r->_nSimulationStepThreads;
+            SetSimulationScheduler(r->GetSimulationScheduler());
         }
 
         if( options & Clone_Modules ) {
@@ -2537,6 +2638,87 @@ protected:
         pbody->_environmentid = 0;
     }
 
+    /// \brief steps vsensors on the worker threads and the calling thread, returns once all of them are done
+    ///
+    /// Has to be called with the environment locked.
+    void _StepSensorsParallel(const std::vector<SensorBasePtr>& vsensors, dReal fTimeStep)
+    {
+        if( _vStepWorkers.size() != (size_t)_nSimulationStepThreads-1 ) {
+            _StopStepWorkers();
+            _bShutdownStepWorkers = false;
+            for(int i = 1; i < _nSimulationStepThreads; ++i) {
+                _vStepWorkers.push_back(boost::shared_ptr<boost::thread>(new boost::thread(boost::bind(&Environment::_StepWorkerThread, this))));
+            }
+        }
+
+        boost::mutex::scoped_lock lock(_mutexStepWorkers);
+        _vStepSensors = vsensors;
+        _nNextStepSensor = 0;
+        _nStepSensorsRemaining = vsensors.size();
+        _fStepSensorsTimeStep = fTimeStep;
+        _stepsensorserror.resize(0);
+        _conditionStepWorkers.notify_all();
+        // the calling thread works on the sensors too
+        while( _nNextStepSensor < _vStepSensors.size() ) {
+            _StepNextSensor(lock);
+        }
+        while( _nStepSensorsRemaining > 0 ) {
+            _conditionStepSensorsDone.wait(lock);
+        }
+        _vStepSensors.clear();
+        if( _stepsensorserror.size() > 0 ) {
+            throw OPENRAVE_EXCEPTION_FORMAT(_("failed to step sensor %s"), _stepsensorserror, ORE_Failed);
+        }
+    }
+
+    /// \brief steps the next sensor of _vStepSensors, lock has to be locked on entry and is locked on exit
+    void _StepNextSensor(boost::mutex::scoped_lock& lock)
+    {
+        SensorBasePtr psensor = _vStepSensors.at(_nNextStepSensor++);
+        dReal fTimeStep = _fStepSensorsTimeStep;
+        lock.unlock();
+        std::string error;
+        try {
+            psensor->SimulationStep(fTimeStep);
+        }
+        catch(const std::exception& ex) {
+            error = str(boost::format("%s: %s")%psensor->GetName()%ex.what());
+        }
+        lock.lock();
+        if( error.size() > 0 && _stepsensorserror.size() == 0 ) {
+            _stepsensorserror = error;
+        }
+        if( --_nStepSensorsRemaining == 0 ) {
+            _conditionStepSensorsDone.notify_all();
+        }
+    }
+
+    void _StepWorkerThread()
+    {
+        boost::mutex::scoped_lock lock(_mutexStepWorkers);
+        while( !_bShutdownStepWorkers ) {
+            if( _nNextStepSensor < _vStepSensors.size() ) {
+                _StepNextSensor(lock);
+            }
+            else {
+                _conditionStepWorkers.wait(lock);
+            }
+        }
+    }
+
+    void _StopStepWorkers()
+    {
+        {
+            boost::mutex::scoped_lock lock(_mutexStepWorkers);
+            _bShutdownStepWorkers = true;
+            _conditionStepWorkers.notify_all();
+        }
+        FOREACH(itworker, _vStepWorkers) {
+            (*itworker)->join();
+        }
+        _vStepWorkers.clear();
+    }
+
     void _StartSimulationThread()
     {
         if( !_threadSimulation ) {
@@ -2562,6 +2744,11 @@ protected:
         uint64_t nLastSleptTime = utils::GetMicroTime();
         RAVELOG_VERBOSE_FORMAT("starting simulation thread envid=%d", environmentid);
         while( _bInit && !_bShutdownSimulation ) {
+            if( _bEnableSimulation && _bRealTime && GetSimulationScheduler().bFixedRate ) {
+                _FixedRateSimulationLoop(nLastUpdateTime);
+                nLastSleptTime = utils::GetMicroTime();
+                continue;
+            }
             bool bNeedSleep = true;
             boost::shared_ptr<EnvironmentMutex::scoped_try_lock> lockenv;
             if( _bEnableSimulation ) {
@@ -2636,6 +2823,106 @@ protected:
         }
     }
 
+    /// \brief microseconds on a monotonic clock, used by the fixed-rate scheduler
+    static uint64_t _GetMonotonicMicroTime()
+    {
+#ifdef TIMER_ABSTIME
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (uint64_t)ts.tv_sec*1000000 + (uint64_t)ts.tv_nsec/1000;
+#else
+        return utils::GetMicroTime();
+#endif
+    }
+
+    /// \brief sleeps until the absolute time returned by _GetMonotonicMicroTime reaches deadline
+    static void _SleepUntilMonotonicMicroTime(uint64_t deadline)
+    {
+#ifdef TIMER_ABSTIME
+        struct timespec ts;
+        ts.tv_sec = deadline/1000000;
+        ts.tv_nsec = (deadline%1000000)*1000;
+        while( clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR ) {
+        }
+#else
+        uint64_t curtime = _GetMonotonicMicroTime();
+        if( deadline > curtime ) {
+            boost::this_thread::sleep(boost::posix_time::microseconds(deadline-curtime));
+        }
+#endif
+    }
+
+    /// \brief steps the simulation at the absolute deadlines of SimulationSchedulerParameters until the fixed-rate scheduler is disabled or the simulation stops
+    void _FixedRateSimulationLoop(uint64_t& nLastUpdateTime)
+    {
+        RAVELOG_VERBOSE_FORMAT("env=%d, starting fixed-rate simulation scheduler", GetId());
+        uint64_t deadline = _GetMonotonicMicroTime();
+        while( _bInit && !_bShutdownSimulation && _bEnableSimulation && _bRealTime ) {
+            SimulationSchedulerParameters parameters = GetSimulationScheduler();
+            if( !parameters.bFixedRate ) {
+                break;
+            }
+            uint64_t period = max((uint64_t)1, (uint64_t)(1000000.0*(double)_fDeltaSimTime/(double)parameters.fRealTimeFactor));
+
+            _SleepUntilMonotonicMicroTime(deadline);
+            uint64_t starttime = _GetMonotonicMicroTime();
+            uint64_t jitter = starttime > deadline ? starttime-deadline : 0;
+            {
+                boost::shared_ptr<EnvironmentMutex::scoped_try_lock> lockenv = _LockEnvironmentWithTimeout(100000);
+                if( !lockenv ) {
+                    // no step was taken, so keep the deadline and let the catch-up policy handle the delay once the lock is acquired
+                    continue;
+                }
+                try {
+                    StepSimulation(_fDeltaSimTime);
+                }
+                catch(const std::exception &ex) {
+                    RAVELOG_ERROR("simulation thread exception: %s\n",ex.what());
+                }
+                if( utils::GetMicroTime()-nLastUpdateTime > 10000 ) {
+                    nLastUpdateTime = utils::GetMicroTime();
+                    try {
+                        UpdatePublishedBodies(1000000); // 1.0s
+                    }
+                    catch(const std::exception& ex) {
+                        RAVELOG_WARN("timeout of UpdatePublishedBodies\n");
+                    }
+                }
+            }
+            uint64_t endtime = _GetMonotonicMicroTime();
+
+            deadline += period;
+            uint64_t numskipped = 0;
+            bool boverrun = endtime > deadline;
+            if( boverrun ) {
+                uint64_t nummissed = (endtime-deadline)/period + 1;
+                uint64_t maxcatchupsteps = parameters.catchuppolicy == CUP_Burst ? (uint64_t)max(0, parameters.maxcatchupsteps) : 0;
+                if( nummissed > maxcatchupsteps ) {
+                    // run the last maxcatchupsteps missed steps back to back and skip the rest
+                    numskipped = nummissed-maxcatchupsteps;
+                    deadline += numskipped*period;
+                }
+            }
+
+            boost::mutex::scoped_lock lock(_mutexSimulationScheduler);
+            uint64_t steptime = endtime-starttime;
+            _schedulerstatistics.numsteps++;
+            _schedulerstatistics.numoverruns += boverrun;
+            _schedulerstatistics.numskippedsteps += numskipped;
+            _schedulerstatistics.totalsteptime += steptime;
+            _schedulerstatistics.maxsteptime = max(_schedulerstatistics.maxsteptime, steptime);
+            _schedulerstatistics.totaljitter += jitter;
+            _schedulerstatistics.maxjitter = max(_schedulerstatistics.maxjitter, jitter);
+            if( _schedulerstatistics.vsteptimehistogram.size() > 0 ) {
+                size_t bin = min((size_t)(steptime/_schedulerstatistics.histogrambinsize), _schedulerstatistics.vsteptimehistogram.size()-1);
+                _schedulerstatistics.vsteptimehistogram[bin]++;
+            }
+        }
+        // the default scheduler catches up to _nSimStartTime, so start it from the current simulation time
+        _nSimStartTime = utils::GetMicroTime()-_nCurSimTime;
+        RAVELOG_VERBOSE_FORMAT("env=%d, stopping fixed-rate simulation scheduler", GetId());
+    }
+
     /// _mutexInterfaces should not be locked
     void _CallBodyCallbacks(KinBodyPtr pbody, int action)
     {
@@ -2780,6 +3067,21 @@ protected:
 
     boost::shared_ptr<boost::thread> _threadSimulation;                      ///< main loop for environment simulation
 
+    SimulationSchedulerParameters _schedulerparameters; ///< protected by _mutexSimulationScheduler
+    SimulationSchedulerStatistics _schedulerstatistics; ///< protected by _mutexSimulationScheduler
+    mutable boost::mutex _mutexSimulationScheduler;
+    int _nSimulationStepThreads; ///< see SetSimulationStepThreads
+    SimulationStepTimes _simulationsteptimes; ///< timing of the last StepSimulation call
+    std::vector<boost::shared_ptr<boost::thread> > _vStepWorkers; ///< threads stepping the sensors in parallel, started on the first parallel step
+    std::vector<SensorBasePtr> _vStepSensors; ///< sensors of the current step that the workers take from, protected by _mutexStepWorkers
+    size_t _nNextStepSensor; ///< index of the next sensor in _vStepSensors to step
+    size_t _nStepSensorsRemaining; ///< number of sensors in _vStepSensors that have not finished stepping
+    dReal _fStepSensorsTimeStep;
+    std::string _stepsensorserror; ///< first error thrown by a sensor stepped in parallel
+    boost::mutex _mutexStepWorkers;
+    boost::condition _conditionStepWorkers, _conditionStepSensorsDone;
+    bool _bShutdownStepWorkers;
+
     mutable EnvironmentMutex _mutexEnvironment;          ///< protects internal data from multithreading issues
     mutable boost::mutex _mutexEnvironmentIds;      ///< protects _vecbodies/_vecrobots from multithreading issues
     mutable boost::timed_mutex _mutexInterfaces;     ///< lock when managing interfaces like _listOwnedInterfaces, _listModules, _mapBodies
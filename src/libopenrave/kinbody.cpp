@@ -16,6 +16,16 @@
 // along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "libopenrave.h"
 #include <algorithm>
+#include <boost/crc.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/random/uniform_01.hpp>
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
 
 // used for functions that are also used internally
 #define CHECK_INTERNAL_COMPUTATION0 OPENRAVE_ASSERT_FORMAT(_nHierarchyComputed != 0, "body %s internal structures need to be computed, current value is %d. Are you sure Environment::AddRobot/AddKinBody was called?", GetName()%_nHierarchyComputed, ORE_NotInitialized);
@@ -228,6 +238,7 @@ KinBody::KinBody(InterfaceType type, EnvironmentBasePtr penv) : InterfaceBase(ty
     _bMakeJoinedLinksAdjacent = true;
     _environmentid = 0;
     _nNonAdjacentLinkCache = 0x80000000;
+    _bHasSampledCollidingLinks = false;
     _nUpdateStampId = 0;
     _bAreAllJoints1DOFAndNonCircular = false;
 }
@@ -4397,6 +4408,24 @@ void KinBody::_ResetInternalCollisionCache()
     FOREACH(it,_vNonAdjacentLinks) {
         it->resize(0);
     }
+    _vSampledCollidingLinks.resize(0);
+    _vSampledAlwaysCollidingLinks.resize(0);
+    _bHasSampledCollidingLinks = false;
+}
+
+void KinBody::_ComputeSampledNonAdjacentLinks() const
+{
+    std::vector<int>& vsampled = _vNonAdjacentLinks.at(AO_SampledColliding);
+    if( !_bHasSampledCollidingLinks ) {
+        vsampled = _vNonAdjacentLinks[0];
+        return;
+    }
+    vsampled.resize(0);
+    FOREACHC(itset, _vNonAdjacentLinks[0]) {
+        if( std::binary_search(_vSampledCollidingLinks.begin(), _vSampledCollidingLinks.end(), *itset) ) {
+            vsampled.push_back(*itset);
+        }
+    }
 }
 
 bool CompareNonAdjacentFarthest(int pair0, int pair1)
@@ -4419,6 +4448,235 @@ bool CompareNonAdjacentFarthest(int pair0, int pair1)
     return dist0 > dist1;
 }
 
+/// \brief on-disk cache of the link pairs found colliding by KinBody::ComputeSampledCollidingLinks when it is called with usecache
+///
+/// The files are stored in the database directory under kinbody.[kinematics geometry hash]/sampledcollidinglinks.[collision checker].
+/// Every file is a CacheFileHeader followed by datasize bytes of data. Arrays in the data are a uint32 count followed by the values.
+/// A file is only used when the magic, version, dReal size, kinematics hash, number of links, data size and crc32 of the data match,
+/// and the data is parsed from a read-only mapping of the file. Anything else is ignored and the file is rebuilt.
+/// The kinematics hash does not cover the adjacency, so the data holds the tested pairs it is checked against.
+namespace nonadjacentcache {
+
+static const char s_magic[8] = {'O','R','K','B','P','A','I','R'};
+static const uint32_t s_version = 3;
+
+struct CacheFileHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t realsize; ///< sizeof(dReal)
+    char kinematicshash[64]; ///< zero padded
+    uint32_t numlinks;
+    uint32_t datasize; ///< number of bytes following the header
+    uint32_t datacrc; ///< crc32 of the data, the same as zlib.crc32
+};
+
+BOOST_STATIC_ASSERT(sizeof(CacheFileHeader) == 92);
+
+/// \brief reads values from the mapped data of a cache file, fails instead of reading past its end
+class DataReader
+{
+public:
+    DataReader(const uint8_t* pdata, size_t size) : _pdata(pdata), _size(size), _offset(0) {
+    }
+
+    template <typename T>
+    bool Read(T& value)
+    {
+        if( _offset + sizeof(T) > _size ) {
+            return false;
+        }
+        std::memcpy(&value, _pdata+_offset, sizeof(T));
+        _offset += sizeof(T);
+        return true;
+    }
+
+    template <typename T>
+    bool ReadArray(uint32_t maxsize, std::vector<T>& values)
+    {
+        uint32_t num = 0;
+        if( !Read(num) || num > maxsize || _offset + num*sizeof(T) > _size ) {
+            return false;
+        }
+        values.resize(num);
+        if( num > 0 ) {
+            std::memcpy(&values[0], _pdata+_offset, num*sizeof(T));
+        }
+        _offset += num*sizeof(T);
+        return true;
+    }
+
+    bool IsAtEnd() const {
+        return _offset == _size;
+    }
+
+private:
+    const uint8_t* _pdata;
+    size_t _size, _offset;
+};
+
+template <typename T>
+inline void WriteValue(std::ostream& f, const T& value)
+{
+    f.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template <typename T>
+inline void WriteArray(std::ostream& f, const std::vector<T>& values)
+{
+    uint32_t num = values.size();
+    WriteValue(f, num);
+    if( values.size() > 0 ) {
+        f.write(reinterpret_cast<const char*>(&values[0]), values.size()*sizeof(T));
+    }
+}
+
+/// \brief writes data to a temporary file first and renames it, so other processes never read a partially written cache
+static void WriteFile(const std::string& fullfilename, const std::string& data)
+{
+#ifdef HAVE_BOOST_FILESYSTEM
+    try {
+        boost::filesystem::create_directories(boost::filesystem::path(fullfilename).parent_path());
+    }
+    catch(const std::exception& ex) {
+        RAVELOG_VERBOSE_FORMAT("failed to create directory for %s: %s", fullfilename%ex.what());
+        return;
+    }
+    // unique per process and thread without drawing from the global random generator
+    std::string tempfilename = str(boost::format("%s.%d.%s")%fullfilename%getpid()%boost::this_thread::get_id());
+    {
+        std::ofstream f(tempfilename.c_str(), std::ios::out|std::ios::binary|std::ios::trunc);
+        if( !f ) {
+            RAVELOG_VERBOSE_FORMAT("failed to write %s", tempfilename);
+            return;
+        }
+        f.write(data.c_str(), data.size());
+        if( !f ) {
+            RAVELOG_VERBOSE_FORMAT("failed to write %s", tempfilename);
+            f.close();
+            std::remove(tempfilename.c_str());
+            return;
+        }
+    }
+    try {
+        boost::filesystem::rename(boost::filesystem::path(tempfilename), boost::filesystem::path(fullfilename));
+    }
+    catch(const std::exception& ex) {
+        RAVELOG_VERBOSE_FORMAT("failed to rename %s: %s", tempfilename%ex.what());
+        std::remove(tempfilename.c_str());
+    }
+#endif
+}
+
+static std::string GetFilename(const std::string& name, const std::string& kinematicshash, const std::string& checkername)
+{
+    return str(boost::format("kinbody.%s/%s.%s")%kinematicshash%name%checkername);
+}
+
+/// \brief maps the file and checks its header and crc, then calls fnread on its data
+///
+/// \param fnread parses the data, returns false if it is not valid for the body
+/// \return true if fnread succeeded and consumed all the data
+static bool LoadFile(const std::string& fullfilename, const std::string& kinematicshash, uint32_t numlinks, const boost::function<bool(DataReader&)>& fnread)
+{
+    boost::shared_ptr<boost::interprocess::file_mapping> pmappedfile;
+    boost::shared_ptr<boost::interprocess::mapped_region> pmappedregion;
+    try {
+        pmappedfile.reset(new boost::interprocess::file_mapping(fullfilename.c_str(), boost::interprocess::read_only));
+        pmappedregion.reset(new boost::interprocess::mapped_region(*pmappedfile, boost::interprocess::read_only));
+    }
+    catch(const boost::interprocess::interprocess_exception& ex) {
+        RAVELOG_VERBOSE_FORMAT("failed to map %s: %s", fullfilename%ex.what());
+        return false;
+    }
+    const uint8_t* pdata = static_cast<const uint8_t*>(pmappedregion->get_address());
+    size_t filesize = pmappedregion->get_size();
+    CacheFileHeader header;
+    if( filesize < sizeof(header) ) {
+        RAVELOG_DEBUG_FORMAT("%s is truncated, ignoring", fullfilename);
+        return false;
+    }
+    std::memcpy(&header, pdata, sizeof(header));
+    if( !std::equal(s_magic, s_magic+sizeof(s_magic), header.magic) || header.version != s_version || header.realsize != sizeof(dReal) ) {
+        RAVELOG_DEBUG_FORMAT("%s has an old format, ignoring", fullfilename);
+        return false;
+    }
+    if( kinematicshash != std::string(header.kinematicshash, strnlen(header.kinematicshash, sizeof(header.kinematicshash))) || header.numlinks != numlinks ) {
+        RAVELOG_DEBUG_FORMAT("%s was saved for a different body, ignoring", fullfilename);
+        return false;
+    }
+    boost::crc_32_type crc;
+    if( header.datasize != filesize-sizeof(header) ) {
+        RAVELOG_DEBUG_FORMAT("%s is truncated, ignoring", fullfilename);
+        return false;
+    }
+    crc.process_bytes(pdata+sizeof(header), header.datasize);
+    if( crc.checksum() != header.datacrc ) {
+        RAVELOG_DEBUG_FORMAT("%s is corrupted, ignoring", fullfilename);
+        return false;
+    }
+    DataReader reader(pdata+sizeof(header), header.datasize);
+    return fnread(reader) && reader.IsAtEnd();
+}
+
+static void SaveFile(const std::string& fullfilename, const std::string& kinematicshash, uint32_t numlinks, const std::string& data)
+{
+    CacheFileHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::copy(s_magic, s_magic+sizeof(s_magic), header.magic);
+    header.version = s_version;
+    header.realsize = sizeof(dReal);
+    std::memcpy(header.kinematicshash, kinematicshash.c_str(), std::min(kinematicshash.size(), sizeof(header.kinematicshash)));
+    header.numlinks = numlinks;
+    header.datasize = data.size();
+    boost::crc_32_type crc;
+    crc.process_bytes(data.c_str(), data.size());
+    header.datacrc = crc.checksum();
+    WriteFile(fullfilename, std::string(reinterpret_cast<const char*>(&header), sizeof(header)) + data);
+}
+
+/// \brief parses the data of a sampledcollidinglinks file
+///
+/// The data is the number of samples, the sorted tested pairs, the sometimes colliding and the always colliding pairs.
+/// Only accepted if the file tested exactly vtestedpairs with at least numsamples samples.
+static bool ReadSampled(DataReader& reader, const std::vector<int>& vtestedpairs, int numsamples, std::vector<int>& vcolliding, std::vector<int>& valwayscolliding)
+{
+    uint32_t filenumsamples = 0;
+    if( !reader.Read(filenumsamples) || filenumsamples < static_cast<uint32_t>(numsamples) ) {
+        return false;
+    }
+    std::vector<int> vfiletested;
+    if( !reader.ReadArray(vtestedpairs.size(), vfiletested) || vfiletested != vtestedpairs ) {
+        return false;
+    }
+    if( !reader.ReadArray(vtestedpairs.size(), vcolliding) || !reader.ReadArray(vtestedpairs.size(), valwayscolliding) ) {
+        return false;
+    }
+    for(size_t i = 0; i < vcolliding.size(); ++i) {
+        if( !std::binary_search(vtestedpairs.begin(), vtestedpairs.end(), vcolliding[i]) ) {
+            return false;
+        }
+    }
+    for(size_t i = 0; i < valwayscolliding.size(); ++i) {
+        if( !std::binary_search(vtestedpairs.begin(), vtestedpairs.end(), valwayscolliding[i]) ) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static std::string WriteSampled(const std::vector<int>& vtestedpairs, int numsamples, const std::vector<int>& vcolliding, const std::vector<int>& valwayscolliding)
+{
+    std::stringstream f(std::ios::out|std::ios::binary);
+    WriteValue(f, static_cast<uint32_t>(numsamples));
+    WriteArray(f, vtestedpairs);
+    WriteArray(f, vcolliding);
+    WriteArray(f, valwayscolliding);
+    return f.str();
+}
+
+} // end namespace nonadjacentcache
+
 const std::vector<int>& KinBody::GetNonAdjacentLinks(int adjacentoptions) const
 {
     class TransformsSaver
@@ -4464,21 +4722,26 @@ private:
         }
         std::sort(_vNonAdjacentLinks[0].begin(), _vNonAdjacentLinks[0].end(), CompareNonAdjacentFarthest);
         _nUpdateStampId++; // because transforms were modified
+        _ComputeSampledNonAdjacentLinks();
         _nNonAdjacentLinkCache = 0;
     }
-    if( (_nNonAdjacentLinkCache&adjacentoptions) != adjacentoptions ) {
-        int requestedoptions = (~_nNonAdjacentLinkCache)&adjacentoptions;
+    // AO_SampledColliding is always valid once _vNonAdjacentLinks[0] is, so only the other options are tracked
+    int cacheoptions = adjacentoptions&~AO_SampledColliding;
+    if( (_nNonAdjacentLinkCache&cacheoptions) != cacheoptions ) {
+        int requestedoptions = (~_nNonAdjacentLinkCache)&cacheoptions;
         // find out what needs to computed
         if( requestedoptions & AO_Enabled ) {
-            _vNonAdjacentLinks.at(AO_Enabled).resize(0);
-            FOREACHC(itset, _vNonAdjacentLinks[0]) {
-                KinBody::LinkConstPtr plink1(_veclinks.at(*itset&0xffff)), plink2(_veclinks.at(*itset>>16));
-                if( plink1->IsEnabled() && plink2->IsEnabled() ) {
-                    _vNonAdjacentLinks[AO_Enabled].push_back(*itset);
+            for(int sampled = 0; sampled <= AO_SampledColliding; sampled += AO_SampledColliding) {
+                _vNonAdjacentLinks.at(sampled|AO_Enabled).resize(0);
+                FOREACHC(itset, _vNonAdjacentLinks[sampled]) {
+                    KinBody::LinkConstPtr plink1(_veclinks.at(*itset&0xffff)), plink2(_veclinks.at(*itset>>16));
+                    if( plink1->IsEnabled() && plink2->IsEnabled() ) {
+                        _vNonAdjacentLinks[sampled|AO_Enabled].push_back(*itset);
+                    }
                 }
+                std::sort(_vNonAdjacentLinks[sampled|AO_Enabled].begin(), _vNonAdjacentLinks[sampled|AO_Enabled].end(), CompareNonAdjacentFarthest);
             }
             _nNonAdjacentLinkCache |= AO_Enabled;
-            std::sort(_vNonAdjacentLinks[AO_Enabled].begin(), _vNonAdjacentLinks[AO_Enabled].end(), CompareNonAdjacentFarthest);
         }
         else {
             throw OPENRAVE_EXCEPTION_FORMAT(_("no support for adjacentoptions %d"), adjacentoptions,ORE_InvalidArguments);
@@ -4487,6 +4750,140 @@ private:
     return _vNonAdjacentLinks.at(adjacentoptions);
 }
 
+/// \brief tests the link pairs of pbody at the configurations [startsample, endsample) of vsamples
+///
+/// Sets bit 1 of vcollisionflags for the pairs that collide in some sample and bit 2 for the pairs that are free in some sample.
+/// Locks the environment of pbody, so it can run on a clone.
+static void SampleCollidingLinks(KinBodyPtr pbody, CollisionCheckerBasePtr collisionchecker, const std::vector<int>& vtestedpairs, const std::vector<dReal>& vsamples, int startsample, int endsample, std::vector<uint8_t>& vcollisionflags)
+{
+    try {
+        EnvironmentMutex::scoped_lock lock(pbody->GetEnv()->GetMutex());
+        KinBody::KinBodyStateSaver saver(pbody, KinBody::Save_LinkTransformation|KinBody::Save_LinkEnable);
+        CollisionOptionsStateSaver colsaver(collisionchecker,0);
+        pbody->Enable(true);
+        const std::vector<KinBody::LinkPtr>& links = pbody->GetLinks();
+        int dof = pbody->GetDOF();
+        size_t numremaining = vcollisionflags.size() - std::count(vcollisionflags.begin(), vcollisionflags.end(), 3);
+        std::vector<dReal> vvalues(dof);
+        for(int isample = startsample; isample < endsample && numremaining > 0; ++isample) {
+            std::copy(vsamples.begin()+isample*dof, vsamples.begin()+(isample+1)*dof, vvalues.begin());
+            pbody->SetDOFValues(vvalues, KinBody::CLA_Nothing);
+            for(size_t ipair = 0; ipair < vtestedpairs.size(); ++ipair) {
+                if( vcollisionflags[ipair] == 3 ) {
+                    continue; // already known to collide only sometimes
+                }
+                bool bcollision = collisionchecker->CheckCollision(KinBody::LinkConstPtr(links.at(vtestedpairs[ipair]&0xffff)), KinBody::LinkConstPtr(links.at(vtestedpairs[ipair]>>16)));
+                vcollisionflags[ipair] |= bcollision ? 1 : 2;
+                if( vcollisionflags[ipair] == 3 ) {
+                    --numremaining;
+                }
+            }
+        }
+    }
+    catch(const std::exception& ex) {
+        RAVELOG_WARN_FORMAT("failed to sample colliding links of %s: %s", pbody->GetName()%ex.what());
+    }
+}
+
+void KinBody::ComputeSampledCollidingLinks(int numsamples, int numthreads, bool usecache)
+{
+    CHECK_INTERNAL_COMPUTATION;
+    OPENRAVE_ASSERT_OP(numsamples,>,0);
+    // test all non-adjacent pairs, including the ones colliding in the initial pose, so that the always colliding ones can be told apart
+    std::vector<int> vtestedpairs;
+    for(size_t i = 0; i < _veclinks.size(); ++i) {
+        for(size_t j = i+1; j < _veclinks.size(); ++j) {
+            if( _setAdjacentLinks.find(i|(j<<16)) == _setAdjacentLinks.end() ) {
+                vtestedpairs.push_back(i|(j<<16));
+            }
+        }
+    }
+    std::sort(vtestedpairs.begin(), vtestedpairs.end());
+    CollisionCheckerBasePtr collisionchecker = !!_selfcollisionchecker ? _selfcollisionchecker : GetEnv()->GetCollisionChecker();
+    std::string cachefilename, fullcachefilename;
+    if( usecache ) {
+        cachefilename = nonadjacentcache::GetFilename("sampledcollidinglinks", GetKinematicsGeometryHash(), collisionchecker->GetXMLId());
+        fullcachefilename = RaveFindDatabaseFile(cachefilename, true);
+    }
+    std::vector<int> vcolliding, valwayscolliding;
+    if( fullcachefilename.size() > 0 && nonadjacentcache::LoadFile(fullcachefilename, __hashkinematics, _veclinks.size(), boost::bind(nonadjacentcache::ReadSampled, _1, boost::cref(vtestedpairs), numsamples, boost::ref(vcolliding), boost::ref(valwayscolliding))) ) {
+        RAVELOG_VERBOSE_FORMAT("body %s loaded sampled colliding links from %s", GetName()%fullcachefilename);
+    }
+    else {
+        vcolliding.resize(0);
+        valwayscolliding.resize(0);
+        uint64_t starttime = utils::GetMicroTime();
+        int dof = GetDOF();
+        std::vector<dReal> vlower, vupper, vsamples(numsamples*dof);
+        GetDOFLimits(vlower, vupper);
+        for(int idof = 0; idof < dof; ++idof) {
+            if( IsDOFRevolute(idof) && vupper[idof]-vlower[idof] > 2*PI ) {
+                // circular joints have very large limits
+                vlower[idof] = -PI;
+                vupper[idof] = PI;
+            }
+        }
+        // fixed seed so that the result only depends on the body and numsamples, not on numthreads or the global random generator
+        boost::mt19937 rng(5489u);
+        boost::uniform_01<boost::mt19937&, dReal> uniform(rng);
+        for(int isample = 0; isample < numsamples; ++isample) {
+            for(int idof = 0; idof < dof; ++idof) {
+                vsamples[isample*dof+idof] = vlower[idof] + (vupper[idof]-vlower[idof])*uniform();
+            }
+        }
+
+        std::vector<uint8_t> vcollisionflags(vtestedpairs.size(), 0);
+        if( numthreads > 1 && numsamples >= numthreads && !_selfcollisionchecker ) {
+            // each thread works on its own environment so that the link transformations do not interfere
+            std::vector<EnvironmentBasePtr> vclonedenvs(numthreads);
+            std::vector< std::vector<uint8_t> > vthreadflags(numthreads, vcollisionflags);
+            boost::thread_group threads;
+            for(int ithread = 0; ithread < numthreads; ++ithread) {
+                vclonedenvs[ithread] = GetEnv()->CloneSelf(Clone_Bodies);
+                vclonedenvs[ithread]->StopSimulation();
+                KinBodyPtr pclonedbody = vclonedenvs[ithread]->GetKinBody(GetName());
+                int startsample = (ithread*numsamples)/numthreads, endsample = ((ithread+1)*numsamples)/numthreads;
+                threads.create_thread(boost::bind(SampleCollidingLinks, pclonedbody, vclonedenvs[ithread]->GetCollisionChecker(), boost::cref(vtestedpairs), boost::cref(vsamples), startsample, endsample, boost::ref(vthreadflags[ithread])));
+            }
+            threads.join_all();
+            for(int ithread = 0; ithread < numthreads; ++ithread) {
+                vclonedenvs[ithread]->Destroy();
+                for(size_t ipair = 0; ipair < vcollisionflags.size(); ++ipair) {
+                    vcollisionflags[ipair] |= vthreadflags[ithread][ipair];
+                }
+            }
+        }
+        else {
+            SampleCollidingLinks(shared_kinbody(), collisionchecker, vtestedpairs, vsamples, 0, numsamples, vcollisionflags);
+        }
+        for(size_t ipair = 0; ipair < vtestedpairs.size(); ++ipair) {
+            if( vcollisionflags[ipair] == 3 ) {
+                vcolliding.push_back(vtestedpairs[ipair]);
+            }
+            else if( vcollisionflags[ipair] == 1 ) {
+                valwayscolliding.push_back(vtestedpairs[ipair]);
+            }
+        }
+        RAVELOG_DEBUG_FORMAT("body %s has %d/%d non-adjacent link pairs sometimes and %d always colliding in %d samples, took %fs", GetName()%vcolliding.size()%vtestedpairs.size()%valwayscolliding.size()%numsamples%(1e-6*(utils::GetMicroTime()-starttime)));
+        if( usecache ) {
+            fullcachefilename = RaveFindDatabaseFile(cachefilename, false);
+            if( fullcachefilename.size() > 0 ) {
+                nonadjacentcache::SaveFile(fullcachefilename, __hashkinematics, _veclinks.size(), nonadjacentcache::WriteSampled(vtestedpairs, numsamples, vcolliding, valwayscolliding));
+            }
+        }
+    }
+    _vSampledCollidingLinks.swap(vcolliding);
+    _vSampledAlwaysCollidingLinks.swap(valwayscolliding);
+    _bHasSampledCollidingLinks = true;
+    _ComputeSampledNonAdjacentLinks();
+    _nNonAdjacentLinkCache &= ~(AO_Enabled|AO_ActiveDOFs); // lists derived from _vNonAdjacentLinks[AO_SampledColliding] are stale
+}
+
+const std::vector<int>& KinBody::GetSampledAlwaysCollidingLinks() const
+{
+    return _vSampledAlwaysCollidingLinks;
+}
+
 const std::set<int>& KinBody::GetAdjacentLinks() const
 {
     CHECK_INTERNAL_COMPUTATION;
@@ -4627,6 +5024,9 @@ void KinBody::Clone(InterfaceBaseConstPtr preference, int cloningoptions)
 
     // cache
     _ResetInternalCollisionCache();
+    _vSampledCollidingLinks = r->_vSampledCollidingLinks;
+    _vSampledAlwaysCollidingLinks = r->_vSampledAlwaysCollidingLinks;
+    _bHasSampledCollidingLinks = r->_bHasSampledCollidingLinks;
 
     // clone the grabbed bodies, note that this can fail if the new cloned environment hasn't added the bodies yet (check out Environment::Clone)
     _vGrabbedBodies.resize(0);
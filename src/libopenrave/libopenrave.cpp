@@ -520,6 +520,11 @@ public:
         }
         listDestroyCallbacks.clear();
 
+        // write the messages still queued by the asynchronous logging backend, they refer to strings of the plugins that are about to be unloaded
+        if( RaveIsAsyncLogging() ) {
+            RaveSetAsyncLogging(false);
+        }
+
         if( !!_pdatabase ) {
             // force destroy in case some one is holding a pointer to it
             _pdatabase->Destroy();
@@ -1187,6 +1192,7 @@ void RaveGetLoadedInterfaces(std::map<InterfaceType, std::vector<std::string> >&
 
 void RaveReloadPlugins()
 {
+    AsyncLoggingSuspender suspender;
     RaveGlobal::instance()->GetDatabase()->ReloadPlugins();
 }
 
@@ -451,6 +451,19 @@ namespace LocalXML
 bool ParseXMLData(BaseXMLReader& reader, const char* buffer, int size);
 }
 
+/// \brief writes the queued asynchronous log records and logs synchronously while in scope
+///
+/// The queued records refer to the file and function names of the code that logged them, so plugins cannot be unloaded while they are queued.
+class AsyncLoggingSuspender
+{
+public:
+    AsyncLoggingSuspender();
+    ~AsyncLoggingSuspender();
+private:
+    bool _bSuspended;
+    uint32_t _buffersize, _flushperiod;
+};
+
 #ifdef _WIN32
 inline const char *strcasestr(const char *s, const char *find)
 {
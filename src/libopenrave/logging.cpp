@@ -0,0 +1,1038 @@
+// -*- coding: utf-8 -*-
+// Copyright (C) 2006-2016 Rosen Diankov <rosen.diankov@gmail.com>
+//
+// This file is part of OpenRAVE.
+// OpenRAVE is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#include "libopenrave.h"
+
+#include <boost/atomic.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/thread/condition.hpp>
+#include <boost/thread/tss.hpp>
+
+#include <cerrno>
+#include <cwchar>
+
+#ifdef _MSC_VER
+#define OPENRAVE_THREAD_LOCAL __declspec(thread)
+#else
+#define OPENRAVE_THREAD_LOCAL __thread
+#endif
+
+namespace OpenRAVE {
+
+namespace {
+
+enum AsyncLogRecordType {
+    ALRT_Padding=0, ///< fills the end of the ring buffer when a record does not fit before wrapping around
+    ALRT_String=1, ///< preformatted message, a newline is appended if missing
+    ALRT_Printf=2, ///< printf format string and its arguments
+    ALRT_Format=3, ///< boost::format format string and its arguments
+};
+
+enum AsyncLogRecordFlags {
+    ALRF_Truncated=1, ///< the arguments did not fit into the record
+};
+
+/// \brief header of every record in a ring buffer. Records are aligned to 8 bytes.
+struct AsyncLogRecordHeader
+{
+    uint32_t size; ///< size of the record in bytes including the header
+    uint8_t type; ///< AsyncLogRecordType
+    uint8_t level;
+    uint8_t flags; ///< combination of AsyncLogRecordFlags
+    uint8_t reserved;
+    int32_t line;
+    uint64_t timestamp; ///< monotonic time in nanoseconds the record was started at
+    const char* filename;
+    const char* function;
+};
+
+static const uint32_t s_nMaxRecordSize = 4096;
+static const uint32_t s_nMinRingSize = 4*s_nMaxRecordSize;
+
+inline uint32_t _AlignRecordSize(size_t size)
+{
+    return (uint32_t)((size+7)&~size_t(7));
+}
+
+/// \brief single producer single consumer byte ring buffer owned by one logging thread
+///
+/// The producer only writes _head and the consumer only writes _tail. The consumer is serialized by AsyncLogger::_mutexFlush.
+class AsyncLogRing
+{
+public:
+    AsyncLogRing(uint32_t capacity, uint32_t generation, const std::string& threadname) : _vbuffer(capacity), _mask(capacity-1), _generation(generation), _threadname(threadname), _head(0), _tail(0), _numlogged(0), _numdropped(0), _numtruncated(0), _numreporteddropped(0), _bOrphaned(false) {
+    }
+
+    /// \brief called by the producer, copies the record into the ring. Returns false if the ring is full.
+    bool Push(const char* precord, uint32_t size)
+    {
+        uint64_t head = _head.load(boost::memory_order_relaxed);
+        uint64_t tail = _tail.load(boost::memory_order_acquire);
+        uint32_t capacity = _mask+1;
+        uint32_t pos = (uint32_t)(head & _mask);
+        uint32_t contiguous = capacity - pos;
+        uint32_t needed = contiguous < size ? contiguous + size : size;
+        if( head + needed - tail > capacity ) {
+            _Increment(_numdropped);
+            return false;
+        }
+        if( contiguous < size ) {
+            AsyncLogRecordHeader* ppadding = reinterpret_cast<AsyncLogRecordHeader*>(&_vbuffer[pos]);
+            ppadding->size = contiguous;
+            ppadding->type = ALRT_Padding;
+            head += contiguous;
+            pos = 0;
+        }
+        memcpy(&_vbuffer[pos], precord, size);
+        _head.store(head + size, boost::memory_order_release);
+        _Increment(_numlogged);
+        return true;
+    }
+
+    /// \brief increments a counter that only the producer writes, avoids the locked read-modify-write
+    static inline void _Increment(boost::atomic<uint64_t>& counter)
+    {
+        counter.store(counter.load(boost::memory_order_relaxed)+1, boost::memory_order_relaxed);
+    }
+
+    std::vector<char> _vbuffer;
+    uint32_t _mask;
+    uint32_t _generation; ///< AsyncLogger::_generation the ring was allocated with
+    std::string _threadname;
+
+    char _padding0[64]; ///< keeps the producer and consumer indices on separate cache lines
+    boost::atomic<uint64_t> _head; ///< total bytes written by the producer
+    char _padding1[64];
+    boost::atomic<uint64_t> _tail; ///< total bytes consumed by the flushing thread
+    char _padding2[64];
+
+    boost::atomic<uint64_t> _numlogged, _numdropped, _numtruncated; ///< only written by the producer
+    uint64_t _numreporteddropped; ///< only accessed by the consumer
+    boost::atomic<bool> _bOrphaned; ///< set when the owning thread exits
+};
+
+typedef boost::shared_ptr<AsyncLogRing> AsyncLogRingPtr;
+
+struct AsyncLogThreadState;
+
+/// \brief a record under construction, copied into the ring on commit
+struct AsyncLogRecordState
+{
+    AsyncLogRecordState() : pthread(NULL), pcur(NULL), pend(NULL), bFull(false) {
+    }
+    AsyncLogThreadState* pthread;
+    std::vector<char> vscratch;
+    char* pcur;
+    char* pend;
+    bool bFull; ///< true if an argument did not fit, all following arguments are discarded so that the types stay in sync with the format
+};
+
+/// \brief producer side state of one thread
+struct AsyncLogThreadState
+{
+    AsyncLogThreadState() : depth(0) {
+        FOREACH(itrecord, records) {
+            itrecord->pthread = this;
+        }
+    }
+
+    AsyncLogRingPtr ring;
+    boost::array<AsyncLogRecordState, 4> records; ///< records of log calls made while evaluating the arguments of an unfinished record are nested
+    int depth; ///< number of records under construction
+};
+
+static OPENRAVE_THREAD_LOCAL AsyncLogThreadState* s_pthreadstate = NULL;
+
+static void _CleanupThreadState(AsyncLogThreadState* pstate)
+{
+    if( !!pstate->ring ) {
+        pstate->ring->_bOrphaned = true;
+    }
+    if( s_pthreadstate == pstate ) {
+        s_pthreadstate = NULL;
+    }
+    delete pstate;
+}
+
+static boost::atomic<bool> s_bAsyncLogging(false);
+
+/// \brief parsed printf conversion specification
+struct PrintfSpec
+{
+    std::string flags; ///< flags, width and precision, the stars are substituted when replaying
+    int numstars; ///< number of '*' int arguments preceding the value
+    char length; ///< 0, 'H' (hh), 'h', 'l', 'L' (ll, q, L), 'j', 'z', 't'
+    char conversion;
+    const char* pend;
+};
+
+/// \brief parses the conversion specification starting after the '%'. The flags string keeps the stars so they can be substituted later.
+static bool _ParsePrintfSpec(const char* p, PrintfSpec& spec)
+{
+    spec.flags.resize(0);
+    spec.numstars = 0;
+    spec.length = 0;
+    while( *p != 0 && strchr("-+ #0123456789.*'I", *p) != NULL ) {
+        if( *p == '*' ) {
+            spec.numstars++;
+        }
+        spec.flags.push_back(*p++);
+    }
+    if( *p == 'h' ) {
+        spec.length = 'h';
+        if( *++p == 'h' ) {
+            spec.length = 'H';
+            ++p;
+        }
+    }
+    else if( *p == 'l' ) {
+        spec.length = 'l';
+        if( *++p == 'l' ) {
+            spec.length = 'L';
+            ++p;
+        }
+    }
+    else if( *p == 'L' || *p == 'q' ) {
+        spec.length = 'L';
+        ++p;
+    }
+    else if( *p == 'j' || *p == 'z' || *p == 't' ) {
+        spec.length = *p++;
+    }
+    if( *p == 0 || strchr("diouxXcCsSpneEfFgGaAm%", *p) == NULL ) {
+        return false;
+    }
+    spec.conversion = *p++;
+    spec.pend = p;
+    return true;
+}
+
+class AsyncLogger
+{
+public:
+    static AsyncLogger& GetInstance()
+    {
+        // never destroyed so that threads logging during static destruction stay valid
+        static AsyncLogger* s_plogger = new AsyncLogger();
+        return *s_plogger;
+    }
+
+    void SetEnabled(bool bEnable, uint32_t buffersize, uint32_t flushperiod)
+    {
+        boost::mutex::scoped_lock lockthread(_mutexThread);
+        if( bEnable ) {
+            uint32_t capacity = s_nMinRingSize;
+            while( capacity < buffersize && capacity < 0x80000000 ) {
+                capacity <<= 1;
+            }
+            if( capacity != _buffersize ) {
+                _buffersize = capacity;
+                _generation++;
+            }
+            _flushperiod = flushperiod > 0 ? flushperiod : 1;
+            if( !_threadflush ) {
+                _bStopFlush = false;
+                _threadflush.reset(new boost::thread(boost::bind(&AsyncLogger::_FlushThread, this)));
+            }
+            if( !_bRegisteredExit ) {
+                atexit(AsyncLogger::_DisableAtExit);
+                _bRegisteredExit = true;
+            }
+            s_bAsyncLogging = true;
+        }
+        else {
+            s_bAsyncLogging = false;
+            if( !!_threadflush ) {
+                {
+                    boost::mutex::scoped_lock lock(_mutexCondition);
+                    _bStopFlush = true;
+                    _condition.notify_all();
+                }
+                _threadflush->join();
+                _threadflush.reset();
+            }
+            Flush();
+        }
+    }
+
+    void GetSettings(uint32_t& buffersize, uint32_t& flushperiod)
+    {
+        boost::mutex::scoped_lock lockthread(_mutexThread);
+        buffersize = _buffersize;
+        flushperiod = _flushperiod;
+    }
+
+    /// \brief returns the producer state of the calling thread, allocating its ring buffer if needed
+    AsyncLogThreadState* GetThreadState()
+    {
+        AsyncLogThreadState* pstate = s_pthreadstate;
+        if( !pstate ) {
+            pstate = new AsyncLogThreadState();
+            _tlsthreadstate->reset(pstate);
+            s_pthreadstate = pstate;
+        }
+        if( !pstate->ring || pstate->ring->_generation != _generation ) {
+            if( !!pstate->ring ) {
+                pstate->ring->_bOrphaned = true;
+            }
+            std::stringstream ss;
+            ss << boost::this_thread::get_id();
+            pstate->ring.reset(new AsyncLogRing(_buffersize, _generation, ss.str()));
+            boost::mutex::scoped_lock lock(_mutexRings);
+            _listrings.push_back(pstate->ring);
+        }
+        return pstate;
+    }
+
+    /// \brief drains all ring buffers and writes the records sorted by their timestamps
+    void Flush()
+    {
+        boost::mutex::scoped_lock lockflush(_mutexFlush);
+        std::vector<AsyncLogRingPtr> vrings;
+        {
+            boost::mutex::scoped_lock lock(_mutexRings);
+            vrings.insert(vrings.end(), _listrings.begin(), _listrings.end());
+        }
+
+        _vrecords.resize(0);
+        std::vector<uint64_t> vheads(vrings.size());
+        for(size_t iring = 0; iring < vrings.size(); ++iring) {
+            AsyncLogRing& ring = *vrings[iring];
+            uint64_t tail = ring._tail.load(boost::memory_order_relaxed);
+            uint64_t head = ring._head.load(boost::memory_order_acquire);
+            while( tail < head ) {
+                const AsyncLogRecordHeader* pheader = reinterpret_cast<const AsyncLogRecordHeader*>(&ring._vbuffer[tail & ring._mask]);
+                if( pheader->type != ALRT_Padding ) {
+                    _vrecords.push_back(pheader);
+                }
+                tail += pheader->size;
+            }
+            vheads[iring] = head;
+        }
+        std::stable_sort(_vrecords.begin(), _vrecords.end(), _CompareTimestamp);
+
+        _output.resize(0);
+        FOREACH(itrecord, _vrecords) {
+            _FormatRecord(**itrecord);
+        }
+        for(size_t iring = 0; iring < vrings.size(); ++iring) {
+            AsyncLogRing& ring = *vrings[iring];
+            ring._tail.store(vheads[iring], boost::memory_order_release);
+            uint64_t numdropped = ring._numdropped.load(boost::memory_order_relaxed);
+            if( numdropped > ring._numreporteddropped ) {
+                _message = str(boost::format("asynchronous logging dropped %d messages of thread %s, consider increasing the buffer size\n")%(numdropped-ring._numreporteddropped)%ring._threadname);
+                _WriteMessage(Level_Warn, __FILE__, __LINE__, __FUNCTION__, _message);
+                ring._numreporteddropped = numdropped;
+            }
+        }
+        _FlushOutput();
+        _numflushes++;
+
+        // rings of exited threads are released once they are empty
+        boost::mutex::scoped_lock lock(_mutexRings);
+        std::list<AsyncLogRingPtr>::iterator itring = _listrings.begin();
+        while( itring != _listrings.end() ) {
+            if( (*itring)->_bOrphaned && (*itring)->_tail.load() == (*itring)->_head.load() ) {
+                _statsremoved.numlogged += (*itring)->_numlogged.load();
+                _statsremoved.numdropped += (*itring)->_numdropped.load();
+                _statsremoved.numtruncated += (*itring)->_numtruncated.load();
+                itring = _listrings.erase(itring);
+            }
+            else {
+                ++itring;
+            }
+        }
+    }
+
+    AsyncLoggingStatistics GetStatistics()
+    {
+        AsyncLoggingStatistics stats;
+        {
+            boost::mutex::scoped_lock lock(_mutexFlush);
+            stats.numflushes = _numflushes;
+        }
+        boost::mutex::scoped_lock lock(_mutexRings);
+        stats.numlogged = _statsremoved.numlogged;
+        stats.numdropped = _statsremoved.numdropped;
+        stats.numtruncated = _statsremoved.numtruncated;
+        FOREACH(itring, _listrings) {
+            stats.numlogged += (*itring)->_numlogged.load(boost::memory_order_relaxed);
+            stats.numdropped += (*itring)->_numdropped.load(boost::memory_order_relaxed);
+            stats.numtruncated += (*itring)->_numtruncated.load(boost::memory_order_relaxed);
+            if( !(*itring)->_bOrphaned ) {
+                stats.numthreads++;
+            }
+        }
+        return stats;
+    }
+
+private:
+    AsyncLogger() : _numflushes(0), _buffersize(s_nMinRingSize), _generation(0), _flushperiod(10), _bStopFlush(false), _bRegisteredExit(false) {
+        _tlsthreadstate = new boost::thread_specific_ptr<AsyncLogThreadState>(_CleanupThreadState);
+    }
+
+    static void _DisableAtExit()
+    {
+        GetInstance().SetEnabled(false, 0, 0);
+    }
+
+    static bool _CompareTimestamp(const AsyncLogRecordHeader* p0, const AsyncLogRecordHeader* p1)
+    {
+        return p0->timestamp < p1->timestamp;
+    }
+
+    void _FlushThread()
+    {
+        boost::mutex::scoped_lock lock(_mutexCondition);
+        while( !_bStopFlush ) {
+            _condition.timed_wait(lock, boost::get_system_time() + boost::posix_time::milliseconds(_flushperiod));
+            if( _bStopFlush ) {
+                break;
+            }
+            lock.unlock();
+            Flush();
+            lock.lock();
+        }
+    }
+
+    /// \brief reads a string argument, returns false if the payload is exhausted
+    static bool _ReadString(const char*& p, const char* pend, std::string& s)
+    {
+        uint32_t length = 0;
+        if( p + sizeof(length) > pend ) {
+            return false;
+        }
+        memcpy(&length, p, sizeof(length));
+        p += sizeof(length);
+        if( p + length > pend ) {
+            return false;
+        }
+        s.assign(p, length);
+        p += length;
+        return true;
+    }
+
+    template <typename T>
+    static T _ReadValue(const char*& p)
+    {
+        T value;
+        memcpy(&value, p, sizeof(value));
+        p += sizeof(value);
+        return value;
+    }
+
+    static size_t _GetArgumentSize(uint8_t type)
+    {
+        switch(type) {
+        case AsyncLogRecordWriter::AT_Bool: return sizeof(bool);
+        case AsyncLogRecordWriter::AT_Char: return sizeof(char);
+        case AsyncLogRecordWriter::AT_SignedChar: return sizeof(signed char);
+        case AsyncLogRecordWriter::AT_UnsignedChar: return sizeof(unsigned char);
+        case AsyncLogRecordWriter::AT_Short: return sizeof(short);
+        case AsyncLogRecordWriter::AT_UnsignedShort: return sizeof(unsigned short);
+        case AsyncLogRecordWriter::AT_Int: return sizeof(int);
+        case AsyncLogRecordWriter::AT_UnsignedInt: return sizeof(unsigned int);
+        case AsyncLogRecordWriter::AT_Long: return sizeof(long);
+        case AsyncLogRecordWriter::AT_UnsignedLong: return sizeof(unsigned long);
+        case AsyncLogRecordWriter::AT_LongLong: return sizeof(long long);
+        case AsyncLogRecordWriter::AT_UnsignedLongLong: return sizeof(unsigned long long);
+        case AsyncLogRecordWriter::AT_Float: return sizeof(float);
+        case AsyncLogRecordWriter::AT_Double: return sizeof(double);
+        case AsyncLogRecordWriter::AT_LongDouble: return sizeof(long double);
+        case AsyncLogRecordWriter::AT_Pointer: return sizeof(const void*);
+        }
+        return 0;
+    }
+
+    /// \brief formats the boost::format arguments of the payload
+    void _FormatBoost(const std::string& fmt, const char* p, const char* pend, bool bTruncated)
+    {
+        boost::format f(fmt);
+        if( bTruncated ) {
+            f.exceptions(boost::io::all_error_bits ^ (boost::io::too_many_args_bit|boost::io::too_few_args_bit));
+        }
+        while( p < pend ) {
+            uint8_t type = *p++;
+            if( type == AsyncLogRecordWriter::AT_String ) {
+                if( !_ReadString(p, pend, _argument) ) {
+                    break;
+                }
+                f % _argument;
+                continue;
+            }
+            if( p + _GetArgumentSize(type) > pend ) {
+                break;
+            }
+            switch(type) {
+            case AsyncLogRecordWriter::AT_Bool: f % _ReadValue<bool>(p); break;
+            case AsyncLogRecordWriter::AT_Char: f % _ReadValue<char>(p); break;
+            case AsyncLogRecordWriter::AT_SignedChar: f % _ReadValue<signed char>(p); break;
+            case AsyncLogRecordWriter::AT_UnsignedChar: f % _ReadValue<unsigned char>(p); break;
+            case AsyncLogRecordWriter::AT_Short: f % _ReadValue<short>(p); break;
+            case AsyncLogRecordWriter::AT_UnsignedShort: f % _ReadValue<unsigned short>(p); break;
+            case AsyncLogRecordWriter::AT_Int: f % _ReadValue<int>(p); break;
+            case AsyncLogRecordWriter::AT_UnsignedInt: f % _ReadValue<unsigned int>(p); break;
+            case AsyncLogRecordWriter::AT_Long: f % _ReadValue<long>(p); break;
+            case AsyncLogRecordWriter::AT_UnsignedLong: f % _ReadValue<unsigned long>(p); break;
+            case AsyncLogRecordWriter::AT_LongLong: f % _ReadValue<long long>(p); break;
+            case AsyncLogRecordWriter::AT_UnsignedLongLong: f % _ReadValue<unsigned long long>(p); break;
+            case AsyncLogRecordWriter::AT_Float: f % _ReadValue<float>(p); break;
+            case AsyncLogRecordWriter::AT_Double: f % _ReadValue<double>(p); break;
+            case AsyncLogRecordWriter::AT_LongDouble: f % _ReadValue<long double>(p); break;
+            case AsyncLogRecordWriter::AT_Pointer: f % _ReadValue<const void*>(p); break;
+            default:
+                p = pend;
+                break;
+            }
+        }
+        _message = f.str();
+    }
+
+    /// \brief formats one printf conversion with snprintf into _message
+    template <typename T>
+    void _AppendPrintf(const std::string& spec, T value)
+    {
+        char buf[256];
+        int r = snprintf(buf, sizeof(buf), spec.c_str(), value);
+        if( r < 0 ) {
+            return;
+        }
+        if( r < (int)sizeof(buf) ) {
+            _message.append(buf, r);
+        }
+        else {
+            std::vector<char> vbuf(r+1);
+            snprintf(&vbuf[0], vbuf.size(), spec.c_str(), value);
+            _message.append(&vbuf[0], r);
+        }
+    }
+
+    /// \brief replays the printf format string one conversion at a time with the captured arguments
+    void _FormatPrintf(const char* fmt, const char* p, const char* pend)
+    {
+        _message.resize(0);
+        PrintfSpec spec;
+        while( *fmt != 0 ) {
+            const char* ppercent = strchr(fmt, '%');
+            if( !ppercent ) {
+                _message.append(fmt);
+                break;
+            }
+            _message.append(fmt, ppercent-fmt);
+            if( !_ParsePrintfSpec(ppercent+1, spec) ) {
+                _message.append(ppercent);
+                break;
+            }
+            fmt = spec.pend;
+            if( spec.conversion == '%' ) {
+                _message.push_back('%');
+                continue;
+            }
+            if( spec.conversion == 'n' ) {
+                continue;
+            }
+            // substitute the star arguments and normalize the length modifiers to the stored types
+            _spec = "%";
+            bool bValid = true;
+            FOREACHC(itflag, spec.flags) {
+                if( *itflag == '*' ) {
+                    if( p + 1 + sizeof(int) > pend ) {
+                        bValid = false;
+                        break;
+                    }
+                    ++p;
+                    _spec += boost::lexical_cast<std::string>(_ReadValue<int>(p));
+                }
+                else {
+                    _spec.push_back(*itflag);
+                }
+            }
+            if( !bValid || p >= pend ) {
+                _message.append(ppercent);
+                break;
+            }
+            uint8_t type = *p++;
+            if( type == AsyncLogRecordWriter::AT_String ) {
+                if( !_ReadString(p, pend, _argument) ) {
+                    _message.append(ppercent);
+                    break;
+                }
+                _spec.push_back('s');
+                _AppendPrintf(_spec, _argument.c_str());
+                continue;
+            }
+            if( p + _GetArgumentSize(type) > pend ) {
+                _message.append(ppercent);
+                break;
+            }
+            switch(type) {
+            case AsyncLogRecordWriter::AT_Int:
+                if( spec.length == 'H' ) {
+                    _spec += "hh";
+                }
+                else if( spec.length == 'h' ) {
+                    _spec += "h";
+                }
+                else if( spec.conversion == 'C' || (spec.conversion == 'c' && spec.length == 'l') ) {
+                    _spec += "l";
+                }
+                _spec.push_back(spec.conversion == 'C' ? 'c' : spec.conversion);
+                if( spec.conversion == 'C' || (spec.conversion == 'c' && spec.length == 'l') ) {
+                    _AppendPrintf(_spec, (wint_t)_ReadValue<int>(p));
+                }
+                else {
+                    _AppendPrintf(_spec, _ReadValue<int>(p));
+                }
+                break;
+            case AsyncLogRecordWriter::AT_Long:
+                _spec += "l";
+                _spec.push_back(spec.conversion);
+                _AppendPrintf(_spec, _ReadValue<long>(p));
+                break;
+            case AsyncLogRecordWriter::AT_LongLong:
+                _spec += "ll";
+                _spec.push_back(spec.conversion);
+                _AppendPrintf(_spec, _ReadValue<long long>(p));
+                break;
+            case AsyncLogRecordWriter::AT_Double:
+                _spec.push_back(spec.conversion);
+                _AppendPrintf(_spec, _ReadValue<double>(p));
+                break;
+            case AsyncLogRecordWriter::AT_LongDouble:
+                _spec += "L";
+                _spec.push_back(spec.conversion);
+                _AppendPrintf(_spec, _ReadValue<long double>(p));
+                break;
+            case AsyncLogRecordWriter::AT_Pointer:
+                _spec.push_back('p');
+                _AppendPrintf(_spec, _ReadValue<const void*>(p));
+                break;
+            default:
+                _message.append(ppercent);
+                return;
+            }
+        }
+    }
+
+    void _FormatRecord(const AsyncLogRecordHeader& header)
+    {
+        const char* p = reinterpret_cast<const char*>(&header) + sizeof(AsyncLogRecordHeader);
+        const char* pend = reinterpret_cast<const char*>(&header) + header.size;
+        bool bTruncated = !!(header.flags & ALRF_Truncated);
+        // the format string is stored as the first string of the payload
+        _format.resize(0);
+        if( !_ReadString(p, pend, _format) ) {
+            return;
+        }
+
+        try {
+            switch(header.type) {
+            case ALRT_String:
+                _message = _format;
+                break;
+            case ALRT_Printf:
+                _FormatPrintf(_format.c_str(), p, pend);
+                break;
+            case ALRT_Format:
+                _FormatBoost(_format, p, pend, bTruncated);
+                break;
+            default:
+                return;
+            }
+        }
+        catch(const std::exception& ex) {
+            _message = _format + " [" + ex.what() + "]";
+        }
+        if( bTruncated ) {
+            if( _message.size() > 0 && _message[_message.size()-1] == '\n' ) {
+                _message.insert(_message.size()-1, " [truncated]");
+            }
+            else {
+                _message += " [truncated]";
+            }
+        }
+        if( header.type != ALRT_Printf && (_message.size() == 0 || _message[_message.size()-1] != '\n') ) {
+            _message.push_back('\n');
+        }
+        _WriteMessage(header.level, header.filename, header.line, header.function, _message);
+    }
+
+    void _WriteMessage(int level, const char* filename, int line, const char* function, const std::string& message)
+    {
+        filename = RaveGetSourceFilename(filename);
+#if OPENRAVE_LOG4CXX
+        log4cxx::LoggerPtr logger = RaveGetLogger();
+        if( !!logger ) {
+            log4cxx::LevelPtr levelptr = log4cxx::Level::getInfo();
+            switch(level&Level_OutputMask) {
+            case Level_Fatal: levelptr = log4cxx::Level::getFatal(); break;
+            case Level_Error: levelptr = log4cxx::Level::getError(); break;
+            case Level_Warn: levelptr = log4cxx::Level::getWarn(); break;
+            case Level_Info: levelptr = log4cxx::Level::getInfo(); break;
+            case Level_Debug: levelptr = log4cxx::Level::getDebug(); break;
+            case Level_Verbose: levelptr = RaveGetVerboseLogLevel(); break;
+            }
+            if( logger->isEnabledFor(levelptr) ) {
+                size_t length = message.size();
+                if( length > 0 && message[length-1] == '\n' ) {
+                    --length;
+                }
+                logger->forcedLog(levelptr, message.substr(0, length), log4cxx::spi::LocationInfo(filename, function, line));
+            }
+            return;
+        }
+#endif
+        int color = -1;
+#ifndef _WIN32
+        switch(level&Level_OutputMask) {
+        case Level_Fatal: color = OPENRAVECOLOR_FATALLEVEL; break;
+        case Level_Error: color = OPENRAVECOLOR_ERRORLEVEL; break;
+        case Level_Warn: color = OPENRAVECOLOR_WARNLEVEL; break;
+        case Level_Debug: color = OPENRAVECOLOR_DEBUGLEVEL; break;
+        case Level_Verbose: color = OPENRAVECOLOR_VERBOSELEVEL; break;
+        }
+#endif
+        if( color >= 0 ) {
+            _output += ChangeTextColor(0, color, 8);
+        }
+        char header[32];
+        _output.push_back('[');
+        _output += filename;
+        snprintf(header, sizeof(header), ":%d ", line);
+        _output += header;
+        _output += function;
+        _output += "] ";
+        if( color >= 0 && message.size() > 0 && message[message.size()-1] == '\n' ) {
+            _output.append(message, 0, message.size()-1);
+            _output += ResetTextColor();
+            _output.push_back('\n');
+        }
+        else {
+            _output += message;
+            if( color >= 0 ) {
+                _output += ResetTextColor();
+            }
+        }
+    }
+
+    void _FlushOutput()
+    {
+        if( _output.size() > 0 ) {
+            fwrite(_output.c_str(), 1, _output.size(), stdout);
+            fflush(stdout);
+            _output.resize(0);
+        }
+    }
+
+    boost::thread_specific_ptr<AsyncLogThreadState>* _tlsthreadstate; ///< cleans up the ring of exited threads, never destroyed
+
+    boost::mutex _mutexRings; ///< protects _listrings
+    std::list<AsyncLogRingPtr> _listrings;
+    AsyncLoggingStatistics _statsremoved; ///< counters of the rings already released
+
+    boost::mutex _mutexFlush; ///< serializes the consumers of the rings
+    std::vector<const AsyncLogRecordHeader*> _vrecords;
+    std::string _format, _message, _argument, _spec, _output; ///< scratch buffers of the consumer
+    uint64_t _numflushes;
+
+    boost::mutex _mutexThread; ///< serializes SetEnabled
+    boost::mutex _mutexCondition;
+    boost::condition _condition;
+    boost::shared_ptr<boost::thread> _threadflush;
+    uint32_t _buffersize;
+    volatile uint32_t _generation;
+    uint32_t _flushperiod;
+    bool _bStopFlush;
+    bool _bRegisteredExit;
+};
+
+/// \brief starts a record in the scratch buffer of the calling thread, returns NULL if the record has to be dropped
+static AsyncLogRecordState* _BeginRecord(uint8_t type, int level, const char* filename, int line, const char* function, const char* fmt, size_t fmtlength)
+{
+    AsyncLogThreadState* pthread = AsyncLogger::GetInstance().GetThreadState();
+    if( pthread->depth >= (int)pthread->records.size() ) {
+        AsyncLogRing::_Increment(pthread->ring->_numdropped);
+        return NULL;
+    }
+    AsyncLogRecordState* precord = &pthread->records[pthread->depth++];
+    if( precord->vscratch.size() == 0 ) {
+        precord->vscratch.resize(s_nMaxRecordSize);
+    }
+    precord->bFull = false;
+    AsyncLogRecordHeader* pheader = reinterpret_cast<AsyncLogRecordHeader*>(&precord->vscratch[0]);
+    pheader->type = type;
+    pheader->level = (uint8_t)(level&Level_OutputMask);
+    pheader->flags = 0;
+    pheader->reserved = 0;
+    pheader->line = line;
+    pheader->timestamp = utils::GetNanoPerformanceTime();
+    pheader->filename = filename;
+    pheader->function = function;
+    precord->pcur = &precord->vscratch[0] + sizeof(AsyncLogRecordHeader);
+    precord->pend = &precord->vscratch[0] + precord->vscratch.size();
+    uint32_t length = (uint32_t)std::min(fmtlength, (size_t)(precord->pend - precord->pcur - sizeof(uint32_t)));
+    if( length < fmtlength ) {
+        pheader->flags |= ALRF_Truncated;
+        precord->bFull = true;
+    }
+    memcpy(precord->pcur, &length, sizeof(length));
+    memcpy(precord->pcur + sizeof(length), fmt, length);
+    precord->pcur += sizeof(length) + length;
+    return precord;
+}
+
+static void _WriteArgument(AsyncLogRecordState* precord, uint8_t type, const void* pvalue, size_t size)
+{
+    if( precord->bFull ) {
+        return;
+    }
+    if( precord->pcur + 1 + size > precord->pend ) {
+        reinterpret_cast<AsyncLogRecordHeader*>(&precord->vscratch[0])->flags |= ALRF_Truncated;
+        precord->bFull = true;
+        return;
+    }
+    *precord->pcur++ = type;
+    memcpy(precord->pcur, pvalue, size);
+    precord->pcur += size;
+}
+
+static void _WriteStringArgument(AsyncLogRecordState* precord, const char* s, size_t length)
+{
+    if( precord->bFull ) {
+        return;
+    }
+    size_t available = precord->pend - precord->pcur;
+    if( available < 1 + sizeof(uint32_t) ) {
+        reinterpret_cast<AsyncLogRecordHeader*>(&precord->vscratch[0])->flags |= ALRF_Truncated;
+        precord->bFull = true;
+        return;
+    }
+    uint32_t storedlength = (uint32_t)std::min(length, available - 1 - sizeof(uint32_t));
+    if( storedlength < length ) {
+        reinterpret_cast<AsyncLogRecordHeader*>(&precord->vscratch[0])->flags |= ALRF_Truncated;
+        precord->bFull = true;
+    }
+    *precord->pcur++ = AsyncLogRecordWriter::AT_String;
+    memcpy(precord->pcur, &storedlength, sizeof(storedlength));
+    memcpy(precord->pcur + sizeof(storedlength), s, storedlength);
+    precord->pcur += sizeof(storedlength) + storedlength;
+}
+
+static void _CommitRecord(AsyncLogRecordState* precord)
+{
+    AsyncLogThreadState* pthread = precord->pthread;
+    AsyncLogRecordHeader* pheader = reinterpret_cast<AsyncLogRecordHeader*>(&precord->vscratch[0]);
+    pheader->size = _AlignRecordSize(precord->pcur - &precord->vscratch[0]);
+    if( pheader->flags & ALRF_Truncated ) {
+        AsyncLogRing::_Increment(pthread->ring->_numtruncated);
+    }
+    pthread->ring->Push(&precord->vscratch[0], pheader->size);
+    pthread->depth--;
+    if( pheader->level == Level_Fatal ) {
+        AsyncLogger::GetInstance().Flush();
+    }
+}
+
+/// \brief pulls the arguments of one printf conversion out of the variable argument list
+static bool _CapturePrintfArgument(AsyncLogRecordState* precord, const PrintfSpec& spec, va_list& list)
+{
+    for(int istar = 0; istar < spec.numstars; ++istar) {
+        int value = va_arg(list, int);
+        _WriteArgument(precord, AsyncLogRecordWriter::AT_Int, &value, sizeof(value));
+    }
+    switch(spec.conversion) {
+    case 'd': case 'i': case 'o': case 'u': case 'x': case 'X': case 'c': case 'C':
+        if( spec.length == 'l' && spec.conversion != 'c' && spec.conversion != 'C' ) {
+            long value = va_arg(list, long);
+            _WriteArgument(precord, AsyncLogRecordWriter::AT_Long, &value, sizeof(value));
+        }
+        else if( spec.length == 'L' ) {
+            long long value = va_arg(list, long long);
+            _WriteArgument(precord, AsyncLogRecordWriter::AT_LongLong, &value, sizeof(value));
+        }
+        else if( spec.length == 'j' ) {
+            long long value = (long long)va_arg(list, intmax_t);
+            _WriteArgument(precord, AsyncLogRecordWriter::AT_LongLong, &value, sizeof(value));
+        }
+        else if( spec.length == 'z' ) {
+            long long value = (long long)va_arg(list, size_t);
+            _WriteArgument(precord, AsyncLogRecordWriter::AT_LongLong, &value, sizeof(value));
+        }
+        else if( spec.length == 't' ) {
+            long long value = (long long)va_arg(list, ptrdiff_t);
+            _WriteArgument(precord, AsyncLogRecordWriter::AT_LongLong, &value, sizeof(value));
+        }
+        else if( spec.conversion == 'C' || (spec.conversion == 'c' && spec.length == 'l') ) {
+            int value = (int)va_arg(list, wint_t);
+            _WriteArgument(precord, AsyncLogRecordWriter::AT_Int, &value, sizeof(value));
+        }
+        else {
+            int value = va_arg(list, int);
+            _WriteArgument(precord, AsyncLogRecordWriter::AT_Int, &value, sizeof(value));
+        }
+        return true;
+    case 'e': case 'E': case 'f': case 'F': case 'g': case 'G': case 'a': case 'A':
+        if( spec.length == 'L' ) {
+            long double value = va_arg(list, long double);
+            _WriteArgument(precord, AsyncLogRecordWriter::AT_LongDouble, &value, sizeof(value));
+        }
+        else {
+            double value = va_arg(list, double);
+            _WriteArgument(precord, AsyncLogRecordWriter::AT_Double, &value, sizeof(value));
+        }
+        return true;
+    case 's': case 'S':
+        if( spec.conversion == 'S' || spec.length == 'l' ) {
+            const wchar_t* ws = va_arg(list, const wchar_t*);
+            std::string s;
+            if( !!ws ) {
+                size_t length = wcstombs(NULL, ws, 0);
+                if( length != (size_t)-1 ) {
+                    s.resize(length);
+                    if( length > 0 ) {
+                        wcstombs(&s[0], ws, length);
+                    }
+                }
+            }
+            else {
+                s = "(null)";
+            }
+            _WriteStringArgument(precord, s.c_str(), s.size());
+        }
+        else {
+            const char* s = va_arg(list, const char*);
+            if( !s ) {
+                s = "(null)";
+            }
+            _WriteStringArgument(precord, s, strlen(s));
+        }
+        return true;
+    case 'm': {
+        const char* s = strerror(errno);
+        _WriteStringArgument(precord, s, strlen(s));
+        return true;
+    }
+    case 'p': {
+        const void* value = va_arg(list, const void*);
+        _WriteArgument(precord, AsyncLogRecordWriter::AT_Pointer, &value, sizeof(value));
+        return true;
+    }
+    case 'n':
+        va_arg(list, void*);
+        return true;
+    case '%':
+        return true;
+    }
+    return false;
+}
+
+} // end namespace
+
+void RaveSetAsyncLogging(bool bEnable, uint32_t buffersize, uint32_t flushperiod)
+{
+    AsyncLogger::GetInstance().SetEnabled(bEnable, buffersize, flushperiod);
+}
+
+bool RaveIsAsyncLogging()
+{
+    return s_bAsyncLogging.load(boost::memory_order_relaxed);
+}
+
+void RaveFlushLog()
+{
+    AsyncLogger::GetInstance().Flush();
+}
+
+AsyncLoggingSuspender::AsyncLoggingSuspender() : _bSuspended(false), _buffersize(0), _flushperiod(0)
+{
+    if( RaveIsAsyncLogging() ) {
+        AsyncLogger::GetInstance().GetSettings(_buffersize, _flushperiod);
+        AsyncLogger::GetInstance().SetEnabled(false, 0, 0);
+        _bSuspended = true;
+    }
+}
+
+AsyncLoggingSuspender::~AsyncLoggingSuspender()
+{
+    if( _bSuspended ) {
+        AsyncLogger::GetInstance().SetEnabled(true, _buffersize, _flushperiod);
+    }
+}
+
+AsyncLoggingStatistics RaveGetAsyncLoggingStatistics()
+{
+    return AsyncLogger::GetInstance().GetStatistics();
+}
+
+void RaveAsyncLogPrintf(int level, const char* filename, int line, const char* function, const char* fmt, ...)
+{
+    if( !fmt ) {
+        return;
+    }
+    AsyncLogRecordState* precord = _BeginRecord(ALRT_Printf, level, filename, line, function, fmt, strlen(fmt));
+    if( !precord ) {
+        return;
+    }
+    va_list list;
+    va_start(list, fmt);
+    PrintfSpec spec;
+    const char* p = strchr(fmt, '%');
+    while( !!p && !precord->bFull ) {
+        if( !_ParsePrintfSpec(p+1, spec) || !_CapturePrintfArgument(precord, spec, list) ) {
+            break;
+        }
+        p = strchr(spec.pend, '%');
+    }
+    va_end(list);
+    _CommitRecord(precord);
+}
+
+void RaveAsyncLogPrintf(int level, const char* filename, int line, const char* function, const std::string& s)
+{
+    AsyncLogRecordState* precord = _BeginRecord(ALRT_String, level, filename, line, function, s.c_str(), s.size());
+    if( !!precord ) {
+        _CommitRecord(precord);
+    }
+}
+
+void AsyncLogRecordWriter::_Begin(int level, const char* filename, int line, const char* function, const char* fmt, size_t fmtlength)
+{
+    _pstate = _BeginRecord(ALRT_Format, level, filename, line, function, fmt, fmtlength);
+}
+
+void AsyncLogRecordWriter::_Write(uint8_t type, const void* pvalue, size_t size)
+{
+    if( !!_pstate ) {
+        _WriteArgument(static_cast<AsyncLogRecordState*>(_pstate), type, pvalue, size);
+    }
+}
+
+void AsyncLogRecordWriter::_WriteString(const char* s, size_t length)
+{
+    if( !!_pstate ) {
+        _WriteStringArgument(static_cast<AsyncLogRecordState*>(_pstate), s, length);
+    }
+}
+
+void AsyncLogRecordWriter::_Commit()
+{
+    if( !!_pstate ) {
+        _CommitRecord(static_cast<AsyncLogRecordState*>(_pstate));
+        _pstate = NULL;
+    }
+}
+
+} // end namespace OpenRAVE
@@ -1365,10 +1365,12 @@ bool CompareNonAdjacentFarthest(int pair0, int pair1); // defined in kinbody.cpp
 const std::vector<int>& RobotBase::GetNonAdjacentLinks(int adjacentoptions) const
 {
     KinBody::GetNonAdjacentLinks(0); // need to call to set the cache
-    if( (_nNonAdjacentLinkCache&adjacentoptions) != adjacentoptions ) {
-        int requestedoptions = (~_nNonAdjacentLinkCache)&adjacentoptions;
+    // AO_SampledColliding is always valid once _vNonAdjacentLinks[0] is, so only the other options are tracked
+    int cacheoptions = adjacentoptions&~AO_SampledColliding;
+    if( (_nNonAdjacentLinkCache&cacheoptions) != cacheoptions ) {
+        int requestedoptions = (~_nNonAdjacentLinkCache)&cacheoptions;
         // find out what needs to computed
-        boost::array<uint8_t,4> compute={ { 0,0,0,0}};
+        boost::array<uint8_t,8> compute={ { 0,0,0,0,0,0,0,0}};
         if( requestedoptions & AO_Enabled ) {
             for(size_t i = 0; i < compute.size(); ++i) {
                 if( i & AO_Enabled ) {
@@ -1387,38 +1389,40 @@ const std::vector<int>& RobotBase::GetNonAdjacentLinks(int adjacentoptions) cons
             throw OPENRAVE_EXCEPTION_FORMAT(_("does not support adjacentoptions %d"),adjacentoptions,ORE_InvalidArguments);
         }
 
-        // compute it
-        if( compute.at(AO_Enabled) ) {
-            _vNonAdjacentLinks.at(AO_Enabled).resize(0);
-            FOREACHC(itset, _vNonAdjacentLinks[0]) {
-                KinBody::LinkConstPtr plink1(_veclinks.at(*itset&0xffff)), plink2(_veclinks.at(*itset>>16));
-                if( plink1->IsEnabled() && plink2->IsEnabled() ) {
-                    _vNonAdjacentLinks[AO_Enabled].push_back(*itset);
+        // compute it, the AO_SampledColliding lists are derived from _vNonAdjacentLinks[AO_SampledColliding] the same way
+        for(int sampled = 0; sampled <= AO_SampledColliding; sampled += AO_SampledColliding) {
+            if( compute.at(sampled|AO_Enabled) ) {
+                _vNonAdjacentLinks.at(sampled|AO_Enabled).resize(0);
+                FOREACHC(itset, _vNonAdjacentLinks[sampled]) {
+                    KinBody::LinkConstPtr plink1(_veclinks.at(*itset&0xffff)), plink2(_veclinks.at(*itset>>16));
+                    if( plink1->IsEnabled() && plink2->IsEnabled() ) {
+                        _vNonAdjacentLinks[sampled|AO_Enabled].push_back(*itset);
+                    }
                 }
+                std::sort(_vNonAdjacentLinks[sampled|AO_Enabled].begin(), _vNonAdjacentLinks[sampled|AO_Enabled].end(), CompareNonAdjacentFarthest);
             }
-            std::sort(_vNonAdjacentLinks[AO_Enabled].begin(), _vNonAdjacentLinks[AO_Enabled].end(), CompareNonAdjacentFarthest);
-        }
-        if( compute.at(AO_ActiveDOFs) ) {
-            _vNonAdjacentLinks.at(AO_ActiveDOFs).resize(0);
-            FOREACHC(itset, _vNonAdjacentLinks[0]) {
-                FOREACHC(it, GetActiveDOFIndices()) {
-                    if( IsDOFInChain(*itset&0xffff,*itset>>16,*it) ) {
-                        _vNonAdjacentLinks[AO_ActiveDOFs].push_back(*itset);
-                        break;
+            if( compute.at(sampled|AO_ActiveDOFs) ) {
+                _vNonAdjacentLinks.at(sampled|AO_ActiveDOFs).resize(0);
+                FOREACHC(itset, _vNonAdjacentLinks[sampled]) {
+                    FOREACHC(it, GetActiveDOFIndices()) {
+                        if( IsDOFInChain(*itset&0xffff,*itset>>16,*it) ) {
+                            _vNonAdjacentLinks[sampled|AO_ActiveDOFs].push_back(*itset);
+                            break;
+                        }
                     }
                 }
+                std::sort(_vNonAdjacentLinks[sampled|AO_ActiveDOFs].begin(), _vNonAdjacentLinks[sampled|AO_ActiveDOFs].end(), CompareNonAdjacentFarthest);
             }
-            std::sort(_vNonAdjacentLinks[AO_ActiveDOFs].begin(), _vNonAdjacentLinks[AO_ActiveDOFs].end(), CompareNonAdjacentFarthest);
-        }
-        if( compute.at(AO_Enabled|AO_ActiveDOFs) ) {
-            _vNonAdjacentLinks.at(AO_Enabled|AO_ActiveDOFs).resize(0);
-            FOREACHC(itset, _vNonAdjacentLinks[AO_ActiveDOFs]) {
-                KinBody::LinkConstPtr plink1(_veclinks.at(*itset&0xffff)), plink2(_veclinks.at(*itset>>16));
-                if( plink1->IsEnabled() && plink2->IsEnabled() ) {
-                    _vNonAdjacentLinks[AO_Enabled|AO_ActiveDOFs].push_back(*itset);
+            if( compute.at(sampled|AO_Enabled|AO_ActiveDOFs) ) {
+                _vNonAdjacentLinks.at(sampled|AO_Enabled|AO_ActiveDOFs).resize(0);
+                FOREACHC(itset, _vNonAdjacentLinks[sampled|AO_ActiveDOFs]) {
+                    KinBody::LinkConstPtr plink1(_veclinks.at(*itset&0xffff)), plink2(_veclinks.at(*itset>>16));
+                    if( plink1->IsEnabled() && plink2->IsEnabled() ) {
+                        _vNonAdjacentLinks[sampled|AO_Enabled|AO_ActiveDOFs].push_back(*itset);
+                    }
                 }
+                std::sort(_vNonAdjacentLinks[sampled|AO_Enabled|AO_ActiveDOFs].begin(), _vNonAdjacentLinks[sampled|AO_Enabled|AO_ActiveDOFs].end(), CompareNonAdjacentFarthest);
             }
-            std::sort(_vNonAdjacentLinks[AO_Enabled|AO_ActiveDOFs].begin(), _vNonAdjacentLinks[AO_Enabled|AO_ActiveDOFs].end(), CompareNonAdjacentFarthest);
         }
         _nNonAdjacentLinkCache |= requestedoptions;
     }
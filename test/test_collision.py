@@ -82,6 +82,26 @@ class RunCollision(EnvironmentSetup):
             assert(not target1.CheckSelfCollision())
             assert(self.env.CheckCollision(target1,report))
 
+    def test_releasegil(self):
+        self.log.info('check that the body checks give the same results when releasing the GIL')
+        with self.env:
+            self.LoadEnv('data/lab1.env.xml')
+            target1 = self.env.GetKinBody('mug1')
+            target2 = self.env.GetKinBody('mug2')
+            robot = self.env.GetRobots()[0]
+            for T in [target2.GetTransform(), target1.GetTransform()]:
+                target2.SetTransform(T)
+                report = CollisionReport()
+                collision = self.env.CheckCollision(target2,report)
+                assert(self.env.CheckCollision(target2,releasegil=True) == collision)
+                assert(self.env.CheckCollision(target2,True) == collision)
+                report2 = CollisionReport()
+                assert(self.env.CheckCollision(target2,report2,True) == collision)
+                assert(report2.plink1 == report.plink1 and report2.plink2 == report.plink2)
+                assert(self.env.CheckCollision(target1,target2,True) == self.env.CheckCollision(target1,target2))
+                assert(self.env.CheckCollision(target1,target2,report2,True) == self.env.CheckCollision(target1,target2,report))
+            assert(robot.CheckSelfCollision(releasegil=True) == robot.CheckSelfCollision())
+
     def test_attachedbodiescollision(self):
         with self.env:
             self.LoadEnv('data/lab1.env.xml')
@@ -13,6 +13,7 @@
 # limitations under the License.
 from common_test_openrave import *
 from openravepy import openravepy_configurationcache
+import threading
 
 class TestConfigurationCache(EnvironmentSetup):
     def setup(self):
@@ -135,6 +136,95 @@ class TestConfigurationCache(EnvironmentSetup):
             self.log.info('writing cache to file...')
             cachechecker.SendCommand('SaveCache')
 
+    def test_saveload(self):
+        import struct
+        self.LoadEnv('data/lab1.env.xml')
+        env=self.env
+        robot=env.GetRobots()[0]
+        robot.SetActiveDOFs(range(7))
+        sampler = RaveCreateSpaceSampler(env, u'MT19937')
+        sampler.SetSpaceDOF(robot.GetActiveDOF())
+        sampler.SetSeed(0)
+        lower,upper = robot.GetActiveDOFLimits()
+        report=CollisionReport()
+        with env:
+            cache=openravepy_configurationcache.ConfigurationCache(robot)
+            for i in range(2000):
+                robot.SetActiveDOFValues(lower+sampler.SampleSequence(SampleDataType.Real,1)*(upper-lower))
+                values = robot.GetActiveDOFValues()
+                incollision = env.CheckCollision(robot, report=report)
+                cache.InsertConfiguration(values, report if incollision else None)
+            assert(cache.SaveCache('testconfigurationcache') == 1)
+            queries = [lower+sampler.SampleSequence(SampleDataType.Real,1)*(upper-lower) for i in range(200)]
+
+            # only the root is created when loading, the rest of the nodes are created by the queries that reach them
+            loadedcache=openravepy_configurationcache.ConfigurationCache(robot)
+            assert(loadedcache.LoadCache('testconfigurationcache') == 1)
+            assert(loadedcache.GetNumNodes() == cache.GetNumNodes())
+            assert(loadedcache.GetNumMappedNodes() == cache.GetNumNodes()-1)
+            for values in queries:
+                nn = cache.FindNearestNode(values, 0)
+                loadednn = loadedcache.FindNearestNode(values, 0)
+                assert(sum(abs(nn[0]-loadednn[0])) <= 1e-7 and abs(nn[1]-loadednn[1]) <= 1e-7)
+                if values is queries[0]:
+                    assert(0 < loadedcache.GetNumMappedNodes() < cache.GetNumNodes()-1)
+            for values in queries:
+                assert(cache.CheckCollision(values)[0] == loadedcache.CheckCollision(values)[0])
+            nodevalues = reshape(cache.GetNodeValues(),(-1,robot.GetActiveDOF()))
+            loadednodevalues = reshape(loadedcache.GetNodeValues(),(-1,robot.GetActiveDOF()))
+            assert(loadedcache.GetNumMappedNodes() == 0)
+            assert(abs(array(sorted(map(tuple,nodevalues))) - array(sorted(map(tuple,loadednodevalues)))).max() <= 1e-7)
+            assert(loadedcache.Validate())
+
+            # the cache is not loaded once the environment, the robot base or the dofs outside of the cache changed
+            body = env.GetKinBody('mug1')
+            T = body.GetTransform()
+            body.SetTransform(matrixFromPose([1,0,0,0,T[0,3]+0.1,T[1,3],T[2,3]]))
+            assert(loadedcache.LoadCache('testconfigurationcache') == 0)
+            body.SetTransform(T)
+            assert(loadedcache.LoadCache('testconfigurationcache') == 1)
+            Trobot = robot.GetTransform()
+            robot.SetTransform(matrixFromPose([1,0,0,0,Trobot[0,3],Trobot[1,3]+0.05,Trobot[2,3]]))
+            assert(loadedcache.LoadCache('testconfigurationcache') == 0)
+            robot.SetTransform(Trobot)
+            dofvalues = robot.GetDOFValues()
+            fingervalues = array(dofvalues)
+            fingervalues[robot.GetActiveManipulator().GetGripperIndices()[0]] += 0.2
+            robot.SetDOFValues(fingervalues)
+            assert(loadedcache.LoadCache('testconfigurationcache') == 0)
+            robot.SetDOFValues(dofvalues)
+            assert(loadedcache.LoadCache('testconfigurationcache') == 1)
+
+            # corrupted files are not loaded
+            filename = RaveFindDatabaseFile('testconfigurationcache', False)
+            data = open(filename, 'rb').read()
+            realsize, = struct.unpack_from('<I', data, 12)
+            rootindex, numbodies = struct.unpack_from('<ii', data, 32)
+            offsetsoffset = 48+3*realsize+128
+            weightsoffset, nodesoffset, childrenoffset, statesoffset = struct.unpack_from('<QQQQ', data, offsetsoffset)
+            rootfirstchild, rootnumchildren = struct.unpack_from('<ii', data, nodesoffset+32*rootindex+8)
+            firstchildindex, = struct.unpack_from('<i', data, childrenoffset+4*rootfirstchild)
+            def patch(offset, format, *values):
+                patched = bytearray(data)
+                struct.pack_into(format, patched, offset, *values)
+                return str(patched)
+            corruptions = [data[:-3], # truncated
+                           patch(offsetsoffset, '<Q', 1<<40), # weights out of bounds
+                           patch(offsetsoffset+16, '<Q', nodesoffset+8), # children overlap the nodes
+                           patch(nodesoffset+32*rootindex+8, '<i', (statesoffset-childrenoffset)//4), # children out of the children section
+                           patch(childrenoffset+4*rootfirstchild, '<i', rootindex), # cycle
+                           patch(childrenoffset+4*rootfirstchild, '<i', 1<<30)] # child out of bounds
+            if numbodies > 0:
+                corruptions.append(data[:-1]+'x') # body name not terminated
+            try:
+                for corrupteddata in corruptions:
+                    open(filename, 'wb').write(corrupteddata)
+                    assert(loadedcache.LoadCache('testconfigurationcache') == 0)
+            finally:
+                open(filename, 'wb').write(data)
+            assert(loadedcache.LoadCache('testconfigurationcache') == 1)
+            assert(loadedcache.Validate())
+
     def test_find_insert(self):
 
         self.LoadEnv('data/lab1.env.xml')
@@ -163,6 +253,52 @@ class TestConfigurationCache(EnvironmentSetup):
 
              self.log.info('exhaustive insertion test passed')
 
+    def test_removenode(self):
+        self.LoadEnv('data/lab1.env.xml')
+        env=self.env
+        robot=env.GetRobots()[0]
+        robot.SetActiveDOFs(range(7))
+        cache=openravepy_configurationcache.ConfigurationCache(robot)
+        sampler = RaveCreateSpaceSampler(env, u'MT19937')
+        sampler.SetSpaceDOF(robot.GetActiveDOF())
+        sampler.SetSeed(0)
+        lower,upper = robot.GetActiveDOFLimits()
+        def checknearestnodes():
+            # the nearest nodes are the same as the ones found by brute force
+            assert(cache.Validate())
+            nodevalues = reshape(cache.GetNodeValues(),(-1,robot.GetActiveDOF()))
+            for iquery in range(100):
+                values = lower+sampler.SampleSequence(SampleDataType.Real,1)*(upper-lower)
+                nn = cache.FindNearestNode(values, 0)
+                assert(nn is not None)
+                assert(abs(nn[1] - min([cache.ComputeDistance(values, nodevalue) for nodevalue in nodevalues])) <= 1e-7)
+
+        with env:
+            inserted = []
+            for i in range(1000):
+                values = lower+sampler.SampleSequence(SampleDataType.Real,1)*(upper-lower)
+                if cache.InsertConfiguration(values, None) == 1:
+                    inserted.append(values)
+            checknearestnodes()
+
+            # the first configuration is the root, its children have to be moved up or become the new root
+            removed = [inserted[0]] + inserted[1::3]
+            numnodes = cache.GetNumNodes()
+            for values in removed:
+                assert(cache.RemoveNode(values))
+            assert(cache.GetNumNodes() < numnodes)
+            checknearestnodes()
+
+            for values in removed:
+                cache.InsertConfiguration(values, None)
+            checknearestnodes()
+
+            # removing all the nodes leaves an empty tree
+            while cache.GetNumNodes() > 0:
+                assert(cache.RemoveNode(reshape(cache.GetNodeValues(),(-1,robot.GetActiveDOF()))[0]))
+            assert(cache.Validate())
+            assert(cache.FindNearestNode(inserted[0], 0) is None)
+
     def test_updates(self):
         env = self.env
         with env:
@@ -215,6 +351,226 @@ class TestConfigurationCache(EnvironmentSetup):
             assert(int(cachechecker.SendCommand('ValidateSelfCache')) == 1)
             self.log.info('valid tests passed')
 
+    def test_sharedcache(self):
+        env=self.env
+        self.LoadEnv('data/lab1.env.xml')
+        with env:
+            robot=env.GetRobots()[0]
+            robot.SetActiveDOFs(robot.GetActiveManipulator().GetArmIndices())
+            cachechecker = RaveCreateCollisionChecker(env,'CacheChecker')
+            env.SetCollisionChecker(cachechecker)
+            success=cachechecker.SendCommand('TrackRobotState %s'%robot.GetName())
+            assert(success is not None)
+            cachechecker.SendCommand('SetShareCache 1')
+
+        clonedenv = env.CloneSelf(CloningOptions.Bodies)
+        try:
+            with env:
+                with clonedenv:
+                    values = robot.GetActiveDOFValues()
+                    incollision = env.CheckCollision(robot)
+
+                    # the checker of the clone finds the configuration checked in the original environment
+                    clonedrobot = clonedenv.GetRobot(robot.GetName())
+                    clonedrobot.SetActiveDOFValues(values)
+                    assert(clonedenv.CheckCollision(clonedrobot) == incollision)
+                    cachedcollisions, cachedcollisionhits, cachedfreehits, cachesize = clonedenv.GetCollisionChecker().SendCommand('GetCacheStatistics').split()
+                    assert(int(cachedcollisionhits)+int(cachedfreehits) == 1)
+
+                    sharedstats = cachechecker.SendCommand('GetSharedCacheStatistics').splitlines()
+                    assert(len(sharedstats) == 2)
+                    self.log.info('shared cache statistics: %s', sharedstats)
+        finally:
+            clonedenv.Destroy()
+
+    def test_sharedcachediverged(self):
+        env=self.env
+        self.LoadEnv('data/lab1.env.xml')
+        with env:
+            robot=env.GetRobots()[0]
+            robot.SetActiveDOFs(robot.GetActiveManipulator().GetArmIndices())
+            cachechecker = RaveCreateCollisionChecker(env,'CacheChecker')
+            env.SetCollisionChecker(cachechecker)
+            success=cachechecker.SendCommand('TrackRobotState %s'%robot.GetName())
+            assert(success is not None)
+            cachechecker.SendCommand('SetShareCache 1')
+
+            # far away from the robot in both environments
+            part = RaveCreateKinBody(env,'')
+            part.InitFromBoxes(array([[0,0,0,0.2,0.2,0.2]]),True)
+            part.SetName('part')
+            part.SetTransform(matrixFromPose([1,0,0,0]+list(robot.GetTransform()[0:3,3]+[5,5,0])))
+            env.Add(part)
+
+        clonedenv = env.CloneSelf(CloningOptions.Bodies)
+        try:
+            with env:
+                with clonedenv:
+                    # the checker of the clone shares the cache once it finds its robot
+                    clonedrobot = clonedenv.GetRobot(robot.GetName())
+                    clonedenv.CheckCollision(clonedrobot)
+                    assert(len(cachechecker.SendCommand('GetSharedCacheStatistics').splitlines()) == 2)
+
+                    # fill the shared cache from the original environment
+                    lower,upper = robot.GetActiveDOFLimits()
+                    random.seed(0)
+                    samples = [lower+random.rand(len(lower))*(upper-lower) for i in range(300)]
+                    for values in samples:
+                        robot.SetActiveDOFValues(values)
+                        env.CheckCollision(robot)
+                    cachedcollisions, cachedcollisionhits, cachedfreehits, cachesize = cachechecker.SendCommand('GetCacheStatistics').split()
+
+                    # move the part into the workspace of the robot in the clone only
+                    clonedpart = clonedenv.GetKinBody('part')
+                    clonedpart.SetTransform(matrixFromPose([1,0,0,0]+list(robot.GetActiveManipulator().GetTransform()[0:3,3])))
+                    assert(len(cachechecker.SendCommand('GetSharedCacheStatistics').splitlines()) == 1)
+
+                    # the free configurations of the original environment are not used by the clone
+                    rawchecker = RaveCreateCollisionChecker(clonedenv,'ode')
+                    rawchecker.InitEnvironment()
+                    numcollisions = 0
+                    for values in samples:
+                        clonedrobot.SetActiveDOFValues(values)
+                        if rawchecker.CheckCollision(clonedrobot):
+                            numcollisions += 1
+                            assert(clonedenv.CheckCollision(clonedrobot))
+                    assert(numcollisions > 0)
+
+                    # the original environment keeps its configurations
+                    cachedcollisions, cachedcollisionhits, cachedfreehits, movecachesize = cachechecker.SendCommand('GetCacheStatistics').split()
+                    assert(int(movecachesize) == int(cachesize))
+        finally:
+            clonedenv.Destroy()
+
+    def test_sharedcachethreads(self):
+        env=self.env
+        self.LoadEnv('data/lab1.env.xml')
+        with env:
+            robot=env.GetRobots()[0]
+            robot.SetActiveDOFs(robot.GetActiveManipulator().GetArmIndices())
+            cachechecker = RaveCreateCollisionChecker(env,'CacheChecker')
+            env.SetCollisionChecker(cachechecker)
+            success=cachechecker.SendCommand('TrackRobotState %s'%robot.GetName())
+            assert(success is not None)
+            cachechecker.SendCommand('SetShareCache 1')
+            lower,upper = robot.GetActiveDOFLimits()
+
+        numthreads = 3
+        numsamples = 200
+        clonedenvs = [env.CloneSelf(CloningOptions.Bodies) for i in range(numthreads)]
+        try:
+            for clonedenv in clonedenvs:
+                with clonedenv:
+                    clonedenv.CheckCollision(clonedenv.GetRobot(robot.GetName()))
+            with env:
+                initialstats = dict((stats[0],[int(x) for x in stats[1:]]) for stats in [line.split() for line in cachechecker.SendCommand('GetSharedCacheStatistics').splitlines()])
+            assert(len(initialstats) == numthreads+1)
+
+            errors = []
+            def QueryAndInsert(clonedenv, seed):
+                try:
+                    randomstate = random.RandomState(seed)
+                    with clonedenv:
+                        clonedrobot = clonedenv.GetRobot(robot.GetName())
+                        rawchecker = RaveCreateCollisionChecker(clonedenv,'ode')
+                        rawchecker.InitEnvironment()
+                        for i in range(numsamples):
+                            clonedrobot.SetActiveDOFValues(lower+randomstate.rand(len(lower))*(upper-lower))
+                            # the cache can only report more collisions than the checker it wraps
+                            if rawchecker.CheckCollision(clonedrobot) and not clonedenv.CheckCollision(clonedrobot):
+                                errors.append('free configuration returned for a colliding one')
+                except Exception, e:
+                    errors.append(str(e))
+
+            # every clone queries and inserts into the shared tree at the same time
+            threads = [threading.Thread(target=QueryAndInsert, args=(clonedenv,ithread)) for ithread, clonedenv in enumerate(clonedenvs)]
+            for thread in threads:
+                thread.start()
+            for thread in threads:
+                thread.join()
+            assert(len(errors) == 0)
+
+            with env:
+                assert(int(cachechecker.SendCommand('ValidateCache')) == 1)
+                sharedstats = [line.split() for line in cachechecker.SendCommand('GetSharedCacheStatistics').splitlines()]
+                cachedcollisions, cachedcollisionhits, cachedfreehits, cachesize = cachechecker.SendCommand('GetCacheStatistics').split()
+            assert(len(sharedstats) == numthreads+1)
+            clonenames = ['%s:%d'%(robot.GetName(),RaveGetEnvironmentId(clonedenv)) for clonedenv in clonedenvs]
+            totalinserted = 0
+            for stats in sharedstats:
+                name = stats[0]
+                numchecks, numcollisionhits, numfreehits, numinserted = [int(x)-initial for x, initial in zip(stats[1:], initialstats[name])]
+                if name in clonenames:
+                    # every sample of the thread is queried
+                    assert(numchecks >= numsamples)
+                else:
+                    assert(numchecks == 0)
+                assert(numcollisionhits+numfreehits <= numchecks)
+                totalinserted += int(stats[4])
+            # the tree holds every inserted configuration that was not removed
+            assert(0 < int(cachesize) <= totalinserted)
+            self.log.info('shared cache statistics with %d threads: %s', numthreads, sharedstats)
+        finally:
+            for clonedenv in clonedenvs:
+                clonedenv.Destroy()
+
+    def test_workspaceindex(self):
+        env=self.env
+        self.LoadEnv('data/lab1.env.xml')
+        with env:
+            robot=env.GetRobots()[0]
+            robot.SetActiveDOFs(robot.GetActiveManipulator().GetArmIndices())
+            cachechecker = RaveCreateCollisionChecker(env,'CacheChecker')
+            env.SetCollisionChecker(cachechecker)
+            success=cachechecker.SendCommand('TrackRobotState %s'%robot.GetName())
+            assert(success is not None)
+
+            initvalues = robot.GetActiveDOFValues()
+            lower,upper = robot.GetActiveDOFLimits()
+            for i in range(500):
+                robot.SetActiveDOFValues(lower+random.rand(len(lower))*(upper-lower))
+                env.CheckCollision(robot)
+            cachedcollisions, cachedcollisionhits, cachedfreehits, cachesize = cachechecker.SendCommand('GetCacheStatistics').split()
+
+            # a small part far away from the robot does not invalidate the free configurations
+            part = RaveCreateKinBody(env,'')
+            part.InitFromBoxes(array([[0,0,0,0.02,0.02,0.02]]),True)
+            part.SetName('part')
+            part.SetTransform(matrixFromPose([1,0,0,0]+list(robot.GetTransform()[0:3,3]+[5,5,0])))
+            env.Add(part)
+            cachedcollisions, cachedcollisionhits, cachedfreehits, addcachesize = cachechecker.SendCommand('GetCacheStatistics').split()
+            assert(int(addcachesize) == int(cachesize))
+
+            # without the workspace index, all free configurations are invalidated
+            cachechecker.SendCommand('SetWorkspaceIndexParameters 0 0')
+            part.SetTransform(matrixFromPose([1,0,0,0]+list(robot.GetTransform()[0:3,3]+[5,4,0])))
+            cachedcollisions, cachedcollisionhits, cachedfreehits, movecachesize = cachechecker.SendCommand('GetCacheStatistics').split()
+            assert(int(movecachesize) < int(cachesize))
+            assert(int(cachechecker.SendCommand('ValidateCache')) == 1)
+
+            # a free configuration stands for all the configurations within the free space threshold, so a body where
+            # the links are at one of them invalidates it
+            cachechecker.SendCommand('SetWorkspaceIndexParameters 0.2 0')
+            robot.SetActiveDOFValues(initvalues)
+            movedvalues = array(initvalues)
+            movedvalues[1] += 0.3
+            freespacethresh = 0.3/(0.8*robot.GetActiveDOFResolutions()[1])
+            cachechecker.SendCommand('SetCacheParameters 0.01 %f 0.1 2'%freespacethresh)
+            assert(not env.CheckCollision(robot))
+            cachedcollisions, cachedcollisionhits, cachedfreehits, cachesize = cachechecker.SendCommand('GetCacheStatistics').split()
+            assert(int(cachesize) == 1)
+            with robot:
+                robot.SetActiveDOFValues(movedvalues)
+                ab = robot.GetActiveManipulator().GetEndEffector().ComputeAABB()
+            part2 = RaveCreateKinBody(env,'')
+            part2.InitFromBoxes(array([list(ab.pos())+[0.02,0.02,0.02]]),True)
+            part2.SetName('part2')
+            env.Add(part2)
+            cachedcollisions, cachedcollisionhits, cachedfreehits, cachesize = cachechecker.SendCommand('GetCacheStatistics').split()
+            assert(int(cachesize) == 0)
+            robot.SetActiveDOFValues(movedvalues)
+            assert(env.CheckCollision(robot))
+
     def test_planning(self):
             env = self.env
             with env:
@@ -37,6 +37,49 @@ class TestDatabases(EnvironmentSetup):
             out=ikmodule.SendCommand('LoadIKFastSolver %s %d 1'%(robot.GetName(),iktype))
             assert(out is not None)
             assert(manip.GetIkSolver() is not None)
+
+    def test_kinematicreachability(self):
+        env=self.env
+        self.LoadEnv('robots/barrettwam.robot.xml')
+        robot=env.GetRobots()[0]
+        rmodel = databases.kinematicreachability.ReachabilityModel(robot)
+        rmodel.generate(xyzdelta=0.2,translationonly=True,numthreads=2)
+        reachability3d = array(rmodel.reachability3d)
+        reachabilitystats = array(rmodel.reachabilitystats)
+        rmodel.generate(xyzdelta=0.2,translationonly=True,usenative=False)
+        assert(transdist(reachability3d,rmodel.reachability3d) <= g_epsilon)
+        assert(transdist(reachabilitystats,rmodel.reachabilitystats) <= g_epsilon)
+
+    def test_inversereachabilityclasses(self):
+        env=self.env
+        self.LoadEnv('robots/barrettwam.robot.xml')
+        robot=env.GetRobots()[0]
+        irmodel = databases.inversereachability.InverseReachabilityModel(robot)
+        module = RaveCreateModule(env,'inversereachability')
+        if module is None:
+            raise nose.SkipTest('inversereachability module not available')
+        # base poses of several well separated classes, every pose rotated by a random angle around the z-axis
+        heightthresh = 0.05
+        quatthresh = 0.15
+        rng = random.RandomState(0)
+        basetrans = []
+        for classquat,height in [((1.0,0,0,0),0.0),(quatFromAxisAngle([1,0,0],0.8),0.0),(quatFromAxisAngle([0,1,0],1.6),0.4),((1.0,0,0,0),0.4)]:
+            for i in range(200):
+                quat = quatMult(quatFromAxisAngle([0,0,1],rng.uniform(0,2*pi)),quatMult(quatFromAxisAngle(rng.uniform(-1,1,3)*0.002),classquat))
+                basetrans.append(r_[quat,rng.uniform(-1,1,2),height+rng.uniform(-0.001,0.001),rng.randint(1,4)])
+        basetrans = array(basetrans)[rng.permutation(len(basetrans))]
+        nativeindices = irmodel.computeEquivalenceClassIndices(module,basetrans,heightthresh,quatthresh,numthreads=2)
+        pythonindices = irmodel.computeEquivalenceClassIndicesPython(basetrans,heightthresh,quatthresh)
+        assert(len(nativeindices) == 4 and len(pythonindices) == 4)
+        assert(sum([len(indices) for indices in nativeindices]) == len(basetrans))
+        assert(sorted([sorted(indices) for indices in nativeindices]) == sorted([sorted(indices) for indices in pythonindices]))
+        for indices in nativeindices:
+            # every class holds the poses of one of the generated classes
+            assert(len(indices) == 200)
+            assert(max(abs(basetrans[indices,6]-basetrans[indices[0],6])) < 0.01)
+            # the statistics of the class do not depend on the clustering
+            equivalenceclass = irmodel.computeEquivalenceClass(basetrans[indices,:],10)
+            assert(equivalenceclass[1][0] < 0.01)
             
 #     def test_database_paths(self):
 #         pass
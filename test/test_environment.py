@@ -262,3 +262,126 @@ class TestEnvironment(EnvironmentSetup):
         # thread is done, so should be able to lock
         assert(env.Lock(1.0))
         env.Unlock()
+
+    def test_parallelsensors(self):
+        self.log.info('check that stepping the sensors in parallel gives the same data and reports the step times')
+        env=self.env
+        env.StopSimulation()
+        env.SetCollisionChecker(RaveCreateCollisionChecker(env,'ode'))
+        self.LoadEnv('data/testwamcamera.env.xml')
+        with env:
+            robot=env.GetRobot('BarrettWAM')
+            for attachedsensor in robot.GetAttachedSensors():
+                attachedsensor.GetSensor().Configure(Sensor.ConfigureCommand.PowerOn)
+            laser=robot.GetAttachedSensor('laser').GetSensor()
+        vranges = []
+        for numthreads in [1,3]:
+            env.SetSimulationStepThreads(numthreads)
+            assert(env.GetSimulationStepThreads() == numthreads)
+            for i in range(3):
+                env.StepSimulation(0.1)
+            steptimes = env.GetSimulationStepTimes()
+            assert(steptimes['total'] >= steptimes['physics']+steptimes['bodies']+steptimes['modules']+steptimes['parallelsensors']+steptimes['sensors'])
+            if numthreads == 1:
+                assert(steptimes['parallelsensors'] == 0)
+            else:
+                assert(steptimes['parallelsensors'] > 0)
+            with env:
+                vranges.append(laser.GetSensorData(Sensor.Type.Laser).ranges)
+        # the private checkers of the parallel sensors see the bodies added and removed afterwards
+        with env:
+            data = laser.GetSensorData(Sensor.Type.Laser)
+            distances = sqrt(sum(data.ranges**2,1))
+            index = argmax(distances)
+            box = RaveCreateKinBody(env,'')
+            box.SetName('obstacle')
+            box.InitFromBoxes(array([r_[data.positions[0]+0.5*data.ranges[index]/distances[index],0.05,0.05,0.05]]),True)
+            env.Add(box)
+        for i in range(3):
+            env.StepSimulation(0.1)
+        with env:
+            assert(sqrt(sum(laser.GetSensorData(Sensor.Type.Laser).ranges[index]**2)) < 0.5)
+            env.Remove(box)
+        for i in range(3):
+            env.StepSimulation(0.1)
+        with env:
+            assert(transdist(laser.GetSensorData(Sensor.Type.Laser).ranges,vranges[1]) <= g_epsilon)
+        env.SetSimulationStepThreads(1)
+        assert(len(vranges[0]) > 0)
+        assert(transdist(vranges[0],vranges[1]) <= g_epsilon)
+
+    def test_fixedratescheduler(self):
+        self.log.info('check that the fixed-rate scheduler does not step while the environment is locked and catches up according to the policy')
+        env=self.env
+        numskipped = {}
+        for catchuppolicy in [CatchUpPolicy.Skip, CatchUpPolicy.Burst]:
+            env.SetSimulationScheduler(True,1,catchuppolicy,20)
+            env.StopSimulation()
+            env.StartSimulation(0.01,True)
+            try:
+                time.sleep(0.3)
+                with env:
+                    env.GetSimulationSchedulerStatistics(True)
+                    simtime = env.GetSimulationTime()
+                    # about 100 deadlines are missed while the lock is held
+                    time.sleep(1.0)
+                    assert(env.GetSimulationSchedulerStatistics()['numsteps'] == 0)
+                    assert(env.GetSimulationTime() == simtime)
+                time.sleep(0.5)
+                numskipped[catchuppolicy] = env.GetSimulationSchedulerStatistics()['numskippedsteps']
+            finally:
+                env.StopSimulation()
+                env.SetSimulationScheduler(False)
+        # burst runs up to 20 of the missed steps instead of skipping them
+        assert(numskipped[CatchUpPolicy.Skip] >= 80)
+        assert(numskipped[CatchUpPolicy.Skip]-numskipped[CatchUpPolicy.Burst] >= 10)
+
+    def test_staterecordreplay(self):
+        self.log.info('record the published bodies and replay them into another environment, also while the environment is locked')
+        env=self.env
+        self.LoadEnv('robots/barrettwam.robot.xml')
+        robot=env.GetRobots()[0]
+        statefilename = 'test_staterecordreplay.state'
+        recorder = RaveCreateModule(env,'staterecorder')
+        env.Add(recorder)
+        try:
+            assert(recorder.SendCommand('Start rate 200 filename %s'%statefilename) is not None)
+            lower,upper = robot.GetDOFLimits()
+            for i in range(50):
+                with env:
+                    robot.SetDOFValues(lower+(upper-lower)*(0.5+0.4*sin(0.1*i+arange(len(lower)))))
+                    finalvalues = robot.GetDOFValues()
+                env.UpdatePublishedBodies()
+                time.sleep(0.01)
+            # let the recorder sample the last state
+            time.sleep(0.05)
+            recorder.SendCommand('Stop')
+            numsampled,numunchanged,numdropped,numwritten,numbytes = [int(s) for s in recorder.SendCommand('GetStatistics').split()]
+            assert(numwritten > 0 and numdropped == 0)
+
+            env2 = Environment()
+            try:
+                env2.Load('robots/barrettwam.robot.xml')
+                robot2 = env2.GetRobots()[0]
+                replayer = RaveCreateModule(env2,'statereplayer')
+                env2.Add(replayer)
+                numchunks,numframes,duration,samplerate = replayer.SendCommand('Open %s'%statefilename).split()
+                assert(int(numframes) == numwritten)
+                with env2:
+                    # the replayer must not wait for a thread that needs the environment lock
+                    numplayed,seconds = replayer.SendCommand('Play speed 0 start 0 wait 1').split()
+                    assert(int(numplayed) == numwritten)
+                    assert(transdist(robot2.GetDOFValues(),finalvalues) <= g_epsilon)
+                    replayer.SendCommand('Play speed 1 start 0')
+                    time.sleep(0.1)
+                    replayer.SendCommand('Stop')
+                    assert(replayer.SendCommand('GetTime').split()[1] == '0')
+                replayer.SendCommand('Seek 0')
+                with env2:
+                    assert(transdist(robot2.GetDOFValues(),finalvalues) > g_epsilon)
+            finally:
+                env2.Destroy()
+        finally:
+            env.Remove(recorder)
+            if os.path.exists(statefilename):
+                os.remove(statefilename)
@@ -12,7 +12,7 @@
 # See the License for the specific language governing permissions and
 # limitations under the License.
 from common_test_openrave import *
-import imp
+import imp, sys, tempfile, subprocess
 
 log=logging.getLogger('openravepytest')
 
@@ -63,3 +63,64 @@ def test_ikparam():
     
     ikparam2 = ikparam*T
     ikparam2.GetTranslationDirection5D().pos()
+
+def CaptureOutput(fn):
+    """returns what fn writes to the file descriptor of stdout, where the asynchronous logging writes to
+    """
+    sys.stdout.flush()
+    fd, filename = tempfile.mkstemp()
+    savedfd = os.dup(1)
+    os.dup2(fd, 1)
+    try:
+        fn()
+    finally:
+        os.dup2(savedfd, 1)
+        os.close(savedfd)
+        os.close(fd)
+    output = open(filename).read()
+    os.remove(filename)
+    return output
+
+def test_asynclogging():
+    level = RaveGetDebugLevel()
+    RaveSetDebugLevel(DebugLevel.Info)
+    try:
+        # the flush period is long enough for the flush thread to stay idle, the messages are only written by the explicit flushes
+        RaveSetAsyncLogging(True,65536,3600000)
+        stats0 = RaveGetAsyncLoggingStatistics()
+        def LogMessages():
+            for i in range(100):
+                RaveLogInfo('asynctest message %d\n'%i)
+            RaveFlushLog()
+        output = CaptureOutput(LogMessages)
+        assert([int(line.split('asynctest message ')[1]) for line in output.splitlines() if 'asynctest message ' in line] == range(100))
+        stats1 = RaveGetAsyncLoggingStatistics()
+        assert(stats1['numlogged']-stats0['numlogged'] == 100 and stats1['numdropped'] == stats0['numdropped'])
+        assert(stats1['numflushes'] > stats0['numflushes'])
+
+        # the smallest buffer cannot hold all the messages until the flush, the dropped ones are counted and reported
+        RaveSetAsyncLogging(True,1,3600000)
+        def LogDropped():
+            for i in range(1000):
+                RaveLogInfo('asynctest dropped %s\n'%('x'*200))
+            RaveFlushLog()
+        output = CaptureOutput(LogDropped)
+        stats2 = RaveGetAsyncLoggingStatistics()
+        numdropped = stats2['numdropped']-stats1['numdropped']
+        assert(numdropped > 0)
+        assert(output.count('asynctest dropped') == 1000-numdropped)
+        assert('dropped %d messages'%numdropped in output)
+
+        # disabling the asynchronous logging writes the pending messages
+        RaveSetAsyncLogging(True,65536,3600000)
+        def LogDisable():
+            RaveLogInfo('asynctest pending\n')
+            RaveSetAsyncLogging(False)
+        assert('asynctest pending' in CaptureOutput(LogDisable))
+    finally:
+        RaveSetAsyncLogging(False)
+        RaveSetDebugLevel(level)
+
+    # so does the exit of the process
+    output = subprocess.check_output([sys.executable, '-c', "from openravepy import *; RaveSetDebugLevel(DebugLevel.Info); RaveSetAsyncLogging(True,65536,3600000); RaveLogInfo('asynctest exit\\n')"])
+    assert('asynctest exit' in output)
@@ -542,3 +542,60 @@ class TestIkSolver(EnvironmentSetup):
         
         sol = r.GetActiveManipulator().FindIKSolution(Tee, 0)
         assert( sol is None)
+
+    def test_findiksolutionsbatch(self):
+        env=self.env
+        self.LoadEnv('data/lab1.env.xml')
+        robot=env.GetRobots()[0]
+        ikmodel = databases.inversekinematics.InverseKinematicsModel(robot,IkParameterization.Type.Transform6D)
+        if not ikmodel.load():
+            ikmodel.autogenerate()
+        with env:
+            lower,upper = robot.GetDOFLimits(ikmodel.manip.GetArmIndices())
+            Tposes = []
+            with robot:
+                for i in range(100):
+                    robot.SetDOFValues(lower+random.rand(len(lower))*(upper-lower),ikmodel.manip.GetArmIndices())
+                    Tposes.append(ikmodel.manip.GetTransform())
+            Tposes = array(Tposes)
+            serialsolutions = [ikmodel.manip.FindIKSolutions(T,IkFilterOptions.CheckEnvCollisions) for T in Tposes]
+            assert(any([len(sols) > 0 for sols in serialsolutions]))
+            for numthreads in [1,4]:
+                batchsolutions = ikmodel.manip.FindIKSolutionsBatch(Tposes,IkFilterOptions.CheckEnvCollisions,numthreads)
+                assert(len(batchsolutions) == len(Tposes))
+                for sols,batchsols in izip(serialsolutions,batchsolutions):
+                    assert(len(sols) == len(batchsols))
+                    if len(sols) > 0:
+                        assert(transdist(sols,batchsols) <= g_epsilon)
+
+    def test_parallelsearch(self):
+        env=self.env
+        self.LoadEnv('data/lab1.env.xml')
+        robot=env.GetRobots()[0]
+        ikmodel = databases.inversekinematics.InverseKinematicsModel(robot,IkParameterization.Type.Transform6D)
+        if not ikmodel.load():
+            ikmodel.autogenerate()
+        iksolver = ikmodel.manip.GetIkSolver()
+        with env:
+            lower,upper = robot.GetDOFLimits(ikmodel.manip.GetArmIndices())
+            Tposes = []
+            with robot:
+                for i in range(50):
+                    robot.SetDOFValues(lower+random.rand(len(lower))*(upper-lower),ikmodel.manip.GetArmIndices())
+                    Tposes.append(ikmodel.manip.GetTransform())
+            for filteroptions in [0,IkFilterOptions.CheckEnvCollisions]:
+                iksolver.SendCommand('SetParallelSearch 0')
+                serialsolutions = [ikmodel.manip.FindIKSolutions(T,filteroptions) for T in Tposes]
+                serialsolution = [ikmodel.manip.FindIKSolution(T,filteroptions) for T in Tposes]
+                assert(any([len(sols) > 0 for sols in serialsolutions]))
+                iksolver.SendCommand('SetParallelSearch 4')
+                for T,sols,sol in izip(Tposes,serialsolutions,serialsolution):
+                    parallelsols = ikmodel.manip.FindIKSolutions(T,filteroptions)
+                    assert(len(sols) == len(parallelsols))
+                    if len(sols) > 0:
+                        assert(transdist(sols,parallelsols) <= g_epsilon)
+                    parallelsol = ikmodel.manip.FindIKSolution(T,filteroptions)
+                    assert((sol is None) == (parallelsol is None))
+                    if sol is not None:
+                        assert(transdist(sol,parallelsol) <= g_epsilon)
+            iksolver.SendCommand('SetParallelSearch 0')
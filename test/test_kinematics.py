@@ -12,6 +12,7 @@
 # See the License for the specific language governing permissions and
 # limitations under the License.
 from common_test_openrave import *
+import struct, zlib
 
 class TestKinematics(EnvironmentSetup):
     def test_bodybasic(self):
@@ -1123,3 +1124,223 @@ class TestKinematics(EnvironmentSetup):
         assert(robot.CheckSelfCollision())
         robot.SetNonCollidingConfiguration()
         assert(not robot.CheckSelfCollision())
+
+    def test_arrayconversions(self):
+        self.log.info('check that numpy arrays are converted the same as lists and that array returns match the list returns')
+        env=self.env
+        with env:
+            robot=self.LoadRobot('robots/barrettwam.robot.xml')
+            lower,upper = robot.GetDOFLimits()
+            values = 0.5*(lower+upper)
+            robot.SetDOFValues(list(values))
+            Tlinks = robot.GetLinkTransformations()
+            robot.SetDOFValues(lower)
+            robot.SetDOFValues(values)
+            assert(transdist(robot.GetDOFValues(),values) <= g_epsilon)
+            # float32 and strided arrays have to be converted rather than read directly
+            robot.SetDOFValues(array(values,float32))
+            assert(transdist(robot.GetDOFValues(),values) <= 1e-6)
+            robot.SetDOFValues(c_[values,values][:,0])
+            assert(transdist(robot.GetDOFValues(),values) <= g_epsilon)
+            Tlinksarray = robot.GetLinkTransformations(False,True)
+            assert(Tlinksarray.shape == (len(robot.GetLinks()),4,4))
+            for T,Tarray in izip(Tlinks,Tlinksarray):
+                assert(transdist(T,Tarray) <= g_epsilon)
+            
+            traj = RaveCreateTrajectory(env,'')
+            traj.Init(robot.GetActiveConfigurationSpecification())
+            traj.Insert(0,r_[lower,values])
+            waypoints = traj.GetWaypoints2D(0,2)
+            assert(waypoints.shape == (2,robot.GetDOF()))
+            assert(transdist(waypoints[1],values) <= g_epsilon)
+            assert(transdist(traj.GetWaypoints(0,2),r_[lower,values]) <= g_epsilon)
+
+    def test_batchqueries(self):
+        self.log.info('check that the batch queries match the per-sample calls')
+        env=self.env
+        with env:
+            robot=self.LoadRobot('robots/barrettwam.robot.xml')
+            lower,upper = robot.GetDOFLimits()
+            dofvalues = lower+random.rand(100,robot.GetDOF())*(upper-lower)
+            for numthreads in [1,4]:
+                Tbatch = robot.ComputeLinkTransformationsBatch(dofvalues,None,numthreads)
+                collisions = robot.CheckCollisionBatch(dofvalues,None,True,False,numthreads)
+                assert(Tbatch.shape == (len(dofvalues),len(robot.GetLinks()),4,4))
+                assert(collisions.shape == (len(dofvalues),))
+                with robot:
+                    for i,values in enumerate(dofvalues):
+                        robot.SetDOFValues(values)
+                        for link,T in izip(robot.GetLinks(),Tbatch[i]):
+                            assert(transdist(link.GetTransform(),T) <= g_epsilon)
+                        assert(collisions[i] == (env.CheckCollision(robot) or robot.CheckSelfCollision()))
+            # the distances of the clones have to be the ones of the original environment
+            for numthreads in [1,4]:
+                collisions,distances = robot.CheckCollisionBatch(dofvalues,None,False,True,numthreads)
+                assert(distances.shape == (len(dofvalues),))
+                with robot:
+                    for i,values in enumerate(dofvalues):
+                        robot.SetDOFValues(values)
+                        report = CollisionReport()
+                        assert(collisions[i] == env.CheckCollision(robot,report))
+                        assert(abs(distances[i]-report.minDistance) <= g_epsilon)
+
+    def test_sampledcollidinglinkscache(self):
+        self.log.info('check that the sampled colliding links are only cached on disk when requested and are reused by bodies with the same kinematics')
+        env=self.env
+        with env:
+            robot=self.LoadRobot('robots/barrettwam.robot.xml')
+            cachefilename = 'kinbody.%s/sampledcollidinglinks.%s'%(robot.GetKinematicsGeometryHash(),env.GetCollisionChecker().GetXMLId())
+            fullcachefilename = RaveFindDatabaseFile(cachefilename)
+            if len(fullcachefilename) > 0:
+                os.remove(fullcachefilename)
+            robot.GetNonAdjacentLinks(0)
+            robot.ComputeSampledCollidingLinks(200)
+            assert(len(RaveFindDatabaseFile(cachefilename)) == 0)
+            robot.ComputeSampledCollidingLinks(200,1,True)
+            assert(len(RaveFindDatabaseFile(cachefilename)) > 0)
+            sampled = robot.GetNonAdjacentLinks(KinBody.AdjacentOptions.SampledColliding)
+            clonedenv = env.CloneSelf(CloningOptions.Bodies)
+            try:
+                clonedrobot = clonedenv.GetRobot(robot.GetName())
+                clonedrobot.ComputeSampledCollidingLinks(200,1,True)
+                assert(clonedrobot.GetNonAdjacentLinks(KinBody.AdjacentOptions.SampledColliding) == sampled)
+            finally:
+                clonedenv.Destroy()
+
+    def test_sampledcollidinglinkscachefile(self):
+        self.log.info('check that GetNonAdjacentLinks writes no cache file and that an invalid sampled colliding links file is rebuilt')
+        env=self.env
+        with env:
+            robot=self.LoadRobot('robots/barrettwam.robot.xml')
+            hash = robot.GetKinematicsGeometryHash()
+            checkername = env.GetCollisionChecker().GetXMLId()
+            robot.GetNonAdjacentLinks(0)
+            assert(len(RaveFindDatabaseFile('kinbody.%s/nonadjacentlinks.%s'%(hash,checkername))) == 0)
+            cachefilename = 'kinbody.%s/sampledcollidinglinks.%s'%(hash,checkername)
+            fullcachefilename = RaveFindDatabaseFile(cachefilename)
+            if len(fullcachefilename) > 0:
+                os.remove(fullcachefilename)
+            robot.ComputeSampledCollidingLinks(200,1,True)
+            sampled = robot.GetNonAdjacentLinks(KinBody.AdjacentOptions.SampledColliding)
+            fullcachefilename = RaveFindDatabaseFile(cachefilename)
+            data = open(fullcachefilename,'rb').read()
+            # the 92 byte header ends with the size and the crc32 of the data
+            header, filedata = data[:92], data[92:]
+
+            def GetClonedSampledLinks():
+                clonedenv = env.CloneSelf(CloningOptions.Bodies)
+                try:
+                    clonedrobot = clonedenv.GetRobot(robot.GetName())
+                    clonedrobot.ComputeSampledCollidingLinks(200,1,True)
+                    return clonedrobot.GetNonAdjacentLinks(KinBody.AdjacentOptions.SampledColliding)
+                finally:
+                    clonedenv.Destroy()
+
+            # a corrupted file is ignored, the pairs are sampled again and the file is rebuilt
+            corrupted = bytearray(data)
+            corrupted[-1] ^= 0xff
+            open(fullcachefilename,'wb').write(corrupted)
+            assert(GetClonedSampledLinks() == sampled)
+            assert(open(fullcachefilename,'rb').read() == data)
+            # so is a file of another version
+            open(fullcachefilename,'wb').write(header[:8]+struct.pack('<I',0)+header[12:84]+struct.pack('<II',len(filedata),zlib.crc32(filedata)&0xffffffff)+filedata)
+            assert(GetClonedSampledLinks() == sampled)
+            assert(open(fullcachefilename,'rb').read() == data)
+
+    def test_sampledcollidinglinks(self):
+        self.log.info('check that sampling self-collisions prunes link pairs and that self-collision checking uses the pruned pairs')
+        env=self.env
+        with env:
+            robot=self.LoadRobot('robots/barrettwam.robot.xml')
+            fullrobot=self.LoadRobot('robots/barrettwam.robot.xml')
+            fullrobot.SetTransform(matrixFromPose([1,0,0,0,5,0,0]))
+            options = KinBody.AdjacentOptions.Enabled|KinBody.AdjacentOptions.SampledColliding
+            nonadjacent = robot.GetNonAdjacentLinks(KinBody.AdjacentOptions.Enabled)
+            assert(robot.GetNonAdjacentLinks(options) == nonadjacent)
+            robot.ComputeSampledCollidingLinks(200)
+            sampled = robot.GetNonAdjacentLinks(options)
+            assert(set(sampled) < set(nonadjacent))
+            assert(robot.GetNonAdjacentLinks(KinBody.AdjacentOptions.Enabled) == nonadjacent)
+            # the samples do not depend on the number of threads
+            clonedenv = env.CloneSelf(CloningOptions.Bodies)
+            try:
+                clonedrobot = clonedenv.GetRobot(robot.GetName())
+                clonedrobot.ComputeSampledCollidingLinks(200,3)
+                assert(clonedrobot.GetNonAdjacentLinks(options) == sampled)
+            finally:
+                clonedenv.Destroy()
+
+            # the pairs colliding in some but not all of many more samples, checking every pair
+            lower,upper = robot.GetDOFLimits()
+            random.seed(0)
+            links = fullrobot.GetLinks()
+            numcolliding = dict([(pair,0) for pair in nonadjacent])
+            numconfigs = 2000
+            allvalues = [lower+(upper-lower)*random.rand(len(lower)) for i in range(numconfigs)]
+            for values in allvalues:
+                fullrobot.SetDOFValues(values)
+                for pair in nonadjacent:
+                    if env.CheckCollision(links[pair[0]],links[pair[1]]):
+                        numcolliding[pair] += 1
+            exact = set([pair for pair,count in numcolliding.iteritems() if 0 < count < numconfigs])
+            # every sampled pair really collides and most colliding pairs are found, only the rarely colliding ones can be missed
+            assert(set(sampled) <= exact)
+            assert(len(sampled) >= 0.6*len(exact))
+
+            report=CollisionReport()
+            numcollisions = 0
+            for values in allvalues[:1000]:
+                robot.SetDOFValues(values)
+                fullrobot.SetDOFValues(values)
+                if robot.CheckSelfCollision(report):
+                    numcollisions += 1
+                    assert(fullrobot.CheckSelfCollision())
+                    pair = tuple(sorted([report.plink1.GetIndex(),report.plink2.GetIndex()]))
+                    assert(pair in sampled)
+            assert(numcollisions > 0)
+
+    def test_sampledalwayscollidinglinks(self):
+        self.log.info('check that link pairs colliding in all samples are classified as always colliding and not checked')
+        env=self.env
+        xmldata = """<kinbody name="always">
+  <body name="base">
+    <geom type="box">
+      <extents>0.1 0.1 0.1</extents>
+    </geom>
+  </body>
+  <body name="link1">
+    <offsetfrom>base</offsetfrom>
+    <geom type="box">
+      <translation>0.5 0 0</translation>
+      <extents>0.05 0.05 0.05</extents>
+    </geom>
+  </body>
+  <body name="link2">
+    <offsetfrom>link1</offsetfrom>
+    <geom type="sphere">
+      <radius>0.15</radius>
+    </geom>
+  </body>
+  <joint name="j0" type="hinge">
+    <body>base</body>
+    <body>link1</body>
+    <axis>0 0 1</axis>
+    <limitsdeg>-90 90</limitsdeg>
+  </joint>
+  <joint name="j1" type="hinge">
+    <body>link1</body>
+    <body>link2</body>
+    <axis>0 0 1</axis>
+    <limitsdeg>-90 90</limitsdeg>
+  </joint>
+</kinbody>"""
+        with env:
+            body = env.ReadKinBodyXMLData(xmldata)
+            env.Add(body)
+            assert(len(body.GetSampledAlwaysCollidingLinks()) == 0)
+            # link2 rotates in place inside base
+            body.ComputeSampledCollidingLinks(100)
+            assert(body.GetSampledAlwaysCollidingLinks() == [(0,2)])
+            assert(len(body.GetNonAdjacentLinks(KinBody.AdjacentOptions.SampledColliding)) == 0)
+            body.SetDOFValues([0.5,-0.5])
+            assert(not body.CheckSelfCollision())
@@ -187,6 +187,104 @@ class RunPlanning(EnvironmentSetup):
             env2.Clone(env,CloningOptions.Bodies|CloningOptions.Simulation)
             misc.CompareEnvironments(env,env2,epsilon=g_epsilon)
             
+    def test_grasperconvexhull(self):
+        env = self.env
+        grasper = RaveCreateModule(env,'grasper')
+        env.AddModule(grasper,'')
+        def computehull(points,reentrant):
+            cmd = 'ConvexHull points %d %d %s returnplanes 1 returnfaces 0 returntriangles 0 returnvolume 1 reentrant %d'%(points.shape[0],points.shape[1],' '.join(str(f) for f in points.flatten()),reentrant)
+            res = grasper.SendCommand(cmd)
+            if res is None:
+                return None, None
+            values = array([float(f) for f in res.split()])
+            numplanes = int(values[0])
+            dim = points.shape[1]
+            return reshape(values[1:1+numplanes*(dim+1)],(numplanes,dim+1)), values[-1]
+        
+        randomstate = random.RandomState(0)
+        if computehull(randomstate.rand(8,3),0)[0] is None:
+            raise nose.SkipTest('grasper was built without qhull')
+        for dim in [2,3,4,6]:
+            for itry in range(20):
+                points = randomstate.randn(3*dim+randomstate.randint(20),dim)
+                qhullplanes,qhullvolume = computehull(points,0)
+                planes,volume = computehull(points,1)
+                assert(planes is not None)
+                assert(abs(volume-qhullvolume) <= 1e-9*qhullvolume)
+                # qhull merges coplanar facets while the reentrant hull repeats their planes, so compare the sets of planes
+                for planes0,planes1 in [(planes,qhullplanes),(qhullplanes,planes)]:
+                    for plane in planes0:
+                        assert(min(sum(abs(planes1-plane),1)) <= 1e-7)
+                # the sign of the largest offset decides force closure in _AnalyzeContacts3D
+                for center in [mean(points,0),points.max(0)+1]:
+                    shiftedpoints = points-center
+                    assert((max(computehull(shiftedpoints,0)[0][:,-1]) < 0) == (max(computehull(shiftedpoints,1)[0][:,-1]) < 0))
+        
+        # flat point sets fail with both hulls
+        flatpoints = c_[randomstate.rand(20,2),zeros(20)]
+        assert(computehull(flatpoints,1)[0] is None)
+        assert(computehull(flatpoints,0)[0] is None)
+        env.Remove(grasper)
+
+    def test_graspthreadedasync(self):
+        env = self.env
+        self.LoadEnv('data/lab1.env.xml')
+        robot = env.GetRobots()[0]
+        target = env.GetKinBody('mug1')
+        gmodel = databases.grasping.GraspingModel(robot=robot,target=target)
+        grasper = interfaces.Grasper(robot,friction=0.4)
+        with env:
+            manip = robot.GetActiveManipulator()
+            approachrays = gmodel.computeBoxApproachRays(delta=0.04)[::8]
+            approachrays[:,3:6] = -approachrays[:,3:6]
+            graspparams = {'approachrays':approachrays, 'rolls':array([0,pi/2]), 'standoffs':array([0]), 'preshapes':array([robot.GetDOFValues(manip.GetGripperIndices())]), 'manipulatordirections':array([manip.GetLocalToolDirection()]), 'target':target, 'forceclosurethreshold':1e-9, 'numthreads':2}
+            robot.SetTransform(eye(4))
+            robot.SetActiveDOFs(manip.GetGripperIndices(),DOFAffine.X+DOFAffine.Y+DOFAffine.Z)
+            # the completed ids are only returned when asked for
+            nextid,syncgrasps = grasper.GraspThreaded(**graspparams)
+            assert(len(syncgrasps) > 0 and nextid == len(approachrays)*2)
+            nextid,completedids,grasps = grasper.GraspThreaded(returncompletedids=True,**graspparams)
+            assert(nextid == len(approachrays)*2 and len(completedids) == 0 and len(grasps) == len(syncgrasps))
+            grasper.GraspThreaded(asynchronous=True,**graspparams)
+        
+        # the workers use the collision options of the main environment when the job started, while they run the main
+        # environment changes its checker and options
+        checkername = env.GetCollisionChecker().GetXMLId()
+        asyncgrasps = []
+        done = False
+        while not done:
+            with env:
+                checker = RaveCreateCollisionChecker(env,checkername)
+                checker.SetCollisionOptions(CollisionOptions.ActiveDOFs)
+                env.SetCollisionChecker(checker)
+            done,nextid,completedids,grasps = grasper.GetGraspThreadedResults(wait=0.01)
+            asyncgrasps += grasps
+        assert(nextid == len(approachrays)*2)
+        # the grasps are evaluated in a different order
+        def GetGraspKeys(grasps):
+            return sorted([tuple(grasp[0])+(grasp[2],) for grasp in grasps])
+        assert(GetGraspKeys(asyncgrasps) == GetGraspKeys(syncgrasps))
+
+        # the workers stop after maxgrasps with ids above nextid already complete, resuming skips them so no grasp is returned twice
+        with env:
+            resumedgrasps = []
+            nextid = 0
+            completedids = []
+            while nextid < len(approachrays)*2:
+                nextid,completedids,grasps = grasper.GraspThreaded(startindex=nextid,skipids=completedids,maxgrasps=2,returncompletedids=True,**graspparams)
+                assert(all([id > nextid for id in completedids]))
+                resumedgrasps += grasps
+        assert(GetGraspKeys(resumedgrasps) == GetGraspKeys(syncgrasps))
+
+        # without the completed ids only the grasps below nextid are returned, so the loop resuming from nextid alone does not return a grasp twice
+        with env:
+            resumedgrasps = []
+            nextid = 0
+            while nextid < len(approachrays)*2:
+                nextid,grasps = grasper.GraspThreaded(startindex=nextid,maxgrasps=2,**graspparams)
+                resumedgrasps += grasps
+        assert(GetGraspKeys(resumedgrasps) == GetGraspKeys(syncgrasps))
+
     def test_movehandstraight(self):
         env = self.env
         with env:
@@ -615,6 +713,149 @@ class RunPlanning(EnvironmentSetup):
             assert(success)
             assert(not env.CheckCollision(collisionbody))
 
+    def test_lazybirrt(self):
+        env=self.env
+        # a thin rod that has to be lifted over a thin wall, the straight edges through the wall collide only between their configurations
+        xml = """<robot name="thinarm">
+  <kinbody>
+    <body name="base" type="dynamic">
+      <geom type="box">
+        <translation>0 0 -0.1</translation>
+        <extents>0.05 0.05 0.05</extents>
+      </geom>
+    </body>
+    <body name="lift" type="dynamic">
+      <offsetfrom>base</offsetfrom>
+      <geom type="box">
+        <extents>0.01 0.01 0.01</extents>
+      </geom>
+    </body>
+    <body name="rod" type="dynamic">
+      <offsetfrom>lift</offsetfrom>
+      <geom type="box">
+        <translation>0.6 0 0</translation>
+        <extents>0.5 0.001 0.001</extents>
+      </geom>
+    </body>
+    <joint name="lift" type="slider">
+      <body>base</body>
+      <body>lift</body>
+      <offsetfrom>lift</offsetfrom>
+      <axis>0 0 1</axis>
+      <limits>0 0.4</limits>
+      <resolution>0.001</resolution>
+    </joint>
+    <joint name="rod" type="hinge">
+      <body>lift</body>
+      <body>rod</body>
+      <offsetfrom>lift</offsetfrom>
+      <axis>0 0 1</axis>
+      <limitsdeg>-90 90</limitsdeg>
+      <resolution>0.001</resolution>
+    </joint>
+  </kinbody>
+</robot>
+"""
+        with env:
+            robot=self.LoadRobotData(xml)
+            wall=RaveCreateKinBody(env,'')
+            wall.SetName('wall')
+            wall.InitFromBoxes(array([[0.8,0,0.1,0.3,0.001,0.1]]),True)
+            env.Add(wall)
+            robot.SetActiveDOFs(range(robot.GetDOF()))
+            initial=array([0.05,-0.5])
+            goal=array([0.05,0.5])
+            robot.SetActiveDOFValues(initial)
+            assert(not env.CheckCollision(robot))
+            planner=RaveCreatePlanner(env,'BiRRT')
+            planner.SendCommand('SetLazyCollisionChecking 1')
+            params=Planner.PlannerParameters()
+            params.SetRobotActiveJoints(robot)
+            params.SetGoalConfig(goal)
+            params.SetMaxIterations(5000)
+            params.SetRandomGeneratorSeed(1)
+            params.SetPostProcessing('','')
+            assert(planner.InitPlan(robot,params))
+            traj=RaveCreateTrajectory(env,'')
+            assert(planner.PlanPath(traj)==PlannerStatus.HasSolution)
+            # the edges through the wall were found when the path was checked and the trees were repaired
+            numedgechecks,numrepairs=[int(s) for s in planner.SendCommand('GetLazyStatistics').split()]
+            assert(numrepairs > 0)
+            path=traj.GetWaypoints(0,traj.GetNumWaypoints(),robot.GetActiveConfigurationSpecification()).reshape((traj.GetNumWaypoints(),robot.GetActiveDOF()))
+            assert(transdist(path[0],initial) <= g_epsilon and transdist(path[-1],goal) <= g_epsilon)
+            for q0,q1 in zip(path[:-1],path[1:]):
+                numsteps=max(1,int(ceil(max(abs(q1-q0))/0.0005)))
+                for t in arange(numsteps+1)/float(numsteps):
+                    robot.SetActiveDOFValues(q0+t*(q1-q0))
+                    assert(not env.CheckCollision(robot))
+
+    def test_parallelbirrt(self):
+        env=self.env
+        self.LoadEnv('data/lab1.env.xml')
+        robot=env.GetRobots()[0]
+        with env:
+            robot.SetActiveDOFs(robot.GetActiveManipulator().GetArmIndices())
+            # a query where the workers find different paths
+            initial=array([1.052310, 1.221501, -2.253538, -0.385016, -2.671971, -0.245164, 1.199619])
+            goal=array([2.354306, -0.464753, -0.971608, 3.094889, 0.347019, -0.705871, 0.580140])
+            robot.SetActiveDOFValues(goal)
+            assert(not env.CheckCollision(robot) and not robot.CheckSelfCollision())
+            robot.SetActiveDOFValues(initial)
+            assert(not env.CheckCollision(robot) and not robot.CheckSelfCollision())
+            params=Planner.PlannerParameters()
+            params.SetRobotActiveJoints(robot)
+            params.SetGoalConfig(goal)
+            params.SetMaxIterations(4000)
+            params.SetRandomGeneratorSeed(5)
+            params.SetPostProcessing('','')
+            def Plan(planner):
+                robot.SetActiveDOFValues(initial)
+                assert(planner.InitPlan(robot,params))
+                traj=RaveCreateTrajectory(env,'')
+                assert(planner.PlanPath(traj)==PlannerStatus.HasSolution)
+                return traj.GetWaypoints(0,traj.GetNumWaypoints(),robot.GetActiveConfigurationSpecification())
+
+            # worker 0 uses the seed of the parameters, so a single worker plans the same path as the BiRRT planner
+            path=Plan(RaveCreatePlanner(env,'BiRRT'))
+            planner=RaveCreatePlanner(env,'ParallelBiRRT')
+            planner.SendCommand('SetNumThreads 1')
+            path1=Plan(planner)
+            assert(len(path1)==len(path) and all(path1==path))
+
+            # all the workers finish when returning the best path, so the result only depends on the seed
+            planner.SendCommand('SetNumThreads 3')
+            planner.SendCommand('SetReturnMode best')
+            path0=Plan(planner)
+            path1=Plan(planner)
+            assert(len(path1)==len(path0) and all(path1==path0))
+            lines=planner.SendCommand('GetStatistics').splitlines()
+            numworkers,ireturned=[int(s) for s in lines[0].split()[:2]]
+            assert(numworkers==3)
+            pathlengths=[float(line.split()[4]) for line in lines[1:]]
+            assert(pathlengths[ireturned]==min(pathlengths))
+
+    def test_parallelbirrtconstraints(self):
+        # the workers cannot use the jacobian constraints of BaseManipulation, so the query has to be planned with them in this environment
+        env = self.env
+        robot = self.LoadRobot('robots/pr2-beta-static.zae')
+        with env:
+            manip=robot.SetActiveManipulator('leftarm_torso')
+            basemanip = interfaces.BaseManipulation(robot,plannername='ParallelBiRRT')
+            robot.SetDOFValues([.31],[robot.GetJoint('torso_lift_joint').GetDOFIndex()])
+            T=array([[0,0,1,.6], [0,1,0,.1], [-1,0,0,.73], [0,0,0,1]])
+            robot.SetDOFValues(manip.FindIKSolution(T,IkFilterOptions.CheckEnvCollisions),manip.GetArmIndices())
+            Tgoal=array([[0,0,1,.6], [0,1,0,.3], [-1,0,0,.73], [0,0,0,1]])
+            constraintfreedoms=array([1,1,0,1,0,0]) # can rotate along z, translate along y
+            constraintmatrix=array([[1,0,0,0], [0,1,0,0], [0,0,1,0], [0,0,0,1]])
+            constrainterrorthresh=0.002
+            traj = basemanip.MoveToHandPosition(matrices=[Tgoal],maxiter=6000,maxtries=2,seedik=16, constraintfreedoms=constraintfreedoms, constraintmatrix=constraintmatrix, constrainterrorthresh=constrainterrorthresh,execute=False,outputtrajobj=True,steplength=0.001)
+            spec=robot.GetConfigurationSpecification()
+            for i in range(traj.GetNumWaypoints()):
+                robot.SetConfigurationValues(traj.GetWaypoint(i,spec))
+                Tee=manip.GetEndEffectorTransform()
+                # x and z are constrained
+                assert(abs(Tee[0,3]-T[0,3]) <= 0.01 and abs(Tee[2,3]-T[2,3]) <= 0.01)
+
 #generate_classes(RunPlanning, globals(), [('ode','ode'),('bullet','bullet')])
 
 class test_ode(RunPlanning):
@@ -56,3 +56,46 @@ class TestSampling(EnvironmentSetup):
         robot.SetActiveDOFs(range(robot.GetDOF()-4),Robot.DOFAffine.X|Robot.DOFAffine.Y|Robot.DOFAffine.RotationAxis,[0,0,1])
         values = sp.SampleSequence(SampleDataType.Real,1)
         assert(len(values[0]) == robot.GetActiveDOF())
+
+    def test_baseplacement(self):
+        env=self.env
+        sp=RaveCreateSpaceSampler(env,'BasePlacement')
+        if sp is None:
+            raise nose.SkipTest('BasePlacement sampler not available')
+        # nothing to sample before the distribution is set
+        assert(not sp.Supports(SampleDataType.Real))
+        rotweight = 0.2
+        bandwidth = array((rotweight*0.1,0.02,0.02))
+        # (zangle, x, y, weight, graspindex)
+        points = array(((0.0,1.0,0.0,1.0,0),(1.0,0.0,-1.0,3.0,1)))
+        cmd = 'SetDistribution rotweight %.15e bandwidth %s robotpose 1 0 0 0 0 0 0 baseheight 0.3 points %d '%(rotweight,' '.join('%.15e'%f for f in bandwidth),len(points))
+        cmd += ' '.join('%.15e %.15e %.15e %.15e %d'%tuple(p) for p in points)
+        # a zero bandwidth is rejected and does not change the sampler
+        assert_raises(openrave_exception, sp.SendCommand, cmd.replace('bandwidth %.15e'%bandwidth[0],'bandwidth 0'))
+        assert(not sp.Supports(SampleDataType.Real))
+        assert(sp.SendCommand(cmd) is not None)
+        assert(sp.Supports(SampleDataType.Real))
+        N = 2000
+        sp.SetSeed(10)
+        samples = sp.SampleSequence2D(SampleDataType.Real,N)
+        assert(samples.shape == (N,8))
+        sp.SetSeed(10)
+        assert(transdist(samples,sp.SampleSequence2D(SampleDataType.Real,N)) <= g_epsilon)
+        # every sample is a rotation around the z-axis at the base height close to the point of its grasp
+        assert(all(abs(samples[:,1:3]) <= g_epsilon))
+        assert(all(abs(samples[:,6]-0.3) <= g_epsilon))
+        graspindices = array(samples[:,7],int)
+        assert(all((graspindices==0)|(graspindices==1)))
+        for sample,graspindex in zip(samples,graspindices):
+            zangledelta = 2*arctan2(sample[3],sample[0])-points[graspindex,0]
+            assert(abs(arctan2(sin(zangledelta),cos(zangledelta)))*rotweight <= 6*bandwidth[0])
+            assert(all(abs(sample[4:6]-points[graspindex,1:3]) <= 6*bandwidth[1:3]))
+        # the grasps are sampled in proportion to their weights
+        ratio = sum(graspindices==0)/float(N)
+        assert(abs(ratio-0.25) < 0.05)
+        # the density at the points is their weight since they are too far from each other, zero far away from both
+        densitycmd = 'ComputeDensity 3 '
+        for zangle,x,y in [points[0,0:3],points[1,0:3],(0.0,5.0,5.0)]:
+            densitycmd += '%.15e 0 0 %.15e %.15e %.15e 0.3 '%(cos(0.5*zangle),sin(0.5*zangle),x,y)
+        densities = array([float(f) for f in sp.SendCommand(densitycmd).split()])
+        assert(transdist(densities,[1.0,3.0,0.0]) <= 1e-7)
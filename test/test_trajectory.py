@@ -833,7 +833,93 @@ class TestTrajectory(EnvironmentSetup):
             planningutils.ExtendWaypoint(traj.GetNumWaypoints(),jitteredgoal,zeros(len(jitteredgoal)), traj, planner)
             assert( sum(abs(traj.GetWaypoint(-1, robot.GetActiveConfigurationSpecification())-jitteredgoal)) <= g_epsilon)
             planningutils.VerifyTrajectory(parameters, traj,0.01)
-            
+
+    def test_parallelshortcut(self):
+        env=self.env
+        self.LoadEnv('data/lab1.env.xml')
+        robot=env.GetRobots()[0]
+        with env:
+            manipprob = interfaces.BaseManipulation(robot)
+            manip = robot.GetActiveManipulator()
+            robot.SetActiveDOFs(manip.GetArmIndices())
+            origtraj=manipprob.MoveManipulator(goal=array([-0.75,1,0,2,-1,-1.5,1]),outputtrajobj=True,execute=False)
+
+            parameters=Planner.PlannerParameters()
+            parameters.SetRobotActiveJoints(robot)
+            parameters.SetExtraParameters('<_nmaxiterations>100</_nmaxiterations><_nrandomgeneratorseed>7</_nrandomgeneratorseed>')
+            def Shortcut(planner, numthreads, numcandidates=8):
+                planner.SendCommand('SetParallelShortcut %d %d'%(numcandidates,numthreads))
+                assert(planner.InitPlan(robot, parameters))
+                traj = RaveClone(origtraj, 0)
+                assert(planner.PlanPath(traj) == PlannerStatus.HasSolution)
+                planningutils.VerifyTrajectory(parameters,traj,samplingstep=0.002)
+                return traj
+
+            # the planner keeps the clones of its workers while the environment does not change
+            planner = RaveCreatePlanner(env, 'parabolicsmoother2')
+            traj = Shortcut(planner, 3)
+            data = traj.GetWaypoints(0, traj.GetNumWaypoints())
+
+            # shortcutting serially in a single thread gives a different path of about the same duration
+            serialtraj = Shortcut(RaveCreatePlanner(env, 'parabolicsmoother2'), 1, 0)
+            assert(traj.GetDuration() < 1.2*serialtraj.GetDuration())
+            for numthreads in [3, 1, 2]:
+                traj2 = Shortcut(planner, numthreads)
+                assert(all(traj2.GetWaypoints(0, traj2.GetNumWaypoints()) == data))
+                traj2 = Shortcut(RaveCreatePlanner(env, 'parabolicsmoother2'), numthreads)
+                assert(all(traj2.GetWaypoints(0, traj2.GetNumWaypoints()) == data))
+
+            # an obstacle next to the smoothed path makes the planner clone the environment again
+            with robot:
+                robot.SetActiveDOFValues(traj.Sample(0.5*traj.GetDuration(), robot.GetActiveConfigurationSpecification()))
+                pos = manip.GetTransform()[0:3,3]
+            box = RaveCreateKinBody(env, '')
+            box.InitFromBoxes(array([r_[pos,0.03,0.03,0.03]]), True)
+            box.SetName('shortcutbox')
+            env.Add(box)
+            traj = Shortcut(planner, 3)
+            traj2 = Shortcut(RaveCreatePlanner(env, 'parabolicsmoother2'), 1)
+            assert(all(traj2.GetWaypoints(0, traj2.GetNumWaypoints()) == traj.GetWaypoints(0, traj.GetNumWaypoints())))
+
+    def test_parallelshortcutmemo(self):
+        env=self.env
+        self.LoadEnv('data/lab1.env.xml')
+        robot=env.GetRobots()[0]
+        with env:
+            manipprob = interfaces.BaseManipulation(robot)
+            manip = robot.GetActiveManipulator()
+            robot.SetActiveDOFs(manip.GetArmIndices())
+            origtraj=manipprob.MoveManipulator(goal=array([-0.75,1,0,2,-1,-1.5,1]),outputtrajobj=True,execute=False)
+
+            # an obstacle next to the path makes many shortcuts fail and be slowed down, so that the workers
+            # check the same segments in a different order depending on the number of threads
+            with robot:
+                robot.SetActiveDOFValues(origtraj.Sample(0.5*origtraj.GetDuration(), robot.GetActiveConfigurationSpecification()))
+                pos = manip.GetTransform()[0:3,3]
+            box = RaveCreateKinBody(env, '')
+            box.InitFromBoxes(array([r_[pos+[0,0,0.1],0.03,0.03,0.03]]), True)
+            box.SetName('shortcutbox')
+            env.Add(box)
+
+            parameters=Planner.PlannerParameters()
+            parameters.SetRobotActiveJoints(robot)
+            for seed in [3, 11]:
+                parameters.SetExtraParameters('<_nmaxiterations>200</_nmaxiterations><_nrandomgeneratorseed>%d</_nrandomgeneratorseed>'%seed)
+                data = None
+                # the feasibility memo of every worker only reuses the results of the same checks, so the
+                # number of threads and the order of the checks do not change the result
+                for numthreads in [1, 4, 4, 2]:
+                    planner = RaveCreatePlanner(env, 'parabolicsmoother2')
+                    planner.SendCommand('SetParallelShortcut 8 %d'%numthreads)
+                    assert(planner.InitPlan(robot, parameters))
+                    traj = RaveClone(origtraj, 0)
+                    assert(planner.PlanPath(traj) == PlannerStatus.HasSolution)
+                    if data is None:
+                        planningutils.VerifyTrajectory(parameters,traj,samplingstep=0.002)
+                        data = traj.GetWaypoints(0, traj.GetNumWaypoints())
+                    else:
+                        assert(all(traj.GetWaypoints(0, traj.GetNumWaypoints()) == data))
+
 
     def test_segmenttraj2():
         env=self.env
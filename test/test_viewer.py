@@ -89,3 +89,46 @@ class TestViewer(EnvironmentSetup):
         time.sleep(4)
         print 'quitting'
         
+
+    def test_viewerrecorder(self):
+        env=self.env
+        self.LoadEnv('data/lab1.env.xml')
+        env.SetViewer('qtcoin',False)
+        viewer = env.GetViewer()
+        recorder = RaveCreateModule(env,'viewerrecorder')
+        if viewer is None or recorder is None:
+            raise nose.SkipTest('viewer or viewerrecorder plugin not available')
+        env.AddModule(recorder,'')
+        # each line is [video_codec id] [mime type] [format name]
+        codecs = [line.split() for line in recorder.SendCommand('GetCodecs').splitlines()]
+        codecids = [int(codec[0]) for codec in codecs if len(codec) > 0 and codec[-1] == 'mp4']
+        if len(codecids) == 0:
+            raise nose.SkipTest('mp4 format not available')
+        
+        body = env.GetBodies()[0]
+        T = body.GetTransform()
+        filename = 'test_viewerrecorder.mpg'
+        try:
+            # a small queue makes the viewer reuse and drop frames while the record thread encodes one of them
+            for droppolicy in ['oldest','newest']:
+                if os.path.exists(filename):
+                    os.remove(filename)
+                assert(recorder.SendCommand('Start 320 240 30 codec %d timing realtime maxqueue 2 droppolicy %s threads 2 filename %s\nviewer %s'%(codecids[0],droppolicy,filename,viewer.GetName())) is not None)
+                starttime = time.time()
+                while time.time()-starttime < 2:
+                    with env:
+                        T[0,3] = 0.5*sin(4*(time.time()-starttime))
+                        body.SetTransform(T)
+                    time.sleep(0.01)
+                stats = [float(f) for f in recorder.SendCommand('GetStatistics').split()]
+                # restart while the record thread is encoding
+                assert(recorder.SendCommand('Start 320 240 30 codec %d timing realtime maxqueue 2 droppolicy %s filename %s\nviewer %s'%(codecids[0],droppolicy,filename,viewer.GetName())) is not None)
+                time.sleep(0.5)
+                recorder.SendCommand('Stop')
+                assert(stats[0] > 0 and stats[2] > 0)
+                assert(stats[2] >= stats[3])
+                assert(os.path.exists(filename) and os.path.getsize(filename) > 0)
+        finally:
+            env.Remove(recorder)
+            if os.path.exists(filename):
+                os.remove(filename)